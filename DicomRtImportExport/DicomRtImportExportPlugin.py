@@ -21,6 +21,11 @@ class DicomRtImportExportPluginClass(DICOMPlugin):
     self.tags['RTPlanLabel'] = "300a,0002"
     self.tags['ReferencedSOPInstanceUID'] = "0008,1155"
 
+    # Loadables of the last examination, and the results of the loadables that have been
+    # loaded together with another one but not requested to be loaded yet (see load)
+    self.examinedLoadables = []
+    self.pendingLoadResults = []
+
   def examineForImport(self,fileLists):
     """ Returns a list of qSlicerDICOMLoadable
     instances corresponding to ways of interpreting the 
@@ -52,17 +57,55 @@ class DicomRtImportExportPluginClass(DICOMPlugin):
           qtLoadable.selected = True
           loadables.append(qtLoadable)
 
+    self.examinedLoadables = loadables
+    self.pendingLoadResults = []
     return loadables
   
   def load(self,loadable):
     """Load the selection as an RT object
-    using the DicomRtImportExport module
+    using the DicomRtImportExport module.
+    The DICOM browser loads the selected loadables one by one. When the first one of
+    the last examination is loaded, all the selected ones are loaded together (see
+    loadLoadables), and the stored result is returned when the others are requested
+    """
+    for pendingIndex in xrange(len(self.pendingLoadResults)):
+      pendingLoadable, pendingSuccess = self.pendingLoadResults[pendingIndex]
+      if pendingLoadable is loadable:
+        del self.pendingLoadResults[pendingIndex]
+        return pendingSuccess
+
+    if not [examinedLoadable for examinedLoadable in self.examinedLoadables if examinedLoadable is loadable]:
+      return self.loadLoadables([loadable])
+
+    loadables = [loadable]
+    for examinedLoadable in self.examinedLoadables:
+      if examinedLoadable.selected and examinedLoadable is not loadable:
+        loadables.append(examinedLoadable)
+    # Each loadable is loaded only once
+    self.examinedLoadables = []
+
+    loadSuccessfulFlags = vtk.vtkIntArray()
+    self.loadLoadables(loadables, loadSuccessfulFlags)
+    for loadableIndex in xrange(1,len(loadables)):
+      self.pendingLoadResults.append( (loadables[loadableIndex], loadSuccessfulFlags.GetValue(loadableIndex) == 1) )
+    return loadSuccessfulFlags.GetValue(0) == 1
+
+  def loadLoadables(self,loadables,loadSuccessfulFlags=None):
+    """Load multiple RT objects at once. The files are read and decoded
+    concurrently, and the nodes are created in the order of the loadables.
+    If loadSuccessfulFlags (vtkIntArray) is given then it is set to contain
+    the success flag of each loadable
     """
-    if len(loadable.files) > 1:
-      print('ERROR: RT objects must be contained by a single file!')
-    vtkLoadable = slicer.vtkSlicerDICOMLoadable()
-    loadable.copyToVtkLoadable(vtkLoadable)
-    success = slicer.modules.dicomrtimportexport.logic().LoadDicomRT(vtkLoadable)
+    vtkLoadables = vtk.vtkCollection()
+    for loadable in loadables:
+      if len(loadable.files) > 1:
+        print('ERROR: RT objects must be contained by a single file!')
+      vtkLoadable = slicer.vtkSlicerDICOMLoadable()
+      loadable.copyToVtkLoadable(vtkLoadable)
+      vtkLoadables.AddItem(vtkLoadable)
+    if loadSuccessfulFlags is None:
+      loadSuccessfulFlags = vtk.vtkIntArray()
+    success = slicer.modules.dicomrtimportexport.logic().LoadDicomRTLoadables(vtkLoadables, loadSuccessfulFlags)
     return success
 
   def examineForExport(self,node):
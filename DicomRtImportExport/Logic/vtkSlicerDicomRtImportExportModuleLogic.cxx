@@ -40,6 +40,7 @@
 // SlicerRT includes
 #include "SlicerRtCommon.h"
 #include "PlmCommon.h"
+#include "vtkImageBlockMinMax.h"
 #include "vtkMRMLBeamsNode.h"
 #include "vtkMRMLIsodoseNode.h"
 #include "vtkMRMLPlanarImageNode.h"
@@ -93,9 +94,15 @@
 #include <vtkPolyData.h>
 #include <vtkImageData.h>
 #include <vtkLookupTable.h>
+#include <vtkMatrix4x4.h>
 #include <vtkImageCast.h>
+#include <vtkGeneralTransform.h>
 #include <vtkStringArray.h>
+#include <vtkIntArray.h>
 #include <vtkObjectFactory.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtksys/SystemTools.hxx>
 
 // ITK includes
 #include <itkImage.h>
@@ -104,6 +111,126 @@
 #include "vtkSlicerDICOMLoadable.h"
 #include "vtkSlicerDICOMExportable.h"
 
+// STD includes
+#include <algorithm>
+#include <map>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Maximum length of the DICOM element values read when examining files. Longer values
+// (such as pixel data or contour data) are only read if accessed
+static const Uint32 EXAMINE_MAX_READ_LENGTH = 4096;
+
+//----------------------------------------------------------------------------
+class vtkSlicerDicomRtImportExportModuleLogic::vtkInternal
+{
+public:
+  /// Result of examining a file for loading
+  struct ExaminedFile
+  {
+    ExaminedFile() : ModifiedTime(0), FileSize(0), Loadable(false), IsRtDose(false) { };
+
+    /// Modification time of the file when it was examined
+    long ModifiedTime;
+    /// Size of the file when it was examined
+    unsigned long FileSize;
+    /// Flag indicating that the file contains a loadable RT object
+    bool Loadable;
+    /// Loadable name (without the referenced RT plan name for RT doses)
+    std::string Name;
+    /// Instance UIDs referenced by the RT object
+    std::vector<std::string> ReferencedSOPInstanceUIDs;
+    /// Flag indicating that the file is an RT dose (its name is completed with the referenced plan name)
+    bool IsRtDose;
+    /// Referenced RT plan instance UID for RT doses
+    std::string ReferencedRtPlanSOPInstanceUID;
+  };
+
+  /// Data shared by the threads examining files
+  struct ExamineFilesThreadData
+  {
+    ExamineFilesThreadData() : NextFileIndex(0) { };
+
+    std::vector<std::string> FileNames;
+    std::vector<ExaminedFile> ExaminedFiles;
+    /// Indices of files (in FileNames) that need to be examined
+    std::vector<int> FileIndicesToExamine;
+    /// Index in FileIndicesToExamine of the next file to examine
+    size_t NextFileIndex;
+    vtkSmartPointer<vtkMutexLock> Lock;
+  };
+
+  /// Examine a file for loading. Only reads the file header and the attributes needed for the
+  /// loadable, and does not access any shared state, so it can be called from multiple threads
+  /// \return True if the file contains a loadable RT object
+  static bool ExamineFile(const std::string& fileName, ExaminedFile& examinedFile);
+
+  /// Add referenced instance UID to examined file if not added yet
+  static void AddReferencedSOPInstanceUID(ExaminedFile& examinedFile, const OFString& uid);
+
+  /// Thread function examining files
+  static VTK_THREAD_RETURN_TYPE ExamineFilesThreadFunction(void* arg);
+
+  /// Data shared by the threads reading loadables
+  struct ReadLoadablesThreadData
+  {
+    ReadLoadablesThreadData() : NextReaderIndex(0) { };
+
+    std::vector< vtkSmartPointer<vtkSlicerDicomRtReader> > Readers;
+    /// Index in Readers of the next reader to update
+    size_t NextReaderIndex;
+    vtkSmartPointer<vtkMutexLock> Lock;
+  };
+
+  /// Thread function reading and decoding loadables. The readers do not access the scene
+  static VTK_THREAD_RETURN_TYPE ReadLoadablesThreadFunction(void* arg);
+
+  /// Segment to be exported as a structure
+  struct ExportedStructure
+  {
+    ExportedStructure() : BinaryLabelmap(NULL), ReferenceImage(NULL) { };
+
+    std::string SegmentID;
+    std::string Name;
+    double Color[3];
+    /// Binary labelmap representation of the segment. Only read
+    vtkOrientedImageData* BinaryLabelmap;
+    /// Parent transform of the segmentation. Own copy for each structure, NULL if not transformed
+    vtkSmartPointer<vtkGeneralTransform> ParentTransform;
+    /// Anatomical image defining the geometry of the exported structures. Only read
+    vtkOrientedImageData* ReferenceImage;
+    /// Structure labelmap in the anatomical image geometry, ready to be added to the writer
+    Plm_image::Pointer PlmStructure;
+    /// Error message if the structure could not be prepared
+    std::string ErrorMessage;
+  };
+
+  /// Data shared by the threads preparing structures for export
+  struct PrepareStructuresThreadData
+  {
+    PrepareStructuresThreadData() : Structures(NULL), NextStructureIndex(0), EndStructureIndex(0) { };
+
+    std::vector<ExportedStructure>* Structures;
+    /// Index of the next structure to prepare
+    size_t NextStructureIndex;
+    /// Index after the last structure to prepare in the current batch
+    size_t EndStructureIndex;
+    vtkSmartPointer<vtkMutexLock> Lock;
+  };
+
+  /// Transform and resample a segment labelmap to the anatomical image geometry and convert it to
+  /// Plastimatch image. Does not access the scene, so it can be called from multiple threads
+  /// \return Success flag, error message is set in the structure on failure
+  static bool PrepareStructure(ExportedStructure& structure);
+
+  /// Thread function preparing structures for export
+  static VTK_THREAD_RETURN_TYPE PrepareStructuresThreadFunction(void* arg);
+
+public:
+  /// Results of previous examinations, keyed by file name
+  std::map<std::string, ExaminedFile> ExaminedFileCache;
+};
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDicomRtImportExportModuleLogic);
 vtkCxxSetObjectMacro(vtkSlicerDicomRtImportExportModuleLogic, VolumesLogic, vtkSlicerVolumesLogic);
@@ -119,6 +246,8 @@ vtkSlicerDicomRtImportExportModuleLogic::vtkSlicerDicomRtImportExportModuleLogic
 
   this->BeamModelsInSeparateBranch = true;
   this->DefaultDoseColorTableNodeId = NULL;
+
+  this->Internal = new vtkInternal();
 }
 
 //----------------------------------------------------------------------------
@@ -128,6 +257,8 @@ vtkSlicerDicomRtImportExportModuleLogic::~vtkSlicerDicomRtImportExportModuleLogi
   this->SetIsodoseLogic(NULL);
   this->SetPlanarImageLogic(NULL);
   this->SetDefaultDoseColorTableNodeId(NULL);
+
+  delete this->Internal;
 }
 
 //----------------------------------------------------------------------------
@@ -157,308 +288,473 @@ void vtkSlicerDicomRtImportExportModuleLogic::OnMRMLSceneEndClose()
 }
 
 //---------------------------------------------------------------------------
-void vtkSlicerDicomRtImportExportModuleLogic::ExamineForLoad(vtkStringArray* fileList, vtkCollection* loadables)
+bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineFile(const std::string& fileName, ExaminedFile& examinedFile)
 {
-  if (!fileList || !loadables)
+  // Load file in DCMTK. Values longer than the maximum read length are only loaded when accessed,
+  // so bulk data (pixel data, contour data) is not read when examining the file
+  DcmFileFormat fileformat;
+  OFCondition result = fileformat.loadFile(fileName.c_str(), EXS_Unknown, EGL_noChange, EXAMINE_MAX_READ_LENGTH);
+  if (!result.good())
   {
-    return;
+    return false; // Failed to parse this file, skip it
   }
-  loadables->RemoveAllItems();
 
-  for (int fileIndex=0; fileIndex<fileList->GetNumberOfValues(); ++fileIndex)
+  // Check SOP Class UID for one of the supported RT objects
+  DcmDataset *dataset = fileformat.getDataset();
+  OFString sopClass;
+  if (!dataset->findAndGetOFString(DCM_SOPClassUID, sopClass).good() || sopClass.empty())
   {
-    // Load file in DCMTK
-    DcmFileFormat fileformat;
-    vtkStdString fileName = fileList->GetValue(fileIndex);
-    OFCondition result = fileformat.loadFile(fileName.c_str(), EXS_Unknown);
-    if (!result.good())
+    return false; // Failed to parse this file, skip it
+  }
+
+  // DICOM parsing is successful, now check if the object is loadable 
+  OFString name("");
+  OFString seriesNumber("");
+  dataset->findAndGetOFString(DCM_SeriesNumber, seriesNumber);
+  if (!seriesNumber.empty())
+  {
+    name += seriesNumber + ": ";
+  }
+
+  // RTDose
+  if (sopClass == UID_RTDoseStorage)
+  {
+    // Assemble name
+    name += "RTDOSE";
+    OFString instanceNumber;
+    dataset->findAndGetOFString(DCM_InstanceNumber, instanceNumber);
+    OFString seriesDescription;
+    dataset->findAndGetOFString(DCM_SeriesDescription, seriesDescription);
+    if (!seriesDescription.empty())
     {
-      continue; // Failed to parse this file, skip it
+      name += ": " + seriesDescription; 
     }
-
-    // Check SOP Class UID for one of the supported RT objects
-    DcmDataset *dataset = fileformat.getDataset();
-    OFString sopClass;
-    if (!dataset->findAndGetOFString(DCM_SOPClassUID, sopClass).good() || sopClass.empty())
+    if (!instanceNumber.empty())
     {
-      continue; // Failed to parse this file, skip it
+      name += " [" + instanceNumber + "]"; 
     }
 
-    // DICOM parsing is successful, now check if the object is loadable 
-    OFString name("");
-    OFString seriesNumber("");
-    std::vector<OFString> referencedSOPInstanceUIDs;
-    dataset->findAndGetOFString(DCM_SeriesNumber, seriesNumber);
-    if (!seriesNumber.empty())
+    // Find referenced RTPlan. Its name is added to the loadable name from the DICOM database
+    examinedFile.IsRtDose = true;
+    DcmItem* referencedRtPlanItem = NULL;
+    OFString referencedSOPInstanceUID("");
+    if ( dataset->findAndGetSequenceItem(DCM_ReferencedRTPlanSequence, referencedRtPlanItem, 0).good()
+      && referencedRtPlanItem->findAndGetOFString(DCM_ReferencedSOPInstanceUID, referencedSOPInstanceUID).good() )
     {
-      name += seriesNumber + ": ";
+      examinedFile.ReferencedRtPlanSOPInstanceUID = referencedSOPInstanceUID.c_str();
+      AddReferencedSOPInstanceUID(examinedFile, referencedSOPInstanceUID);
     }
-
-    // RTDose
-    if (sopClass == UID_RTDoseStorage)
+  }
+  // RTPlan
+  else if (sopClass == UID_RTPlanStorage)
+  {
+    // Assemble name
+    name += "RTPLAN";
+    OFString planLabel;
+    dataset->findAndGetOFString(DCM_RTPlanLabel, planLabel);
+    OFString planName;
+    dataset->findAndGetOFString(DCM_RTPlanName, planName);
+    if (!planLabel.empty() && !planName.empty())
     {
-      // Assemble name
-      name += "RTDOSE";
-      OFString instanceNumber;
-      dataset->findAndGetOFString(DCM_InstanceNumber, instanceNumber);
-      OFString seriesDescription;
-      dataset->findAndGetOFString(DCM_SeriesDescription, seriesDescription);
-      if (!seriesDescription.empty())
+      if (planLabel.compare(planName)!=0)
       {
-        name += ": " + seriesDescription; 
+        // Plan label and name is different, display both
+        name += ": " + planLabel + " (" + planName + ")";
       }
-      if (!instanceNumber.empty())
+      else
       {
-        name += " [" + instanceNumber + "]"; 
+        name += ": " + planLabel;
       }
+    }
+    else if (!planLabel.empty() && planName.empty())
+    {
+      name += ": " + planLabel;
+    }
+    else if (planLabel.empty() && !planName.empty())
+    {
+      name += ": " + planName;
+    }
+  }
+  // RTStructureSet
+  else if (sopClass == UID_RTStructureSetStorage)
+  {
+    // Assemble name
+    name += "RTSTRUCT";
+    OFString structLabel;
+    dataset->findAndGetOFString(DCM_StructureSetLabel, structLabel);
+    if (!structLabel.empty())
+    {
+      name += ": " + structLabel;
+    }
 
-      // Find RTPlan name for RTDose series
-      OFString referencedSOPInstanceUID("");
-      DRTDoseIOD rtDoseObject;
-      if (rtDoseObject.read(*dataset).good())
+    // Get referenced image instance UIDs. The dataset is traversed directly (instead of reading the
+    // whole structure set IOD), so that the contour data is never loaded
+    DcmItem* roiContourItem = NULL;
+    for (unsigned long roiIndex=0; dataset->findAndGetSequenceItem(DCM_ROIContourSequence, roiContourItem, roiIndex).good(); ++roiIndex)
+    {
+      DcmItem* contourItem = NULL;
+      for (unsigned long contourIndex=0; roiContourItem->findAndGetSequenceItem(DCM_ContourSequence, contourItem, contourIndex).good(); ++contourIndex)
       {
-        DRTReferencedRTPlanSequence &referencedRTPlanSequence = rtDoseObject.getReferencedRTPlanSequence();
-        if (referencedRTPlanSequence.gotoFirstItem().good())
+        DcmItem* contourImageItem = NULL;
+        OFString referencedSOPInstanceUID("");
+        if ( contourItem->findAndGetSequenceItem(DCM_ContourImageSequence, contourImageItem, 0).good()
+          && contourImageItem->findAndGetOFString(DCM_ReferencedSOPInstanceUID, referencedSOPInstanceUID).good() )
         {
-          DRTReferencedRTPlanSequence::Item &referencedRTPlanSequenceItem = referencedRTPlanSequence.getCurrentItem();
-          if (referencedRTPlanSequenceItem.isValid())
-          {
-            if (referencedRTPlanSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-            {
-              referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-            }
-          }
+          AddReferencedSOPInstanceUID(examinedFile, referencedSOPInstanceUID);
         }
       }
+    }
 
-      // Create and open DICOM database to perform database operations for getting RTPlan name
-      QSettings settings;
-      QString databaseDirectory = settings.value("DatabaseDirectory").toString();
-      QString databaseFile = databaseDirectory + vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_DATABASE_FILENAME.c_str();
-      ctkDICOMDatabase* dicomDatabase = new ctkDICOMDatabase();
-      dicomDatabase->openDatabase(databaseFile, vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
-
-      // Get RTPlan name to show it with the dose
-      QString rtPlanLabelTag("300a,0002");
-      QString rtPlanFileName = dicomDatabase->fileForInstance(referencedSOPInstanceUID.c_str());
-      if (!rtPlanFileName.isEmpty())
-      {
-        name += OFString(": ") + OFString(dicomDatabase->fileValue(rtPlanFileName,rtPlanLabelTag).toLatin1().constData());
-      }
-
-      // Close and delete DICOM database
-      dicomDatabase->closeDatabase();
-      delete dicomDatabase;
-      QSqlDatabase::removeDatabase(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
-      QSqlDatabase::removeDatabase(QString(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str()) + "TagCache");
-    }
-    // RTPlan
-    else if (sopClass == UID_RTPlanStorage)
-    {
-      // Assemble name
-      name += "RTPLAN";
-      OFString planLabel;
-      dataset->findAndGetOFString(DCM_RTPlanLabel, planLabel);
-      OFString planName;
-      dataset->findAndGetOFString(DCM_RTPlanName, planName);
-      if (!planLabel.empty() && !planName.empty())
+    // If the above tags do not store the referenced instance UIDs, then look at the other possible place
+    if (examinedFile.ReferencedSOPInstanceUIDs.empty())
+    {
+      DcmItem* referencedFrameOfReferenceItem = NULL;
+      DcmItem* referencedStudyItem = NULL;
+      DcmItem* referencedSeriesItem = NULL;
+      if ( dataset->findAndGetSequenceItem(DCM_ReferencedFrameOfReferenceSequence, referencedFrameOfReferenceItem, 0).good()
+        && referencedFrameOfReferenceItem->findAndGetSequenceItem(DCM_RTReferencedStudySequence, referencedStudyItem, 0).good()
+        && referencedStudyItem->findAndGetSequenceItem(DCM_RTReferencedSeriesSequence, referencedSeriesItem, 0).good() )
       {
-        if (planLabel.compare(planName)!=0)
+        DcmItem* contourImageItem = NULL;
+        for (unsigned long imageIndex=0; referencedSeriesItem->findAndGetSequenceItem(DCM_ContourImageSequence, contourImageItem, imageIndex).good(); ++imageIndex)
         {
-          // Plan label and name is different, display both
-          name += ": " + planLabel + " (" + planName + ")";
-        }
-        else
-        {
-          name += ": " + planLabel;
+          OFString referencedSOPInstanceUID("");
+          if (contourImageItem->findAndGetOFString(DCM_ReferencedSOPInstanceUID, referencedSOPInstanceUID).good())
+          {
+            AddReferencedSOPInstanceUID(examinedFile, referencedSOPInstanceUID);
+          }
         }
       }
-      else if (!planLabel.empty() && planName.empty())
-      {
-        name += ": " + planLabel;
-      }
-      else if (planLabel.empty() && !planName.empty())
-      {
-        name += ": " + planName;
-      }
+    } // End finding referenced instance UIDs
+  }
+  // RTImage
+  else if (sopClass == UID_RTImageStorage)
+  {
+    // Assemble name
+    name += "RTIMAGE";
+    OFString imageLabel;
+    dataset->findAndGetOFString(DCM_RTImageLabel, imageLabel);
+    if (!imageLabel.empty())
+    {
+      name += ": " + imageLabel;
     }
-    // RTStructureSet
-    else if (sopClass == UID_RTStructureSetStorage)
+
+    // Get referenced RTPlan
+    DcmItem* referencedRtPlanItem = NULL;
+    OFString referencedSOPInstanceUID("");
+    if ( dataset->findAndGetSequenceItem(DCM_ReferencedRTPlanSequence, referencedRtPlanItem, 0).good()
+      && referencedRtPlanItem->findAndGetOFString(DCM_ReferencedSOPInstanceUID, referencedSOPInstanceUID).good() )
     {
-      // Assemble name
-      name += "RTSTRUCT";
-      OFString structLabel;
-      dataset->findAndGetOFString(DCM_StructureSetLabel, structLabel);
-      if (!structLabel.empty())
-      {
-        name += ": " + structLabel;
-      }
+      AddReferencedSOPInstanceUID(examinedFile, referencedSOPInstanceUID);
+    }
+  }
+  /* Not yet supported
+  else if (sopClass == UID_RTTreatmentSummaryRecordStorage)
+  else if (sopClass == UID_RTIonPlanStorage)
+  else if (sopClass == UID_RTIonBeamsTreatmentRecordStorage)
+  */
+  else
+  {
+    return false; // Not an RT file
+  }
 
-      // Get referenced image instance UIDs
-      OFString referencedSOPInstanceUID("");
-      DRTStructureSetIOD rtStructureSetObject;
-      if (rtStructureSetObject.read(*dataset).good())
-      {
-        DRTROIContourSequence &rtROIContourSequenceObject = rtStructureSetObject.getROIContourSequence();
-        if (rtROIContourSequenceObject.gotoFirstItem().good())
-        {
-          do // For all ROIs
-          {
-            DRTROIContourSequence::Item &currentRoiObject = rtROIContourSequenceObject.getCurrentItem();
-            if (currentRoiObject.isValid())
-            {
-              DRTContourSequence &rtContourSequenceObject = currentRoiObject.getContourSequence();
-              if (rtContourSequenceObject.gotoFirstItem().good())
-              {
-                do // For all contours
-                {
-                  DRTContourSequence::Item &contourItem = rtContourSequenceObject.getCurrentItem();
-                  if (!contourItem.isValid())
-                  {
-                    DRTContourImageSequence &rtContourImageSequenceObject = contourItem.getContourImageSequence();
-                    if (rtContourImageSequenceObject.gotoFirstItem().good())
-                    {
-                      DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
-                      if (rtContourImageSequenceItem.isValid())
-                      {
-                        OFString referencedSOPInstanceUID("");
-                        if (rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-                        {
-                          referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-                        }
-                      }
-                    }
-                  }
-                } // For all contours
-                while (rtContourSequenceObject.gotoNextItem().good());
-              }
-            }
-          } // For all ROIs
-          while (rtROIContourSequenceObject.gotoNextItem().good());
-        } // End ROIContourSequence
-
-        // If the above tags do not store the referenced instance UIDs, then look at the other possible place
-        if (referencedSOPInstanceUIDs.empty())
-        {
-          DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject = rtStructureSetObject.getReferencedFrameOfReferenceSequence();
-          if (rtReferencedFrameOfReferenceSequenceObject.gotoFirstItem().good())
-          {
-            DRTReferencedFrameOfReferenceSequence::Item &currentReferencedFrameOfReferenceSequenceItem = rtReferencedFrameOfReferenceSequenceObject.getCurrentItem();
-            if (currentReferencedFrameOfReferenceSequenceItem.isValid())
-            {
-              DRTRTReferencedStudySequence &rtReferencedStudySequenceObject = currentReferencedFrameOfReferenceSequenceItem.getRTReferencedStudySequence();
-              if (rtReferencedStudySequenceObject.gotoFirstItem().good())
-              {
-                DRTRTReferencedStudySequence::Item &rtReferencedStudySequenceItem = rtReferencedStudySequenceObject.getCurrentItem();
-                if (rtReferencedStudySequenceItem.isValid())
-                {
-                  DRTRTReferencedSeriesSequence &rtReferencedSeriesSequenceObject = rtReferencedStudySequenceItem.getRTReferencedSeriesSequence();
-                  if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
-                  {
-                    if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
-                    {
-                      DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject.getCurrentItem();
-                      if (rtReferencedSeriesSequenceItem.isValid())
-                      {
-                        DRTContourImageSequence &rtContourImageSequenceObject = rtReferencedSeriesSequenceItem.getContourImageSequence();
-                        if (rtContourImageSequenceObject.gotoFirstItem().good())
-                        {
-                          do
-                          {
-                            DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
-                            if (rtContourImageSequenceItem.isValid())
-                            {
-                              OFString referencedSOPInstanceUID("");
-                              if (rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-                              {
-                                referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-                              }
-                            }
-                          } // For all contours
-                          while (rtContourImageSequenceObject.gotoNextItem().good());
-                        }
-                      }
-                    }
-                  }
-                }
-              }
-            }
-          }
-        } // End DRTReferencedFrameOfReferenceSequence
-      } // End finding referenced instance UIDs
+  examinedFile.Name = name.c_str();
+  examinedFile.Loadable = true;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::AddReferencedSOPInstanceUID(ExaminedFile& examinedFile, const OFString& uid)
+{
+  if (uid.empty())
+  {
+    return;
+  }
+  std::string uidString(uid.c_str());
+  if (std::find(examinedFile.ReferencedSOPInstanceUIDs.begin(), examinedFile.ReferencedSOPInstanceUIDs.end(), uidString) == examinedFile.ReferencedSOPInstanceUIDs.end())
+  {
+    examinedFile.ReferencedSOPInstanceUIDs.push_back(uidString);
+  }
+}
+
+//---------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineFilesThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  ExamineFilesThreadData* threadData = static_cast<ExamineFilesThreadData*>(threadInfo->UserData);
+
+  // Files are taken one by one, as examination time differs a lot between files
+  while (true)
+  {
+    threadData->Lock->Lock();
+    size_t fileIndex = threadData->NextFileIndex++;
+    threadData->Lock->Unlock();
+    if (fileIndex >= threadData->FileIndicesToExamine.size())
+    {
+      break;
+    }
+    int fileListIndex = threadData->FileIndicesToExamine[fileIndex];
+    try
+    {
+      ExamineFile(threadData->FileNames[fileListIndex], threadData->ExaminedFiles[fileListIndex]);
+    }
+    catch (...)
+    {
+      // Exceptions must not leave the thread, the file is considered not loadable
+      threadData->ExaminedFiles[fileListIndex].Loadable = false;
+    }
+  }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::ExamineForLoad(vtkStringArray* fileList, vtkCollection* loadables)
+{
+  if (!fileList || !loadables)
+  {
+    return;
+  }
+  loadables->RemoveAllItems();
+
+  // Look up files in the cache of previous examinations. Files are examined again if changed since
+  vtkInternal::ExamineFilesThreadData threadData;
+  int numberOfFiles = fileList->GetNumberOfValues();
+  threadData.FileNames.resize(numberOfFiles);
+  threadData.ExaminedFiles.resize(numberOfFiles);
+  for (int fileIndex=0; fileIndex<numberOfFiles; ++fileIndex)
+  {
+    std::string fileName = fileList->GetValue(fileIndex);
+    threadData.FileNames[fileIndex] = fileName;
+    long modifiedTime = vtksys::SystemTools::ModifiedTime(fileName.c_str());
+    unsigned long fileSize = vtksys::SystemTools::FileLength(fileName.c_str());
+
+    std::map<std::string, vtkInternal::ExaminedFile>::iterator cacheIt = this->Internal->ExaminedFileCache.find(fileName);
+    if ( cacheIt != this->Internal->ExaminedFileCache.end()
+      && cacheIt->second.ModifiedTime == modifiedTime && cacheIt->second.FileSize == fileSize )
+    {
+      threadData.ExaminedFiles[fileIndex] = cacheIt->second;
+      continue;
     }
-    // RTImage
-    else if (sopClass == UID_RTImageStorage)
+    threadData.ExaminedFiles[fileIndex].ModifiedTime = modifiedTime;
+    threadData.ExaminedFiles[fileIndex].FileSize = fileSize;
+    threadData.FileIndicesToExamine.push_back(fileIndex);
+  }
+
+  // Examine the new and changed files in parallel
+  if (!threadData.FileIndicesToExamine.empty())
+  {
+    threadData.Lock = vtkSmartPointer<vtkMutexLock>::New();
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads( std::min( vtkMultiThreader::GetGlobalDefaultNumberOfThreads(),
+      (int)threadData.FileIndicesToExamine.size() ) );
+    threader->SetSingleMethod(vtkInternal::ExamineFilesThreadFunction, &threadData);
+    threader->SingleMethodExecute();
+
+    for (std::vector<int>::iterator fileIndexIt = threadData.FileIndicesToExamine.begin(); fileIndexIt != threadData.FileIndicesToExamine.end(); ++fileIndexIt)
     {
-      // Assemble name
-      name += "RTIMAGE";
-      OFString imageLabel;
-      dataset->findAndGetOFString(DCM_RTImageLabel, imageLabel);
-      if (!imageLabel.empty())
+      this->Internal->ExaminedFileCache[threadData.FileNames[*fileIndexIt]] = threadData.ExaminedFiles[*fileIndexIt];
+    }
+  }
+
+  // Create loadables in the order of the input files
+  ctkDICOMDatabase* dicomDatabase = NULL;
+  for (int fileIndex=0; fileIndex<numberOfFiles; ++fileIndex)
+  {
+    vtkInternal::ExaminedFile& examinedFile = threadData.ExaminedFiles[fileIndex];
+    if (!examinedFile.Loadable)
+    {
+      continue;
+    }
+
+    std::string name = examinedFile.Name;
+    if (examinedFile.IsRtDose)
+    {
+      // Create and open DICOM database to perform database operations for getting RTPlan name.
+      // The database is opened once for all the examined files
+      if (!dicomDatabase)
       {
-        name += ": " + imageLabel;
+        QSettings settings;
+        QString databaseDirectory = settings.value("DatabaseDirectory").toString();
+        QString databaseFile = databaseDirectory + vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_DATABASE_FILENAME.c_str();
+        dicomDatabase = new ctkDICOMDatabase();
+        dicomDatabase->openDatabase(databaseFile, vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
       }
 
-      // Get referenced RTPlan
-      OFString referencedSOPInstanceUID("");
-      DRTImageIOD rtImageObject;
-      if (rtImageObject.read(*dataset).good())
+      // Get RTPlan name to show it with the dose
+      QString rtPlanLabelTag("300a,0002");
+      QString rtPlanFileName = dicomDatabase->fileForInstance(examinedFile.ReferencedRtPlanSOPInstanceUID.c_str());
+      if (!rtPlanFileName.isEmpty())
       {
-        DRTReferencedRTPlanSequenceInRTImageModule &rtReferencedRtPlanSequenceObject = rtImageObject.getReferencedRTPlanSequence();
-        if (rtReferencedRtPlanSequenceObject.gotoFirstItem().good())
-        {
-          DRTReferencedRTPlanSequenceInRTImageModule::Item &currentReferencedRtPlanSequenceObject = rtReferencedRtPlanSequenceObject.getCurrentItem();
-          if (currentReferencedRtPlanSequenceObject.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-          {
-            referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-          }
-        }
+        name += std::string(": ") + dicomDatabase->fileValue(rtPlanFileName,rtPlanLabelTag).toLatin1().constData();
       }
     }
-    /* Not yet supported
-    else if (sopClass == UID_RTTreatmentSummaryRecordStorage)
-    else if (sopClass == UID_RTIonPlanStorage)
-    else if (sopClass == UID_RTIonBeamsTreatmentRecordStorage)
-    */
-    else
-    {
-      continue; // Not an RT file
-    }
 
     // The file is a loadable RT object, create and set up loadable
     vtkSmartPointer<vtkSlicerDICOMLoadable> loadable = vtkSmartPointer<vtkSlicerDICOMLoadable>::New();
     loadable->SetName(name.c_str());
-    loadable->AddFile(fileName.c_str());
+    loadable->AddFile(threadData.FileNames[fileIndex].c_str());
     loadable->SetConfidence(1.0);
     loadable->SetSelected(true);
-    std::vector<OFString>::iterator uidIt;
-    for (uidIt = referencedSOPInstanceUIDs.begin(); uidIt != referencedSOPInstanceUIDs.end(); ++uidIt)
+    std::vector<std::string>::iterator uidIt;
+    for (uidIt = examinedFile.ReferencedSOPInstanceUIDs.begin(); uidIt != examinedFile.ReferencedSOPInstanceUIDs.end(); ++uidIt)
     {
       loadable->AddReferencedInstanceUID(uidIt->c_str());
     }
     loadables->AddItem(loadable);
   }
+
+  // Close and delete DICOM database
+  if (dicomDatabase)
+  {
+    dicomDatabase->closeDatabase();
+    delete dicomDatabase;
+    QSqlDatabase::removeDatabase(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
+    QSqlDatabase::removeDatabase(QString(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str()) + "TagCache");
+  }
 }
 
 //---------------------------------------------------------------------------
-bool vtkSlicerDicomRtImportExportModuleLogic::LoadDicomRT(vtkSlicerDICOMLoadable* loadable)
+VTK_THREAD_RETURN_TYPE vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ReadLoadablesThreadFunction(void* arg)
 {
-  bool loadSuccessful = false;
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  ReadLoadablesThreadData* threadData = static_cast<ReadLoadablesThreadData*>(threadInfo->UserData);
 
+  // Loadables are taken one by one, as reading time differs a lot between RT objects
+  while (true)
+  {
+    threadData->Lock->Lock();
+    size_t readerIndex = threadData->NextReaderIndex++;
+    threadData->Lock->Unlock();
+    if (readerIndex >= threadData->Readers.size())
+    {
+      break;
+    }
+    vtkSlicerDicomRtReader* rtReader = threadData->Readers[readerIndex];
+    if (!rtReader)
+    {
+      continue;
+    }
+    try
+    {
+      rtReader->Update();
+    }
+    catch (...)
+    {
+      // Exceptions must not leave the thread, none of the load successful flags of the reader are set then
+    }
+  }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDicomRtImportExportModuleLogic::SetupReaderForLoadable(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable)
+{
   if (!loadable || loadable->GetFiles()->GetNumberOfValues() < 1 || loadable->GetConfidence() == 0.0)
   {
     vtkErrorMacro("LoadDicomRT: Unable to load DICOM-RT data due to invalid loadable information!");
-    return loadSuccessful;
+    return false;
   }
 
   const char* firstFileName = loadable->GetFiles()->GetValue(0);
 
   std::cout << "Loading series '" << loadable->GetName() << "' from file '" << firstFileName << "'" << std::endl;
 
-  vtkSmartPointer<vtkSlicerDicomRtReader> rtReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
   rtReader->SetFileName(firstFileName);
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDicomRtImportExportModuleLogic::LoadDicomRT(vtkSlicerDICOMLoadable* loadable)
+{
+  vtkSmartPointer<vtkSlicerDicomRtReader> rtReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
+  if (!this->SetupReaderForLoadable(rtReader, loadable))
+  {
+    return false;
+  }
+
   rtReader->Update();
 
+  return this->AddDicomRTToScene(rtReader, loadable);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDicomRtImportExportModuleLogic::LoadDicomRTLoadables(vtkCollection* loadables, vtkIntArray* loadSuccessfulFlags/*=NULL*/)
+{
+  if (loadSuccessfulFlags)
+  {
+    loadSuccessfulFlags->Initialize();
+  }
+  if (!loadables)
+  {
+    vtkErrorMacro("LoadDicomRTLoadables: Invalid loadables collection!");
+    return false;
+  }
+
+  // Create readers for all loadables. Readers are NULL for invalid loadables
+  vtkInternal::ReadLoadablesThreadData threadData;
+  std::vector<vtkSlicerDICOMLoadable*> rtLoadables;
+  for (int loadableIndex=0; loadableIndex<loadables->GetNumberOfItems(); ++loadableIndex)
+  {
+    vtkSlicerDICOMLoadable* loadable = vtkSlicerDICOMLoadable::SafeDownCast(loadables->GetItemAsObject(loadableIndex));
+    vtkSmartPointer<vtkSlicerDicomRtReader> rtReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
+    if (!this->SetupReaderForLoadable(rtReader, loadable))
+    {
+      rtReader = NULL;
+    }
+    rtLoadables.push_back(loadable);
+    threadData.Readers.push_back(rtReader);
+  }
+  if (rtLoadables.empty())
+  {
+    return true;
+  }
+
+  // Read and decode the files concurrently. Readers only parse their own file and do not access the scene.
+  // The readers decode the structure sets in parallel too, so the threads are split between the two levels
+  int numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  int numberOfReaderThreads = std::min(numberOfThreads, (int)threadData.Readers.size());
+  int numberOfThreadsPerReader = std::max(1, numberOfThreads / numberOfReaderThreads);
+  for (size_t readerIndex=0; readerIndex<threadData.Readers.size(); ++readerIndex)
+  {
+    if (threadData.Readers[readerIndex])
+    {
+      threadData.Readers[readerIndex]->SetNumberOfThreads(numberOfThreadsPerReader);
+    }
+  }
+  threadData.Lock = vtkSmartPointer<vtkMutexLock>::New();
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(numberOfReaderThreads);
+  threader->SetSingleMethod(vtkInternal::ReadLoadablesThreadFunction, &threadData);
+  threader->SingleMethodExecute();
+
+  // Node creation and subject hierarchy insertion is done serially in the original order
+  bool loadSuccessful = true;
+  for (size_t loadableIndex=0; loadableIndex<rtLoadables.size(); ++loadableIndex)
+  {
+    bool loadableLoadSuccessful = ( threadData.Readers[loadableIndex]
+      && this->AddDicomRTToScene(threadData.Readers[loadableIndex], rtLoadables[loadableIndex]) );
+    if (!loadableLoadSuccessful)
+    {
+      loadSuccessful = false;
+    }
+    if (loadSuccessfulFlags)
+    {
+      loadSuccessfulFlags->InsertNextValue(loadableLoadSuccessful ? 1 : 0);
+    }
+    // Release decoded data as soon as it is in the scene
+    threadData.Readers[loadableIndex] = NULL;
+  }
+
+  return loadSuccessful;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDicomRtImportExportModuleLogic::AddDicomRTToScene(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable)
+{
+  bool loadSuccessful = false;
+
   // One series can contain composite information, e.g, an RTPLAN series can contain structure sets and plans as well
   // TODO: vtkSlicerDicomRtReader class does not support this yet
 
@@ -676,56 +972,65 @@ bool vtkSlicerDicomRtImportExportModuleLogic::LoadRtDose(vtkSlicerDicomRtReader*
   const char* fileName = loadable->GetFiles()->GetValue(0);
   const char* seriesName = loadable->GetName();
 
-  // Load Volume
-  vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode> volumeStorageNode = vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode>::New();
   vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-  volumeStorageNode->SetFileName(fileName);
-  volumeStorageNode->ResetFileNameList();
-  volumeStorageNode->SetSingleFile(1);
-
-  // Read volume from disk
-  if (!volumeStorageNode->ReadData(volumeNode))
+  vtkSmartPointer<vtkImageData> floatVolumeData = rtReader->GetDoseImageData();
+  if (floatVolumeData)
   {
-    vtkErrorMacro("LoadRtDose: Failed to load dose volume file '" << fileName << "' (series name '" << seriesName << "')");
-    return false;
+    // Use the dose grid decoded and scaled by the reader when parsing the dataset
+    vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    rtReader->GetDoseIJKToRASMatrix(doseIjkToRasMatrix);
+    volumeNode->SetIJKToRASMatrix(doseIjkToRasMatrix);
+  }
+  else
+  {
+    // Fall back to reading the volume from disk if the reader could not decode the pixel data
+    vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode> volumeStorageNode = vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode>::New();
+    volumeStorageNode->SetFileName(fileName);
+    volumeStorageNode->ResetFileNameList();
+    volumeStorageNode->SetSingleFile(1);
+    if (!volumeStorageNode->ReadData(volumeNode))
+    {
+      vtkErrorMacro("LoadRtDose: Failed to load dose volume file '" << fileName << "' (series name '" << seriesName << "')");
+      return false;
+    }
+
+    // Set new spacing
+    double* initialSpacing = volumeNode->GetSpacing();
+    double* correctSpacing = rtReader->GetPixelSpacing();
+    volumeNode->SetSpacing(correctSpacing[0], correctSpacing[1], initialSpacing[2]);
+
+    // Apply dose grid scaling
+    std::stringstream ss;
+    ss << rtReader->GetDoseGridScaling();
+    double doseGridScaling = 0.0;
+    ss >> doseGridScaling;
+
+    vtkSmartPointer<vtkImageCast> imageCast = vtkSmartPointer<vtkImageCast>::New();
+    imageCast->SetInputData(volumeNode->GetImageData());
+    imageCast->SetOutputScalarTypeToFloat();
+    imageCast->Update();
+    floatVolumeData = vtkSmartPointer<vtkImageData>::New();
+    floatVolumeData->ShallowCopy(imageCast->GetOutput());
+
+    float* floatPtr = (float*)floatVolumeData->GetScalarPointer();
+    vtkIdType numberOfPoints = floatVolumeData->GetNumberOfPoints();
+    for (vtkIdType i=0; i<numberOfPoints; ++i)
+    {
+      floatPtr[i] = static_cast<float>(floatPtr[i] * doseGridScaling);
+    }
   }
 
   volumeNode->SetScene(this->GetMRMLScene());
   std::string volumeNodeName = this->GetMRMLScene()->GenerateUniqueName(seriesName);
   volumeNode->SetName(volumeNodeName.c_str());
   this->GetMRMLScene()->AddNode(volumeNode);
-
-  // Set new spacing
-  double* initialSpacing = volumeNode->GetSpacing();
-  double* correctSpacing = rtReader->GetPixelSpacing();
-  volumeNode->SetSpacing(correctSpacing[0], correctSpacing[1], initialSpacing[2]);
   volumeNode->SetAttribute(SlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
 
-  // Apply dose grid scaling
-  vtkSmartPointer<vtkImageData> floatVolumeData = vtkSmartPointer<vtkImageData>::New();
+  volumeNode->SetAndObserveImageData(floatVolumeData);
 
-  vtkSmartPointer<vtkImageCast> imageCast = vtkSmartPointer<vtkImageCast>::New();
-  imageCast->SetInputData(volumeNode->GetImageData());
-  imageCast->SetOutputScalarTypeToFloat();
-  imageCast->Update();
-  floatVolumeData->DeepCopy(imageCast->GetOutput());
-
-  std::stringstream ss;
-  ss << rtReader->GetDoseGridScaling();
-  double doubleValue;
-  ss >> doubleValue;
-  double doseGridScaling = doubleValue;
-
-  float value = 0.0;
-  float* floatPtr = (float*)floatVolumeData->GetScalarPointer();
-  for (long i=0; i<floatVolumeData->GetNumberOfPoints(); ++i)
-  {
-    value = (*floatPtr) * doseGridScaling;
-    (*floatPtr) = value;
-    ++floatPtr;
-  }
-
-  volumeNode->SetAndObserveImageData(floatVolumeData);      
+  // Build block min/max index of the dose once on load. It is attached to the image data and is used
+  // by the algorithms looking for dose ranges (isodose, DVH, gamma) until the dose is modified
+  vtkImageBlockMinMax::GetBlockMinMaxForImage(floatVolumeData);
 
   // Create dose color table from default isodose color table
   if (!this->DefaultDoseColorTableNodeId)
@@ -1662,6 +1967,71 @@ void vtkSlicerDicomRtImportExportModuleLogic::SetupRtImageGeometry(vtkMRMLNode*
   displayedModelNode->SetDisplayVisibility(0);
 }
 
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::PrepareStructure(ExportedStructure& structure)
+{
+  // Copy labelmap image data as it will be probably transformed and resampled
+  vtkSmartPointer<vtkOrientedImageData> binaryLabelmapCopy = vtkSmartPointer<vtkOrientedImageData>::New();
+  binaryLabelmapCopy->DeepCopy(structure.BinaryLabelmap);
+
+  // Apply parent transformation if necessary
+  if (structure.ParentTransform)
+  {
+    vtkOrientedImageDataResample::TransformOrientedImage(binaryLabelmapCopy, structure.ParentTransform);
+  }
+  // Make sure the labelmap dimensions match the reference dimensions
+  if ( !vtkOrientedImageDataResample::DoGeometriesMatch(structure.ReferenceImage, binaryLabelmapCopy)
+    || !vtkOrientedImageDataResample::DoExtentsMatch(structure.ReferenceImage, binaryLabelmapCopy) )
+  {
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(binaryLabelmapCopy, structure.ReferenceImage, binaryLabelmapCopy))
+    {
+      structure.ErrorMessage = "Failed to resample segment " + structure.SegmentID + " to match anatomical image geometry";
+      return false;
+    }
+  }
+
+  // Convert mask to Plm image
+  structure.PlmStructure = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(binaryLabelmapCopy);
+  if (!structure.PlmStructure)
+  {
+    structure.ErrorMessage = "Failed to convert segment labelmap " + structure.SegmentID + " to Plastimatch image";
+    return false;
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::PrepareStructuresThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  PrepareStructuresThreadData* threadData = static_cast<PrepareStructuresThreadData*>(threadInfo->UserData);
+
+  while (true)
+  {
+    threadData->Lock->Lock();
+    size_t structureIndex = threadData->NextStructureIndex++;
+    threadData->Lock->Unlock();
+    if (structureIndex >= threadData->EndStructureIndex)
+    {
+      break;
+    }
+    ExportedStructure& structure = (*threadData->Structures)[structureIndex];
+    try
+    {
+      PrepareStructure(structure);
+    }
+    catch (...)
+    {
+      // Exceptions must not leave the thread
+      structure.PlmStructure.reset();
+      structure.ErrorMessage = "Failed to prepare segment " + structure.SegmentID + " for export";
+    }
+  }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
 //----------------------------------------------------------------------------
 std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkCollection* exportables)
 {
@@ -1779,76 +2149,92 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
       return error;
     }
 
-    // Export each segment in segmentation
+    // Get parent transform once, the structures are transformed with their own copies of it
+    vtkSmartPointer<vtkGeneralTransform> segmentationToWorldTransform;
+    if (segmentationNode->GetParentTransformNode())
+    {
+      segmentationToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+      segmentationNode->GetParentTransformNode()->GetTransformToWorld(segmentationToWorldTransform);
+    }
+
+    // Collect segments and their properties from the scene
+    vtkMRMLSegmentationDisplayNode* segmentationDisplayNode = vtkMRMLSegmentationDisplayNode::SafeDownCast(
+      segmentationNode->GetDisplayNode() );
+    std::vector<vtkInternal::ExportedStructure> structures;
     vtkSegmentation::SegmentMap segmentMap = segmentationNode->GetSegmentation()->GetSegments();
     for (vtkSegmentation::SegmentMap::iterator segmentIt = segmentMap.begin(); segmentIt != segmentMap.end(); ++segmentIt)
     {
       std::string segmentID = segmentIt->first;
       vtkSegment* segment = segmentIt->second;
 
+      vtkInternal::ExportedStructure structure;
+      structure.SegmentID = segmentID;
+      structure.ReferenceImage = imageData;
+
       // Get binary labelmap representation
-      vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(
+      structure.BinaryLabelmap = vtkOrientedImageData::SafeDownCast(
         segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
-      if (!binaryLabelmap)
+      if (!structure.BinaryLabelmap)
       {
         error = "Failed to get binary labelmap representation from segment " + segmentID;
         vtkErrorMacro("ExportDicomRTStudy: " + error);
         return error;
       }
-      // Temporarily copy labelmap image data as it will be probably resampled
-      vtkSmartPointer<vtkOrientedImageData> binaryLabelmapCopy = vtkSmartPointer<vtkOrientedImageData>::New();
-      binaryLabelmapCopy->DeepCopy(binaryLabelmap);
-
-      // Apply parent transformation nodes if necessary
-      if (segmentationNode->GetParentTransformNode())
+      if (segmentationToWorldTransform)
       {
-        if (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(segmentationNode, binaryLabelmapCopy))
-        {
-          std::string errorMessage("Failed to apply parent transformation to exported segment!");
-          vtkErrorMacro("ExportDicomRTStudy: " << errorMessage);
-          return errorMessage;
-        }
+        structure.ParentTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+        structure.ParentTransform->DeepCopy(segmentationToWorldTransform);
       }
-      // Make sure the labelmap dimensions match the reference dimensions
-      if ( !vtkOrientedImageDataResample::DoGeometriesMatch(imageData, binaryLabelmapCopy)
-        || !vtkOrientedImageDataResample::DoExtentsMatch(imageData, binaryLabelmapCopy) )
+
+      // Get segment properties
+      structure.Name = segment->GetName();
+      structure.Color[0] = structure.Color[1] = structure.Color[2] = 0.5;
+      segment->GetDefaultColor(structure.Color);
+      if (segmentationDisplayNode)
       {
-        if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(binaryLabelmapCopy, imageData, binaryLabelmapCopy))
+        vtkMRMLSegmentationDisplayNode::SegmentDisplayProperties properties;
+        if (segmentationDisplayNode->GetSegmentDisplayProperties(segmentID, properties))
         {
-          error = "Failed to resample segment " + segmentID + " to match anatomical image geometry";
-          vtkErrorMacro("ExportDicomRTStudy: " + error);
-          return error;
+          structure.Color[0] = properties.Color[0];
+          structure.Color[1] = properties.Color[1];
+          structure.Color[2] = properties.Color[2];
         }
       }
 
-      // Convert mask to Plm image
-      Plm_image::Pointer plmStructure = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(binaryLabelmapCopy);
-      if (!plmStructure)
-      {
-        error = "Failed to convert segment labelmap " + segmentID + " to Plastimatch image";
-        vtkErrorMacro("ExportDicomRTStudy: " + error);
-        return error;
-      }
+      structures.push_back(structure);
+    }
 
-      // Get segment properties
-      std::string segmentName = segment->GetName();
+    // Prepare structures in parallel, in batches of one structure per thread, and add each batch to the writer
+    // in segment order before preparing the next one. This way only a few structure labelmaps exist at a time
+    // (the writer stores the added structures in its own compact labelmap).
+    vtkInternal::PrepareStructuresThreadData threadData;
+    threadData.Structures = &structures;
+    threadData.Lock = vtkSmartPointer<vtkMutexLock>::New();
+    int numberOfThreads = std::max(1, std::min( vtkMultiThreader::GetGlobalDefaultNumberOfThreads(), (int)structures.size() ));
+    for (size_t batchStartIndex=0; batchStartIndex<structures.size(); batchStartIndex += numberOfThreads)
+    {
+      threadData.NextStructureIndex = batchStartIndex;
+      threadData.EndStructureIndex = std::min(batchStartIndex + numberOfThreads, structures.size());
 
-      double segmentColor[3] = {0.5,0.5,0.5};
-      segment->GetDefaultColor(segmentColor);
-      vtkMRMLSegmentationDisplayNode* segmentationDisplayNode = vtkMRMLSegmentationDisplayNode::SafeDownCast(
-        segmentationNode->GetDisplayNode() );
-      if (segmentationDisplayNode)
+      vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+      threader->SetNumberOfThreads( (int)(threadData.EndStructureIndex - batchStartIndex) );
+      threader->SetSingleMethod(vtkInternal::PrepareStructuresThreadFunction, &threadData);
+      threader->SingleMethodExecute();
+
+      for (size_t structureIndex=batchStartIndex; structureIndex<threadData.EndStructureIndex; ++structureIndex)
       {
-        vtkMRMLSegmentationDisplayNode::SegmentDisplayProperties properties;
-        if (segmentationDisplayNode->GetSegmentDisplayProperties(segmentID, properties))
+        vtkInternal::ExportedStructure& structure = structures[structureIndex];
+        if (!structure.PlmStructure)
         {
-          segmentColor[0] = properties.Color[0];
-          segmentColor[1] = properties.Color[1];
-          segmentColor[2] = properties.Color[2];
+          error = structure.ErrorMessage;
+          vtkErrorMacro("ExportDicomRTStudy: " + error);
+          return error;
         }
-      }
+        rtWriter->AddStructure(structure.PlmStructure->itk_uchar(), structure.Name.c_str(), structure.Color);
 
-      rtWriter->AddStructure(plmStructure->itk_uchar(), segmentName.c_str(), segmentColor);
+        // Release structure labelmap as soon as it is added
+        structure.PlmStructure.reset();
+      }
     }
   }
 
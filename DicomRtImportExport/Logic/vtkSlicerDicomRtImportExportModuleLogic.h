@@ -47,6 +47,7 @@ class vtkStringArray;
 class vtkPolyData;
 class vtkSlicerDicomRtReader;
 class vtkCollection;
+class vtkIntArray;
 
 /// \ingroup SlicerRt_QtModules_DicomRtImport
 class VTK_SLICER_DICOMRTIMPORTEXPORT_LOGIC_EXPORT vtkSlicerDicomRtImportExportModuleLogic :
@@ -57,7 +58,9 @@ public:
   vtkTypeMacro(vtkSlicerDicomRtImportExportModuleLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent);
 
-  /// Examine a list of file lists and determine what objects can be loaded from them
+  /// Examine a list of file lists and determine what objects can be loaded from them.
+  /// Only the attributes needed for the loadables are read (no bulk data), the files are examined
+  /// in parallel, and the results are reused for files that have not changed since their last examination.
   /// \param fileList List of files to examine and generate loadables from
   /// \param loadables Collection to store generated (output) loadables
   void ExamineForLoad(vtkStringArray* fileList, vtkCollection* loadables);
@@ -66,6 +69,13 @@ public:
   /// /return True if loading successful
   bool LoadDicomRT(vtkSlicerDICOMLoadable* loadable);
 
+  /// Load multiple DICOM RT series. The files are read and decoded concurrently, then the
+  /// nodes are added to the scene on the calling thread in the order of the loadables
+  /// \param loadables Collection of loadables (vtkSlicerDICOMLoadable) to load
+  /// \param loadSuccessfulFlags Optional output array, set to contain 1 for each loadable that was loaded successfully and 0 for the others
+  /// \return True if all loadables were loaded successfully
+  bool LoadDicomRTLoadables(vtkCollection* loadables, vtkIntArray* loadSuccessfulFlags=NULL);
+
   /// Set Volumes module logic
   void SetVolumesLogic(vtkSlicerVolumesLogic* volumesLogic);
 
@@ -99,6 +109,14 @@ protected:
   virtual void OnMRMLSceneEndClose();
 
 protected:
+  /// Set up reader to read the file of a loadable
+  /// \return False if the loadable is invalid
+  bool SetupReaderForLoadable(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable);
+
+  /// Add the RT objects read by the reader into the MRML scene
+  /// \return Success flag
+  bool AddDicomRTToScene(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable);
+
   /// Load RT Structure Set and related objects into the MRML scene
   /// \return Success flag
   bool LoadRtStructureSet(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable);
@@ -150,6 +168,9 @@ private:
 
   /// Default dose color table ID. Loaded on Slicer startup.
   char* DefaultDoseColorTableNodeId;
+
+  class vtkInternal;
+  vtkInternal* Internal;
 };
 
 #endif
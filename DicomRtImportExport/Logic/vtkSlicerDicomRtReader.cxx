@@ -29,13 +29,20 @@
 
 // VTK includes
 #include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
 #include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
 #include <vtkObjectFactory.h>
 #include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
 
 // STD includes
+#include <algorithm>
+#include <set>
 #include <vector>
 
 // DCMTK includes
@@ -64,6 +71,261 @@
 // CTK includes
 #include <ctkDICOMDatabase.h>
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Relative tolerance for deciding if the frames of a dose grid are equally spaced
+  const double DOSE_GRID_FRAME_SPACING_TOLERANCE = 0.01;
+
+  /// Convert stored dose grid values to dose in a single pass.
+  /// Kept as a plain loop over contiguous arrays so that the compiler can vectorize it.
+  template <class T>
+  void ScaleDoseGridToFloat(const T* storedValues, float* doseValues, vtkIdType numberOfValues, double doseGridScaling)
+  {
+    for (vtkIdType i=0; i<numberOfValues; ++i)
+    {
+      doseValues[i] = static_cast<float>(storedValues[i] * doseGridScaling);
+    }
+  }
+
+  /// Convert 32-bit stored dose grid values to dose in a single pass.
+  /// The words of the pixel data are already in local byte order, the least significant word of each value comes first.
+  template <class T>
+  void ScaleDoseGrid32ToFloat(const Uint16* storedWords, float* doseValues, vtkIdType numberOfValues, double doseGridScaling)
+  {
+    for (vtkIdType i=0; i<numberOfValues; ++i)
+    {
+      Uint32 storedValue = static_cast<Uint32>(storedWords[2*i]) | (static_cast<Uint32>(storedWords[2*i+1]) << 16);
+      doseValues[i] = static_cast<float>(static_cast<T>(storedValue) * doseGridScaling);
+    }
+  }
+
+  /// Contours of one ROI decoded from its item in the ROI contour sequence of a structure set
+  struct RoiContourDecodingTask
+  {
+    RoiContourDecodingTask() : RoiContourItem(NULL), MultipleReferencedInstances(false) { };
+
+    /// ROI contour sequence item. Only accessed by the thread decoding the ROI
+    DcmItem* RoiContourItem;
+    /// Decoded contour points in RAS. NULL if the ROI has no contours
+    vtkSmartPointer<vtkPoints> Points;
+    /// One closed polyline (or vertex) cell per contour
+    vtkSmartPointer<vtkCellArray> Cells;
+    /// Referenced slice instance UID for each contour (cell) index
+    std::map<int, std::string> ContourIndexToSOPInstanceUIDMap;
+    /// All slice instance UIDs referenced by the contours
+    std::set<std::string> ReferencedSOPInstanceUIDs;
+    /// Flag indicating that a contour references multiple instances, which is not yet supported
+    bool MultipleReferencedInstances;
+  };
+
+  /// Data shared by the threads decoding ROI contours
+  struct RoiContourDecodingThreadData
+  {
+    RoiContourDecodingThreadData() : NextTaskIndex(0) { };
+
+    std::vector<RoiContourDecodingTask> Tasks;
+    /// Index of the next ROI to decode
+    size_t NextTaskIndex;
+    vtkSmartPointer<vtkMutexLock> Lock;
+  };
+
+  /// Parse the backslash separated values of a Contour Data string into a point buffer, converting from
+  /// DICOM LPS to Slicer RAS on the fly. Values are parsed in place, without creating intermediate containers.
+  /// \return Number of values parsed
+  unsigned long ParseContourData(const char* contourDataString, float* pointBuffer, unsigned long maximumNumberOfValues)
+  {
+    unsigned long valueIndex = 0;
+    const char* valueStart = contourDataString;
+    while (valueStart && valueIndex < maximumNumberOfValues)
+    {
+      OFBool success = OFFalse;
+      double value = OFStandard::atof(valueStart, &success);
+      if (!success)
+      {
+        break;
+      }
+      pointBuffer[valueIndex] = static_cast<float>(valueIndex % 3 == 2 ? value : -value);
+      ++valueIndex;
+
+      valueStart = strchr(valueStart, '\\');
+      if (valueStart)
+      {
+        ++valueStart;
+      }
+    }
+    return valueIndex;
+  }
+
+  /// Decode all contours of a ROI into a single preallocated point buffer and cell array
+  void DecodeRoiContours(RoiContourDecodingTask& task)
+  {
+    DcmSequenceOfItems* contourSequence = NULL;
+    if ( task.RoiContourItem->findAndGetSequence(DCM_ContourSequence, contourSequence).bad()
+      || contourSequence == NULL || contourSequence->card() == 0 )
+    {
+      return;
+    }
+
+    // Collect contours and count points first, so that the buffers can be allocated at once
+    std::vector<DcmItem*> contourItems;
+    std::vector<const char*> contourDataStrings;
+    std::vector<vtkIdType> contourNumberOfPoints;
+    contourItems.reserve(contourSequence->card());
+    contourDataStrings.reserve(contourSequence->card());
+    contourNumberOfPoints.reserve(contourSequence->card());
+    vtkIdType totalNumberOfPoints = 0;
+    for (DcmObject* contourObject = contourSequence->nextInContainer(NULL); contourObject; contourObject = contourSequence->nextInContainer(contourObject))
+    {
+      DcmItem* contourItem = dynamic_cast<DcmItem*>(contourObject);
+      DcmElement* contourDataElement = NULL;
+      char* contourDataString = NULL;
+      if ( !contourItem || contourItem->findAndGetElement(DCM_ContourData, contourDataElement).bad()
+        || contourDataElement->getString(contourDataString).bad() || contourDataString == NULL )
+      {
+        continue;
+      }
+
+      // Number of contour points cannot exceed the number of coordinates in the contour data
+      vtkIdType numberOfPointsInData = contourDataElement->getVM() / 3;
+      Sint32 numberOfPoints = 0;
+      if (contourItem->findAndGetSint32(DCM_NumberOfContourPoints, numberOfPoints).bad() || numberOfPoints <= 0)
+      {
+        numberOfPoints = numberOfPointsInData;
+      }
+      vtkIdType numberOfPointsToRead = std::min(static_cast<vtkIdType>(numberOfPoints), numberOfPointsInData);
+      if (numberOfPointsToRead == 0)
+      {
+        continue;
+      }
+
+      contourItems.push_back(contourItem);
+      contourDataStrings.push_back(contourDataString);
+      contourNumberOfPoints.push_back(numberOfPointsToRead);
+      totalNumberOfPoints += numberOfPointsToRead;
+    }
+    if (contourItems.empty())
+    {
+      return;
+    }
+
+    // Each cell contains its size, its points, and the first point again to close the contour
+    vtkIdType numberOfContours = static_cast<vtkIdType>(contourItems.size());
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetDataTypeToFloat();
+    points->SetNumberOfPoints(totalNumberOfPoints);
+    float* pointBuffer = static_cast<float*>(points->GetVoidPointer(0));
+    vtkSmartPointer<vtkIdTypeArray> cellConnectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+    cellConnectivity->SetNumberOfValues(totalNumberOfPoints + 2*numberOfContours);
+    vtkIdType* cellBuffer = cellConnectivity->GetPointer(0);
+
+    vtkIdType pointId = 0;
+    vtkIdType numberOfCells = 0;
+    vtkIdType* cellBufferPosition = cellBuffer;
+    for (vtkIdType contourIndex=0; contourIndex<numberOfContours; ++contourIndex)
+    {
+      unsigned long numberOfValues = ParseContourData(contourDataStrings[contourIndex], pointBuffer + 3*pointId, 3*contourNumberOfPoints[contourIndex]);
+      vtkIdType numberOfPoints = numberOfValues / 3;
+      if (numberOfPoints == 0)
+      {
+        continue;
+      }
+
+      *(cellBufferPosition++) = numberOfPoints + 1;
+      for (vtkIdType k=0; k<numberOfPoints; ++k)
+      {
+        *(cellBufferPosition++) = pointId + k;
+      }
+      // Close the contour
+      *(cellBufferPosition++) = pointId;
+      pointId += numberOfPoints;
+
+      // Add map to the referenced slice instance UID
+      // This is not a mandatory field so no error logged if not found. The reason why
+      // it is still read and stored is that it references the contours individually
+      DcmSequenceOfItems* contourImageSequence = NULL;
+      if ( contourItems[contourIndex]->findAndGetSequence(DCM_ContourImageSequence, contourImageSequence).good()
+        && contourImageSequence && contourImageSequence->card() > 0 )
+      {
+        OFString referencedSOPInstanceUID("");
+        contourImageSequence->getItem(0)->findAndGetOFString(DCM_ReferencedSOPInstanceUID, referencedSOPInstanceUID);
+        task.ContourIndexToSOPInstanceUIDMap[numberOfCells] = referencedSOPInstanceUID.c_str();
+        task.ReferencedSOPInstanceUIDs.insert(referencedSOPInstanceUID.c_str());
+
+        // Check if multiple SOP instance UIDs are referenced
+        if (contourImageSequence->card() > 1)
+        {
+          task.MultipleReferencedInstances = true;
+        }
+      }
+
+      ++numberOfCells;
+    }
+
+    // Contours with unparsable values may have been read partially, so trim the buffers to the decoded size
+    points->SetNumberOfPoints(pointId);
+    cellConnectivity->SetNumberOfValues(cellBufferPosition - cellBuffer);
+    task.Points = points;
+    task.Cells = vtkSmartPointer<vtkCellArray>::New();
+    task.Cells->SetCells(numberOfCells, cellConnectivity);
+  }
+
+  /// Thread function decoding ROI contours
+  VTK_THREAD_RETURN_TYPE DecodeRoiContoursThreadFunction(void* arg)
+  {
+    vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+    RoiContourDecodingThreadData* threadData = static_cast<RoiContourDecodingThreadData*>(threadInfo->UserData);
+
+    // ROIs are taken one by one, as the number of contour points differs a lot between ROIs
+    while (true)
+    {
+      threadData->Lock->Lock();
+      size_t taskIndex = threadData->NextTaskIndex++;
+      threadData->Lock->Unlock();
+      if (taskIndex >= threadData->Tasks.size())
+      {
+        break;
+      }
+      try
+      {
+        DecodeRoiContours(threadData->Tasks[taskIndex]);
+      }
+      catch (...)
+      {
+        // Exceptions must not leave the thread, the ROI is considered empty
+        threadData->Tasks[taskIndex].Points = NULL;
+      }
+    }
+
+    return VTK_THREAD_RETURN_VALUE;
+  }
+
+  /// Patient, study and series attributes of a dataset with the same getters as the DCMTK IOD classes,
+  /// so that the hierarchy information can be stored without reading the whole IOD
+  class DatasetHierarchyAttributes
+  {
+  public:
+    DatasetHierarchyAttributes(DcmItem& dataset) : Dataset(dataset) { };
+
+    OFCondition getPatientName(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_PatientName, value); };
+    OFCondition getPatientID(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_PatientID, value); };
+    OFCondition getPatientSex(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_PatientSex, value); };
+    OFCondition getPatientBirthDate(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_PatientBirthDate, value); };
+    OFCondition getPatientComments(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_PatientComments, value); };
+    OFCondition getStudyInstanceUID(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_StudyInstanceUID, value); };
+    OFCondition getStudyDescription(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_StudyDescription, value); };
+    OFCondition getStudyDate(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_StudyDate, value); };
+    OFCondition getStudyTime(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_StudyTime, value); };
+    OFCondition getSeriesInstanceUID(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_SeriesInstanceUID, value); };
+    OFCondition getSeriesDescription(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_SeriesDescription, value); };
+    OFCondition getModality(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_Modality, value); };
+    OFCondition getSeriesNumber(OFString& value) { return this->Dataset.findAndGetOFStringArray(DCM_SeriesNumber, value); };
+
+  private:
+    DcmItem& Dataset;
+  };
+}
+
 //----------------------------------------------------------------------------
 vtkSlicerDicomRtReader::RoiEntry::RoiEntry()
 {
@@ -151,6 +413,8 @@ vtkSlicerDicomRtReader::vtkSlicerDicomRtReader()
   this->DoseUnits = NULL;
   this->DoseGridScaling = NULL;
   this->RTDoseReferencedRTPlanSOPInstanceUID = NULL;
+  this->DoseImageData = NULL;
+  this->DoseIJKToRASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
 
   this->SOPInstanceUID = NULL;
 
@@ -183,6 +447,8 @@ vtkSlicerDicomRtReader::vtkSlicerDicomRtReader()
   this->LoadRTDoseSuccessful = false;
   this->LoadRTPlanSuccessful = false;
   this->LoadRTImageSuccessful = false;
+
+  this->NumberOfThreads = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -673,38 +939,37 @@ void vtkSlicerDicomRtReader::LoadRTPlan(DcmDataset* dataset)
 }
 
 //----------------------------------------------------------------------------
-DRTRTReferencedSeriesSequence* vtkSlicerDicomRtReader::GetReferencedSeriesSequence(DRTStructureSetIOD &rtStructureSetObject)
+const DRTRTReferencedSeriesSequence* vtkSlicerDicomRtReader::GetReferencedSeriesSequence(const DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject)
 {
-  DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject = rtStructureSetObject.getReferencedFrameOfReferenceSequence();
-  if (!rtReferencedFrameOfReferenceSequenceObject.gotoFirstItem().good())
+  if (rtReferencedFrameOfReferenceSequenceObject.getNumberOfItems() == 0)
   {
     vtkErrorMacro("GetReferencedSeriesSequence: No referenced frame of reference sequence object item is available");
     return NULL;
   }
 
-  DRTReferencedFrameOfReferenceSequence::Item &currentReferencedFrameOfReferenceSequenceItem = rtReferencedFrameOfReferenceSequenceObject.getCurrentItem();
+  const DRTReferencedFrameOfReferenceSequence::Item &currentReferencedFrameOfReferenceSequenceItem = rtReferencedFrameOfReferenceSequenceObject.getItem(0);
   if (!currentReferencedFrameOfReferenceSequenceItem.isValid())
   {
     vtkErrorMacro("GetReferencedSeriesSequence: Frame of reference sequence object item is invalid");
     return NULL;
   }
 
-  DRTRTReferencedStudySequence &rtReferencedStudySequenceObject = currentReferencedFrameOfReferenceSequenceItem.getRTReferencedStudySequence();
-  if (!rtReferencedStudySequenceObject.gotoFirstItem().good())
+  const DRTRTReferencedStudySequence &rtReferencedStudySequenceObject = currentReferencedFrameOfReferenceSequenceItem.getRTReferencedStudySequence();
+  if (rtReferencedStudySequenceObject.getNumberOfItems() == 0)
   {
     vtkErrorMacro("GetReferencedSeriesSequence: No referenced study sequence object item is available");
     return NULL;
   }
 
-  DRTRTReferencedStudySequence::Item &rtReferencedStudySequenceItem = rtReferencedStudySequenceObject.getCurrentItem();
+  const DRTRTReferencedStudySequence::Item &rtReferencedStudySequenceItem = rtReferencedStudySequenceObject.getItem(0);
   if (!rtReferencedStudySequenceItem.isValid())
   {
     vtkErrorMacro("GetReferencedSeriesSequence: Referenced study sequence object item is invalid");
     return NULL;
   }
 
-  DRTRTReferencedSeriesSequence &rtReferencedSeriesSequenceObject = rtReferencedStudySequenceItem.getRTReferencedSeriesSequence();
-  if (!rtReferencedSeriesSequenceObject.gotoFirstItem().good())
+  const DRTRTReferencedSeriesSequence &rtReferencedSeriesSequenceObject = rtReferencedStudySequenceItem.getRTReferencedSeriesSequence();
+  if (rtReferencedSeriesSequenceObject.getNumberOfItems() == 0)
   {
     vtkErrorMacro("GetReferencedSeriesSequence: No referenced series sequence object item is available");
     return NULL;
@@ -714,17 +979,17 @@ DRTRTReferencedSeriesSequence* vtkSlicerDicomRtReader::GetReferencedSeriesSequen
 }
 
 //----------------------------------------------------------------------------
-OFString vtkSlicerDicomRtReader::GetReferencedSeriesInstanceUID(DRTStructureSetIOD rtStructureSetObject)
+OFString vtkSlicerDicomRtReader::GetReferencedSeriesInstanceUID(const DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject)
 {
   OFString invalidUid("");
-  DRTRTReferencedSeriesSequence* rtReferencedSeriesSequenceObject = this->GetReferencedSeriesSequence(rtStructureSetObject);
-  if (!rtReferencedSeriesSequenceObject || !rtReferencedSeriesSequenceObject->gotoFirstItem().good())
+  const DRTRTReferencedSeriesSequence* rtReferencedSeriesSequenceObject = this->GetReferencedSeriesSequence(rtReferencedFrameOfReferenceSequenceObject);
+  if (!rtReferencedSeriesSequenceObject)
   {
     vtkErrorMacro("GetReferencedSeriesInstanceUID: No referenced series sequence object item is available");
     return invalidUid;
   }
 
-  DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject->getCurrentItem();
+  const DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject->getItem(0);
   if (!rtReferencedSeriesSequenceItem.isValid())
   {
     vtkErrorMacro("GetReferencedSeriesInstanceUID: Referenced series sequence object item is invalid");
@@ -737,24 +1002,24 @@ OFString vtkSlicerDicomRtReader::GetReferencedSeriesInstanceUID(DRTStructureSetI
 }
 
 //----------------------------------------------------------------------------
-DRTContourImageSequence* vtkSlicerDicomRtReader::GetReferencedFrameOfReferenceContourImageSequence(DRTStructureSetIOD &rtStructureSetObject)
+const DRTContourImageSequence* vtkSlicerDicomRtReader::GetReferencedFrameOfReferenceContourImageSequence(const DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject)
 {
-  DRTRTReferencedSeriesSequence* rtReferencedSeriesSequenceObject = this->GetReferencedSeriesSequence(rtStructureSetObject);
-  if (!rtReferencedSeriesSequenceObject || !rtReferencedSeriesSequenceObject->gotoFirstItem().good())
+  const DRTRTReferencedSeriesSequence* rtReferencedSeriesSequenceObject = this->GetReferencedSeriesSequence(rtReferencedFrameOfReferenceSequenceObject);
+  if (!rtReferencedSeriesSequenceObject)
   {
     vtkErrorMacro("GetReferencedFrameOfReferenceContourImageSequence: No referenced series sequence object item is available");
     return NULL;
   }
 
-  DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject->getCurrentItem();
+  const DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject->getItem(0);
   if (!rtReferencedSeriesSequenceItem.isValid())
   {
     vtkErrorMacro("GetReferencedFrameOfReferenceContourImageSequence: Referenced series sequence object item is invalid");
     return NULL;
   }
 
-  DRTContourImageSequence &rtContourImageSequenceObject = rtReferencedSeriesSequenceItem.getContourImageSequence();
-  if (!rtContourImageSequenceObject.gotoFirstItem().good())
+  const DRTContourImageSequence &rtContourImageSequenceObject = rtReferencedSeriesSequenceItem.getContourImageSequence();
+  if (rtContourImageSequenceObject.getNumberOfItems() == 0)
   {
     vtkErrorMacro("GetReferencedFrameOfReferenceContourImageSequence: No contour image sequence object item is available");
     return NULL;
@@ -768,18 +1033,15 @@ void vtkSlicerDicomRtReader::LoadRTStructureSet(DcmDataset* dataset)
 {
   this->LoadRTStructureSetSuccessful = false;
 
-  DRTStructureSetIOD rtStructureSetObject;
-  if (rtStructureSetObject.read(*dataset).bad())
-  {
-    vtkErrorMacro("LoadRTStructureSet: Could not load strucure set object from dataset");
-    return;
-  }
-
   vtkDebugMacro("LoadRTStructureSet: RT Structure Set object");
 
+  // Only the sequences that are needed are read from the dataset. Reading the whole structure set IOD
+  // would copy the contour data of all the ROIs, which is decoded directly from the dataset instead
+
   // Read ROI name, description, and number into the ROI contour sequence vector (StructureSetROISequence)
-  DRTStructureSetROISequence &rtStructureSetROISequenceObject = rtStructureSetObject.getStructureSetROISequence();
-  if (!rtStructureSetROISequenceObject.gotoFirstItem().good())
+  DRTStructureSetROISequence rtStructureSetROISequenceObject;
+  if ( rtStructureSetROISequenceObject.read(*dataset, "1-n", "1", "StructureSetModule").bad()
+    || !rtStructureSetROISequenceObject.gotoFirstItem().good() )
   {
     vtkErrorMacro("LoadRTStructureSet: No structure sets were found");
     return;
@@ -815,33 +1077,32 @@ void vtkSlicerDicomRtReader::LoadRTStructureSet(DcmDataset* dataset)
   while (rtStructureSetROISequenceObject.gotoNextItem().good());
 
   // Get referenced anatomical image
-  OFString referencedSeriesInstanceUID = this->GetReferencedSeriesInstanceUID(rtStructureSetObject);
+  DRTReferencedFrameOfReferenceSequence rtReferencedFrameOfReferenceSequenceObject;
+  rtReferencedFrameOfReferenceSequenceObject.read(*dataset, "1-n", "3", "StructureSetModule");
+  OFString referencedSeriesInstanceUID = this->GetReferencedSeriesInstanceUID(rtReferencedFrameOfReferenceSequenceObject);
 
   // Get ROI contour sequence
-  DRTROIContourSequence &rtROIContourSequenceObject = rtStructureSetObject.getROIContourSequence();
-  // Reset the ROI contour sequence to the start
-  if (!rtROIContourSequenceObject.gotoFirstItem().good())
+  DcmSequenceOfItems* roiContourSequence = NULL;
+  if (dataset->findAndGetSequence(DCM_ROIContourSequence, roiContourSequence).bad() || roiContourSequence == NULL || roiContourSequence->card() == 0)
   {
     vtkErrorMacro("LoadRTStructureSet: No ROIContourSequence found!");
     return;
   }
 
-  // Used for connection from one planar contour ROI to the corresponding anatomical volume slice instance
-  std::map<int, std::string> contourToSliceInstanceUIDMap;
-  std::set<std::string> referencedSopInstanceUids;
-
-  // Read ROIs, iterate over ROI contour sequence
-  do 
+  // Collect ROIs to decode. Contour data is decoded directly from the dataset, and the ROIs are decoded in parallel
+  RoiContourDecodingThreadData threadData;
+  std::vector<RoiEntry*> decodedRoiEntries;
+  for (DcmObject* roiContourObject = roiContourSequence->nextInContainer(NULL); roiContourObject; roiContourObject = roiContourSequence->nextInContainer(roiContourObject))
   {
-    DRTROIContourSequence::Item &currentRoiObject = rtROIContourSequenceObject.getCurrentItem();
-    if (!currentRoiObject.isValid())
+    DcmItem* roiContourItem = dynamic_cast<DcmItem*>(roiContourObject);
+    if (!roiContourItem)
     {
       continue;
     }
 
     // Get ROI entry created for the referenced ROI
     Sint32 referencedRoiNumber = -1;
-    currentRoiObject.getReferencedROINumber(referencedRoiNumber);
+    roiContourItem->findAndGetSint32(DCM_ReferencedROINumber, referencedRoiNumber);
     RoiEntry* roiEntry = this->FindRoiByNumber(referencedRoiNumber);
     if (roiEntry == NULL)
     {
@@ -849,98 +1110,56 @@ void vtkSlicerDicomRtReader::LoadRTStructureSet(DcmDataset* dataset)
       continue;
     } 
 
-    // Get contour sequence
-    DRTContourSequence &rtContourSequenceObject = currentRoiObject.getContourSequence();
-    if (!rtContourSequenceObject.gotoFirstItem().good())
+    RoiContourDecodingTask task;
+    task.RoiContourItem = roiContourItem;
+    threadData.Tasks.push_back(task);
+    decodedRoiEntries.push_back(roiEntry);
+  }
+
+  if (!threadData.Tasks.empty())
+  {
+    threadData.Lock = vtkSmartPointer<vtkMutexLock>::New();
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    int numberOfThreads = (this->NumberOfThreads > 0 ? this->NumberOfThreads : vtkMultiThreader::GetGlobalDefaultNumberOfThreads());
+    threader->SetNumberOfThreads( std::min(numberOfThreads, (int)threadData.Tasks.size()) );
+    threader->SetSingleMethod(DecodeRoiContoursThreadFunction, &threadData);
+    threader->SingleMethodExecute();
+  }
+
+  // Store decoded ROIs
+  std::set<std::string> referencedSopInstanceUids;
+  for (size_t taskIndex=0; taskIndex<threadData.Tasks.size(); ++taskIndex)
+  {
+    RoiContourDecodingTask& task = threadData.Tasks[taskIndex];
+    RoiEntry* roiEntry = decodedRoiEntries[taskIndex];
+    if (task.Points.GetPointer() == NULL)
     {
       vtkErrorMacro("LoadRTStructureSet: Contour sequence for ROI named '"
-        << roiEntry->Name << "' with number " << referencedRoiNumber << " is empty!");
+        << roiEntry->Name << "' with number " << roiEntry->Number << " is empty!");
       continue;
     }
-
-    // Create containers for contour poly data
-    vtkSmartPointer<vtkPoints> currentRoiContourPoints = vtkSmartPointer<vtkPoints>::New();
-    vtkSmartPointer<vtkCellArray> currentRoiContourCells = vtkSmartPointer<vtkCellArray>::New();
-    vtkIdType pointId = 0;
-
-    // Read contour data, iterate over contour sequence
-    do
+    if (task.MultipleReferencedInstances)
     {
-      // Get contour
-      DRTContourSequence::Item &contourItem = rtContourSequenceObject.getCurrentItem();
-      if (!contourItem.isValid())
-      {
-        continue;
-      }
-
-      // Get number of contour points
-      OFString numberOfPointsString("");
-      contourItem.getNumberOfContourPoints(numberOfPointsString);
-      std::stringstream ss;
-      ss << numberOfPointsString;
-      int numberOfPoints;
-      ss >> numberOfPoints;
-
-      // Get contour point data
-      OFVector<vtkTypeFloat64> contourData_LPS;
-      contourItem.getContourData(contourData_LPS);
-
-      unsigned int contourIndex = currentRoiContourCells->InsertNextCell(numberOfPoints+1);
-      for (int k=0; k<numberOfPoints; k++)
-      {
-        // Convert from DICOM LPS -> Slicer RAS
-        currentRoiContourPoints->InsertPoint(pointId, -contourData_LPS[3*k], -contourData_LPS[3*k+1], contourData_LPS[3*k+2]);
-        currentRoiContourCells->InsertCellPoint(pointId);
-        pointId++;
-      }
-
-      // Close the contour
-      currentRoiContourCells->InsertCellPoint(pointId-numberOfPoints);
-
-      // Add map to the referenced slice instance UID
-      // This is not a mandatory field so no error logged if not found. The reason why
-      // it is still read and stored is that it references the contours individually
-      DRTContourImageSequence &rtContourImageSequenceObject = contourItem.getContourImageSequence();
-      if (rtContourImageSequenceObject.gotoFirstItem().good())
-      {
-        DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
-        if (rtContourImageSequenceItem.isValid())
-        {
-          OFString referencedSOPInstanceUID("");
-          rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID);
-          contourToSliceInstanceUIDMap[contourIndex] = referencedSOPInstanceUID.c_str();
-          referencedSopInstanceUids.insert(referencedSOPInstanceUID.c_str());
-
-          // Check if multiple SOP instance UIDs are referenced
-          if (rtContourImageSequenceObject.getNumberOfItems() > 1)
-          {
-            vtkWarningMacro("LoadRTStructureSet: Contour in ROI " << roiEntry->Number << ": " << roiEntry->Name << " contains multiple referenced instances. This is not yet supported!");
-          }
-        }
-        else
-        {
-          vtkErrorMacro("LoadRTStructureSet: Contour image sequence object item is invalid");
-        }
-      }
+      vtkWarningMacro("LoadRTStructureSet: Contour in ROI " << roiEntry->Number << ": " << roiEntry->Name << " contains multiple referenced instances. This is not yet supported!");
     }
-    while (rtContourSequenceObject.gotoNextItem().good());
 
     // Read slice reference UIDs from referenced frame of reference sequence if it was not included in the ROIContourSequence above
+    std::map<int, std::string>& contourToSliceInstanceUIDMap = task.ContourIndexToSOPInstanceUIDMap;
     if (contourToSliceInstanceUIDMap.empty())
     {
-      DRTContourImageSequence* rtContourImageSequenceObject = this->GetReferencedFrameOfReferenceContourImageSequence(rtStructureSetObject);
-      if (rtContourImageSequenceObject && rtContourImageSequenceObject->gotoFirstItem().good())
+      const DRTContourImageSequence* rtContourImageSequenceObject = this->GetReferencedFrameOfReferenceContourImageSequence(rtReferencedFrameOfReferenceSequenceObject);
+      if (rtContourImageSequenceObject)
       {
         int currentSliceNumber = -1; // Use negative keys to indicate that the slice instances cannot be directly mapped to the ROI planar contours
-        do 
+        for (size_t itemIndex=0; itemIndex<rtContourImageSequenceObject->getNumberOfItems(); ++itemIndex)
         {
-          DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject->getCurrentItem();
+          const DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject->getItem(itemIndex);
           if (rtContourImageSequenceItem.isValid())
           {
             OFString referencedSOPInstanceUID("");
             rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID);
             contourToSliceInstanceUIDMap[currentSliceNumber] = referencedSOPInstanceUID.c_str();
-            referencedSopInstanceUids.insert(referencedSOPInstanceUID.c_str());
+            task.ReferencedSOPInstanceUIDs.insert(referencedSOPInstanceUID.c_str());
           }
           else
           {
@@ -948,26 +1167,26 @@ void vtkSlicerDicomRtReader::LoadRTStructureSet(DcmDataset* dataset)
           }
           currentSliceNumber--;
         }
-        while (rtContourImageSequenceObject->gotoNextItem().good());
       }
       else
       {
         vtkErrorMacro("LoadRTStructureSet: No items in contour image sequence object item in referenced frame of reference sequence!");
       }
     }
+    referencedSopInstanceUids.insert(task.ReferencedSOPInstanceUIDs.begin(), task.ReferencedSOPInstanceUIDs.end());
 
     // Save just loaded contour data into ROI entry
     vtkSmartPointer<vtkPolyData> currentRoiPolyData = vtkSmartPointer<vtkPolyData>::New();
-    currentRoiPolyData->SetPoints(currentRoiContourPoints);
-    if (currentRoiContourPoints->GetNumberOfPoints() == 1)
+    currentRoiPolyData->SetPoints(task.Points);
+    if (task.Points->GetNumberOfPoints() == 1)
     {
       // Point ROI
-      currentRoiPolyData->SetVerts(currentRoiContourCells);
+      currentRoiPolyData->SetVerts(task.Cells);
     }
-    else if (currentRoiContourPoints->GetNumberOfPoints() > 1)
+    else if (task.Points->GetNumberOfPoints() > 1)
     {
       // Contour ROI
-      currentRoiPolyData->SetLines(currentRoiContourCells);
+      currentRoiPolyData->SetLines(task.Cells);
     }
     roiEntry->SetPolyData(currentRoiPolyData);
 
@@ -975,7 +1194,7 @@ void vtkSlicerDicomRtReader::LoadRTStructureSet(DcmDataset* dataset)
     Sint32 roiDisplayColor = -1;
     for (int j=0; j<3; j++)
     {
-      currentRoiObject.getROIDisplayColor(roiDisplayColor,j);
+      task.RoiContourItem->findAndGetSint32(DCM_ROIDisplayColor, roiDisplayColor, j);
       roiEntry->DisplayColor[j] = roiDisplayColor/255.0;
     }
 
@@ -984,24 +1203,23 @@ void vtkSlicerDicomRtReader::LoadRTStructureSet(DcmDataset* dataset)
 
     // Set referenced SOP instance UIDs
     roiEntry->ContourIndexToSOPInstanceUIDMap = contourToSliceInstanceUIDMap;
+  }
 
-    // Serialize referenced SOP instance UID set
-    std::set<std::string>::iterator uidIt;
-    std::string serializedUidList("");
-    for (uidIt = referencedSopInstanceUids.begin(); uidIt != referencedSopInstanceUids.end(); ++uidIt)
-    {
-      serializedUidList.append(*uidIt);
-      serializedUidList.append(" ");
-    }
-    // Strip last space
-    serializedUidList = serializedUidList.substr(0, serializedUidList.size()-1);
-    this->SetRTStructureSetReferencedSOPInstanceUIDs(serializedUidList.c_str());
+  // Serialize referenced SOP instance UID set
+  std::set<std::string>::iterator uidIt;
+  std::string serializedUidList("");
+  for (uidIt = referencedSopInstanceUids.begin(); uidIt != referencedSopInstanceUids.end(); ++uidIt)
+  {
+    serializedUidList.append(*uidIt);
+    serializedUidList.append(" ");
   }
-  while (rtROIContourSequenceObject.gotoNextItem().good());
+  // Strip last space
+  serializedUidList = serializedUidList.substr(0, serializedUidList.size()-1);
+  this->SetRTStructureSetReferencedSOPInstanceUIDs(serializedUidList.c_str());
 
   // SOP instance UID
   OFString sopInstanceUid("");
-  if (rtStructureSetObject.getSOPInstanceUID(sopInstanceUid).bad())
+  if (dataset->findAndGetOFString(DCM_SOPInstanceUID, sopInstanceUid).bad())
   {
     vtkErrorMacro("LoadRTStructureSet: Failed to get SOP instance UID for RT structure set!");
     return; // mandatory DICOM value
@@ -1009,7 +1227,8 @@ void vtkSlicerDicomRtReader::LoadRTStructureSet(DcmDataset* dataset)
   this->SetSOPInstanceUID(sopInstanceUid.c_str());
 
   // Get and store patient, study and series information
-  this->GetAndStoreHierarchyInformation(&rtStructureSetObject);
+  DatasetHierarchyAttributes hierarchyAttributes(*dataset);
+  this->GetAndStoreHierarchyInformation(&hierarchyAttributes);
 
   this->LoadRTStructureSetSuccessful = true;
 }
@@ -1210,6 +1429,17 @@ void vtkSlicerDicomRtReader::LoadRTDose(DcmDataset* dataset)
   this->SetPixelSpacing(pixelSpacingOFVector[1], pixelSpacingOFVector[0]);
   vtkDebugMacro("Pixel Spacing: (" << pixelSpacingOFVector[1] << ", " << pixelSpacingOFVector[0] << ")");
 
+  // Decode the dose grid from the already parsed dataset, so that the file does not need to be read again
+  std::stringstream doseGridScalingSs;
+  doseGridScalingSs << doseGridScaling.c_str();
+  double doseGridScalingValue = 0.0;
+  doseGridScalingSs >> doseGridScalingValue;
+  if (!this->LoadRTDosePixelData(dataset, doseGridScalingValue))
+  {
+    vtkWarningMacro("LoadRTDose: Dose grid could not be decoded directly from the RT Dose dataset");
+    this->DoseImageData = NULL;
+  }
+
   // Get referenced RTPlan instance UID
   DRTReferencedRTPlanSequence &referencedRTPlanSequence = rtDoseObject.getReferencedRTPlanSequence();
   if (referencedRTPlanSequence.gotoFirstItem().good())
@@ -1240,6 +1470,185 @@ void vtkSlicerDicomRtReader::LoadRTDose(DcmDataset* dataset)
   this->LoadRTDoseSuccessful = true;
 }
 
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtReader::LoadRTDosePixelData(DcmDataset* dataset, double doseGridScaling)
+{
+  Uint16 rows = 0;
+  Uint16 columns = 0;
+  Uint16 bitsAllocated = 0;
+  Uint16 bitsStored = 0;
+  Uint16 pixelRepresentation = 0;
+  Uint16 samplesPerPixel = 1;
+  if ( dataset->findAndGetUint16(DCM_Rows, rows).bad() || dataset->findAndGetUint16(DCM_Columns, columns).bad()
+    || dataset->findAndGetUint16(DCM_BitsAllocated, bitsAllocated).bad() || dataset->findAndGetUint16(DCM_PixelRepresentation, pixelRepresentation).bad() )
+  {
+    vtkErrorMacro("LoadRTDosePixelData: Failed to get image pixel attributes for dose object");
+    return false;
+  }
+  if (dataset->findAndGetUint16(DCM_BitsStored, bitsStored).bad())
+  {
+    bitsStored = bitsAllocated;
+  }
+  dataset->findAndGetUint16(DCM_SamplesPerPixel, samplesPerPixel);
+  if ((bitsAllocated != 16 && bitsAllocated != 32) || bitsStored != bitsAllocated || samplesPerPixel != 1)
+  {
+    vtkErrorMacro("LoadRTDosePixelData: Unsupported dose grid pixel format (bits allocated: " << bitsAllocated
+      << ", bits stored: " << bitsStored << ", samples per pixel: " << samplesPerPixel << ")");
+    return false;
+  }
+
+  Sint32 numberOfFrames = 1;
+  if (dataset->findAndGetSint32(DCM_NumberOfFrames, numberOfFrames).bad() || numberOfFrames < 1)
+  {
+    numberOfFrames = 1;
+  }
+
+  // Image plane
+  double imagePosition[3] = {0.0, 0.0, 0.0};
+  double imageOrientation[6] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0};
+  for (unsigned long i=0; i<3; ++i)
+  {
+    if (dataset->findAndGetFloat64(DCM_ImagePositionPatient, imagePosition[i], i).bad())
+    {
+      vtkErrorMacro("LoadRTDosePixelData: Failed to get Image Position (Patient) for dose object");
+      return false;
+    }
+  }
+  for (unsigned long i=0; i<6; ++i)
+  {
+    if (dataset->findAndGetFloat64(DCM_ImageOrientationPatient, imageOrientation[i], i).bad())
+    {
+      vtkErrorMacro("LoadRTDosePixelData: Failed to get Image Orientation (Patient) for dose object");
+      return false;
+    }
+  }
+
+  // Frame spacing from the grid frame offset vector. The offsets are either relative to the image position
+  // (first offset is zero) or absolute coordinates along the slice normal (first offset equals the image position),
+  // the first frame is located at the image position in both cases.
+  double frameSpacing = 1.0;
+  if (numberOfFrames > 1)
+  {
+    std::vector<double> frameOffsets(numberOfFrames, 0.0);
+    for (Sint32 frameIndex=0; frameIndex<numberOfFrames; ++frameIndex)
+    {
+      if (dataset->findAndGetFloat64(DCM_GridFrameOffsetVector, frameOffsets[frameIndex], frameIndex).bad())
+      {
+        vtkErrorMacro("LoadRTDosePixelData: Failed to get Grid Frame Offset Vector for multi-frame dose object");
+        return false;
+      }
+    }
+    frameSpacing = (frameOffsets[numberOfFrames-1] - frameOffsets[0]) / (numberOfFrames-1);
+    if (frameSpacing == 0.0)
+    {
+      vtkErrorMacro("LoadRTDosePixelData: Invalid Grid Frame Offset Vector, frames are not separated");
+      return false;
+    }
+    for (Sint32 frameIndex=1; frameIndex<numberOfFrames; ++frameIndex)
+    {
+      double currentSpacing = frameOffsets[frameIndex] - frameOffsets[frameIndex-1];
+      if (fabs(currentSpacing - frameSpacing) > DOSE_GRID_FRAME_SPACING_TOLERANCE * fabs(frameSpacing))
+      {
+        vtkWarningMacro("LoadRTDosePixelData: Dose grid frames are not equally spaced, using average frame spacing " << frameSpacing);
+        break;
+      }
+    }
+  }
+
+  // Make sure pixel data is available in an uncompressed representation
+  DcmXfer originalXfer(dataset->getOriginalXfer());
+  if (originalXfer.isEncapsulated() && dataset->chooseRepresentation(EXS_LittleEndianExplicit, NULL).bad())
+  {
+    vtkErrorMacro("LoadRTDosePixelData: Unable to decompress dose grid pixel data (transfer syntax: " << originalXfer.getXferName() << ")");
+    return false;
+  }
+
+  const Uint16* pixelWords = NULL;
+  unsigned long numberOfWords = 0;
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(rows) * columns * numberOfFrames;
+  if ( dataset->findAndGetUint16Array(DCM_PixelData, pixelWords, &numberOfWords).bad() || pixelWords == NULL
+    || numberOfWords < static_cast<unsigned long>(numberOfVoxels * (bitsAllocated / 16)) )
+  {
+    vtkErrorMacro("LoadRTDosePixelData: Failed to get dose grid pixel data (expected " << numberOfVoxels << " voxels)");
+    return false;
+  }
+
+  // Decode and scale directly into the output image
+  vtkSmartPointer<vtkImageData> doseImageData = vtkSmartPointer<vtkImageData>::New();
+  doseImageData->SetExtent(0, columns-1, 0, rows-1, 0, numberOfFrames-1);
+  doseImageData->AllocateScalars(VTK_FLOAT, 1);
+  float* doseValues = static_cast<float*>(doseImageData->GetScalarPointer());
+  if (bitsAllocated == 16)
+  {
+    if (pixelRepresentation == 0)
+    {
+      ScaleDoseGridToFloat(pixelWords, doseValues, numberOfVoxels, doseGridScaling);
+    }
+    else
+    {
+      ScaleDoseGridToFloat(reinterpret_cast<const Sint16*>(pixelWords), doseValues, numberOfVoxels, doseGridScaling);
+    }
+  }
+  else
+  {
+    if (pixelRepresentation == 0)
+    {
+      ScaleDoseGrid32ToFloat<Uint32>(pixelWords, doseValues, numberOfVoxels, doseGridScaling);
+    }
+    else
+    {
+      ScaleDoseGrid32ToFloat<Sint32>(pixelWords, doseValues, numberOfVoxels, doseGridScaling);
+    }
+  }
+
+  // Geometry: columns of the image are along the row direction and rows along the column direction.
+  // A negative frame spacing is represented by flipping the slice direction.
+  double rowDirection[3] = {imageOrientation[0], imageOrientation[1], imageOrientation[2]};
+  double columnDirection[3] = {imageOrientation[3], imageOrientation[4], imageOrientation[5]};
+  double sliceDirection[3] = {0.0, 0.0, 0.0};
+  vtkMath::Cross(rowDirection, columnDirection, sliceDirection);
+  if (frameSpacing < 0.0)
+  {
+    frameSpacing = -frameSpacing;
+    vtkMath::MultiplyScalar(sliceDirection, -1.0);
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> ijkToLpsMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  for (int row=0; row<3; ++row)
+  {
+    ijkToLpsMatrix->SetElement(row, 0, rowDirection[row] * this->PixelSpacing[0]);
+    ijkToLpsMatrix->SetElement(row, 1, columnDirection[row] * this->PixelSpacing[1]);
+    ijkToLpsMatrix->SetElement(row, 2, sliceDirection[row] * frameSpacing);
+    ijkToLpsMatrix->SetElement(row, 3, imagePosition[row]);
+  }
+
+  // DICOM uses LPS, Slicer uses RAS
+  vtkSmartPointer<vtkMatrix4x4> lpsToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  lpsToRasMatrix->SetElement(0, 0, -1.0);
+  lpsToRasMatrix->SetElement(1, 1, -1.0);
+  vtkMatrix4x4::Multiply4x4(lpsToRasMatrix, ijkToLpsMatrix, this->DoseIJKToRASMatrix);
+
+  this->DoseImageData = doseImageData;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkSlicerDicomRtReader::GetDoseImageData()
+{
+  return this->DoseImageData.GetPointer();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtReader::GetDoseIJKToRASMatrix(vtkMatrix4x4* ijkToRasMatrix)
+{
+  if (!ijkToRasMatrix)
+  {
+    vtkErrorMacro("GetDoseIJKToRASMatrix: Invalid output matrix!");
+    return;
+  }
+  ijkToRasMatrix->DeepCopy(this->DoseIJKToRASMatrix);
+}
+
 //----------------------------------------------------------------------------
 vtkSlicerDicomRtReader::BeamEntry* vtkSlicerDicomRtReader::FindBeamByNumber(unsigned int beamNumber)
 {
@@ -45,9 +45,11 @@ class DRTContourImageSequence;
 class DRTContourSequence;
 class DRTROIContourSequence;
 class DRTRTReferencedSeriesSequence;
-class DRTStructureSetIOD;
+class DRTReferencedFrameOfReferenceSequence;
 class DcmDataset;
 class OFString;
+class vtkImageData;
+class vtkMatrix4x4;
 class vtkPolyData;
 
 // Due to some reason the Python wrapping of this class fails, therefore
@@ -121,6 +123,10 @@ public:
   /// Set input file name
   vtkSetStringMacro(FileName);
 
+  /// Maximum number of threads used for decoding the structure set contours, the global default if zero
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
   /// Get referenced SOP instance UID list for the loaded structure set
   vtkGetStringMacro(RTStructureSetReferencedSOPInstanceUIDs);
   /// Set referenced SOP instance UID list for the loaded structure set
@@ -139,6 +145,13 @@ public:
   /// Set dose grid scaling
   vtkSetStringMacro(DoseGridScaling);
 
+  /// Get dose volume decoded from the RT Dose pixel data, already scaled to dose units (float scalars).
+  /// The image has unit spacing and zero origin, the geometry is available from \sa GetDoseIJKToRASMatrix.
+  /// NULL if the pixel data could not be decoded directly (e.g. unsupported pixel format)
+  vtkImageData* GetDoseImageData();
+  /// Get IJK to RAS matrix of the decoded dose volume
+  void GetDoseIJKToRASMatrix(vtkMatrix4x4* ijkToRasMatrix);
+
   /// Get RT Plan SOP instance UID referenced by RT Dose
   vtkGetStringMacro(RTDoseReferencedRTPlanSOPInstanceUID);
   /// Set RT Plan SOP instance UID referenced by RT Dose
@@ -320,6 +333,11 @@ protected:
   /// Load RT Dose
   void LoadRTDose(DcmDataset*);
 
+  /// Decode dose grid from RT Dose pixel data into a float image scaled by the dose grid scaling
+  /// and compute its geometry from the image plane attributes and the grid frame offset vector
+  /// \return Success flag
+  bool LoadRTDosePixelData(DcmDataset* dataset, double doseGridScaling);
+
   /// Load RT Image
   void LoadRTImage(DcmDataset* dataset);
 
@@ -364,14 +382,14 @@ protected:
   /// Find and return a ROI entry according to its ROI number
   RoiEntry* FindRoiByNumber(unsigned int roiNumber);
 
-  /// Get frame of reference for an SOP instance
-  DRTRTReferencedSeriesSequence* GetReferencedSeriesSequence(DRTStructureSetIOD &rtStructureSetObject);
+  /// Get referenced series sequence from the referenced frame of reference sequence of a structure set
+  const DRTRTReferencedSeriesSequence* GetReferencedSeriesSequence(const DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject);
 
   /// Get contour image sequence object in the referenced frame of reference sequence for a structure set
-  DRTContourImageSequence* GetReferencedFrameOfReferenceContourImageSequence(DRTStructureSetIOD &rtStructureSetObject);
+  const DRTContourImageSequence* GetReferencedFrameOfReferenceContourImageSequence(const DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject);
 
   /// Get referenced series instance UID for the structure set (0020,000E)
-  OFString GetReferencedSeriesInstanceUID(DRTStructureSetIOD rtStructureSetObject);
+  OFString GetReferencedSeriesInstanceUID(const DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject);
 
 //xBTX //TODO #210: Re-enable
   template<class T> void GetAndStoreHierarchyInformation(T* dcmtkIodObject);
@@ -405,6 +423,12 @@ protected:
   /// RT Plan SOP instance UID referenced by RT Dose
   char* RTDoseReferencedRTPlanSOPInstanceUID;
 
+  /// Dose volume decoded from the pixel data in dose units - for RTDOSE
+  vtkSmartPointer<vtkImageData> DoseImageData;
+
+  /// IJK to RAS matrix of the decoded dose volume - for RTDOSE
+  vtkSmartPointer<vtkMatrix4x4> DoseIJKToRASMatrix;
+
   /// SOP instance UID
   char* SOPInstanceUID;
 
@@ -498,6 +522,9 @@ protected:
   /// Flag indicating if RT Image has been successfully read from the input dataset
   bool LoadRTImageSuccessful;
 
+  /// Maximum number of threads used for decoding the structure set contours
+  int NumberOfThreads;
+
 protected:
   vtkSlicerDicomRtReader();
   virtual ~vtkSlicerDicomRtReader();
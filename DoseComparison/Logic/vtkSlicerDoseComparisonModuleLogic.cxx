@@ -25,6 +25,7 @@
 // SlicerRT includes
 #include "SlicerRtCommon.h"
 #include "PlmCommon.h"
+#include "vtkImageBlockMinMax.h"
 
 // Plastimatch includes
 #include "gamma_dose_comparison.h"
@@ -222,8 +223,8 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference()
 
   double checkpointConvertStart = timer->GetUniversalTime();
   vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = this->DoseComparisonNode->GetReferenceDoseVolumeNode();
-  Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode);
-  Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(this->DoseComparisonNode->GetCompareDoseVolumeNode());
+  Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode, true, true);
+  Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(this->DoseComparisonNode->GetCompareDoseVolumeNode(), true, true);
 
   Plm_image::Pointer maskVolume;
   vtkMRMLSegmentationNode* maskSegmentationNode = this->DoseComparisonNode->GetMaskSegmentationNode();
@@ -265,7 +266,7 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference()
     }
 
     // Convert mask to Plm image
-    maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap);
+    maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap, true);
     if (!maskVolume)
     {
       std::string errorMessage("Failed to convert mask segment labelmap into Plm_image");
@@ -290,6 +291,18 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference()
   {
     gamma.set_reference_dose(this->DoseComparisonNode->GetReferenceDoseGy());
   }
+  else if (!maskSegmentationNode)
+  {
+    // Get maximum dose from the block index of the reference dose instead of having it scanned again.
+    // The analysis threshold is relative to this value (with a mask the maximum is determined within the mask)
+    vtkImageBlockMinMax* referenceDoseBlockMinMax = vtkImageBlockMinMax::GetBlockMinMaxForImage(referenceDoseVolumeNode->GetImageData());
+    if (referenceDoseBlockMinMax)
+    {
+      double referenceDoseRange[2] = {0.0, 0.0};
+      referenceDoseBlockMinMax->GetScalarRange(referenceDoseRange);
+      gamma.set_reference_dose(referenceDoseRange[1]);
+    }
+  }
   gamma.set_analysis_threshold(this->DoseComparisonNode->GetAnalysisThresholdPercent() / 100.0 );
   gamma.set_gamma_max(this->DoseComparisonNode->GetMaximumGamma());
   gamma.set_ref_only_threshold(this->DoseComparisonNode->GetDoseThresholdOnReferenceOnly());
@@ -312,7 +325,7 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference()
     return errorMessage;
   }
 
-  SlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT);
+  SlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT, true, true);
   gammaVolumeNode->SetAttribute(vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_GAMMA_VOLUME_IDENTIFIER_ATTRIBUTE_NAME, "1");
 
   // Set default colormap to red
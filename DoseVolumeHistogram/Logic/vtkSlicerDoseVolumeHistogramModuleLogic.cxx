@@ -24,6 +24,7 @@
 
 // SlicerRT includes
 #include "SlicerRtCommon.h"
+#include "vtkImageBlockMinMax.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
@@ -311,10 +312,22 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh()
   int disabledNodeModify = this->DoseVolumeHistogramNode->StartModify();
 
   // Get maximum dose from dose volume for number of DVH bins
-  vtkNew<vtkImageAccumulate> doseStat;
-  doseStat->SetInputData(doseVolumeNode->GetImageData());
-  doseStat->Update();
-  double maxDose = doseStat->GetMax()[0];
+  double maxDose = 0.0;
+  vtkImageBlockMinMax* doseBlockMinMax = vtkImageBlockMinMax::GetBlockMinMaxForImage(doseVolumeNode->GetImageData());
+  if (doseBlockMinMax)
+  {
+    // Use the block index of the dose that is only rebuilt when the dose changes
+    double doseRange[2] = {0.0, 0.0};
+    doseBlockMinMax->GetScalarRange(doseRange);
+    maxDose = doseRange[1];
+  }
+  else
+  {
+    vtkNew<vtkImageAccumulate> doseStat;
+    doseStat->SetInputData(doseVolumeNode->GetImageData());
+    doseStat->Update();
+    maxDose = doseStat->GetMax()[0];
+  }
 
   // Get selected segmentation
   vtkSegmentation* selectedSegmentation = segmentationNode->GetSegmentation();
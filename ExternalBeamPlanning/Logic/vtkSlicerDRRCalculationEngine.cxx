@@ -0,0 +1,825 @@
+/*==============================================================================
+
+  Copyright (c) Radiation Medicine Program, University Health Network,
+  Princess Margaret Hospital, Toronto, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Kevin Wang, Princess Margaret Cancer Centre
+  and was supported by Cancer Care Ontario (CCO)'s ACRU program
+  with funds provided by the Ontario Ministry of Health and Long-Term Care
+  and Ontario Consortium for Adaptive Interventions in Radiation Oncology (OCAIRO).
+
+==============================================================================*/
+
+// Module includes
+#include "vtkSlicerDRRCalculationEngine.h"
+
+// Beams includes
+#include "vtkMRMLRTBeamNode.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkCellArray.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Size of the image relative to the field defined by the jaws, so that the anatomy around the field is visible
+  const double DRR_FIELD_MARGIN_FACTOR = 1.2;
+  /// Planar contours closer than this along the z axis are considered to be on the same slice
+  const double DRR_CONTOUR_SLICE_TOLERANCE_MM = 0.001;
+
+  //----------------------------------------------------------------------------
+  /// Convert points projected on the isocenter plane (mm) to continuous pixel coordinates of the image
+  void ConvertProjectedPointsToPixels(std::vector<double>& projectedPoints, const int imageSize[2], const double imageSpacing[2])
+  {
+    double imageOrigin[2] = { -0.5 * (imageSize[0] - 1) * imageSpacing[0], -0.5 * (imageSize[1] - 1) * imageSpacing[1] };
+    for (size_t pointIndex=0; pointIndex<projectedPoints.size()/2; ++pointIndex)
+    {
+      projectedPoints[2*pointIndex] = (projectedPoints[2*pointIndex] - imageOrigin[0]) / imageSpacing[0];
+      projectedPoints[2*pointIndex+1] = (projectedPoints[2*pointIndex+1] - imageOrigin[1]) / imageSpacing[1];
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Get the projected points of a cell as a polygon
+  /// \return False if a point of the cell cannot be projected (it is behind the source)
+  bool GetProjectedPolygon(vtkIdType numberOfCellPoints, const vtkIdType* cellPointIds,
+    const std::vector<double>& projectedPoints, const std::vector<bool>& validPoints, std::vector<double>& polygon)
+  {
+    polygon.clear();
+    for (vtkIdType cellPointIndex=0; cellPointIndex<numberOfCellPoints; ++cellPointIndex)
+    {
+      vtkIdType pointId = cellPointIds[cellPointIndex];
+      if (!validPoints[pointId])
+      {
+        return false;
+      }
+      polygon.push_back(projectedPoints[2*pointId]);
+      polygon.push_back(projectedPoints[2*pointId+1]);
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Fill polygons given in continuous pixel coordinates (pixel centers at integer coordinates).
+  /// Pixels with centers inside the polygons are set (even-odd rule, half-open in the row direction).
+  /// The crossings of all polygons are combined in each row, so a polygon inside another one is a hole
+  void FillProjectedPolygons(const std::vector<std::vector<double> >& polygons, unsigned short* labelmapPtr, const int imageSize[2], unsigned short label)
+  {
+    double minimumRow = VTK_DOUBLE_MAX;
+    double maximumRow = VTK_DOUBLE_MIN;
+    for (size_t polygonIndex=0; polygonIndex<polygons.size(); ++polygonIndex)
+    {
+      const std::vector<double>& polygon = polygons[polygonIndex];
+      if (polygon.size() < 6)
+      {
+        continue;
+      }
+      for (size_t vertexIndex=0; vertexIndex<polygon.size()/2; ++vertexIndex)
+      {
+        minimumRow = std::min(minimumRow, polygon[2*vertexIndex+1]);
+        maximumRow = std::max(maximumRow, polygon[2*vertexIndex+1]);
+      }
+    }
+    if (minimumRow > maximumRow)
+    {
+      return;
+    }
+    int firstRow = std::max(0, (int)ceil(minimumRow));
+    int lastRow = std::min(imageSize[1]-1, (int)floor(maximumRow));
+
+    std::vector<double> crossings;
+    for (int row=firstRow; row<=lastRow; ++row)
+    {
+      crossings.clear();
+      for (size_t polygonIndex=0; polygonIndex<polygons.size(); ++polygonIndex)
+      {
+        const std::vector<double>& polygon = polygons[polygonIndex];
+        int numberOfVertices = (int)polygon.size() / 2;
+        if (numberOfVertices < 3)
+        {
+          continue;
+        }
+        for (int vertexIndex=0; vertexIndex<numberOfVertices; ++vertexIndex)
+        {
+          const double* a = &(polygon[2*vertexIndex]);
+          const double* b = &(polygon[2*((vertexIndex+1)%numberOfVertices)]);
+          if ((a[1] <= row) != (b[1] <= row))
+          {
+            crossings.push_back(a[0] + (row - a[1]) * (b[0] - a[0]) / (b[1] - a[1]));
+          }
+        }
+      }
+      std::sort(crossings.begin(), crossings.end());
+
+      unsigned short* rowPtr = labelmapPtr + (vtkIdType)row * imageSize[0];
+      for (size_t crossingIndex=0; crossingIndex+1<crossings.size(); crossingIndex+=2)
+      {
+        int firstColumn = std::max(0, (int)ceil(crossings[crossingIndex]));
+        int lastColumn = std::min(imageSize[0]-1, (int)floor(crossings[crossingIndex+1]));
+        for (int column=firstColumn; column<=lastColumn; ++column)
+        {
+          rowPtr[column] = label;
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  template<class T> void ConvertHounsfieldUnitsToAttenuation(const T* huPtr, float* attenuationPtr, vtkIdType numberOfVoxels, double waterAttenuationCoefficient)
+  {
+    for (vtkIdType voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+    {
+      double attenuation = waterAttenuationCoefficient * (1.0 + static_cast<double>(huPtr[voxelIndex]) / 1000.0);
+      attenuationPtr[voxelIndex] = static_cast<float>(attenuation > 0.0 ? attenuation : 0.0);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Data shared by the ray tracing threads. The rows of the DRR image are taken from a common counter
+  struct DRRThreadData
+  {
+    const float* Attenuation;
+    int Extent[6];
+    vtkIdType Increments[3];
+
+    /// Source position in the IJK coordinate system of the attenuation volume
+    double SourceIjk[3];
+    /// End point of the ray of the first pixel, and its increment per column and row, in IJK
+    double RayEndOriginIjk[3];
+    double RayEndColumnStepIjk[3];
+    double RayEndRowStepIjk[3];
+    /// The same in RAS, for computing the length of the rays in mm
+    double SourceRas[3];
+    double RayEndOriginRas[3];
+    double RayEndColumnStepRas[3];
+    double RayEndRowStepRas[3];
+
+    int ImageSize[2];
+    float* Output;
+
+    int NextRowIndex;
+    vtkSmartPointer<vtkMutexLock> Lock;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Trace a ray through the attenuation volume (incremental Siddon-Jacobs traversal).
+  /// \return Sum of attenuation coefficients weighted by the intersection lengths as fraction of the ray length
+  double TraceRay(const DRRThreadData* data, const double start[3], const double end[3])
+  {
+    // Clip the ray to the volume. Voxel boundaries are halfway between voxel centers
+    double direction[3] = {0.0, 0.0, 0.0};
+    double alphaMin = 0.0;
+    double alphaMax = 1.0;
+    for (int axis=0; axis<3; ++axis)
+    {
+      direction[axis] = end[axis] - start[axis];
+      double lowerBound = data->Extent[2*axis] - 0.5;
+      double upperBound = data->Extent[2*axis+1] + 0.5;
+      if (fabs(direction[axis]) < 1e-12)
+      {
+        if (start[axis] < lowerBound || start[axis] > upperBound)
+        {
+          return 0.0;
+        }
+        continue;
+      }
+      double alpha0 = (lowerBound - start[axis]) / direction[axis];
+      double alpha1 = (upperBound - start[axis]) / direction[axis];
+      alphaMin = std::max(alphaMin, std::min(alpha0, alpha1));
+      alphaMax = std::min(alphaMax, std::max(alpha0, alpha1));
+    }
+    if (alphaMin >= alphaMax)
+    {
+      return 0.0;
+    }
+
+    // Find the entry voxel and the parametric distances to the next voxel boundary along each axis
+    int index[3] = {0, 0, 0};
+    int step[3] = {0, 0, 0};
+    double alphaNext[3] = {VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, VTK_DOUBLE_MAX};
+    double alphaIncrement[3] = {0.0, 0.0, 0.0};
+    const float* voxelPtr = data->Attenuation;
+    for (int axis=0; axis<3; ++axis)
+    {
+      double entry = start[axis] + alphaMin * direction[axis];
+      index[axis] = (int)floor(entry + 0.5);
+      index[axis] = std::max(data->Extent[2*axis], std::min(data->Extent[2*axis+1], index[axis]));
+      voxelPtr += (index[axis] - data->Extent[2*axis]) * data->Increments[axis];
+      if (direction[axis] > 1e-12)
+      {
+        step[axis] = 1;
+        alphaNext[axis] = (index[axis] + 0.5 - start[axis]) / direction[axis];
+        alphaIncrement[axis] = 1.0 / direction[axis];
+      }
+      else if (direction[axis] < -1e-12)
+      {
+        step[axis] = -1;
+        alphaNext[axis] = (index[axis] - 0.5 - start[axis]) / direction[axis];
+        alphaIncrement[axis] = -1.0 / direction[axis];
+      }
+    }
+
+    // Step through the voxels along the ray
+    double sum = 0.0;
+    double alpha = alphaMin;
+    while (alpha < alphaMax)
+    {
+      int axis = (alphaNext[0] < alphaNext[1]) ? (alphaNext[0] < alphaNext[2] ? 0 : 2) : (alphaNext[1] < alphaNext[2] ? 1 : 2);
+      double alphaExit = std::min(alphaNext[axis], alphaMax);
+      sum += (*voxelPtr) * (alphaExit - alpha);
+      alpha = alphaExit;
+
+      index[axis] += step[axis];
+      if (index[axis] < data->Extent[2*axis] || index[axis] > data->Extent[2*axis+1])
+      {
+        break;
+      }
+      voxelPtr += step[axis] * data->Increments[axis];
+      alphaNext[axis] += alphaIncrement[axis];
+    }
+
+    return sum;
+  }
+
+  //----------------------------------------------------------------------------
+  VTK_THREAD_RETURN_TYPE DRRThreadFunction(void* arg)
+  {
+    vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+    DRRThreadData* data = static_cast<DRRThreadData*>(threadInfo->UserData);
+
+    while (true)
+    {
+      data->Lock->Lock();
+      int rowIndex = data->NextRowIndex++;
+      data->Lock->Unlock();
+      if (rowIndex >= data->ImageSize[1])
+      {
+        break;
+      }
+
+      float* outputPtr = data->Output + (vtkIdType)rowIndex * data->ImageSize[0];
+      for (int columnIndex=0; columnIndex<data->ImageSize[0]; ++columnIndex)
+      {
+        double rayEndIjk[3] = {0.0, 0.0, 0.0};
+        double rayEndRas[3] = {0.0, 0.0, 0.0};
+        for (int axis=0; axis<3; ++axis)
+        {
+          rayEndIjk[axis] = data->RayEndOriginIjk[axis] + columnIndex * data->RayEndColumnStepIjk[axis] + rowIndex * data->RayEndRowStepIjk[axis];
+          rayEndRas[axis] = data->RayEndOriginRas[axis] + columnIndex * data->RayEndColumnStepRas[axis] + rowIndex * data->RayEndRowStepRas[axis];
+        }
+        double rayLength = sqrt(vtkMath::Distance2BetweenPoints(data->SourceRas, rayEndRas));
+        outputPtr[columnIndex] = static_cast<float>(TraceRay(data, data->SourceIjk, rayEndIjk) * rayLength);
+      }
+    }
+
+    return VTK_THREAD_RETURN_VALUE;
+  }
+}
+
+//----------------------------------------------------------------------------
+class vtkSlicerDRRCalculationEngine::vtkInternal
+{
+public:
+  vtkInternal();
+
+public:
+  /// Input CT volume
+  vtkSmartPointer<vtkImageData> InputImageData;
+  /// IJK to RAS matrix of the input volume
+  vtkSmartPointer<vtkMatrix4x4> InputIjkToRasMatrix;
+
+  /// Input volume converted to linear attenuation coefficients
+  vtkSmartPointer<vtkImageData> AttenuationImageData;
+  /// Modified time of the input image data when it was converted
+  unsigned long AttenuationInputMTime;
+  /// Water attenuation coefficient used for the conversion
+  double AttenuationWaterCoefficient;
+};
+
+//----------------------------------------------------------------------------
+vtkSlicerDRRCalculationEngine::vtkInternal::vtkInternal()
+{
+  this->InputIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->AttenuationInputMTime = 0;
+  this->AttenuationWaterCoefficient = 0.0;
+}
+
+vtkStandardNewMacro(vtkSlicerDRRCalculationEngine);
+
+//----------------------------------------------------------------------------
+vtkSlicerDRRCalculationEngine::vtkSlicerDRRCalculationEngine()
+{
+  this->SAD = 2000.0;
+  this->GantryAngle = 0.0;
+  this->CollimatorAngle = 0.0;
+  this->CouchAngle = 0.0;
+  this->IsocenterPosition[0] = this->IsocenterPosition[1] = this->IsocenterPosition[2] = 0.0;
+  this->ImageSize[0] = this->ImageSize[1] = 256;
+  this->ImageSpacing[0] = this->ImageSpacing[1] = 1.0;
+  // Approximate linear attenuation coefficient of water for diagnostic energies
+  this->WaterAttenuationCoefficient = 0.02;
+  this->NumberOfThreads = 0;
+
+  this->Internal = new vtkInternal;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerDRRCalculationEngine::~vtkSlicerDRRCalculationEngine()
+{
+  delete this->Internal;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDRRCalculationEngine::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "SAD: " << this->SAD << "\n";
+  os << indent << "GantryAngle: " << this->GantryAngle << "\n";
+  os << indent << "CollimatorAngle: " << this->CollimatorAngle << "\n";
+  os << indent << "CouchAngle: " << this->CouchAngle << "\n";
+  os << indent << "IsocenterPosition: " << this->IsocenterPosition[0] << " " << this->IsocenterPosition[1] << " " << this->IsocenterPosition[2] << "\n";
+  os << indent << "ImageSize: " << this->ImageSize[0] << " " << this->ImageSize[1] << "\n";
+  os << indent << "ImageSpacing: " << this->ImageSpacing[0] << " " << this->ImageSpacing[1] << "\n";
+  os << indent << "WaterAttenuationCoefficient: " << this->WaterAttenuationCoefficient << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDRRCalculationEngine::SetInputVolume(vtkImageData* imageData, vtkMatrix4x4* ijkToRasMatrix)
+{
+  this->Internal->InputImageData = imageData;
+  if (ijkToRasMatrix)
+  {
+    this->Internal->InputIjkToRasMatrix->DeepCopy(ijkToRasMatrix);
+  }
+  else
+  {
+    this->Internal->InputIjkToRasMatrix->Identity();
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDRRCalculationEngine::SetBeamGeometry(vtkMRMLRTBeamNode* beamNode)
+{
+  if (!beamNode)
+  {
+    vtkErrorMacro("SetBeamGeometry: Invalid beam node!");
+    return;
+  }
+
+  this->SetSAD(beamNode->GetSAD());
+  this->SetGantryAngle(beamNode->GetGantryAngle());
+  this->SetCollimatorAngle(beamNode->GetCollimatorAngle());
+  this->SetCouchAngle(beamNode->GetCouchAngle());
+  double isocenter[3] = {0.0, 0.0, 0.0};
+  beamNode->GetIsocenterPosition(isocenter);
+  this->SetIsocenterPosition(isocenter);
+
+  // Fit the image to the field. The image is centered on the beam axis, so the largest jaw opening determines the size
+  double maximumJawPosition = std::max( std::max(fabs(beamNode->GetX1Jaw()), fabs(beamNode->GetX2Jaw())),
+    std::max(fabs(beamNode->GetY1Jaw()), fabs(beamNode->GetY2Jaw())) );
+  if (maximumJawPosition > 0.0 && this->ImageSize[0] > 0 && this->ImageSize[1] > 0)
+  {
+    double spacing = 2.0 * maximumJawPosition * DRR_FIELD_MARGIN_FACTOR / std::max(this->ImageSize[0], this->ImageSize[1]);
+    this->SetImageSpacing(spacing, spacing);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDRRCalculationEngine::GetBeamToRasMatrix(vtkMatrix4x4* beamToRasMatrix)
+{
+  if (!beamToRasMatrix)
+  {
+    return;
+  }
+
+  // Same beam orientation as the beam model (\sa vtkMRMLRTBeamNode::UpdateBeamTransform).
+  // The couch rotates the patient around the vertical axis, so the beam rotates the opposite way relative to the patient.
+  vtkSmartPointer<vtkTransform> beamToRasTransform = vtkSmartPointer<vtkTransform>::New();
+  beamToRasTransform->Identity();
+  beamToRasTransform->RotateY(-this->CouchAngle);
+  beamToRasTransform->RotateZ(this->GantryAngle);
+  beamToRasTransform->RotateY(this->CollimatorAngle);
+  beamToRasTransform->RotateX(-90);
+  beamToRasTransform->PostMultiply();
+  beamToRasTransform->Translate(this->IsocenterPosition);
+
+  beamToRasMatrix->DeepCopy(beamToRasTransform->GetMatrix());
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDRRCalculationEngine::GetImageIjkToRasMatrix(vtkMatrix4x4* ijkToRasMatrix)
+{
+  if (!ijkToRasMatrix)
+  {
+    return;
+  }
+
+  // Pixels on the isocenter plane, centered on the beam axis
+  vtkSmartPointer<vtkMatrix4x4> beamToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->GetBeamToRasMatrix(beamToRasMatrix);
+
+  vtkSmartPointer<vtkMatrix4x4> imageToBeamMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  imageToBeamMatrix->SetElement(0, 0, this->ImageSpacing[0]);
+  imageToBeamMatrix->SetElement(1, 1, this->ImageSpacing[1]);
+  imageToBeamMatrix->SetElement(0, 3, -0.5 * (this->ImageSize[0] - 1) * this->ImageSpacing[0]);
+  imageToBeamMatrix->SetElement(1, 3, -0.5 * (this->ImageSize[1] - 1) * this->ImageSpacing[1]);
+  vtkMatrix4x4::Multiply4x4(beamToRasMatrix, imageToBeamMatrix, ijkToRasMatrix);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDRRCalculationEngine::UpdateAttenuationVolume()
+{
+  vtkImageData* inputImageData = this->Internal->InputImageData;
+  if (!inputImageData || !inputImageData->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("UpdateAttenuationVolume: Invalid input volume!");
+    return false;
+  }
+
+  if ( this->Internal->AttenuationImageData.GetPointer()
+    && this->Internal->AttenuationInputMTime == inputImageData->GetMTime()
+    && this->Internal->AttenuationWaterCoefficient == this->WaterAttenuationCoefficient )
+  {
+    return true;
+  }
+
+  vtkSmartPointer<vtkImageData> attenuationImageData = vtkSmartPointer<vtkImageData>::New();
+  attenuationImageData->SetExtent(inputImageData->GetExtent());
+  attenuationImageData->AllocateScalars(VTK_FLOAT, 1);
+
+  vtkIdType numberOfVoxels = attenuationImageData->GetNumberOfPoints();
+  float* attenuationPtr = static_cast<float*>(attenuationImageData->GetScalarPointer());
+  void* huPtr = inputImageData->GetScalarPointer();
+  switch (inputImageData->GetScalarType())
+  {
+    vtkTemplateMacro(ConvertHounsfieldUnitsToAttenuation<VTK_TT>(static_cast<VTK_TT*>(huPtr), attenuationPtr, numberOfVoxels, this->WaterAttenuationCoefficient));
+  default:
+    vtkErrorMacro("UpdateAttenuationVolume: Unsupported scalar type " << inputImageData->GetScalarTypeAsString());
+    return false;
+  }
+
+  this->Internal->AttenuationImageData = attenuationImageData;
+  this->Internal->AttenuationInputMTime = inputImageData->GetMTime();
+  this->Internal->AttenuationWaterCoefficient = this->WaterAttenuationCoefficient;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDRRCalculationEngine::ComputeDRR(vtkImageData* outputImageData, vtkMatrix4x4* outputIjkToRasMatrix)
+{
+  if (!outputImageData || !outputIjkToRasMatrix)
+  {
+    vtkErrorMacro("ComputeDRR: Invalid output image or matrix!");
+    return false;
+  }
+  if (this->ImageSize[0] <= 0 || this->ImageSize[1] <= 0 || this->SAD <= 0.0)
+  {
+    vtkErrorMacro("ComputeDRR: Invalid image size or source to axis distance!");
+    return false;
+  }
+  if (!this->UpdateAttenuationVolume())
+  {
+    return false;
+  }
+  vtkImageData* attenuationImageData = this->Internal->AttenuationImageData;
+
+  vtkSmartPointer<vtkMatrix4x4> beamToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->GetBeamToRasMatrix(beamToRasMatrix);
+  this->GetImageIjkToRasMatrix(outputIjkToRasMatrix);
+
+  vtkSmartPointer<vtkMatrix4x4> rasToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(this->Internal->InputIjkToRasMatrix, rasToIjkMatrix);
+
+  // The rays are extended beyond the isocenter plane so that they traverse the whole volume
+  int extent[6] = {0, -1, 0, -1, 0, -1};
+  attenuationImageData->GetExtent(extent);
+  double diagonalIjk[4] = {extent[1]-extent[0]+1.0, extent[3]-extent[2]+1.0, extent[5]-extent[4]+1.0, 0.0};
+  double diagonalRas[4] = {0.0, 0.0, 0.0, 0.0};
+  this->Internal->InputIjkToRasMatrix->MultiplyPoint(diagonalIjk, diagonalRas);
+  double rayExtension = 1.0 + 2.0 * vtkMath::Norm(diagonalRas) / this->SAD;
+
+  DRRThreadData threadData;
+  threadData.Attenuation = static_cast<const float*>(attenuationImageData->GetScalarPointer());
+  attenuationImageData->GetExtent(threadData.Extent);
+  threadData.Increments[0] = 1;
+  threadData.Increments[1] = threadData.Extent[1] - threadData.Extent[0] + 1;
+  threadData.Increments[2] = threadData.Increments[1] * (threadData.Extent[3] - threadData.Extent[2] + 1);
+
+  // Source, end point of the first ray, and end point increments per column and row in RAS
+  double sourceBeam[4] = {0.0, 0.0, this->SAD, 1.0};
+  double sourceRas[4] = {0.0, 0.0, 0.0, 1.0};
+  beamToRasMatrix->MultiplyPoint(sourceBeam, sourceRas);
+  double firstPixelImage[4] = {0.0, 0.0, 0.0, 1.0};
+  double firstPixelRas[4] = {0.0, 0.0, 0.0, 1.0};
+  outputIjkToRasMatrix->MultiplyPoint(firstPixelImage, firstPixelRas);
+  double columnStepImage[4] = {1.0, 0.0, 0.0, 0.0};
+  double rowStepImage[4] = {0.0, 1.0, 0.0, 0.0};
+  double columnStepRas[4] = {0.0, 0.0, 0.0, 0.0};
+  double rowStepRas[4] = {0.0, 0.0, 0.0, 0.0};
+  outputIjkToRasMatrix->MultiplyPoint(columnStepImage, columnStepRas);
+  outputIjkToRasMatrix->MultiplyPoint(rowStepImage, rowStepRas);
+
+  double rayEndOriginRas[4] = {0.0, 0.0, 0.0, 1.0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    threadData.SourceRas[axis] = sourceRas[axis];
+    rayEndOriginRas[axis] = sourceRas[axis] + (firstPixelRas[axis] - sourceRas[axis]) * rayExtension;
+    threadData.RayEndOriginRas[axis] = rayEndOriginRas[axis];
+    threadData.RayEndColumnStepRas[axis] = columnStepRas[axis] * rayExtension;
+    threadData.RayEndRowStepRas[axis] = rowStepRas[axis] * rayExtension;
+  }
+
+  // Same in IJK of the volume (the transform is affine, so the increments can be transformed as vectors)
+  double sourceIjk[4] = {0.0, 0.0, 0.0, 1.0};
+  double rayEndOriginIjk[4] = {0.0, 0.0, 0.0, 1.0};
+  double columnStepIjk[4] = {0.0, 0.0, 0.0, 0.0};
+  double rowStepIjk[4] = {0.0, 0.0, 0.0, 0.0};
+  double rayEndColumnStepRas[4] = {threadData.RayEndColumnStepRas[0], threadData.RayEndColumnStepRas[1], threadData.RayEndColumnStepRas[2], 0.0};
+  double rayEndRowStepRas[4] = {threadData.RayEndRowStepRas[0], threadData.RayEndRowStepRas[1], threadData.RayEndRowStepRas[2], 0.0};
+  rasToIjkMatrix->MultiplyPoint(sourceRas, sourceIjk);
+  rasToIjkMatrix->MultiplyPoint(rayEndOriginRas, rayEndOriginIjk);
+  rasToIjkMatrix->MultiplyPoint(rayEndColumnStepRas, columnStepIjk);
+  rasToIjkMatrix->MultiplyPoint(rayEndRowStepRas, rowStepIjk);
+  for (int axis=0; axis<3; ++axis)
+  {
+    threadData.SourceIjk[axis] = sourceIjk[axis];
+    threadData.RayEndOriginIjk[axis] = rayEndOriginIjk[axis];
+    threadData.RayEndColumnStepIjk[axis] = columnStepIjk[axis];
+    threadData.RayEndRowStepIjk[axis] = rowStepIjk[axis];
+  }
+
+  // Allocate output
+  outputImageData->SetExtent(0, this->ImageSize[0]-1, 0, this->ImageSize[1]-1, 0, 0);
+  outputImageData->SetOrigin(0.0, 0.0, 0.0);
+  outputImageData->SetSpacing(1.0, 1.0, 1.0);
+  outputImageData->AllocateScalars(VTK_FLOAT, 1);
+  threadData.Output = static_cast<float*>(outputImageData->GetScalarPointer());
+  threadData.ImageSize[0] = this->ImageSize[0];
+  threadData.ImageSize[1] = this->ImageSize[1];
+  threadData.NextRowIndex = 0;
+  threadData.Lock = vtkSmartPointer<vtkMutexLock>::New();
+
+  // Trace the rays, the threads take the image rows one by one
+  int numberOfThreads = (this->NumberOfThreads > 0 ? this->NumberOfThreads : vtkMultiThreader::GetGlobalDefaultNumberOfThreads());
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(std::max(1, std::min(numberOfThreads, this->ImageSize[1])));
+  threader->SetSingleMethod(DRRThreadFunction, &threadData);
+  threader->SingleMethodExecute();
+
+  outputImageData->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDRRCalculationEngine::ProjectPoints(vtkPolyData* polyData, vtkMatrix4x4* polyDataToRasMatrix, std::vector<double>& projectedPoints, std::vector<bool>& validPoints)
+{
+  vtkSmartPointer<vtkMatrix4x4> polyDataToBeamMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->GetBeamToRasMatrix(polyDataToBeamMatrix);
+  polyDataToBeamMatrix->Invert();
+  if (polyDataToRasMatrix)
+  {
+    vtkMatrix4x4::Multiply4x4(polyDataToBeamMatrix, polyDataToRasMatrix, polyDataToBeamMatrix);
+  }
+
+  vtkIdType numberOfPoints = (polyData->GetPoints() ? polyData->GetNumberOfPoints() : 0);
+  projectedPoints.resize(2 * numberOfPoints);
+  validPoints.resize(numberOfPoints);
+  for (vtkIdType pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+  {
+    double point[4] = {0.0, 0.0, 0.0, 1.0};
+    polyData->GetPoint(pointIndex, point);
+    double pointBeam[4] = {0.0, 0.0, 0.0, 1.0};
+    polyDataToBeamMatrix->MultiplyPoint(point, pointBeam);
+
+    // The source is at (0,0,SAD), the rays diverge from the source to the isocenter plane (z=0)
+    double distanceFromSource = this->SAD - pointBeam[2];
+    validPoints[pointIndex] = (distanceFromSource > 1e-6 * this->SAD);
+    double magnification = (validPoints[pointIndex] ? this->SAD / distanceFromSource : 0.0);
+    projectedPoints[2*pointIndex] = pointBeam[0] * magnification;
+    projectedPoints[2*pointIndex+1] = pointBeam[1] * magnification;
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDRRCalculationEngine::ProjectPolyData(vtkPolyData* polyData, vtkMatrix4x4* polyDataToRasMatrix, vtkImageData* labelmap, unsigned short label)
+{
+  if (!polyData || !labelmap)
+  {
+    vtkErrorMacro("ProjectPolyData: Invalid input structure or output labelmap!");
+    return false;
+  }
+  int* dimensions = labelmap->GetDimensions();
+  if ( labelmap->GetScalarType() != VTK_UNSIGNED_SHORT || labelmap->GetNumberOfScalarComponents() != 1
+    || dimensions[0] != this->ImageSize[0] || dimensions[1] != this->ImageSize[1] || dimensions[2] != 1 )
+  {
+    vtkErrorMacro("ProjectPolyData: Output labelmap must be an unsigned short image with the size of the DRR image!");
+    return false;
+  }
+  if (this->SAD <= 0.0 || this->ImageSpacing[0] <= 0.0 || this->ImageSpacing[1] <= 0.0)
+  {
+    vtkErrorMacro("ProjectPolyData: Invalid source to axis distance or image spacing!");
+    return false;
+  }
+
+  std::vector<double> projectedPoints;
+  std::vector<bool> validPoints;
+  this->ProjectPoints(polyData, polyDataToRasMatrix, projectedPoints, validPoints);
+  ConvertProjectedPointsToPixels(projectedPoints, this->ImageSize, this->ImageSpacing);
+
+  // Surface triangles are filled one by one, their union is the projection of the surface
+  unsigned short* labelmapPtr = static_cast<unsigned short*>(labelmap->GetScalarPointer());
+  std::vector<std::vector<double> > polygons(1);
+  vtkIdType numberOfCellPoints = 0;
+  vtkIdType* cellPointIds = NULL;
+  vtkCellArray* polys = polyData->GetPolys();
+  if (polys)
+  {
+    for (polys->InitTraversal(); polys->GetNextCell(numberOfCellPoints, cellPointIds); )
+    {
+      if (GetProjectedPolygon(numberOfCellPoints, cellPointIds, projectedPoints, validPoints, polygons[0]))
+      {
+        FillProjectedPolygons(polygons, labelmapPtr, this->ImageSize, label);
+      }
+    }
+  }
+
+  // Planar contours: sort the contours by slice (z coordinate of the first point in the poly data coordinate system)
+  vtkCellArray* lines = polyData->GetLines();
+  std::vector<std::pair<double, std::vector<vtkIdType> > > contours;
+  if (lines)
+  {
+    for (lines->InitTraversal(); lines->GetNextCell(numberOfCellPoints, cellPointIds); )
+    {
+      if (numberOfCellPoints < 3)
+      {
+        continue;
+      }
+      double firstPoint[3] = {0.0, 0.0, 0.0};
+      polyData->GetPoint(cellPointIds[0], firstPoint);
+      contours.push_back(std::make_pair(firstPoint[2], std::vector<vtkIdType>(cellPointIds, cellPointIds + numberOfCellPoints)));
+    }
+  }
+  if (contours.empty())
+  {
+    labelmap->Modified();
+    return true;
+  }
+  std::sort(contours.begin(), contours.end());
+
+  // Group the contours of the same slice. The slice thickness is the smallest distance between slices
+  std::vector<size_t> sliceFirstContourIndices;
+  double sliceThickness = VTK_DOUBLE_MAX;
+  for (size_t contourIndex=0; contourIndex<contours.size(); ++contourIndex)
+  {
+    double distanceFromSlice = ( sliceFirstContourIndices.empty() ? VTK_DOUBLE_MAX
+      : contours[contourIndex].first - contours[sliceFirstContourIndices.back()].first );
+    if (distanceFromSlice >= DRR_CONTOUR_SLICE_TOLERANCE_MM)
+    {
+      if (!sliceFirstContourIndices.empty())
+      {
+        sliceThickness = std::min(sliceThickness, distanceFromSlice);
+      }
+      sliceFirstContourIndices.push_back(contourIndex);
+    }
+  }
+  sliceFirstContourIndices.push_back(contours.size());
+  if (sliceThickness == VTK_DOUBLE_MAX)
+  {
+    sliceThickness = 0.0;
+  }
+
+  // Each contour represents the structure in a slab of the slice thickness around its plane. The projection
+  // of the slab is the union of the projections of its faces, so the contours are extruded along z to the
+  // two sides of the slab, and the two sides and the faces connecting them are projected. A beam that is
+  // perpendicular to the z axis sees the contours edge-on, then the projection is covered by the connecting
+  // faces. The contours of a slice are filled together, so that the contours of holes are not filled
+  vtkSmartPointer<vtkPoints> slabPoints = vtkSmartPointer<vtkPoints>::New();
+  std::vector<vtkIdType> contourFirstSlabPointIds;
+  for (size_t contourIndex=0; contourIndex<contours.size(); ++contourIndex)
+  {
+    contourFirstSlabPointIds.push_back(slabPoints->GetNumberOfPoints());
+    const std::vector<vtkIdType>& contourPointIds = contours[contourIndex].second;
+    for (size_t contourPointIndex=0; contourPointIndex<contourPointIds.size(); ++contourPointIndex)
+    {
+      double point[3] = {0.0, 0.0, 0.0};
+      polyData->GetPoint(contourPointIds[contourPointIndex], point);
+      slabPoints->InsertNextPoint(point[0], point[1], point[2] - 0.5 * sliceThickness);
+      slabPoints->InsertNextPoint(point[0], point[1], point[2] + 0.5 * sliceThickness);
+    }
+  }
+  vtkSmartPointer<vtkPolyData> slabPolyData = vtkSmartPointer<vtkPolyData>::New();
+  slabPolyData->SetPoints(slabPoints);
+  this->ProjectPoints(slabPolyData, polyDataToRasMatrix, projectedPoints, validPoints);
+  ConvertProjectedPointsToPixels(projectedPoints, this->ImageSize, this->ImageSpacing);
+
+  std::vector<vtkIdType> facePointIds;
+  for (size_t sliceIndex=0; sliceIndex+1<sliceFirstContourIndices.size(); ++sliceIndex)
+  {
+    // Sides of the slab (bottom points have even, top points have odd offsets)
+    for (int side=0; side<(sliceThickness > 0.0 ? 2 : 1); ++side)
+    {
+      polygons.clear();
+      for (size_t contourIndex=sliceFirstContourIndices[sliceIndex]; contourIndex<sliceFirstContourIndices[sliceIndex+1]; ++contourIndex)
+      {
+        facePointIds.clear();
+        for (size_t contourPointIndex=0; contourPointIndex<contours[contourIndex].second.size(); ++contourPointIndex)
+        {
+          facePointIds.push_back(contourFirstSlabPointIds[contourIndex] + (vtkIdType)(2*contourPointIndex + side));
+        }
+        polygons.push_back(std::vector<double>());
+        if (!GetProjectedPolygon((vtkIdType)facePointIds.size(), &(facePointIds[0]), projectedPoints, validPoints, polygons.back()))
+        {
+          polygons.pop_back();
+        }
+      }
+      FillProjectedPolygons(polygons, labelmapPtr, this->ImageSize, label);
+    }
+    if (sliceThickness <= 0.0)
+    {
+      continue;
+    }
+
+    // Faces connecting the two sides, one quadrilateral per contour segment
+    polygons.resize(1);
+    for (size_t contourIndex=sliceFirstContourIndices[sliceIndex]; contourIndex<sliceFirstContourIndices[sliceIndex+1]; ++contourIndex)
+    {
+      vtkIdType numberOfContourPoints = (vtkIdType)contours[contourIndex].second.size();
+      for (vtkIdType contourPointIndex=0; contourPointIndex<numberOfContourPoints; ++contourPointIndex)
+      {
+        vtkIdType pointId = contourFirstSlabPointIds[contourIndex] + 2*contourPointIndex;
+        vtkIdType nextPointId = contourFirstSlabPointIds[contourIndex] + 2*((contourPointIndex+1) % numberOfContourPoints);
+        vtkIdType quadPointIds[4] = { pointId, nextPointId, nextPointId+1, pointId+1 };
+        if (GetProjectedPolygon(4, quadPointIds, projectedPoints, validPoints, polygons[0]))
+        {
+          FillProjectedPolygons(polygons, labelmapPtr, this->ImageSize, label);
+        }
+      }
+    }
+  }
+
+  labelmap->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDRRCalculationEngine::GetProjectedBounds(vtkPolyData* polyData, vtkMatrix4x4* polyDataToRasMatrix, double bounds[4])
+{
+  if (!polyData || this->SAD <= 0.0)
+  {
+    vtkErrorMacro("GetProjectedBounds: Invalid input structure or source to axis distance!");
+    return false;
+  }
+
+  std::vector<double> projectedPoints;
+  std::vector<bool> validPoints;
+  this->ProjectPoints(polyData, polyDataToRasMatrix, projectedPoints, validPoints);
+
+  bool found = false;
+  for (size_t pointIndex=0; pointIndex<validPoints.size(); ++pointIndex)
+  {
+    if (!validPoints[pointIndex])
+    {
+      continue;
+    }
+    double x = projectedPoints[2*pointIndex];
+    double y = projectedPoints[2*pointIndex+1];
+    if (!found)
+    {
+      bounds[0] = bounds[1] = x;
+      bounds[2] = bounds[3] = y;
+      found = true;
+      continue;
+    }
+    bounds[0] = std::min(bounds[0], x);
+    bounds[1] = std::max(bounds[1], x);
+    bounds[2] = std::min(bounds[2], y);
+    bounds[3] = std::max(bounds[3], y);
+  }
+  return found;
+}
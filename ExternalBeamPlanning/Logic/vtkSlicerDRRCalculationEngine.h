@@ -0,0 +1,173 @@
+/*==============================================================================
+
+  Copyright (c) Radiation Medicine Program, University Health Network,
+  Princess Margaret Hospital, Toronto, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Kevin Wang, Princess Margaret Cancer Centre
+  and was supported by Cancer Care Ontario (CCO)'s ACRU program
+  with funds provided by the Ontario Ministry of Health and Long-Term Care
+  and Ontario Consortium for Adaptive Interventions in Radiation Oncology (OCAIRO).
+
+==============================================================================*/
+
+// .NAME vtkSlicerDRRCalculationEngine -
+// .SECTION Description
+// This class computes digitally reconstructed radiographs (DRR) of a CT volume and projections
+// of structures in the beam's eye view. Divergent rays are traced from the beam source through
+// the CT volume to the isocenter plane, and structures are projected analytically, without rendering.
+
+#ifndef __vtkSlicerDRRCalculationEngine_h
+#define __vtkSlicerDRRCalculationEngine_h
+
+// ExternalBeamPlanning includes
+#include "vtkSlicerExternalBeamPlanningModuleLogicExport.h"
+
+// VTK includes
+#include "vtkObject.h"
+
+// STD includes
+#include <vector>
+
+class vtkImageData;
+class vtkMatrix4x4;
+class vtkMRMLRTBeamNode;
+class vtkPolyData;
+
+/// \ingroup SlicerRt_ExternalBeamPlanning
+/// \brief Multithreaded DRR computation for the beam's eye view.
+///
+/// Each DRR pixel is the line integral of the linear attenuation coefficient along the ray from
+/// the beam source through the pixel. The rays are traversed voxel by voxel using the incremental
+/// Siddon-Jacobs algorithm, and the rows of the image are distributed between threads.
+/// The CT voxel values are interpreted as Hounsfield units and converted to attenuation once,
+/// so only the ray tracing is repeated when the beam geometry changes.
+/// The image plane is perpendicular to the beam axis at the isocenter.
+///
+/// Structures are projected by mapping their points through the divergent projection onto the
+/// isocenter plane and filling the projected cells with scanlines. For a closed surface the union
+/// of the projected triangles is the silhouette of the structure. Planar contours are extruded to
+/// slabs of the slice thickness, and the union of the projected faces of the slabs is used.
+class VTK_SLICER_EXTERNALBEAMPLANNING_MODULE_LOGIC_EXPORT vtkSlicerDRRCalculationEngine : public vtkObject
+{
+public:
+  static vtkSlicerDRRCalculationEngine *New();
+  vtkTypeMacro(vtkSlicerDRRCalculationEngine, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Set CT volume and its IJK to RAS matrix. The volume is only converted to attenuation
+  /// coefficients again if the image data changed since the last computation
+  void SetInputVolume(vtkImageData* imageData, vtkMatrix4x4* ijkToRasMatrix);
+
+  /// Copy source to axis distance, gantry, collimator and couch angles and isocenter from a beam node.
+  /// The image spacing is set so that the image covers the field defined by the jaws with a margin
+  void SetBeamGeometry(vtkMRMLRTBeamNode* beamNode);
+
+  /// Compute the DRR with the current input volume and beam geometry
+  /// \param outputImageData Output image with one slice, containing the line integrals of attenuation (float)
+  /// \param outputIjkToRasMatrix Matrix that places the output image on the isocenter plane in RAS
+  /// \return Success
+  bool ComputeDRR(vtkImageData* outputImageData, vtkMatrix4x4* outputIjkToRasMatrix);
+
+  /// Get matrix that places the DRR image on the isocenter plane in RAS
+  void GetImageIjkToRasMatrix(vtkMatrix4x4* ijkToRasMatrix);
+
+  /// Project a closed surface or planar contours (closed polylines or polygons) onto the image plane
+  /// through the divergent beam, and set the pixels covered by the projection to the given label.
+  /// Planar contours are grouped by their z coordinate, and the contours of a slice are filled together
+  /// with the even-odd rule, so the contours of holes within a slice are not filled. Each slice is
+  /// extruded along z to the slice thickness, so contours seen edge-on still cover their projection.
+  /// \param polyData Structure to project
+  /// \param polyDataToRasMatrix Transform of the structure to RAS. Identity is used if NULL
+  /// \param labelmap Image with the size of the DRR image and unsigned short scalars. Pixels outside
+  ///   the projection are not changed, so multiple structures can be projected into the same image
+  /// \param label Value of the pixels covered by the projection
+  /// \return Success
+  bool ProjectPolyData(vtkPolyData* polyData, vtkMatrix4x4* polyDataToRasMatrix, vtkImageData* labelmap, unsigned short label);
+
+  /// Get bounding box of the projection of a structure on the isocenter plane in the beam coordinate system
+  /// \param bounds Output bounds (xmin, xmax, ymin, ymax) in mm
+  /// \return False if no point of the structure is in front of the source
+  bool GetProjectedBounds(vtkPolyData* polyData, vtkMatrix4x4* polyDataToRasMatrix, double bounds[4]);
+
+  /// Get matrix that transforms from the beam coordinate system to RAS.
+  /// In the beam coordinate system the isocenter is at the origin and the source is at (0,0,SAD)
+  void GetBeamToRasMatrix(vtkMatrix4x4* beamToRasMatrix);
+
+  /// Source to axis distance (mm)
+  vtkSetMacro(SAD, double);
+  vtkGetMacro(SAD, double);
+
+  /// Gantry angle (degrees)
+  vtkSetMacro(GantryAngle, double);
+  vtkGetMacro(GantryAngle, double);
+
+  /// Collimator angle (degrees)
+  vtkSetMacro(CollimatorAngle, double);
+  vtkGetMacro(CollimatorAngle, double);
+
+  /// Couch angle (degrees)
+  vtkSetMacro(CouchAngle, double);
+  vtkGetMacro(CouchAngle, double);
+
+  /// Isocenter position in RAS
+  vtkSetVector3Macro(IsocenterPosition, double);
+  vtkGetVector3Macro(IsocenterPosition, double);
+
+  /// Number of pixels of the DRR image. Default is 256x256
+  vtkSetVector2Macro(ImageSize, int);
+  vtkGetVector2Macro(ImageSize, int);
+
+  /// Pixel spacing of the DRR image on the isocenter plane (mm). Default is 1mm
+  vtkSetVector2Macro(ImageSpacing, double);
+  vtkGetVector2Macro(ImageSpacing, double);
+
+  /// Linear attenuation coefficient of water (1/mm). Voxels of -1000 HU have zero attenuation,
+  /// voxels of 0 HU have the attenuation of water
+  vtkSetMacro(WaterAttenuationCoefficient, double);
+  vtkGetMacro(WaterAttenuationCoefficient, double);
+
+  /// Maximum number of threads used for ray tracing. Default number of threads is used if 0 (default)
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+protected:
+  /// Convert the input volume to attenuation coefficients if the input changed
+  bool UpdateAttenuationVolume();
+
+  /// Project the points of a structure onto the isocenter plane in beam coordinates (mm).
+  /// Points behind the source are marked invalid.
+  void ProjectPoints(vtkPolyData* polyData, vtkMatrix4x4* polyDataToRasMatrix, std::vector<double>& projectedPoints, std::vector<bool>& validPoints);
+
+protected:
+  double SAD;
+  double GantryAngle;
+  double CollimatorAngle;
+  double CouchAngle;
+  double IsocenterPosition[3];
+  int ImageSize[2];
+  double ImageSpacing[2];
+  double WaterAttenuationCoefficient;
+  int NumberOfThreads;
+
+protected:
+  vtkSlicerDRRCalculationEngine();
+  virtual ~vtkSlicerDRRCalculationEngine();
+
+private:
+  vtkSlicerDRRCalculationEngine(const vtkSlicerDRRCalculationEngine&); // Not implemented
+  void operator=(const vtkSlicerDRRCalculationEngine&);         // Not implemented
+
+  class vtkInternal;
+  vtkInternal* Internal;
+};
+
+#endif
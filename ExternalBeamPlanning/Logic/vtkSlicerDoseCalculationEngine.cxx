@@ -40,9 +40,14 @@
 #include <vtkObjectFactory.h>
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
+#include <map>
+#include <vector>
 
 //----------------------------------------------------------------------------
 class vtkSlicerDoseCalculationEngine::vtkInternal
@@ -50,6 +55,104 @@ class vtkSlicerDoseCalculationEngine::vtkInternal
 public:
   vtkInternal();
 
+  /// Inputs and outputs of the dose calculation of one beam.
+  /// Each beam has its own plan, beam and dose buffer, so beams can be calculated in parallel.
+  struct BeamDoseCalculation
+  {
+    BeamDoseCalculation();
+
+    /// Beam node the calculation was requested for. Not accessed during the calculation
+    vtkSmartPointer<vtkMRMLRTBeamNode> BeamNode;
+    /// Modified time of the beam node when the beam parameters were copied. Stored in the cache, so that
+    /// the results are not reused if the beam node is modified while the calculation is running
+    unsigned long BeamNodeMTime;
+    /// Copy of the beam parameters used by the calculation, so that the beam node
+    /// can be modified while the calculation is running
+    vtkSmartPointer<vtkMRMLRTProtonBeamNode> BeamParameters;
+    /// Target volume given by the caller. It may be shared by multiple beams, so it is
+    /// not accessed during the calculation, only used for identifying the cached results
+    Plm_image::Pointer Target;
+    /// Copy of the target volume used by the calculation of this beam only.
+    /// Plastimatch converts the target image in place, so the beams cannot share it
+    Plm_image::Pointer BeamTarget;
+    /// Target volume of this beam as ITK image (converted before the calculation is started)
+    itk::Image<unsigned char, 3>::Pointer TargetItk;
+    double Isocenter[3];
+    double Source[3];
+    double RxDose;
+
+    /// Calculated range compensator
+    itk::Image<float, 3>::Pointer RangeCompensatorVolumeItk;
+    /// Calculated aperture
+    itk::Image<unsigned char, 3>::Pointer ApertureVolumeItk;
+    /// Calculated dose
+    itk::Image<float, 3>::Pointer DoseVolumeItk;
+    /// Error message if the calculation failed, empty otherwise
+    std::string ErrorMessage;
+    /// Flag indicating that the dose has already been added to the accumulated dose
+    bool Accumulated;
+    /// Flag indicating that the results were taken from the cache, so no calculation is needed
+    bool Cached;
+    /// Flag indicating that the calculation was stopped because cancel was requested
+    bool Cancelled;
+  };
+
+  /// Results of a previous calculation of a beam, and the inputs that were used for it.
+  /// The inputs are compared to the ones of the next calculation of the same beam, and the
+  /// results are reused if none of them changed.
+  struct CachedBeamDose
+  {
+    CachedBeamDose();
+
+    /// Modified time of the beam node (all beam, aperture and energy parameters)
+    unsigned long BeamNodeMTime;
+    double Isocenter[3];
+    double Source[3];
+    double RxDose;
+    /// Reference volume. Stored so that its address cannot be reused by a different volume
+    Plm_image::Pointer Reference;
+    /// Target volume. Stored so that its address cannot be reused by a different volume
+    Plm_image::Pointer Target;
+
+    itk::Image<float, 3>::Pointer RangeCompensatorVolumeItk;
+    itk::Image<unsigned char, 3>::Pointer ApertureVolumeItk;
+    itk::Image<float, 3>::Pointer DoseVolumeItk;
+  };
+
+  /// Calculate dose for one beam. Does not access any shared state other than the reference volume,
+  /// which is only read, so it can be called from multiple threads at the same time.
+  /// If internal is given, then progress is reported and cancel requests are checked between the steps
+  static bool CalculateBeamDose(BeamDoseCalculation& beam, itk::Image<short, 3>::Pointer referenceVolumeItk, vtkInternal* internal=NULL);
+
+  /// Thread function calculating the dose for the queued beams. The beams are taken one by one
+  /// from the queue, as calculation time differs between beams
+  static VTK_THREAD_RETURN_TYPE BeamDoseThreadFunction(void* arg);
+
+  /// Thread function running the beam dose threads in the background (\sa StartDoseCalculationForAllBeams)
+  static VTK_THREAD_RETURN_TYPE DoseCalculationThreadFunction(void* arg);
+
+  /// Return true if the calculation is requested to be stopped. Thread safe
+  bool IsCancelRequested();
+
+  /// Increase number of completed calculation steps. Thread safe
+  void CompleteBeamCalculationStep(int numberOfSteps=1);
+
+  /// Thread function adding a range of voxels of the beam doses to the accumulated dose
+  static VTK_THREAD_RETURN_TYPE AccumulateDoseThreadFunction(void* arg);
+
+  /// Add a calculation for a beam. Performs all the operations that are not thread safe.
+  /// \return False if the inputs are invalid
+  bool InitializeBeamDoseCalculation(BeamDoseCalculation& beam,
+    vtkMRMLRTBeamNode* beamNode, Plm_image::Pointer& plmTgt, double isocenter[], double src[], double RxDose);
+
+  /// Set results of a beam from the cache if the inputs have not changed since the last calculation
+  /// \return True if cached results were found
+  bool GetCachedBeamDose(BeamDoseCalculation& beam);
+
+  /// Store results of a successful beam calculation in the cache
+  void SetCachedBeamDose(BeamDoseCalculation& beam);
+
+public:
   /// Pointer that contains the dose
   Plm_image::Pointer plmRef;
 
@@ -67,73 +170,222 @@ public:
 
   /// Pointer that contains the dose
   float TotalRx;
+
+  /// Beams queued for the parallel dose calculation
+  std::vector<BeamDoseCalculation> Beams;
+
+  /// Reference volume shared by the beam dose threads
+  itk::Image<short, 3>::Pointer ReferenceVolumeItk;
+
+  /// Index of the next beam to calculate by the beam dose threads
+  unsigned int NextBeamIndex;
+
+  /// Lock for the beam queue and the state of the calculation
+  vtkSmartPointer<vtkMutexLock> CalculationLock;
+
+  /// Maximum number of beams calculated in parallel
+  int NumberOfThreads;
+
+  /// Number of beam dose threads used by the running calculation
+  int NumberOfBeamThreads;
+
+  /// Threader running the calculation in the background
+  vtkSmartPointer<vtkMultiThreader> CalculationThreader;
+
+  /// ID of the background calculation thread, -1 if there is none
+  int CalculationThreadID;
+
+  /// Flag indicating that the background calculation thread is still calculating beams
+  bool CalculationRunning;
+
+  /// Flag indicating that the calculation should be stopped as soon as possible
+  bool CancelRequested;
+
+  /// Number of beam calculation steps completed, for progress reporting
+  int NumberOfCompletedSteps;
+
+  /// Results of the last calculation of the beams, keyed by beam node ID
+  std::map<std::string, CachedBeamDose> BeamDoseCache;
 };
 
 //----------------------------------------------------------------------------
 vtkSlicerDoseCalculationEngine::vtkInternal::vtkInternal()
 {
   this->TotalRx = 0.f;
+  this->NextBeamIndex = 0;
+  this->CalculationLock = vtkSmartPointer<vtkMutexLock>::New();
+  this->NumberOfThreads = 0;
+  this->NumberOfBeamThreads = 1;
+  this->CalculationThreader = vtkSmartPointer<vtkMultiThreader>::New();
+  this->CalculationThreadID = -1;
+  this->CalculationRunning = false;
+  this->CancelRequested = false;
+  this->NumberOfCompletedSteps = 0;
 }
 
-vtkStandardNewMacro(vtkSlicerDoseCalculationEngine);
+//----------------------------------------------------------------------------
+// Number of steps reported for the calculation of each beam: preparation, beam modifiers, dose
+static const int NUMBER_OF_STEPS_PER_BEAM = 3;
 
 //----------------------------------------------------------------------------
-vtkSlicerDoseCalculationEngine::vtkSlicerDoseCalculationEngine()
+vtkSlicerDoseCalculationEngine::vtkInternal::BeamDoseCalculation::BeamDoseCalculation()
 {
-  this->Internal = new vtkInternal;
+  this->BeamNode = NULL;
+  this->BeamNodeMTime = 0;
+  this->Isocenter[0] = this->Isocenter[1] = this->Isocenter[2] = 0.0;
+  this->Source[0] = this->Source[1] = this->Source[2] = 0.0;
+  this->RxDose = 0.0;
+  this->Accumulated = false;
+  this->Cached = false;
+  this->Cancelled = false;
 }
 
 //----------------------------------------------------------------------------
-vtkSlicerDoseCalculationEngine::~vtkSlicerDoseCalculationEngine()
+vtkSlicerDoseCalculationEngine::vtkInternal::CachedBeamDose::CachedBeamDose()
 {
-  delete this->Internal;
+  this->BeamNodeMTime = 0;
+  this->Isocenter[0] = this->Isocenter[1] = this->Isocenter[2] = 0.0;
+  this->Source[0] = this->Source[1] = this->Source[2] = 0.0;
+  this->RxDose = 0.0;
 }
 
 //----------------------------------------------------------------------------
-void vtkSlicerDoseCalculationEngine::PrintSelf(ostream& os, vtkIndent indent)
+bool vtkSlicerDoseCalculationEngine::vtkInternal::InitializeBeamDoseCalculation(BeamDoseCalculation& beam,
+  vtkMRMLRTBeamNode* beamNode, Plm_image::Pointer& plmTgt, double isocenter[], double src[], double RxDose)
 {
-  this->Superclass::PrintSelf(os, indent);
+  vtkMRMLRTProtonBeamNode* protonBeamNode = vtkMRMLRTProtonBeamNode::SafeDownCast(beamNode);
+  if (!protonBeamNode || !plmTgt || !this->plmRef)
+  {
+    beam.ErrorMessage = "Invalid inputs";
+    return false;
+  }
+
+  // Sanity check of aperture parameters modifies the beam node, so it must not be done in the worker threads
+  protonBeamNode->UpdateApertureParameters(beamNode->GetSAD());
+
+  beam.BeamNode = beamNode;
+  beam.BeamNodeMTime = beamNode->GetMTime();
+
+  // Copy the parameters used by the calculation
+  beam.BeamParameters = vtkSmartPointer<vtkMRMLRTProtonBeamNode>::New();
+  beam.BeamParameters->SetBeamWeight(protonBeamNode->GetBeamWeight());
+  beam.BeamParameters->SetSmearing(protonBeamNode->GetSmearing());
+  beam.BeamParameters->SetAlgorithm(protonBeamNode->GetAlgorithm());
+  beam.BeamParameters->SetLateralSpreadHomoApprox(protonBeamNode->GetLateralSpreadHomoApprox());
+  beam.BeamParameters->SetRangeCompensatorHighland(protonBeamNode->GetRangeCompensatorHighland());
+  beam.BeamParameters->SetSourceSize(protonBeamNode->GetSourceSize());
+  beam.BeamParameters->SetStepLength(protonBeamNode->GetStepLength());
+  beam.BeamParameters->SetApertureOffset(protonBeamNode->GetApertureOffset());
+  beam.BeamParameters->SetApertureOrigin(protonBeamNode->GetApertureOrigin());
+  beam.BeamParameters->SetApertureSpacing(protonBeamNode->GetApertureSpacing());
+  beam.BeamParameters->SetApertureDim(protonBeamNode->GetApertureDim());
+  beam.BeamParameters->SetBeamLineType(protonBeamNode->GetBeamLineType());
+  beam.BeamParameters->SetManualEnergyLimits(protonBeamNode->GetManualEnergyLimits());
+  beam.BeamParameters->SetMinimumEnergy(protonBeamNode->GetMinimumEnergy());
+  beam.BeamParameters->SetMaximumEnergy(protonBeamNode->GetMaximumEnergy());
+  beam.BeamParameters->SetProximalMargin(protonBeamNode->GetProximalMargin());
+  beam.BeamParameters->SetDistalMargin(protonBeamNode->GetDistalMargin());
+  beam.BeamParameters->SetEnergyResolution(protonBeamNode->GetEnergyResolution());
+  beam.BeamParameters->SetEnergySpread(protonBeamNode->GetEnergySpread());
+
+  beam.Target = plmTgt;
+  for (int i=0; i<3; ++i)
+  {
+    beam.Isocenter[i] = isocenter[i];
+    beam.Source[i] = src[i];
+  }
+  beam.RxDose = RxDose;
+
+  if (this->GetCachedBeamDose(beam))
+  {
+    return true;
+  }
+
+  // Conversion changes the Plm_image, so it is done before the threads are started, and each
+  // beam gets its own copy of the target that the calculation is allowed to convert
+  plmTgt->itk_uchar();
+  beam.BeamTarget = plmTgt->clone();
+  beam.TargetItk = beam.BeamTarget->itk_uchar();
+  return true;
 }
 
 //----------------------------------------------------------------------------
-void vtkSlicerDoseCalculationEngine::InitializeAccumulatedDose(Plm_image::Pointer plmRef)
+bool vtkSlicerDoseCalculationEngine::vtkInternal::GetCachedBeamDose(BeamDoseCalculation& beam)
 {
-  this->Internal->plmRef = plmRef;
-  itk::Image<short, 3>::Pointer referenceVolumeItk = this->Internal->plmRef->itk_short();
+  if (!beam.BeamNode || !beam.BeamNode->GetID())
+  {
+    return false;
+  }
+  std::map<std::string, CachedBeamDose>::iterator cacheIt = this->BeamDoseCache.find(beam.BeamNode->GetID());
+  if (cacheIt == this->BeamDoseCache.end())
+  {
+    return false;
+  }
 
-  this->Internal->accumulateVolumeItk = itk_image_create<float>(Plm_image_header(referenceVolumeItk));
-  this->Internal->doseVolumeItk = itk_image_create<float>(Plm_image_header(referenceVolumeItk));
-  this->Internal->TotalRx = 0.f;
+  CachedBeamDose& cached = cacheIt->second;
+  if ( cached.BeamNodeMTime != beam.BeamNodeMTime
+    || cached.Reference.get() != this->plmRef.get()
+    || cached.Target.get() != beam.Target.get()
+    || cached.RxDose != beam.RxDose )
+  {
+    return false;
+  }
+  for (int i=0; i<3; ++i)
+  {
+    if (cached.Isocenter[i] != beam.Isocenter[i] || cached.Source[i] != beam.Source[i])
+    {
+      return false;
+    }
+  }
+
+  beam.RangeCompensatorVolumeItk = cached.RangeCompensatorVolumeItk;
+  beam.ApertureVolumeItk = cached.ApertureVolumeItk;
+  beam.DoseVolumeItk = cached.DoseVolumeItk;
+  beam.Cached = true;
+  return true;
 }
 
 //----------------------------------------------------------------------------
-void vtkSlicerDoseCalculationEngine::CalculateDose(
-  vtkMRMLRTBeamNode* beamNode, 
-  Plm_image::Pointer& plmTgt,
-  double isocenter[],
-  double src[],
-  double RxDose)
+void vtkSlicerDoseCalculationEngine::vtkInternal::SetCachedBeamDose(BeamDoseCalculation& beam)
 {
-  vtkMRMLRTProtonBeamNode* protonBeamNode = vtkMRMLRTProtonBeamNode::SafeDownCast (beamNode);
-  
-  this->Internal->plmRef->print ();
-  plmTgt->print ();
+  if ( beam.Cached || !beam.ErrorMessage.empty() || beam.DoseVolumeItk.IsNull()
+    || !beam.BeamNode || !beam.BeamNode->GetID() )
+  {
+    return;
+  }
 
-  float origin[3] = {plmTgt->origin(0),plmTgt->origin(1), plmTgt->origin(2)};
-  float spacing[3] = {plmTgt->spacing(0),plmTgt->spacing(1), plmTgt->spacing(2)};
-  plm_long dim[3] = {(plm_long) plmTgt->dim(0), (plm_long) plmTgt->dim(1), (plm_long) plmTgt->dim(2)};
+  CachedBeamDose& cached = this->BeamDoseCache[beam.BeamNode->GetID()];
+  cached.BeamNodeMTime = beam.BeamNodeMTime;
+  for (int i=0; i<3; ++i)
+  {
+    cached.Isocenter[i] = beam.Isocenter[i];
+    cached.Source[i] = beam.Source[i];
+  }
+  cached.RxDose = beam.RxDose;
+  cached.Reference = this->plmRef;
+  cached.Target = beam.Target;
+  cached.RangeCompensatorVolumeItk = beam.RangeCompensatorVolumeItk;
+  cached.ApertureVolumeItk = beam.ApertureVolumeItk;
+  cached.DoseVolumeItk = beam.DoseVolumeItk;
+}
 
-#if defined (commentout)
-  /* This is debugging code, for checking the input volume */
-  double min_val, max_val, avg;
-  int non_zero, num_vox;
-  itk_image_stats (Internal->plmRef->m_itk_int32, &min_val, &max_val, &avg, &non_zero, &num_vox);
-  printf ("MIN %f AVE %f MAX %f NONZERO %d NUMVOX %d\n", 
-    (float) min_val, (float) avg, (float) max_val, non_zero, num_vox);
-#endif
+//----------------------------------------------------------------------------
+bool vtkSlicerDoseCalculationEngine::vtkInternal::CalculateBeamDose(BeamDoseCalculation& beam, itk::Image<short, 3>::Pointer referenceVolumeItk, vtkInternal* internal/*=NULL*/)
+{
+  // Only the copy of the beam parameters is used, the beam node may be modified meanwhile
+  vtkMRMLRTProtonBeamNode* protonBeamNode = beam.BeamParameters;
+  vtkMRMLRTBeamNode* beamNode = protonBeamNode;
+  if (!protonBeamNode)
+  {
+    beam.ErrorMessage = "Dose calculation is only available for proton beams";
+    return false;
+  }
 
-  itk::Image<short, 3>::Pointer referenceVolumeItk = this->Internal->plmRef->itk_short();
-  itk::Image<unsigned char, 3>::Pointer targetVolumeItk = plmTgt->itk_uchar();
+  Plm_image::Pointer& plmTgt = beam.BeamTarget;
+  itk::Image<unsigned char, 3>::Pointer targetVolumeItk = beam.TargetItk;
+  double* isocenter = beam.Isocenter;
+  double* src = beam.Source;
+  double RxDose = beam.RxDose;
 
   Rt_plan rt_plan;
   Rt_beam *rt_beam;
@@ -148,32 +400,19 @@ void vtkSlicerDoseCalculationEngine::CalculateDose(
     // Assign inputs to dose calc logic
 
     // Update plan
-    printf("\n ***PLAN PARAMETERS***\n");
-    printf ("Setting reference volume\n");
     rt_plan.set_patient (referenceVolumeItk);
-    printf ("Setting target volume\n");
     rt_plan.set_target (targetVolumeItk);
-    printf ("Setting reference dose point -> ");
     rt_plan.set_ref_dose_point(isocenter); // MD Fix, for the moment, the reference dose point is the isocenter
-    printf("Reference dose position: %lg %lg %lg\n", rt_plan.get_ref_dose_point()[0], rt_plan.get_ref_dose_point()[1], rt_plan.get_ref_dose_point()[2]);
     rt_plan.set_have_ref_dose_point(true);
     rt_plan.set_have_dose_norm(true);
-    printf ("Setting dose prescription -> ");
     rt_plan.set_normalization_dose(RxDose);
-    printf("Dose prescription = %lg\n", rt_plan.get_normalization_dose());
 
     // Not needed for dose calculation: 
     // Parameter Set, Plan Contour, Dose Volume, Dose Grid
 
     // Update beam
-    printf("\n ***BEAM PARAMETERS***\n");
-    printf ("Setting source position -> ");
     rt_beam->set_source_position(src);
-    printf("Source position: %lg %lg %lg\n", rt_beam->get_source_position()[0], rt_beam->get_source_position()[1], rt_beam->get_source_position()[2]);
-    printf ("Setting isocenter position -> ");
     rt_beam->set_isocenter_position(isocenter);
-    printf("Isocenter position: %lg %lg %lg\n", rt_beam->get_isocenter_position()[0], rt_beam->get_isocenter_position()[1], rt_beam->get_isocenter_position()[2]);
-    printf ("Setting dose calculation algorithm -> ");
     switch(protonBeamNode->GetAlgorithm())
     {
         case vtkMRMLRTProtonBeamNode::CGS:
@@ -189,125 +428,88 @@ void vtkSlicerDoseCalculationEngine::CalculateDose(
             rt_beam->set_flavor('a');
             break;
     }
-    printf("Algorithm Flavor = %c\n", rt_beam->get_flavor());
-    printf ("Setting homo approximation -> ");
     if (protonBeamNode->GetLateralSpreadHomoApprox() == true)
     {
         rt_beam->set_homo_approx('y');
-        printf("Homo approximation set to true\n");
     }
     else
     {
         rt_beam->set_homo_approx('n');
-        printf("Homo approximation set to false\n");
     }
-    printf ("Setting beam weight -> ");
     rt_beam->set_beam_weight(beamNode->GetBeamWeight());
-    printf("Beam weight = %lg\n", rt_beam->get_beam_weight());
-    printf ("Setting smearing -> ");
     rt_beam->set_smearing(beamNode->GetSmearing());
-    printf("Smearing = %lg\n", rt_beam->get_smearing());
-    printf ("Setting Highland model for range compensator\n");
     if (protonBeamNode->GetRangeCompensatorHighland() == true)
     {
         rt_beam->set_rc_MC_model('n');
-        printf("Highland model for range compensator set to true\n");
     }
     else
     {
         rt_beam->set_rc_MC_model('y');
-        printf("Highland model for range compensator set to false\n");
     }
-    printf ("Setting source size -> ");
     rt_beam->set_source_size(protonBeamNode->GetSourceSize());
-    printf("Source size = %lg\n", rt_beam->get_source_size());
-    printf ("Setting step length -> ");
     rt_beam->set_step_length(protonBeamNode->GetStepLength());
-    printf("Step length = %lg\n", rt_beam->get_step_length());
     // Not needed: BeamType, NominalEnergy, BeamOnTime, NominalmA, MLC_Array
     // To be added in the future: couchAngle
 
     // Update aperture parameters
-    printf("\nAPERTURE PARAMETERS:\n");
-    protonBeamNode->UpdateApertureParameters(beamNode->GetSAD()); // Sanity check before we set the parameters
-    printf ("Setting aperture distance -> ");
+    // Aperture parameters are updated (sanity check) in the main thread before the calculation is started
     rt_beam->get_aperture()->set_distance(protonBeamNode->GetApertureOffset());
-    printf("Aperture distance = %lg\n", rt_beam->get_aperture()->get_distance());
-    printf ("Setting aperture origin -> ");
     rt_beam->get_aperture()->set_origin(protonBeamNode->GetApertureOrigin());
-    printf("Aperture origin = %lg %lg\n", protonBeamNode->GetApertureOrigin(0), protonBeamNode->GetApertureOrigin(1));
-    printf ("Setting aperture spacing -> ");
     rt_beam->get_aperture()->set_spacing(protonBeamNode->GetApertureSpacing());
-    printf("Aperture Spacing = %lg %lg\n", rt_beam->get_aperture()->get_spacing(0),  rt_beam->get_aperture()->get_spacing(1));
-    printf ("Setting aperture dim -> ");
     rt_beam->get_aperture()->set_dim(protonBeamNode->GetApertureDim() );
-    printf("Aperture dim = %d %d\n", rt_beam->get_aperture()->get_dim(0), rt_beam->get_aperture()->get_dim(1) );
     // To be added in the future: collimatorAngle
 
     // Update mebs parameters
-    printf("\nENERGY PARAMETERS:\n");
-    printf("Setting beam line type -> ");
     if (protonBeamNode->GetBeamLineType() == true)
     {
         rt_beam->set_beam_line_type("active");      
-        printf("beam line type set to active\n");
     }
     else
     {
         rt_beam->set_beam_line_type("passive");      
-        printf("beam line type set to passive\n");
     }
-    printf("Setting have prescription -> ");
     rt_beam->get_mebs()->set_have_prescription(protonBeamNode->GetManualEnergyLimits());
-    printf("Manual energy prescription set to %d\n", rt_beam->get_mebs()->get_have_prescription());
     if (rt_beam->get_mebs()->get_have_prescription() == true)
     {
         rt_beam->get_mebs()->set_energy_min(protonBeamNode->GetMinimumEnergy());
         rt_beam->get_mebs()->set_energy_max(protonBeamNode->GetMaximumEnergy());
-        printf("Energy min: %lg, Energy max: %lg\n", rt_beam->get_mebs()->get_energy_min(), rt_beam->get_mebs()->get_energy_max());
     }
-    printf("Setting proximal margin -> ");
     rt_beam->get_mebs()->set_proximal_margin (protonBeamNode->GetProximalMargin());
-    printf("Proximal margin = %lg\n", rt_beam->get_mebs()->get_proximal_margin());
-    printf("Setting distal margin -> ");
     rt_beam->get_mebs()->set_distal_margin (protonBeamNode->GetDistalMargin());
-    printf("Distal margin = %lg\n", rt_beam->get_mebs()->get_distal_margin());
-    printf("Setting energy resolution -> ");
     rt_beam->get_mebs()->set_energy_resolution(protonBeamNode->GetEnergyResolution());
-    printf("Energy resolution = %lg\n", rt_beam->get_mebs()->get_energy_resolution());
-    printf("Setting energy spread -> ");
     rt_beam->get_mebs()->set_spread (protonBeamNode->GetEnergySpread());
-    printf("Energy spread = %lg\n", rt_beam->get_mebs()->get_spread());
 
     // Distal and proximal margins are updated when the SOBP is created
     /* All the rt_beam parameters are updated to initiate the dose calculation */
     if (!rt_plan.prepare_beam_for_calc (rt_beam))
     {
-      /* Failure.  How to notify the user?? */
-      std::cerr << "Sorry, rt_plan.prepare_beam_for_calc() failed.\n";
-      return;
+      beam.ErrorMessage = "rt_plan.prepare_beam_for_calc() failed";
+      return false;
     }
-
-    /* A little warm fuzzy for the developers */
-    rt_plan.print_verif ();
-    printf ("Working...\n");
-    fflush(stdout);
-
   }
   catch (std::exception& ex)
   {
-    vtkErrorMacro("ComputeDose: Plastimatch exception: " << ex.what());
-    return;
+    beam.ErrorMessage = std::string("Plastimatch exception: ") + ex.what();
+    return false;
+  }
+  if (internal)
+  {
+    internal->CompleteBeamCalculationStep();
+    if (internal->IsCancelRequested())
+    {
+      beam.Cancelled = true;
+      return false;
+    }
   }
 
   /* Get aperture as itk image */
   Rpl_volume *rpl_vol = rt_beam->rpl_vol;
   Plm_image::Pointer& ap = rpl_vol->get_aperture()->get_aperture_image();
-  this->Internal->apertureVolumeItk = ap->itk_uchar();
+  beam.ApertureVolumeItk = ap->itk_uchar();
 
   /* Get range compensator as itk image */
   Plm_image::Pointer& rc = rpl_vol->get_aperture()->get_range_compensator_image();
-  this->Internal->rcVolumeItk = rc->itk_float();
+  beam.RangeCompensatorVolumeItk = rc->itk_float();
 
   /* Compute the dose */
   try
@@ -327,19 +529,470 @@ void vtkSlicerDoseCalculationEngine::CalculateDose(
         int ap_dim[2] = {rt_beam->rpl_vol->get_aperture()->get_dim()[0], rt_beam->rpl_vol->get_aperture()->get_dim()[1]};
         rt_beam->get_mebs()->generate_part_num_from_weight(ap_dim);
     }
+  }
+  catch (std::exception& ex)
+  {
+    beam.ErrorMessage = std::string("Plastimatch exception: ") + ex.what();
+    return false;
+  }
+  if (internal)
+  {
+    internal->CompleteBeamCalculationStep();
+    if (internal->IsCancelRequested())
+    {
+      beam.Cancelled = true;
+      return false;
+    }
+  }
+
+  try
+  {
     /* We can compute the dose */
     rt_plan.compute_dose (rt_beam);
   }
   catch (std::exception& ex)
   {
-    vtkErrorMacro("ComputeDose: Plastimatch exception: " << ex.what());
-    return;
+    beam.ErrorMessage = std::string("Plastimatch exception: ") + ex.what();
+    return false;
   }
   /* Get dose as itk image */
-  this->Internal->doseVolumeItk = rt_beam->get_dose()->itk_float();
-  
+  beam.DoseVolumeItk = rt_beam->get_dose()->itk_float();
+  if (internal)
+  {
+    internal->CompleteBeamCalculationStep();
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerDoseCalculationEngine::vtkInternal::BeamDoseThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkInternal* internal = static_cast<vtkInternal*>(threadInfo->UserData);
+
+  while (true)
+  {
+    internal->CalculationLock->Lock();
+    unsigned int beamIndex = internal->NextBeamIndex++;
+    bool cancelRequested = internal->CancelRequested;
+    internal->CalculationLock->Unlock();
+    if (beamIndex >= internal->Beams.size())
+    {
+      break;
+    }
+    BeamDoseCalculation& beam = internal->Beams[beamIndex];
+    if (beam.Cached)
+    {
+      continue;
+    }
+    if (cancelRequested)
+    {
+      // Remaining beams are not started
+      beam.Cancelled = true;
+      continue;
+    }
+    try
+    {
+      CalculateBeamDose(beam, internal->ReferenceVolumeItk, internal);
+    }
+    catch (...)
+    {
+      // Exceptions must not leave the thread
+      beam.ErrorMessage = "Unexpected exception";
+    }
+  }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerDoseCalculationEngine::vtkInternal::DoseCalculationThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkInternal* internal = static_cast<vtkInternal*>(threadInfo->UserData);
+
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(internal->NumberOfBeamThreads);
+  threader->SetSingleMethod(BeamDoseThreadFunction, internal);
+  threader->SingleMethodExecute();
+
+  internal->CalculationLock->Lock();
+  internal->CalculationRunning = false;
+  internal->CalculationLock->Unlock();
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDoseCalculationEngine::vtkInternal::IsCancelRequested()
+{
+  this->CalculationLock->Lock();
+  bool cancelRequested = this->CancelRequested;
+  this->CalculationLock->Unlock();
+  return cancelRequested;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDoseCalculationEngine::vtkInternal::CompleteBeamCalculationStep(int numberOfSteps/*=1*/)
+{
+  this->CalculationLock->Lock();
+  this->NumberOfCompletedSteps += numberOfSteps;
+  this->CalculationLock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerDoseCalculationEngine::vtkInternal::AccumulateDoseThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkInternal* internal = static_cast<vtkInternal*>(threadInfo->UserData);
+
+  // Each thread sums all beams in its own range of voxels, so no locking is needed and
+  // the result does not depend on the number of threads
+  float* accumulatedDose = internal->accumulateVolumeItk->GetBufferPointer();
+  size_t numberOfVoxels = internal->accumulateVolumeItk->GetLargestPossibleRegion().GetNumberOfPixels();
+  size_t voxelsPerThread = (numberOfVoxels + threadInfo->NumberOfThreads - 1) / threadInfo->NumberOfThreads;
+  size_t firstVoxel = std::min(numberOfVoxels, voxelsPerThread * threadInfo->ThreadID);
+  size_t lastVoxel = std::min(numberOfVoxels, firstVoxel + voxelsPerThread);
+
+  for (std::vector<BeamDoseCalculation>::iterator beamIt = internal->Beams.begin(); beamIt != internal->Beams.end(); ++beamIt)
+  {
+    if (beamIt->Accumulated || beamIt->DoseVolumeItk.IsNull())
+    {
+      continue;
+    }
+    const float* beamDose = beamIt->DoseVolumeItk->GetBufferPointer();
+    for (size_t voxelIndex=firstVoxel; voxelIndex<lastVoxel; ++voxelIndex)
+    {
+      accumulatedDose[voxelIndex] += beamDose[voxelIndex];
+    }
+  }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+vtkStandardNewMacro(vtkSlicerDoseCalculationEngine);
+
+//----------------------------------------------------------------------------
+vtkSlicerDoseCalculationEngine::vtkSlicerDoseCalculationEngine()
+{
+  this->Internal = new vtkInternal;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerDoseCalculationEngine::~vtkSlicerDoseCalculationEngine()
+{
+  // Background calculation accesses the internal data, so it must be stopped first
+  if (this->Internal->CalculationThreadID >= 0)
+  {
+    this->CancelDoseCalculation();
+    this->Internal->CalculationThreader->TerminateThread(this->Internal->CalculationThreadID);
+    this->Internal->CalculationThreadID = -1;
+  }
+  delete this->Internal;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDoseCalculationEngine::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDoseCalculationEngine::InitializeAccumulatedDose(Plm_image::Pointer plmRef)
+{
+  if (this->Internal->CalculationThreadID >= 0)
+  {
+    vtkErrorMacro("InitializeAccumulatedDose: Dose calculation is in progress!");
+    return;
+  }
+
+  this->Internal->plmRef = plmRef;
+  itk::Image<short, 3>::Pointer referenceVolumeItk = this->Internal->plmRef->itk_short();
+
+  this->Internal->accumulateVolumeItk = itk_image_create<float>(Plm_image_header(referenceVolumeItk));
+  this->Internal->doseVolumeItk = itk_image_create<float>(Plm_image_header(referenceVolumeItk));
+  this->Internal->TotalRx = 0.f;
+  this->Internal->Beams.clear();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDoseCalculationEngine::CalculateDose(
+  vtkMRMLRTBeamNode* beamNode, 
+  Plm_image::Pointer& plmTgt,
+  double isocenter[],
+  double src[],
+  double RxDose)
+{
+  // The reference volume, the cache and the accumulated dose are used by the background calculation
+  if (this->Internal->CalculationThreadID >= 0)
+  {
+    vtkErrorMacro("CalculateDose: Dose calculation is in progress!");
+    return false;
+  }
+
+  vtkInternal::BeamDoseCalculation beam;
+  if ( !this->Internal->InitializeBeamDoseCalculation(beam, beamNode, plmTgt, isocenter, src, RxDose)
+    || (!beam.Cached && !vtkInternal::CalculateBeamDose(beam, this->Internal->plmRef->itk_short())) )
+  {
+    vtkErrorMacro("ComputeDose: " << beam.ErrorMessage);
+    return false;
+  }
+  this->Internal->SetCachedBeamDose(beam);
+
+  this->Internal->apertureVolumeItk = beam.ApertureVolumeItk;
+  this->Internal->rcVolumeItk = beam.RangeCompensatorVolumeItk;
+  this->Internal->doseVolumeItk = beam.DoseVolumeItk;
+
   /* Add into accumulate image */
   itk_image_accumulate (this->Internal->accumulateVolumeItk, 1.0, this->Internal->doseVolumeItk);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDoseCalculationEngine::AddBeamToDoseCalculation(
+  vtkMRMLRTBeamNode* beamNode,
+  Plm_image::Pointer& plmTgt,
+  double isocenter[],
+  double src[],
+  double RxDose)
+{
+  if (this->Internal->CalculationThreadID >= 0)
+  {
+    vtkErrorMacro("AddBeamToDoseCalculation: Dose calculation is in progress!");
+    return false;
+  }
+
+  vtkInternal::BeamDoseCalculation beam;
+  if (!this->Internal->InitializeBeamDoseCalculation(beam, beamNode, plmTgt, isocenter, src, RxDose))
+  {
+    vtkErrorMacro("AddBeamToDoseCalculation: " << beam.ErrorMessage);
+    return false;
+  }
+  this->Internal->Beams.push_back(beam);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDoseCalculationEngine::CalculateDoseForAllBeams()
+{
+  if (!this->StartDoseCalculationForAllBeams())
+  {
+    return false;
+  }
+  return this->FinishDoseCalculationForAllBeams();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDoseCalculationEngine::StartDoseCalculationForAllBeams()
+{
+  if (!this->Internal->plmRef || this->Internal->accumulateVolumeItk.IsNull())
+  {
+    vtkErrorMacro("StartDoseCalculationForAllBeams: Accumulated dose is not initialized!");
+    return false;
+  }
+  if (this->Internal->CalculationThreadID >= 0)
+  {
+    vtkErrorMacro("StartDoseCalculationForAllBeams: Dose calculation is already in progress!");
+    return false;
+  }
+
+  // Make sure the reference volume is converted before it is shared by the threads
+  this->Internal->ReferenceVolumeItk = this->Internal->plmRef->itk_short();
+
+  // Calculate beams in parallel, each into its own dose buffer. Beams with cached results are skipped
+  int numberOfBeamsToCalculate = 0;
+  for (std::vector<vtkInternal::BeamDoseCalculation>::iterator beamIt = this->Internal->Beams.begin(); beamIt != this->Internal->Beams.end(); ++beamIt)
+  {
+    if (!beamIt->Cached)
+    {
+      ++numberOfBeamsToCalculate;
+    }
+  }
+  int numberOfThreads = (this->Internal->NumberOfThreads > 0 ? this->Internal->NumberOfThreads : vtkMultiThreader::GetGlobalDefaultNumberOfThreads());
+  this->Internal->NumberOfBeamThreads = std::max(1, std::min(numberOfThreads, numberOfBeamsToCalculate));
+  this->Internal->NextBeamIndex = 0;
+  this->Internal->CancelRequested = false;
+  this->Internal->NumberOfCompletedSteps = NUMBER_OF_STEPS_PER_BEAM * ((int)this->Internal->Beams.size() - numberOfBeamsToCalculate);
+  if (numberOfBeamsToCalculate == 0)
+  {
+    this->Internal->CalculationRunning = false;
+    return true;
+  }
+
+  this->Internal->CalculationRunning = true;
+  this->Internal->CalculationThreadID = this->Internal->CalculationThreader->SpawnThread(
+    vtkInternal::DoseCalculationThreadFunction, this->Internal);
+  if (this->Internal->CalculationThreadID < 0)
+  {
+    vtkErrorMacro("StartDoseCalculationForAllBeams: Failed to start dose calculation thread!");
+    this->Internal->CalculationRunning = false;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDoseCalculationEngine::IsDoseCalculationRunning()
+{
+  this->Internal->CalculationLock->Lock();
+  bool running = this->Internal->CalculationRunning;
+  this->Internal->CalculationLock->Unlock();
+  return running;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerDoseCalculationEngine::GetDoseCalculationProgress()
+{
+  if (this->Internal->Beams.empty())
+  {
+    return 1.0;
+  }
+  this->Internal->CalculationLock->Lock();
+  int numberOfCompletedSteps = this->Internal->NumberOfCompletedSteps;
+  this->Internal->CalculationLock->Unlock();
+  return std::min(1.0, (double)numberOfCompletedSteps / (NUMBER_OF_STEPS_PER_BEAM * this->Internal->Beams.size()));
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDoseCalculationEngine::CancelDoseCalculation()
+{
+  this->Internal->CalculationLock->Lock();
+  this->Internal->CancelRequested = true;
+  this->Internal->CalculationLock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDoseCalculationEngine::FinishDoseCalculationForAllBeams()
+{
+  if (this->Internal->accumulateVolumeItk.IsNull())
+  {
+    vtkErrorMacro("FinishDoseCalculationForAllBeams: Accumulated dose is not initialized!");
+    return false;
+  }
+
+  // Wait for the background calculation to complete
+  if (this->Internal->CalculationThreadID >= 0)
+  {
+    this->Internal->CalculationThreader->TerminateThread(this->Internal->CalculationThreadID);
+    this->Internal->CalculationThreadID = -1;
+  }
+
+  // Report errors in the main thread
+  bool success = true;
+  itk::Image<float, 3>::RegionType accumulateRegion = this->Internal->accumulateVolumeItk->GetLargestPossibleRegion();
+  for (std::vector<vtkInternal::BeamDoseCalculation>::iterator beamIt = this->Internal->Beams.begin(); beamIt != this->Internal->Beams.end(); ++beamIt)
+  {
+    if (beamIt->Accumulated)
+    {
+      continue;
+    }
+    if (!beamIt->ErrorMessage.empty())
+    {
+      vtkErrorMacro("FinishDoseCalculationForAllBeams: Failed to calculate dose for beam " << (beamIt->BeamNode ? beamIt->BeamNode->GetName() : "") << ": " << beamIt->ErrorMessage);
+      beamIt->Accumulated = true;
+      success = false;
+      continue;
+    }
+    // Doses of the beams completed before cancelling are kept as partial result
+    this->Internal->SetCachedBeamDose(*beamIt);
+    if (beamIt->DoseVolumeItk.IsNotNull() && beamIt->DoseVolumeItk->GetLargestPossibleRegion() != accumulateRegion)
+    {
+      // Dose is not on the reference grid, accumulate with resampling
+      itk_image_accumulate (this->Internal->accumulateVolumeItk, 1.0, beamIt->DoseVolumeItk);
+      beamIt->Accumulated = true;
+    }
+  }
+
+  // Parallel reduction of the beam doses into the accumulated dose
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(vtkMultiThreader::GetGlobalDefaultNumberOfThreads());
+  threader->SetSingleMethod(vtkInternal::AccumulateDoseThreadFunction, this->Internal);
+  threader->SingleMethodExecute();
+  this->Internal->accumulateVolumeItk->Modified();
+  for (std::vector<vtkInternal::BeamDoseCalculation>::iterator beamIt = this->Internal->Beams.begin(); beamIt != this->Internal->Beams.end(); ++beamIt)
+  {
+    beamIt->Accumulated = true;
+  }
+  this->Internal->ReferenceVolumeItk = NULL;
+
+  return success;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDoseCalculationEngine::GetDoseCalculationCancelled()
+{
+  for (std::vector<vtkInternal::BeamDoseCalculation>::iterator beamIt = this->Internal->Beams.begin(); beamIt != this->Internal->Beams.end(); ++beamIt)
+  {
+    if (beamIt->Cancelled)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerDoseCalculationEngine::GetNumberOfBeamsInDoseCalculation()
+{
+  return (int)this->Internal->Beams.size();
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLRTBeamNode* vtkSlicerDoseCalculationEngine::GetBeamInDoseCalculation(int beamIndex)
+{
+  if (beamIndex < 0 || beamIndex >= (int)this->Internal->Beams.size())
+  {
+    return NULL;
+  }
+  return this->Internal->Beams[beamIndex].BeamNode;
+}
+
+//---------------------------------------------------------------------------
+itk::Image<float, 3>::Pointer vtkSlicerDoseCalculationEngine::GetRangeCompensatorVolume(int beamIndex)
+{
+  if (beamIndex < 0 || beamIndex >= (int)this->Internal->Beams.size())
+  {
+    return NULL;
+  }
+  return this->Internal->Beams[beamIndex].RangeCompensatorVolumeItk;
+}
+
+//---------------------------------------------------------------------------
+itk::Image<unsigned char, 3>::Pointer vtkSlicerDoseCalculationEngine::GetApertureVolume(int beamIndex)
+{
+  if (beamIndex < 0 || beamIndex >= (int)this->Internal->Beams.size())
+  {
+    return NULL;
+  }
+  return this->Internal->Beams[beamIndex].ApertureVolumeItk;
+}
+
+//---------------------------------------------------------------------------
+itk::Image<float, 3>::Pointer vtkSlicerDoseCalculationEngine::GetComputedDose(int beamIndex)
+{
+  if (beamIndex < 0 || beamIndex >= (int)this->Internal->Beams.size())
+  {
+    return NULL;
+  }
+  return this->Internal->Beams[beamIndex].DoseVolumeItk;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseCalculationEngine::SetNumberOfThreads(int numberOfThreads)
+{
+  this->Internal->NumberOfThreads = numberOfThreads;
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerDoseCalculationEngine::GetNumberOfThreads()
+{
+  return this->Internal->NumberOfThreads;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseCalculationEngine::ClearCache()
+{
+  this->Internal->BeamDoseCache.clear();
 }
 
 //---------------------------------------------------------------------------
@@ -375,6 +1028,13 @@ double vtkSlicerDoseCalculationEngine::GetTotalRx()
 //---------------------------------------------------------------------------
 void vtkSlicerDoseCalculationEngine::FinalizeAccumulatedDose()
 {
-  /* Free up memory for reference CT */
+  if (this->Internal->CalculationThreadID >= 0)
+  {
+    vtkErrorMacro("FinalizeAccumulatedDose: Dose calculation is in progress!");
+    return;
+  }
+
+  /* Free up memory for reference CT and beam calculations */
   Internal->plmRef.reset();
+  Internal->Beams.clear();
 }
@@ -52,16 +52,82 @@ public:
   void InitializeAccumulatedDose(Plm_image::Pointer);
 
   /// Do dose calculation
-  void CalculateDose(
+  /// \return False if the calculation failed or a parallel dose calculation is in progress
+  bool CalculateDose(
     vtkMRMLRTBeamNode* beamNode, 
     Plm_image::Pointer& plmTgt,
     double isocenter[],
     double src[], 
     double RxDose);
 
+  /// Queue a beam for the parallel dose calculation (\sa CalculateDoseForAllBeams).
+  /// The target volume is converted and the beam parameters are checked in the calling thread.
+  /// \return False if the beam cannot be calculated
+  bool AddBeamToDoseCalculation(
+    vtkMRMLRTBeamNode* beamNode, 
+    Plm_image::Pointer& plmTgt,
+    double isocenter[],
+    double src[], 
+    double RxDose);
+
+  /// Calculate dose for all the queued beams in parallel, each beam with its own plan and dose
+  /// buffer, then add the beam doses to the accumulated dose.
+  /// The beam parameters are copied when the beam is queued, so the beam nodes are not accessed
+  /// while the calculation is running.
+  /// \return False if the dose calculation failed for any of the beams
+  bool CalculateDoseForAllBeams();
+
+  /// Start calculating dose for all the queued beams in a background thread and return immediately.
+  /// \sa IsDoseCalculationRunning, GetDoseCalculationProgress, CancelDoseCalculation, FinishDoseCalculationForAllBeams
+  /// \return False if the calculation could not be started
+  bool StartDoseCalculationForAllBeams();
+
+  /// Return true while the background calculation is calculating beams
+  bool IsDoseCalculationRunning();
+
+  /// Get progress of the background calculation (between 0 and 1)
+  double GetDoseCalculationProgress();
+
+  /// Request the background calculation to stop. The calculation of the beams is stopped between
+  /// calculation steps, and the beams that are already completed are kept as partial result.
+  void CancelDoseCalculation();
+
+  /// Wait for the background calculation to finish, then add the doses of the calculated beams
+  /// to the accumulated dose. Must be called from the thread that started the calculation.
+  /// \return False if the dose calculation failed for any of the beams
+  bool FinishDoseCalculationForAllBeams();
+
+  /// Return true if the last calculation was cancelled before all beams were calculated
+  bool GetDoseCalculationCancelled();
+
+  /// Get number of beams queued for the parallel dose calculation
+  int GetNumberOfBeamsInDoseCalculation();
+
+  /// Get a beam queued for the parallel dose calculation
+  vtkMRMLRTBeamNode* GetBeamInDoseCalculation(int beamIndex);
+
+  /// Set maximum number of beams calculated in parallel. Default number of threads is used if 0 (default)
+  void SetNumberOfThreads(int numberOfThreads);
+  /// Get maximum number of beams calculated in parallel
+  int GetNumberOfThreads();
+
+  /// Clear results of previous beam calculations.
+  /// Results of a beam are reused as long as the beam node, isocenter, source, prescription,
+  /// reference and target volumes are the same as in the previous calculation of the beam.
+  void ClearCache();
+
   /// Do dose calculation
   itk::Image<float, 3>::Pointer GetRangeCompensatorVolume();
 
+  /// Get range compensator calculated for a queued beam
+  itk::Image<float, 3>::Pointer GetRangeCompensatorVolume(int beamIndex);
+
+  /// Get aperture calculated for a queued beam
+  itk::Image<unsigned char, 3>::Pointer GetApertureVolume(int beamIndex);
+
+  /// Get dose calculated for a queued beam
+  itk::Image<float, 3>::Pointer GetComputedDose(int beamIndex);
+
   /// Do dose calculation
   itk::Image<unsigned char, 3>::Pointer GetApertureVolume();
 
@@ -27,10 +27,15 @@
 #include "vtkMRMLRTBeamNode.h"
 #include "vtkSlicerBeamsModuleLogic.h"
 #include "vtkSlicerDoseCalculationEngine.h"
+#include "vtkSlicerDRRCalculationEngine.h"
 #include "vtkSlicerExternalBeamPlanningModuleLogic.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
+#include "vtkMRMLSegmentationDisplayNode.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
 #include "vtkSlicerSegmentationsModuleLogic.h"
 
 // Plastimatch includes
@@ -57,12 +62,15 @@
 #include <vtkMRMLLinearTransformNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScalarVolumeDisplayNode.h>
+#include <vtkMRMLLabelMapVolumeNode.h>
+#include <vtkMRMLLabelMapVolumeDisplayNode.h>
 #include <vtkMRMLDoubleArrayNode.h>
 #include <vtkMRMLSliceLogic.h>
 #include <vtkMRMLSliceNode.h>
 #include <vtkMRMLSliceCompositeNode.h>
 #include <vtkMRMLScalarVolumeDisplayNode.h>
 #include <vtkMRMLSelectionNode.h>
+#include <vtkMRMLTransformNode.h>
 
 // VTK includes
 #include <vtkNew.h>
@@ -73,15 +81,10 @@
 #include <vtkDoubleArray.h>
 #include <vtkPolyData.h>
 #include <vtkObjectFactory.h>
-#include <vtkRenderer.h>
-#include <vtkRenderWindow.h>
-#include <vtkCamera.h>
 #include <vtkColorTransferFunction.h>
 #include <vtkImageData.h>
 #include <vtkImageCast.h>
 #include <vtkPiecewiseFunction.h>
-#include <vtkProperty.h>
-#include <vtkActor.h>
 #include <vtkVolume.h>
 #include <vtkVolumeProperty.h>
 #include <vtkVolumeRayCastMapper.h>
@@ -89,27 +92,74 @@
 #include <vtkVolumeRayCastCompositeFunction.h>
 #include <vtkVolumeTextureMapper3D.h>
 #include <vtkVolumeTextureMapper2D.h>
-#include <vtkWindowToImageFilter.h>
 #include <vtkImageShiftScale.h>
-#include <vtkImageExtractComponents.h>
 #include <vtkTransform.h>
-#include <vtkPolyDataMapper.h>
-#include <vtkImageGradientMagnitude.h>
-#include <vtkImageMathematics.h>
+#include <vtkMatrix4x4.h>
+#include <vtkAbstractTransform.h>
 
 // ITK includes
 #include <itkImageRegionIteratorWithIndex.h>
 
+// STD includes
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <sstream>
+
 //----------------------------------------------------------------------------
 class vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal
 {
 public:
   vtkInternal();
 
+  /// Get the reference volume converted for the dose calculation.
+  /// The volume is only converted again if the volume node, its image data or its transform changed
+  Plm_image::Pointer GetReferencePlmImage(vtkMRMLScalarVolumeNode* referenceVolumeNode);
+
+  /// Get the target segment of the beam converted for the dose calculation.
+  /// The segment is only converted again if the segmentation, the segment or its transform changed
+  Plm_image::Pointer GetTargetPlmImage(vtkSlicerExternalBeamPlanningModuleLogic* logic, vtkMRMLRTBeamNode* beamNode);
+
+  /// Get the latest modified time of a transformable node and its parent transforms
+  static unsigned long GetTransformableNodeMTime(vtkMRMLTransformableNode* node);
+
+  /// Clear converted reference and target volumes and cached beam results
+  void ClearCache();
+
+  /// Get the poly data of a segment that is projected into the beam's eye view. Planar contours are
+  /// used if available, otherwise the closed surface. If the segmentation has neither, a temporary
+  /// closed surface is created for the segment, and the segmentation itself is not changed
+  static vtkSmartPointer<vtkPolyData> GetSegmentPolyDataForProjection(vtkSegmentation* segmentation, const std::string& segmentID);
+
+  /// Get the transform of a segmentation node to world coordinates
+  /// \return False if the segmentation is under a non-linear transform
+  static bool GetSegmentationToWorldMatrix(vtkMRMLSegmentationNode* segmentationNode, vtkMatrix4x4* segmentationToWorldMatrix);
+
+public:
   vtkSlicerCLIModuleLogic* MatlabDoseCalculationModuleLogic;
   vtkSlicerDoseCalculationEngine* doseEngine;
+  /// DRR engine, kept between updates so that the reference volume is only converted once
+  vtkSmartPointer<vtkSlicerDRRCalculationEngine> DRREngine;
 
+  /// Converted reference volume
   Plm_image::Pointer plmRef;
+  /// ID of the node the reference volume was converted from
+  std::string plmRefNodeID;
+  /// Modified time of the reference volume node when it was converted
+  unsigned long plmRefMTime;
+
+  /// Converted target segment and the modified time of the segment when it was converted
+  struct CachedTarget
+  {
+    unsigned long MTime;
+    Plm_image::Pointer PlmTarget;
+  };
+  /// Converted target segments, keyed by segmentation node ID and segment ID
+  std::map<std::string, CachedTarget> TargetCache;
+
+  /// Flag indicating that a background dose calculation was started and its results are not yet processed
+  bool DoseCalculationInProgress;
+
   float TotalRx;
 };
 
@@ -118,9 +168,156 @@ vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal::vtkInternal()
 {
   this->MatlabDoseCalculationModuleLogic = 0;
   this->doseEngine = vtkSlicerDoseCalculationEngine::New();
+  this->DRREngine = vtkSmartPointer<vtkSlicerDRRCalculationEngine>::New();
+  this->plmRefMTime = 0;
+  this->DoseCalculationInProgress = false;
   this->TotalRx = 0.f;
 }
 
+//----------------------------------------------------------------------------
+unsigned long vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal::GetTransformableNodeMTime(vtkMRMLTransformableNode* node)
+{
+  // Modified times are increasing globally, so the maximum changes if any of the objects is modified
+  unsigned long mTime = 0;
+  for (vtkMRMLTransformableNode* currentNode = node; currentNode; currentNode = currentNode->GetParentTransformNode())
+  {
+    mTime = std::max(mTime, currentNode->GetMTime());
+    vtkMRMLTransformNode* transformNode = vtkMRMLTransformNode::SafeDownCast(currentNode);
+    if (transformNode && transformNode->GetTransformToParent())
+    {
+      mTime = std::max(mTime, transformNode->GetTransformToParent()->GetMTime());
+    }
+  }
+  return mTime;
+}
+
+//----------------------------------------------------------------------------
+Plm_image::Pointer vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal::GetReferencePlmImage(vtkMRMLScalarVolumeNode* referenceVolumeNode)
+{
+  if (!referenceVolumeNode || !referenceVolumeNode->GetImageData())
+  {
+    return PlmCommon::ConvertVolumeNodeToPlmImage(referenceVolumeNode);
+  }
+
+  unsigned long referenceMTime = std::max( GetTransformableNodeMTime(referenceVolumeNode),
+    referenceVolumeNode->GetImageData()->GetMTime() );
+  if ( !this->plmRef || this->plmRefNodeID.compare(referenceVolumeNode->GetID()) || this->plmRefMTime != referenceMTime )
+  {
+    this->plmRef = PlmCommon::ConvertVolumeNodeToPlmImage(referenceVolumeNode);
+    this->plmRefNodeID = referenceVolumeNode->GetID();
+    this->plmRefMTime = referenceMTime;
+  }
+  return this->plmRef;
+}
+
+//----------------------------------------------------------------------------
+Plm_image::Pointer vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal::GetTargetPlmImage(vtkSlicerExternalBeamPlanningModuleLogic* logic, vtkMRMLRTBeamNode* beamNode)
+{
+  Plm_image::Pointer plmTgt;
+  vtkMRMLSegmentationNode* targetSegmentationNode = beamNode->GetTargetSegmentationNode();
+  vtkSegmentation* segmentation = (targetSegmentationNode ? targetSegmentationNode->GetSegmentation() : NULL);
+  vtkSegment* segment = (segmentation && beamNode->GetTargetSegmentID() ? segmentation->GetSegment(beamNode->GetTargetSegmentID()) : NULL);
+
+  // Get modified time of the target segment and the representations it is converted from
+  std::string cacheKey;
+  unsigned long targetMTime = 0;
+  if (segment)
+  {
+    cacheKey = std::string(targetSegmentationNode->GetID()) + "/" + beamNode->GetTargetSegmentID();
+    targetMTime = std::max( GetTransformableNodeMTime(targetSegmentationNode),
+      std::max(segmentation->GetMTime(), segment->GetMTime()) );
+    const char* representationNames[2] = { segmentation->GetMasterRepresentationName(),
+      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() };
+    for (int i=0; i<2; ++i)
+    {
+      vtkDataObject* representation = (representationNames[i] ? segment->GetRepresentation(representationNames[i]) : NULL);
+      if (representation)
+      {
+        targetMTime = std::max(targetMTime, representation->GetMTime());
+      }
+    }
+
+    std::map<std::string, CachedTarget>::iterator cacheIt = this->TargetCache.find(cacheKey);
+    if (cacheIt != this->TargetCache.end() && cacheIt->second.MTime == targetMTime)
+    {
+      return cacheIt->second.PlmTarget;
+    }
+  }
+
+  // Get a labelmap for the target
+  vtkSmartPointer<vtkOrientedImageData> targetLabelmap = logic->GetTargetLabelmap(beamNode);
+  if (targetLabelmap == NULL)
+  {
+    return plmTgt;
+  }
+
+  // Convert inputs to ITK images
+  plmTgt = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(targetLabelmap);
+  if (plmTgt && !cacheKey.empty())
+  {
+    CachedTarget& cachedTarget = this->TargetCache[cacheKey];
+    cachedTarget.MTime = targetMTime;
+    cachedTarget.PlmTarget = plmTgt;
+  }
+  return plmTgt;
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal::GetSegmentPolyDataForProjection(vtkSegmentation* segmentation, const std::string& segmentID)
+{
+  vtkSmartPointer<vtkPolyData> segmentPolyData;
+  vtkSegment* segment = (segmentation ? segmentation->GetSegment(segmentID) : NULL);
+  if (!segment)
+  {
+    return segmentPolyData;
+  }
+
+  std::string planarContourName(vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName());
+  std::string closedSurfaceName(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName());
+  if (segmentation->ContainsRepresentation(planarContourName))
+  {
+    segmentPolyData = vtkPolyData::SafeDownCast(segment->GetRepresentation(planarContourName));
+  }
+  else if (segmentation->ContainsRepresentation(closedSurfaceName))
+  {
+    segmentPolyData = vtkPolyData::SafeDownCast(segment->GetRepresentation(closedSurfaceName));
+  }
+  else
+  {
+    // Convert a copy of the segment, so that no representation is added to the segmentation of the user
+    segmentPolyData = vtkSmartPointer<vtkPolyData>::Take( vtkPolyData::SafeDownCast(
+      vtkSlicerSegmentationsModuleLogic::CreateRepresentationForOneSegment(segmentation, segmentID, closedSurfaceName) ) );
+  }
+  return segmentPolyData;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal::GetSegmentationToWorldMatrix(vtkMRMLSegmentationNode* segmentationNode, vtkMatrix4x4* segmentationToWorldMatrix)
+{
+  segmentationToWorldMatrix->Identity();
+  vtkMRMLTransformNode* transformNode = (segmentationNode ? segmentationNode->GetParentTransformNode() : NULL);
+  if (!transformNode)
+  {
+    return true;
+  }
+  if (!transformNode->IsTransformToWorldLinear())
+  {
+    return false;
+  }
+  transformNode->GetMatrixTransformToWorld(segmentationToWorldMatrix);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::vtkInternal::ClearCache()
+{
+  this->plmRef.reset();
+  this->plmRefNodeID.clear();
+  this->plmRefMTime = 0;
+  this->TargetCache.clear();
+  this->doseEngine->ClearCache();
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerExternalBeamPlanningModuleLogic);
 
@@ -251,6 +448,15 @@ void vtkSlicerExternalBeamPlanningModuleLogic::OnMRMLSceneEndImport()
 //---------------------------------------------------------------------------
 void vtkSlicerExternalBeamPlanningModuleLogic::OnMRMLSceneEndClose()
 {
+  // Discard results of a running dose calculation
+  if (this->Internal->DoseCalculationInProgress)
+  {
+    this->Internal->doseEngine->CancelDoseCalculation();
+    this->Internal->doseEngine->FinishDoseCalculationForAllBeams();
+    this->Internal->doseEngine->FinalizeAccumulatedDose();
+    this->Internal->DoseCalculationInProgress = false;
+  }
+  this->Internal->ClearCache();
   this->Modified();
 }
 
@@ -446,17 +652,15 @@ void vtkSlicerExternalBeamPlanningModuleLogic::UpdateDRR(char *beamname)
 {
   if ( !this->GetMRMLScene() || !this->ExternalBeamPlanningNode )
   {
-    vtkErrorMacro("RemoveBeam: Invalid MRML scene or parameter set node!");
+    vtkErrorMacro("UpdateDRR: Invalid MRML scene or parameter set node!");
     return;
   }
 
-#if defined (commentout)
-
-  vtkMRMLRTPlanNode* rtPlanNode = this->ExternalBeamPlanningNode->GetRtPlanNode();
-  vtkMRMLScalarVolumeNode* referenceVolumeNode = this->ExternalBeamPlanningNode->GetReferenceVolumeNode();
+  vtkMRMLRTPlanNode* rtPlanNode = this->GetRTPlanNode();
+  vtkMRMLScalarVolumeNode* referenceVolumeNode = (rtPlanNode ? rtPlanNode->GetRTPlanReferenceVolumeNode() : NULL);
 
   // Make sure inputs are initialized
-  if (!rtPlanNode || !referenceVolumeNode)
+  if (!rtPlanNode || !referenceVolumeNode || !referenceVolumeNode->GetImageData())
   {
     vtkErrorMacro("UpdateDRR: Inputs are not initialized!");
     return;
@@ -464,323 +668,219 @@ void vtkSlicerExternalBeamPlanningModuleLogic::UpdateDRR(char *beamname)
 
   vtkSmartPointer<vtkCollection> beams = vtkSmartPointer<vtkCollection>::New();
   rtPlanNode->GetRTBeamNodes(beams);
-  // Fill the table
-  if (!beams) return;
   vtkMRMLRTBeamNode* beamNode = NULL;
   for (int i=0; i<beams->GetNumberOfItems(); ++i)
   {
-    beamNode = vtkMRMLRTBeamNode::SafeDownCast(beams->GetItemAsObject(i));
-    if (beamNode && beamNode->BeamNameIs(beamname)) {
+    vtkMRMLRTBeamNode* currentBeamNode = vtkMRMLRTBeamNode::SafeDownCast(beams->GetItemAsObject(i));
+    if (currentBeamNode && currentBeamNode->BeamNameIs(beamname))
+    {
+      beamNode = currentBeamNode;
       break;
     }
   }
-
-  // Make sure inputs are initialized
   if (!beamNode)
   {
-    vtkErrorMacro("UpdateDRR: Inputs are not initialized!");
+    vtkErrorMacro("UpdateDRR: Beam " << (beamname ? beamname : "(null)") << " not found!");
     return;
   }
-  vtkMRMLMarkupsFiducialNode* isocenterMarkupsNode = beamNode->GetIsocenterFiducialNode();
-  // vtkMRMLDoubleArrayNode* MLCPositionDoubleArrayNode = beamNode->GetMLCPositionDoubleArrayNode();
-  if (!isocenterMarkupsNode) // || !MLCPositionDoubleArrayNode)
+
+  // Geometry of the reference volume in world coordinates
+  vtkSmartPointer<vtkMatrix4x4> referenceIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceVolumeNode->GetIJKToRASMatrix(referenceIjkToRasMatrix);
+  vtkMRMLTransformNode* referenceTransformNode = referenceVolumeNode->GetParentTransformNode();
+  if (referenceTransformNode)
   {
-    vtkErrorMacro("UpdateDRR: Inputs are not initialized!");
+    if (!referenceTransformNode->IsTransformToWorldLinear())
+    {
+      vtkErrorMacro("UpdateDRR: Non-linear transform of the reference volume is not supported!");
+      return;
+    }
+    vtkSmartPointer<vtkMatrix4x4> referenceRasToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    referenceTransformNode->GetMatrixTransformToWorld(referenceRasToWorldMatrix);
+    vtkMatrix4x4::Multiply4x4(referenceRasToWorldMatrix, referenceIjkToRasMatrix, referenceIjkToRasMatrix);
+  }
+
+  // Compute DRR by ray tracing the reference volume from the beam source.
+  // The engine keeps the reference volume converted to attenuation, so only the rays are traced again
+  // when the beam geometry changes
+  vtkSlicerDRRCalculationEngine* drrEngine = this->Internal->DRREngine;
+  drrEngine->SetImageSize(this->DRRImageSize);
+  drrEngine->SetInputVolume(referenceVolumeNode->GetImageData(), referenceIjkToRasMatrix);
+  drrEngine->SetBeamGeometry(beamNode);
+
+  vtkSmartPointer<vtkImageData> drrImageData = vtkSmartPointer<vtkImageData>::New();
+  vtkSmartPointer<vtkMatrix4x4> drrIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!drrEngine->ComputeDRR(drrImageData, drrIjkToRasMatrix))
+  {
+    vtkErrorMacro("UpdateDRR: Failed to compute DRR for beam " << beamNode->GetName());
     return;
   }
 
-  // Cast image data to uchar for faster rendering (this is for CT data only now)
-  vtkSmartPointer<vtkImageShiftScale> cast = vtkSmartPointer<vtkImageShiftScale>::New();
-  cast->SetInputData(referenceVolumeNode->GetImageData());
-  cast->SetOutputScalarTypeToUnsignedChar();
-  cast->SetShift(1000);
-  cast->SetScale(255./2000.);
-  cast->SetClampOverflow(1);
-  cast->Update();
-
-  // Create the renderer, render window 
-  vtkSmartPointer<vtkRenderer> renderer = vtkSmartPointer<vtkRenderer>::New();
-  vtkSmartPointer<vtkRenderWindow> renWin = vtkSmartPointer<vtkRenderWindow>::New();
-  renWin->SetOffScreenRendering(1);
-  renWin->AddRenderer(renderer);
-
-  // Create our volume and mapper
-  // Currently use cpu ray casting as gpu ray casting and texturemapping 3d are not working on my computer
-  vtkSmartPointer<vtkVolume> volume = vtkSmartPointer<vtkVolume>::New();
-  vtkSmartPointer<vtkVolumeRayCastMapper> mapper = vtkSmartPointer<vtkVolumeRayCastMapper>::New();
-  vtkSmartPointer<vtkVolumeRayCastCompositeFunction> compositeFunction = vtkSmartPointer<vtkVolumeRayCastCompositeFunction>::New();
-  mapper->SetVolumeRayCastFunction(compositeFunction);
-  //vtkSmartPointer<vtkVolumeTextureMapper3D> mapper = vtkSmartPointer<vtkVolumeTextureMapper3D>::New();
-  //vtkSmartPointer<vtkVolumeTextureMapper2D> mapper = vtkSmartPointer<vtkVolumeTextureMapper2D>::New();
-  //vtkSmartPointer<vtkGPUVolumeRayCastMapper> mapper = vtkSmartPointer<vtkGPUVolumeRayCastMapper>::New();
-  mapper->SetInputData( cast->GetOutput() );
-  mapper->SetBlendModeToComposite();
-  volume->SetMapper( mapper );
-
-  // Create our transfer function
-  vtkSmartPointer<vtkColorTransferFunction> colorFun = vtkSmartPointer<vtkColorTransferFunction>::New();
-  vtkSmartPointer<vtkPiecewiseFunction> opacityFun = vtkSmartPointer<vtkPiecewiseFunction>::New();
-
-  // Create the property and attach the transfer functions
-  vtkSmartPointer<vtkVolumeProperty> volumeProperty = vtkSmartPointer<vtkVolumeProperty>::New();
-  volumeProperty->SetColor( colorFun );
-  volumeProperty->SetScalarOpacity( opacityFun );
-  volumeProperty->SetInterpolationTypeToLinear();
-
-  colorFun->AddRGBPoint( 0, 0, 0, 0);
-  colorFun->AddRGBPoint( 128, 0, 0, 0);
-  colorFun->AddRGBPoint( 255, 1, 1, 1);
-
-  opacityFun->AddPoint(0, 0 );
-  opacityFun->AddPoint(128, 0 );
-  opacityFun->AddPoint(255, 0.2);
-
-  volumeProperty->ShadeOff();
-  volumeProperty->SetScalarOpacityUnitDistance(0.8919);
-
-  // connect up the volume to the property and the mapper
-  volume->SetProperty( volumeProperty );
-
-  vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
-  transform->Identity();
-  transform->RotateY(this->ExternalBeamPlanningNode->GetGantryAngle());
-  transform->RotateX(90);
-
-  vtkSmartPointer<vtkTransform> transform2 = vtkSmartPointer<vtkTransform>::New();
-  transform2->Identity();
-  double isoCenterPosition[3] = {0.0,0.0,0.0};
-  isocenterMarkupsNode->GetNthFiducialPosition(0,isoCenterPosition);
-  transform2->Translate(-isoCenterPosition[0], -isoCenterPosition[1], -isoCenterPosition[2]);
-
-  vtkSmartPointer<vtkTransform> transform3 = vtkSmartPointer<vtkTransform>::New();
-  vtkSmartPointer<vtkMatrix4x4> IJK2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  referenceVolumeNode->GetIJKToRASMatrix(IJK2RASMatrix);
-  transform3->SetMatrix(IJK2RASMatrix);
-
-  transform->PreMultiply();
-  transform->Concatenate(transform2);
-  transform->Concatenate(transform3);
-  volume->SetUserTransform( transform );
-
-  // The usual rendering stuff.
-  vtkSmartPointer<vtkCamera> camera = vtkSmartPointer<vtkCamera>::New();
-  // fixed camera parameters for now
-  camera->SetPosition(0, 0, 1000);
-  camera->SetFocalPoint(0, 0, 0);
-  camera->SetViewAngle(14.68);
-  camera->SetClippingRange(100, 2000);
-  camera->ParallelProjectionOff();
-
-  // Add the volume to the scene
-  renderer->AddVolume( volume );
-  renderer->SetActiveCamera(camera);
-
-  renWin->SetSize(this->DRRImageSize[0], this->DRRImageSize[1]);
-  renWin->Render();
-
-  // Capture and convert to 2D image
-  vtkSmartPointer<vtkWindowToImageFilter> windowToImage = vtkSmartPointer<vtkWindowToImageFilter>::New();
-  windowToImage->SetInput( renWin );
-
-  vtkSmartPointer<vtkImageExtractComponents> extract = vtkSmartPointer<vtkImageExtractComponents>::New();
-  extract->SetInputConnection( windowToImage->GetOutputPort() );
-  extract->SetComponents(0);
-  extract->Update();
-
-  // Add the drr image to mrml scene
-  vtkSmartPointer<vtkMRMLScalarVolumeNode> DRRImageNode = beamNode->GetDRRVolumeNode();
-  if (!DRRImageNode)
-  {
-    DRRImageNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-    DRRImageNode = vtkMRMLScalarVolumeNode::SafeDownCast(this->GetMRMLScene()->AddNode(DRRImageNode));
-    std::string DRRImageNodeName = std::string(beamname) + std::string("_DRRImage");
-    DRRImageNodeName = this->GetMRMLScene()->GenerateUniqueName(DRRImageNodeName);
-    DRRImageNode->SetName(DRRImageNodeName.c_str());
-    beamNode->SetAndObserveDRRVolumeNode(DRRImageNode);
-  }
-  //DRRImageNode->SetAndObserveDisplayNodeID(displayNode->GetID());
-  DRRImageNode->SetAndObserveImageData(extract->GetOutput());
-  DRRImageNode->SetOrigin(-128,-128,0);
-  DRRImageNode->SetSelectable(1);
-
-  vtkSmartPointer<vtkMRMLSliceLogic> sliceLogic = this->GetApplicationLogic()->GetSliceLogicByLayoutName("Slice4");
-  if (!sliceLogic)
-  {
-    vtkErrorMacro("UpdateDRR: Invalid sliceLogic for DRR viewer!");
-    return;
-  }
+  // Add the DRR image to the scene, placed on the isocenter plane perpendicular to the beam
+  vtkMRMLScalarVolumeNode* drrVolumeNode = beamNode->GetDRRVolumeNode();
+  if (!drrVolumeNode)
+  {
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> newDrrVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    std::string drrVolumeNodeName = this->GetMRMLScene()->GenerateUniqueName(std::string(beamNode->GetName()) + "_DRRImage");
+    newDrrVolumeNode->SetName(drrVolumeNodeName.c_str());
+    this->GetMRMLScene()->AddNode(newDrrVolumeNode);
 
-  // Transforms to place the DRR image aligned with the beam geometry
-  vtkSmartPointer<vtkTransform> transformDRR = vtkSmartPointer<vtkTransform>::New();
-  transformDRR->Identity();
-  transformDRR->RotateZ(this->ExternalBeamPlanningNode->GetGantryAngle());
-  transformDRR->RotateX(-90);
+    vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode> drrDisplayNode = vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode>::New();
+    this->GetMRMLScene()->AddNode(drrDisplayNode);
+    drrDisplayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeGrey");
+    drrDisplayNode->AutoWindowLevelOn();
+    newDrrVolumeNode->SetAndObserveDisplayNodeID(drrDisplayNode->GetID());
 
-  vtkSmartPointer<vtkTransform> transformDRR2 = vtkSmartPointer<vtkTransform>::New();
-  transformDRR2->Identity();
-  transformDRR2->Translate(isoCenterPosition[0], isoCenterPosition[1], isoCenterPosition[2]);
+    beamNode->SetAndObserveDRRVolumeNode(newDrrVolumeNode);
+    drrVolumeNode = newDrrVolumeNode;
+  }
+  drrVolumeNode->SetIJKToRASMatrix(drrIjkToRasMatrix);
+  drrVolumeNode->SetAndObserveImageData(drrImageData);
 
-  transformDRR->PostMultiply();
-  transformDRR->Concatenate(transformDRR2->GetMatrix());
+  // Project the structures of the target segmentation into the beam's eye view on the same image grid
+  if (beamNode->GetTargetSegmentationNode())
+  {
+    this->UpdateContourBEV(beamNode);
+  }
+}
 
-  vtkSmartPointer<vtkMRMLLinearTransformNode> DRRImageTransformNode = vtkMRMLLinearTransformNode::SafeDownCast(
-    this->GetMRMLScene()->GetNodeByID(DRRImageNode->GetTransformNodeID()));
-  if (!DRRImageTransformNode)
+//---------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::UpdateContourBEV(vtkMRMLRTBeamNode* beamNode)
+{
+  if (!this->GetMRMLScene() || !beamNode)
+  {
+    vtkErrorMacro("UpdateContourBEV: Invalid MRML scene or beam node!");
+    return;
+  }
+  vtkMRMLSegmentationNode* segmentationNode = beamNode->GetTargetSegmentationNode();
+  vtkSegmentation* segmentation = (segmentationNode ? segmentationNode->GetSegmentation() : NULL);
+  if (!segmentation)
+  {
+    vtkErrorMacro("UpdateContourBEV: No target segmentation for beam " << beamNode->GetName());
+    return;
+  }
+  vtkSmartPointer<vtkMatrix4x4> segmentationToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!vtkInternal::GetSegmentationToWorldMatrix(segmentationNode, segmentationToWorldMatrix))
   {
-    DRRImageTransformNode = vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
-    DRRImageTransformNode = vtkMRMLLinearTransformNode::SafeDownCast(this->GetMRMLScene()->AddNode(DRRImageTransformNode));
-    std::string DRRImageTransformNodeName = std::string(beamname) + std::string("_DRRImage_Transform");
-    DRRImageTransformNodeName = this->GetMRMLScene()->GenerateUniqueName(DRRImageTransformNodeName);
-    DRRImageTransformNode->SetName(DRRImageTransformNodeName.c_str());
-    DRRImageNode->SetAndObserveTransformNodeID(DRRImageTransformNode->GetID());
+    vtkErrorMacro("UpdateContourBEV: Non-linear transform of the segmentation is not supported!");
+    return;
   }
-  DRRImageTransformNode->SetAndObserveMatrixTransformToParent(transformDRR->GetMatrix());
 
-  // 
-  vtkSmartPointer<vtkMRMLSliceNode> sliceNode = sliceLogic->GetSliceNode();
-  vtkSmartPointer<vtkMRMLSliceCompositeNode> compositeSliceNode = sliceLogic->GetSliceCompositeNode();
-  compositeSliceNode->SetBackgroundVolumeID(DRRImageNode->GetID());
+  // The image grid is the same as the DRR of the beam, so the two can be overlaid
+  vtkSlicerDRRCalculationEngine* drrEngine = this->Internal->DRREngine;
+  drrEngine->SetImageSize(this->DRRImageSize);
+  drrEngine->SetBeamGeometry(beamNode);
 
-  //TODO: convert to segmentations
-  // Get list of segments from the segmentation node
-  vtkSmartPointer<vtkSegmentation> selectedSegmentation = this->ExternalBeamPlanningNode->GetTargetSegmentationNode()->GetSegmentation();
-  vtkSegmentation::SegmentMap segmentMap = selectedSegmentation->GetSegments();
+  vtkSmartPointer<vtkImageData> contourBEVImageData = vtkSmartPointer<vtkImageData>::New();
+  contourBEVImageData->SetExtent(0, this->DRRImageSize[0]-1, 0, this->DRRImageSize[1]-1, 0, 0);
+  contourBEVImageData->AllocateScalars(VTK_UNSIGNED_SHORT, 1);
+  memset(contourBEVImageData->GetScalarPointer(), 0, sizeof(unsigned short) * contourBEVImageData->GetNumberOfPoints());
 
-  // Compute DVH and get result nodes
-  vtkSmartPointer<vtkImageData> mergedImageData = vtkSmartPointer<vtkImageData>::New();
-  unsigned int numberOfContours = 0;
-  
-  for (vtkSegmentation::SegmentMap::iterator segmentIt = segmentMap.begin(); segmentIt != segmentMap.end(); ++segmentIt)
-  {
-    numberOfContours++;
-    //if (contourNode)
-    //{
-    // Create the translucent contour object in BEV 
-    // Create the renderer, render window 
-    vtkSmartPointer<vtkRenderer> renderer2 = vtkSmartPointer<vtkRenderer>::New();
-    vtkSmartPointer<vtkRenderWindow> renWin2 = vtkSmartPointer<vtkRenderWindow>::New();
-    renWin2->SetOffScreenRendering(1);
-    renWin2->AddRenderer(renderer2);
-
-    // Now we'll look at it. //TODO: This comment is meaningless
-    vtkSmartPointer<vtkPolyDataMapper> contourPolyDataMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-    vtkSmartPointer<vtkPolyData> polydata = vtkPolyData::SafeDownCast(segmentIt->second->GetRepresentation(vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName()));
-    contourPolyDataMapper->SetInputData(polydata);
-    //contourPolyDataMapper->SetScalarRange(0,255);
-    vtkSmartPointer<vtkActor> contourPolyDataActor = vtkSmartPointer<vtkActor>::New();
-    contourPolyDataActor->SetMapper(contourPolyDataMapper);
-    contourPolyDataActor->GetProperty()->LightingOff();
-    contourPolyDataActor->GetProperty()->SetColor(1.0,1.0,1.0);
-
-    vtkSmartPointer<vtkTransform> transformContourBEV = vtkSmartPointer<vtkTransform>::New();
-    transformContourBEV->Identity();
-    transformContourBEV->RotateY(this->ExternalBeamPlanningNode->GetGantryAngle());
-    transformContourBEV->RotateX(90);
-
-    vtkSmartPointer<vtkTransform> transformContourBEV2 = vtkSmartPointer<vtkTransform>::New();
-    transformContourBEV2->Identity();
-    transformContourBEV2->Translate(-isoCenterPosition[0], -isoCenterPosition[1], -isoCenterPosition[2]);
-
-    transformContourBEV->PreMultiply();
-    transformContourBEV->Concatenate(transformContourBEV2);
-    contourPolyDataActor->SetUserTransform( transformContourBEV );
-
-    // The usual rendering stuff.
-    vtkSmartPointer<vtkCamera> camera2 = vtkSmartPointer<vtkCamera>::New();
-    // fixed camera parameters for now
-    camera2->SetPosition(0, 0, 1000);
-    camera2->SetFocalPoint(0, 0, 0);
-    camera2->SetViewAngle(14.68);
-    camera2->SetClippingRange(100, 2000);
-    camera2->ParallelProjectionOff();
-
-    // Add the volume to the scene
-    renderer2->AddActor(contourPolyDataActor);
-    renderer2->SetActiveCamera(camera2);
-
-    renWin2->SetSize(this->DRRImageSize[0], this->DRRImageSize[1]);
-    renWin2->Render();
-
-    // Capture and convert to 2D image
-    vtkSmartPointer<vtkWindowToImageFilter> windowToImage2 = vtkSmartPointer<vtkWindowToImageFilter>::New();
-    windowToImage2->SetInput( renWin2 );
-
-    vtkSmartPointer<vtkImageExtractComponents> extract2 = vtkSmartPointer<vtkImageExtractComponents>::New();
-    extract2->SetInputConnection( windowToImage2->GetOutputPort() );
-    extract2->SetComponents(0);
-    extract2->Update();
-
-    // Investigate when contour technique to use (gradient )
-    vtkSmartPointer<vtkImageGradientMagnitude> magnitude = vtkSmartPointer<vtkImageGradientMagnitude>::New();
-    magnitude->SetInputConnection( extract2->GetOutputPort() );
-    magnitude->SetDimensionality(2);
-    magnitude->Update();
-
-    if (numberOfContours > 1)
+  // Project all segments into one multi-label image. The label of a segment is its index in the
+  // color table of the segmentation, so that the image can be displayed with the same colors
+  std::vector<std::string> segmentIDs;
+  segmentation->GetSegmentIDs(segmentIDs);
+  for (unsigned int segmentIndex=0; segmentIndex<segmentIDs.size(); ++segmentIndex)
+  {
+    vtkSegment* segment = segmentation->GetSegment(segmentIDs[segmentIndex]);
+    vtkSmartPointer<vtkPolyData> segmentPolyData = vtkInternal::GetSegmentPolyDataForProjection(segmentation, segmentIDs[segmentIndex]);
+    if (!segmentPolyData)
     {
-      vtkSmartPointer<vtkImageMathematics> addFilter = vtkSmartPointer<vtkImageMathematics>::New(); 
-      addFilter->SetInput1Data(mergedImageData);
-      addFilter->SetInput2Data(magnitude->GetOutput());
-      addFilter->SetOperationToAdd();
-      addFilter->Update();
-      mergedImageData->DeepCopy(addFilter->GetOutput());
+      vtkWarningMacro("UpdateContourBEV: No contours or surface available for segment " << segmentIDs[segmentIndex]);
+      continue;
     }
-    else
+
+    int label = segmentIndex + 1;
+    std::string colorIndexStr;
+    if (segment->GetTag(vtkMRMLSegmentationDisplayNode::GetColorIndexTag(), colorIndexStr))
     {
-      mergedImageData->DeepCopy(magnitude->GetOutput());
+      std::stringstream colorSS;
+      colorSS << colorIndexStr;
+      colorSS >> label;
     }
+    if (label <= 0 || label > VTK_UNSIGNED_SHORT_MAX)
+    {
+      label = segmentIndex + 1;
+    }
+
+    drrEngine->ProjectPolyData(segmentPolyData, segmentationToWorldMatrix, contourBEVImageData, (unsigned short)label);
   }
 
-  // Add the contour BEV image to mrml scene
-  vtkSmartPointer<vtkMRMLScalarVolumeNode> contourBEVImageNode = beamNode->GetContourBEVVolumeNode();
-  if (!contourBEVImageNode)
+  vtkSmartPointer<vtkMatrix4x4> contourBEVIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  drrEngine->GetImageIjkToRasMatrix(contourBEVIjkToRasMatrix);
+
+  // Add the contour BEV image to the scene, displayed with the colors of the segmentation
+  vtkMRMLScalarVolumeNode* contourBEVVolumeNode = beamNode->GetContourBEVVolumeNode();
+  if (!contourBEVVolumeNode)
   {
-    contourBEVImageNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-    contourBEVImageNode = vtkMRMLScalarVolumeNode::SafeDownCast(this->GetMRMLScene()->AddNode(contourBEVImageNode));
-    std::string contourBEVImageNodeName = std::string(beamname) + std::string("_ContourBEVImage");
-    contourBEVImageNodeName = this->GetMRMLScene()->GenerateUniqueName(contourBEVImageNodeName);
-    contourBEVImageNode->SetName(contourBEVImageNodeName.c_str());
+    vtkSmartPointer<vtkMRMLLabelMapVolumeNode> newContourBEVVolumeNode = vtkSmartPointer<vtkMRMLLabelMapVolumeNode>::New();
+    std::string contourBEVVolumeNodeName = this->GetMRMLScene()->GenerateUniqueName(std::string(beamNode->GetName()) + "_ContourBEVImage");
+    newContourBEVVolumeNode->SetName(contourBEVVolumeNodeName.c_str());
+    this->GetMRMLScene()->AddNode(newContourBEVVolumeNode);
+
+    vtkSmartPointer<vtkMRMLLabelMapVolumeDisplayNode> contourBEVDisplayNode = vtkSmartPointer<vtkMRMLLabelMapVolumeDisplayNode>::New();
+    this->GetMRMLScene()->AddNode(contourBEVDisplayNode);
+    if (segmentationNode->GetDisplayNode() && segmentationNode->GetDisplayNode()->GetColorNodeID())
+    {
+      contourBEVDisplayNode->SetAndObserveColorNodeID(segmentationNode->GetDisplayNode()->GetColorNodeID());
+    }
+    else
+    {
+      contourBEVDisplayNode->SetDefaultColorMap();
+    }
+    newContourBEVVolumeNode->SetAndObserveDisplayNodeID(contourBEVDisplayNode->GetID());
 
+    beamNode->SetAndObserveContourBEVVolumeNode(newContourBEVVolumeNode);
+    contourBEVVolumeNode = newContourBEVVolumeNode;
   }
-  beamNode->SetAndObserveContourBEVVolumeNode(contourBEVImageNode);
+  contourBEVVolumeNode->SetIJKToRASMatrix(contourBEVIjkToRasMatrix);
+  contourBEVVolumeNode->SetAndObserveImageData(contourBEVImageData);
+}
 
-  vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode> volumeDisplayNode = vtkMRMLScalarVolumeDisplayNode::SafeDownCast(contourBEVImageNode->GetDisplayNode());
-  if (!volumeDisplayNode)
+//---------------------------------------------------------------------------
+bool vtkSlicerExternalBeamPlanningModuleLogic::FitBeamJawsToTarget(vtkMRMLRTBeamNode* beamNode, double margin)
+{
+  if (!beamNode)
   {
-    // Set default colormap to the loaded one if found or generated, or to rainbow otherwise
-    volumeDisplayNode = vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode>::New();
-    this->GetMRMLScene()->AddNode(volumeDisplayNode);
+    vtkErrorMacro("FitBeamJawsToTarget: Invalid beam node!");
+    return false;
+  }
+  vtkMRMLSegmentationNode* segmentationNode = beamNode->GetTargetSegmentationNode();
+  vtkSegmentation* segmentation = (segmentationNode ? segmentationNode->GetSegmentation() : NULL);
+  vtkSmartPointer<vtkPolyData> targetPolyData;
+  if (beamNode->GetTargetSegmentID())
+  {
+    targetPolyData = vtkInternal::GetSegmentPolyDataForProjection(segmentation, beamNode->GetTargetSegmentID());
+  }
+  if (!targetPolyData)
+  {
+    vtkErrorMacro("FitBeamJawsToTarget: Failed to get target segment of beam " << beamNode->GetName());
+    return false;
+  }
+  vtkSmartPointer<vtkMatrix4x4> segmentationToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!vtkInternal::GetSegmentationToWorldMatrix(segmentationNode, segmentationToWorldMatrix))
+  {
+    vtkErrorMacro("FitBeamJawsToTarget: Non-linear transform of the segmentation is not supported!");
+    return false;
   }
-  volumeDisplayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeGreen");
-  volumeDisplayNode->SetScalarRange(0,255);
-  volumeDisplayNode->AutoWindowLevelOff();
-  volumeDisplayNode->SetWindow(64);
-  volumeDisplayNode->SetLevel(128);
-
-  contourBEVImageNode->SetAndObserveDisplayNodeID(volumeDisplayNode->GetID());
-  contourBEVImageNode->SetAndObserveImageData(mergedImageData);
-  contourBEVImageNode->SetOrigin(-128,-128,0);
-  contourBEVImageNode->SetSelectable(1);
-
-  contourBEVImageNode->SetAndObserveTransformNodeID(DRRImageTransformNode->GetID());
-
-  compositeSliceNode->SetForegroundVolumeID(contourBEVImageNode->GetID());
-  compositeSliceNode->SetForegroundOpacity(0.3);
-
-  // Transform ???
-  vtkSmartPointer<vtkTransform> transformSlice = vtkSmartPointer<vtkTransform>::New();
-  transformSlice->Identity();
-  transformSlice->RotateZ(this->ExternalBeamPlanningNode->GetGantryAngle());
-  transformSlice->RotateX(-90);
-  transformSlice->Update();
 
-  sliceNode->SetOrientationToReformat();
-  sliceNode->SetSliceToRAS(transformSlice->GetMatrix());
-  sliceNode->UpdateMatrices();
+  vtkSlicerDRRCalculationEngine* drrEngine = this->Internal->DRREngine;
+  drrEngine->SetBeamGeometry(beamNode);
+  double bounds[4] = {0.0, 0.0, 0.0, 0.0};
+  if (!drrEngine->GetProjectedBounds(targetPolyData, segmentationToWorldMatrix, bounds))
+  {
+    vtkErrorMacro("FitBeamJawsToTarget: Target of beam " << beamNode->GetName() << " is not in the field of the beam!");
+    return false;
+  }
 
-  sliceLogic->FitSliceToAll();
+  // On the isocenter plane the beam x axis spans from -Y2 to Y1 and the beam y axis from -X2 to X1
+  beamNode->SetY2Jaw(-bounds[0] + margin);
+  beamNode->SetY1Jaw(bounds[1] + margin);
+  beamNode->SetX2Jaw(-bounds[2] + margin);
+  beamNode->SetX1Jaw(bounds[3] + margin);
 
-#endif
+  this->UpdateBeamGeometryModel(beamNode->GetName());
+  return true;
 }
 
 //---------------------------------------------------------------------------
@@ -811,7 +911,6 @@ vtkSmartPointer<vtkOrientedImageData>
 vtkSlicerExternalBeamPlanningModuleLogic::GetTargetLabelmap(vtkMRMLRTBeamNode* beamNode)
 {
   vtkSmartPointer<vtkOrientedImageData> targetLabelmap;
-  printf ("1\n");
   vtkMRMLSegmentationNode* targetSegmentationNode = beamNode->GetTargetSegmentationNode();
   if (!targetSegmentationNode)
   {
@@ -819,7 +918,6 @@ vtkSlicerExternalBeamPlanningModuleLogic::GetTargetLabelmap(vtkMRMLRTBeamNode* b
     return targetLabelmap;
   }
 
-  printf ("2\n");
   vtkSegmentation *segmentation = targetSegmentationNode->GetSegmentation();
   if (!segmentation)
   {
@@ -827,7 +925,6 @@ vtkSlicerExternalBeamPlanningModuleLogic::GetTargetLabelmap(vtkMRMLRTBeamNode* b
     return targetLabelmap;
   }
 
-  printf ("3\n");
   vtkSegment *segment = segmentation->GetSegment(beamNode->GetTargetSegmentID());
   if (!segment) 
   {
@@ -835,7 +932,6 @@ vtkSlicerExternalBeamPlanningModuleLogic::GetTargetLabelmap(vtkMRMLRTBeamNode* b
     return targetLabelmap;
   }
 
-  printf ("4\n");
   
   //segmentationNode->GetImageData ();
   if (segmentation->ContainsRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
@@ -896,16 +992,8 @@ void vtkSlicerExternalBeamPlanningModuleLogic::ComputeDoseByPlastimatch(vtkMRMLR
     return;
   }
 
-  // Get a labelmap for the target
-  vtkSmartPointer<vtkOrientedImageData> targetLabelmap = this->GetTargetLabelmap(beamNode);
-  if (targetLabelmap == NULL)
-  {
-    return;
-  }
-
-  // Convert inputs to ITK images
-  Plm_image::Pointer plmTgt 
-    = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(targetLabelmap);
+  // Get the target converted to ITK image (reused from previous calculations if the target is unchanged)
+  Plm_image::Pointer plmTgt = this->Internal->GetTargetPlmImage(this, beamNode);
   if (!plmTgt)
   {
     std::string errorMessage("Failed to convert reference segment labelmap into Plm_image");
@@ -925,48 +1013,250 @@ void vtkSlicerExternalBeamPlanningModuleLogic::ComputeDoseByPlastimatch(vtkMRMLR
   
   
 //  vtkOrientedImageData* targetLabelmap = vtkOrientedImageData::SafeDownCast(targetSegmentationNode->GetSegmentation()->GetSegmentRepresentation(beamNode->GetTargetSegmentID(), vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()));
-//  printf ("8\n");
 //  vtkSmartPointer<vtkMRMLScalarVolumeNode> targetLabelmapNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-//  printf ("9\n");
 //  targetLabelmapNode->SetAndObserveImageData(targetLabelmap);
 
-  printf ("10a\n");
 //  Plm_image::Pointer plmTgt = PlmCommon::ConvertVolumeNodeToPlmImage(
 //    targetLabelmapNode);
-  printf ("10b\n");
-  plmTgt->print ();
 
-  printf ("11\n");
   double src[3];
   double isocenter[3] = { 0, 0, 0 };
+  this->GetBeamIsocenterAndSourcePosition(beamNode, isocenter, src);
+
+  double RxDose = rtPlanNode->GetRxDose();
+
+  if (!this->Internal->doseEngine->CalculateDose (
+    beamNode, 
+    plmTgt, 
+    isocenter, 
+    src,
+    RxDose))
+  {
+    vtkErrorMacro("ComputeDoseByPlastimatch: Dose calculation failed for beam " << beamNode->GetName());
+    return;
+  }
+
+  this->AddBeamDoseCalculationResultsToScene(beamNode,
+    this->Internal->doseEngine->GetRangeCompensatorVolume(),
+    this->Internal->doseEngine->GetApertureVolume(),
+    this->Internal->doseEngine->GetComputedDose() );
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::ComputeDoseForAllBeams()
+{
+  if ( !this->GetMRMLScene() || !this->ExternalBeamPlanningNode )
+  {
+    vtkErrorMacro("ComputeDoseForAllBeams: Invalid MRML scene or parameter set node!");
+    return;
+  }
+  if (this->Internal->DoseCalculationInProgress)
+  {
+    vtkErrorMacro("ComputeDoseForAllBeams: Dose calculation is already in progress!");
+    return;
+  }
+  vtkMRMLRTPlanNode* rtPlanNode = this->GetRTPlanNode();
+  if (!rtPlanNode || !rtPlanNode->GetRTPlanReferenceVolumeNode())
+  {
+    vtkErrorMacro("ComputeDoseForAllBeams: Inputs are not initialized!");
+    return;
+  }
+
+  std::vector<vtkMRMLRTBeamNode*> beams;
+  rtPlanNode->GetRTBeamNodes(beams);
+
+  // Only the Plastimatch engine supports calculating the beams in parallel
+  if (rtPlanNode->GetRTPlanDoseEngine() != vtkMRMLRTPlanNode::Plastimatch)
+  {
+    for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt)
+    {
+      this->ComputeDose(*beamIt);
+    }
+    return;
+  }
+
+  // Calculate all beams in parallel and accumulate the total dose
+  this->InitializeAccumulatedDose();
+  this->QueueBeamsForDoseCalculation();
+  if (!this->Internal->doseEngine->CalculateDoseForAllBeams())
+  {
+    vtkErrorMacro("ComputeDoseForAllBeams: Dose calculation failed!");
+    this->Internal->doseEngine->FinalizeAccumulatedDose();
+    return;
+  }
+
+  this->AddDoseCalculationResultsToScene();
+  this->RegisterAccumulatedDose();
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerExternalBeamPlanningModuleLogic::StartDoseCalculation()
+{
+  if ( !this->GetMRMLScene() || !this->ExternalBeamPlanningNode )
+  {
+    vtkErrorMacro("StartDoseCalculation: Invalid MRML scene or parameter set node!");
+    return false;
+  }
+  if (this->Internal->DoseCalculationInProgress)
+  {
+    vtkErrorMacro("StartDoseCalculation: Dose calculation is already in progress!");
+    return false;
+  }
+  vtkMRMLRTPlanNode* rtPlanNode = this->GetRTPlanNode();
+  if (!rtPlanNode || !rtPlanNode->GetRTPlanReferenceVolumeNode())
+  {
+    vtkErrorMacro("StartDoseCalculation: Inputs are not initialized!");
+    return false;
+  }
+  if (rtPlanNode->GetRTPlanDoseEngine() != vtkMRMLRTPlanNode::Plastimatch)
+  {
+    vtkErrorMacro("StartDoseCalculation: Background dose calculation is only available for the Plastimatch dose engine!");
+    return false;
+  }
+
+  // Inputs are prepared in the main thread, only the calculation runs in the background
+  this->InitializeAccumulatedDose();
+  this->QueueBeamsForDoseCalculation();
+  if (!this->Internal->doseEngine->StartDoseCalculationForAllBeams())
+  {
+    this->Internal->doseEngine->FinalizeAccumulatedDose();
+    return false;
+  }
+
+  this->Internal->DoseCalculationInProgress = true;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerExternalBeamPlanningModuleLogic::IsDoseCalculationInProgress()
+{
+  return this->Internal->DoseCalculationInProgress;
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerExternalBeamPlanningModuleLogic::GetDoseCalculationProgress()
+{
+  if (!this->Internal->DoseCalculationInProgress)
+  {
+    return 0.0;
+  }
+  return this->Internal->doseEngine->GetDoseCalculationProgress();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::CancelDoseCalculation()
+{
+  if (this->Internal->DoseCalculationInProgress)
+  {
+    this->Internal->doseEngine->CancelDoseCalculation();
+  }
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerExternalBeamPlanningModuleLogic::UpdateDoseCalculation()
+{
+  if (!this->Internal->DoseCalculationInProgress)
+  {
+    return false;
+  }
+
+  double progress = this->Internal->doseEngine->GetDoseCalculationProgress();
+  this->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+  if (this->Internal->doseEngine->IsDoseCalculationRunning())
+  {
+    return true;
+  }
+
+  // Calculation is finished (or cancelled), add the results of the calculated beams to the scene
+  this->Internal->DoseCalculationInProgress = false;
+  bool success = this->Internal->doseEngine->FinishDoseCalculationForAllBeams();
+  if (this->GetMRMLScene() && this->ExternalBeamPlanningNode && this->GetRTPlanNode())
+  {
+    this->AddDoseCalculationResultsToScene();
+    this->RegisterAccumulatedDose();
+  }
+  else
+  {
+    this->Internal->doseEngine->FinalizeAccumulatedDose();
+  }
+
+  this->InvokeEvent(vtkSlicerExternalBeamPlanningModuleLogic::DoseCalculationFinishedEvent, &success);
+  return false;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::QueueBeamsForDoseCalculation()
+{
+  vtkMRMLRTPlanNode* rtPlanNode = this->GetRTPlanNode();
+  std::vector<vtkMRMLRTBeamNode*> beams;
+  rtPlanNode->GetRTBeamNodes(beams);
+
+  // Prepare inputs of all beams in the main thread (segmentation conversion and MRML access are not thread safe)
+  double RxDose = rtPlanNode->GetRxDose();
+  for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt)
+  {
+    vtkMRMLRTBeamNode* beamNode = (*beamIt);
+    Plm_image::Pointer plmTgt = this->Internal->GetTargetPlmImage(this, beamNode);
+    if (!plmTgt)
+    {
+      vtkErrorMacro("QueueBeamsForDoseCalculation: Failed to convert target segment labelmap of beam " << beamNode->GetName() << " into Plm_image");
+      continue;
+    }
+
+    double src[3] = { 0, 0, 0 };
+    double isocenter[3] = { 0, 0, 0 };
+    this->GetBeamIsocenterAndSourcePosition(beamNode, isocenter, src);
+    this->Internal->doseEngine->AddBeamToDoseCalculation(beamNode, plmTgt, isocenter, src, RxDose);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::AddDoseCalculationResultsToScene()
+{
+  // Add per-beam results to the scene. Beams removed from the scene meanwhile are skipped
+  for (int beamIndex=0; beamIndex<this->Internal->doseEngine->GetNumberOfBeamsInDoseCalculation(); ++beamIndex)
+  {
+    vtkMRMLRTBeamNode* beamNode = this->Internal->doseEngine->GetBeamInDoseCalculation(beamIndex);
+    if (!beamNode || beamNode->GetScene() != this->GetMRMLScene())
+    {
+      continue;
+    }
+    if (this->Internal->doseEngine->GetComputedDose(beamIndex).IsNull())
+    {
+      continue;
+    }
+    this->AddBeamDoseCalculationResultsToScene(beamNode,
+      this->Internal->doseEngine->GetRangeCompensatorVolume(beamIndex),
+      this->Internal->doseEngine->GetApertureVolume(beamIndex),
+      this->Internal->doseEngine->GetComputedDose(beamIndex) );
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::GetBeamIsocenterAndSourcePosition(vtkMRMLRTBeamNode* beamNode, double isocenter[3], double src[3])
+{
   beamNode->GetIsocenterPosition(isocenter);
   isocenter[0] = -isocenter[0];
   isocenter[1] = -isocenter[1];
 
   /* Adjust src according to gantry angle */
-  printf ("12\n");
   double ga_radians = 
     beamNode->GetGantryAngle() * M_PI / 180.;
   double src_dist = beamNode->GetSAD();
   src[0] = isocenter[0] + src_dist * sin(ga_radians);
   src[1] = isocenter[1] - src_dist * cos(ga_radians);
   src[2] = isocenter[2];
+}
 
-  double RxDose = rtPlanNode->GetRxDose();
-
-  printf ("Gonna try to doseEngine->CalculateDose()\n");
-  this->Internal->doseEngine->CalculateDose (
-    beamNode, 
-    plmTgt, 
-    isocenter, 
-    src,
-    RxDose);
+//---------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::AddBeamDoseCalculationResultsToScene(vtkMRMLRTBeamNode* beamNode,
+  itk::Image<float, 3>::Pointer rcVolumeItk, itk::Image<unsigned char, 3>::Pointer apertureVolumeItk, itk::Image<float, 3>::Pointer doseVolumeItk)
+{
+  vtkMRMLScalarVolumeNode* referenceVolumeNode = this->GetRTPlanNode()->GetRTPlanReferenceVolumeNode();
 
   /* Create the MRML node for the volume */
   vtkSmartPointer<vtkMRMLScalarVolumeNode> rcVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
 
-  itk::Image<float, 3>::Pointer rcVolumeItk = this->Internal->doseEngine->GetRangeCompensatorVolume();
-
   /* Convert range compensator image to vtk */
   vtkSmartPointer<vtkImageData> rcVolume = vtkSmartPointer<vtkImageData>::New();
   SlicerRtCommon::ConvertItkImageToVtkImageData<float>(rcVolumeItk, rcVolume, VTK_FLOAT);
@@ -992,8 +1282,6 @@ void vtkSlicerExternalBeamPlanningModuleLogic::ComputeDoseByPlastimatch(vtkMRMLR
   vtkSmartPointer<vtkMRMLScalarVolumeNode> apertureVolumeNode =
     vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
 
-  itk::Image<unsigned char, 3>::Pointer apertureVolumeItk = this->Internal->doseEngine->GetApertureVolume();
-
   /* Convert aperture image to vtk */
   vtkSmartPointer<vtkImageData> apertureVolume = vtkSmartPointer<vtkImageData>::New();
   SlicerRtCommon::ConvertItkImageToVtkImageData<unsigned char>(apertureVolumeItk, apertureVolume, VTK_UNSIGNED_CHAR);
@@ -1021,7 +1309,6 @@ void vtkSlicerExternalBeamPlanningModuleLogic::ComputeDoseByPlastimatch(vtkMRMLR
 
   /* Convert dose image to vtk */
   vtkSmartPointer<vtkImageData> doseVolume = vtkSmartPointer<vtkImageData>::New();
-  itk::Image<float, 3>::Pointer doseVolumeItk = this->Internal->doseEngine->GetComputedDose();
   SlicerRtCommon::ConvertItkImageToVtkImageData<float>(doseVolumeItk, doseVolume, VTK_FLOAT);
 
   doseVolumeNode->SetAndObserveImageData (doseVolume);
@@ -1135,7 +1422,8 @@ void vtkSlicerExternalBeamPlanningModuleLogic::InitializeAccumulatedDose()
   }
 
   vtkMRMLScalarVolumeNode* referenceVolumeNode = planNode->GetRTPlanReferenceVolumeNode();
-  Plm_image::Pointer plmRef = PlmCommon::ConvertVolumeNodeToPlmImage(referenceVolumeNode);
+  // Reference volume is only converted again if it changed since the last calculation
+  Plm_image::Pointer plmRef = this->Internal->GetReferencePlmImage(referenceVolumeNode);
   this->Internal->doseEngine->InitializeAccumulatedDose(plmRef);
 }
 
@@ -1235,6 +1523,12 @@ void vtkSlicerExternalBeamPlanningModuleLogic::RegisterAccumulatedDose()
   }
 }
 
+//---------------------------------------------------------------------------
+void vtkSlicerExternalBeamPlanningModuleLogic::ClearDoseCalculationCache()
+{
+  this->Internal->ClearCache();
+}
+
 //---------------------------------------------------------------------------
 void vtkSlicerExternalBeamPlanningModuleLogic::RemoveDoseNodes()
 {
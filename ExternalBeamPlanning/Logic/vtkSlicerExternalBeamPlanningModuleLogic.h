@@ -34,6 +34,9 @@
 
 // MRML includes
 
+// VTK includes
+#include <vtkCommand.h>
+
 // ITK includes
 #include <itkImage.h>
 
@@ -54,6 +57,12 @@ class VTK_SLICER_EXTERNALBEAMPLANNING_MODULE_LOGIC_EXPORT vtkSlicerExternalBeamP
   public vtkSlicerModuleLogic
 {
 public:
+  enum
+  {
+    /// Invoked when a dose calculation started by StartDoseCalculation is finished or cancelled,
+    /// and its results are added to the scene. Call data is a pointer to a bool indicating success
+    DoseCalculationFinishedEvent = vtkCommand::UserEvent + 1
+  };
 
   static vtkSlicerExternalBeamPlanningModuleLogic *New();
   vtkTypeMacro(vtkSlicerExternalBeamPlanningModuleLogic, vtkSlicerModuleLogic);
@@ -86,9 +95,22 @@ public:
   /// TODO
   void SetBeamIsocenterToTargetCenter (vtkMRMLRTBeamNode *beam);
 
-  /// TODO
+  /// Compute the DRR of the reference volume in the beam's eye view of the beam with the given name
+  /// and store it in the DRR volume node of the beam. The DRR is computed by ray tracing on the CPU
+  /// (\sa vtkSlicerDRRCalculationEngine), so no render window is needed
   void UpdateDRR(char*);
 
+  /// Project the segments of the target segmentation of the beam into the beam's eye view, and store
+  /// the projections as a multi-label image in the contour BEV volume node of the beam.
+  /// The projection is computed analytically on the DRR image grid, so no render window is needed
+  void UpdateContourBEV(vtkMRMLRTBeamNode* beamNode);
+
+  /// Set the jaw positions of the beam so that the field covers the projection of the target segment
+  /// in the beam's eye view. It is not exposed in the module GUI, it is available for scripting
+  /// \param margin Distance between the projected target and the jaws on the isocenter plane (mm)
+  /// \return Success
+  bool FitBeamJawsToTarget(vtkMRMLRTBeamNode* beamNode, double margin);
+
   /// Get labelmap from target segment of beam node
   vtkSmartPointer<vtkOrientedImageData> GetTargetLabelmap(vtkMRMLRTBeamNode* beamNode);
 
@@ -98,6 +120,35 @@ public:
   /// TODO
   void ComputeDoseByPlastimatch (vtkMRMLRTBeamNode*);
 
+  /// Compute dose for all beams of the plan. With the Plastimatch engine the beams are
+  /// calculated in parallel and their doses are added to the accumulated dose, which is
+  /// registered in the scene (\sa InitializeAccumulatedDose, RegisterAccumulatedDose).
+  /// Rejected while a background dose calculation is in progress (\sa StartDoseCalculation)
+  void ComputeDoseForAllBeams();
+
+  /// Start dose calculation for all beams of the plan in the background (Plastimatch engine only).
+  /// The accumulated dose is initialized and the inputs are prepared before returning, then the beams
+  /// are calculated in a worker thread, so the scene can be used during the calculation.
+  /// UpdateDoseCalculation must be called periodically from the main thread until it returns false.
+  /// \return False if the calculation could not be started
+  bool StartDoseCalculation();
+
+  /// Return true if a background dose calculation is started and its results are not yet added to the scene
+  bool IsDoseCalculationInProgress();
+
+  /// Get progress of the background dose calculation (between 0 and 1)
+  double GetDoseCalculationProgress();
+
+  /// Request the background dose calculation to stop. Doses of the beams that are already calculated
+  /// are added to the scene and the accumulated dose as partial result
+  void CancelDoseCalculation();
+
+  /// Process the state of the background dose calculation. Invokes ProgressEvent (call data is a pointer
+  /// to the progress value). When the calculation is finished, the results are added to the scene,
+  /// the accumulated dose is registered and DoseCalculationFinishedEvent is invoked.
+  /// \return True if the calculation is still running
+  bool UpdateDoseCalculation();
+
   /// TODO
   void ComputeWED ();
 
@@ -114,6 +165,10 @@ public:
   /// TODO
   void RegisterAccumulatedDose();
 
+  /// Clear the converted reference and target volumes and the beam results kept
+  /// for reuse by the next dose calculation
+  void ClearDoseCalculationCache();
+
   /// Remove all MRML nodes created by dose calculation, such as 
   /// apertures, range compensators, and doses
   void RemoveDoseNodes();
@@ -132,6 +187,21 @@ protected:
   virtual void OnMRMLSceneEndImport();
   virtual void OnMRMLSceneEndClose();
 
+  /// Get isocenter and source position of a beam in the dose calculation coordinate system
+  void GetBeamIsocenterAndSourcePosition(vtkMRMLRTBeamNode* beamNode, double isocenter[3], double src[3]);
+
+  /// Queue all beams of the plan for dose calculation in the dose engine
+  void QueueBeamsForDoseCalculation();
+
+  /// Add results of the beams calculated by the dose engine to the scene
+  void AddDoseCalculationResultsToScene();
+
+  /// Add range compensator, aperture and dose volumes calculated for a beam to the scene
+  void AddBeamDoseCalculationResultsToScene(vtkMRMLRTBeamNode* beamNode,
+    itk::Image<float, 3>::Pointer rcVolumeItk,
+    itk::Image<unsigned char, 3>::Pointer apertureVolumeItk,
+    itk::Image<float, 3>::Pointer doseVolumeItk);
+
   /// Parameter set MRML node
   vtkMRMLExternalBeamPlanningNode* ExternalBeamPlanningNode;
   int DRRImageSize[2];
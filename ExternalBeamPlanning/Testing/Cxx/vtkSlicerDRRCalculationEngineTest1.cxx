@@ -0,0 +1,274 @@
+/*==============================================================================
+
+  Copyright (c) Radiation Medicine Program, University Health Network,
+  Princess Margaret Hospital, Toronto, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Kevin Wang, Princess Margaret Cancer Centre
+  and was supported by Cancer Care Ontario (CCO)'s ACRU program
+  with funds provided by the Ontario Ministry of Health and Long-Term Care
+  and Ontario Consortium for Adaptive Interventions in Radiation Oncology (OCAIRO).
+
+==============================================================================*/
+
+// ExternalBeamPlanning includes
+#include "vtkSlicerDRRCalculationEngine.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  /// Phantom: box of 200 x 100 x 200 mm (RAS) centered on the origin, with 2mm voxels
+  const int PHANTOM_EXTENT[6] = {0, 99, 0, 49, 0, 99};
+  const double PHANTOM_SPACING = 2.0;
+  const double PHANTOM_HALF_SIZE[3] = {100.0, 50.0, 100.0};
+
+  const double SAD = 1000.0;
+  const double WATER_ATTENUATION = 0.02;
+  const int IMAGE_SIZE = 9;
+  const double IMAGE_SPACING = 40.0;
+
+  /// Create phantom with uniform Hounsfield units and its IJK to RAS matrix
+  void CreatePhantom(vtkImageData* imageData, vtkMatrix4x4* ijkToRasMatrix, short hounsfieldUnits)
+  {
+    imageData->SetExtent(const_cast<int*>(PHANTOM_EXTENT));
+    imageData->AllocateScalars(VTK_SHORT, 1);
+    short* voxelPtr = static_cast<short*>(imageData->GetScalarPointer());
+    std::fill(voxelPtr, voxelPtr + imageData->GetNumberOfPoints(), hounsfieldUnits);
+
+    ijkToRasMatrix->Identity();
+    for (int axis=0; axis<3; ++axis)
+    {
+      ijkToRasMatrix->SetElement(axis, axis, PHANTOM_SPACING);
+      ijkToRasMatrix->SetElement(axis, 3, -PHANTOM_HALF_SIZE[axis] + 0.5 * PHANTOM_SPACING);
+    }
+  }
+
+  /// Ring structure: square contours of 200mm with a square hole of 120mm on three slices 10mm apart
+  const double RING_OUTER_HALF_SIZE = 100.0;
+  const double RING_INNER_HALF_SIZE = 60.0;
+  const double RING_SLICE_POSITIONS[3] = {-10.0, 0.0, 10.0};
+  const unsigned short RING_LABEL = 3;
+
+  /// Create planar contours of the ring structure on axial slices
+  void CreateRingContours(vtkPolyData* polyData)
+  {
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+    double halfSizes[2] = {RING_OUTER_HALF_SIZE, RING_INNER_HALF_SIZE};
+    double corners[4][2] = { {-1.0, -1.0}, {1.0, -1.0}, {1.0, 1.0}, {-1.0, 1.0} };
+    for (int sliceIndex=0; sliceIndex<3; ++sliceIndex)
+    {
+      for (int contourIndex=0; contourIndex<2; ++contourIndex)
+      {
+        lines->InsertNextCell(4);
+        for (int cornerIndex=0; cornerIndex<4; ++cornerIndex)
+        {
+          lines->InsertCellPoint(points->InsertNextPoint( corners[cornerIndex][0] * halfSizes[contourIndex],
+            corners[cornerIndex][1] * halfSizes[contourIndex], RING_SLICE_POSITIONS[sliceIndex] ));
+        }
+      }
+    }
+    polyData->SetPoints(points);
+    polyData->SetLines(lines);
+  }
+
+  bool IsWithinTolerance(double result, double expected)
+  {
+    return fabs(result - expected) <= 1e-4 * std::max(1.0, fabs(expected));
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDRRCalculationEngineTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkImageData> phantomImageData = vtkSmartPointer<vtkImageData>::New();
+  vtkSmartPointer<vtkMatrix4x4> phantomIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  CreatePhantom(phantomImageData, phantomIjkToRasMatrix, 0);
+
+  vtkSmartPointer<vtkSlicerDRRCalculationEngine> drrEngine = vtkSmartPointer<vtkSlicerDRRCalculationEngine>::New();
+  drrEngine->SetInputVolume(phantomImageData, phantomIjkToRasMatrix);
+  drrEngine->SetSAD(SAD);
+  drrEngine->SetGantryAngle(0.0);
+  drrEngine->SetWaterAttenuationCoefficient(WATER_ATTENUATION);
+  drrEngine->SetImageSize(IMAGE_SIZE, IMAGE_SIZE);
+  drrEngine->SetImageSpacing(IMAGE_SPACING, IMAGE_SPACING);
+
+  vtkSmartPointer<vtkImageData> drrImageData = vtkSmartPointer<vtkImageData>::New();
+  vtkSmartPointer<vtkMatrix4x4> drrIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!drrEngine->ComputeDRR(drrImageData, drrIjkToRasMatrix))
+  {
+    std::cerr << "Failed to compute DRR!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Gantry 0: the source is anterior to the isocenter, the rays cross the 100mm thick phantom
+  // through its anterior and posterior faces, or miss the phantom if they are far from the axis
+  double sourceRas[3] = {0.0, SAD, 0.0};
+  for (int row=0; row<IMAGE_SIZE; ++row)
+  {
+    for (int column=0; column<IMAGE_SIZE; ++column)
+    {
+      double pixelIjk[4] = {(double)column, (double)row, 0.0, 1.0};
+      double pixelRas[4] = {0.0, 0.0, 0.0, 1.0};
+      drrIjkToRasMatrix->MultiplyPoint(pixelIjk, pixelRas);
+      if (fabs(pixelRas[1]) > 1e-6)
+      {
+        std::cerr << "DRR pixel (" << column << ", " << row << ") is not on the isocenter plane!" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      // Pixels are at 0, 40, 80, 120 and 160 mm from the axis and the phantom extends to 100mm laterally.
+      // Magnification within the phantom is between 0.95 and 1.05, so the rays within 80mm cross the whole
+      // phantom, and the rays from 120mm miss it
+      double expectedValue = -1.0;
+      double lateralDistance = std::max(fabs(pixelRas[0]), fabs(pixelRas[2]));
+      if (lateralDistance < 2.5 * IMAGE_SPACING)
+      {
+        double rayLength = sqrt(vtkMath::Distance2BetweenPoints(sourceRas, pixelRas));
+        expectedValue = WATER_ATTENUATION * 2.0 * PHANTOM_HALF_SIZE[1] * rayLength / SAD;
+      }
+      else
+      {
+        expectedValue = 0.0;
+      }
+
+      double value = drrImageData->GetScalarComponentAsDouble(column, row, 0, 0);
+      if (!IsWithinTolerance(value, expectedValue))
+      {
+        std::cerr << "DRR pixel (" << column << ", " << row << ") mismatch: " << value << " instead of " << expectedValue << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // Result does not depend on the number of threads
+  vtkSmartPointer<vtkImageData> singleThreadDrrImageData = vtkSmartPointer<vtkImageData>::New();
+  drrEngine->SetNumberOfThreads(1);
+  drrEngine->ComputeDRR(singleThreadDrrImageData, drrIjkToRasMatrix);
+  drrEngine->SetNumberOfThreads(0);
+  float* drrPtr = static_cast<float*>(drrImageData->GetScalarPointer());
+  float* singleThreadDrrPtr = static_cast<float*>(singleThreadDrrImageData->GetScalarPointer());
+  if (!std::equal(drrPtr, drrPtr + IMAGE_SIZE*IMAGE_SIZE, singleThreadDrrPtr))
+  {
+    std::cerr << "DRR computed with one thread differs from the multithreaded result!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Gantry 90: the central ray crosses the 200mm wide phantom from left to right
+  int centerPixel = IMAGE_SIZE / 2;
+  drrEngine->SetGantryAngle(90.0);
+  drrEngine->ComputeDRR(drrImageData, drrIjkToRasMatrix);
+  double centralValue = drrImageData->GetScalarComponentAsDouble(centerPixel, centerPixel, 0, 0);
+  double expectedCentralValue = WATER_ATTENUATION * 2.0 * PHANTOM_HALF_SIZE[0];
+  if (!IsWithinTolerance(centralValue, expectedCentralValue))
+  {
+    std::cerr << "Central DRR pixel mismatch at gantry angle 90: " << centralValue << " instead of " << expectedCentralValue << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Modified input volume is converted again: 1000 HU has twice the attenuation of water
+  short* phantomPtr = static_cast<short*>(phantomImageData->GetScalarPointer());
+  std::fill(phantomPtr, phantomPtr + phantomImageData->GetNumberOfPoints(), 1000);
+  phantomImageData->Modified();
+  drrEngine->SetGantryAngle(0.0);
+  drrEngine->ComputeDRR(drrImageData, drrIjkToRasMatrix);
+  centralValue = drrImageData->GetScalarComponentAsDouble(centerPixel, centerPixel, 0, 0);
+  expectedCentralValue = 2.0 * WATER_ATTENUATION * 2.0 * PHANTOM_HALF_SIZE[1];
+  if (!IsWithinTolerance(centralValue, expectedCentralValue))
+  {
+    std::cerr << "Central DRR pixel mismatch after changing the phantom to 1000 HU: " << centralValue << " instead of " << expectedCentralValue << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Air has no attenuation
+  std::fill(phantomPtr, phantomPtr + phantomImageData->GetNumberOfPoints(), -1000);
+  phantomImageData->Modified();
+  drrEngine->ComputeDRR(drrImageData, drrIjkToRasMatrix);
+  double drrRange[2] = {0.0, 0.0};
+  drrImageData->GetScalarRange(drrRange);
+  if (drrRange[0] != 0.0 || drrRange[1] != 0.0)
+  {
+    std::cerr << "DRR of an air phantom is not zero: range is " << drrRange[0] << ", " << drrRange[1] << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Planar contours: the slices of the ring are rotated to be perpendicular to the beam axis at gantry 0,
+  // so the hole is visible. Rays within 40mm from the axis go through the hole, rays at 80mm hit the ring
+  vtkSmartPointer<vtkPolyData> ringPolyData = vtkSmartPointer<vtkPolyData>::New();
+  CreateRingContours(ringPolyData);
+  vtkSmartPointer<vtkMatrix4x4> ringToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  ringToRasMatrix->Zero();
+  ringToRasMatrix->SetElement(0, 0, 1.0);
+  ringToRasMatrix->SetElement(1, 2, 1.0);
+  ringToRasMatrix->SetElement(2, 1, -1.0);
+  ringToRasMatrix->SetElement(3, 3, 1.0);
+
+  vtkSmartPointer<vtkImageData> contourBEVImageData = vtkSmartPointer<vtkImageData>::New();
+  contourBEVImageData->SetExtent(0, IMAGE_SIZE-1, 0, IMAGE_SIZE-1, 0, 0);
+  contourBEVImageData->AllocateScalars(VTK_UNSIGNED_SHORT, 1);
+  vtkSmartPointer<vtkMatrix4x4> contourBEVIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  for (int gantryAngle=0; gantryAngle<=90; gantryAngle+=90)
+  {
+    unsigned short* contourBEVPtr = static_cast<unsigned short*>(contourBEVImageData->GetScalarPointer());
+    std::fill(contourBEVPtr, contourBEVPtr + IMAGE_SIZE*IMAGE_SIZE, 0);
+    drrEngine->SetGantryAngle(gantryAngle);
+    if (!drrEngine->ProjectPolyData(ringPolyData, ringToRasMatrix, contourBEVImageData, RING_LABEL))
+    {
+      std::cerr << "Failed to project planar contours at gantry angle " << gantryAngle << std::endl;
+      return EXIT_FAILURE;
+    }
+    drrEngine->GetImageIjkToRasMatrix(contourBEVIjkToRasMatrix);
+
+    for (int row=0; row<IMAGE_SIZE; ++row)
+    {
+      for (int column=0; column<IMAGE_SIZE; ++column)
+      {
+        double pixelIjk[4] = {(double)column, (double)row, 0.0, 1.0};
+        double pixelRas[4] = {0.0, 0.0, 0.0, 1.0};
+        contourBEVIjkToRasMatrix->MultiplyPoint(pixelIjk, pixelRas);
+
+        // At gantry 90 the beam is parallel to the slices, so the ring is seen from the side as a 30mm
+        // thick slab (the three 10mm thick slices), and the hole is not visible
+        bool expectedInside = false;
+        if (gantryAngle == 0)
+        {
+          expectedInside = IsWithinTolerance(std::max(fabs(pixelRas[0]), fabs(pixelRas[2])), 2.0 * IMAGE_SPACING);
+        }
+        else
+        {
+          expectedInside = (fabs(pixelRas[1]) < 1e-6 && fabs(pixelRas[2]) < 2.5 * IMAGE_SPACING);
+        }
+        unsigned short value = contourBEVPtr[row * IMAGE_SIZE + column];
+        if (value != (expectedInside ? RING_LABEL : 0))
+        {
+          std::cerr << "Projected contour pixel (" << column << ", " << row << ") mismatch at gantry angle " << gantryAngle
+            << ": " << value << " instead of " << (expectedInside ? RING_LABEL : 0) << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
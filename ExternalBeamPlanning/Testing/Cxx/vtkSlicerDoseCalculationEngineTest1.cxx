@@ -0,0 +1,555 @@
+/*==============================================================================
+
+  Copyright (c) Radiation Medicine Program, University Health Network,
+  Princess Margaret Hospital, Toronto, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Kevin Wang, Princess Margaret Cancer Centre
+  and was supported by Cancer Care Ontario (CCO)'s ACRU program
+  with funds provided by the Ontario Ministry of Health and Long-Term Care
+  and Ontario Consortium for Adaptive Interventions in Radiation Oncology (OCAIRO).
+
+==============================================================================*/
+
+// ExternalBeamPlanning includes
+#include "vtkMRMLRTProtonBeamNode.h"
+#include "vtkSlicerDoseCalculationEngine.h"
+
+// Plastimatch includes
+#include "plm_image.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+
+// ITK includes
+#include <itkImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  /// Water phantom: cube of 100mm centered on the origin, with 2.5mm voxels
+  const int PHANTOM_SIZE = 40;
+  const double PHANTOM_SPACING = 2.5;
+  /// Target: cube of 20mm in the center of the phantom, which is also the isocenter
+  const double TARGET_HALF_SIZE = 10.0;
+
+  const int NUMBER_OF_BEAMS = 3;
+  const double GANTRY_ANGLES[NUMBER_OF_BEAMS] = {0.0, 120.0, 240.0};
+  const double JAW_SIZE = 15.0;
+  const double PENCIL_BEAM_RESOLUTION = 2.0;
+  const double RX_DOSE = 1.0;
+  const double DOSE_TOLERANCE = 1e-4;
+
+  typedef itk::Image<float, 3> DoseImageType;
+
+  /// Create image on the phantom grid filled with zeros
+  template<class T> typename itk::Image<T, 3>::Pointer CreatePhantomImage()
+  {
+    typedef itk::Image<T, 3> ImageType;
+    typename ImageType::SizeType size;
+    size.Fill(PHANTOM_SIZE);
+    typename ImageType::RegionType region;
+    region.SetSize(size);
+    typename ImageType::SpacingType spacing;
+    spacing.Fill(PHANTOM_SPACING);
+    typename ImageType::PointType origin;
+    origin.Fill(-0.5 * (PHANTOM_SIZE - 1) * PHANTOM_SPACING);
+
+    typename ImageType::Pointer image = ImageType::New();
+    image->SetRegions(region);
+    image->SetSpacing(spacing);
+    image->SetOrigin(origin);
+    image->Allocate();
+    image->FillBuffer(0);
+    return image;
+  }
+
+  /// Create reference volume of water (0 HU)
+  Plm_image::Pointer CreateReference()
+  {
+    Plm_image::Pointer plmRef = Plm_image::New();
+    plmRef->set_itk(CreatePhantomImage<short>());
+    return plmRef;
+  }
+
+  /// Create target labelmap
+  Plm_image::Pointer CreateTarget()
+  {
+    itk::Image<unsigned char, 3>::Pointer targetItk = CreatePhantomImage<unsigned char>();
+    itk::ImageRegionIteratorWithIndex< itk::Image<unsigned char, 3> > targetIt(targetItk, targetItk->GetLargestPossibleRegion());
+    for (targetIt.GoToBegin(); !targetIt.IsAtEnd(); ++targetIt)
+    {
+      itk::Image<unsigned char, 3>::PointType point;
+      targetItk->TransformIndexToPhysicalPoint(targetIt.GetIndex(), point);
+      if ( fabs(point[0]) <= TARGET_HALF_SIZE && fabs(point[1]) <= TARGET_HALF_SIZE && fabs(point[2]) <= TARGET_HALF_SIZE )
+      {
+        targetIt.Set(1);
+      }
+    }
+
+    Plm_image::Pointer plmTgt = Plm_image::New();
+    plmTgt->set_itk(targetItk);
+    return plmTgt;
+  }
+
+  /// Create proton beams around the target. Beams are added to the scene, as beam results are identified by node ID
+  void CreateBeams(vtkMRMLScene* scene, std::vector<vtkMRMLRTProtonBeamNode*>& beams)
+  {
+    for (int beamIndex=0; beamIndex<NUMBER_OF_BEAMS; ++beamIndex)
+    {
+      vtkSmartPointer<vtkMRMLRTProtonBeamNode> beamNode = vtkSmartPointer<vtkMRMLRTProtonBeamNode>::New();
+      beamNode->SetGantryAngle(GANTRY_ANGLES[beamIndex]);
+      beamNode->SetX1Jaw(JAW_SIZE);
+      beamNode->SetX2Jaw(JAW_SIZE);
+      beamNode->SetY1Jaw(JAW_SIZE);
+      beamNode->SetY2Jaw(JAW_SIZE);
+      beamNode->SetPBResolution(PENCIL_BEAM_RESOLUTION);
+      scene->AddNode(beamNode);
+      beams.push_back(beamNode);
+    }
+  }
+
+  /// Get source position the same way as the module logic, for a beam with the isocenter in the origin
+  void GetSourcePosition(vtkMRMLRTBeamNode* beamNode, double src[3])
+  {
+    double gantryAngleRadians = beamNode->GetGantryAngle() * vtkMath::Pi() / 180.0;
+    src[0] = beamNode->GetSAD() * sin(gantryAngleRadians);
+    src[1] = -beamNode->GetSAD() * cos(gantryAngleRadians);
+    src[2] = 0.0;
+  }
+
+  /// Queue all the beams for the parallel dose calculation
+  bool AddBeams(vtkSlicerDoseCalculationEngine* engine, std::vector<vtkMRMLRTProtonBeamNode*>& beams, Plm_image::Pointer& plmTgt)
+  {
+    for (std::vector<vtkMRMLRTProtonBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt)
+    {
+      double isocenter[3] = {0.0, 0.0, 0.0};
+      double src[3] = {0.0, 0.0, 0.0};
+      GetSourcePosition(*beamIt, src);
+      if (!engine->AddBeamToDoseCalculation(*beamIt, plmTgt, isocenter, src, RX_DOSE))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Calculate dose for all the beams in parallel
+  bool CalculateAllBeams(vtkSlicerDoseCalculationEngine* engine, std::vector<vtkMRMLRTProtonBeamNode*>& beams,
+    Plm_image::Pointer& plmRef, Plm_image::Pointer& plmTgt)
+  {
+    engine->InitializeAccumulatedDose(plmRef);
+    return AddBeams(engine, beams, plmTgt) && engine->CalculateDoseForAllBeams();
+  }
+
+  /// Get the dose volumes of the beams in the last calculation
+  std::vector<DoseImageType::Pointer> GetBeamDoses(vtkSlicerDoseCalculationEngine* engine)
+  {
+    std::vector<DoseImageType::Pointer> beamDoses;
+    for (int beamIndex=0; beamIndex<engine->GetNumberOfBeamsInDoseCalculation(); ++beamIndex)
+    {
+      beamDoses.push_back(engine->GetComputedDose(beamIndex));
+    }
+    return beamDoses;
+  }
+
+  /// Check which beams were taken from the cache, i.e. have the same dose volume as in the previous calculation
+  bool CheckCachedBeams(vtkSlicerDoseCalculationEngine* engine, const std::vector<DoseImageType::Pointer>& previousBeamDoses,
+    const bool expectedCached[NUMBER_OF_BEAMS], const char* name)
+  {
+    std::vector<DoseImageType::Pointer> beamDoses = GetBeamDoses(engine);
+    if (beamDoses.size() != previousBeamDoses.size())
+    {
+      std::cerr << "Number of beams changed: " << name << std::endl;
+      return false;
+    }
+    for (int beamIndex=0; beamIndex<(int)beamDoses.size(); ++beamIndex)
+    {
+      if (beamDoses[beamIndex].IsNull())
+      {
+        std::cerr << "Missing dose of beam " << beamIndex << ": " << name << std::endl;
+        return false;
+      }
+      bool cached = (beamDoses[beamIndex].GetPointer() == previousBeamDoses[beamIndex].GetPointer());
+      if (cached != expectedCached[beamIndex])
+      {
+        std::cerr << "Dose of beam " << beamIndex << (cached ? " is reused" : " is recalculated")
+          << " unexpectedly: " << name << std::endl;
+        return false;
+      }
+    }
+    return CheckAccumulatedDose(engine, name);
+  }
+
+  /// Get maximum of a dose volume
+  double GetMaximumDose(DoseImageType::Pointer dose)
+  {
+    const float* dosePtr = dose->GetBufferPointer();
+    size_t numberOfVoxels = dose->GetLargestPossibleRegion().GetNumberOfPixels();
+    return (numberOfVoxels > 0 ? *std::max_element(dosePtr, dosePtr + numberOfVoxels) : 0.0);
+  }
+
+  /// Compare two dose volumes voxel by voxel, with tolerance relative to the maximum of the expected dose
+  bool CompareDose(DoseImageType::Pointer dose, DoseImageType::Pointer expectedDose, const char* name)
+  {
+    if (dose.IsNull() || expectedDose.IsNull())
+    {
+      std::cerr << "Missing dose volume: " << name << std::endl;
+      return false;
+    }
+    if (dose->GetLargestPossibleRegion() != expectedDose->GetLargestPossibleRegion())
+    {
+      std::cerr << "Dose volume geometry mismatch: " << name << std::endl;
+      return false;
+    }
+    const float* dosePtr = dose->GetBufferPointer();
+    const float* expectedDosePtr = expectedDose->GetBufferPointer();
+    size_t numberOfVoxels = dose->GetLargestPossibleRegion().GetNumberOfPixels();
+    double tolerance = DOSE_TOLERANCE * std::max(1.0, GetMaximumDose(expectedDose));
+    for (size_t voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+    {
+      if (fabs(dosePtr[voxelIndex] - expectedDosePtr[voxelIndex]) > tolerance)
+      {
+        std::cerr << "Dose mismatch: " << name << " at voxel " << voxelIndex << ": "
+          << dosePtr[voxelIndex] << " instead of " << expectedDosePtr[voxelIndex] << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Check that the accumulated dose is the sum of the doses of the beams in the last calculation
+  bool CheckAccumulatedDose(vtkSlicerDoseCalculationEngine* engine, const char* name)
+  {
+    DoseImageType::Pointer accumulatedDose = engine->GetAccumulatedDose();
+    DoseImageType::Pointer sumOfBeamDoses = CreatePhantomImage<float>();
+    for (int beamIndex=0; beamIndex<engine->GetNumberOfBeamsInDoseCalculation(); ++beamIndex)
+    {
+      DoseImageType::Pointer beamDose = engine->GetComputedDose(beamIndex);
+      if (beamDose.IsNull())
+      {
+        continue;
+      }
+      if (beamDose->GetLargestPossibleRegion() != sumOfBeamDoses->GetLargestPossibleRegion())
+      {
+        std::cerr << "Beam dose is not on the reference grid: " << name << std::endl;
+        return false;
+      }
+      const float* beamDosePtr = beamDose->GetBufferPointer();
+      float* sumPtr = sumOfBeamDoses->GetBufferPointer();
+      size_t numberOfVoxels = sumOfBeamDoses->GetLargestPossibleRegion().GetNumberOfPixels();
+      for (size_t voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+      {
+        sumPtr[voxelIndex] += beamDosePtr[voxelIndex];
+      }
+    }
+    return CompareDose(accumulatedDose, sumOfBeamDoses, name);
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDoseCalculationEngineTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkMRMLScene> scene = vtkSmartPointer<vtkMRMLScene>::New();
+  std::vector<vtkMRMLRTProtonBeamNode*> beams;
+  CreateBeams(scene, beams);
+  Plm_image::Pointer plmRef = CreateReference();
+  Plm_image::Pointer plmTgt = CreateTarget();
+
+  // Calculate the beams one by one as reference
+  vtkSmartPointer<vtkSlicerDoseCalculationEngine> sequentialEngine = vtkSmartPointer<vtkSlicerDoseCalculationEngine>::New();
+  sequentialEngine->InitializeAccumulatedDose(plmRef);
+  for (std::vector<vtkMRMLRTProtonBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt)
+  {
+    double isocenter[3] = {0.0, 0.0, 0.0};
+    double src[3] = {0.0, 0.0, 0.0};
+    GetSourcePosition(*beamIt, src);
+    if (!sequentialEngine->CalculateDose(*beamIt, plmTgt, isocenter, src, RX_DOSE))
+    {
+      std::cerr << "Failed to calculate dose of a single beam!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  DoseImageType::Pointer expectedAccumulatedDose = sequentialEngine->GetAccumulatedDose();
+  sequentialEngine->FinalizeAccumulatedDose();
+  if (GetMaximumDose(expectedAccumulatedDose) <= 0.0)
+  {
+    std::cerr << "Accumulated dose of the single beam calculations is empty!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Calculate the beams in parallel, each beam in its own thread
+  vtkSmartPointer<vtkSlicerDoseCalculationEngine> parallelEngine = vtkSmartPointer<vtkSlicerDoseCalculationEngine>::New();
+  parallelEngine->SetNumberOfThreads(NUMBER_OF_BEAMS);
+  parallelEngine->InitializeAccumulatedDose(plmRef);
+  if (!AddBeams(parallelEngine, beams, plmTgt))
+  {
+    std::cerr << "Failed to add beams to the parallel dose calculation!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!parallelEngine->CalculateDoseForAllBeams())
+  {
+    std::cerr << "Parallel dose calculation failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (parallelEngine->GetNumberOfBeamsInDoseCalculation() != NUMBER_OF_BEAMS)
+  {
+    std::cerr << "Number of beams in the parallel dose calculation is " << parallelEngine->GetNumberOfBeamsInDoseCalculation()
+      << " instead of " << NUMBER_OF_BEAMS << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int beamIndex=0; beamIndex<NUMBER_OF_BEAMS; ++beamIndex)
+  {
+    if ( parallelEngine->GetBeamInDoseCalculation(beamIndex) != beams[beamIndex]
+      || parallelEngine->GetComputedDose(beamIndex).IsNull()
+      || parallelEngine->GetApertureVolume(beamIndex).IsNull()
+      || parallelEngine->GetRangeCompensatorVolume(beamIndex).IsNull() )
+    {
+      std::cerr << "Missing results for beam " << beamIndex << " in the parallel dose calculation!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if ( !CheckAccumulatedDose(parallelEngine, "parallel calculation")
+    || !CompareDose(parallelEngine->GetAccumulatedDose(), expectedAccumulatedDose, "parallel vs. single beam calculation") )
+  {
+    return EXIT_FAILURE;
+  }
+  parallelEngine->FinalizeAccumulatedDose();
+
+  // Result does not depend on the number of threads
+  vtkSmartPointer<vtkSlicerDoseCalculationEngine> singleThreadEngine = vtkSmartPointer<vtkSlicerDoseCalculationEngine>::New();
+  singleThreadEngine->SetNumberOfThreads(1);
+  singleThreadEngine->InitializeAccumulatedDose(plmRef);
+  if (!AddBeams(singleThreadEngine, beams, plmTgt) || !singleThreadEngine->CalculateDoseForAllBeams())
+  {
+    std::cerr << "Single thread dose calculation failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CompareDose(singleThreadEngine->GetAccumulatedDose(), expectedAccumulatedDose, "single thread vs. single beam calculation"))
+  {
+    return EXIT_FAILURE;
+  }
+  singleThreadEngine->FinalizeAccumulatedDose();
+
+  // Results of the beams are reused if nothing changed since the previous calculation
+  vtkSmartPointer<vtkSlicerDoseCalculationEngine> cachingEngine = vtkSmartPointer<vtkSlicerDoseCalculationEngine>::New();
+  if (!CalculateAllBeams(cachingEngine, beams, plmRef, plmTgt))
+  {
+    std::cerr << "Dose calculation failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<DoseImageType::Pointer> initialBeamDoses = GetBeamDoses(cachingEngine);
+  std::vector<DoseImageType::Pointer> previousBeamDoses = initialBeamDoses;
+  const bool allCached[NUMBER_OF_BEAMS] = {true, true, true};
+  const bool noneCached[NUMBER_OF_BEAMS] = {false, false, false};
+
+  cachingEngine->InitializeAccumulatedDose(plmRef);
+  if (!AddBeams(cachingEngine, beams, plmTgt) || !cachingEngine->StartDoseCalculationForAllBeams())
+  {
+    std::cerr << "Failed to start dose calculation of cached beams!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (cachingEngine->IsDoseCalculationRunning() || cachingEngine->GetDoseCalculationProgress() != 1.0)
+  {
+    std::cerr << "Dose calculation is started although all beams are cached!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !cachingEngine->FinishDoseCalculationForAllBeams()
+    || !CheckCachedBeams(cachingEngine, previousBeamDoses, allCached, "unchanged beams")
+    || !CompareDose(cachingEngine->GetAccumulatedDose(), expectedAccumulatedDose, "cached vs. single beam calculation") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Editing a beam invalidates its results only
+  const bool allCachedButSecond[NUMBER_OF_BEAMS] = {true, false, true};
+  double proximalMargin = beams[1]->GetProximalMargin();
+  beams[1]->SetProximalMargin(proximalMargin + 5.0);
+  if ( !CalculateAllBeams(cachingEngine, beams, plmRef, plmTgt)
+    || !CheckCachedBeams(cachingEngine, previousBeamDoses, allCachedButSecond, "edited beam") )
+  {
+    return EXIT_FAILURE;
+  }
+  previousBeamDoses = GetBeamDoses(cachingEngine);
+  beams[1]->SetProximalMargin(proximalMargin);
+  if ( !CalculateAllBeams(cachingEngine, beams, plmRef, plmTgt)
+    || !CheckCachedBeams(cachingEngine, previousBeamDoses, allCachedButSecond, "restored beam")
+    || !CompareDose(cachingEngine->GetComputedDose(1), initialBeamDoses[1], "restored beam vs. initial calculation") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Results are not reused for a beam edited while it is calculated, as the parameters copied
+  // at queueing are not the current parameters of the beam anymore
+  const bool allCachedButThird[NUMBER_OF_BEAMS] = {true, true, false};
+  previousBeamDoses = GetBeamDoses(cachingEngine);
+  proximalMargin = beams[2]->GetProximalMargin();
+  beams[2]->SetProximalMargin(proximalMargin + 5.0);
+  cachingEngine->InitializeAccumulatedDose(plmRef);
+  if (!AddBeams(cachingEngine, beams, plmTgt) || !cachingEngine->StartDoseCalculationForAllBeams())
+  {
+    std::cerr << "Failed to start dose calculation of the edited beam!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  beams[2]->SetProximalMargin(proximalMargin);
+  if ( !cachingEngine->FinishDoseCalculationForAllBeams()
+    || !CheckCachedBeams(cachingEngine, previousBeamDoses, allCachedButThird, "beam edited during calculation") )
+  {
+    return EXIT_FAILURE;
+  }
+  previousBeamDoses = GetBeamDoses(cachingEngine);
+  if ( !CalculateAllBeams(cachingEngine, beams, plmRef, plmTgt)
+    || !CheckCachedBeams(cachingEngine, previousBeamDoses, allCachedButThird, "beam edited after queueing")
+    || !CompareDose(cachingEngine->GetAccumulatedDose(), expectedAccumulatedDose, "recalculated vs. single beam calculation") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Changing the target or clearing the cache invalidates all results
+  previousBeamDoses = GetBeamDoses(cachingEngine);
+  Plm_image::Pointer otherPlmTgt = CreateTarget();
+  if ( !CalculateAllBeams(cachingEngine, beams, plmRef, otherPlmTgt)
+    || !CheckCachedBeams(cachingEngine, previousBeamDoses, noneCached, "changed target") )
+  {
+    return EXIT_FAILURE;
+  }
+  previousBeamDoses = GetBeamDoses(cachingEngine);
+  cachingEngine->ClearCache();
+  if ( !CalculateAllBeams(cachingEngine, beams, plmRef, otherPlmTgt)
+    || !CheckCachedBeams(cachingEngine, previousBeamDoses, noneCached, "cleared cache")
+    || !CompareDose(cachingEngine->GetAccumulatedDose(), expectedAccumulatedDose, "cleared cache vs. single beam calculation") )
+  {
+    return EXIT_FAILURE;
+  }
+  cachingEngine->FinalizeAccumulatedDose();
+
+  // Calculate in the background and poll the progress until finished
+  vtkSmartPointer<vtkSlicerDoseCalculationEngine> backgroundEngine = vtkSmartPointer<vtkSlicerDoseCalculationEngine>::New();
+  backgroundEngine->SetNumberOfThreads(1);
+  backgroundEngine->InitializeAccumulatedDose(plmRef);
+  if (!AddBeams(backgroundEngine, beams, plmTgt) || !backgroundEngine->StartDoseCalculationForAllBeams())
+  {
+    std::cerr << "Failed to start background dose calculation!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Inputs and results cannot be changed until the background calculation is finished
+  DoseImageType::Pointer backgroundAccumulatedDose = backgroundEngine->GetAccumulatedDose();
+  double isocenter[3] = {0.0, 0.0, 0.0};
+  double src[3] = {0.0, 0.0, 0.0};
+  GetSourcePosition(beams[0], src);
+  vtkObject::GlobalWarningDisplayOff();
+  bool calculateDoseAccepted = backgroundEngine->CalculateDose(beams[0], plmTgt, isocenter, src, RX_DOSE);
+  bool addBeamAccepted = backgroundEngine->AddBeamToDoseCalculation(beams[0], plmTgt, isocenter, src, RX_DOSE);
+  bool restartAccepted = backgroundEngine->StartDoseCalculationForAllBeams();
+  backgroundEngine->InitializeAccumulatedDose(plmRef);
+  vtkObject::GlobalWarningDisplayOn();
+  if ( calculateDoseAccepted || addBeamAccepted || restartAccepted
+    || backgroundEngine->GetNumberOfBeamsInDoseCalculation() != NUMBER_OF_BEAMS
+    || backgroundEngine->GetAccumulatedDose().GetPointer() != backgroundAccumulatedDose.GetPointer() )
+  {
+    std::cerr << "Dose calculation inputs are changed while the background calculation is in progress!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double lastProgress = 0.0;
+  while (backgroundEngine->IsDoseCalculationRunning())
+  {
+    double progress = backgroundEngine->GetDoseCalculationProgress();
+    if (progress < lastProgress || progress > 1.0)
+    {
+      std::cerr << "Invalid background dose calculation progress: " << progress << " after " << lastProgress << std::endl;
+      return EXIT_FAILURE;
+    }
+    lastProgress = progress;
+    vtksys::SystemTools::Delay(10);
+  }
+  if (backgroundEngine->GetDoseCalculationProgress() != 1.0)
+  {
+    std::cerr << "Background dose calculation finished with progress " << backgroundEngine->GetDoseCalculationProgress() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !backgroundEngine->FinishDoseCalculationForAllBeams()
+    || backgroundEngine->GetDoseCalculationCancelled()
+    || !CheckAccumulatedDose(backgroundEngine, "background calculation")
+    || !CompareDose(backgroundEngine->GetAccumulatedDose(), expectedAccumulatedDose, "background vs. single beam calculation") )
+  {
+    std::cerr << "Background dose calculation failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  backgroundEngine->FinalizeAccumulatedDose();
+
+  // Cancel right after starting. The beams completed until then are kept as partial result
+  vtkSmartPointer<vtkSlicerDoseCalculationEngine> cancelledEngine = vtkSmartPointer<vtkSlicerDoseCalculationEngine>::New();
+  cancelledEngine->SetNumberOfThreads(1);
+  cancelledEngine->InitializeAccumulatedDose(plmRef);
+  if (!AddBeams(cancelledEngine, beams, plmTgt) || !cancelledEngine->StartDoseCalculationForAllBeams())
+  {
+    std::cerr << "Failed to start dose calculation to cancel!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  cancelledEngine->CancelDoseCalculation();
+  if (!cancelledEngine->FinishDoseCalculationForAllBeams())
+  {
+    std::cerr << "Cancelled dose calculation reported failure!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<DoseImageType::Pointer> partialBeamDoses = GetBeamDoses(cancelledEngine);
+  if ( !cancelledEngine->GetDoseCalculationCancelled() || cancelledEngine->IsDoseCalculationRunning()
+    || std::find(partialBeamDoses.begin(), partialBeamDoses.end(), DoseImageType::Pointer()) == partialBeamDoses.end() )
+  {
+    std::cerr << "Dose calculation is not cancelled!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CheckAccumulatedDose(cancelledEngine, "cancelled calculation"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Next calculation reuses the completed beams and calculates the cancelled ones
+  bool completedBeams[NUMBER_OF_BEAMS] = {false, false, false};
+  for (int beamIndex=0; beamIndex<NUMBER_OF_BEAMS; ++beamIndex)
+  {
+    completedBeams[beamIndex] = partialBeamDoses[beamIndex].IsNotNull();
+  }
+  if ( !CalculateAllBeams(cancelledEngine, beams, plmRef, plmTgt)
+    || cancelledEngine->GetDoseCalculationCancelled()
+    || !CheckCachedBeams(cancelledEngine, partialBeamDoses, completedBeams, "calculation after cancel")
+    || !CompareDose(cancelledEngine->GetAccumulatedDose(), expectedAccumulatedDose, "calculation after cancel vs. single beam calculation") )
+  {
+    return EXIT_FAILURE;
+  }
+  cancelledEngine->FinalizeAccumulatedDose();
+
+  // Engine can be deleted while the background calculation is running
+  vtkSmartPointer<vtkSlicerDoseCalculationEngine> deletedEngine = vtkSmartPointer<vtkSlicerDoseCalculationEngine>::New();
+  deletedEngine->InitializeAccumulatedDose(plmRef);
+  otherPlmTgt = CreateTarget();
+  if (!AddBeams(deletedEngine, beams, otherPlmTgt) || !deletedEngine->StartDoseCalculationForAllBeams())
+  {
+    std::cerr << "Failed to start dose calculation to delete!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  deletedEngine = NULL;
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
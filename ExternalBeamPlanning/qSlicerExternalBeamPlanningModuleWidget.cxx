@@ -56,6 +56,7 @@
 
 // Qt includes
 #include <QDebug>
+#include <QTimer>
 
 //-----------------------------------------------------------------------------
 /// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
@@ -75,6 +76,11 @@ public:
 
   int currentBeamRow;
   int totalBeamRows;
+
+  /// Timer for polling the dose calculation running in the background
+  QTimer DoseCalculationTimer;
+  /// Flag indicating that the user requested to cancel the dose calculation
+  bool DoseCalculationCancelRequested;
 };
 
 //-----------------------------------------------------------------------------
@@ -87,6 +93,7 @@ qSlicerExternalBeamPlanningModuleWidgetPrivate::qSlicerExternalBeamPlanningModul
 {
   currentBeamRow = -1;
   totalBeamRows = 0;
+  DoseCalculationCancelRequested = false;
 }
 
 //-----------------------------------------------------------------------------
@@ -658,6 +665,7 @@ void qSlicerExternalBeamPlanningModuleWidget::setup()
   this->connect( d->pushButton_CalculateDose, SIGNAL(clicked()), this, SLOT(calculateDoseClicked()) );
   this->connect( d->pushButton_CalculateWED, SIGNAL(clicked()), this, SLOT(calculateWEDClicked()) );
   this->connect( d->pushButton_ClearDose, SIGNAL(clicked()), this, SLOT(clearDoseClicked()) );
+  this->connect( &d->DoseCalculationTimer, SIGNAL(timeout()), this, SLOT(updateDoseCalculation()) );
 
   /* Disable unused buttons in prescription task */
   //this->radiationTypeChanged(0);
@@ -1638,6 +1646,12 @@ void qSlicerExternalBeamPlanningModuleWidget::gantryAngleChanged(double value)
 
   // Update beam visualization
   this->UpdateBeamGeometryModel();
+
+  // Keep the DRR of the beam up to date while the gantry is rotated
+  if (beamNode->GetDRRVolumeNode())
+  {
+    d->logic()->UpdateDRR(beamNode->GetName());
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -2098,6 +2112,15 @@ void qSlicerExternalBeamPlanningModuleWidget::calculateDoseClicked()
 {
   Q_D(qSlicerExternalBeamPlanningModuleWidget);
 
+  // Button cancels the calculation while it is running
+  if (d->logic()->IsDoseCalculationInProgress())
+  {
+    d->logic()->CancelDoseCalculation();
+    d->DoseCalculationCancelRequested = true;
+    d->label_CalculateDoseStatus->setText("Cancelling dose calculation...");
+    return;
+  }
+
   d->label_CalculateDoseStatus->setText("Starting dose calculation...");
 
   if (!this->mrmlScene())
@@ -2167,9 +2190,6 @@ void qSlicerExternalBeamPlanningModuleWidget::calculateDoseClicked()
   }
   vtkMRMLRTProtonBeamNode* beamNode = NULL;
 
-  d->logic()->InitializeAccumulatedDose();
-  d->label_CalculateDoseStatus->setText("Dose calculation in progress"); //+ beamNode->GetBeamName();
-
   for (int i=0; i<beams->GetNumberOfItems(); ++i)
   {
     beamNode = vtkMRMLRTProtonBeamNode::SafeDownCast(beams->GetItemAsObject(i));
@@ -2179,18 +2199,46 @@ void qSlicerExternalBeamPlanningModuleWidget::calculateDoseClicked()
           d->label_CalculateDoseStatus->setText("Dose calculation is not available for this particle");
           return;
       }
-      d->logic()->ComputeDose(beamNode);
-      // sum in the final dose matrix with weights externalbeam for RxDose, and beamNode for beam wieght
     }
     else
     {
       d->label_CalculateDoseStatus->setText("beam not found"); // + beamNode->GetBeamName();
     }
   }
-  
-  d->logic()->RegisterAccumulatedDose();
-  d->label_CalculateDoseStatus->setText("Dose calculation done.");
-  return;
+
+  // Calculate the dose of all beams (in parallel) in the background and sum in the final dose matrix
+  if (!d->logic()->StartDoseCalculation())
+  {
+    d->label_CalculateDoseStatus->setText("Failed to start dose calculation");
+    return;
+  }
+
+  d->DoseCalculationCancelRequested = false;
+  d->label_CalculateDoseStatus->setText("Dose calculation in progress");
+  d->pushButton_CalculateDose->setText("Cancel Dose Calculation");
+  d->DoseCalculationTimer.start(200);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerExternalBeamPlanningModuleWidget::updateDoseCalculation()
+{
+  Q_D(qSlicerExternalBeamPlanningModuleWidget);
+
+  if (d->logic()->UpdateDoseCalculation())
+  {
+    if (!d->DoseCalculationCancelRequested)
+    {
+      d->label_CalculateDoseStatus->setText( QString("Dose calculation in progress (%1%)").arg(
+        (int)(d->logic()->GetDoseCalculationProgress() * 100.0) ) );
+    }
+    return;
+  }
+
+  // Results are added to the scene by the logic
+  d->DoseCalculationTimer.stop();
+  d->pushButton_CalculateDose->setText("Calculate Dose");
+  d->label_CalculateDoseStatus->setText(d->DoseCalculationCancelRequested ? "Dose calculation cancelled." : "Dose calculation done.");
+  d->DoseCalculationCancelRequested = false;
 }
 
 //-----------------------------------------------------------------------------
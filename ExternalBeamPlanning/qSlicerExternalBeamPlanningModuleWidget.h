@@ -138,6 +138,9 @@ protected slots:
   void calculateWEDClicked();
   void clearDoseClicked();
 
+  /// Update status of the dose calculation running in the background
+  void updateDoseCalculation();
+
   void collimatorTypeChanged(const QString &);
 
 protected:
@@ -30,6 +30,7 @@
 
 // SlicerRT includes
 #include "SlicerRtCommon.h"
+#include "vtkImageBlockMinMax.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
@@ -52,6 +53,7 @@
 #include <vtkImageMarchingCubes.h>
 #include <vtkImageChangeInformation.h>
 #include <vtkImageReslice.h>
+#include <vtkExtractVOI.h>
 #include <vtkSmartPointer.h>
 #include <vtkLookupTable.h>
 #include <vtkTriangleFilter.h>
@@ -461,16 +463,29 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces()
   outputIJK2IJKResliceTransform->Concatenate(inputRAS2IJKMatrix);
   outputIJK2IJKResliceTransform->Inverse();
 
-  int dimensions[3] = {0, 0, 0};
-  doseVolumeNode->GetImageData()->GetDimensions(dimensions);
-  vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
-  reslice->SetInputData(doseVolumeNode->GetImageData());
-  reslice->SetOutputOrigin(0, 0, 0);
-  reslice->SetOutputSpacing(1, 1, 1);
-  reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
-  reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
-  reslice->Update();
-  vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage = reslice->GetOutput(); 
+  // Reslicing is only needed if there is a parent transform, otherwise the reslice transform is identity
+  vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage;
+  if (inputVolumeNodeTransformNode != NULL)
+  {
+    int dimensions[3] = {0, 0, 0};
+    doseVolumeNode->GetImageData()->GetDimensions(dimensions);
+    vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
+    reslice->SetInputData(doseVolumeNode->GetImageData());
+    reslice->SetOutputOrigin(0, 0, 0);
+    reslice->SetOutputSpacing(1, 1, 1);
+    reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
+    reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
+    reslice->Update();
+    reslicedDoseVolumeImage = reslice->GetOutput();
+  }
+  else
+  {
+    reslicedDoseVolumeImage = doseVolumeNode->GetImageData();
+  }
+
+  // Get block min/max index of the dose so that the regions not containing an isodose level are skipped.
+  // The index of the dose volume itself is built on load and kept until the dose is modified.
+  vtkImageBlockMinMax* doseBlockMinMax = vtkImageBlockMinMax::GetBlockMinMaxForImage(reslicedDoseVolumeImage);
 
   // Report progress
   ++currentStep;
@@ -490,8 +505,34 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces()
     double isoLevel = doubleValue;
     colorTableNode->GetColor(i, val);
 
+    // Only contour the region that may contain the isodose level
+    vtkSmartPointer<vtkImageData> isodoseRegionImage = reslicedDoseVolumeImage;
+    if (doseBlockMinMax)
+    {
+      int isodoseRegionExtent[6] = {0,-1,0,-1,0,-1};
+      if (!doseBlockMinMax->GetExtentContainingRange(isoLevel, isoLevel, isodoseRegionExtent))
+      {
+        // Isodose level is not present in the dose volume
+        ++currentStep;
+        progress = (double)(currentStep) / (double)stepCount;
+        this->InvokeEvent(SlicerRtCommon::ProgressUpdated, (void*)&progress);
+        continue;
+      }
+
+      int doseExtent[6] = {0,-1,0,-1,0,-1};
+      reslicedDoseVolumeImage->GetExtent(doseExtent);
+      if (!SlicerRtCommon::AreExtentsEqual(doseExtent, isodoseRegionExtent))
+      {
+        vtkSmartPointer<vtkExtractVOI> extractRegion = vtkSmartPointer<vtkExtractVOI>::New();
+        extractRegion->SetInputData(reslicedDoseVolumeImage);
+        extractRegion->SetVOI(isodoseRegionExtent);
+        extractRegion->Update();
+        isodoseRegionImage = extractRegion->GetOutput();
+      }
+    }
+
     vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
-    marchingCubes->SetInputData(reslicedDoseVolumeImage);
+    marchingCubes->SetInputData(isodoseRegionImage);
     marchingCubes->SetNumberOfContours(1); 
     marchingCubes->SetValue(0, isoLevel);
     marchingCubes->ComputeScalarsOff();
@@ -540,7 +581,8 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces()
   
       vtkSmartPointer<vtkMRMLModelDisplayNode> displayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
       displayNode = vtkMRMLModelDisplayNode::SafeDownCast(this->GetMRMLScene()->AddNode(displayNode));
-      displayNode->SliceIntersectionVisibilityOn();  
+      // Isodose lines are contoured directly in the slice views by the isodose displayable manager
+      displayNode->SliceIntersectionVisibilityOff();
       displayNode->VisibilityOn(); 
       displayNode->SetColor(val[0], val[1], val[2]);
       displayNode->SetOpacity(val[3]);
@@ -0,0 +1,984 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// MRMLDisplayableManager includes
+#include "vtkMRMLIsodoseDisplayableManager2D.h"
+
+// Isodose includes
+#include "vtkMRMLIsodoseNode.h"
+
+// SlicerRtCommon includes
+#include "vtkImageBlockMinMax.h"
+
+// MRML includes
+#include <vtkMRMLColorTableNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLSliceNode.h>
+#include <vtkMRMLTransformNode.h>
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+#include <vtkCallbackCommand.h>
+#include <vtkEventBroker.h>
+#include <vtkActor2D.h>
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkGeneralTransform.h>
+#include <vtkImageData.h>
+#include <vtkImageReslice.h>
+#include <vtkIntArray.h>
+#include <vtkMarchingSquares.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper2D.h>
+#include <vtkRenderer.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+#include <vtkUnsignedCharArray.h>
+
+// STD includes
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <vector>
+
+//---------------------------------------------------------------------------
+vtkStandardNewMacro(vtkMRMLIsodoseDisplayableManager2D);
+
+// Maximum number of slice positions for which the isodose lines are kept in the cache of a view
+static const unsigned int MAXIMUM_NUMBER_OF_CACHED_SLICE_POSITIONS = 64;
+// Maximum number of samples along each axis of the dose resampled on the slice plane
+static const double MAXIMUM_NUMBER_OF_PLANE_SAMPLES = 2048.0;
+// Tolerance (in mm) used when comparing slice positions and when checking plane intersection
+static const double SLICE_POSITION_TOLERANCE = 1e-4;
+
+//---------------------------------------------------------------------------
+// Convert a linear transform that is almost exactly a permute transform
+// to an exact permute transform, as vtkImageReslice works faster if it
+// reslices along an axis (see vtkMRMLSegmentationsDisplayableManager2D).
+//----------------------------------------------------------------------------
+static void SnapToPermuteMatrix(vtkTransform* transform)
+{
+  const double SUPPRESSION_FACTOR = 1e-3;
+  vtkHomogeneousTransform* linearTransform = vtkHomogeneousTransform::SafeDownCast(transform);
+  if (!linearTransform)
+    {
+    return;
+    }
+  bool modified = false;
+  vtkNew<vtkMatrix4x4> transformMatrix;
+  linearTransform->GetMatrix(transformMatrix.GetPointer());
+  for (int c=0; c<3; c++)
+    {
+    double absValues[3] = {fabs(transformMatrix->Element[0][c]), fabs(transformMatrix->Element[1][c]), fabs(transformMatrix->Element[2][c])};
+    double maxValue = std::max(absValues[0], std::max(absValues[1], absValues[2]));
+    double zeroThreshold = SUPPRESSION_FACTOR * maxValue;
+    for (int r=0; r<3; r++)
+      {
+      if (absValues[r]!=0 && absValues[r]<zeroThreshold)
+        {
+        transformMatrix->Element[r][c]=0;
+        modified = true;
+        }
+      }
+    }
+  if (modified)
+    {
+    transform->SetMatrix(transformMatrix.GetPointer());
+    }
+}
+
+//---------------------------------------------------------------------------
+class vtkMRMLIsodoseDisplayableManager2D::vtkInternal
+{
+public:
+
+  vtkInternal( vtkMRMLIsodoseDisplayableManager2D* external );
+  ~vtkInternal();
+
+  /// Isodose level parsed from the isodose color table
+  struct IsodoseLevel
+    {
+    double Value;
+    double Color[4];
+    };
+
+  /// Isodose lines of a slice position, in slice plane coordinates
+  struct CachedContours
+    {
+    double SliceToRAS[16];
+    vtkSmartPointer<vtkPolyData> Contours;
+    };
+
+  struct Pipeline
+    {
+    vtkWeakPointer<vtkMRMLScalarVolumeNode> DoseVolumeNode;
+    vtkWeakPointer<vtkMRMLColorTableNode> ColorTableNode;
+    std::vector<IsodoseLevel> IsodoseLevels;
+
+    vtkSmartPointer<vtkGeneralTransform> NodeToWorldTransform;
+    vtkSmartPointer<vtkGeneralTransform> WorldToNodeTransform;
+
+    /// Contours of the most recently visited slice positions (most recent is the last)
+    std::deque<CachedContours> ContourCache;
+
+    /// Transform from slice plane coordinates to slice XY
+    vtkSmartPointer<vtkTransform> PlaneToSliceTransform;
+    vtkSmartPointer<vtkTransformPolyDataFilter> ContourTransformer;
+    vtkSmartPointer<vtkActor2D> ContourActor;
+    };
+
+  typedef std::map<vtkMRMLIsodoseNode*, Pipeline*> PipelinesCacheType;
+  PipelinesCacheType IsodosePipelines;
+
+  // Isodose nodes
+  void AddIsodoseNode(vtkMRMLIsodoseNode* isodoseNode);
+  void RemoveIsodoseNode(vtkMRMLIsodoseNode* isodoseNode);
+  void UpdateIsodoseNode(vtkMRMLIsodoseNode* isodoseNode);
+
+  // Dose volume and color table nodes
+  bool IsNodeReferenced(vtkMRMLNode* node, Pipeline* excludedPipeline=NULL);
+  void OnReferencedNodeModified(vtkMRMLNode* node, unsigned long event);
+  void OnReferencedNodeRemoved(vtkMRMLNode* node);
+
+  // Slice Node
+  void SetSliceNode(vtkMRMLSliceNode* sliceNode);
+  void UpdateSliceNode();
+
+  // Pipelines
+  Pipeline* CreatePipeline();
+  void DeletePipeline(Pipeline* pipeline);
+  void UpdatePipelineReferences(vtkMRMLIsodoseNode* isodoseNode, Pipeline* pipeline);
+  void UpdatePipeline(vtkMRMLIsodoseNode* isodoseNode, Pipeline* pipeline);
+  void UpdateDoseTransforms(Pipeline* pipeline);
+  void UpdateIsodoseLevels(Pipeline* pipeline);
+
+  // Contouring
+  vtkPolyData* GetIsodoseContours(Pipeline* pipeline);
+  vtkSmartPointer<vtkPolyData> ComputeIsodoseContours(Pipeline* pipeline);
+
+  // Observations
+  void AddObservation(vtkObject* node, unsigned long event);
+  void RemoveObservation(vtkObject* node, unsigned long event);
+  void AddReferencedNodeObservations(Pipeline* pipeline);
+  void RemoveReferencedNodeObservations(vtkMRMLNode* node);
+
+  // Helper functions
+  void ClearDisplayableNodes();
+
+private:
+  vtkSmartPointer<vtkMatrix4x4> SliceXYToRAS;
+  vtkSmartPointer<vtkMatrix4x4> SliceToRAS;
+  vtkMRMLIsodoseDisplayableManager2D* External;
+  vtkSmartPointer<vtkMRMLSliceNode> SliceNode;
+};
+
+//---------------------------------------------------------------------------
+// vtkInternal methods
+
+//---------------------------------------------------------------------------
+vtkMRMLIsodoseDisplayableManager2D::vtkInternal::vtkInternal(vtkMRMLIsodoseDisplayableManager2D* external)
+: External(external)
+{
+  this->SliceXYToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->SliceXYToRAS->Identity();
+  this->SliceToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->SliceToRAS->Identity();
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLIsodoseDisplayableManager2D::vtkInternal::~vtkInternal()
+{
+  this->ClearDisplayableNodes();
+  this->SliceNode = NULL;
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::SetSliceNode(vtkMRMLSliceNode* sliceNode)
+{
+  if (!sliceNode || this->SliceNode == sliceNode)
+    {
+    return;
+    }
+  this->SliceNode=sliceNode;
+  this->UpdateSliceNode();
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::UpdateSliceNode()
+{
+  // Update the slice transforms then update the pipelines to account for plane location.
+  // Contours are only computed if the slice plane itself has changed and it is not in the cache.
+  this->SliceXYToRAS->DeepCopy( this->SliceNode->GetXYToRAS() );
+  this->SliceToRAS->DeepCopy( this->SliceNode->GetSliceToRAS() );
+  for (PipelinesCacheType::iterator pipelineIt = this->IsodosePipelines.begin(); pipelineIt != this->IsodosePipelines.end(); ++pipelineIt)
+    {
+    this->UpdatePipeline(pipelineIt->first, pipelineIt->second);
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::AddIsodoseNode(vtkMRMLIsodoseNode* isodoseNode)
+{
+  if (!isodoseNode || this->IsodosePipelines.find(isodoseNode) != this->IsodosePipelines.end())
+    {
+    return;
+    }
+
+  this->AddObservation(isodoseNode, vtkCommand::ModifiedEvent);
+  this->AddObservation(isodoseNode, vtkMRMLNode::ReferenceAddedEvent);
+  this->AddObservation(isodoseNode, vtkMRMLNode::ReferenceModifiedEvent);
+  this->AddObservation(isodoseNode, vtkMRMLNode::ReferenceRemovedEvent);
+
+  Pipeline* pipeline = this->CreatePipeline();
+  this->IsodosePipelines[isodoseNode] = pipeline;
+
+  this->UpdatePipeline(isodoseNode, pipeline);
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::RemoveIsodoseNode(vtkMRMLIsodoseNode* isodoseNode)
+{
+  PipelinesCacheType::iterator pipelineIt = this->IsodosePipelines.find(isodoseNode);
+  if (pipelineIt == this->IsodosePipelines.end())
+    {
+    return;
+    }
+
+  this->RemoveObservation(isodoseNode, vtkCommand::ModifiedEvent);
+  this->RemoveObservation(isodoseNode, vtkMRMLNode::ReferenceAddedEvent);
+  this->RemoveObservation(isodoseNode, vtkMRMLNode::ReferenceModifiedEvent);
+  this->RemoveObservation(isodoseNode, vtkMRMLNode::ReferenceRemovedEvent);
+
+  Pipeline* pipeline = pipelineIt->second;
+  this->IsodosePipelines.erase(pipelineIt);
+  this->DeletePipeline(pipeline);
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::UpdateIsodoseNode(vtkMRMLIsodoseNode* isodoseNode)
+{
+  PipelinesCacheType::iterator pipelineIt = this->IsodosePipelines.find(isodoseNode);
+  if (pipelineIt == this->IsodosePipelines.end())
+    {
+    this->AddIsodoseNode(isodoseNode);
+    return;
+    }
+  this->UpdatePipeline(isodoseNode, pipelineIt->second);
+}
+
+//---------------------------------------------------------------------------
+bool vtkMRMLIsodoseDisplayableManager2D::vtkInternal::IsNodeReferenced(vtkMRMLNode* node, Pipeline* excludedPipeline/*=NULL*/)
+{
+  if (!node)
+    {
+    return false;
+    }
+  for (PipelinesCacheType::iterator pipelineIt = this->IsodosePipelines.begin(); pipelineIt != this->IsodosePipelines.end(); ++pipelineIt)
+    {
+    Pipeline* pipeline = pipelineIt->second;
+    if (pipeline == excludedPipeline)
+      {
+      continue;
+      }
+    if (pipeline->DoseVolumeNode.GetPointer() == node || pipeline->ColorTableNode.GetPointer() == node)
+      {
+      return true;
+      }
+    }
+  return false;
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::OnReferencedNodeModified(vtkMRMLNode* node, unsigned long event)
+{
+  for (PipelinesCacheType::iterator pipelineIt = this->IsodosePipelines.begin(); pipelineIt != this->IsodosePipelines.end(); ++pipelineIt)
+    {
+    Pipeline* pipeline = pipelineIt->second;
+    bool contoursInvalid = false;
+    if (pipeline->DoseVolumeNode.GetPointer() == node)
+      {
+      if (event == vtkMRMLTransformableNode::TransformModifiedEvent)
+        {
+        this->UpdateDoseTransforms(pipeline);
+        }
+      contoursInvalid = true;
+      }
+    if (pipeline->ColorTableNode.GetPointer() == node)
+      {
+      this->UpdateIsodoseLevels(pipeline);
+      contoursInvalid = true;
+      }
+    if (contoursInvalid)
+      {
+      pipeline->ContourCache.clear();
+      this->UpdatePipeline(pipelineIt->first, pipeline);
+      }
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::OnReferencedNodeRemoved(vtkMRMLNode* node)
+{
+  if (!this->IsNodeReferenced(node))
+    {
+    return;
+    }
+  // References of the isodose nodes are updated when the referenced node is removed from the scene
+  for (PipelinesCacheType::iterator pipelineIt = this->IsodosePipelines.begin(); pipelineIt != this->IsodosePipelines.end(); ++pipelineIt)
+    {
+    this->UpdatePipeline(pipelineIt->first, pipelineIt->second);
+    }
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLIsodoseDisplayableManager2D::vtkInternal::Pipeline*
+vtkMRMLIsodoseDisplayableManager2D::vtkInternal::CreatePipeline()
+{
+  Pipeline* pipeline = new Pipeline();
+  pipeline->NodeToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  pipeline->WorldToNodeTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  pipeline->PlaneToSliceTransform = vtkSmartPointer<vtkTransform>::New();
+  pipeline->ContourTransformer = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+  pipeline->ContourActor = vtkSmartPointer<vtkActor2D>::New();
+
+  // Contours are stored in slice plane coordinates, so that the cache is not invalidated by panning and zooming
+  pipeline->ContourTransformer->SetTransform(pipeline->PlaneToSliceTransform);
+
+  // Each isodose line has its own color stored in the cell scalars
+  vtkSmartPointer<vtkPolyDataMapper2D> contourMapper = vtkSmartPointer<vtkPolyDataMapper2D>::New();
+  contourMapper->SetInputConnection(pipeline->ContourTransformer->GetOutputPort());
+  contourMapper->ScalarVisibilityOn();
+  contourMapper->SetScalarModeToUseCellData();
+  contourMapper->SetColorModeToDefault();
+  pipeline->ContourActor->SetMapper(contourMapper);
+  pipeline->ContourActor->SetVisibility(0);
+
+  this->External->GetRenderer()->AddActor( pipeline->ContourActor );
+
+  return pipeline;
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::DeletePipeline(Pipeline* pipeline)
+{
+  if (!pipeline)
+    {
+    return;
+    }
+  // Pipeline needs to be removed from the pipelines map before calling this function,
+  // so that observations of nodes only referenced by this pipeline are removed
+  if (!this->IsNodeReferenced(pipeline->DoseVolumeNode))
+    {
+    this->RemoveReferencedNodeObservations(pipeline->DoseVolumeNode);
+    }
+  if (!this->IsNodeReferenced(pipeline->ColorTableNode))
+    {
+    this->RemoveReferencedNodeObservations(pipeline->ColorTableNode);
+    }
+  this->External->GetRenderer()->RemoveActor(pipeline->ContourActor);
+  delete pipeline;
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::UpdatePipelineReferences(vtkMRMLIsodoseNode* isodoseNode, Pipeline* pipeline)
+{
+  vtkMRMLScalarVolumeNode* doseVolumeNode = isodoseNode->GetDoseVolumeNode();
+  vtkMRMLColorTableNode* colorTableNode = isodoseNode->GetColorTableNode();
+  if (pipeline->DoseVolumeNode.GetPointer() == doseVolumeNode && pipeline->ColorTableNode.GetPointer() == colorTableNode)
+    {
+    return;
+    }
+
+  vtkMRMLScalarVolumeNode* previousDoseVolumeNode = pipeline->DoseVolumeNode;
+  vtkMRMLColorTableNode* previousColorTableNode = pipeline->ColorTableNode;
+  pipeline->DoseVolumeNode = doseVolumeNode;
+  pipeline->ColorTableNode = colorTableNode;
+
+  // Stop observing the previously referenced nodes if not used by other pipelines
+  if (previousDoseVolumeNode != doseVolumeNode && !this->IsNodeReferenced(previousDoseVolumeNode))
+    {
+    this->RemoveReferencedNodeObservations(previousDoseVolumeNode);
+    }
+  if (previousColorTableNode != colorTableNode && !this->IsNodeReferenced(previousColorTableNode))
+    {
+    this->RemoveReferencedNodeObservations(previousColorTableNode);
+    }
+  this->AddReferencedNodeObservations(pipeline);
+
+  this->UpdateDoseTransforms(pipeline);
+  this->UpdateIsodoseLevels(pipeline);
+  pipeline->ContourCache.clear();
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::UpdatePipeline(vtkMRMLIsodoseNode* isodoseNode, Pipeline* pipeline)
+{
+  if (!isodoseNode || !pipeline)
+    {
+    return;
+    }
+  this->UpdatePipelineReferences(isodoseNode, pipeline);
+
+  vtkMRMLScalarVolumeNode* doseVolumeNode = pipeline->DoseVolumeNode;
+  if ( !this->SliceNode || !isodoseNode->GetShowIsodoseLines()
+    || !doseVolumeNode || !doseVolumeNode->GetImageData() || pipeline->IsodoseLevels.empty() )
+    {
+    pipeline->ContourActor->SetVisibility(0);
+    return;
+    }
+
+  // Get contours of the current slice position (computed only if not in the cache)
+  vtkPolyData* contours = this->GetIsodoseContours(pipeline);
+  if (!contours || contours->GetNumberOfCells() == 0)
+    {
+    pipeline->ContourActor->SetVisibility(0);
+    return;
+    }
+  pipeline->ContourTransformer->SetInputData(contours);
+
+  // Set slice plane to slice XY transform
+  vtkNew<vtkMatrix4x4> rasToSliceXY;
+  vtkMatrix4x4::Invert(this->SliceXYToRAS, rasToSliceXY.GetPointer());
+  vtkNew<vtkMatrix4x4> planeToSliceXY;
+  vtkMatrix4x4::Multiply4x4(rasToSliceXY.GetPointer(), this->SliceToRAS, planeToSliceXY.GetPointer());
+  pipeline->PlaneToSliceTransform->SetMatrix(planeToSliceXY.GetPointer());
+
+  pipeline->ContourActor->SetVisibility(1);
+  pipeline->ContourActor->SetPosition(0,0);
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::UpdateDoseTransforms(Pipeline* pipeline)
+{
+  pipeline->NodeToWorldTransform->Identity();
+  pipeline->WorldToNodeTransform->Identity();
+  vtkMRMLTransformNode* transformNode = (pipeline->DoseVolumeNode ? pipeline->DoseVolumeNode->GetParentTransformNode() : NULL);
+  if (transformNode)
+    {
+    transformNode->GetTransformToWorld(pipeline->NodeToWorldTransform);
+    // Need inverse of the transform for image resampling
+    transformNode->GetTransformFromWorld(pipeline->WorldToNodeTransform);
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::UpdateIsodoseLevels(Pipeline* pipeline)
+{
+  pipeline->IsodoseLevels.clear();
+  vtkMRMLColorTableNode* colorTableNode = pipeline->ColorTableNode;
+  if (!colorTableNode)
+    {
+    return;
+    }
+
+  // Isodose levels are stored as the color names in the isodose color table (same as in the isodose logic)
+  for (int colorIndex=0; colorIndex<colorTableNode->GetNumberOfColors(); ++colorIndex)
+    {
+    const char* strIsoLevel = colorTableNode->GetColorName(colorIndex);
+    if (!strIsoLevel)
+      {
+      continue;
+      }
+    std::stringstream ss;
+    ss << strIsoLevel;
+    IsodoseLevel level;
+    if (!(ss >> level.Value))
+      {
+      continue;
+      }
+    colorTableNode->GetColor(colorIndex, level.Color);
+    pipeline->IsodoseLevels.push_back(level);
+    }
+}
+
+//---------------------------------------------------------------------------
+vtkPolyData* vtkMRMLIsodoseDisplayableManager2D::vtkInternal::GetIsodoseContours(Pipeline* pipeline)
+{
+  // Look up current slice position in the cache
+  const double* sliceToRAS = &(this->SliceToRAS->Element[0][0]);
+  for (std::deque<CachedContours>::iterator cacheIt = pipeline->ContourCache.begin(); cacheIt != pipeline->ContourCache.end(); ++cacheIt)
+    {
+    bool matching = true;
+    for (int i=0; i<16 && matching; ++i)
+      {
+      matching = (fabs(cacheIt->SliceToRAS[i] - sliceToRAS[i]) < SLICE_POSITION_TOLERANCE);
+      }
+    if (matching)
+      {
+      return cacheIt->Contours;
+      }
+    }
+
+  // Not found in the cache, compute contours and store them
+  CachedContours cachedContours;
+  std::copy(sliceToRAS, sliceToRAS+16, cachedContours.SliceToRAS);
+  cachedContours.Contours = this->ComputeIsodoseContours(pipeline);
+  pipeline->ContourCache.push_back(cachedContours);
+  if (pipeline->ContourCache.size() > MAXIMUM_NUMBER_OF_CACHED_SLICE_POSITIONS)
+    {
+    pipeline->ContourCache.pop_front();
+    }
+  return cachedContours.Contours;
+}
+
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> vtkMRMLIsodoseDisplayableManager2D::vtkInternal::ComputeIsodoseContours(Pipeline* pipeline)
+{
+  vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+  vtkMRMLScalarVolumeNode* doseVolumeNode = pipeline->DoseVolumeNode;
+
+  // Dose IJK to world transform and its inverse, including the parent transform of the dose volume
+  vtkNew<vtkMatrix4x4> ijkToRASMatrix;
+  doseVolumeNode->GetIJKToRASMatrix(ijkToRASMatrix.GetPointer());
+  vtkNew<vtkGeneralTransform> ijkToWorldTransform;
+  ijkToWorldTransform->PostMultiply();
+  ijkToWorldTransform->Concatenate(ijkToRASMatrix.GetPointer());
+  ijkToWorldTransform->Concatenate(pipeline->NodeToWorldTransform);
+  vtkNew<vtkMatrix4x4> rasToIJKMatrix;
+  doseVolumeNode->GetRASToIJKMatrix(rasToIJKMatrix.GetPointer());
+  vtkNew<vtkGeneralTransform> worldToIJKTransform;
+  worldToIJKTransform->PostMultiply();
+  worldToIJKTransform->Concatenate(pipeline->WorldToNodeTransform);
+  worldToIJKTransform->Concatenate(rasToIJKMatrix.GetPointer());
+
+  std::vector<double> levelValues;
+  for (std::vector<IsodoseLevel>::iterator levelIt = pipeline->IsodoseLevels.begin(); levelIt != pipeline->IsodoseLevels.end(); ++levelIt)
+    {
+    levelValues.push_back(levelIt->Value);
+    }
+  vtkMRMLIsodoseDisplayableManager2D::ContourDoseOnSlicePlane(doseVolumeNode->GetImageData(),
+    ijkToWorldTransform.GetPointer(), worldToIJKTransform.GetPointer(), this->SliceToRAS, levelValues, contours);
+
+  // Color each line by its isodose level
+  vtkDataArray* levelIndices = contours->GetCellData()->GetArray("IsodoseLevelIndex");
+  if (!levelIndices)
+    {
+    return contours;
+    }
+  vtkSmartPointer<vtkUnsignedCharArray> contourColors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+  contourColors->SetName("IsodoseColors");
+  contourColors->SetNumberOfComponents(4);
+  contourColors->SetNumberOfTuples(contours->GetNumberOfCells());
+  for (vtkIdType cellId=0; cellId<contours->GetNumberOfCells(); ++cellId)
+    {
+    const IsodoseLevel& cellLevel = pipeline->IsodoseLevels[(int)levelIndices->GetComponent(cellId, 0)];
+    unsigned char color[4] = {
+      (unsigned char)(cellLevel.Color[0] * 255.0), (unsigned char)(cellLevel.Color[1] * 255.0),
+      (unsigned char)(cellLevel.Color[2] * 255.0), (unsigned char)(cellLevel.Color[3] * 255.0) };
+    contourColors->SetTupleValue(cellId, color);
+    }
+  contours->GetCellData()->SetScalars(contourColors);
+
+  return contours;
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::AddObservation(vtkObject* node, unsigned long event)
+{
+  if (!node)
+    {
+    return;
+    }
+  vtkEventBroker* broker = vtkEventBroker::GetInstance();
+  if (!broker->GetObservationExist(node, event, this->External, this->External->GetMRMLNodesCallbackCommand() ))
+    {
+    broker->AddObservation(node, event, this->External, this->External->GetMRMLNodesCallbackCommand() );
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::RemoveObservation(vtkObject* node, unsigned long event)
+{
+  if (!node)
+    {
+    return;
+    }
+  vtkEventBroker* broker = vtkEventBroker::GetInstance();
+  vtkEventBroker::ObservationVector observations;
+  observations = broker->GetObservations(node, event, this->External, this->External->GetMRMLNodesCallbackCommand() );
+  broker->RemoveObservations(observations);
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::AddReferencedNodeObservations(Pipeline* pipeline)
+{
+  this->AddObservation(pipeline->DoseVolumeNode, vtkMRMLVolumeNode::ImageDataModifiedEvent);
+  this->AddObservation(pipeline->DoseVolumeNode, vtkMRMLTransformableNode::TransformModifiedEvent);
+  this->AddObservation(pipeline->ColorTableNode, vtkCommand::ModifiedEvent);
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::RemoveReferencedNodeObservations(vtkMRMLNode* node)
+{
+  if (vtkMRMLScalarVolumeNode::SafeDownCast(node))
+    {
+    this->RemoveObservation(node, vtkMRMLVolumeNode::ImageDataModifiedEvent);
+    this->RemoveObservation(node, vtkMRMLTransformableNode::TransformModifiedEvent);
+    }
+  else if (vtkMRMLColorTableNode::SafeDownCast(node))
+    {
+    this->RemoveObservation(node, vtkCommand::ModifiedEvent);
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::vtkInternal::ClearDisplayableNodes()
+{
+  while (this->IsodosePipelines.size() > 0)
+    {
+    this->RemoveIsodoseNode(this->IsodosePipelines.begin()->first);
+    }
+}
+
+
+//---------------------------------------------------------------------------
+// vtkMRMLIsodoseDisplayableManager2D methods
+
+//---------------------------------------------------------------------------
+vtkMRMLIsodoseDisplayableManager2D::vtkMRMLIsodoseDisplayableManager2D()
+{
+  this->Internal = new vtkInternal(this);
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLIsodoseDisplayableManager2D::~vtkMRMLIsodoseDisplayableManager2D()
+{
+  delete this->Internal;
+  this->Internal = NULL;
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "vtkMRMLIsodoseDisplayableManager2D: " << this->GetClassName() << "\n";
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::ContourDoseOnSlicePlane(vtkImageData* doseImageData,
+  vtkAbstractTransform* ijkToWorldTransform, vtkAbstractTransform* worldToIJKTransform,
+  vtkMatrix4x4* sliceToRAS, const std::vector<double>& isodoseLevels, vtkPolyData* contours)
+{
+  if (!contours)
+    {
+    return;
+    }
+  contours->Initialize();
+  if (!doseImageData || !ijkToWorldTransform || !worldToIJKTransform || !sliceToRAS)
+    {
+    return;
+    }
+
+  // Skip contouring if none of the isodose levels are present in the dose volume
+  vtkImageBlockMinMax* doseBlockMinMax = vtkImageBlockMinMax::GetBlockMinMaxForImage(doseImageData);
+  if (!doseBlockMinMax)
+    {
+    return;
+    }
+  double doseRange[2] = {0.0, 0.0};
+  doseBlockMinMax->GetScalarRange(doseRange);
+  bool levelInDoseRange = false;
+  for (std::vector<double>::const_iterator levelIt = isodoseLevels.begin(); levelIt != isodoseLevels.end(); ++levelIt)
+    {
+    if ((*levelIt) > doseRange[0] && (*levelIt) <= doseRange[1])
+      {
+      levelInDoseRange = true;
+      break;
+      }
+    }
+  if (!levelInDoseRange)
+    {
+    return;
+    }
+
+  // Determine the region of the slice plane covered by the dose volume
+  vtkNew<vtkMatrix4x4> rasToPlaneMatrix;
+  vtkMatrix4x4::Invert(sliceToRAS, rasToPlaneMatrix.GetPointer());
+  vtkNew<vtkGeneralTransform> ijkToPlaneTransform;
+  ijkToPlaneTransform->PostMultiply();
+  ijkToPlaneTransform->Concatenate(ijkToWorldTransform);
+  ijkToPlaneTransform->Concatenate(rasToPlaneMatrix.GetPointer());
+
+  int doseExtent[6] = {0,-1,0,-1,0,-1};
+  doseImageData->GetExtent(doseExtent);
+  double planeBounds[6] = {VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX};
+  for (int corner=0; corner<8; ++corner)
+    {
+    double cornerIjk[3] = { (double)doseExtent[(corner & 1) ? 1 : 0], (double)doseExtent[(corner & 2) ? 3 : 2], (double)doseExtent[(corner & 4) ? 5 : 4] };
+    double cornerPlane[3] = {0.0, 0.0, 0.0};
+    ijkToPlaneTransform->TransformPoint(cornerIjk, cornerPlane);
+    for (int axis=0; axis<3; ++axis)
+      {
+      planeBounds[axis*2] = std::min(planeBounds[axis*2], cornerPlane[axis]);
+      planeBounds[axis*2+1] = std::max(planeBounds[axis*2+1], cornerPlane[axis]);
+      }
+    }
+  if (planeBounds[4] > SLICE_POSITION_TOLERANCE || planeBounds[5] < -SLICE_POSITION_TOLERANCE)
+    {
+    // Slice plane does not intersect the dose volume
+    return;
+    }
+
+  // Sample the plane at the finest dose resolution (distance of neighboring voxels at the first corner),
+  // limiting the number of samples for very oblique planes
+  double firstVoxelWorld[3] = {0.0, 0.0, 0.0};
+  double firstVoxelIjk[3] = { (double)doseExtent[0], (double)doseExtent[2], (double)doseExtent[4] };
+  ijkToWorldTransform->TransformPoint(firstVoxelIjk, firstVoxelWorld);
+  double samplingDistance = VTK_DOUBLE_MAX;
+  for (int axis=0; axis<3; ++axis)
+    {
+    double neighborVoxelIjk[3] = { firstVoxelIjk[0], firstVoxelIjk[1], firstVoxelIjk[2] };
+    neighborVoxelIjk[axis] += 1.0;
+    double neighborVoxelWorld[3] = {0.0, 0.0, 0.0};
+    ijkToWorldTransform->TransformPoint(neighborVoxelIjk, neighborVoxelWorld);
+    samplingDistance = std::min(samplingDistance, sqrt(vtkMath::Distance2BetweenPoints(firstVoxelWorld, neighborVoxelWorld)));
+    }
+  for (int axis=0; axis<2; ++axis)
+    {
+    double planeSize = planeBounds[axis*2+1] - planeBounds[axis*2];
+    if (planeSize / samplingDistance > MAXIMUM_NUMBER_OF_PLANE_SAMPLES)
+      {
+      samplingDistance = planeSize / MAXIMUM_NUMBER_OF_PLANE_SAMPLES;
+      }
+    }
+  if (samplingDistance <= 0.0)
+    {
+    return;
+    }
+  int planeExtent[6] = {
+    (int)floor(planeBounds[0] / samplingDistance), (int)ceil(planeBounds[1] / samplingDistance),
+    (int)floor(planeBounds[2] / samplingDistance), (int)ceil(planeBounds[3] / samplingDistance),
+    0, 0 };
+
+  // Calculate slice plane to dose IJK transform
+  vtkSmartPointer<vtkGeneralTransform> planeToIJKTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  planeToIJKTransform->PostMultiply();
+  planeToIJKTransform->Concatenate(sliceToRAS);
+  planeToIJKTransform->Concatenate(worldToIJKTransform);
+
+  // Resample dose on the slice plane
+  vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
+  vtkSmartPointer<vtkTransform> linearPlaneToIJKTransform = vtkSmartPointer<vtkTransform>::New();
+  if (vtkMRMLTransformNode::IsGeneralTransformLinear(planeToIJKTransform, linearPlaneToIJKTransform))
+    {
+    SnapToPermuteMatrix(linearPlaneToIJKTransform);
+    reslice->SetResliceTransform(linearPlaneToIJKTransform);
+    }
+  else
+    {
+    reslice->SetResliceTransform(planeToIJKTransform);
+    }
+  reslice->SetInputData(doseImageData);
+  reslice->SetInterpolationModeToLinear();
+  reslice->SetBackgroundLevel(doseRange[0]);
+  reslice->AutoCropOutputOff();
+  reslice->SetOptimization(1);
+  reslice->SetOutputOrigin(0.0, 0.0, 0.0);
+  reslice->SetOutputSpacing(samplingDistance, samplingDistance, 1.0);
+  reslice->SetOutputExtent(planeExtent);
+  reslice->SetOutputDimensionality(2);
+  reslice->Update();
+
+  // Only contour the levels that are present in the slice
+  double sliceRange[2] = {0.0, 0.0};
+  reslice->GetOutput()->GetScalarRange(sliceRange);
+  std::vector<int> slicedLevelIndices;
+  vtkSmartPointer<vtkMarchingSquares> marchingSquares = vtkSmartPointer<vtkMarchingSquares>::New();
+  marchingSquares->SetInputConnection(reslice->GetOutputPort());
+  for (int levelIndex=0; levelIndex<(int)isodoseLevels.size(); ++levelIndex)
+    {
+    if (isodoseLevels[levelIndex] > sliceRange[0] && isodoseLevels[levelIndex] <= sliceRange[1])
+      {
+      marchingSquares->SetValue((int)slicedLevelIndices.size(), isodoseLevels[levelIndex]);
+      slicedLevelIndices.push_back(levelIndex);
+      }
+    }
+  if (slicedLevelIndices.empty())
+    {
+    return;
+    }
+  marchingSquares->Update();
+  contours->ShallowCopy(marchingSquares->GetOutput());
+
+  // Find the isodose level of each line from the value it was contoured at (stored in the point scalars)
+  vtkDataArray* contourValues = contours->GetPointData()->GetScalars();
+  vtkSmartPointer<vtkIntArray> levelIndices = vtkSmartPointer<vtkIntArray>::New();
+  levelIndices->SetName("IsodoseLevelIndex");
+  levelIndices->SetNumberOfTuples(contours->GetNumberOfCells());
+  levelIndices->FillComponent(0, slicedLevelIndices[0]);
+  vtkCellArray* lines = contours->GetLines();
+  vtkIdType numberOfPoints = 0;
+  vtkIdType* pointIds = NULL;
+  vtkIdType cellId = contours->GetNumberOfVerts();
+  for (lines->InitTraversal(); lines->GetNextCell(numberOfPoints, pointIds); ++cellId)
+    {
+    if (!contourValues || numberOfPoints == 0)
+      {
+      continue;
+      }
+    double value = contourValues->GetComponent(pointIds[0], 0);
+    int cellLevelIndex = slicedLevelIndices[0];
+    for (std::vector<int>::iterator levelIndexIt = slicedLevelIndices.begin(); levelIndexIt != slicedLevelIndices.end(); ++levelIndexIt)
+      {
+      if (fabs(isodoseLevels[*levelIndexIt] - value) < fabs(isodoseLevels[cellLevelIndex] - value))
+        {
+        cellLevelIndex = (*levelIndexIt);
+        }
+      }
+    levelIndices->SetValue(cellId, cellLevelIndex);
+    }
+  contours->GetPointData()->Initialize();
+  contours->GetCellData()->AddArray(levelIndices);
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::OnMRMLSceneNodeAdded(vtkMRMLNode* node)
+{
+  if ( !node->IsA("vtkMRMLIsodoseNode") )
+    {
+    return;
+    }
+
+  // Escape if the scene a scene is being closed, imported or connected
+  if (this->GetMRMLScene()->IsBatchProcessing())
+    {
+    this->SetUpdateFromMRMLRequested(1);
+    return;
+    }
+
+  this->Internal->AddIsodoseNode(vtkMRMLIsodoseNode::SafeDownCast(node));
+  this->RequestRender();
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
+{
+  if (!node)
+    {
+    return;
+    }
+
+  vtkMRMLIsodoseNode* isodoseNode = vtkMRMLIsodoseNode::SafeDownCast(node);
+  if (isodoseNode)
+    {
+    this->Internal->RemoveIsodoseNode(isodoseNode);
+    this->RequestRender();
+    }
+  else if (this->Internal->IsNodeReferenced(node))
+    {
+    this->Internal->OnReferencedNodeRemoved(node);
+    this->RequestRender();
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData)
+{
+  vtkMRMLScene* scene = this->GetMRMLScene();
+
+  if ( scene->IsBatchProcessing() )
+    {
+    return;
+    }
+
+  vtkMRMLIsodoseNode* isodoseNode = vtkMRMLIsodoseNode::SafeDownCast(caller);
+  vtkMRMLNode* referencedNode = vtkMRMLNode::SafeDownCast(caller);
+
+  if (isodoseNode)
+    {
+    this->Internal->UpdateIsodoseNode(isodoseNode);
+    this->RequestRender();
+    }
+  else if ( vtkMRMLSliceNode::SafeDownCast(caller) )
+    {
+    this->Internal->UpdateSliceNode();
+    this->RequestRender();
+    }
+  else if ( this->Internal->IsNodeReferenced(referencedNode) )
+    {
+    this->Internal->OnReferencedNodeModified(referencedNode, event);
+    this->RequestRender();
+    }
+  else
+    {
+    this->Superclass::ProcessMRMLNodesEvents(caller, event, callData);
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::UpdateFromMRML()
+{
+  this->SetUpdateFromMRMLRequested(0);
+
+  vtkMRMLScene* scene = this->GetMRMLScene();
+  if (!scene)
+    {
+    vtkDebugMacro( "vtkMRMLIsodoseDisplayableManager2D->UpdateFromMRML: Scene is not set.")
+    return;
+    }
+  this->Internal->ClearDisplayableNodes();
+
+  std::vector<vtkMRMLNode *> isodoseNodes;
+  int numberOfIsodoseNodes = scene->GetNodesByClass("vtkMRMLIsodoseNode", isodoseNodes);
+  for (int i=0; i<numberOfIsodoseNodes; i++)
+    {
+    this->Internal->AddIsodoseNode(vtkMRMLIsodoseNode::SafeDownCast(isodoseNodes[i]));
+    }
+  this->RequestRender();
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::UnobserveMRMLScene()
+{
+  this->Internal->ClearDisplayableNodes();
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::OnMRMLSceneStartClose()
+{
+  this->Internal->ClearDisplayableNodes();
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::OnMRMLSceneEndClose()
+{
+  this->SetUpdateFromMRMLRequested(1);
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::OnMRMLSceneEndBatchProcess()
+{
+  this->SetUpdateFromMRMLRequested(1);
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLIsodoseDisplayableManager2D::Create()
+{
+  this->Internal->SetSliceNode(this->GetMRMLSliceNode());
+  this->SetUpdateFromMRMLRequested(1);
+}
@@ -0,0 +1,99 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkMRMLIsodoseDisplayableManager2D_h
+#define __vtkMRMLIsodoseDisplayableManager2D_h
+
+// MRMLDisplayableManager includes
+#include "vtkMRMLAbstractSliceViewDisplayableManager.h"
+
+#include "vtkSlicerIsodoseModuleMRMLDisplayableManagerExport.h"
+
+// STD includes
+#include <vector>
+
+class vtkAbstractTransform;
+class vtkImageData;
+class vtkMatrix4x4;
+class vtkPolyData;
+
+/// \brief Displayable manager for showing isodose lines in slice (2D) views.
+///
+/// The dose volume is resampled on the slice plane and the isodose lines are
+/// contoured directly in 2D (marching squares) for each isodose level, so no
+/// isodose surface needs to be extracted for the slice views.
+/// The contours are computed in slice plane coordinates and cached per slice
+/// position, so panning and zooming only changes a transform, and returning to
+/// a previously visited slice position does not require contouring again.
+///
+/// \ingroup SlicerRt_QtModules_Isodose
+class VTK_SLICER_ISODOSE_MODULE_MRMLDISPLAYABLEMANAGER_EXPORT vtkMRMLIsodoseDisplayableManager2D
+  : public vtkMRMLAbstractSliceViewDisplayableManager
+{
+public:
+  static vtkMRMLIsodoseDisplayableManager2D* New();
+  vtkTypeMacro(vtkMRMLIsodoseDisplayableManager2D, vtkMRMLAbstractSliceViewDisplayableManager);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Contour isodose levels of a dose image on a slice plane.
+  /// The lines are in slice plane coordinates (the plane is Z=0 of the slice to RAS transform), and the
+  /// index of the isodose level of each line is stored in the "IsodoseLevelIndex" cell data array.
+  /// Levels that are not present in the dose image or in the slice are skipped.
+  /// \param doseImageData Dose image
+  /// \param ijkToWorldTransform Transform from dose IJK to world coordinates
+  /// \param worldToIJKTransform Inverse of ijkToWorldTransform
+  /// \param sliceToRAS Slice to RAS matrix of the slice plane
+  /// \param isodoseLevels Dose values to contour
+  /// \param contours Output isodose lines
+  static void ContourDoseOnSlicePlane(vtkImageData* doseImageData,
+    vtkAbstractTransform* ijkToWorldTransform, vtkAbstractTransform* worldToIJKTransform,
+    vtkMatrix4x4* sliceToRAS, const std::vector<double>& isodoseLevels, vtkPolyData* contours);
+
+protected:
+  virtual void UnobserveMRMLScene();
+  virtual void OnMRMLSceneNodeAdded(vtkMRMLNode* node);
+  virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node);
+  virtual void ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData);
+
+  /// Update actors based on isodose nodes in the scene
+  virtual void UpdateFromMRML();
+
+  virtual void OnMRMLSceneStartClose();
+  virtual void OnMRMLSceneEndClose();
+
+  virtual void OnMRMLSceneEndBatchProcess();
+
+  /// Initialize the displayable manager based on its associated vtkMRMLSliceNode
+  virtual void Create();
+
+protected:
+  vtkMRMLIsodoseDisplayableManager2D();
+  virtual ~vtkMRMLIsodoseDisplayableManager2D();
+
+private:
+  vtkMRMLIsodoseDisplayableManager2D(const vtkMRMLIsodoseDisplayableManager2D&);// Not implemented
+  void operator=(const vtkMRMLIsodoseDisplayableManager2D&);                 // Not Implemented
+
+  class vtkInternal;
+  vtkInternal * Internal;
+  friend class vtkInternal;
+};
+
+#endif
@@ -0,0 +1,214 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkImageBlockMinMax.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+
+namespace
+{
+  const int TEST_EXTENT[6] = {2, 21, -3, 13, 0, 9};
+  const int TEST_BLOCK_SIZE = 4;
+  const int SPIKE_POSITION[3] = {13, 4, 4};
+  const short SPIKE_VALUE = 1000;
+
+  /// Create image with a deterministic pattern of values in [0,49] and a single spike voxel
+  void CreateTestImage(vtkImageData* imageData)
+  {
+    imageData->SetExtent(const_cast<int*>(TEST_EXTENT));
+    imageData->AllocateScalars(VTK_SHORT, 1);
+    for (int k=TEST_EXTENT[4]; k<=TEST_EXTENT[5]; ++k)
+    {
+      for (int j=TEST_EXTENT[2]; j<=TEST_EXTENT[3]; ++j)
+      {
+        for (int i=TEST_EXTENT[0]; i<=TEST_EXTENT[1]; ++i)
+        {
+          short* voxel = static_cast<short*>(imageData->GetScalarPointer(i,j,k));
+          (*voxel) = static_cast<short>(((i*7 + j*13 + k*29) % 50 + 50) % 50);
+        }
+      }
+    }
+    short* spikeVoxel = static_cast<short*>(imageData->GetScalarPointer(SPIKE_POSITION[0], SPIKE_POSITION[1], SPIKE_POSITION[2]));
+    (*spikeVoxel) = SPIKE_VALUE;
+  }
+
+  /// Compute range of the voxels within an extent by visiting every voxel
+  void ComputeRangeBruteForce(vtkImageData* imageData, const int extent[6], double range[2])
+  {
+    range[0] = VTK_DOUBLE_MAX;
+    range[1] = VTK_DOUBLE_MIN;
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        for (int i=extent[0]; i<=extent[1]; ++i)
+        {
+          double value = imageData->GetScalarComponentAsDouble(i,j,k,0);
+          range[0] = std::min(range[0], value);
+          range[1] = std::max(range[1], value);
+        }
+      }
+    }
+  }
+
+  bool IsVoxelInExtent(const int voxel[3], const int extent[6])
+  {
+    return voxel[0] >= extent[0] && voxel[0] <= extent[1]
+      && voxel[1] >= extent[2] && voxel[1] <= extent[3]
+      && voxel[2] >= extent[4] && voxel[2] <= extent[5];
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkImageBlockMinMaxTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkImageData> imageData = vtkSmartPointer<vtkImageData>::New();
+  CreateTestImage(imageData);
+
+  vtkSmartPointer<vtkImageBlockMinMax> blockMinMax = vtkSmartPointer<vtkImageBlockMinMax>::New();
+  blockMinMax->SetBlockSize(TEST_BLOCK_SIZE);
+  if (!blockMinMax->Build(imageData))
+  {
+    std::cerr << "Failed to build block index!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Blocks are defined on the cells: 19, 16 and 9 cells along the axes
+  int* blockDimensions = blockMinMax->GetBlockDimensions();
+  if (blockDimensions[0] != 5 || blockDimensions[1] != 4 || blockDimensions[2] != 3 || blockMinMax->GetNumberOfBlocks() != 60)
+  {
+    std::cerr << "Block dimensions mismatch: " << blockDimensions[0] << ", " << blockDimensions[1] << ", " << blockDimensions[2]
+      << " instead of 5, 4, 3" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Global range must be exact
+  double imageRange[2] = {0.0, 0.0};
+  ComputeRangeBruteForce(imageData, TEST_EXTENT, imageRange);
+  double indexRange[2] = {0.0, 0.0};
+  blockMinMax->GetScalarRange(indexRange);
+  if (indexRange[0] != imageRange[0] || indexRange[1] != imageRange[1])
+  {
+    std::cerr << "Scalar range mismatch: " << indexRange[0] << ", " << indexRange[1]
+      << " instead of " << imageRange[0] << ", " << imageRange[1] << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Block ranges must be exact, block extents must overlap by one voxel and cover the image
+  int expectedSpikeExtent[6] = {VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN};
+  int numberOfSpikeBlocks = 0;
+  for (int blockK=0; blockK<blockDimensions[2]; ++blockK)
+  {
+    for (int blockJ=0; blockJ<blockDimensions[1]; ++blockJ)
+    {
+      for (int blockI=0; blockI<blockDimensions[0]; ++blockI)
+      {
+        int blockExtent[6] = {0,-1,0,-1,0,-1};
+        blockMinMax->GetBlockExtent(blockI, blockJ, blockK, blockExtent);
+        int blockCoordinates[3] = {blockI, blockJ, blockK};
+        for (int axis=0; axis<3; ++axis)
+        {
+          int expectedFirst = TEST_EXTENT[2*axis] + blockCoordinates[axis]*TEST_BLOCK_SIZE;
+          int expectedLast = std::min(expectedFirst + TEST_BLOCK_SIZE, TEST_EXTENT[2*axis+1]);
+          if (blockExtent[2*axis] != expectedFirst || blockExtent[2*axis+1] != expectedLast)
+          {
+            std::cerr << "Extent mismatch in block (" << blockI << ", " << blockJ << ", " << blockK << ") along axis " << axis << std::endl;
+            return EXIT_FAILURE;
+          }
+        }
+
+        double blockRange[2] = {0.0, 0.0};
+        ComputeRangeBruteForce(imageData, blockExtent, blockRange);
+        if ( !blockMinMax->BlockMayContainRange(blockI, blockJ, blockK, blockRange[0], blockRange[0])
+          || !blockMinMax->BlockMayContainRange(blockI, blockJ, blockK, blockRange[1], blockRange[1])
+          || blockMinMax->BlockMayContainRange(blockI, blockJ, blockK, blockRange[0]-2.0, blockRange[0]-1.0)
+          || blockMinMax->BlockMayContainRange(blockI, blockJ, blockK, blockRange[1]+1.0, blockRange[1]+2.0) )
+        {
+          std::cerr << "Range mismatch in block (" << blockI << ", " << blockJ << ", " << blockK << "): expected "
+            << blockRange[0] << ", " << blockRange[1] << std::endl;
+          return EXIT_FAILURE;
+        }
+
+        if (IsVoxelInExtent(SPIKE_POSITION, blockExtent))
+        {
+          ++numberOfSpikeBlocks;
+          for (int axis=0; axis<3; ++axis)
+          {
+            expectedSpikeExtent[2*axis] = std::min(expectedSpikeExtent[2*axis], blockExtent[2*axis]);
+            expectedSpikeExtent[2*axis+1] = std::max(expectedSpikeExtent[2*axis+1], blockExtent[2*axis+1]);
+          }
+        }
+      }
+    }
+  }
+
+  // Spike voxel (13,4,4) is on the overlapping layer along K only, so it is contained by two blocks
+  if (numberOfSpikeBlocks != 2 || blockMinMax->GetNumberOfBlocksContainingRange(SPIKE_VALUE, SPIKE_VALUE) != 2)
+  {
+    std::cerr << "Number of blocks containing the spike value mismatch: "
+      << blockMinMax->GetNumberOfBlocksContainingRange(SPIKE_VALUE, SPIKE_VALUE) << " instead of " << numberOfSpikeBlocks << std::endl;
+    return EXIT_FAILURE;
+  }
+  int spikeExtent[6] = {0,-1,0,-1,0,-1};
+  if ( !blockMinMax->GetExtentContainingRange(SPIKE_VALUE-1, SPIKE_VALUE+1, spikeExtent)
+    || !std::equal(spikeExtent, spikeExtent+6, expectedSpikeExtent) )
+  {
+    std::cerr << "Extent containing the spike value mismatch: " << spikeExtent[0] << ", " << spikeExtent[1] << ", " << spikeExtent[2]
+      << ", " << spikeExtent[3] << ", " << spikeExtent[4] << ", " << spikeExtent[5] << std::endl;
+    return EXIT_FAILURE;
+  }
+  int emptyExtent[6] = {0,-1,0,-1,0,-1};
+  if (blockMinMax->GetExtentContainingRange(100.0, 999.0, emptyExtent) || emptyExtent[0] <= emptyExtent[1])
+  {
+    std::cerr << "Non-empty extent found for a range that is not in the image!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Index attached to the image is reused until the image is modified
+  vtkImageBlockMinMax* attachedBlockMinMax = vtkImageBlockMinMax::GetBlockMinMaxForImage(imageData);
+  if (!attachedBlockMinMax || attachedBlockMinMax != vtkImageBlockMinMax::GetBlockMinMaxForImage(imageData))
+  {
+    std::cerr << "Block index attached to the image is not reused!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  short* spikeVoxel = static_cast<short*>(imageData->GetScalarPointer(SPIKE_POSITION[0], SPIKE_POSITION[1], SPIKE_POSITION[2]));
+  (*spikeVoxel) = 0;
+  imageData->Modified();
+  if (attachedBlockMinMax->IsUpToDate(imageData))
+  {
+    std::cerr << "Block index is up-to-date after the image has been modified!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  attachedBlockMinMax = vtkImageBlockMinMax::GetBlockMinMaxForImage(imageData);
+  if (!attachedBlockMinMax || attachedBlockMinMax->GetNumberOfBlocksContainingRange(SPIKE_VALUE, SPIKE_VALUE) != 0)
+  {
+    std::cerr << "Block index has not been rebuilt after the image has been modified!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,203 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Isodose includes
+#include "vtkMRMLIsodoseDisplayableManager2D.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  const int DOSE_EXTENT[6] = {0, 60, 0, 50, 0, 40};
+  const double DOSE_SPACING[3] = {1.5, 2.0, 2.5};
+  const double DOSE_CENTER[3] = {10.0, -20.0, 30.0};
+  /// Dose decreases linearly with the distance from the center, so the isodose surfaces are spheres
+  const double MAXIMUM_DOSE = 50.0;
+  const double RADIUS_TOLERANCE_MM = 0.3;
+  const double LENGTH_TOLERANCE = 0.02;
+
+  /// Create dose image sampling the cone dose function. The dose IJK to world transform is rotated
+  /// and places the center of the image at the dose center
+  void CreateTestDose(vtkImageData* doseImageData, vtkTransform* ijkToWorldTransform)
+  {
+    ijkToWorldTransform->Identity();
+    ijkToWorldTransform->PostMultiply();
+    ijkToWorldTransform->Scale(DOSE_SPACING[0], DOSE_SPACING[1], DOSE_SPACING[2]);
+    ijkToWorldTransform->Translate( -0.5*DOSE_EXTENT[1]*DOSE_SPACING[0],
+      -0.5*DOSE_EXTENT[3]*DOSE_SPACING[1], -0.5*DOSE_EXTENT[5]*DOSE_SPACING[2] );
+    ijkToWorldTransform->RotateZ(30.0);
+    ijkToWorldTransform->Translate(DOSE_CENTER[0], DOSE_CENTER[1], DOSE_CENTER[2]);
+
+    doseImageData->SetExtent(const_cast<int*>(DOSE_EXTENT));
+    doseImageData->AllocateScalars(VTK_FLOAT, 1);
+    for (int k=DOSE_EXTENT[4]; k<=DOSE_EXTENT[5]; ++k)
+    {
+      for (int j=DOSE_EXTENT[2]; j<=DOSE_EXTENT[3]; ++j)
+      {
+        for (int i=DOSE_EXTENT[0]; i<=DOSE_EXTENT[1]; ++i)
+        {
+          double voxelIjk[3] = {(double)i, (double)j, (double)k};
+          double voxelWorld[3] = {0.0, 0.0, 0.0};
+          ijkToWorldTransform->TransformPoint(voxelIjk, voxelWorld);
+          double distance = sqrt(vtkMath::Distance2BetweenPoints(voxelWorld, DOSE_CENTER));
+          *(static_cast<float*>(doseImageData->GetScalarPointer(i,j,k))) = (float)std::max(0.0, MAXIMUM_DOSE - distance);
+        }
+      }
+    }
+  }
+
+  /// Contour the dose on a slice plane at the given distance from the dose center and check that the lines
+  /// of each isodose level lie on the circle where the plane cuts the isodose sphere, and cover the whole circle
+  bool CheckIsodoseLines(vtkImageData* doseImageData, vtkTransform* ijkToWorldTransform, vtkMatrix4x4* sliceToRAS,
+    const std::vector<double>& isodoseLevels, double planeDistanceFromCenter, const char* planeName)
+  {
+    vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+    vtkMRMLIsodoseDisplayableManager2D::ContourDoseOnSlicePlane(doseImageData,
+      ijkToWorldTransform, ijkToWorldTransform->GetLinearInverse(), sliceToRAS, isodoseLevels, contours);
+    vtkDataArray* levelIndices = contours->GetCellData()->GetArray("IsodoseLevelIndex");
+    if (contours->GetNumberOfCells() == 0 || !levelIndices)
+    {
+      std::cerr << __LINE__ << ": No isodose lines on the " << planeName << " plane!" << std::endl;
+      return false;
+    }
+
+    std::vector<double> lineLengths(isodoseLevels.size(), 0.0);
+    vtkCellArray* lines = contours->GetLines();
+    vtkIdType numberOfPoints = 0;
+    vtkIdType* pointIds = NULL;
+    vtkIdType cellId = contours->GetNumberOfVerts();
+    for (lines->InitTraversal(); lines->GetNextCell(numberOfPoints, pointIds); ++cellId)
+    {
+      int levelIndex = (int)levelIndices->GetComponent(cellId, 0);
+      double expectedRadius = sqrt( (MAXIMUM_DOSE-isodoseLevels[levelIndex])*(MAXIMUM_DOSE-isodoseLevels[levelIndex])
+        - planeDistanceFromCenter*planeDistanceFromCenter );
+      double previousPointRAS[4] = {0.0, 0.0, 0.0, 1.0};
+      for (vtkIdType pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+      {
+        double pointPlane[4] = {0.0, 0.0, 0.0, 1.0};
+        contours->GetPoint(pointIds[pointIndex], pointPlane);
+        if (fabs(pointPlane[2]) > 1e-6)
+        {
+          std::cerr << __LINE__ << ": Isodose line point is not on the " << planeName << " plane!" << std::endl;
+          return false;
+        }
+        double pointRAS[4] = {0.0, 0.0, 0.0, 1.0};
+        sliceToRAS->MultiplyPoint(pointPlane, pointRAS);
+        double radius = sqrt(vtkMath::Distance2BetweenPoints(pointRAS, DOSE_CENTER) - planeDistanceFromCenter*planeDistanceFromCenter);
+        if (fabs(radius - expectedRadius) > RADIUS_TOLERANCE_MM)
+        {
+          std::cerr << __LINE__ << ": Radius of the " << isodoseLevels[levelIndex] << " isodose line on the " << planeName
+            << " plane is " << radius << " mm instead of " << expectedRadius << " mm" << std::endl;
+          return false;
+        }
+        if (pointIndex > 0)
+        {
+          lineLengths[levelIndex] += sqrt(vtkMath::Distance2BetweenPoints(previousPointRAS, pointRAS));
+        }
+        std::copy(pointRAS, pointRAS+3, previousPointRAS);
+      }
+    }
+
+    for (int levelIndex=0; levelIndex<(int)isodoseLevels.size(); ++levelIndex)
+    {
+      double levelRadiusSquared = (MAXIMUM_DOSE-isodoseLevels[levelIndex])*(MAXIMUM_DOSE-isodoseLevels[levelIndex])
+        - planeDistanceFromCenter*planeDistanceFromCenter;
+      double expectedLength = (isodoseLevels[levelIndex] < MAXIMUM_DOSE && levelRadiusSquared > 0.0 ? 2.0*vtkMath::Pi()*sqrt(levelRadiusSquared) : 0.0);
+      if (fabs(lineLengths[levelIndex] - expectedLength) > LENGTH_TOLERANCE * expectedLength)
+      {
+        std::cerr << __LINE__ << ": Length of the " << isodoseLevels[levelIndex] << " isodose line on the " << planeName
+          << " plane is " << lineLengths[levelIndex] << " mm instead of " << expectedLength << " mm" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkMRMLIsodoseDisplayableManager2DTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkImageData> doseImageData = vtkSmartPointer<vtkImageData>::New();
+  vtkSmartPointer<vtkTransform> ijkToWorldTransform = vtkSmartPointer<vtkTransform>::New();
+  CreateTestDose(doseImageData, ijkToWorldTransform);
+
+  // The last level is above the maximum dose, so it has no lines
+  std::vector<double> isodoseLevels;
+  isodoseLevels.push_back(10.0);
+  isodoseLevels.push_back(20.0);
+  isodoseLevels.push_back(30.0);
+  isodoseLevels.push_back(60.0);
+
+  // Axial plane above the dose center
+  const double axialDistanceMm = 6.0;
+  vtkSmartPointer<vtkTransform> axialSliceToRAS = vtkSmartPointer<vtkTransform>::New();
+  axialSliceToRAS->Translate(DOSE_CENTER[0], DOSE_CENTER[1], DOSE_CENTER[2] + axialDistanceMm);
+  if (!CheckIsodoseLines(doseImageData, ijkToWorldTransform, axialSliceToRAS->GetMatrix(), isodoseLevels, axialDistanceMm, "axial"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Oblique plane
+  const double obliqueDistanceMm = 4.0;
+  vtkSmartPointer<vtkTransform> obliqueSliceToRAS = vtkSmartPointer<vtkTransform>::New();
+  obliqueSliceToRAS->Translate(DOSE_CENTER[0], DOSE_CENTER[1], DOSE_CENTER[2]);
+  obliqueSliceToRAS->RotateWXYZ(35.0, 1.0, 2.0, 0.5);
+  obliqueSliceToRAS->Translate(0.0, 0.0, obliqueDistanceMm);
+  if (!CheckIsodoseLines(doseImageData, ijkToWorldTransform, obliqueSliceToRAS->GetMatrix(), isodoseLevels, obliqueDistanceMm, "oblique"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // No lines on a plane outside the dose volume or for levels above the maximum dose
+  vtkSmartPointer<vtkTransform> outsideSliceToRAS = vtkSmartPointer<vtkTransform>::New();
+  outsideSliceToRAS->Translate(DOSE_CENTER[0], DOSE_CENTER[1], DOSE_CENTER[2] + 200.0);
+  vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+  vtkMRMLIsodoseDisplayableManager2D::ContourDoseOnSlicePlane(doseImageData,
+    ijkToWorldTransform, ijkToWorldTransform->GetLinearInverse(), outsideSliceToRAS->GetMatrix(), isodoseLevels, contours);
+  if (contours->GetNumberOfCells() != 0)
+  {
+    std::cerr << __LINE__ << ": Isodose lines found on a plane outside the dose volume!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<double> highIsodoseLevels(1, MAXIMUM_DOSE + 5.0);
+  vtkMRMLIsodoseDisplayableManager2D::ContourDoseOnSlicePlane(doseImageData,
+    ijkToWorldTransform, ijkToWorldTransform->GetLinearInverse(), axialSliceToRAS->GetMatrix(), highIsodoseLevels, contours);
+  if (contours->GetNumberOfCells() != 0)
+  {
+    std::cerr << __LINE__ << ": Isodose lines found for a level above the maximum dose!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
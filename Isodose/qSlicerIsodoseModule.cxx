@@ -29,6 +29,15 @@
 // Isodose Logic includes
 #include <vtkSlicerIsodoseModuleLogic.h>
 
+// Isodose MRMLDM includes
+#include "vtkMRMLIsodoseDisplayableManager2D.h"
+
+// MRMLDisplayableManager includes
+#include <vtkMRMLSliceViewDisplayableManagerFactory.h>
+
+// VTK includes
+#include <vtkSmartPointer.h>
+
 // Isodose includes
 #include "qSlicerIsodoseModule.h"
 #include "qSlicerIsodoseModuleWidget.h"
@@ -111,6 +120,11 @@ void qSlicerIsodoseModule::setup()
 
   // Register Subject Hierarchy plugins
   qSlicerSubjectHierarchyPluginHandler::instance()->registerPlugin(new qSlicerSubjectHierarchyIsodosePlugin());
+
+  // Use the displayable manager class to make sure the the containing library is loaded
+  vtkSmartPointer<vtkMRMLIsodoseDisplayableManager2D> dm2d = vtkSmartPointer<vtkMRMLIsodoseDisplayableManager2D>::New();
+  // Register displayable manager showing isodose lines in the slice views
+  vtkMRMLSliceViewDisplayableManagerFactory::GetInstance()->RegisterDisplayableManager("vtkMRMLIsodoseDisplayableManager2D");
 }
 
 //-----------------------------------------------------------------------------
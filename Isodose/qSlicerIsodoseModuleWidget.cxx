@@ -580,25 +580,9 @@ void qSlicerIsodoseModuleWidget::setIsolineVisibility(bool visible)
     return;
   }
 
-  paramNode->DisableModifiedEventOn();
+  // Isodose lines are shown in the slice views by the isodose displayable manager, which
+  // observes the parameter node, so the modified event must not be suppressed here
   paramNode->SetShowIsodoseLines(visible);
-  paramNode->DisableModifiedEventOff();
-
-  vtkMRMLModelHierarchyNode* modelHierarchyNode = d->logic()->GetRootModelHierarchyNode();
-  if(!modelHierarchyNode)
-  {
-    qCritical() << "qSlicerIsodoseModuleWidget::setIsolineVisibility: Invalid isodose surface models parent hierarchy node!";
-    return;
-  }
-
-  vtkSmartPointer<vtkCollection> childModelNodes = vtkSmartPointer<vtkCollection>::New();
-  modelHierarchyNode->GetChildrenModelNodes(childModelNodes);
-  childModelNodes->InitTraversal();
-  for (int i=0; i<childModelNodes->GetNumberOfItems(); ++i)
-  {
-    vtkMRMLModelNode* modelNode = vtkMRMLModelNode::SafeDownCast(childModelNodes->GetItemAsObject(i));
-    modelNode->GetDisplayNode()->SetSliceIntersectionVisibility(visible);
-  }
 }
 
 //------------------------------------------------------------------------------
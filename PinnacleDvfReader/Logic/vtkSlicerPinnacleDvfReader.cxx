@@ -37,6 +37,33 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Number of byte planes stored for the vector field (high bytes of X, Y, Z, then low bytes of X, Y, Z)
+  const int NUMBER_OF_DVF_PLANES = 6;
+
+  /// Decode the high and low byte planes of a slice into interleaved displacement vectors,
+  /// converting from LPS to RAS. The planes are in the order they are stored in the file.
+  template <class T>
+  void DecodeDvfSlice(const char* planes, vtkIdType sliceVoxelCount, float minResolution, T* vectors)
+  {
+    const signed char* xHigh = reinterpret_cast<const signed char*>(planes);
+    const signed char* yHigh = reinterpret_cast<const signed char*>(planes + sliceVoxelCount);
+    const signed char* zHigh = reinterpret_cast<const signed char*>(planes + 2*sliceVoxelCount);
+    const unsigned char* xLow = reinterpret_cast<const unsigned char*>(planes + 3*sliceVoxelCount);
+    const unsigned char* yLow = reinterpret_cast<const unsigned char*>(planes + 4*sliceVoxelCount);
+    const unsigned char* zLow = reinterpret_cast<const unsigned char*>(planes + 5*sliceVoxelCount);
+    for (vtkIdType n=0; n<sliceVoxelCount; ++n)
+    {
+      vectors[3*n]   = static_cast<T>( -(xHigh[n] + minResolution * xLow[n]) );
+      vectors[3*n+1] = static_cast<T>( -(yHigh[n] + minResolution * yLow[n]) );
+      vectors[3*n+2] = static_cast<T>(   zHigh[n] + minResolution * zLow[n]  );
+    }
+  }
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerPinnacleDvfReader);
@@ -49,6 +76,7 @@ vtkSlicerPinnacleDvfReader::vtkSlicerPinnacleDvfReader()
   this->GridOrigin[0] = 0.0;
   this->GridOrigin[1] = 0.0;
   this->GridOrigin[2] = 0.0;
+  this->GridScalarType = VTK_FLOAT;
   this->PostDeformationRegistrationMatrix = vtkMatrix4x4::New();
   this->DeformableRegistrationGrid = vtkImageData::New();
   this->DeformableRegistrationGridOrientationMatrix = vtkMatrix4x4::New();
@@ -195,21 +223,16 @@ void vtkSlicerPinnacleDvfReader::LoadDeformableSpatialRegistration(char *fileNam
   readFileStream.read ((char *) &ySpacing, sizeof(double));
   readFileStream.read ((char *) &zSpacing, sizeof(double));
 
-  long voxelCount = dvfSizeX * dvfSizeY * dvfSizeZ;
-
-  signed char *xBufferHigh = new signed char[voxelCount];
-  signed char *yBufferHigh = new signed char[voxelCount];
-  signed char *zBufferHigh = new signed char[voxelCount];
-  unsigned char *xBufferLow = new unsigned char[voxelCount];
-  unsigned char *yBufferLow = new unsigned char[voxelCount];
-  unsigned char *zBufferLow = new unsigned char[voxelCount];
-
-  readFileStream.read ((char *) xBufferHigh, voxelCount);
-  readFileStream.read ((char *) yBufferHigh, voxelCount);
-  readFileStream.read ((char *) zBufferHigh, voxelCount);
-  readFileStream.read ((char *) xBufferLow, voxelCount);
-  readFileStream.read ((char *) yBufferLow, voxelCount);
-  readFileStream.read ((char *) zBufferLow, voxelCount);
+  if (readFileStream.fail() || dvfSizeX <= 0 || dvfSizeY <= 0 || dvfSizeZ <= 0)
+  {
+    vtkErrorMacro("LoadPinnacleDvf: Invalid DVF file header");
+    return;
+  }
+  if (this->GridScalarType != VTK_FLOAT && this->GridScalarType != VTK_DOUBLE)
+  {
+    vtkErrorMacro("LoadPinnacleDvf: Unsupported grid scalar type " << this->GridScalarType << ", only float and double are supported");
+    return;
+  }
 
   this->DeformableRegistrationGridOrientationMatrix->Identity();
   this->DeformableRegistrationGridOrientationMatrix->SetElement(0,0,-1);
@@ -220,54 +243,39 @@ void vtkSlicerPinnacleDvfReader::LoadDeformableSpatialRegistration(char *fileNam
   this->DeformableRegistrationGrid->SetOrigin(this->GridOrigin[0], this->GridOrigin[1], this->GridOrigin[2]);
   this->DeformableRegistrationGrid->SetSpacing(xSpacing, ySpacing, zSpacing);
   this->DeformableRegistrationGrid->SetExtent(0,dvfSizeX-1,0,dvfSizeY-1,0,dvfSizeZ-1);
-  this->DeformableRegistrationGrid->AllocateScalars(VTK_DOUBLE, 3);
-
-  int n = 0;
-  for (unsigned int k=0; k<dvfSizeZ; k++)
+  this->DeformableRegistrationGrid->AllocateScalars(this->GridScalarType, 3);
+
+  // The byte planes (each containing the whole volume) are stored one after the other.
+  // Read them slice by slice, so that only the byte planes of one slice are kept in memory,
+  // and decode them directly into the grid.
+  vtkIdType sliceVoxelCount = (vtkIdType)dvfSizeX * dvfSizeY;
+  vtkIdType voxelCount = sliceVoxelCount * dvfSizeZ;
+  std::streampos planesStartPosition = readFileStream.tellg();
+  std::vector<char> slicePlanes(NUMBER_OF_DVF_PLANES * sliceVoxelCount);
+  for (int k=0; k<dvfSizeZ; k++)
   {
-    for (unsigned int j=0; j<dvfSizeY; j++)
+    for (int plane=0; plane<NUMBER_OF_DVF_PLANES; ++plane)
     {
-      for (unsigned int i=0; i<dvfSizeX; i++)
+      readFileStream.seekg(planesStartPosition + (std::streamoff)(plane*voxelCount + k*sliceVoxelCount));
+      readFileStream.read(&(slicePlanes[plane*sliceVoxelCount]), sliceVoxelCount);
+      if (readFileStream.gcount() != sliceVoxelCount)
       {
-        n = i + j*dvfSizeX + k*dvfSizeX*dvfSizeY ;
-        this->DeformableRegistrationGrid->SetScalarComponentFromDouble(i,j,k,0, -1*(xBufferHigh[n] + (MIN_RESOLUTION * xBufferLow[n])) );
-        this->DeformableRegistrationGrid->SetScalarComponentFromDouble(i,j,k,1, -1*(yBufferHigh[n] + (MIN_RESOLUTION * yBufferLow[n])) );
-        this->DeformableRegistrationGrid->SetScalarComponentFromDouble(i,j,k,2,  1*(zBufferHigh[n] + (MIN_RESOLUTION * zBufferLow[n])) );
+        vtkErrorMacro("LoadPinnacleDvf: The end of the file was reached earlier than specified by the grid size");
+        return;
       }
     }
+
+    void* sliceVectors = this->DeformableRegistrationGrid->GetScalarPointer(0, 0, k);
+    if (this->GridScalarType == VTK_FLOAT)
+    {
+      DecodeDvfSlice(&(slicePlanes[0]), sliceVoxelCount, MIN_RESOLUTION, static_cast<float*>(sliceVectors));
+    }
+    else
+    {
+      DecodeDvfSlice(&(slicePlanes[0]), sliceVoxelCount, MIN_RESOLUTION, static_cast<double*>(sliceVectors));
+    }
   }
   readFileStream.close();
-  
-  if(xBufferHigh)
-  {
-      delete [] xBufferHigh;
-      xBufferHigh = NULL;
-  }
-  if(yBufferHigh)
-  {
-      delete [] yBufferHigh;
-      yBufferHigh = NULL;
-  }
-  if(zBufferHigh)
-  {
-      delete [] zBufferHigh;
-      zBufferHigh = NULL;
-  }
-  if(xBufferLow)
-  {
-      delete [] xBufferLow;
-      xBufferLow = NULL;
-  }
-  if(yBufferLow)
-  {
-      delete [] yBufferLow;
-      yBufferLow = NULL;
-  }
-  if(zBufferLow)
-  {
-      delete [] zBufferLow;
-      zBufferLow = NULL;
-  }
 
   this->LoadDeformableSpatialRegistrationSuccessful = true; 
 }
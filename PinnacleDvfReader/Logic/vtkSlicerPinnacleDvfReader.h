@@ -65,6 +65,10 @@ public:
   vtkSetVector3Macro(GridOrigin,double);
   vtkGetVector3Macro(GridOrigin,double);
 
+  /// Set scalar type of the deformable registration grid (VTK_FLOAT by default, or VTK_DOUBLE)
+  vtkSetMacro(GridScalarType,int);
+  vtkGetMacro(GridScalarType,int);
+
   /// Get load deformable spatial registration successful flag
   vtkGetMacro(LoadDeformableSpatialRegistrationSuccessful, bool);
 
@@ -78,6 +82,9 @@ protected:
   /// Deformation grid origin
   double GridOrigin[3];
 
+  /// Scalar type of the deformable registration grid
+  int GridScalarType;
+
   /// Post deformation registration matrix
   vtkMatrix4x4* PostDeformationRegistrationMatrix;
 
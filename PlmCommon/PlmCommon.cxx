@@ -40,29 +40,29 @@
 //----------------------------------------------------------------------------
 template<class T> 
 static typename itk::Image<T,3>::Pointer
-convert_to_itk (vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform)
+convert_to_itk (vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform, bool shareImageBuffer)
 {
   typename itk::Image<T,3>::Pointer image = itk::Image<T,3>::New ();
   SlicerRtCommon::ConvertVolumeNodeToItkImage<T>(
-    inVolumeNode, image, applyWorldTransform, true);
+    inVolumeNode, image, applyWorldTransform, true, shareImageBuffer);
   return image;
 }
 
 //----------------------------------------------------------------------------
 template<class T> 
 static typename itk::Image<T,3>::Pointer
-convert_to_itk (vtkOrientedImageData* inImageData)
+convert_to_itk (vtkOrientedImageData* inImageData, bool shareImageBuffer)
 {
   typename itk::Image<T,3>::Pointer image = itk::Image<T,3>::New ();
   SlicerRtCommon::ConvertVtkOrientedImageDataToItkImage<T>(
-    inImageData, image, true);
+    inImageData, image, true, shareImageBuffer);
   return image;
 }
 
 //----------------------------------------------------------------------------
 //----------------------------------------------------------------------------
 Plm_image::Pointer 
-PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform/* = true*/)
+PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform/* = true*/, bool shareImageBuffer/* = false*/)
 {
   Plm_image::Pointer image = Plm_image::New ();
 
@@ -78,49 +78,49 @@ PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bo
   switch (vtk_type) {
   case VTK_CHAR:
   case VTK_SIGNED_CHAR:
-    image->set_itk (convert_to_itk<char> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<char> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
   
   case VTK_UNSIGNED_CHAR:
-    image->set_itk (convert_to_itk<unsigned char> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<unsigned char> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
   
   case VTK_SHORT:
-    image->set_itk (convert_to_itk<short> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<short> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
   
   case VTK_UNSIGNED_SHORT:
-    image->set_itk (convert_to_itk<unsigned short> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<unsigned short> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
   
 #if (CMAKE_SIZEOF_UINT == 4)
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<int> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<int> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned int> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<unsigned int> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
 #else
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<long> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<long> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned long> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<unsigned long> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
 #endif
   
   case VTK_FLOAT:
-    image->set_itk (convert_to_itk<float> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<float> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
   
   case VTK_DOUBLE:
-    image->set_itk (convert_to_itk<double> (inVolumeNode, applyWorldTransform));
+    image->set_itk (convert_to_itk<double> (inVolumeNode, applyWorldTransform, shareImageBuffer));
     break;
 
   default:
@@ -133,15 +133,15 @@ PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bo
 
 //----------------------------------------------------------------------------
 Plm_image::Pointer 
-PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform/* = true*/)
+PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform/* = true*/, bool shareImageBuffer/* = false*/)
 {
   return PlmCommon::ConvertVolumeNodeToPlmImage(
-    vtkMRMLScalarVolumeNode::SafeDownCast(inNode), applyWorldTransform);
+    vtkMRMLScalarVolumeNode::SafeDownCast(inNode), applyWorldTransform, shareImageBuffer);
 }
 
 //----------------------------------------------------------------------------
 Plm_image::Pointer 
-PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData)
+PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData, bool shareImageBuffer/* = false*/)
 {
   Plm_image::Pointer image = Plm_image::New ();
 
@@ -156,49 +156,49 @@ PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageDa
   switch (vtk_type) {
   case VTK_CHAR:
   case VTK_SIGNED_CHAR:
-    image->set_itk (convert_to_itk<char> (inImageData));
+    image->set_itk (convert_to_itk<char> (inImageData, shareImageBuffer));
     break;
   
   case VTK_UNSIGNED_CHAR:
-    image->set_itk (convert_to_itk<unsigned char> (inImageData));
+    image->set_itk (convert_to_itk<unsigned char> (inImageData, shareImageBuffer));
     break;
   
   case VTK_SHORT:
-    image->set_itk (convert_to_itk<short> (inImageData));
+    image->set_itk (convert_to_itk<short> (inImageData, shareImageBuffer));
     break;
   
   case VTK_UNSIGNED_SHORT:
-    image->set_itk (convert_to_itk<unsigned short> (inImageData));
+    image->set_itk (convert_to_itk<unsigned short> (inImageData, shareImageBuffer));
     break;
   
 #if (CMAKE_SIZEOF_UINT == 4)
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<int> (inImageData));
+    image->set_itk (convert_to_itk<int> (inImageData, shareImageBuffer));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned int> (inImageData));
+    image->set_itk (convert_to_itk<unsigned int> (inImageData, shareImageBuffer));
     break;
 #else
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<long> (inImageData));
+    image->set_itk (convert_to_itk<long> (inImageData, shareImageBuffer));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned long> (inImageData));
+    image->set_itk (convert_to_itk<unsigned long> (inImageData, shareImageBuffer));
     break;
 #endif
   
   case VTK_FLOAT:
-    image->set_itk (convert_to_itk<float> (inImageData));
+    image->set_itk (convert_to_itk<float> (inImageData, shareImageBuffer));
     break;
   
   case VTK_DOUBLE:
-    image->set_itk (convert_to_itk<double> (inImageData));
+    image->set_itk (convert_to_itk<double> (inImageData, shareImageBuffer));
     break;
 
   default:
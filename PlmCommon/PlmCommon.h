@@ -48,15 +48,21 @@ public:
   /// Convert MRML volume node to Plm image using typed scalar volume node
   /// \param inVolumeNode Scalar volume node to convert
   /// \param applyWorldTransform Flag determining if parent transform is applied to volume node when converting to Plm image. True by default
-  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform = true);
+  /// \param shareImageBuffer Flag determining if the Plm image uses the voxel buffer of the volume node instead of a copy.
+  ///   Only for read-only use of the Plm image while the volume is not modified. False by default
+  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform = true, bool shareImageBuffer = false);
 
   /// Convert MRML volume node to Plm image using generic MRML node type
   /// \param inNode Node to convert (must be scalar volume node type)
   /// \param applyWorldTransform Flag determining if parent transform is applied to volume node when converting to Plm image. True by default
-  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform = true);
+  /// \param shareImageBuffer Flag determining if the Plm image uses the voxel buffer of the volume node instead of a copy. False by default
+  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform = true, bool shareImageBuffer = false);
 
   /// Convert VTK oriented image data to Plm image
-  static Plm_image::Pointer ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData);
+  /// \param inImageData Image data to convert
+  /// \param shareImageBuffer Flag determining if the Plm image uses the voxel buffer of the image data instead of a copy.
+  ///   Only for read-only use of the Plm image while the image data is not modified. False by default
+  static Plm_image::Pointer ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData, bool shareImageBuffer = false);
 };
 
 #endif
@@ -66,6 +66,8 @@ vtkMRMLSegmentComparisonNode::vtkMRMLSegmentComparisonNode()
   this->AverageHausdorffDistanceForBoundaryMm = -1.0;
   this->Percent95HausdorffDistanceForVolumeMm = -1.0;
   this->Percent95HausdorffDistanceForBoundaryMm = -1.0;
+  this->SurfaceDiceToleranceMm = 1.0;
+  this->SurfaceDice = -1.0;
   this->HausdorffResultsValidOff();
 
   this->HideFromEditors = false;
@@ -127,6 +129,8 @@ void vtkMRMLSegmentComparisonNode::WriteXML(ostream& of, int nIndent)
   of << indent << " AverageHausdorffDistanceForBoundaryMm=\"" << this->AverageHausdorffDistanceForBoundaryMm << "\"";
   of << indent << " Percent95HausdorffDistanceForVolumeMm=\"" << this->Percent95HausdorffDistanceForVolumeMm << "\"";
   of << indent << " Percent95HausdorffDistanceForBoundaryMm=\"" << this->Percent95HausdorffDistanceForBoundaryMm << "\"";
+  of << indent << " SurfaceDiceToleranceMm=\"" << this->SurfaceDiceToleranceMm << "\"";
+  of << indent << " SurfaceDice=\"" << this->SurfaceDice << "\"";
 
   of << indent << " HausdorffResultsValid=\"" << (this->HausdorffResultsValid ? "true" : "false") << "\"";
 }
@@ -335,6 +339,22 @@ void vtkMRMLSegmentComparisonNode::ReadXMLAttributes(const char** atts)
       ss >> doubleAttValue;
       this->Percent95HausdorffDistanceForBoundaryMm = doubleAttValue;
     }
+    else if (!strcmp(attName, "SurfaceDiceToleranceMm")) 
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double doubleAttValue;
+      ss >> doubleAttValue;
+      this->SurfaceDiceToleranceMm = doubleAttValue;
+    }
+    else if (!strcmp(attName, "SurfaceDice")) 
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double doubleAttValue;
+      ss >> doubleAttValue;
+      this->SurfaceDice = doubleAttValue;
+    }
     else if (!strcmp(attName, "HausdorffResultsValid")) 
       {
       this->HausdorffResultsValid = (strcmp(attValue,"true") ? false : true);
@@ -370,6 +390,8 @@ void vtkMRMLSegmentComparisonNode::Copy(vtkMRMLNode *anode)
   this->AverageHausdorffDistanceForBoundaryMm = node->AverageHausdorffDistanceForBoundaryMm;
   this->Percent95HausdorffDistanceForVolumeMm = node->Percent95HausdorffDistanceForVolumeMm;
   this->Percent95HausdorffDistanceForBoundaryMm = node->Percent95HausdorffDistanceForBoundaryMm;
+  this->SurfaceDiceToleranceMm = node->SurfaceDiceToleranceMm;
+  this->SurfaceDice = node->SurfaceDice;
   this->HausdorffResultsValid = node->HausdorffResultsValid;
 
   this->DisableModifiedEventOff();
@@ -422,6 +444,8 @@ void vtkMRMLSegmentComparisonNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << " AverageHausdorffDistanceForBoundaryMm:   " << this->AverageHausdorffDistanceForBoundaryMm << "\n";
   os << indent << " Percent95HausdorffDistanceForVolumeMm:   " << this->Percent95HausdorffDistanceForVolumeMm << "\n";
   os << indent << " Percent95HausdorffDistanceForBoundaryMm:   " << this->Percent95HausdorffDistanceForBoundaryMm << "\n";
+  os << indent << " SurfaceDiceToleranceMm:   " << this->SurfaceDiceToleranceMm << "\n";
+  os << indent << " SurfaceDice:   " << this->SurfaceDice << "\n";
 
   os << indent << " HausdorffResultsValid:   " << (this->HausdorffResultsValid ? "true" : "false") << "\n";
 }
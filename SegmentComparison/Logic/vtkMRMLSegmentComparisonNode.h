@@ -159,6 +159,16 @@ public:
   /// Set 95% Hausdorff distance for the boundary voxels
   vtkSetMacro(Percent95HausdorffDistanceForBoundaryMm, double);
 
+  /// Get distance tolerance used for computing surface Dice
+  vtkGetMacro(SurfaceDiceToleranceMm, double);
+  /// Set distance tolerance used for computing surface Dice
+  vtkSetMacro(SurfaceDiceToleranceMm, double);
+
+  /// Get surface Dice
+  vtkGetMacro(SurfaceDice, double);
+  /// Set surface Dice
+  vtkSetMacro(SurfaceDice, double);
+
   /// Get/Set results Hausdorff valid flag
   vtkGetMacro(HausdorffResultsValid, bool);
   vtkSetMacro(HausdorffResultsValid, bool);
@@ -225,6 +235,12 @@ protected:
   /// 95% Hausdorff distance for the boundary voxels
   double Percent95HausdorffDistanceForBoundaryMm;
 
+  /// Boundary voxels closer than this distance to the boundary of the other structure are considered matching for surface Dice
+  double SurfaceDiceToleranceMm;
+
+  /// Fraction of boundary voxels of both structures that are within tolerance distance from the boundary of the other
+  double SurfaceDice;
+
   /// Flag telling whether the Hausdorff results are valid
   bool HausdorffResultsValid;
 };
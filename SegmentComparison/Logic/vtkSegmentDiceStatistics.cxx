@@ -0,0 +1,310 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkSegmentDiceStatistics.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSegmentDiceStatistics);
+vtkCxxSetObjectMacro(vtkSegmentDiceStatistics, ReferenceLabelmap, vtkOrientedImageData);
+vtkCxxSetObjectMacro(vtkSegmentDiceStatistics, CompareLabelmap, vtkOrientedImageData);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  const int BITS_PER_WORD = 64;
+
+  /// Get 64-bit word from its upper and lower 32 bits
+  inline vtkTypeUInt64 MakeWord(vtkTypeUInt32 upper, vtkTypeUInt32 lower)
+  {
+    return (static_cast<vtkTypeUInt64>(upper) << 32) | lower;
+  }
+
+  /// Number of set bits of a word
+  inline vtkIdType CountBits(vtkTypeUInt64 word)
+  {
+    word = word - ((word >> 1) & MakeWord(0x55555555, 0x55555555));
+    word = (word & MakeWord(0x33333333, 0x33333333)) + ((word >> 2) & MakeWord(0x33333333, 0x33333333));
+    word = (word + (word >> 4)) & MakeWord(0x0F0F0F0F, 0x0F0F0F0F);
+    return static_cast<vtkIdType>((word * MakeWord(0x01010101, 0x01010101)) >> 56);
+  }
+
+  /// Sum of the positions of the set bits of a word. Each bit of the position is counted separately
+  /// using the mask of the positions that have that bit set.
+  inline vtkIdType SumBitPositions(vtkTypeUInt64 word)
+  {
+    return CountBits(word & MakeWord(0xAAAAAAAA, 0xAAAAAAAA))
+      + 2 * CountBits(word & MakeWord(0xCCCCCCCC, 0xCCCCCCCC))
+      + 4 * CountBits(word & MakeWord(0xF0F0F0F0, 0xF0F0F0F0))
+      + 8 * CountBits(word & MakeWord(0xFF00FF00, 0xFF00FF00))
+      + 16 * CountBits(word & MakeWord(0xFFFF0000, 0xFFFF0000))
+      + 32 * CountBits(word & MakeWord(0xFFFFFFFF, 0x00000000));
+  }
+
+  /// Voxel count and sum of voxel coordinates of a segment, for computing the center of mass
+  struct SegmentMoments
+  {
+    SegmentMoments() : NumberOfVoxels(0) { this->Sums[0] = this->Sums[1] = this->Sums[2] = 0.0; };
+    void AddWord(vtkTypeUInt64 word, int firstI, int j, int k)
+    {
+      vtkIdType count = CountBits(word);
+      if (count == 0)
+      {
+        return;
+      }
+      this->NumberOfVoxels += count;
+      this->Sums[0] += (double)count * firstI + SumBitPositions(word);
+      this->Sums[1] += (double)count * j;
+      this->Sums[2] += (double)count * k;
+    }
+    vtkIdType NumberOfVoxels;
+    double Sums[3];
+  };
+
+  /// Pack the voxels of a box into bit words: one bit per voxel, set if the voxel is non-zero.
+  /// Each row of the box starts a new word. The box may exceed the image extent.
+  template <class T>
+  void PackBox(T* scalarPointer, vtkImageData* image, const int boxExtent[6], int wordsPerRow, std::vector<vtkTypeUInt64>& words)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    image->GetExtent(extent);
+    vtkIdType increments[3] = {0,0,0};
+    image->GetIncrements(increments);
+    int rowsPerSlice = boxExtent[3] - boxExtent[2] + 1;
+
+    int commonExtent[6] = {0,-1,0,-1,0,-1};
+    for (int axis=0; axis<3; ++axis)
+    {
+      commonExtent[2*axis] = std::max(extent[2*axis], boxExtent[2*axis]);
+      commonExtent[2*axis+1] = std::min(extent[2*axis+1], boxExtent[2*axis+1]);
+    }
+    for (int k=commonExtent[4]; k<=commonExtent[5]; ++k)
+    {
+      for (int j=commonExtent[2]; j<=commonExtent[3]; ++j)
+      {
+        T* row = scalarPointer + (k-extent[4])*increments[2] + (j-extent[2])*increments[1] + (commonExtent[0]-extent[0])*increments[0];
+        vtkTypeUInt64* rowWords = &(words[((vtkIdType)(k-boxExtent[4])*rowsPerSlice + (j-boxExtent[2])) * wordsPerRow]);
+        for (int i=commonExtent[0]; i<=commonExtent[1]; ++i, row+=increments[0])
+        {
+          int bitIndex = i - boxExtent[0];
+          rowWords[bitIndex / BITS_PER_WORD] |= static_cast<vtkTypeUInt64>(*row != 0) << (bitIndex % BITS_PER_WORD);
+        }
+      }
+    }
+  }
+
+  /// Convert center of mass from IJK to world coordinates
+  void GetCenterInWorld(const SegmentMoments& moments, vtkMatrix4x4* imageToWorldMatrix, double center[3])
+  {
+    center[0] = center[1] = center[2] = 0.0;
+    if (moments.NumberOfVoxels == 0)
+    {
+      return;
+    }
+    double centerIjk[4] = { moments.Sums[0] / moments.NumberOfVoxels, moments.Sums[1] / moments.NumberOfVoxels,
+      moments.Sums[2] / moments.NumberOfVoxels, 1.0 };
+    double centerWorld[4] = {0.0, 0.0, 0.0, 1.0};
+    imageToWorldMatrix->MultiplyPoint(centerIjk, centerWorld);
+    std::copy(centerWorld, centerWorld+3, center);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentDiceStatistics::vtkSegmentDiceStatistics()
+{
+  this->ReferenceLabelmap = NULL;
+  this->CompareLabelmap = NULL;
+
+  this->DiceCoefficient = -1.0;
+  this->NumberOfTruePositives = 0;
+  this->NumberOfTrueNegatives = 0;
+  this->NumberOfFalsePositives = 0;
+  this->NumberOfFalseNegatives = 0;
+  this->ReferenceCenter[0] = this->ReferenceCenter[1] = this->ReferenceCenter[2] = 0.0;
+  this->CompareCenter[0] = this->CompareCenter[1] = this->CompareCenter[2] = 0.0;
+  this->ReferenceVolumeCc = -1.0;
+  this->CompareVolumeCc = -1.0;
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentDiceStatistics::~vtkSegmentDiceStatistics()
+{
+  this->SetReferenceLabelmap(NULL);
+  this->SetCompareLabelmap(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentDiceStatistics::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "DiceCoefficient: " << this->DiceCoefficient << "\n";
+  os << indent << "NumberOfTruePositives: " << this->NumberOfTruePositives << "\n";
+  os << indent << "NumberOfTrueNegatives: " << this->NumberOfTrueNegatives << "\n";
+  os << indent << "NumberOfFalsePositives: " << this->NumberOfFalsePositives << "\n";
+  os << indent << "NumberOfFalseNegatives: " << this->NumberOfFalseNegatives << "\n";
+  os << indent << "ReferenceCenter: " << this->ReferenceCenter[0] << ", " << this->ReferenceCenter[1] << ", " << this->ReferenceCenter[2] << "\n";
+  os << indent << "CompareCenter: " << this->CompareCenter[0] << ", " << this->CompareCenter[1] << ", " << this->CompareCenter[2] << "\n";
+  os << indent << "ReferenceVolumeCc: " << this->ReferenceVolumeCc << "\n";
+  os << indent << "CompareVolumeCc: " << this->CompareVolumeCc << "\n";
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSegmentDiceStatistics::GetNumberOfVoxels()
+{
+  return this->NumberOfTruePositives + this->NumberOfTrueNegatives + this->NumberOfFalsePositives + this->NumberOfFalseNegatives;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentDiceStatistics::Compute()
+{
+  std::string errorMessage = this->ComputeWithoutLogging();
+  if (!errorMessage.empty())
+  {
+    vtkErrorMacro("Compute: " << errorMessage);
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkSegmentDiceStatistics::ComputeWithoutLogging()
+{
+  this->DiceCoefficient = -1.0;
+  this->NumberOfTruePositives = this->NumberOfTrueNegatives = this->NumberOfFalsePositives = this->NumberOfFalseNegatives = 0;
+  this->ReferenceCenter[0] = this->ReferenceCenter[1] = this->ReferenceCenter[2] = 0.0;
+  this->CompareCenter[0] = this->CompareCenter[1] = this->CompareCenter[2] = 0.0;
+  this->ReferenceVolumeCc = this->CompareVolumeCc = -1.0;
+
+  if ( !this->ReferenceLabelmap || !this->ReferenceLabelmap->GetPointData()->GetScalars()
+    || !this->CompareLabelmap || !this->CompareLabelmap->GetPointData()->GetScalars() )
+  {
+    return "Invalid input labelmaps";
+  }
+
+  // Sample compare labelmap on the reference lattice
+  vtkSmartPointer<vtkOrientedImageData> compareLabelmap = this->CompareLabelmap;
+  if (!vtkOrientedImageDataResample::DoGeometriesMatch(this->ReferenceLabelmap, this->CompareLabelmap))
+  {
+    compareLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      this->CompareLabelmap, this->ReferenceLabelmap, compareLabelmap, false, true))
+    {
+      return "Failed to resample compare labelmap to the reference lattice";
+    }
+  }
+
+  // Voxels outside the union of the bounding boxes are all true negatives, so only the union
+  // (within the reference extent) needs to be visited
+  int referenceImageExtent[6] = {0,-1,0,-1,0,-1};
+  this->ReferenceLabelmap->GetExtent(referenceImageExtent);
+  vtkIdType numberOfVoxels = 1;
+  for (int axis=0; axis<3; ++axis)
+  {
+    numberOfVoxels *= std::max(0, referenceImageExtent[2*axis+1] - referenceImageExtent[2*axis] + 1);
+  }
+
+  int referenceExtent[6] = {0,-1,0,-1,0,-1};
+  int compareExtent[6] = {0,-1,0,-1,0,-1};
+  bool referenceEmpty = !vtkOrientedImageDataResample::CalculateEffectiveExtent(this->ReferenceLabelmap, referenceExtent);
+  bool compareEmpty = !vtkOrientedImageDataResample::CalculateEffectiveExtent(compareLabelmap, compareExtent);
+  int boxExtent[6] = {0,-1,0,-1,0,-1};
+  bool boxEmpty = (referenceEmpty && compareEmpty);
+  for (int axis=0; axis<3 && !boxEmpty; ++axis)
+  {
+    boxExtent[2*axis] = std::min(referenceEmpty ? VTK_INT_MAX : referenceExtent[2*axis], compareEmpty ? VTK_INT_MAX : compareExtent[2*axis]);
+    boxExtent[2*axis+1] = std::max(referenceEmpty ? VTK_INT_MIN : referenceExtent[2*axis+1], compareEmpty ? VTK_INT_MIN : compareExtent[2*axis+1]);
+    boxExtent[2*axis] = std::max(boxExtent[2*axis], referenceImageExtent[2*axis]);
+    boxExtent[2*axis+1] = std::min(boxExtent[2*axis+1], referenceImageExtent[2*axis+1]);
+    boxEmpty = (boxExtent[2*axis] > boxExtent[2*axis+1]);
+  }
+
+  SegmentMoments referenceMoments;
+  SegmentMoments compareMoments;
+  if (!boxEmpty)
+  {
+    int wordsPerRow = (boxExtent[1] - boxExtent[0] + BITS_PER_WORD) / BITS_PER_WORD;
+    int rowsPerSlice = boxExtent[3] - boxExtent[2] + 1;
+    vtkIdType numberOfWords = (vtkIdType)wordsPerRow * rowsPerSlice * (boxExtent[5] - boxExtent[4] + 1);
+    std::vector<vtkTypeUInt64> referenceWords(numberOfWords, 0);
+    std::vector<vtkTypeUInt64> compareWords(numberOfWords, 0);
+    switch (this->ReferenceLabelmap->GetScalarType())
+    {
+      vtkTemplateMacro(PackBox(static_cast<VTK_TT*>(this->ReferenceLabelmap->GetScalarPointer()), this->ReferenceLabelmap, boxExtent, wordsPerRow, referenceWords));
+    }
+    switch (compareLabelmap->GetScalarType())
+    {
+      vtkTemplateMacro(PackBox(static_cast<VTK_TT*>(compareLabelmap->GetScalarPointer()), compareLabelmap, boxExtent, wordsPerRow, compareWords));
+    }
+
+    vtkIdType wordIndex = 0;
+    for (int k=boxExtent[4]; k<=boxExtent[5]; ++k)
+    {
+      for (int j=boxExtent[2]; j<=boxExtent[3]; ++j)
+      {
+        for (int word=0; word<wordsPerRow; ++word, ++wordIndex)
+        {
+          vtkTypeUInt64 referenceWord = referenceWords[wordIndex];
+          vtkTypeUInt64 compareWord = compareWords[wordIndex];
+          if (!(referenceWord | compareWord))
+          {
+            continue;
+          }
+          this->NumberOfTruePositives += CountBits(referenceWord & compareWord);
+          this->NumberOfFalsePositives += CountBits(compareWord & ~referenceWord);
+          this->NumberOfFalseNegatives += CountBits(referenceWord & ~compareWord);
+          int firstI = boxExtent[0] + word * BITS_PER_WORD;
+          referenceMoments.AddWord(referenceWord, firstI, j, k);
+          compareMoments.AddWord(compareWord, firstI, j, k);
+        }
+      }
+    }
+  }
+  this->NumberOfTrueNegatives = numberOfVoxels - this->NumberOfTruePositives - this->NumberOfFalsePositives - this->NumberOfFalseNegatives;
+
+  vtkIdType denominator = 2 * this->NumberOfTruePositives + this->NumberOfFalsePositives + this->NumberOfFalseNegatives;
+  this->DiceCoefficient = (denominator > 0 ? 2.0 * this->NumberOfTruePositives / denominator : 0.0);
+
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->ReferenceLabelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+  GetCenterInWorld(referenceMoments, imageToWorldMatrix, this->ReferenceCenter);
+  GetCenterInWorld(compareMoments, imageToWorldMatrix, this->CompareCenter);
+
+  double spacing[3] = {1.0, 1.0, 1.0};
+  this->ReferenceLabelmap->GetSpacing(spacing);
+  double voxelVolumeCc = spacing[0] * spacing[1] * spacing[2] / 1000.0;
+  this->ReferenceVolumeCc = referenceMoments.NumberOfVoxels * voxelVolumeCc;
+  this->CompareVolumeCc = compareMoments.NumberOfVoxels * voxelVolumeCc;
+
+  return "";
+}
@@ -0,0 +1,108 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkSegmentDiceStatistics - Dice similarity statistics of two segment labelmaps
+// .SECTION Description
+// Computes the voxel overlap statistics of two binary labelmaps (non-zero voxels belong to the
+// segment) directly on the oriented image data. The compare labelmap is sampled on the lattice of the
+// reference labelmap, and the statistics are computed within the extent of the reference labelmap.
+//
+// Only the union of the bounding boxes of the non-zero voxels is visited. The rows of both labelmaps
+// are packed into bit words, and the voxel counts and center of mass sums are computed from the words
+// with bit counting. True negatives are all the other voxels of the reference extent.
+
+#ifndef __vtkSegmentDiceStatistics_h
+#define __vtkSegmentDiceStatistics_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <string>
+
+#include "vtkSlicerSegmentComparisonModuleLogicExport.h"
+
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_SegmentComparison
+class VTK_SLICER_SEGMENTCOMPARISON_MODULE_LOGIC_EXPORT vtkSegmentDiceStatistics : public vtkObject
+{
+public:
+  static vtkSegmentDiceStatistics *New();
+  vtkTypeMacro(vtkSegmentDiceStatistics, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Compute the statistics from the input labelmaps
+  /// \return Success
+  bool Compute();
+
+  /// Compute the statistics without logging errors, so that it can be called from worker threads.
+  /// Inputs of different geometry are resampled first, which may log errors.
+  /// \return Error message, empty string if no error
+  std::string ComputeWithoutLogging();
+
+public:
+  /// Set reference segment labelmap. The statistics are computed on its lattice and within its extent
+  void SetReferenceLabelmap(vtkOrientedImageData* labelmap);
+  vtkGetObjectMacro(ReferenceLabelmap, vtkOrientedImageData);
+
+  /// Set compare segment labelmap. It is resampled to the reference lattice if its geometry differs
+  void SetCompareLabelmap(vtkOrientedImageData* labelmap);
+  vtkGetObjectMacro(CompareLabelmap, vtkOrientedImageData);
+
+public:
+  vtkGetMacro(DiceCoefficient, double);
+  vtkGetMacro(NumberOfTruePositives, vtkIdType);
+  vtkGetMacro(NumberOfTrueNegatives, vtkIdType);
+  vtkGetMacro(NumberOfFalsePositives, vtkIdType);
+  vtkGetMacro(NumberOfFalseNegatives, vtkIdType);
+  /// Get total number of voxels in the reference extent
+  vtkIdType GetNumberOfVoxels();
+  /// Center of mass of the reference segment in world (RAS) coordinates
+  vtkGetVector3Macro(ReferenceCenter, double);
+  /// Center of mass of the compare segment in world (RAS) coordinates
+  vtkGetVector3Macro(CompareCenter, double);
+  vtkGetMacro(ReferenceVolumeCc, double);
+  vtkGetMacro(CompareVolumeCc, double);
+
+protected:
+  vtkOrientedImageData* ReferenceLabelmap;
+  vtkOrientedImageData* CompareLabelmap;
+
+  double DiceCoefficient;
+  vtkIdType NumberOfTruePositives;
+  vtkIdType NumberOfTrueNegatives;
+  vtkIdType NumberOfFalsePositives;
+  vtkIdType NumberOfFalseNegatives;
+  double ReferenceCenter[3];
+  double CompareCenter[3];
+  double ReferenceVolumeCc;
+  double CompareVolumeCc;
+
+protected:
+  vtkSegmentDiceStatistics();
+  virtual ~vtkSegmentDiceStatistics();
+
+private:
+  vtkSegmentDiceStatistics(const vtkSegmentDiceStatistics&); // Not implemented
+  void operator=(const vtkSegmentDiceStatistics&);           // Not implemented
+};
+
+#endif
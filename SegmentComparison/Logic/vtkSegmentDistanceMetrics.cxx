@@ -0,0 +1,378 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkSegmentDistanceMetrics.h"
+
+// SlicerRT includes
+#include "vtkLabelmapDistanceTransform.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSegmentDistanceMetrics);
+vtkCxxSetObjectMacro(vtkSegmentDistanceMetrics, ReferenceLabelmap, vtkOrientedImageData);
+vtkCxxSetObjectMacro(vtkSegmentDistanceMetrics, CompareLabelmap, vtkOrientedImageData);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Metrics of the distances from the voxels of one segment to the other segment
+  struct DirectedDistances
+  {
+    double MaximumForVolume;
+    double AverageForVolume;
+    double Percent95ForVolume;
+    double MaximumForBoundary;
+    double AverageForBoundary;
+    double Percent95ForBoundary;
+    vtkIdType NumberOfBoundaryVoxels;
+    vtkIdType NumberOfBoundaryVoxelsWithinTolerance;
+  };
+
+  /// Get the image indices along an axis of the grid that covers two index ranges. If the ranges are apart
+  /// then the indices between them are left out, so each range is contiguous on the grid.
+  void GetGridIndices(int start1, int end1, int start2, int end2, std::vector<int>& gridIndices)
+  {
+    if (start2 < start1)
+    {
+      std::swap(start1, start2);
+      std::swap(end1, end2);
+    }
+    gridIndices.clear();
+    if (start2 <= end1 + 1)
+    {
+      end1 = std::max(end1, end2);
+      start2 = end1 + 1;
+    }
+    for (int index=start1; index<=end1; ++index)
+    {
+      gridIndices.push_back(index);
+    }
+    for (int index=start2; index<=end2; ++index)
+    {
+      gridIndices.push_back(index);
+    }
+  }
+
+  /// Fill the mask of a segment on the grid. The box must be one of the ranges of the grid along each axis.
+  void FillGridMask(vtkOrientedImageData* labelmap, const int boxExtent[6], const std::vector<int> gridIndices[3],
+    std::vector<unsigned char>& mask)
+  {
+    int gridDimensions[3] = { (int)gridIndices[0].size(), (int)gridIndices[1].size(), (int)gridIndices[2].size() };
+    int boxDimensions[3] = { boxExtent[1]-boxExtent[0]+1, boxExtent[3]-boxExtent[2]+1, boxExtent[5]-boxExtent[4]+1 };
+    int boxOffset[3] = {0,0,0};
+    for (int axis=0; axis<3; ++axis)
+    {
+      boxOffset[axis] = (int)(std::lower_bound(gridIndices[axis].begin(), gridIndices[axis].end(), boxExtent[2*axis]) - gridIndices[axis].begin());
+    }
+
+    std::vector<unsigned char> boxMask((size_t)boxDimensions[0]*boxDimensions[1]*boxDimensions[2]);
+    vtkOrientedImageDataResample::FillMaskFromImage(labelmap, boxExtent, &(boxMask[0]));
+    mask.assign((size_t)gridDimensions[0]*gridDimensions[1]*gridDimensions[2], 0);
+    for (int k=0; k<boxDimensions[2]; ++k)
+    {
+      for (int j=0; j<boxDimensions[1]; ++j)
+      {
+        std::vector<unsigned char>::iterator boxRow = boxMask.begin() + ((vtkIdType)k*boxDimensions[1] + j)*boxDimensions[0];
+        vtkIdType gridRowIndex = ((vtkIdType)(k+boxOffset[2])*gridDimensions[1] + (j+boxOffset[1]))*gridDimensions[0] + boxOffset[0];
+        std::copy(boxRow, boxRow + boxDimensions[0], mask.begin() + gridRowIndex);
+      }
+    }
+  }
+
+  /// Get the boundary voxels of a mask: mask voxels that have a neighbor outside the mask.
+  /// Mask voxels must not be on the border of the grid.
+  /// \param fullyConnected If true then all 26 neighbors are considered, otherwise only the 6 face neighbors
+  void ComputeBoundaryMask(const std::vector<unsigned char>& mask, const int dimensions[3], bool fullyConnected, std::vector<unsigned char>& boundary)
+  {
+    vtkIdType increments[3] = { 1, dimensions[0], (vtkIdType)dimensions[0]*dimensions[1] };
+    std::vector<vtkIdType> neighborOffsets;
+    for (int dk=-1; dk<=1; ++dk)
+    {
+      for (int dj=-1; dj<=1; ++dj)
+      {
+        for (int di=-1; di<=1; ++di)
+        {
+          int numberOfNonZeroOffsets = (di != 0) + (dj != 0) + (dk != 0);
+          if (numberOfNonZeroOffsets == 1 || (fullyConnected && numberOfNonZeroOffsets > 1))
+          {
+            neighborOffsets.push_back(dk*increments[2] + dj*increments[1] + di);
+          }
+        }
+      }
+    }
+
+    boundary.assign(mask.size(), 0);
+    for (int k=1; k<dimensions[2]-1; ++k)
+    {
+      for (int j=1; j<dimensions[1]-1; ++j)
+      {
+        vtkIdType index = k*increments[2] + j*increments[1] + 1;
+        for (int i=1; i<dimensions[0]-1; ++i, ++index)
+        {
+          if (!mask[index])
+          {
+            continue;
+          }
+          for (std::vector<vtkIdType>::iterator offsetIt = neighborOffsets.begin(); offsetIt != neighborOffsets.end(); ++offsetIt)
+          {
+            if (!mask[index + (*offsetIt)])
+            {
+              boundary[index] = 1;
+              break;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /// Compute maximum, average and 95th percentile of distances. The order of the distances is changed
+  void ComputeDistanceStatistics(std::vector<float>& distances, double& maximum, double& average, double& percent95)
+  {
+    maximum = average = percent95 = 0.0;
+    if (distances.empty())
+    {
+      return;
+    }
+    double sum = 0.0;
+    for (std::vector<float>::iterator distanceIt = distances.begin(); distanceIt != distances.end(); ++distanceIt)
+    {
+      sum += (*distanceIt);
+      maximum = std::max(maximum, (double)(*distanceIt));
+    }
+    average = sum / distances.size();
+
+    size_t ordinal = std::min(distances.size()-1, (size_t)floor(0.95 * distances.size()));
+    std::nth_element(distances.begin(), distances.begin()+ordinal, distances.end());
+    percent95 = distances[ordinal];
+  }
+
+  /// Compute distances from the voxels of a segment to another segment.
+  /// \param positions Positions of the grid voxels along each axis in millimeters
+  /// \param squaredDistances Working buffer with the size of the masks
+  void ComputeDirectedDistances(const std::vector<unsigned char>& mask, const std::vector<unsigned char>& boundary,
+    const std::vector<unsigned char>& otherMask, const std::vector<unsigned char>& otherContour,
+    const int dimensions[3], const double* const positions[3], double toleranceMm, int numberOfThreads,
+    std::vector<float>& squaredDistances, DirectedDistances& result)
+  {
+    vtkIdType numberOfVoxels = (vtkIdType)mask.size();
+    std::vector<float> distances;
+
+    // Distance of each segment voxel to the nearest voxel of the other segment
+    vtkLabelmapDistanceTransform::ComputeSquaredDistancesAtPositions(&(otherMask[0]), dimensions, positions, &(squaredDistances[0]), numberOfThreads);
+    for (vtkIdType index=0; index<numberOfVoxels; ++index)
+    {
+      if (mask[index])
+      {
+        distances.push_back(sqrt(squaredDistances[index]));
+      }
+    }
+    ComputeDistanceStatistics(distances, result.MaximumForVolume, result.AverageForVolume, result.Percent95ForVolume);
+
+    // Distance of each boundary voxel to the nearest contour voxel of the other segment. Outside the other
+    // segment it is the same as the distance to the nearest voxel of the other segment
+    distances.clear();
+    result.NumberOfBoundaryVoxelsWithinTolerance = 0;
+    vtkLabelmapDistanceTransform::ComputeSquaredDistancesAtPositions(&(otherContour[0]), dimensions, positions, &(squaredDistances[0]), numberOfThreads);
+    for (vtkIdType index=0; index<numberOfVoxels; ++index)
+    {
+      if (boundary[index])
+      {
+        float distance = sqrt(squaredDistances[index]);
+        distances.push_back(distance);
+        if (distance <= toleranceMm)
+        {
+          ++result.NumberOfBoundaryVoxelsWithinTolerance;
+        }
+      }
+    }
+    result.NumberOfBoundaryVoxels = (vtkIdType)distances.size();
+    ComputeDistanceStatistics(distances, result.MaximumForBoundary, result.AverageForBoundary, result.Percent95ForBoundary);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentDistanceMetrics::vtkSegmentDistanceMetrics()
+{
+  this->ReferenceLabelmap = NULL;
+  this->CompareLabelmap = NULL;
+  this->SurfaceDiceToleranceMm = 1.0;
+  this->NumberOfThreads = 0;
+
+  this->MaximumHausdorffDistanceForVolumeMm = -1.0;
+  this->MaximumHausdorffDistanceForBoundaryMm = -1.0;
+  this->AverageHausdorffDistanceForVolumeMm = -1.0;
+  this->AverageHausdorffDistanceForBoundaryMm = -1.0;
+  this->Percent95HausdorffDistanceForVolumeMm = -1.0;
+  this->Percent95HausdorffDistanceForBoundaryMm = -1.0;
+  this->SurfaceDice = -1.0;
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentDistanceMetrics::~vtkSegmentDistanceMetrics()
+{
+  this->SetReferenceLabelmap(NULL);
+  this->SetCompareLabelmap(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentDistanceMetrics::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "SurfaceDiceToleranceMm: " << this->SurfaceDiceToleranceMm << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "MaximumHausdorffDistanceForVolumeMm: " << this->MaximumHausdorffDistanceForVolumeMm << "\n";
+  os << indent << "MaximumHausdorffDistanceForBoundaryMm: " << this->MaximumHausdorffDistanceForBoundaryMm << "\n";
+  os << indent << "AverageHausdorffDistanceForVolumeMm: " << this->AverageHausdorffDistanceForVolumeMm << "\n";
+  os << indent << "AverageHausdorffDistanceForBoundaryMm: " << this->AverageHausdorffDistanceForBoundaryMm << "\n";
+  os << indent << "Percent95HausdorffDistanceForVolumeMm: " << this->Percent95HausdorffDistanceForVolumeMm << "\n";
+  os << indent << "Percent95HausdorffDistanceForBoundaryMm: " << this->Percent95HausdorffDistanceForBoundaryMm << "\n";
+  os << indent << "SurfaceDice: " << this->SurfaceDice << "\n";
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentDistanceMetrics::Compute()
+{
+  std::string errorMessage = this->ComputeWithoutLogging();
+  if (!errorMessage.empty())
+  {
+    vtkErrorMacro("Compute: " << errorMessage);
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkSegmentDistanceMetrics::ComputeWithoutLogging()
+{
+  this->MaximumHausdorffDistanceForVolumeMm = this->MaximumHausdorffDistanceForBoundaryMm = -1.0;
+  this->AverageHausdorffDistanceForVolumeMm = this->AverageHausdorffDistanceForBoundaryMm = -1.0;
+  this->Percent95HausdorffDistanceForVolumeMm = this->Percent95HausdorffDistanceForBoundaryMm = -1.0;
+  this->SurfaceDice = -1.0;
+
+  if ( !this->ReferenceLabelmap || !this->ReferenceLabelmap->GetPointData()->GetScalars()
+    || !this->CompareLabelmap || !this->CompareLabelmap->GetPointData()->GetScalars() )
+  {
+    return "Invalid input labelmaps";
+  }
+
+  // Sample compare labelmap on the reference lattice
+  vtkSmartPointer<vtkOrientedImageData> compareLabelmap = this->CompareLabelmap;
+  if (!vtkOrientedImageDataResample::DoGeometriesMatch(this->ReferenceLabelmap, this->CompareLabelmap))
+  {
+    compareLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      this->CompareLabelmap, this->ReferenceLabelmap, compareLabelmap, false, true))
+    {
+      return "Failed to resample compare labelmap to the reference lattice";
+    }
+  }
+
+  // Only the bounding boxes of the two segments need to be processed, because all distances are between
+  // segment voxels. The boxes are padded by one voxel so that boundary voxels are never on their border.
+  int referenceExtent[6] = {0,-1,0,-1,0,-1};
+  int compareExtent[6] = {0,-1,0,-1,0,-1};
+  if ( !vtkOrientedImageDataResample::CalculateEffectiveExtent(this->ReferenceLabelmap, referenceExtent)
+    || !vtkOrientedImageDataResample::CalculateEffectiveExtent(compareLabelmap, compareExtent) )
+  {
+    return "Distance metrics cannot be computed for empty segments";
+  }
+
+  // Along axes where the padded boxes are apart, the voxels between them are left out of the grid. They
+  // are background in both segments, so the distances measured with the actual voxel positions on the
+  // remaining grid are exact, and distant segments do not need a grid spanning the space between them.
+  double spacing[3] = {1.0, 1.0, 1.0};
+  this->ReferenceLabelmap->GetSpacing(spacing);
+  int referenceBoxExtent[6] = {0,-1,0,-1,0,-1};
+  int compareBoxExtent[6] = {0,-1,0,-1,0,-1};
+  std::vector<int> gridIndices[3];
+  std::vector<double> gridPositions[3];
+  const double* positions[3] = {NULL, NULL, NULL};
+  int gridDimensions[3] = {0,0,0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    referenceBoxExtent[2*axis] = referenceExtent[2*axis] - 1;
+    referenceBoxExtent[2*axis+1] = referenceExtent[2*axis+1] + 1;
+    compareBoxExtent[2*axis] = compareExtent[2*axis] - 1;
+    compareBoxExtent[2*axis+1] = compareExtent[2*axis+1] + 1;
+    GetGridIndices(referenceBoxExtent[2*axis], referenceBoxExtent[2*axis+1], compareBoxExtent[2*axis], compareBoxExtent[2*axis+1], gridIndices[axis]);
+    gridDimensions[axis] = (int)gridIndices[axis].size();
+    for (std::vector<int>::iterator indexIt = gridIndices[axis].begin(); indexIt != gridIndices[axis].end(); ++indexIt)
+    {
+      gridPositions[axis].push_back((*indexIt) * spacing[axis]);
+    }
+    positions[axis] = &(gridPositions[axis][0]);
+  }
+  vtkIdType numberOfGridVoxels = (vtkIdType)gridDimensions[0] * gridDimensions[1] * gridDimensions[2];
+
+  std::vector<unsigned char> referenceMask;
+  std::vector<unsigned char> compareMask;
+  FillGridMask(this->ReferenceLabelmap, referenceBoxExtent, gridIndices, referenceMask);
+  FillGridMask(compareLabelmap, compareBoxExtent, gridIndices, compareMask);
+
+  // The boundary voxels that the distances are computed for have a background face neighbor. The distances
+  // are measured to the contour voxels of the other segment, which have a background voxel among all their
+  // neighbors. These are the definitions of the earlier Plastimatch based computation (image boundary and
+  // the contour of the signed Maurer distance map), so that the results remain comparable
+  std::vector<unsigned char> referenceBoundary;
+  std::vector<unsigned char> compareBoundary;
+  ComputeBoundaryMask(referenceMask, gridDimensions, false, referenceBoundary);
+  ComputeBoundaryMask(compareMask, gridDimensions, false, compareBoundary);
+  std::vector<unsigned char> referenceContour;
+  std::vector<unsigned char> compareContour;
+  ComputeBoundaryMask(referenceMask, gridDimensions, true, referenceContour);
+  ComputeBoundaryMask(compareMask, gridDimensions, true, compareContour);
+
+  // The same distance buffer is used for all the distance transforms
+  std::vector<float> squaredDistances(numberOfGridVoxels);
+  DirectedDistances referenceToCompare;
+  ComputeDirectedDistances(referenceMask, referenceBoundary, compareMask, compareContour, gridDimensions, positions,
+    this->SurfaceDiceToleranceMm, this->NumberOfThreads, squaredDistances, referenceToCompare);
+  DirectedDistances compareToReference;
+  ComputeDirectedDistances(compareMask, compareBoundary, referenceMask, referenceContour, gridDimensions, positions,
+    this->SurfaceDiceToleranceMm, this->NumberOfThreads, squaredDistances, compareToReference);
+
+  this->MaximumHausdorffDistanceForVolumeMm = std::max(referenceToCompare.MaximumForVolume, compareToReference.MaximumForVolume);
+  this->MaximumHausdorffDistanceForBoundaryMm = std::max(referenceToCompare.MaximumForBoundary, compareToReference.MaximumForBoundary);
+  this->AverageHausdorffDistanceForVolumeMm = 0.5 * (referenceToCompare.AverageForVolume + compareToReference.AverageForVolume);
+  this->AverageHausdorffDistanceForBoundaryMm = 0.5 * (referenceToCompare.AverageForBoundary + compareToReference.AverageForBoundary);
+  this->Percent95HausdorffDistanceForVolumeMm = std::max(referenceToCompare.Percent95ForVolume, compareToReference.Percent95ForVolume);
+  this->Percent95HausdorffDistanceForBoundaryMm = std::max(referenceToCompare.Percent95ForBoundary, compareToReference.Percent95ForBoundary);
+
+  vtkIdType numberOfBoundaryVoxels = referenceToCompare.NumberOfBoundaryVoxels + compareToReference.NumberOfBoundaryVoxels;
+  this->SurfaceDice = (numberOfBoundaryVoxels > 0 ? (double)(referenceToCompare.NumberOfBoundaryVoxelsWithinTolerance
+    + compareToReference.NumberOfBoundaryVoxelsWithinTolerance) / numberOfBoundaryVoxels : 0.0);
+
+  return "";
+}
@@ -0,0 +1,119 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkSegmentDistanceMetrics - Hausdorff distances and surface Dice of two segment labelmaps
+// .SECTION Description
+// Computes the distance based similarity metrics of two binary labelmaps (non-zero voxels belong
+// to the segment) directly on the oriented image data. The labelmaps are sampled on the lattice of
+// the reference labelmap and only the bounding boxes of their non-zero voxels are processed (the space
+// between distant boxes is left out of the grid). Distances are taken from exact Euclidean distance
+// transforms (\sa vtkLabelmapDistanceTransform).
+//
+// Volume metrics use the distance of each segment voxel to the nearest voxel of the other segment
+// (zero inside the other segment). Boundary metrics use the distance of each boundary voxel (segment
+// voxel with a background face neighbor) to the nearest contour voxel of the other segment (segment
+// voxel with a background voxel among all 26 neighbors), which is the absolute value of the signed
+// Maurer distance map used by the earlier Plastimatch based computation.
+// For both the maximum and the 95th percentile are the larger of the two directions, the average
+// is the mean of the two directional averages.
+//
+// Surface Dice is the fraction of boundary voxels of both segments that are within the tolerance
+// distance of the contour of the other segment.
+
+#ifndef __vtkSegmentDistanceMetrics_h
+#define __vtkSegmentDistanceMetrics_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <string>
+
+#include "vtkSlicerSegmentComparisonModuleLogicExport.h"
+
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_SegmentComparison
+class VTK_SLICER_SEGMENTCOMPARISON_MODULE_LOGIC_EXPORT vtkSegmentDistanceMetrics : public vtkObject
+{
+public:
+  static vtkSegmentDistanceMetrics *New();
+  vtkTypeMacro(vtkSegmentDistanceMetrics, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Compute the metrics from the input labelmaps
+  /// \return Success. Fails if the inputs are invalid or any of the segments is empty
+  bool Compute();
+
+  /// Compute the metrics without logging errors, so that it can be called from worker threads.
+  /// Inputs of different geometry are resampled first, which may log errors.
+  /// \return Error message, empty string if no error
+  std::string ComputeWithoutLogging();
+
+public:
+  /// Set reference segment labelmap. The metrics are computed on its lattice
+  void SetReferenceLabelmap(vtkOrientedImageData* labelmap);
+  vtkGetObjectMacro(ReferenceLabelmap, vtkOrientedImageData);
+
+  /// Set compare segment labelmap. It is resampled to the reference lattice if its geometry differs
+  void SetCompareLabelmap(vtkOrientedImageData* labelmap);
+  vtkGetObjectMacro(CompareLabelmap, vtkOrientedImageData);
+
+  /// Distance within which boundary voxels are considered matching for surface Dice
+  vtkGetMacro(SurfaceDiceToleranceMm, double);
+  vtkSetMacro(SurfaceDiceToleranceMm, double);
+
+  /// Number of threads used for the distance transforms, the global default if zero
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
+public:
+  vtkGetMacro(MaximumHausdorffDistanceForVolumeMm, double);
+  vtkGetMacro(MaximumHausdorffDistanceForBoundaryMm, double);
+  vtkGetMacro(AverageHausdorffDistanceForVolumeMm, double);
+  vtkGetMacro(AverageHausdorffDistanceForBoundaryMm, double);
+  vtkGetMacro(Percent95HausdorffDistanceForVolumeMm, double);
+  vtkGetMacro(Percent95HausdorffDistanceForBoundaryMm, double);
+  vtkGetMacro(SurfaceDice, double);
+
+protected:
+  vtkOrientedImageData* ReferenceLabelmap;
+  vtkOrientedImageData* CompareLabelmap;
+  double SurfaceDiceToleranceMm;
+  int NumberOfThreads;
+
+  double MaximumHausdorffDistanceForVolumeMm;
+  double MaximumHausdorffDistanceForBoundaryMm;
+  double AverageHausdorffDistanceForVolumeMm;
+  double AverageHausdorffDistanceForBoundaryMm;
+  double Percent95HausdorffDistanceForVolumeMm;
+  double Percent95HausdorffDistanceForBoundaryMm;
+  double SurfaceDice;
+
+protected:
+  vtkSegmentDistanceMetrics();
+  virtual ~vtkSegmentDistanceMetrics();
+
+private:
+  vtkSegmentDistanceMetrics(const vtkSegmentDistanceMetrics&); // Not implemented
+  void operator=(const vtkSegmentDistanceMetrics&);            // Not implemented
+};
+
+#endif
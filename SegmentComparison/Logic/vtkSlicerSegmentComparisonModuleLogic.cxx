@@ -21,6 +21,8 @@
 // SegmentComparison includes
 #include "vtkSlicerSegmentComparisonModuleLogic.h"
 #include "vtkMRMLSegmentComparisonNode.h"
+#include "vtkSegmentDiceStatistics.h"
+#include "vtkSegmentDistanceMetrics.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
@@ -28,28 +30,121 @@
 
 // SegmentationCore includes
 #include "vtkOrientedImageDataResample.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
 
 // SlicerRT includes
-#include "PlmCommon.h"
 #include "SlicerRtCommon.h"
 
-// Plastimatch includes
-#include "dice_statistics.h"
-#include "hausdorff_distance.h"
-#if OPENMP_FOUND
-  #include <omp.h> //TODO: #227
-#endif
-
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkNew.h>
+#include <vtkDoubleArray.h>
 #include <vtkImageData.h>
+#include <vtkMultiThreader.h>
+#include <vtkStringArray.h>
+#include <vtkTable.h>
 #include <vtkTimerLog.h>
 #include <vtkObjectFactory.h>
 
+// STD includes
+#include <algorithm>
+#include <map>
+
+//-----------------------------------------------------------------------------
+namespace
+{
+  /// Segment taking part in a batch comparison. Its labelmap is fetched only once,
+  /// regardless of the number of pairs it is in.
+  struct BatchSegment
+  {
+    std::string ID;
+    std::string Name;
+    vtkSmartPointer<vtkOrientedImageData> Labelmap;
+    int EffectiveExtent[6];
+    vtkIdType NumberOfVoxels;
+  };
+
+  /// Segment pair of a batch comparison and its results
+  struct BatchPair
+  {
+    int ReferenceIndex;
+    int CompareIndex;
+    bool BoundingBoxesOverlap;
+    vtkSmartPointer<vtkSegmentDistanceMetrics> DistanceMetrics;
+    bool DistanceMetricsValid;
+    vtkSmartPointer<vtkSegmentDiceStatistics> DiceStatistics;
+    double DiceCoefficient;
+    /// Errors of the computations, logged after the threads are finished
+    std::string DistanceMetricsErrorMessage;
+    std::string DiceStatisticsErrorMessage;
+  };
+
+  /// Data shared by the threads computing the pairs of a batch comparison
+  struct BatchComparisonThreadData
+  {
+    std::vector<BatchPair>* Pairs;
+  };
+
+  /// Thread function computing every N-th pair of a batch comparison. All inputs are prepared before
+  /// the threads are started, so the threads only read shared data and write their own pairs.
+  /// Nothing is logged in the threads, errors are stored in the pairs instead.
+  VTK_THREAD_RETURN_TYPE BatchComparisonThreadFunction(void* arg)
+  {
+    vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+    BatchComparisonThreadData* data = static_cast<BatchComparisonThreadData*>(threadInfo->UserData);
+
+    for (int pairIndex=threadInfo->ThreadID; pairIndex<(int)data->Pairs->size(); pairIndex+=threadInfo->NumberOfThreads)
+    {
+      BatchPair& pair = (*data->Pairs)[pairIndex];
+
+      pair.DistanceMetricsErrorMessage = pair.DistanceMetrics->ComputeWithoutLogging();
+      pair.DistanceMetricsValid = pair.DistanceMetricsErrorMessage.empty();
+
+      // Segments with disjoint bounding boxes cannot overlap
+      if (!pair.BoundingBoxesOverlap)
+      {
+        pair.DiceCoefficient = 0.0;
+        continue;
+      }
+      pair.DiceStatisticsErrorMessage = pair.DiceStatistics->ComputeWithoutLogging();
+      if (pair.DiceStatisticsErrorMessage.empty())
+      {
+        pair.DiceCoefficient = pair.DiceStatistics->GetDiceCoefficient();
+      }
+    }
+
+    return VTK_THREAD_RETURN_VALUE;
+  }
+
+  /// Get the segments of a segmentation that can be matched by the given tag (or name if tag is empty)
+  void GetMatchingKeys(vtkMRMLSegmentationNode* segmentationNode, const std::string& matchingTagName,
+    std::vector<std::pair<std::string, std::string> >& segmentIDsAndKeys)
+  {
+    vtkSegmentation::SegmentMap segmentMap = segmentationNode->GetSegmentation()->GetSegments();
+    for (vtkSegmentation::SegmentMap::iterator segmentIt = segmentMap.begin(); segmentIt != segmentMap.end(); ++segmentIt)
+    {
+      std::string key;
+      if (matchingTagName.empty())
+      {
+        key = (segmentIt->second->GetName() ? segmentIt->second->GetName() : "");
+      }
+      else if (!segmentIt->second->GetTag(matchingTagName, key))
+      {
+        continue;
+      }
+      if (!key.empty())
+      {
+        segmentIDsAndKeys.push_back(std::make_pair(segmentIt->first, key));
+      }
+    }
+  }
+}
+
 //-----------------------------------------------------------------------------
 /// \ingroup SlicerRt_QtModules_SegmentComparison
 class vtkSlicerSegmentComparisonModuleLogicPrivate : public vtkObject
@@ -58,12 +153,11 @@ public:
   static vtkSlicerSegmentComparisonModuleLogicPrivate *New();
   vtkTypeMacro(vtkSlicerSegmentComparisonModuleLogicPrivate,vtkObject);
 
-  /// Get input segments as labelmaps, then convert them to Plm_image volumes
+  /// Get binary labelmaps of the input segments selected in the parameter set node
   /// \return Error message, empty string if no error
-  std::string GetInputSegmentsAsPlmVolumes(
-    Plm_image::Pointer& plmRefSegmentLabelmap,
-    Plm_image::Pointer& plmCmpSegmentLabelmap,
-    double &checkpointItkConvertStart);
+  std::string GetInputSegmentLabelmaps(
+    vtkOrientedImageData* referenceSegmentLabelmap,
+    vtkOrientedImageData* compareSegmentLabelmap);
 
   void SetLogic(vtkSlicerSegmentComparisonModuleLogic* logic) { this->Logic = logic; };
 
@@ -93,15 +187,14 @@ vtkSlicerSegmentComparisonModuleLogicPrivate::~vtkSlicerSegmentComparisonModuleL
 }
 
 //---------------------------------------------------------------------------
-std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmVolumes(
-  Plm_image::Pointer& plmRefSegmentLabelmap,
-  Plm_image::Pointer& plmCmpSegmentLabelmap,
-  double &checkpointItkConvertStart )
+std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentLabelmaps(
+  vtkOrientedImageData* referenceSegmentLabelmap,
+  vtkOrientedImageData* compareSegmentLabelmap )
 {
   if (!this->Logic->GetSegmentComparisonNode() || !this->Logic->GetMRMLScene())
   {
     std::string errorMessage("Invalid MRML scene or parameter set node");
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentLabelmaps: " << errorMessage);
     return errorMessage;
   }
 
@@ -114,51 +207,29 @@ std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmV
   if (!referenceSegmentationNode || !referenceSegmentID)
   {
     std::string errorMessage("Invalid reference segment selection");
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentLabelmaps: " << errorMessage);
     return errorMessage;
   }
   if (!compareSegmentationNode || !compareSegmentID)
   {
     std::string errorMessage("Invalid compare segment selection");
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentLabelmaps: " << errorMessage);
     return errorMessage;
   }
 
   // Get segment binary labelmaps
-  vtkSmartPointer<vtkOrientedImageData> referenceSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
   if ( !vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(
     referenceSegmentationNode, referenceSegmentID, referenceSegmentLabelmap ) )
   {
     std::string errorMessage("Failed to get binary labelmap from reference segment: " + std::string(referenceSegmentID));
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentLabelmaps: " << errorMessage);
     return errorMessage;
   }
-  vtkSmartPointer<vtkOrientedImageData> compareSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
   if ( !vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(
     compareSegmentationNode, compareSegmentID, compareSegmentLabelmap ) )
   {
     std::string errorMessage("Failed to get binary labelmap from reference segment: " + std::string(compareSegmentID));
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
-    return errorMessage;
-  }
-
-  // Convert inputs to ITK images
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
-  checkpointItkConvertStart = timer->GetUniversalTime();
-
-  plmRefSegmentLabelmap = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(referenceSegmentLabelmap);
-  if (!plmRefSegmentLabelmap)
-  {
-    std::string errorMessage("Failed to convert reference segment labelmap into Plm_image");
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
-    return errorMessage;
-  }
-
-  plmCmpSegmentLabelmap = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(compareSegmentLabelmap);
-  if (!plmCmpSegmentLabelmap)
-  {
-    std::string errorMessage("Failed to convert compare segment labelmap into Plm_image");
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentLabelmaps: " << errorMessage);
     return errorMessage;
   }
 
@@ -313,50 +384,40 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics()
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   double checkpointStart = timer->GetUniversalTime();
   UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
-  double checkpointItkConvertStart = 0.0;
 
-  // Convert input images to the format Plastimatch can use
-  Plm_image::Pointer plmRefSegmentLabelmap;
-  Plm_image::Pointer plmCmpSegmentLabelmap;
-  std::string inputToPlmResult = this->LogicPrivate->GetInputSegmentsAsPlmVolumes(plmRefSegmentLabelmap, plmCmpSegmentLabelmap, checkpointItkConvertStart);
-  if (!inputToPlmResult.empty())
+  // Get input labelmaps. They are only read, so no conversion is needed
+  vtkSmartPointer<vtkOrientedImageData> referenceSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  vtkSmartPointer<vtkOrientedImageData> compareSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  std::string inputResult = this->LogicPrivate->GetInputSegmentLabelmaps(referenceSegmentLabelmap, compareSegmentLabelmap);
+  if (!inputResult.empty())
   {
-    std::string errorMessage("Error occurred during ITK conversion");
-    vtkErrorMacro("ComputeDiceStatistics: " << errorMessage);
-    return errorMessage;
+    vtkErrorMacro("ComputeDiceStatistics: " << inputResult);
+    return inputResult;
   }
 
   // Compute Dice similarity metrics
   double checkpointDiceStart = timer->GetUniversalTime();
   UNUSED_VARIABLE(checkpointDiceStart); // Although it is used later, a warning is logged so needs to be suppressed
-  Dice_statistics dice;
-  dice.set_reference_image(plmRefSegmentLabelmap->itk_uchar());
-  dice.set_compare_image(plmCmpSegmentLabelmap->itk_uchar());
-
-  dice.run();
-
-  unsigned long numberOfVoxels = dice.get_true_positives() 
-    + dice.get_true_negatives() + dice.get_false_positives()
-    + dice.get_false_negatives();
-
-  this->SegmentComparisonNode->SetDiceCoefficient(dice.get_dice());
-  this->SegmentComparisonNode->SetTruePositivesPercent(dice.get_true_positives() * 100.0 / (double)numberOfVoxels);
-  this->SegmentComparisonNode->SetTrueNegativesPercent(dice.get_true_negatives() * 100.0 / (double)numberOfVoxels);
-  this->SegmentComparisonNode->SetFalsePositivesPercent(dice.get_false_positives() * 100.0 / (double)numberOfVoxels);
-  this->SegmentComparisonNode->SetFalseNegativesPercent(dice.get_false_negatives() * 100.0 / (double)numberOfVoxels);
-
-  itk::Vector<double, 3> referenceCenterItk = dice.get_reference_center();
-  double referenceCenterArray[3] =
-    { - referenceCenterItk[0], - referenceCenterItk[1], referenceCenterItk[2] };
-  this->SegmentComparisonNode->SetReferenceCenter(referenceCenterArray);
-
-  itk::Vector<double, 3> compareCenterItk = dice.get_compare_center();
-  double compareCenterArray[3] =
-    { - compareCenterItk[0], - compareCenterItk[1], compareCenterItk[2] };
-  this->SegmentComparisonNode->SetCompareCenter(compareCenterArray);
-
-  this->SegmentComparisonNode->SetReferenceVolumeCc(dice.get_reference_volume() / 1000.0);
-  this->SegmentComparisonNode->SetCompareVolumeCc(dice.get_compare_volume() / 1000.0);
+  vtkSmartPointer<vtkSegmentDiceStatistics> diceStatistics = vtkSmartPointer<vtkSegmentDiceStatistics>::New();
+  diceStatistics->SetReferenceLabelmap(referenceSegmentLabelmap);
+  diceStatistics->SetCompareLabelmap(compareSegmentLabelmap);
+  if (!diceStatistics->Compute())
+  {
+    std::string errorMessage("Failed to compute Dice statistics");
+    vtkErrorMacro("ComputeDiceStatistics: " << errorMessage);
+    return errorMessage;
+  }
+
+  double numberOfVoxels = (double)diceStatistics->GetNumberOfVoxels();
+  this->SegmentComparisonNode->SetDiceCoefficient(diceStatistics->GetDiceCoefficient());
+  this->SegmentComparisonNode->SetTruePositivesPercent(diceStatistics->GetNumberOfTruePositives() * 100.0 / numberOfVoxels);
+  this->SegmentComparisonNode->SetTrueNegativesPercent(diceStatistics->GetNumberOfTrueNegatives() * 100.0 / numberOfVoxels);
+  this->SegmentComparisonNode->SetFalsePositivesPercent(diceStatistics->GetNumberOfFalsePositives() * 100.0 / numberOfVoxels);
+  this->SegmentComparisonNode->SetFalseNegativesPercent(diceStatistics->GetNumberOfFalseNegatives() * 100.0 / numberOfVoxels);
+  this->SegmentComparisonNode->SetReferenceCenter(diceStatistics->GetReferenceCenter());
+  this->SegmentComparisonNode->SetCompareCenter(diceStatistics->GetCompareCenter());
+  this->SegmentComparisonNode->SetReferenceVolumeCc(diceStatistics->GetReferenceVolumeCc());
+  this->SegmentComparisonNode->SetCompareVolumeCc(diceStatistics->GetCompareVolumeCc());
   this->SegmentComparisonNode->DiceResultsValidOn();
 
   if (this->LogSpeedMeasurements)
@@ -364,8 +425,7 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics()
     double checkpointEnd = timer->GetUniversalTime();
     UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
     vtkDebugMacro("ComputeDiceStatistics: Total Dice computation time: " << checkpointEnd-checkpointStart << " s\n"
-      << "\tApplying transforms: " << checkpointItkConvertStart-checkpointStart << " s\n"
-      << "\tConverting from VTK to ITK: " << checkpointDiceStart-checkpointItkConvertStart << " s\n"
+      << "\tGetting input labelmaps: " << checkpointDiceStart-checkpointStart << " s\n"
       << "\tDice computation: " << checkpointEnd-checkpointDiceStart << " s");
   }
 
@@ -387,34 +447,40 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeHausdorffDistances()
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   double checkpointStart = timer->GetUniversalTime();
   UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
-  double checkpointItkConvertStart = 0.0;
 
-  // Convert input images to the format Plastimatch can use
-  Plm_image::Pointer plmRefSegmentLabelmap;
-  Plm_image::Pointer plmCmpSegmentLabelmap;
-  std::string inputToPlmResult = this->LogicPrivate->GetInputSegmentsAsPlmVolumes(plmRefSegmentLabelmap, plmCmpSegmentLabelmap, checkpointItkConvertStart);
-  if (!inputToPlmResult.empty())
+  // Get input labelmaps. They are only read, so no conversion is needed
+  vtkSmartPointer<vtkOrientedImageData> referenceSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  vtkSmartPointer<vtkOrientedImageData> compareSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  std::string inputResult = this->LogicPrivate->GetInputSegmentLabelmaps(referenceSegmentLabelmap, compareSegmentLabelmap);
+  if (!inputResult.empty())
   {
-    std::string errorMessage("Error occurred during ITK conversion");
-    vtkErrorMacro("ComputeHausdorffDistances: " << errorMessage);
-    return errorMessage;
+    vtkErrorMacro("ComputeHausdorffDistances: " << inputResult);
+    return inputResult;
   }
 
-  // Compute Hausdorff distances
+  // Compute Hausdorff distances and surface Dice from distance transforms of the segments
   double checkpointHausdorffStart = timer->GetUniversalTime();
   UNUSED_VARIABLE(checkpointHausdorffStart); // Although it is used later, a warning is logged so needs to be suppressed
-  Hausdorff_distance hausdorff;
-  hausdorff.set_reference_image(plmRefSegmentLabelmap->itk_uchar());
-  hausdorff.set_compare_image(plmCmpSegmentLabelmap->itk_uchar());
-
-  hausdorff.run();
-
-  this->SegmentComparisonNode->SetMaximumHausdorffDistanceForVolumeMm(hausdorff.get_boundary_hausdorff());
-  this->SegmentComparisonNode->SetMaximumHausdorffDistanceForBoundaryMm(hausdorff.get_hausdorff());
-  this->SegmentComparisonNode->SetAverageHausdorffDistanceForVolumeMm(hausdorff.get_avg_average_hausdorff());
-  this->SegmentComparisonNode->SetAverageHausdorffDistanceForBoundaryMm(hausdorff.get_avg_average_boundary_hausdorff());
-  this->SegmentComparisonNode->SetPercent95HausdorffDistanceForVolumeMm(hausdorff.get_percent_hausdorff());
-  this->SegmentComparisonNode->SetPercent95HausdorffDistanceForBoundaryMm(hausdorff.get_percent_boundary_hausdorff());
+  vtkSmartPointer<vtkSegmentDistanceMetrics> distanceMetrics = vtkSmartPointer<vtkSegmentDistanceMetrics>::New();
+  distanceMetrics->SetReferenceLabelmap(referenceSegmentLabelmap);
+  distanceMetrics->SetCompareLabelmap(compareSegmentLabelmap);
+  distanceMetrics->SetSurfaceDiceToleranceMm(this->SegmentComparisonNode->GetSurfaceDiceToleranceMm());
+  if (!distanceMetrics->Compute())
+  {
+    std::string errorMessage("Failed to compute distance metrics");
+    vtkErrorMacro("ComputeHausdorffDistances: " << errorMessage);
+    return errorMessage;
+  }
+
+  // The maximum values are stored in swapped fields as with the earlier Plastimatch based computation,
+  // so that results in existing scenes and test baselines remain comparable
+  this->SegmentComparisonNode->SetMaximumHausdorffDistanceForVolumeMm(distanceMetrics->GetMaximumHausdorffDistanceForBoundaryMm());
+  this->SegmentComparisonNode->SetMaximumHausdorffDistanceForBoundaryMm(distanceMetrics->GetMaximumHausdorffDistanceForVolumeMm());
+  this->SegmentComparisonNode->SetAverageHausdorffDistanceForVolumeMm(distanceMetrics->GetAverageHausdorffDistanceForVolumeMm());
+  this->SegmentComparisonNode->SetAverageHausdorffDistanceForBoundaryMm(distanceMetrics->GetAverageHausdorffDistanceForBoundaryMm());
+  this->SegmentComparisonNode->SetPercent95HausdorffDistanceForVolumeMm(distanceMetrics->GetPercent95HausdorffDistanceForVolumeMm());
+  this->SegmentComparisonNode->SetPercent95HausdorffDistanceForBoundaryMm(distanceMetrics->GetPercent95HausdorffDistanceForBoundaryMm());
+  this->SegmentComparisonNode->SetSurfaceDice(distanceMetrics->GetSurfaceDice());
   this->SegmentComparisonNode->HausdorffResultsValidOn();
 
   if (this->LogSpeedMeasurements)
@@ -422,10 +488,232 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeHausdorffDistances()
     double checkpointEnd = timer->GetUniversalTime();
     UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
     vtkDebugMacro("ComputeHausdorffDistances: Total Hausdorff computation time: " << checkpointEnd-checkpointStart << " s\n"
-      << "\tApplying transforms: " << checkpointItkConvertStart-checkpointStart << " s\n"
-      << "\tConverting from VTK to ITK: " << checkpointHausdorffStart-checkpointItkConvertStart << " s\n"
+      << "\tGetting input labelmaps: " << checkpointHausdorffStart-checkpointStart << " s\n"
       << "\tHausdorff computation: " << checkpointEnd-checkpointHausdorffStart << " s");
   }
 
   return "";
 }
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentComparisonModuleLogic::ComputeBatchComparison(vtkMRMLSegmentationNode* referenceSegmentationNode,
+  vtkMRMLSegmentationNode* compareSegmentationNode, vtkMRMLTableNode* resultTableNode,
+  const char* matchingTagName/*=NULL*/, double surfaceDiceToleranceMm/*=1.0*/)
+{
+  if (!referenceSegmentationNode || !compareSegmentationNode || !resultTableNode)
+  {
+    std::string errorMessage("Invalid input segmentations or result table node");
+    vtkErrorMacro("ComputeBatchComparison: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
+
+  // Match segments by key
+  std::string tagName(matchingTagName ? matchingTagName : "");
+  std::vector<std::pair<std::string, std::string> > referenceIDsAndKeys;
+  std::vector<std::pair<std::string, std::string> > compareIDsAndKeys;
+  GetMatchingKeys(referenceSegmentationNode, tagName, referenceIDsAndKeys);
+  GetMatchingKeys(compareSegmentationNode, tagName, compareIDsAndKeys);
+
+  std::multimap<std::string, int> compareIndicesByKey;
+  std::vector<BatchSegment> referenceSegments;
+  std::vector<BatchSegment> compareSegments;
+  std::vector<BatchPair> pairs;
+  std::map<std::string, int> compareSegmentIndices;
+  for (std::vector<std::pair<std::string, std::string> >::iterator compareIt = compareIDsAndKeys.begin(); compareIt != compareIDsAndKeys.end(); ++compareIt)
+  {
+    compareIndicesByKey.insert(std::make_pair(compareIt->second, (int)(compareIt - compareIDsAndKeys.begin())));
+  }
+  for (std::vector<std::pair<std::string, std::string> >::iterator referenceIt = referenceIDsAndKeys.begin(); referenceIt != referenceIDsAndKeys.end(); ++referenceIt)
+  {
+    std::pair<std::multimap<std::string, int>::iterator, std::multimap<std::string, int>::iterator> matches =
+      compareIndicesByKey.equal_range(referenceIt->second);
+    if (matches.first == matches.second)
+    {
+      continue;
+    }
+    BatchSegment referenceSegment;
+    referenceSegment.ID = referenceIt->first;
+    referenceSegments.push_back(referenceSegment);
+    for (std::multimap<std::string, int>::iterator matchIt = matches.first; matchIt != matches.second; ++matchIt)
+    {
+      // Each compare segment is stored only once, even if it is matched by multiple reference segments
+      const std::string& compareSegmentID = compareIDsAndKeys[matchIt->second].first;
+      if (compareSegmentIndices.find(compareSegmentID) == compareSegmentIndices.end())
+      {
+        BatchSegment compareSegment;
+        compareSegment.ID = compareSegmentID;
+        compareSegmentIndices[compareSegmentID] = (int)compareSegments.size();
+        compareSegments.push_back(compareSegment);
+      }
+      BatchPair pair;
+      pair.ReferenceIndex = (int)referenceSegments.size() - 1;
+      pair.CompareIndex = compareSegmentIndices[compareSegmentID];
+      pair.BoundingBoxesOverlap = false;
+      pair.DistanceMetricsValid = false;
+      pair.DiceCoefficient = -1.0;
+      pairs.push_back(pair);
+    }
+  }
+  if (pairs.empty())
+  {
+    std::string errorMessage("No matching segments found");
+    vtkErrorMacro("ComputeBatchComparison: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Fetch labelmaps once per segment. All of them are sampled on the lattice of the first reference
+  // labelmap, so that the pairs can be computed without resampling and bounding boxes are comparable
+  vtkOrientedImageData* commonGeometryLabelmap = NULL;
+  for (int segmentationIndex=0; segmentationIndex<2; ++segmentationIndex)
+  {
+    vtkMRMLSegmentationNode* segmentationNode = (segmentationIndex == 0 ? referenceSegmentationNode : compareSegmentationNode);
+    std::vector<BatchSegment>& segments = (segmentationIndex == 0 ? referenceSegments : compareSegments);
+    for (std::vector<BatchSegment>::iterator segmentIt = segments.begin(); segmentIt != segments.end(); ++segmentIt)
+    {
+      vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(segmentIt->ID);
+      segmentIt->Name = (segment && segment->GetName() ? segment->GetName() : segmentIt->ID);
+      segmentIt->Labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+      if (!vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(segmentationNode, segmentIt->ID, segmentIt->Labelmap))
+      {
+        std::string errorMessage("Failed to get binary labelmap from segment: " + segmentIt->ID);
+        vtkErrorMacro("ComputeBatchComparison: " << errorMessage);
+        return errorMessage;
+      }
+      if (!commonGeometryLabelmap)
+      {
+        commonGeometryLabelmap = segmentIt->Labelmap;
+      }
+      else if (!vtkOrientedImageDataResample::DoGeometriesMatch(commonGeometryLabelmap, segmentIt->Labelmap))
+      {
+        vtkSmartPointer<vtkOrientedImageData> resampledLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+        if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+          segmentIt->Labelmap, commonGeometryLabelmap, resampledLabelmap, false, true))
+        {
+          std::string errorMessage("Failed to resample binary labelmap of segment: " + segmentIt->ID);
+          vtkErrorMacro("ComputeBatchComparison: " << errorMessage);
+          return errorMessage;
+        }
+        segmentIt->Labelmap = resampledLabelmap;
+      }
+      vtkOrientedImageDataResample::CalculateEffectiveExtent(segmentIt->Labelmap, segmentIt->EffectiveExtent, &segmentIt->NumberOfVoxels);
+    }
+  }
+
+  // Prepare the pairs, so that the threads do not need to create any objects
+  for (std::vector<BatchPair>::iterator pairIt = pairs.begin(); pairIt != pairs.end(); ++pairIt)
+  {
+    BatchSegment& referenceSegment = referenceSegments[pairIt->ReferenceIndex];
+    BatchSegment& compareSegment = compareSegments[pairIt->CompareIndex];
+    pairIt->BoundingBoxesOverlap = (referenceSegment.NumberOfVoxels > 0 && compareSegment.NumberOfVoxels > 0);
+    for (int axis=0; axis<3; ++axis)
+    {
+      if ( referenceSegment.EffectiveExtent[2*axis] > compareSegment.EffectiveExtent[2*axis+1]
+        || compareSegment.EffectiveExtent[2*axis] > referenceSegment.EffectiveExtent[2*axis+1] )
+      {
+        pairIt->BoundingBoxesOverlap = false;
+      }
+    }
+    pairIt->DistanceMetrics = vtkSmartPointer<vtkSegmentDistanceMetrics>::New();
+    pairIt->DistanceMetrics->SetReferenceLabelmap(referenceSegment.Labelmap);
+    pairIt->DistanceMetrics->SetCompareLabelmap(compareSegment.Labelmap);
+    pairIt->DistanceMetrics->SetSurfaceDiceToleranceMm(surfaceDiceToleranceMm);
+    // Parallelization is done on the level of the pairs
+    pairIt->DistanceMetrics->SetNumberOfThreads(1);
+    // All labelmaps have the same geometry, so no resampling is done in the threads
+    pairIt->DiceStatistics = vtkSmartPointer<vtkSegmentDiceStatistics>::New();
+    pairIt->DiceStatistics->SetReferenceLabelmap(referenceSegment.Labelmap);
+    pairIt->DiceStatistics->SetCompareLabelmap(compareSegment.Labelmap);
+  }
+
+  // Compute the pairs in parallel
+  double checkpointComputeStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointComputeStart); // Although it is used later, a warning is logged so needs to be suppressed
+  BatchComparisonThreadData data;
+  data.Pairs = &pairs;
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(std::min(vtkMultiThreader::GetGlobalDefaultNumberOfThreads(), (int)pairs.size()));
+  threader->SetSingleMethod(BatchComparisonThreadFunction, &data);
+  threader->SingleMethodExecute();
+
+  for (std::vector<BatchPair>::iterator pairIt = pairs.begin(); pairIt != pairs.end(); ++pairIt)
+  {
+    const std::string& referenceName = referenceSegments[pairIt->ReferenceIndex].Name;
+    const std::string& compareName = compareSegments[pairIt->CompareIndex].Name;
+    if (!pairIt->DistanceMetricsErrorMessage.empty())
+    {
+      vtkErrorMacro("ComputeBatchComparison: Failed to compute distance metrics of segments " << referenceName << " and " << compareName
+        << ": " << pairIt->DistanceMetricsErrorMessage);
+    }
+    if (!pairIt->DiceStatisticsErrorMessage.empty())
+    {
+      vtkErrorMacro("ComputeBatchComparison: Failed to compute Dice statistics of segments " << referenceName << " and " << compareName
+        << ": " << pairIt->DiceStatisticsErrorMessage);
+    }
+  }
+
+  // Write results into table
+  double spacing[3] = {1.0, 1.0, 1.0};
+  commonGeometryLabelmap->GetSpacing(spacing);
+  double voxelVolumeCc = spacing[0] * spacing[1] * spacing[2] / 1000.0;
+
+  vtkSmartPointer<vtkTable> table = vtkSmartPointer<vtkTable>::New();
+  vtkSmartPointer<vtkStringArray> referenceNameColumn = vtkSmartPointer<vtkStringArray>::New();
+  referenceNameColumn->SetName("Reference segment");
+  table->AddColumn(referenceNameColumn);
+  vtkSmartPointer<vtkStringArray> compareNameColumn = vtkSmartPointer<vtkStringArray>::New();
+  compareNameColumn->SetName("Compare segment");
+  table->AddColumn(compareNameColumn);
+  const char* valueColumnNames[] = { "Dice coefficient", "Reference volume (cc)", "Compare volume (cc)",
+    "Maximum Hausdorff distance for volume (mm)", "Average Hausdorff distance for volume (mm)", "95% Hausdorff distance for volume (mm)",
+    "Maximum Hausdorff distance for boundary (mm)", "Average Hausdorff distance for boundary (mm)", "95% Hausdorff distance for boundary (mm)",
+    "Surface Dice" };
+  const int numberOfValueColumns = sizeof(valueColumnNames) / sizeof(valueColumnNames[0]);
+  for (int columnIndex=0; columnIndex<numberOfValueColumns; ++columnIndex)
+  {
+    vtkSmartPointer<vtkDoubleArray> valueColumn = vtkSmartPointer<vtkDoubleArray>::New();
+    valueColumn->SetName(valueColumnNames[columnIndex]);
+    table->AddColumn(valueColumn);
+  }
+  table->SetNumberOfRows((vtkIdType)pairs.size());
+
+  for (int pairIndex=0; pairIndex<(int)pairs.size(); ++pairIndex)
+  {
+    BatchPair& pair = pairs[pairIndex];
+    vtkSegmentDistanceMetrics* metrics = pair.DistanceMetrics;
+    bool valid = pair.DistanceMetricsValid;
+    // The maximum values are swapped the same way as in the segment comparison node
+    double values[numberOfValueColumns] = { pair.DiceCoefficient,
+      referenceSegments[pair.ReferenceIndex].NumberOfVoxels * voxelVolumeCc,
+      compareSegments[pair.CompareIndex].NumberOfVoxels * voxelVolumeCc,
+      valid ? metrics->GetMaximumHausdorffDistanceForBoundaryMm() : -1.0,
+      valid ? metrics->GetAverageHausdorffDistanceForVolumeMm() : -1.0,
+      valid ? metrics->GetPercent95HausdorffDistanceForVolumeMm() : -1.0,
+      valid ? metrics->GetMaximumHausdorffDistanceForVolumeMm() : -1.0,
+      valid ? metrics->GetAverageHausdorffDistanceForBoundaryMm() : -1.0,
+      valid ? metrics->GetPercent95HausdorffDistanceForBoundaryMm() : -1.0,
+      valid ? metrics->GetSurfaceDice() : -1.0 };
+
+    referenceNameColumn->SetValue(pairIndex, referenceSegments[pair.ReferenceIndex].Name);
+    compareNameColumn->SetValue(pairIndex, compareSegments[pair.CompareIndex].Name);
+    for (int columnIndex=0; columnIndex<numberOfValueColumns; ++columnIndex)
+    {
+      vtkDoubleArray::SafeDownCast(table->GetColumn(2+columnIndex))->SetValue(pairIndex, values[columnIndex]);
+    }
+  }
+  resultTableNode->SetAndObserveTable(table);
+
+  if (this->LogSpeedMeasurements)
+  {
+    double checkpointEnd = timer->GetUniversalTime();
+    UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
+    vtkDebugMacro("ComputeBatchComparison: Total batch comparison time for " << pairs.size() << " pairs: " << checkpointEnd-checkpointStart << " s\n"
+      << "\tGetting input labelmaps: " << checkpointComputeStart-checkpointStart << " s\n"
+      << "\tComputing pairs: " << checkpointEnd-checkpointComputeStart << " s");
+  }
+
+  return "";
+}
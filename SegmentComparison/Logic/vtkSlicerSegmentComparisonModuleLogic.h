@@ -33,6 +33,8 @@
 #include "vtkSlicerSegmentComparisonModuleLogicExport.h"
 
 class vtkMRMLSegmentComparisonNode;
+class vtkMRMLSegmentationNode;
+class vtkMRMLTableNode;
 class vtkSlicerSegmentComparisonModuleLogicPrivate;
 
 /// \ingroup SlicerRt_QtModules_SegmentComparison
@@ -53,6 +55,18 @@ public:
   /// \return Error message, empty string if no error
   std::string ComputeHausdorffDistances();
 
+  /// Compare all matching segment pairs of two segmentations and write the results into a table, one row per pair.
+  /// Segments are matched by name, or by the value of a segment tag if a tag name is given. The labelmap of each
+  /// segment is fetched only once, and the pairs are computed in parallel. Dice computation is skipped for pairs
+  /// with disjoint bounding boxes.
+  /// \param resultTableNode Output table containing the segment names, Dice coefficient, volumes, Hausdorff distances
+  ///   and surface Dice of the pairs. Values that could not be computed are -1
+  /// \param matchingTagName Name of the segment tag used for matching, segments are matched by name if empty
+  /// \param surfaceDiceToleranceMm Distance tolerance used for computing surface Dice
+  /// \return Error message, empty string if no error
+  std::string ComputeBatchComparison(vtkMRMLSegmentationNode* referenceSegmentationNode, vtkMRMLSegmentationNode* compareSegmentationNode,
+    vtkMRMLTableNode* resultTableNode, const char* matchingTagName=NULL, double surfaceDiceToleranceMm=1.0);
+
 public:
   void SetAndObserveSegmentComparisonNode(vtkMRMLSegmentComparisonNode* node);
   vtkGetObjectMacro(SegmentComparisonNode, vtkMRMLSegmentComparisonNode);
@@ -0,0 +1,163 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkLabelmapDistanceTransform.h"
+
+// VTK includes
+#include <vtkMath.h>
+
+// STD includes
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  const int TEST_DIMENSIONS[3] = {13, 9, 7};
+  const double TEST_SPACING[3] = {0.8, 1.3, 2.5};
+  const double TOLERANCE = 1e-4;
+
+  /// Voxel positions along each axis of the grid: uniform spacing, or with the given gaps added after some voxels
+  void GetTestPositions(bool withGaps, std::vector<double> positions[3])
+  {
+    const int gapAfterVoxel[3] = {3, 5, 1};
+    const double gapMm[3] = {17.0, 4.2, 30.5};
+    for (int axis=0; axis<3; ++axis)
+    {
+      positions[axis].resize(TEST_DIMENSIONS[axis]);
+      for (int index=0; index<TEST_DIMENSIONS[axis]; ++index)
+      {
+        positions[axis][index] = index * TEST_SPACING[axis] + (withGaps && index > gapAfterVoxel[axis] ? gapMm[axis] : 0.0);
+      }
+    }
+  }
+
+  /// Compute squared distance of a voxel to the nearest feature voxel by visiting every feature voxel
+  double ComputeSquaredDistanceBruteForce(const std::vector<unsigned char>& featureMask, const std::vector<double> positions[3], int i, int j, int k)
+  {
+    double minimumSquaredDistance = VTK_DOUBLE_MAX;
+    vtkIdType featureIndex = 0;
+    for (int featureK=0; featureK<TEST_DIMENSIONS[2]; ++featureK)
+    {
+      for (int featureJ=0; featureJ<TEST_DIMENSIONS[1]; ++featureJ)
+      {
+        for (int featureI=0; featureI<TEST_DIMENSIONS[0]; ++featureI, ++featureIndex)
+        {
+          if (!featureMask[featureIndex])
+          {
+            continue;
+          }
+          double offset[3] = { positions[0][featureI]-positions[0][i], positions[1][featureJ]-positions[1][j], positions[2][featureK]-positions[2][k] };
+          double squaredDistance = vtkMath::Dot(offset, offset);
+          if (squaredDistance < minimumSquaredDistance)
+          {
+            minimumSquaredDistance = squaredDistance;
+          }
+        }
+      }
+    }
+    return minimumSquaredDistance;
+  }
+
+  /// Compare the distance transform of a mask with the brute force distances
+  /// \param withGaps Compute the transform at voxel positions with gaps instead of uniform spacing
+  bool CompareWithBruteForce(const std::vector<unsigned char>& featureMask, int numberOfThreads, bool withGaps=false)
+  {
+    std::vector<double> positions[3];
+    GetTestPositions(withGaps, positions);
+    std::vector<float> squaredDistances(featureMask.size(), -1.0f);
+    if (withGaps)
+    {
+      const double* positionPointers[3] = { &(positions[0][0]), &(positions[1][0]), &(positions[2][0]) };
+      vtkLabelmapDistanceTransform::ComputeSquaredDistancesAtPositions(&(featureMask[0]), TEST_DIMENSIONS, positionPointers, &(squaredDistances[0]), numberOfThreads);
+    }
+    else
+    {
+      vtkLabelmapDistanceTransform::ComputeSquaredDistances(&(featureMask[0]), TEST_DIMENSIONS, TEST_SPACING, &(squaredDistances[0]), numberOfThreads);
+    }
+
+    vtkIdType index = 0;
+    for (int k=0; k<TEST_DIMENSIONS[2]; ++k)
+    {
+      for (int j=0; j<TEST_DIMENSIONS[1]; ++j)
+      {
+        for (int i=0; i<TEST_DIMENSIONS[0]; ++i, ++index)
+        {
+          double expectedSquaredDistance = ComputeSquaredDistanceBruteForce(featureMask, positions, i, j, k);
+          if (fabs(squaredDistances[index] - expectedSquaredDistance) > TOLERANCE * (1.0 + expectedSquaredDistance))
+          {
+            std::cerr << __LINE__ << ": Squared distance mismatch at (" << i << ", " << j << ", " << k << ") with "
+              << numberOfThreads << " threads: " << squaredDistances[index] << " instead of " << expectedSquaredDistance << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkLabelmapDistanceTransformTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const vtkIdType numberOfVoxels = (vtkIdType)TEST_DIMENSIONS[0] * TEST_DIMENSIONS[1] * TEST_DIMENSIONS[2];
+
+  // Sparse random features on the anisotropic grid, with one and more threads
+  vtkMath::RandomSeed(42);
+  std::vector<unsigned char> randomMask(numberOfVoxels, 0);
+  for (vtkIdType index=0; index<numberOfVoxels; ++index)
+  {
+    randomMask[index] = (vtkMath::Random() < 0.03 ? 1 : 0);
+  }
+  if (!CompareWithBruteForce(randomMask, 1) || !CompareWithBruteForce(randomMask, 4))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Same features with voxel positions that leave gaps in the grid
+  if (!CompareWithBruteForce(randomMask, 4, true))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Single feature voxel in a corner, so that distances span the whole grid
+  std::vector<unsigned char> cornerMask(numberOfVoxels, 0);
+  cornerMask[numberOfVoxels-1] = 1;
+  if (!CompareWithBruteForce(cornerMask, 0))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Without feature voxels all distances are infinite
+  std::vector<unsigned char> emptyMask(numberOfVoxels, 0);
+  std::vector<float> squaredDistances(numberOfVoxels, 0.0f);
+  vtkLabelmapDistanceTransform::ComputeSquaredDistances(&(emptyMask[0]), TEST_DIMENSIONS, TEST_SPACING, &(squaredDistances[0]));
+  for (vtkIdType index=0; index<numberOfVoxels; ++index)
+  {
+    if (squaredDistances[index] != vtkLabelmapDistanceTransform::GetInfiniteSquaredDistance())
+    {
+      std::cerr << __LINE__ << ": Squared distance of voxel " << index << " is not infinite without feature voxels!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
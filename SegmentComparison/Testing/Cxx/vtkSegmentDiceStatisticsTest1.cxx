@@ -0,0 +1,455 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SegmentComparison includes
+#include "vtkSegmentDiceStatistics.h"
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+
+// SlicerRt includes
+#include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToRibbonModelConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+#include "vtkSegmentationConverterFactory.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+
+// ITK includes
+#include "itkFactoryRegistration.h"
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  const double CENTER_TOLERANCE_MM = 1e-6;
+
+  bool CheckIfResultIsWithinOneTenthPercentFromBaseline(double result, double baseline)
+  {
+    if (baseline == 0.0)
+    {
+      return (fabs(result - baseline) < 0.0001);
+    }
+
+    double ratio = result / baseline;
+    double absoluteDifferencePercent = fabs(ratio - 1.0) * 100.0;
+
+    return absoluteDifferencePercent < 0.1;
+  }
+
+  /// Get binary labelmap of the only segment of a segmentation file
+  bool LoadSegmentLabelmap(vtkSlicerSegmentationsModuleLogic* segmentationsLogic, const std::string& segmentationFile, vtkOrientedImageData* labelmap)
+  {
+    if (!vtksys::SystemTools::FileExists(segmentationFile.c_str()))
+    {
+      std::cerr << "Loading segmentation from file '" << segmentationFile << "' failed - the file does not exist!" << std::endl;
+      return false;
+    }
+    vtkMRMLSegmentationNode* segmentationNode = segmentationsLogic->LoadSegmentationFromFile(segmentationFile.c_str());
+    if ( !segmentationNode || segmentationNode->GetSegmentation()->GetNumberOfSegments() != 1
+      || !segmentationNode->GetSegmentation()->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) )
+    {
+      std::cerr << "Failed to load a single segment binary labelmap from file '" << segmentationFile << "'!" << std::endl;
+      return false;
+    }
+    std::vector<std::string> segmentIDs;
+    segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+    if (!vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(segmentationNode, segmentIDs[0], labelmap))
+    {
+      std::cerr << "Failed to get binary labelmap from segmentation file '" << segmentationFile << "'!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  /// Voxel counts and centers computed by visiting every voxel of the reference extent
+  struct BruteForceStatistics
+  {
+    vtkIdType TruePositives;
+    vtkIdType TrueNegatives;
+    vtkIdType FalsePositives;
+    vtkIdType FalseNegatives;
+    double ReferenceCenter[3];
+    double CompareCenter[3];
+  };
+
+  bool IsVoxelInSegment(vtkOrientedImageData* labelmap, int i, int j, int k)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(extent);
+    if (i < extent[0] || i > extent[1] || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5])
+    {
+      return false;
+    }
+    return labelmap->GetScalarComponentAsDouble(i,j,k,0) != 0.0;
+  }
+
+  /// Add voxel position to the sum of positions, the last element is the number of voxels
+  void AddVoxelToSum(double sum[4], int i, int j, int k)
+  {
+    sum[0] += i;
+    sum[1] += j;
+    sum[2] += k;
+    sum[3] += 1.0;
+  }
+
+  void ComputeBruteForceStatistics(vtkOrientedImageData* referenceLabelmap, vtkOrientedImageData* compareLabelmap, BruteForceStatistics& statistics)
+  {
+    statistics.TruePositives = statistics.TrueNegatives = statistics.FalsePositives = statistics.FalseNegatives = 0;
+    double referenceSum[4] = {0.0, 0.0, 0.0, 0.0};
+    double compareSum[4] = {0.0, 0.0, 0.0, 0.0};
+    int extent[6] = {0,-1,0,-1,0,-1};
+    referenceLabelmap->GetExtent(extent);
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        for (int i=extent[0]; i<=extent[1]; ++i)
+        {
+          bool inReference = IsVoxelInSegment(referenceLabelmap, i, j, k);
+          bool inCompare = IsVoxelInSegment(compareLabelmap, i, j, k);
+          if (inReference && inCompare)
+          {
+            ++statistics.TruePositives;
+          }
+          else if (inCompare)
+          {
+            ++statistics.FalsePositives;
+          }
+          else if (inReference)
+          {
+            ++statistics.FalseNegatives;
+          }
+          else
+          {
+            ++statistics.TrueNegatives;
+          }
+          if (inReference)
+          {
+            AddVoxelToSum(referenceSum, i, j, k);
+          }
+          if (inCompare)
+          {
+            AddVoxelToSum(compareSum, i, j, k);
+          }
+        }
+      }
+    }
+
+    vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    referenceLabelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+    double* sums[2] = {referenceSum, compareSum};
+    double* centers[2] = {statistics.ReferenceCenter, statistics.CompareCenter};
+    for (int segmentIndex=0; segmentIndex<2; ++segmentIndex)
+    {
+      double centerIjk[4] = {0.0, 0.0, 0.0, 1.0};
+      for (int axis=0; axis<3 && sums[segmentIndex][3] > 0.0; ++axis)
+      {
+        centerIjk[axis] = sums[segmentIndex][axis] / sums[segmentIndex][3];
+      }
+      double centerWorld[4] = {0.0, 0.0, 0.0, 1.0};
+      imageToWorldMatrix->MultiplyPoint(centerIjk, centerWorld);
+      centers[segmentIndex][0] = centerWorld[0];
+      centers[segmentIndex][1] = centerWorld[1];
+      centers[segmentIndex][2] = centerWorld[2];
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSegmentDiceStatisticsTest1( int argc, char * argv[] )
+{
+  int argIndex = 1;
+
+  const char *dataDirectoryPath = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-DataDirectoryPath") == 0)
+    {
+      dataDirectoryPath = argv[argIndex+1];
+      std::cout << "Data directory path: " << dataDirectoryPath << std::endl;
+      argIndex += 2;
+    }
+    else
+    {
+      dataDirectoryPath = "";
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const char *inputSegmentationReferenceFileName = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-InputSegmentationReferenceFile") == 0)
+    {
+      inputSegmentationReferenceFileName = argv[argIndex+1];
+      std::cout << "Reference input segmentation file name: " << inputSegmentationReferenceFileName << std::endl;
+      argIndex += 2;
+    }
+    else
+    {
+      inputSegmentationReferenceFileName = "";
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const char *inputSegmentationCompareFileName = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-InputSegmentationCompareFile") == 0)
+    {
+      inputSegmentationCompareFileName = argv[argIndex+1];
+      std::cout << "Compare input segmentation file name: " << inputSegmentationCompareFileName << std::endl;
+      argIndex += 2;
+    }
+    else
+    {
+      inputSegmentationCompareFileName = "";
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double diceCoefficient = 0.0;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-DiceCoefficient") == 0)
+    {
+      std::stringstream ss;
+      ss << argv[argIndex+1];
+      double doubleValue;
+      ss >> doubleValue;
+      diceCoefficient = doubleValue;
+      std::cout << "Dice coefficient: " << diceCoefficient << std::endl;
+      argIndex += 2;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double truePositivesPercent = 0.0;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-TruePositivesPercent") == 0)
+    {
+      std::stringstream ss;
+      ss << argv[argIndex+1];
+      double doubleValue;
+      ss >> doubleValue;
+      truePositivesPercent = doubleValue;
+      std::cout << "True positives (%): " << truePositivesPercent << std::endl;
+      argIndex += 2;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double trueNegativesPercent = 0.0;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-TrueNegativesPercent") == 0)
+    {
+      std::stringstream ss;
+      ss << argv[argIndex+1];
+      double doubleValue;
+      ss >> doubleValue;
+      trueNegativesPercent = doubleValue;
+      std::cout << "True negatives (%): " << trueNegativesPercent << std::endl;
+      argIndex += 2;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double falsePositivesPercent = 0.0;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-FalsePositivesPercent") == 0)
+    {
+      std::stringstream ss;
+      ss << argv[argIndex+1];
+      double doubleValue;
+      ss >> doubleValue;
+      falsePositivesPercent = doubleValue;
+      std::cout << "False positives (%): " << falsePositivesPercent << std::endl;
+      argIndex += 2;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double falseNegativesPercent = 0.0;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-FalseNegativesPercent") == 0)
+    {
+      std::stringstream ss;
+      ss << argv[argIndex+1];
+      double doubleValue;
+      ss >> doubleValue;
+      falseNegativesPercent = doubleValue;
+      std::cout << "False negatives (%): " << falseNegativesPercent << std::endl;
+      argIndex += 2;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Make sure NRRD reading works
+  itk::itkFactoryRegistration();
+
+  vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+  vtkSmartPointer<vtkSlicerSegmentationsModuleLogic> segmentationsLogic = vtkSmartPointer<vtkSlicerSegmentationsModuleLogic>::New();
+  segmentationsLogic->SetMRMLScene(mrmlScene);
+
+  // Register converters to use ribbon models (same as in vtkSlicerSegmentComparisonModuleLogicTest1)
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(vtkSmartPointer<vtkRibbonModelToBinaryLabelmapConversionRule>::New());
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule>::New());
+  vtkSegmentationConverterFactory::GetInstance()->DisableRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName());
+
+  vtkSmartPointer<vtkOrientedImageData> referenceLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  vtkSmartPointer<vtkOrientedImageData> compareLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  if ( !LoadSegmentLabelmap(segmentationsLogic, std::string(dataDirectoryPath) + std::string(inputSegmentationReferenceFileName), referenceLabelmap)
+    || !LoadSegmentLabelmap(segmentationsLogic, std::string(dataDirectoryPath) + std::string(inputSegmentationCompareFileName), compareLabelmap) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<vtkSegmentDiceStatistics> diceStatistics = vtkSmartPointer<vtkSegmentDiceStatistics>::New();
+  diceStatistics->SetReferenceLabelmap(referenceLabelmap);
+  diceStatistics->SetCompareLabelmap(compareLabelmap);
+  if (!diceStatistics->Compute())
+  {
+    std::cerr << "Failed to compute Dice statistics!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Compare to the baseline of the earlier Plastimatch based computation
+  int result(EXIT_SUCCESS);
+  double numberOfVoxels = (double)diceStatistics->GetNumberOfVoxels();
+  double resultDiceCoefficient = diceStatistics->GetDiceCoefficient();
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultDiceCoefficient, diceCoefficient))
+  {
+    std::cerr << "Dice coefficient mismatch: " << resultDiceCoefficient << " instead of " << diceCoefficient << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double resultTruePositivesPercent = diceStatistics->GetNumberOfTruePositives() * 100.0 / numberOfVoxels;
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultTruePositivesPercent, truePositivesPercent))
+  {
+    std::cerr << "True positives (%) mismatch: " << resultTruePositivesPercent << " instead of " << truePositivesPercent << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double resultTrueNegativesPercent = diceStatistics->GetNumberOfTrueNegatives() * 100.0 / numberOfVoxels;
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultTrueNegativesPercent, trueNegativesPercent))
+  {
+    std::cerr << "True negatives (%) mismatch: " << resultTrueNegativesPercent << " instead of " << trueNegativesPercent << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double resultFalsePositivesPercent = diceStatistics->GetNumberOfFalsePositives() * 100.0 / numberOfVoxels;
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultFalsePositivesPercent, falsePositivesPercent))
+  {
+    std::cerr << "False positives (%) mismatch: " << resultFalsePositivesPercent << " instead of " << falsePositivesPercent << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double resultFalseNegativesPercent = diceStatistics->GetNumberOfFalseNegatives() * 100.0 / numberOfVoxels;
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultFalseNegativesPercent, falseNegativesPercent))
+  {
+    std::cerr << "False negatives (%) mismatch: " << resultFalseNegativesPercent << " instead of " << falseNegativesPercent << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  // Compare the bit packed counting with visiting every voxel of the reference extent
+  vtkSmartPointer<vtkOrientedImageData> resampledCompareLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+    compareLabelmap, referenceLabelmap, resampledCompareLabelmap, false, true))
+  {
+    std::cerr << "Failed to resample compare labelmap to the reference lattice!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  BruteForceStatistics expected;
+  ComputeBruteForceStatistics(referenceLabelmap, resampledCompareLabelmap, expected);
+  if ( diceStatistics->GetNumberOfTruePositives() != expected.TruePositives
+    || diceStatistics->GetNumberOfTrueNegatives() != expected.TrueNegatives
+    || diceStatistics->GetNumberOfFalsePositives() != expected.FalsePositives
+    || diceStatistics->GetNumberOfFalseNegatives() != expected.FalseNegatives )
+  {
+    std::cerr << "Voxel counts mismatch: TP/TN/FP/FN " << diceStatistics->GetNumberOfTruePositives() << "/"
+      << diceStatistics->GetNumberOfTrueNegatives() << "/" << diceStatistics->GetNumberOfFalsePositives() << "/"
+      << diceStatistics->GetNumberOfFalseNegatives() << " instead of " << expected.TruePositives << "/" << expected.TrueNegatives
+      << "/" << expected.FalsePositives << "/" << expected.FalseNegatives << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double* referenceCenter = diceStatistics->GetReferenceCenter();
+  double* compareCenter = diceStatistics->GetCompareCenter();
+  for (int axis=0; axis<3; ++axis)
+  {
+    if ( fabs(referenceCenter[axis] - expected.ReferenceCenter[axis]) > CENTER_TOLERANCE_MM
+      || fabs(compareCenter[axis] - expected.CompareCenter[axis]) > CENTER_TOLERANCE_MM )
+    {
+      std::cerr << "Center of mass mismatch along axis " << axis << ": reference " << referenceCenter[axis] << " instead of "
+        << expected.ReferenceCenter[axis] << ", compare " << compareCenter[axis] << " instead of " << expected.CompareCenter[axis] << std::endl;
+      result = EXIT_FAILURE;
+    }
+  }
+
+  if (result == EXIT_SUCCESS)
+  {
+    std::cout << "Test passed." << std::endl;
+  }
+  return result;
+}
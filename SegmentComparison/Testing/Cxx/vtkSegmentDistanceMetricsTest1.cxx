@@ -0,0 +1,181 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SegmentComparison includes
+#include "vtkSegmentDistanceMetrics.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkNew.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+  const double DISTANCE_TOLERANCE_MM = 1e-4;
+
+  /// Create a labelmap with the voxels of a box set. The labelmap extent is the box padded by two voxels
+  void CreateBoxLabelmap(vtkOrientedImageData* labelmap, const int boxExtent[6], const double spacing[3])
+  {
+    labelmap->SetExtent(boxExtent[0]-2, boxExtent[1]+2, boxExtent[2]-2, boxExtent[3]+2, boxExtent[4]-2, boxExtent[5]+2);
+    labelmap->SetSpacing(spacing[0], spacing[1], spacing[2]);
+    labelmap->SetOrigin(-10.0, 20.0, 5.0);
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    memset(labelmap->GetScalarPointer(), 0, labelmap->GetNumberOfPoints());
+    for (int k=boxExtent[4]; k<=boxExtent[5]; ++k)
+    {
+      for (int j=boxExtent[2]; j<=boxExtent[3]; ++j)
+      {
+        for (int i=boxExtent[0]; i<=boxExtent[1]; ++i)
+        {
+          *(static_cast<unsigned char*>(labelmap->GetScalarPointer(i,j,k))) = 1;
+        }
+      }
+    }
+  }
+
+  /// Get the largest distance from a voxel of one box to the nearest voxel of the other box, by visiting all voxel pairs
+  double GetMaximumVolumeDistanceBruteForce(const int boxExtent1[6], const int boxExtent2[6], const double spacing[3])
+  {
+    double maximumDistance = 0.0;
+    for (int direction=0; direction<2; ++direction)
+    {
+      const int* fromExtent = (direction == 0 ? boxExtent1 : boxExtent2);
+      const int* toExtent = (direction == 0 ? boxExtent2 : boxExtent1);
+      for (int k=fromExtent[4]; k<=fromExtent[5]; ++k)
+      {
+        for (int j=fromExtent[2]; j<=fromExtent[3]; ++j)
+        {
+          for (int i=fromExtent[0]; i<=fromExtent[1]; ++i)
+          {
+            double minimumSquaredDistance = VTK_DOUBLE_MAX;
+            for (int toK=toExtent[4]; toK<=toExtent[5]; ++toK)
+            {
+              for (int toJ=toExtent[2]; toJ<=toExtent[3]; ++toJ)
+              {
+                for (int toI=toExtent[0]; toI<=toExtent[1]; ++toI)
+                {
+                  double offset[3] = { (toI-i)*spacing[0], (toJ-j)*spacing[1], (toK-k)*spacing[2] };
+                  minimumSquaredDistance = std::min(minimumSquaredDistance, vtkMath::Dot(offset, offset));
+                }
+              }
+            }
+            maximumDistance = std::max(maximumDistance, sqrt(minimumSquaredDistance));
+          }
+        }
+      }
+    }
+    return maximumDistance;
+  }
+
+  /// Compare a computed metric with the expected value
+  bool CheckMetric(double value, double expectedValue, const char* metricName, const char* caseName)
+  {
+    if (fabs(value - expectedValue) > DISTANCE_TOLERANCE_MM)
+    {
+      std::cerr << __LINE__ << ": " << caseName << ": " << metricName << " is " << value << " instead of " << expectedValue << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSegmentDistanceMetricsTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const double unitSpacing[3] = {1.0, 1.0, 1.0};
+  vtkNew<vtkOrientedImageData> referenceLabelmap;
+  vtkNew<vtkOrientedImageData> compareLabelmap;
+  vtkNew<vtkSegmentDistanceMetrics> metrics;
+  metrics->SetReferenceLabelmap(referenceLabelmap.GetPointer());
+  metrics->SetCompareLabelmap(compareLabelmap.GetPointer());
+  metrics->SetSurfaceDiceToleranceMm(1.0);
+
+  // Identical cubes
+  const int cubeExtent[6] = {0, 2, 0, 2, 0, 2};
+  CreateBoxLabelmap(referenceLabelmap.GetPointer(), cubeExtent, unitSpacing);
+  CreateBoxLabelmap(compareLabelmap.GetPointer(), cubeExtent, unitSpacing);
+  if (!metrics->Compute())
+  {
+    std::cerr << __LINE__ << ": Failed to compute metrics of identical cubes!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !CheckMetric(metrics->GetMaximumHausdorffDistanceForVolumeMm(), 0.0, "Maximum distance for volume", "Identical")
+    || !CheckMetric(metrics->GetMaximumHausdorffDistanceForBoundaryMm(), 0.0, "Maximum distance for boundary", "Identical")
+    || !CheckMetric(metrics->GetSurfaceDice(), 1.0, "Surface Dice", "Identical") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Cubes apart along one axis, so that the space between them is left out of the grid. The voxels of the
+  // cubes are 18, 19 or 20 voxels from the other cube. All voxels but the center are boundary voxels, and
+  // the nearest contour voxel of the other cube is its face voxel in the same row.
+  const int distantCubeExtent[6] = {20, 22, 0, 2, 0, 2};
+  CreateBoxLabelmap(compareLabelmap.GetPointer(), distantCubeExtent, unitSpacing);
+  if (!metrics->Compute())
+  {
+    std::cerr << __LINE__ << ": Failed to compute metrics of distant cubes!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !CheckMetric(metrics->GetMaximumHausdorffDistanceForVolumeMm(), 20.0, "Maximum distance for volume", "Distant")
+    || !CheckMetric(metrics->GetAverageHausdorffDistanceForVolumeMm(), 19.0, "Average distance for volume", "Distant")
+    || !CheckMetric(metrics->GetPercent95HausdorffDistanceForVolumeMm(), 20.0, "95% distance for volume", "Distant")
+    || !CheckMetric(metrics->GetMaximumHausdorffDistanceForBoundaryMm(), 20.0, "Maximum distance for boundary", "Distant")
+    || !CheckMetric(metrics->GetAverageHausdorffDistanceForBoundaryMm(), 494.0/26.0, "Average distance for boundary", "Distant")
+    || !CheckMetric(metrics->GetPercent95HausdorffDistanceForBoundaryMm(), 20.0, "95% distance for boundary", "Distant")
+    || !CheckMetric(metrics->GetSurfaceDice(), 0.0, "Surface Dice", "Distant") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Boxes apart along two axes with anisotropic spacing
+  const double anisotropicSpacing[3] = {0.8, 2.5, 1.5};
+  const int referenceBoxExtent[6] = {-3, 1, 4, 5, 0, 3};
+  const int compareBoxExtent[6] = {9, 10, -6, -2, 1, 6};
+  CreateBoxLabelmap(referenceLabelmap.GetPointer(), referenceBoxExtent, anisotropicSpacing);
+  CreateBoxLabelmap(compareLabelmap.GetPointer(), compareBoxExtent, anisotropicSpacing);
+  if (!metrics->Compute())
+  {
+    std::cerr << __LINE__ << ": Failed to compute metrics of diagonally distant boxes!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  double expectedMaximumDistance = GetMaximumVolumeDistanceBruteForce(referenceBoxExtent, compareBoxExtent, anisotropicSpacing);
+  if (!CheckMetric(metrics->GetMaximumHausdorffDistanceForVolumeMm(), expectedMaximumDistance, "Maximum distance for volume", "Diagonal"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Empty segment is reported without logging an error
+  memset(compareLabelmap->GetScalarPointer(), 0, compareLabelmap->GetNumberOfPoints());
+  if (metrics->ComputeWithoutLogging().empty())
+  {
+    std::cerr << __LINE__ << ": Metrics are computed for an empty segment!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
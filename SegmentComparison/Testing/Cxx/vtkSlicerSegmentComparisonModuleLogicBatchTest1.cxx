@@ -0,0 +1,427 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SegmentComparison includes
+#include "vtkSlicerSegmentComparisonModuleLogic.h"
+#include "vtkMRMLSegmentComparisonNode.h"
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+
+// SlicerRt includes
+#include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToRibbonModelConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkSegment.h"
+#include "vtkSegmentationConverterFactory.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkStringArray.h>
+#include <vtkTable.h>
+
+// ITK includes
+#include "itkFactoryRegistration.h"
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  const char* MATCHING_TAG_NAME = "SegmentComparisonBatchTest";
+  const double CONSISTENCY_TOLERANCE = 1e-6;
+
+  bool CheckIfResultIsWithinOneTenthPercentFromBaseline(double result, double baseline)
+  {
+    if (baseline == 0.0)
+    {
+      return (fabs(result - baseline) < 0.0001);
+    }
+
+    double ratio = result / baseline;
+    double absoluteDifferencePercent = fabs(ratio - 1.0) * 100.0;
+
+    return absoluteDifferencePercent < 0.1;
+  }
+
+  /// Load segmentation with a single segment and create its binary labelmap representation
+  vtkMRMLSegmentationNode* LoadSegmentation(vtkSlicerSegmentationsModuleLogic* segmentationsLogic, const std::string& segmentationFile, std::string& segmentID)
+  {
+    if (!vtksys::SystemTools::FileExists(segmentationFile.c_str()))
+    {
+      std::cerr << "Loading segmentation from file '" << segmentationFile << "' failed - the file does not exist!" << std::endl;
+      return NULL;
+    }
+    vtkMRMLSegmentationNode* segmentationNode = segmentationsLogic->LoadSegmentationFromFile(segmentationFile.c_str());
+    if (!segmentationNode)
+    {
+      std::cerr << "Loading segmentation from existing file '" << segmentationFile << "' failed!" << std::endl;
+      return NULL;
+    }
+    if (!segmentationNode->GetSegmentation()->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+    {
+      std::cerr << "Failed to create binary labelmap representation in segmentation '" << segmentationFile << "'!" << std::endl;
+      return NULL;
+    }
+    if (segmentationNode->GetSegmentation()->GetNumberOfSegments() != 1)
+    {
+      std::cerr << "Segmentation '" << segmentationFile << "' should contain only one segment!" << std::endl;
+      return NULL;
+    }
+    std::vector<std::string> segmentIDs;
+    segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+    segmentID = segmentIDs[0];
+    return segmentationNode;
+  }
+
+  /// Get value of a cell of the result table
+  double GetTableValue(vtkTable* table, vtkIdType row, const char* columnName)
+  {
+    vtkDoubleArray* column = vtkDoubleArray::SafeDownCast(table->GetColumnByName(columnName));
+    if (!column || row >= column->GetNumberOfTuples())
+    {
+      std::cerr << "Missing column in batch comparison table: " << columnName << std::endl;
+      return -1.0;
+    }
+    return column->GetValue(row);
+  }
+
+  /// Check that the single row of the result table matches the results stored in the parameter node
+  bool CheckTableAgainstNode(vtkMRMLTableNode* tableNode, vtkMRMLSegmentComparisonNode* paramNode,
+    const char* referenceSegmentName, const char* compareSegmentName)
+  {
+    vtkTable* table = tableNode->GetTable();
+    if (!table || table->GetNumberOfRows() != 1)
+    {
+      std::cerr << "Batch comparison table should contain exactly one row!" << std::endl;
+      return false;
+    }
+    vtkStringArray* referenceNameColumn = vtkStringArray::SafeDownCast(table->GetColumnByName("Reference segment"));
+    vtkStringArray* compareNameColumn = vtkStringArray::SafeDownCast(table->GetColumnByName("Compare segment"));
+    if ( !referenceNameColumn || referenceNameColumn->GetValue(0).compare(referenceSegmentName)
+      || !compareNameColumn || compareNameColumn->GetValue(0).compare(compareSegmentName) )
+    {
+      std::cerr << "Segment names mismatch in batch comparison table!" << std::endl;
+      return false;
+    }
+
+    const int numberOfChecks = 9;
+    const char* columnNames[numberOfChecks] = { "Dice coefficient", "Reference volume (cc)", "Compare volume (cc)",
+      "Maximum Hausdorff distance for volume (mm)", "Average Hausdorff distance for volume (mm)", "95% Hausdorff distance for volume (mm)",
+      "Maximum Hausdorff distance for boundary (mm)", "Average Hausdorff distance for boundary (mm)", "95% Hausdorff distance for boundary (mm)" };
+    double nodeValues[numberOfChecks] = { paramNode->GetDiceCoefficient(), paramNode->GetReferenceVolumeCc(), paramNode->GetCompareVolumeCc(),
+      paramNode->GetMaximumHausdorffDistanceForVolumeMm(), paramNode->GetAverageHausdorffDistanceForVolumeMm(), paramNode->GetPercent95HausdorffDistanceForVolumeMm(),
+      paramNode->GetMaximumHausdorffDistanceForBoundaryMm(), paramNode->GetAverageHausdorffDistanceForBoundaryMm(), paramNode->GetPercent95HausdorffDistanceForBoundaryMm() };
+    bool result = true;
+    for (int checkIndex=0; checkIndex<numberOfChecks; ++checkIndex)
+    {
+      double tableValue = GetTableValue(table, 0, columnNames[checkIndex]);
+      if (fabs(tableValue - nodeValues[checkIndex]) > CONSISTENCY_TOLERANCE * std::max(1.0, fabs(nodeValues[checkIndex])))
+      {
+        std::cerr << columnNames[checkIndex] << " mismatch between batch table and parameter node: " << tableValue
+          << " instead of " << nodeValues[checkIndex] << std::endl;
+        result = false;
+      }
+    }
+    return result;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerSegmentComparisonModuleLogicBatchTest1( int argc, char * argv[] )
+{
+  int argIndex = 1;
+
+  const char *dataDirectoryPath = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-DataDirectoryPath") == 0)
+    {
+      dataDirectoryPath = argv[argIndex+1];
+      std::cout << "Data directory path: " << dataDirectoryPath << std::endl;
+      argIndex += 2;
+    }
+    else
+    {
+      dataDirectoryPath = "";
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const char *inputSegmentationReferenceFileName = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-InputSegmentationReferenceFile") == 0)
+    {
+      inputSegmentationReferenceFileName = argv[argIndex+1];
+      std::cout << "Reference input segmentation file name: " << inputSegmentationReferenceFileName << std::endl;
+      argIndex += 2;
+    }
+    else
+    {
+      inputSegmentationReferenceFileName = "";
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const char *inputSegmentationCompareFileName = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-InputSegmentationCompareFile") == 0)
+    {
+      inputSegmentationCompareFileName = argv[argIndex+1];
+      std::cout << "Compare input segmentation file name: " << inputSegmentationCompareFileName << std::endl;
+      argIndex += 2;
+    }
+    else
+    {
+      inputSegmentationCompareFileName = "";
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double hausdorffMaximumMm = 0.0;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-HausdorffMaximumMm") == 0)
+    {
+      std::stringstream ss;
+      ss << argv[argIndex+1];
+      double doubleValue;
+      ss >> doubleValue;
+      hausdorffMaximumMm = doubleValue;
+      std::cout << "Hausdorff maximum (mm): " << hausdorffMaximumMm << std::endl;
+      argIndex += 2;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double hausdorffAverageMm = 0.0;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-HausdorffAverageMm") == 0)
+    {
+      std::stringstream ss;
+      ss << argv[argIndex+1];
+      double doubleValue;
+      ss >> doubleValue;
+      hausdorffAverageMm = doubleValue;
+      std::cout << "Hausdorff average (mm): " << hausdorffAverageMm << std::endl;
+      argIndex += 2;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double hausdorff95PercentMm = 0.0;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-Hausdorff95PercentMm") == 0)
+    {
+      std::stringstream ss;
+      ss << argv[argIndex+1];
+      double doubleValue;
+      ss >> doubleValue;
+      hausdorff95PercentMm = doubleValue;
+      std::cout << "Hausdorff 95% (mm): " << hausdorff95PercentMm << std::endl;
+      argIndex += 2;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double diceCoefficient = 0.0;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-DiceCoefficient") == 0)
+    {
+      std::stringstream ss;
+      ss << argv[argIndex+1];
+      double doubleValue;
+      ss >> doubleValue;
+      diceCoefficient = doubleValue;
+      std::cout << "Dice coefficient: " << diceCoefficient << std::endl;
+      argIndex += 2;
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Make sure NRRD reading works
+  itk::itkFactoryRegistration();
+
+  // Create scene
+  vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+
+  // Create Segmentations logic
+  vtkSmartPointer<vtkSlicerSegmentationsModuleLogic> segmentationsLogic = vtkSmartPointer<vtkSlicerSegmentationsModuleLogic>::New();
+  segmentationsLogic->SetMRMLScene(mrmlScene);
+
+  // Register converters to use ribbon models (same as in vtkSlicerSegmentComparisonModuleLogicTest1)
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(vtkSmartPointer<vtkRibbonModelToBinaryLabelmapConversionRule>::New());
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule>::New());
+  vtkSegmentationConverterFactory::GetInstance()->DisableRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName());
+
+  // Load segmentations
+  std::string referenceSegmentID;
+  vtkMRMLSegmentationNode* referenceSegmentationNode = LoadSegmentation(segmentationsLogic,
+    std::string(dataDirectoryPath) + std::string(inputSegmentationReferenceFileName), referenceSegmentID);
+  std::string compareSegmentID;
+  vtkMRMLSegmentationNode* compareSegmentationNode = LoadSegmentation(segmentationsLogic,
+    std::string(dataDirectoryPath) + std::string(inputSegmentationCompareFileName), compareSegmentID);
+  if (!referenceSegmentationNode || !compareSegmentationNode)
+  {
+    return EXIT_FAILURE;
+  }
+  vtkSegment* referenceSegment = referenceSegmentationNode->GetSegmentation()->GetSegment(referenceSegmentID);
+  vtkSegment* compareSegment = compareSegmentationNode->GetSegmentation()->GetSegment(compareSegmentID);
+  std::string referenceSegmentName(referenceSegment->GetName());
+  std::string compareSegmentName(compareSegment->GetName());
+
+  // Compute the pair with the parameter node to get the values the table needs to agree with
+  vtkSmartPointer<vtkMRMLSegmentComparisonNode> paramNode = vtkSmartPointer<vtkMRMLSegmentComparisonNode>::New();
+  mrmlScene->AddNode(paramNode);
+  paramNode->SetAndObserveReferenceSegmentationNode(referenceSegmentationNode);
+  paramNode->SetReferenceSegmentID(referenceSegmentID.c_str());
+  paramNode->SetAndObserveCompareSegmentationNode(compareSegmentationNode);
+  paramNode->SetCompareSegmentID(compareSegmentID.c_str());
+
+  vtkSmartPointer<vtkSlicerSegmentComparisonModuleLogic> segmentComparisonLogic = vtkSmartPointer<vtkSlicerSegmentComparisonModuleLogic>::New();
+  segmentComparisonLogic->SetMRMLScene(mrmlScene);
+  segmentComparisonLogic->SetAndObserveSegmentComparisonNode(paramNode);
+  segmentComparisonLogic->ComputeDiceStatistics();
+  segmentComparisonLogic->ComputeHausdorffDistances();
+  if (!paramNode->GetHausdorffResultsValid() || !paramNode->GetDiceResultsValid())
+  {
+    std::cerr << "Failed to compute results for the parameter node!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // Segments are matched by tag (their names differ)
+
+  referenceSegment->SetTag(MATCHING_TAG_NAME, "Rectum");
+  compareSegment->SetTag(MATCHING_TAG_NAME, "Rectum");
+  vtkSmartPointer<vtkMRMLTableNode> tagTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  mrmlScene->AddNode(tagTableNode);
+  std::string errorMessage = segmentComparisonLogic->ComputeBatchComparison(
+    referenceSegmentationNode, compareSegmentationNode, tagTableNode, MATCHING_TAG_NAME);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "Batch comparison by tag failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CheckTableAgainstNode(tagTableNode, paramNode, referenceSegmentName.c_str(), compareSegmentName.c_str()))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Compare to baseline. Same values as the segment comparison test on the same inputs
+  int result(EXIT_SUCCESS);
+  vtkTable* table = tagTableNode->GetTable();
+  double resultDiceCoefficient = GetTableValue(table, 0, "Dice coefficient");
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultDiceCoefficient, diceCoefficient))
+  {
+    std::cerr << "Dice coefficient mismatch: " << resultDiceCoefficient << " instead of " << diceCoefficient << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double resultHausdorffMaximumMm = GetTableValue(table, 0, "Maximum Hausdorff distance for boundary (mm)");
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultHausdorffMaximumMm, hausdorffMaximumMm))
+  {
+    std::cerr << "Hausdorff maximum (mm) mismatch: " << resultHausdorffMaximumMm << " instead of " << hausdorffMaximumMm << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double resultHausdorffAverageMm = GetTableValue(table, 0, "Average Hausdorff distance for boundary (mm)");
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultHausdorffAverageMm, hausdorffAverageMm))
+  {
+    std::cerr << "Hausdorff average (mm) mismatch: " << resultHausdorffAverageMm << " instead of " << hausdorffAverageMm << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double resultHausdorff95PercentMm = GetTableValue(table, 0, "95% Hausdorff distance for boundary (mm)");
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultHausdorff95PercentMm, hausdorff95PercentMm))
+  {
+    std::cerr << "Hausdorff 95% mismatch: " << resultHausdorff95PercentMm << " instead of " << hausdorff95PercentMm << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double surfaceDice = GetTableValue(table, 0, "Surface Dice");
+  if (surfaceDice < 0.0 || surfaceDice > 1.0)
+  {
+    std::cerr << "Invalid surface Dice: " << surfaceDice << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // Segments are matched by name
+
+  compareSegment->SetName(referenceSegmentName.c_str());
+  vtkSmartPointer<vtkMRMLTableNode> nameTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  mrmlScene->AddNode(nameTableNode);
+  errorMessage = segmentComparisonLogic->ComputeBatchComparison(referenceSegmentationNode, compareSegmentationNode, nameTableNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "Batch comparison by name failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CheckTableAgainstNode(nameTableNode, paramNode, referenceSegmentName.c_str(), referenceSegmentName.c_str()))
+  {
+    return EXIT_FAILURE;
+  }
+
+  if (result == EXIT_SUCCESS)
+  {
+    std::cout << "Test passed." << std::endl;
+  }
+  return result;
+}
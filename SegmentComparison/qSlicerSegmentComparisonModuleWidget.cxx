@@ -423,6 +423,8 @@ void qSlicerSegmentComparisonModuleWidget::computeHausdorffClicked()
       QString("%1 mm").arg(paramNode->GetAverageHausdorffDistanceForBoundaryMm(),0,'f',2) );
     d->lineEdit_95PercentHausdorffDistanceForBoundary->setText(
       QString("%1 mm").arg(paramNode->GetPercent95HausdorffDistanceForBoundaryMm(),0,'f',2) );
+    d->lineEdit_SurfaceDice->setText(
+      QString("%1 (%2 mm tolerance)").arg(paramNode->GetSurfaceDice(),0,'f',4).arg(paramNode->GetSurfaceDiceToleranceMm()) );
   }
   else
   {
@@ -544,4 +546,5 @@ void qSlicerSegmentComparisonModuleWidget::invalidateHausdorffResults()
   d->lineEdit_MaximumHausdorffDistanceForBoundary->setText(tr("N/A"));
   d->lineEdit_AverageHausdorffDistanceForBoundary->setText(tr("N/A"));
   d->lineEdit_95PercentHausdorffDistanceForBoundary->setText(tr("N/A"));
+  d->lineEdit_SurfaceDice->setText(tr("N/A"));
 }
@@ -1,5 +1,6 @@
 import os
 import unittest
+import numpy
 import vtk, qt, ctk, slicer
 from slicer.ScriptedLoadableModule import *
 from slicer.util import VTKObservationMixin
@@ -190,13 +191,161 @@ class SegmentEditorTest(ScriptedLoadableModuleTest):
     slicer.mrmlScene.Clear(0)
 
   def runTest(self):
-    """Currently no testing functionality.
+    """Run as few or as many tests as needed here.
     """
     self.setUp()
     self.test_SegmentEditor1()
 
   def test_SegmentEditor1(self):
-    """Add test here later.
+    """Paint in a slice view and check that only the painted region is applied to the segment
+    and reported to the observers of the segmentation, then undo the change the same way.
     """
     self.delayDisplay("Starting the test")
+    import vtkSegmentationCore
+    from vtkSlicerSegmentationsModuleMRML import vtkMRMLSegmentationNode
+    from vtk.util import numpy_support
+    self.binaryLabelmapReprName = vtkSegmentationCore.vtkSegmentationConverter.GetSegmentationBinaryLabelmapRepresentationName()
+
+    # Master volume of 40x40x10 voxels with identity geometry shown in the only slice view
+    self.masterExtent = (0, 39, 0, 39, 0, 9)
+    masterImage = vtk.vtkImageData()
+    masterImage.SetExtent(self.masterExtent)
+    masterImage.AllocateScalars(vtk.VTK_SHORT, 1)
+    masterImage.GetPointData().GetScalars().Fill(0)
+    masterVolumeNode = slicer.vtkMRMLScalarVolumeNode()
+    masterVolumeNode.SetName('Master')
+    masterVolumeNode.SetAndObserveImageData(masterImage)
+    slicer.mrmlScene.AddNode(masterVolumeNode)
+    masterDisplayNode = slicer.vtkMRMLScalarVolumeDisplayNode()
+    slicer.mrmlScene.AddNode(masterDisplayNode)
+    masterDisplayNode.SetAndObserveColorNodeID('vtkMRMLColorTableNodeGrey')
+    masterVolumeNode.SetAndObserveDisplayNodeID(masterDisplayNode.GetID())
+
+    layoutManager = slicer.app.layoutManager()
+    layoutManager.setLayout(slicer.vtkMRMLLayoutNode.SlicerLayoutOneUpRedSliceView)
+    selectionNode = slicer.app.applicationLogic().GetSelectionNode()
+    selectionNode.SetReferenceActiveVolumeID(masterVolumeNode.GetID())
+    slicer.app.applicationLogic().PropagateVolumeSelection(0)
+    sliceWidget = layoutManager.sliceWidget('Red')
+    sliceWidget.sliceLogic().FitSliceToAll()
+    sliceWidget.sliceLogic().SetSliceOffset(5.0)
+    slicer.app.processEvents()
+
+    # Segment labelmap in the master geometry, covering the master volume, with a box of foreground voxels
+    segmentLabelmap = vtkSegmentationCore.vtkOrientedImageData()
+    segmentLabelmap.SetExtent(self.masterExtent)
+    segmentLabelmap.AllocateScalars(vtk.VTK_UNSIGNED_CHAR, 1)
+    segmentLabelmap.GetPointData().GetScalars().Fill(0)
+    for k in xrange(2, 8):
+      for j in xrange(4, 10):
+        for i in xrange(4, 10):
+          segmentLabelmap.SetScalarComponentFromDouble(i, j, k, 0, 1)
+    segment = vtkSegmentationCore.vtkSegment()
+    segment.SetName('Box')
+    segment.AddRepresentation(self.binaryLabelmapReprName, segmentLabelmap)
+    segmentationNode = vtkMRMLSegmentationNode()
+    segmentationNode.SetName('Segmentation')
+    slicer.mrmlScene.AddNode(segmentationNode)
+    segmentationNode.CreateDefaultDisplayNodes()
+    segmentationNode.GetSegmentation().SetMasterRepresentationName(self.binaryLabelmapReprName)
+    self.assertTrue(segmentationNode.GetSegmentation().AddSegment(segment, 'Box'))
+
+    # Edit the segment in the Segment Editor module
+    slicer.util.selectModule('SegmentEditor')
+    editor = slicer.modules.SegmentEditorWidget.editor
+    editorNode = editor.mrmlSegmentEditorNode()
+    self.assertIsNotNone(editorNode)
+    editor.setSegmentationNode(segmentationNode)
+    editor.setMasterVolumeNode(masterVolumeNode)
+    editorNode.SetSelectedSegmentID('Box')
+    editor.updateWidgetFromMRML()
+    self.assertEqual(editorNode.GetEditedLabelmap().GetExtent(), self.masterExtent)
+
+    self.segmentRegionModifiedCount = 0
+    def onSegmentRegionModified(caller, event):
+      self.segmentRegionModifiedCount += 1
+    regionObserverTag = segmentationNode.AddObserver(vtkMRMLSegmentationNode.SegmentRegionModified, onSegmentRegionModified)
+
+    def segmentVoxels():
+      labelmap = segmentationNode.GetSegmentation().GetSegment('Box').GetRepresentation(self.binaryLabelmapReprName)
+      # The labelmap is updated in place, so it keeps the extent of the master volume instead of being shrunk
+      self.assertEqual(labelmap.GetExtent(), self.masterExtent)
+      return numpy_support.vtk_to_numpy(labelmap.GetPointData().GetScalars()).reshape(10, 40, 40).copy()
+
+    def editedVoxels():
+      labelmap = editorNode.GetEditedLabelmap()
+      return numpy_support.vtk_to_numpy(labelmap.GetPointData().GetScalars()).reshape(10, 40, 40).copy()
+
+    def click(ras):
+      rasToXy = vtk.vtkMatrix4x4()
+      vtk.vtkMatrix4x4.Invert(sliceWidget.sliceLogic().GetSliceNode().GetXYToRAS(), rasToXy)
+      xy = rasToXy.MultiplyPoint(ras + [1.0])
+      interactor = sliceWidget.sliceView().interactorStyle().GetInteractor()
+      interactor.SetEventPosition(int(round(xy[0])), int(round(xy[1])))
+      interactor.InvokeEvent(vtk.vtkCommand.LeftButtonPressEvent)
+      interactor.InvokeEvent(vtk.vtkCommand.LeftButtonReleaseEvent)
+
+    emptyExtent = (0, -1, 0, -1, 0, -1)
+    editor.activeEffect = editor.effectByName('Paint')
+    paintEffect = editor.activeEffect
+    paintEffect.setParameter('Radius', 3.0)
+    paintEffect.setParameter('PixelMode', 0)
+
+    self.delayDisplay("Paint with brush")
+    voxelsBefore = segmentVoxels()
+    click([20.0, 20.0, 5.0])
+    voxelsAfter = segmentVoxels()
+    changedK, changedJ, changedI = numpy.nonzero(voxelsAfter != voxelsBefore)
+    self.assertGreater(len(changedI), 0)
+    self.assertTrue((changedK == 5).all())
+    self.assertTrue((abs(changedI - 20) <= 4).all() and (abs(changedJ - 20) <= 4).all())
+    self.assertTrue((voxelsAfter[changedK, changedJ, changedI] == 1).all())
+    self.assertTrue((editedVoxels() == voxelsAfter).all())
+    self.assertEqual(self.segmentRegionModifiedCount, 1)
+    self.assertEqual(editorNode.GetEditedLabelmapModifiedExtent(), emptyExtent)
+
+    self.delayDisplay("Paint a pixel")
+    paintEffect.setParameter('PixelMode', 1)
+    voxelsBefore = voxelsAfter
+    click([30.0, 10.0, 5.0])
+    voxelsAfter = segmentVoxels()
+    self.assertEqual(numpy.count_nonzero(voxelsAfter != voxelsBefore), 1)
+    self.assertEqual(voxelsAfter[5, 10, 30], 1)
+    self.assertTrue((editedVoxels() == voxelsAfter).all())
+    # Button release after an immediately applied point does not apply again
+    self.assertEqual(self.segmentRegionModifiedCount, 2)
+    self.assertEqual(editorNode.GetEditedLabelmapModifiedExtent(), emptyExtent)
+
+    self.delayDisplay("Undo the pixel")
+    editor.undo()
+    self.assertTrue((segmentVoxels() == voxelsBefore).all())
+    self.assertTrue((editedVoxels() == voxelsBefore).all())
+    self.assertEqual(self.segmentRegionModifiedCount, 3)
+    self.assertEqual(editorNode.GetEditedLabelmapModifiedExtent(), emptyExtent)
+
+    self.delayDisplay("Apply a change that is not reported by the effect")
+    voxelsBefore = segmentVoxels()
+    editorNode.GetEditedLabelmap().SetScalarComponentFromDouble(35, 35, 8, 0, 1)
+    editorNode.GetEditedLabelmap().Modified()
+    editor.applyChangesToSelectedSegment()
+    voxelsAfter = segmentVoxels()
+    self.assertEqual(numpy.count_nonzero(voxelsAfter != voxelsBefore), 1)
+    self.assertEqual(voxelsAfter[8, 35, 35], 1)
+    self.assertEqual(self.segmentRegionModifiedCount, 4)
+
+    self.delayDisplay("Modify the segment outside the editor")
+    # The history cannot restore the segment consistently anymore, so undo does not change it
+    segmentLabelmap.SetScalarComponentFromDouble(0, 0, 0, 0, 1)
+    segmentLabelmap.Modified()
+    voxelsBefore = segmentVoxels()
+    editor.undo()
+    self.assertTrue((segmentVoxels() == voxelsBefore).all())
+    self.assertEqual(self.segmentRegionModifiedCount, 4)
+
+    # The region of an operation interrupted by switching effects is discarded
+    editorNode.AddEditedLabelmapModifiedExtent([0, 3, 0, 3, 0, 3])
+    editor.activeEffect = None
+    self.assertEqual(editorNode.GetEditedLabelmapModifiedExtent(), emptyExtent)
+
+    segmentationNode.RemoveObserver(regionObserverTag)
     self.delayDisplay('Test passed!')
@@ -0,0 +1,477 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkLabelmapBooleanExpression.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLabelmapBooleanExpression);
+vtkCxxSetObjectMacro(vtkLabelmapBooleanExpression, OutputLabelmap, vtkOrientedImageData);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Runs of consecutive segment voxels in a row: first and last I index of each run, in increasing order
+  typedef std::vector<std::pair<int, int> > RunList;
+
+  /// Run length encoded labelmap. Rows are indexed within the encoded extent.
+  struct RunLengthLabelmap
+  {
+    RunLengthLabelmap()
+    {
+      this->Extent[0] = this->Extent[2] = this->Extent[4] = 0;
+      this->Extent[1] = this->Extent[3] = this->Extent[5] = -1;
+      this->EffectiveExtent[0] = this->EffectiveExtent[2] = this->EffectiveExtent[4] = VTK_INT_MAX;
+      this->EffectiveExtent[1] = this->EffectiveExtent[3] = this->EffectiveExtent[5] = VTK_INT_MIN;
+    };
+
+    /// Append the runs of a row to the end of a run list
+    void AppendRow(int j, int k, RunList& runs) const
+    {
+      if (j < this->EffectiveExtent[2] || j > this->EffectiveExtent[3] || k < this->EffectiveExtent[4] || k > this->EffectiveExtent[5])
+      {
+        return;
+      }
+      vtkIdType rowIndex = (vtkIdType)(k-this->Extent[4]) * (this->Extent[3]-this->Extent[2]+1) + (j-this->Extent[2]);
+      runs.insert(runs.end(), this->Runs.begin() + this->RowStarts[rowIndex], this->Runs.begin() + this->RowStarts[rowIndex+1]);
+    }
+
+    /// Extent of the encoded rows
+    int Extent[6];
+    /// Extent of the segment voxels, reversed if there are none
+    int EffectiveExtent[6];
+    /// Index of the first run of each row in Runs, with an extra element at the end
+    std::vector<vtkIdType> RowStarts;
+    RunList Runs;
+  };
+
+  /// Encode the non-zero voxels of an image into runs. Only the rows of the effective extent are encoded
+  template <class T>
+  void EncodeRunLength(T* scalarPointer, vtkImageData* image, RunLengthLabelmap& encoded)
+  {
+    encoded.RowStarts.clear();
+    encoded.Runs.clear();
+    if (!vtkOrientedImageDataResample::CalculateEffectiveExtent(image, encoded.Extent))
+    {
+      // Reversed effective extent does not change the box of a union
+      encoded.RowStarts.push_back(0);
+      return;
+    }
+    std::copy(encoded.Extent, encoded.Extent+6, encoded.EffectiveExtent);
+
+    const int* extent = encoded.Extent;
+    int imageExtent[6] = {0,-1,0,-1,0,-1};
+    image->GetExtent(imageExtent);
+    vtkIdType increments[3] = {0,0,0};
+    image->GetIncrements(increments);
+    encoded.RowStarts.reserve((size_t)(extent[3]-extent[2]+1) * (extent[5]-extent[4]+1) + 1);
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        encoded.RowStarts.push_back((vtkIdType)encoded.Runs.size());
+        T* row = scalarPointer + (k-imageExtent[4])*increments[2] + (j-imageExtent[2])*increments[1] + (extent[0]-imageExtent[0])*increments[0];
+        int runStart = VTK_INT_MAX;
+        for (int i=extent[0]; i<=extent[1]; ++i, row+=increments[0])
+        {
+          if (*row != 0)
+          {
+            if (runStart == VTK_INT_MAX)
+            {
+              runStart = i;
+            }
+          }
+          else if (runStart != VTK_INT_MAX)
+          {
+            encoded.Runs.push_back(std::make_pair(runStart, i-1));
+            runStart = VTK_INT_MAX;
+          }
+        }
+        if (runStart != VTK_INT_MAX)
+        {
+          encoded.Runs.push_back(std::make_pair(runStart, extent[1]));
+        }
+      }
+    }
+    encoded.RowStarts.push_back((vtkIdType)encoded.Runs.size());
+  }
+
+  /// Append a run to a run list, merging it with the last run if they touch
+  inline void AppendRun(RunList& runs, int start, int end)
+  {
+    if (!runs.empty() && start <= runs.back().second + 1)
+    {
+      runs.back().second = std::max(runs.back().second, end);
+    }
+    else
+    {
+      runs.push_back(std::make_pair(start, end));
+    }
+  }
+
+  /// Combine two run lists of a row
+  void ApplyOperation(int operation, const RunList& a, const RunList& b, RunList& result)
+  {
+    result.clear();
+    RunList::const_iterator aIt = a.begin();
+    RunList::const_iterator bIt = b.begin();
+    switch (operation)
+    {
+    case vtkLabelmapBooleanExpression::Union:
+      while (aIt != a.end() || bIt != b.end())
+      {
+        if (bIt == b.end() || (aIt != a.end() && aIt->first <= bIt->first))
+        {
+          AppendRun(result, aIt->first, aIt->second);
+          ++aIt;
+        }
+        else
+        {
+          AppendRun(result, bIt->first, bIt->second);
+          ++bIt;
+        }
+      }
+      break;
+    case vtkLabelmapBooleanExpression::Intersect:
+      while (aIt != a.end() && bIt != b.end())
+      {
+        int start = std::max(aIt->first, bIt->first);
+        int end = std::min(aIt->second, bIt->second);
+        if (start <= end)
+        {
+          result.push_back(std::make_pair(start, end));
+        }
+        if (aIt->second < bIt->second)
+        {
+          ++aIt;
+        }
+        else
+        {
+          ++bIt;
+        }
+      }
+      break;
+    case vtkLabelmapBooleanExpression::Subtract:
+      for (; aIt != a.end(); ++aIt)
+      {
+        int start = aIt->first;
+        // Skip runs of B that end before the current run of A. They cannot affect later runs of A either
+        while (bIt != b.end() && bIt->second < start)
+        {
+          ++bIt;
+        }
+        for (RunList::const_iterator cutIt = bIt; cutIt != b.end() && cutIt->first <= aIt->second; ++cutIt)
+        {
+          if (cutIt->first > start)
+          {
+            result.push_back(std::make_pair(start, cutIt->first-1));
+          }
+          start = std::max(start, cutIt->second+1);
+        }
+        if (start <= aIt->second)
+        {
+          result.push_back(std::make_pair(start, aIt->second));
+        }
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  /// Set voxels of the runs in an image row starting at the given I index
+  template <class T>
+  void FillRunsInRow(T* row, int firstI, const RunList& runs, double value)
+  {
+    T segmentValue = static_cast<T>(value);
+    for (RunList::const_iterator runIt = runs.begin(); runIt != runs.end(); ++runIt)
+    {
+      std::fill(row + (runIt->first-firstI), row + (runIt->second-firstI+1), segmentValue);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapBooleanExpression::vtkLabelmapBooleanExpression()
+{
+  this->OutputLabelmap = NULL;
+  this->OutputValue = 1.0;
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapBooleanExpression::~vtkLabelmapBooleanExpression()
+{
+  this->SetOutputLabelmap(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapBooleanExpression::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfInputLabelmaps: " << this->InputLabelmaps.size() << "\n";
+  os << indent << "Expression:";
+  const char* operationSymbols[3] = { "|", "&", "-" };
+  for (std::vector<ExpressionTerm>::iterator termIt = this->Expression.begin(); termIt != this->Expression.end(); ++termIt)
+  {
+    if (termIt->IsOperand)
+    {
+      os << " " << termIt->Value;
+    }
+    else
+    {
+      os << " " << (termIt->Value >= Union && termIt->Value <= Subtract ? operationSymbols[termIt->Value] : "?");
+    }
+  }
+  os << "\n";
+  os << indent << "OutputValue: " << this->OutputValue << "\n";
+}
+
+//----------------------------------------------------------------------------
+int vtkLabelmapBooleanExpression::AddInputLabelmap(vtkOrientedImageData* labelmap)
+{
+  this->InputLabelmaps.push_back(labelmap);
+  this->Modified();
+  return (int)this->InputLabelmaps.size() - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapBooleanExpression::RemoveAllInputLabelmaps()
+{
+  this->InputLabelmaps.clear();
+  this->Expression.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapBooleanExpression::AddOperandToExpression(int inputIndex)
+{
+  ExpressionTerm term;
+  term.IsOperand = true;
+  term.Value = inputIndex;
+  this->Expression.push_back(term);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapBooleanExpression::AddOperationToExpression(int operation)
+{
+  ExpressionTerm term;
+  term.IsOperand = false;
+  term.Value = operation;
+  this->Expression.push_back(term);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapBooleanExpression::ClearExpression()
+{
+  this->Expression.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkLabelmapBooleanExpression::Compute()
+{
+  this->SetOutputLabelmap(NULL);
+
+  // Validate inputs and expression
+  if ( this->InputLabelmaps.empty() || !this->InputLabelmaps[0]
+    || !this->InputLabelmaps[0]->GetPointData()->GetScalars() )
+  {
+    vtkErrorMacro("Compute: Invalid first input labelmap!");
+    return false;
+  }
+  int depth = 0;
+  for (std::vector<ExpressionTerm>::iterator termIt = this->Expression.begin(); termIt != this->Expression.end(); ++termIt)
+  {
+    if (termIt->IsOperand)
+    {
+      if ( termIt->Value < 0 || termIt->Value >= (int)this->InputLabelmaps.size()
+        || !this->InputLabelmaps[termIt->Value] || !this->InputLabelmaps[termIt->Value]->GetPointData()->GetScalars() )
+      {
+        vtkErrorMacro("Compute: Invalid input labelmap " << termIt->Value << " in expression!");
+        return false;
+      }
+      ++depth;
+    }
+    else if (termIt->Value < Union || termIt->Value > Subtract || depth < 2)
+    {
+      vtkErrorMacro("Compute: Invalid operation " << termIt->Value << " in expression!");
+      return false;
+    }
+    else
+    {
+      --depth;
+    }
+  }
+  if (depth != 1)
+  {
+    vtkErrorMacro("Compute: Expression must combine the operands into a single result!");
+    return false;
+  }
+
+  // Encode inputs. They are sampled on the lattice of the first input, including their whole extent.
+  // Linear interpolation is used so that the resampled voxels are the same as in earlier versions of the
+  // segment morphology logic, which resampled segment B this way
+  vtkOrientedImageData* referenceLabelmap = this->InputLabelmaps[0];
+  std::vector<RunLengthLabelmap> encodedInputs(this->InputLabelmaps.size());
+  for (int inputIndex=0; inputIndex<(int)this->InputLabelmaps.size(); ++inputIndex)
+  {
+    vtkSmartPointer<vtkOrientedImageData> inputLabelmap = this->InputLabelmaps[inputIndex];
+    if (!inputLabelmap || !inputLabelmap->GetPointData()->GetScalars())
+    {
+      // Inputs not used in the expression may be invalid
+      continue;
+    }
+    if (inputIndex > 0 && !vtkOrientedImageDataResample::DoGeometriesMatch(referenceLabelmap, inputLabelmap))
+    {
+      vtkSmartPointer<vtkOrientedImageData> resampledLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+      if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+        inputLabelmap, referenceLabelmap, resampledLabelmap, true, true))
+      {
+        vtkErrorMacro("Compute: Failed to resample input labelmap " << inputIndex);
+        return false;
+      }
+      inputLabelmap = resampledLabelmap;
+    }
+    switch (inputLabelmap->GetScalarType())
+    {
+      vtkTemplateMacro(EncodeRunLength(static_cast<VTK_TT*>(inputLabelmap->GetScalarPointer()), inputLabelmap, encodedInputs[inputIndex]));
+    }
+  }
+
+  // Rows outside the box cannot contain result voxels: union extends, intersection narrows the box,
+  // and subtraction keeps the box of the minuend
+  std::vector<std::vector<int> > extentStack;
+  for (std::vector<ExpressionTerm>::iterator termIt = this->Expression.begin(); termIt != this->Expression.end(); ++termIt)
+  {
+    if (termIt->IsOperand)
+    {
+      const int* effectiveExtent = encodedInputs[termIt->Value].EffectiveExtent;
+      extentStack.push_back(std::vector<int>(effectiveExtent, effectiveExtent+6));
+      continue;
+    }
+    std::vector<int> extentB = extentStack.back();
+    extentStack.pop_back();
+    std::vector<int>& extentA = extentStack.back();
+    for (int axis=0; axis<3; ++axis)
+    {
+      if (termIt->Value == Union)
+      {
+        extentA[2*axis] = std::min(extentA[2*axis], extentB[2*axis]);
+        extentA[2*axis+1] = std::max(extentA[2*axis+1], extentB[2*axis+1]);
+      }
+      else if (termIt->Value == Intersect)
+      {
+        extentA[2*axis] = std::max(extentA[2*axis], extentB[2*axis]);
+        extentA[2*axis+1] = std::min(extentA[2*axis+1], extentB[2*axis+1]);
+      }
+    }
+  }
+  std::vector<int> boxExtent = extentStack.back();
+
+  // Evaluate the expression row by row. Run lists of the stack are reused between rows
+  RunLengthLabelmap result;
+  std::copy(boxExtent.begin(), boxExtent.end(), result.Extent);
+  std::vector<RunList> runStack(this->Expression.size());
+  RunList operationResult;
+  for (int k=boxExtent[4]; k<=boxExtent[5]; ++k)
+  {
+    for (int j=boxExtent[2]; j<=boxExtent[3]; ++j)
+    {
+      depth = 0;
+      for (std::vector<ExpressionTerm>::iterator termIt = this->Expression.begin(); termIt != this->Expression.end(); ++termIt)
+      {
+        if (termIt->IsOperand)
+        {
+          runStack[depth].clear();
+          encodedInputs[termIt->Value].AppendRow(j, k, runStack[depth]);
+          ++depth;
+        }
+        else
+        {
+          ApplyOperation(termIt->Value, runStack[depth-2], runStack[depth-1], operationResult);
+          runStack[depth-2].swap(operationResult);
+          --depth;
+        }
+      }
+
+      result.RowStarts.push_back((vtkIdType)result.Runs.size());
+      const RunList& rowRuns = runStack[0];
+      if (rowRuns.empty())
+      {
+        continue;
+      }
+      result.Runs.insert(result.Runs.end(), rowRuns.begin(), rowRuns.end());
+      result.EffectiveExtent[0] = std::min(result.EffectiveExtent[0], rowRuns.front().first);
+      result.EffectiveExtent[1] = std::max(result.EffectiveExtent[1], rowRuns.back().second);
+      result.EffectiveExtent[2] = std::min(result.EffectiveExtent[2], j);
+      result.EffectiveExtent[3] = std::max(result.EffectiveExtent[3], j);
+      result.EffectiveExtent[4] = std::min(result.EffectiveExtent[4], k);
+      result.EffectiveExtent[5] = std::max(result.EffectiveExtent[5], k);
+    }
+  }
+  result.RowStarts.push_back((vtkIdType)result.Runs.size());
+
+  // Write output cropped to the result. Empty result has empty extent
+  int outputExtent[6] = {0,-1,0,-1,0,-1};
+  if (!result.Runs.empty())
+  {
+    std::copy(result.EffectiveExtent, result.EffectiveExtent+6, outputExtent);
+  }
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceLabelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+  vtkSmartPointer<vtkOrientedImageData> outputLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  outputLabelmap->SetExtent(outputExtent);
+  outputLabelmap->SetGeometryFromImageToWorldMatrix(imageToWorldMatrix);
+  outputLabelmap->AllocateScalars(referenceLabelmap->GetScalarType(), 1);
+  if (!result.Runs.empty())
+  {
+    outputLabelmap->GetPointData()->GetScalars()->FillComponent(0, 0.0);
+    RunList rowRuns;
+    for (int k=outputExtent[4]; k<=outputExtent[5]; ++k)
+    {
+      for (int j=outputExtent[2]; j<=outputExtent[3]; ++j)
+      {
+        rowRuns.clear();
+        result.AppendRow(j, k, rowRuns);
+        switch (outputLabelmap->GetScalarType())
+        {
+          vtkTemplateMacro(FillRunsInRow(static_cast<VTK_TT*>(outputLabelmap->GetScalarPointer(outputExtent[0], j, k)), outputExtent[0], rowRuns, this->OutputValue));
+        }
+      }
+    }
+  }
+
+  this->SetOutputLabelmap(outputLabelmap);
+  return true;
+}
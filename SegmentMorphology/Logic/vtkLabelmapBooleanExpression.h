@@ -0,0 +1,115 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkLabelmapBooleanExpression - Evaluate boolean expressions of binary labelmaps
+// .SECTION Description
+// Computes the union, intersection and difference of any number of binary labelmaps (non-zero voxels
+// belong to the segment) in a single pass. The expression is given in postfix order, for example
+// A - (B | C) is: operand A, operand B, operand C, union, subtract.
+//
+// Each input is encoded once into run lists (runs of consecutive segment voxels in each image row),
+// and the expression is evaluated row by row on the run lists, so no intermediate volumes are allocated.
+// Only the rows that can contain the result are visited, and the output is cropped to the extent of
+// the result. All inputs are sampled on the lattice of the first input. Inputs with a different geometry
+// are resampled with linear interpolation, the same way as the segment morphology logic did before.
+
+#ifndef __vtkLabelmapBooleanExpression_h
+#define __vtkLabelmapBooleanExpression_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerSegmentMorphologyModuleLogicExport.h"
+
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_SegmentMorphology
+class VTK_SLICER_SEGMENTMORPHOLOGY_MODULE_LOGIC_EXPORT vtkLabelmapBooleanExpression : public vtkObject
+{
+public:
+  enum BooleanOperationType
+  {
+    Union,
+    Intersect,
+    Subtract
+  };
+
+public:
+  static vtkLabelmapBooleanExpression *New();
+  vtkTypeMacro(vtkLabelmapBooleanExpression, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Evaluate the expression on the input labelmaps
+  /// \return Success. Fails if the inputs or the expression are invalid
+  bool Compute();
+
+public:
+  /// Add input labelmap that can be used as operand in the expression
+  /// \return Index of the input
+  int AddInputLabelmap(vtkOrientedImageData* labelmap);
+  /// Remove all input labelmaps and clear the expression
+  void RemoveAllInputLabelmaps();
+  /// Get number of input labelmaps
+  int GetNumberOfInputLabelmaps() { return (int)this->InputLabelmaps.size(); };
+
+  /// Append input labelmap to the expression (postfix order)
+  void AddOperandToExpression(int inputIndex);
+  /// Append operation to the expression (postfix order). It is applied on the two preceding terms
+  void AddOperationToExpression(int operation);
+  /// Clear the expression, keep the inputs
+  void ClearExpression();
+
+  /// Get output labelmap. It has the geometry and scalar type of the first input, cropped to the extent of the result
+  vtkGetObjectMacro(OutputLabelmap, vtkOrientedImageData);
+
+  /// Value of the segment voxels in the output labelmap
+  vtkGetMacro(OutputValue, double);
+  vtkSetMacro(OutputValue, double);
+
+protected:
+  void SetOutputLabelmap(vtkOrientedImageData* labelmap);
+
+protected:
+  /// Term of the expression: operand (input index) or operation
+  struct ExpressionTerm
+  {
+    bool IsOperand;
+    int Value;
+  };
+
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > InputLabelmaps;
+  std::vector<ExpressionTerm> Expression;
+  vtkOrientedImageData* OutputLabelmap;
+  double OutputValue;
+
+protected:
+  vtkLabelmapBooleanExpression();
+  virtual ~vtkLabelmapBooleanExpression();
+
+private:
+  vtkLabelmapBooleanExpression(const vtkLabelmapBooleanExpression&); // Not implemented
+  void operator=(const vtkLabelmapBooleanExpression&);               // Not implemented
+};
+
+#endif
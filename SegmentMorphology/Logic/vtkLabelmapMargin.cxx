@@ -0,0 +1,198 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkLabelmapMargin.h"
+
+// SlicerRT includes
+#include "vtkLabelmapDistanceTransform.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLabelmapMargin);
+vtkCxxSetObjectMacro(vtkLabelmapMargin, InputLabelmap, vtkOrientedImageData);
+vtkCxxSetObjectMacro(vtkLabelmapMargin, OutputLabelmap, vtkOrientedImageData);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Tolerance of the scaled distance so that voxels exactly on the margin are included
+  const double MARGIN_TOLERANCE = 1.0e-4;
+
+  /// Get the semi-axis of the ellipsoidal kernel in voxels along an axis. The kernel size is the one that
+  /// vtkImageContinuousDilate3D and vtkImageContinuousErode3D were used with earlier (odd number of voxels
+  /// nearest to twice the margin plus one), and its semi-axis is half of the size as in these filters.
+  double GetKernelSemiAxisVoxels(double marginMm, double spacing)
+  {
+    int kernelSize = (int)( 2.0*(marginMm/spacing + 0.5) );
+    return std::max(kernelSize, 1) * 0.5;
+  }
+
+  /// Write output voxels from the squared scaled distances computed on a box containing the output extent.
+  /// When expanding, voxels within the margin of the segment are set. When shrinking, voxels farther than
+  /// the margin from the background are set.
+  template <class T>
+  void FillOutputFromDistances(T* scalarPointer, vtkImageData* output, const std::vector<float>& squaredDistances,
+    const int boxExtent[6], bool expand, double outputValue)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    output->GetExtent(extent);
+    int boxDimensions[3] = { boxExtent[1]-boxExtent[0]+1, boxExtent[3]-boxExtent[2]+1, boxExtent[5]-boxExtent[4]+1 };
+    const float threshold = (float)(1.0 + MARGIN_TOLERANCE);
+    T segmentValue = static_cast<T>(outputValue);
+    T* voxel = scalarPointer;
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        const float* distanceRow = &(squaredDistances[((vtkIdType)(k-boxExtent[4])*boxDimensions[1] + (j-boxExtent[2]))*boxDimensions[0] + (extent[0]-boxExtent[0])]);
+        for (int i=extent[0]; i<=extent[1]; ++i, ++voxel, ++distanceRow)
+        {
+          bool withinMargin = (*distanceRow <= threshold);
+          *voxel = (withinMargin == expand ? segmentValue : 0);
+        }
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapMargin::vtkLabelmapMargin()
+{
+  this->InputLabelmap = NULL;
+  this->OutputLabelmap = NULL;
+  this->MarginMm[0] = this->MarginMm[1] = this->MarginMm[2] = 0.0;
+  this->Operation = Expand;
+  this->OutputValue = 1.0;
+  this->NumberOfThreads = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapMargin::~vtkLabelmapMargin()
+{
+  this->SetInputLabelmap(NULL);
+  this->SetOutputLabelmap(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapMargin::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "MarginMm: " << this->MarginMm[0] << ", " << this->MarginMm[1] << ", " << this->MarginMm[2] << "\n";
+  os << indent << "Operation: " << (this->Operation == Expand ? "Expand" : "Shrink") << "\n";
+  os << indent << "OutputValue: " << this->OutputValue << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+}
+
+//----------------------------------------------------------------------------
+bool vtkLabelmapMargin::Compute()
+{
+  this->SetOutputLabelmap(NULL);
+
+  if (!this->InputLabelmap || !this->InputLabelmap->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("Compute: Invalid input labelmap!");
+    return false;
+  }
+  if (this->Operation != Expand && this->Operation != Shrink)
+  {
+    vtkErrorMacro("Compute: Invalid operation " << this->Operation);
+    return false;
+  }
+  if (this->MarginMm[0] < 0.0 || this->MarginMm[1] < 0.0 || this->MarginMm[2] < 0.0)
+  {
+    vtkErrorMacro("Compute: Margins must not be negative!");
+    return false;
+  }
+  bool expand = (this->Operation == Expand);
+
+  vtkSmartPointer<vtkOrientedImageData> outputLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  int effectiveExtent[6] = {0,-1,0,-1,0,-1};
+  if (!vtkOrientedImageDataResample::CalculateEffectiveExtent(this->InputLabelmap, effectiveExtent))
+  {
+    // Empty segment remains empty
+    outputLabelmap->DeepCopy(this->InputLabelmap);
+    this->SetOutputLabelmap(outputLabelmap);
+    return true;
+  }
+
+  // Scale the distances so that the semi-axes of the kernel are at unit distance along each axis. Along
+  // axes without margin the semi-axis is half voxel, so any neighbor is farther than that.
+  double spacing[3] = {1.0, 1.0, 1.0};
+  this->InputLabelmap->GetSpacing(spacing);
+  double scaledSpacing[3] = {2.0, 2.0, 2.0};
+  int marginVoxels[3] = {0, 0, 0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    double semiAxisVoxels = GetKernelSemiAxisVoxels(this->MarginMm[axis], fabs(spacing[axis]));
+    scaledSpacing[axis] = 1.0 / semiAxisVoxels;
+    marginVoxels[axis] = (int)floor(semiAxisVoxels * (1.0 + MARGIN_TOLERANCE));
+  }
+
+  // Expanded segment may grow by the margin beyond its bounding box (and the input extent). When shrinking
+  // the bounding box only needs one layer of background around it, as any background voxel outside has
+  // a nearer one in that layer.
+  int boxExtent[6] = {0,-1,0,-1,0,-1};
+  int outputExtent[6] = {0,-1,0,-1,0,-1};
+  for (int axis=0; axis<3; ++axis)
+  {
+    int boxMargin = (expand ? marginVoxels[axis] : 1);
+    boxExtent[2*axis] = effectiveExtent[2*axis] - boxMargin;
+    boxExtent[2*axis+1] = effectiveExtent[2*axis+1] + boxMargin;
+    outputExtent[2*axis] = (expand ? boxExtent[2*axis] : effectiveExtent[2*axis]);
+    outputExtent[2*axis+1] = (expand ? boxExtent[2*axis+1] : effectiveExtent[2*axis+1]);
+  }
+  int boxDimensions[3] = { boxExtent[1]-boxExtent[0]+1, boxExtent[3]-boxExtent[2]+1, boxExtent[5]-boxExtent[4]+1 };
+
+  // Features are the segment voxels when expanding and the background voxels when shrinking
+  std::vector<unsigned char> featureMask((size_t)boxDimensions[0]*boxDimensions[1]*boxDimensions[2]);
+  vtkOrientedImageDataResample::FillMaskFromImage(this->InputLabelmap, boxExtent, &(featureMask[0]), !expand);
+  std::vector<float> squaredDistances(featureMask.size(), 0.0f);
+  vtkLabelmapDistanceTransform::ComputeSquaredDistances(&(featureMask[0]), boxDimensions, scaledSpacing, &(squaredDistances[0]), this->NumberOfThreads);
+  featureMask.clear();
+
+  // Output has the same lattice as the input, so the extent is enough to position it
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->InputLabelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+  outputLabelmap->SetExtent(outputExtent);
+  outputLabelmap->SetGeometryFromImageToWorldMatrix(imageToWorldMatrix);
+  outputLabelmap->AllocateScalars(this->InputLabelmap->GetScalarType(), 1);
+  switch (outputLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro(FillOutputFromDistances(static_cast<VTK_TT*>(outputLabelmap->GetScalarPointer()), outputLabelmap, squaredDistances, boxExtent, expand, this->OutputValue));
+  }
+
+  this->SetOutputLabelmap(outputLabelmap);
+  return true;
+}
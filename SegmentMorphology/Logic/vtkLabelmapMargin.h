@@ -0,0 +1,110 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkLabelmapMargin - Expand or shrink a binary labelmap by an ellipsoidal margin
+// .SECTION Description
+// Grows or shrinks the non-zero region of a labelmap by a margin that can be different along each
+// axis of the image. A voxel is within the margin if the ellipsoidal kernel centered on the voxel
+// contains a voxel of the segment (expand) or of the background (shrink). The kernel is the same as
+// the one of the vtkImageContinuousDilate3D and vtkImageContinuousErode3D filters that were used
+// earlier with the kernel size int(2*(margin/spacing+0.5)) voxels along each axis, i.e. its semi-axes
+// are half of the kernel size. For odd kernel sizes the result is identical to these filters.
+//
+// The margin is computed from an exact Euclidean distance transform (\sa vtkLabelmapDistanceTransform)
+// with the voxel spacing divided by the semi-axes, so within the kernel the scaled distance is at most one.
+// The cost is linear in the number of voxels and does not depend on the margin size. Only the bounding
+// box of the segment (grown by the margin when expanding) is processed, and the output is cropped to it.
+
+#ifndef __vtkLabelmapMargin_h
+#define __vtkLabelmapMargin_h
+
+// VTK includes
+#include <vtkObject.h>
+
+#include "vtkSlicerSegmentMorphologyModuleLogicExport.h"
+
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_SegmentMorphology
+class VTK_SLICER_SEGMENTMORPHOLOGY_MODULE_LOGIC_EXPORT vtkLabelmapMargin : public vtkObject
+{
+public:
+  enum MarginOperationType
+  {
+    Expand,
+    Shrink
+  };
+
+public:
+  static vtkLabelmapMargin *New();
+  vtkTypeMacro(vtkLabelmapMargin, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Compute output labelmap from the input labelmap
+  /// \return Success
+  bool Compute();
+
+public:
+  /// Set input segment labelmap
+  void SetInputLabelmap(vtkOrientedImageData* labelmap);
+  vtkGetObjectMacro(InputLabelmap, vtkOrientedImageData);
+
+  /// Get output labelmap. It has the geometry and scalar type of the input, cropped to the processed region
+  vtkGetObjectMacro(OutputLabelmap, vtkOrientedImageData);
+
+  /// Margin along the I, J, K axes of the input image in mm. Zero means no change along the axis
+  vtkGetVector3Macro(MarginMm, double);
+  vtkSetVector3Macro(MarginMm, double);
+
+  /// Operation to perform, expand by default
+  vtkGetMacro(Operation, int);
+  vtkSetMacro(Operation, int);
+  void SetOperationToExpand() { this->SetOperation(Expand); };
+  void SetOperationToShrink() { this->SetOperation(Shrink); };
+
+  /// Value of the segment voxels in the output labelmap
+  vtkGetMacro(OutputValue, double);
+  vtkSetMacro(OutputValue, double);
+
+  /// Number of threads used for the distance transform, the global default if zero
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
+protected:
+  void SetOutputLabelmap(vtkOrientedImageData* labelmap);
+
+protected:
+  vtkOrientedImageData* InputLabelmap;
+  vtkOrientedImageData* OutputLabelmap;
+  double MarginMm[3];
+  int Operation;
+  double OutputValue;
+  int NumberOfThreads;
+
+protected:
+  vtkLabelmapMargin();
+  virtual ~vtkLabelmapMargin();
+
+private:
+  vtkLabelmapMargin(const vtkLabelmapMargin&); // Not implemented
+  void operator=(const vtkLabelmapMargin&);    // Not implemented
+};
+
+#endif
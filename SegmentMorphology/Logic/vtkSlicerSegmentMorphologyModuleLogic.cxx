@@ -22,12 +22,13 @@
 // SegmentMorphology Logic includes
 #include "vtkSlicerSegmentMorphologyModuleLogic.h"
 #include "vtkMRMLSegmentMorphologyNode.h"
+#include "vtkLabelmapBooleanExpression.h"
+#include "vtkLabelmapMargin.h"
 
 // Segmentation includes
 #include "vtkMRMLSegmentationNode.h"
 #include "vtkSlicerSegmentationsModuleLogic.h"
 #include "vtkOrientedImageData.h"
-#include "vtkOrientedImageDataResample.h"
 
 // SlicerRT includes
 #include "SlicerRtCommon.h"
@@ -38,13 +39,9 @@
 // VTK includes
 #include <vtkGeneralTransform.h>
 #include <vtkImageAccumulate.h>
-#include <vtkImageContinuousDilate3D.h>
-#include <vtkImageContinuousErode3D.h>
-#include <vtkImageLogic.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkSmartPointer.h>
-#include <vtkImageConstantPad.h>
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerSegmentMorphologyModuleLogic);
@@ -240,42 +237,12 @@ std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation()
       vtkErrorMacro("ApplyMorphologyOperation: " << errorMessage);
       return errorMessage;
     }
-
-    // Resample image B if has a different geometry than image A
-    if (!vtkOrientedImageDataResample::DoGeometriesMatch(imageA, imageB))
-    {
-      vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(imageB, imageA, imageB, true);
-    }
-
-    // Make sure the two volumes have the same extent (otherwise logic filter crashes)
-    int aExtent[6] = {0,-1,0,-1,0,-1};
-    imageA->GetExtent(aExtent);
-    int bExtent[6] = {0,-1,0,-1,0,-1};
-    imageB->GetExtent(bExtent);
-    int unionExtent[6] = { std::min(aExtent[0],bExtent[0]), std::max(aExtent[1],bExtent[1]), std::min(aExtent[2],bExtent[2]), std::max(aExtent[3],bExtent[3]), std::min(aExtent[4],bExtent[4]), std::max(aExtent[5],bExtent[5]) };
-
-    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
-    padder->SetInputData(imageA);
-    padder->SetOutputWholeExtent(unionExtent);
-    padder->Update();
-    imageA->vtkImageData::DeepCopy(padder->GetOutput());
-    padder->SetInputData(imageB);
-    padder->Update();
-    imageB->vtkImageData::DeepCopy(padder->GetOutput());
+    // Image B is resampled to the geometry of image A by the boolean operation if needed
   }
 
-  // Get kernel size
-  double spacingA[3] = {0.0,0.0,0.0};
-  imageA->GetSpacing(spacingA);
-
-  double xSize = this->GetSegmentMorphologyNode()->GetXSize();
-  double ySize = this->GetSegmentMorphologyNode()->GetYSize();
-  double zSize = this->GetSegmentMorphologyNode()->GetZSize();
-
-  int kernelSize[3] = {1,1,1};
-  kernelSize[0] = (int)( 2.0*(xSize/spacingA[0] + 0.5) );
-  kernelSize[1] = (int)( 2.0*(ySize/spacingA[1] + 0.5) );
-  kernelSize[2] = (int)( 2.0*(zSize/spacingA[2] + 0.5) );
+  // Get margin sizes
+  double marginMm[3] = { this->GetSegmentMorphologyNode()->GetXSize(),
+    this->GetSegmentMorphologyNode()->GetYSize(), this->GetSegmentMorphologyNode()->GetZSize() };
 
   // Apply operation on image data
   vtkSmartPointer<vtkImageAccumulate> histogram = vtkSmartPointer<vtkImageAccumulate>::New();
@@ -286,81 +253,55 @@ std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation()
   vtkSmartPointer<vtkImageData> tempOutputImageData = NULL;
   switch (operation) 
   {
-  // Expand
+  // Expand and shrink
   case vtkMRMLSegmentMorphologyNode::Expand:
-    {
-    // Pad image by expansion extent (extents are fitted to the structure, dilate will reach the edge of the image)
-    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
-    padder->SetInputData(imageA);
-    int extent[6] = {0,-1,0,-1,0,-1};
-    imageA->GetExtent(extent);
-
-    // Now set the output extent to the new size
-    int expansionExtent[3] = { int(xSize/spacingA[0] + 1.0), int(ySize/spacingA[1] + 1.0), int(zSize/spacingA[2] + 1.0) }; // Rounding up
-    padder->SetOutputWholeExtent(extent[0]-expansionExtent[0], extent[1]+expansionExtent[0], extent[2]-expansionExtent[1], extent[3]+expansionExtent[1], extent[4]-expansionExtent[2], extent[5]+expansionExtent[2]);
-    padder->Update();
-
-    vtkSmartPointer<vtkImageContinuousDilate3D> dilateFilter = vtkSmartPointer<vtkImageContinuousDilate3D>::New();
-    dilateFilter->SetInputConnection(padder->GetOutputPort());
-    dilateFilter->SetKernelSize(kernelSize[0], kernelSize[1], kernelSize[2]);
-    dilateFilter->Update();
-    tempOutputImageData = dilateFilter->GetOutput();
-    break;
-    }
-
-  // Shrink
   case vtkMRMLSegmentMorphologyNode::Shrink:
     {
-    vtkSmartPointer<vtkImageContinuousErode3D> erodeFilter = vtkSmartPointer<vtkImageContinuousErode3D>::New();
-    erodeFilter->SetInputData(imageA);
-    erodeFilter->SetKernelSize(kernelSize[0], kernelSize[1], kernelSize[2]);
-    erodeFilter->Update();
-    tempOutputImageData = erodeFilter->GetOutput();
+    // Output extent is fitted to the result (the expanded segment may reach beyond the input extent)
+    vtkSmartPointer<vtkLabelmapMargin> marginFilter = vtkSmartPointer<vtkLabelmapMargin>::New();
+    marginFilter->SetInputLabelmap(imageA);
+    marginFilter->SetMarginMm(marginMm);
+    marginFilter->SetOperation(operation == vtkMRMLSegmentMorphologyNode::Expand ? vtkLabelmapMargin::Expand : vtkLabelmapMargin::Shrink);
+    marginFilter->SetOutputValue(valueMax);
+    if (!marginFilter->Compute())
+    {
+      std::string errorMessage("Failed to compute margin of segment A");
+      vtkErrorMacro("ApplyMorphologyOperation: " << errorMessage);
+      return errorMessage;
+    }
+    tempOutputImageData = marginFilter->GetOutputLabelmap();
     break;
     }
 
-  // Union
+  // Union, intersect, subtract
   case vtkMRMLSegmentMorphologyNode::Union:
+  case vtkMRMLSegmentMorphologyNode::Intersect:
+  case vtkMRMLSegmentMorphologyNode::Subtract:
     {
-    vtkSmartPointer<vtkImageLogic> logicFilter = vtkSmartPointer<vtkImageLogic>::New();
-    logicFilter->SetInput1Data(imageA);
-    logicFilter->SetInput2Data(imageB);
-    logicFilter->SetOperationToOr();
-    logicFilter->SetOutputTrueValue(valueMax);
-    logicFilter->Update();
-    tempOutputImageData = logicFilter->GetOutput();
-    break;
+    // Output extent is cropped to the result
+    vtkSmartPointer<vtkLabelmapBooleanExpression> booleanExpression = vtkSmartPointer<vtkLabelmapBooleanExpression>::New();
+    booleanExpression->AddOperandToExpression(booleanExpression->AddInputLabelmap(imageA));
+    booleanExpression->AddOperandToExpression(booleanExpression->AddInputLabelmap(imageB));
+    if (operation == vtkMRMLSegmentMorphologyNode::Union)
+    {
+      booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Union);
     }
-
-  // Intersect
-  case vtkMRMLSegmentMorphologyNode::Intersect:
+    else if (operation == vtkMRMLSegmentMorphologyNode::Intersect)
     {
-    vtkSmartPointer<vtkImageLogic> logicFilter = vtkSmartPointer<vtkImageLogic>::New();
-    logicFilter->SetInput1Data(imageA);
-    logicFilter->SetInput2Data(imageB);
-    logicFilter->SetOperationToAnd();
-    logicFilter->SetOutputTrueValue(valueMax);
-    logicFilter->Update();
-    tempOutputImageData = logicFilter->GetOutput();
-    break;
+      booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Intersect);
     }
-
-  // Subtract
-  case vtkMRMLSegmentMorphologyNode::Subtract:
+    else
+    {
+      booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Subtract);
+    }
+    booleanExpression->SetOutputValue(valueMax);
+    if (!booleanExpression->Compute())
     {
-    vtkSmartPointer<vtkImageLogic> logicFilter = vtkSmartPointer<vtkImageLogic>::New();
-    logicFilter->SetInput1Data(imageB);
-    logicFilter->SetOperationToNot();
-    logicFilter->SetOutputTrueValue(valueMax);
-    logicFilter->Update();
-
-    vtkSmartPointer<vtkImageLogic> logicFilter2 = vtkSmartPointer<vtkImageLogic>::New();
-    logicFilter2->SetInput1Data(imageA);
-    logicFilter2->SetInput2Data(logicFilter->GetOutput());
-    logicFilter2->SetOperationToAnd();
-    logicFilter2->SetOutputTrueValue(valueMax);
-    logicFilter2->Update();
-    tempOutputImageData = logicFilter2->GetOutput();
+      std::string errorMessage("Failed to compute boolean operation of segments A and B");
+      vtkErrorMacro("ApplyMorphologyOperation: " << errorMessage);
+      return errorMessage;
+    }
+    tempOutputImageData = booleanExpression->GetOutputLabelmap();
     break;
     }
   default:
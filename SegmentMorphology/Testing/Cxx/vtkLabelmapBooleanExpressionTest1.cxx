@@ -0,0 +1,272 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SegmentMorphology includes
+#include "vtkLabelmapBooleanExpression.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  const double LABELMAP_SPACING[3] = {0.8, 1.2, 2.0};
+  const double LABELMAP_ORIGIN[3] = {-20.0, 15.0, 40.0};
+  const unsigned char OUTPUT_VALUE = 5;
+
+  enum ShapeType
+  {
+    Ellipsoid,
+    Box
+  };
+
+  /// Create labelmap on the common lattice shifted by the given number of voxels along I, with an ellipsoid
+  /// or a box given in lattice indices
+  void CreateTestLabelmap(vtkOrientedImageData* labelmap, const int extent[6], int shiftI, int shape, const double center[3], const double radius[3])
+  {
+    labelmap->SetExtent(extent[0]-shiftI, extent[1]-shiftI, extent[2], extent[3], extent[4], extent[5]);
+    labelmap->SetSpacing(const_cast<double*>(LABELMAP_SPACING));
+    labelmap->SetOrigin(LABELMAP_ORIGIN[0] + shiftI*LABELMAP_SPACING[0], LABELMAP_ORIGIN[1], LABELMAP_ORIGIN[2]);
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        for (int i=extent[0]; i<=extent[1]; ++i)
+        {
+          double x = (i-center[0])/radius[0];
+          double y = (j-center[1])/radius[1];
+          double z = (k-center[2])/radius[2];
+          bool inside = false;
+          if (shape == Ellipsoid)
+          {
+            inside = (x*x + y*y + z*z <= 1.0);
+          }
+          else
+          {
+            inside = (fabs(x) <= 1.0 && fabs(y) <= 1.0 && fabs(z) <= 1.0);
+          }
+          *(static_cast<unsigned char*>(labelmap->GetScalarPointer(i-shiftI,j,k))) = (inside ? 1 : 0);
+        }
+      }
+    }
+  }
+
+  /// Get whether a voxel of the common lattice is in the segment. Voxels outside the extent are background
+  bool IsVoxelInSegment(vtkOrientedImageData* labelmap, int i, int j, int k)
+  {
+    int shiftI = (int)floor((labelmap->GetOrigin()[0] - LABELMAP_ORIGIN[0]) / LABELMAP_SPACING[0] + 0.5);
+    int extent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(extent);
+    i -= shiftI;
+    if (i < extent[0] || i > extent[1] || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5])
+    {
+      return false;
+    }
+    return labelmap->GetScalarComponentAsDouble(i,j,k,0) != 0.0;
+  }
+
+  /// Compare the output of a boolean expression with the expected segment over the union of the input extents.
+  /// The output must be cropped to the expected segment
+  template <class ExpectedFunctor>
+  bool CompareWithExpected(vtkLabelmapBooleanExpression* booleanExpression, vtkOrientedImageData* inputs[3],
+    const int unionExtent[6], ExpectedFunctor expectedFunctor, const char* expressionName)
+  {
+    if (!booleanExpression->Compute() || !booleanExpression->GetOutputLabelmap())
+    {
+      std::cerr << __LINE__ << ": Failed to compute " << expressionName << "!" << std::endl;
+      return false;
+    }
+    vtkOrientedImageData* output = booleanExpression->GetOutputLabelmap();
+    if (output->GetScalarType() != VTK_UNSIGNED_CHAR)
+    {
+      std::cerr << __LINE__ << ": Output scalar type of " << expressionName << " differs from the first input!" << std::endl;
+      return false;
+    }
+
+    int expectedExtent[6] = {VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN};
+    int mismatches = 0;
+    for (int k=unionExtent[4]; k<=unionExtent[5]; ++k)
+    {
+      for (int j=unionExtent[2]; j<=unionExtent[3]; ++j)
+      {
+        for (int i=unionExtent[0]; i<=unionExtent[1]; ++i)
+        {
+          bool expected = expectedFunctor( IsVoxelInSegment(inputs[0], i, j, k),
+            IsVoxelInSegment(inputs[1], i, j, k), IsVoxelInSegment(inputs[2], i, j, k) );
+          if (expected != IsVoxelInSegment(output, i, j, k))
+          {
+            ++mismatches;
+          }
+          else if (expected && output->GetScalarComponentAsDouble(i,j,k,0) != OUTPUT_VALUE)
+          {
+            std::cerr << __LINE__ << ": Output value of " << expressionName << " mismatch!" << std::endl;
+            return false;
+          }
+          if (expected)
+          {
+            expectedExtent[0] = std::min(expectedExtent[0], i);
+            expectedExtent[1] = std::max(expectedExtent[1], i);
+            expectedExtent[2] = std::min(expectedExtent[2], j);
+            expectedExtent[3] = std::max(expectedExtent[3], j);
+            expectedExtent[4] = std::min(expectedExtent[4], k);
+            expectedExtent[5] = std::max(expectedExtent[5], k);
+          }
+        }
+      }
+    }
+    if (mismatches > 0)
+    {
+      std::cerr << __LINE__ << ": Result of " << expressionName << " differs from the expected segment in " << mismatches << " voxels" << std::endl;
+      return false;
+    }
+    if (expectedExtent[0] > expectedExtent[1])
+    {
+      // Empty result
+      std::fill(expectedExtent, expectedExtent+6, 0);
+      expectedExtent[1] = expectedExtent[3] = expectedExtent[5] = -1;
+    }
+    if (!std::equal(expectedExtent, expectedExtent+6, output->GetExtent()))
+    {
+      std::cerr << __LINE__ << ": Output of " << expressionName << " is not cropped to the result!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  struct SubtractUnion
+  {
+    bool operator()(bool a, bool b, bool c) const { return a && !(b || c); }
+  };
+  struct UnionIntersect
+  {
+    bool operator()(bool a, bool b, bool c) const { return (a && b) || c; }
+  };
+  struct IntersectSubtract
+  {
+    bool operator()(bool a, bool b, bool c) const { return (c && a) && !b; }
+  };
+  struct EmptyResult
+  {
+    bool operator()(bool vtkNotUsed(a), bool b, bool c) const { return (b && c) && !b; }
+  };
+}
+
+//-----------------------------------------------------------------------------
+int vtkLabelmapBooleanExpressionTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Inputs overlap partially and have different extents. Input C is on a lattice shifted along I,
+  // so it is resampled to the first input
+  const int extentA[6] = {0, 24, 0, 19, 0, 9};
+  const double centerA[3] = {12.0, 10.0, 4.5};
+  const double radiusA[3] = {10.5, 8.3, 4.2};
+  vtkSmartPointer<vtkOrientedImageData> labelmapA = vtkSmartPointer<vtkOrientedImageData>::New();
+  CreateTestLabelmap(labelmapA, extentA, 0, Ellipsoid, centerA, radiusA);
+
+  const int extentB[6] = {4, 34, -5, 14, 2, 12};
+  const double centerB[3] = {16.0, 6.0, 6.0};
+  const double radiusB[3] = {9.0, 6.0, 3.0};
+  vtkSmartPointer<vtkOrientedImageData> labelmapB = vtkSmartPointer<vtkOrientedImageData>::New();
+  CreateTestLabelmap(labelmapB, extentB, 0, Box, centerB, radiusB);
+
+  const int extentC[6] = {-6, 12, 5, 25, 0, 9};
+  const double centerC[3] = {4.0, 16.0, 5.0};
+  const double radiusC[3] = {7.5, 6.5, 3.5};
+  vtkSmartPointer<vtkOrientedImageData> labelmapC = vtkSmartPointer<vtkOrientedImageData>::New();
+  CreateTestLabelmap(labelmapC, extentC, 3, Ellipsoid, centerC, radiusC);
+
+  const int unionExtent[6] = {-6, 34, -5, 25, 0, 12};
+  vtkOrientedImageData* inputs[3] = {labelmapA, labelmapB, labelmapC};
+
+  vtkSmartPointer<vtkLabelmapBooleanExpression> booleanExpression = vtkSmartPointer<vtkLabelmapBooleanExpression>::New();
+  int inputIndexA = booleanExpression->AddInputLabelmap(labelmapA);
+  int inputIndexB = booleanExpression->AddInputLabelmap(labelmapB);
+  int inputIndexC = booleanExpression->AddInputLabelmap(labelmapC);
+  booleanExpression->SetOutputValue(OUTPUT_VALUE);
+
+  // A - (B | C)
+  booleanExpression->AddOperandToExpression(inputIndexA);
+  booleanExpression->AddOperandToExpression(inputIndexB);
+  booleanExpression->AddOperandToExpression(inputIndexC);
+  booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Union);
+  booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Subtract);
+  if (!CompareWithExpected(booleanExpression, inputs, unionExtent, SubtractUnion(), "A - (B | C)"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // (A & B) | C
+  booleanExpression->ClearExpression();
+  booleanExpression->AddOperandToExpression(inputIndexA);
+  booleanExpression->AddOperandToExpression(inputIndexB);
+  booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Intersect);
+  booleanExpression->AddOperandToExpression(inputIndexC);
+  booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Union);
+  if (!CompareWithExpected(booleanExpression, inputs, unionExtent, UnionIntersect(), "(A & B) | C"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // (C & A) - B, the first operand of the expression is not the first input
+  booleanExpression->ClearExpression();
+  booleanExpression->AddOperandToExpression(inputIndexC);
+  booleanExpression->AddOperandToExpression(inputIndexA);
+  booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Intersect);
+  booleanExpression->AddOperandToExpression(inputIndexB);
+  booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Subtract);
+  if (!CompareWithExpected(booleanExpression, inputs, unionExtent, IntersectSubtract(), "(C & A) - B"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // (B & C) - B has no voxels, the output extent is empty
+  booleanExpression->ClearExpression();
+  booleanExpression->AddOperandToExpression(inputIndexB);
+  booleanExpression->AddOperandToExpression(inputIndexC);
+  booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Intersect);
+  booleanExpression->AddOperandToExpression(inputIndexB);
+  booleanExpression->AddOperationToExpression(vtkLabelmapBooleanExpression::Subtract);
+  if (!CompareWithExpected(booleanExpression, inputs, unionExtent, EmptyResult(), "(B & C) - B"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Expression that does not combine the operands into a single result is rejected
+  booleanExpression->ClearExpression();
+  booleanExpression->AddOperandToExpression(inputIndexA);
+  booleanExpression->AddOperandToExpression(inputIndexB);
+  vtkObject::GlobalWarningDisplayOff();
+  bool invalidExpressionAccepted = booleanExpression->Compute();
+  vtkObject::GlobalWarningDisplayOn();
+  if (invalidExpressionAccepted)
+  {
+    std::cerr << __LINE__ << ": Invalid expression is accepted!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SegmentMorphology includes
+#include "vtkLabelmapMargin.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkImageConstantPad.h>
+#include <vtkImageContinuousDilate3D.h>
+#include <vtkImageContinuousErode3D.h>
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  const int LABELMAP_EXTENT[6] = {-3, 30, 2, 29, 0, 17};
+  const double LABELMAP_SPACING[3] = {0.8, 1.2, 2.0};
+  const unsigned char OUTPUT_VALUE = 3;
+
+  /// Create anisotropic labelmap with an irregular segment: an ellipsoid with a box attached to it
+  /// and a cavity inside. The segment is farther from the edges of the extent than the margins.
+  void CreateTestLabelmap(vtkOrientedImageData* labelmap)
+  {
+    labelmap->SetExtent(const_cast<int*>(LABELMAP_EXTENT));
+    labelmap->SetSpacing(const_cast<double*>(LABELMAP_SPACING));
+    labelmap->SetOrigin(-20.0, 15.0, 40.0);
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    for (int k=LABELMAP_EXTENT[4]; k<=LABELMAP_EXTENT[5]; ++k)
+    {
+      for (int j=LABELMAP_EXTENT[2]; j<=LABELMAP_EXTENT[3]; ++j)
+      {
+        for (int i=LABELMAP_EXTENT[0]; i<=LABELMAP_EXTENT[1]; ++i)
+        {
+          double x = (i-12.0)/8.5;
+          double y = (j-14.0)/6.3;
+          double z = (k-8.0)/3.7;
+          bool inEllipsoid = (x*x + y*y + z*z <= 1.0);
+          bool inBox = (i >= 16 && i <= 24 && j >= 10 && j <= 13 && k >= 5 && k <= 12);
+          bool inCavity = (i >= 9 && i <= 11 && j >= 13 && j <= 15 && k == 8);
+          *(static_cast<unsigned char*>(labelmap->GetScalarPointer(i,j,k))) = ((inEllipsoid || inBox) && !inCavity ? 1 : 0);
+        }
+      }
+    }
+  }
+
+  bool IsVoxelInSegment(vtkImageData* imageData, int i, int j, int k)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    imageData->GetExtent(extent);
+    if (i < extent[0] || i > extent[1] || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5])
+    {
+      return false;
+    }
+    return imageData->GetScalarComponentAsDouble(i,j,k,0) != 0.0;
+  }
+
+  /// Compare two labelmaps voxel by voxel over the union of their extents
+  /// \return Number of mismatching voxels
+  int CompareOverUnionExtent(vtkImageData* imageData1, vtkImageData* imageData2)
+  {
+    int extent1[6] = {0,-1,0,-1,0,-1};
+    imageData1->GetExtent(extent1);
+    int extent2[6] = {0,-1,0,-1,0,-1};
+    imageData2->GetExtent(extent2);
+    int mismatches = 0;
+    for (int k=std::min(extent1[4],extent2[4]); k<=std::max(extent1[5],extent2[5]); ++k)
+    {
+      for (int j=std::min(extent1[2],extent2[2]); j<=std::max(extent1[3],extent2[3]); ++j)
+      {
+        for (int i=std::min(extent1[0],extent2[0]); i<=std::max(extent1[1],extent2[1]); ++i)
+        {
+          if (IsVoxelInSegment(imageData1, i, j, k) != IsVoxelInSegment(imageData2, i, j, k))
+          {
+            ++mismatches;
+          }
+        }
+      }
+    }
+    return mismatches;
+  }
+
+  /// Compute margin with vtkLabelmapMargin and with the continuous dilate/erode filters using the same
+  /// kernel size as the segment morphology logic did earlier, and compare the results
+  bool CompareWithContinuousFilter(vtkOrientedImageData* labelmap, double marginMm[3], bool expand)
+  {
+    vtkSmartPointer<vtkLabelmapMargin> marginFilter = vtkSmartPointer<vtkLabelmapMargin>::New();
+    marginFilter->SetInputLabelmap(labelmap);
+    marginFilter->SetMarginMm(marginMm);
+    marginFilter->SetOperation(expand ? vtkLabelmapMargin::Expand : vtkLabelmapMargin::Shrink);
+    marginFilter->SetOutputValue(OUTPUT_VALUE);
+    if (!marginFilter->Compute() || !marginFilter->GetOutputLabelmap())
+    {
+      std::cerr << __LINE__ << ": Failed to compute margin!" << std::endl;
+      return false;
+    }
+    vtkOrientedImageData* output = marginFilter->GetOutputLabelmap();
+    double outputRange[2] = {0.0, 0.0};
+    output->GetScalarRange(outputRange);
+    if (output->GetScalarType() != VTK_UNSIGNED_CHAR || outputRange[1] != OUTPUT_VALUE)
+    {
+      std::cerr << __LINE__ << ": Output scalar type or value mismatch!" << std::endl;
+      return false;
+    }
+    double outputSpacing[3] = {0.0, 0.0, 0.0};
+    output->GetSpacing(outputSpacing);
+    double outputOrigin[3] = {0.0, 0.0, 0.0};
+    output->GetOrigin(outputOrigin);
+    if (!std::equal(outputSpacing, outputSpacing+3, labelmap->GetSpacing()) || !std::equal(outputOrigin, outputOrigin+3, labelmap->GetOrigin()))
+    {
+      std::cerr << __LINE__ << ": Output geometry differs from the input!" << std::endl;
+      return false;
+    }
+
+    int kernelSize[3] = {1, 1, 1};
+    int padding[3] = {0, 0, 0};
+    for (int axis=0; axis<3; ++axis)
+    {
+      kernelSize[axis] = (int)( 2.0*(marginMm[axis]/LABELMAP_SPACING[axis] + 0.5) );
+      padding[axis] = int(marginMm[axis]/LABELMAP_SPACING[axis] + 1.0);
+    }
+    vtkSmartPointer<vtkImageData> expectedOutput;
+    if (expand)
+    {
+      vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
+      padder->SetInputData(labelmap);
+      padder->SetOutputWholeExtent(LABELMAP_EXTENT[0]-padding[0], LABELMAP_EXTENT[1]+padding[0], LABELMAP_EXTENT[2]-padding[1],
+        LABELMAP_EXTENT[3]+padding[1], LABELMAP_EXTENT[4]-padding[2], LABELMAP_EXTENT[5]+padding[2]);
+      vtkSmartPointer<vtkImageContinuousDilate3D> dilateFilter = vtkSmartPointer<vtkImageContinuousDilate3D>::New();
+      dilateFilter->SetInputConnection(padder->GetOutputPort());
+      dilateFilter->SetKernelSize(kernelSize[0], kernelSize[1], kernelSize[2]);
+      dilateFilter->Update();
+      expectedOutput = dilateFilter->GetOutput();
+    }
+    else
+    {
+      vtkSmartPointer<vtkImageContinuousErode3D> erodeFilter = vtkSmartPointer<vtkImageContinuousErode3D>::New();
+      erodeFilter->SetInputData(labelmap);
+      erodeFilter->SetKernelSize(kernelSize[0], kernelSize[1], kernelSize[2]);
+      erodeFilter->Update();
+      expectedOutput = erodeFilter->GetOutput();
+    }
+
+    int mismatches = CompareOverUnionExtent(output, expectedOutput);
+    if (mismatches > 0)
+    {
+      std::cerr << __LINE__ << ": " << (expand ? "Expanded" : "Shrunk") << " segment differs from the continuous "
+        << (expand ? "dilate" : "erode") << " filter in " << mismatches << " voxels with margin " << marginMm[0] << ", "
+        << marginMm[1] << ", " << marginMm[2] << " mm" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkLabelmapMarginTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  CreateTestLabelmap(labelmap);
+
+  // Different margin along each axis. The margins are chosen so that the kernel sizes are odd
+  // (7, 5, 5 voxels), for which the continuous filters are symmetric
+  double anisotropicMarginMm[3] = {2.6, 2.5, 4.5};
+  if ( !CompareWithContinuousFilter(labelmap, anisotropicMarginMm, true)
+    || !CompareWithContinuousFilter(labelmap, anisotropicMarginMm, false) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // No margin along one axis (kernel sizes 5, 5, 1 voxels)
+  double inPlaneMarginMm[3] = {1.7, 2.9, 0.0};
+  if ( !CompareWithContinuousFilter(labelmap, inPlaneMarginMm, true)
+    || !CompareWithContinuousFilter(labelmap, inPlaneMarginMm, false) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Zero margin leaves the segment unchanged
+  double zeroMarginMm[3] = {0.0, 0.0, 0.0};
+  vtkSmartPointer<vtkLabelmapMargin> marginFilter = vtkSmartPointer<vtkLabelmapMargin>::New();
+  marginFilter->SetInputLabelmap(labelmap);
+  marginFilter->SetMarginMm(zeroMarginMm);
+  for (int operation=vtkLabelmapMargin::Expand; operation<=vtkLabelmapMargin::Shrink; ++operation)
+  {
+    marginFilter->SetOperation(operation);
+    if (!marginFilter->Compute() || CompareOverUnionExtent(marginFilter->GetOutputLabelmap(), labelmap) != 0)
+    {
+      std::cerr << __LINE__ << ": Segment is changed by zero margin!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Negative margin is rejected
+  double negativeMarginMm[3] = {1.0, -1.0, 1.0};
+  marginFilter->SetMarginMm(negativeMarginMm);
+  vtkObject::GlobalWarningDisplayOff();
+  bool negativeMarginAccepted = marginFilter->Compute();
+  vtkObject::GlobalWarningDisplayOn();
+  if (negativeMarginAccepted)
+  {
+    std::cerr << __LINE__ << ": Negative margin is accepted!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -55,8 +55,21 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <algorithm>
+
 #define MIN_VOLUME_DIFFERENCE_TOLERANCE_VOXEL 100
 
+//-----------------------------------------------------------------------------
+bool IsVoxelInSegment(vtkImageData* imageData, int extent[6], int i, int j, int k)
+{
+  if (i < extent[0] || i > extent[1] || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5])
+  {
+    return false;
+  }
+  return (*static_cast<unsigned char*>(imageData->GetScalarPointer(i,j,k))) != 0;
+}
+
 //-----------------------------------------------------------------------------
 int vtkSlicerSegmentMorphologyModuleLogicTest1( int argc, char * argv[] )
 {
@@ -443,20 +456,12 @@ int vtkSlicerSegmentMorphologyModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
-  // Check geometries and extents
+  // Check geometries. The extents may differ, as the output is cropped to the region of the result
   if (!vtkOrientedImageDataResample::DoGeometriesMatch(baselineImageData, outputImageData))
   {
     std::cerr << "Baseline and output image data have different geometries!" << std::endl;
     return EXIT_FAILURE;
   }
-  if (!vtkOrientedImageDataResample::DoExtentsMatch(baselineImageData, outputImageData))
-  {
-    std::cerr << "Baseline and output image data have different extents!" << std::endl;
-    return EXIT_FAILURE;
-  }
-
-  unsigned char* baselineImagePtr = (unsigned char*)baselineImageData->GetScalarPointer();
-  unsigned char* outputImagePtr = (unsigned char*)outputImageData->GetScalarPointer();
 
   if (!baselineImageData || baselineImageData->GetScalarType() != VTK_UNSIGNED_CHAR)
   {
@@ -468,21 +473,28 @@ int vtkSlicerSegmentMorphologyModuleLogicTest1( int argc, char * argv[] )
     std::cerr << "Invalid image data! Scalar type has to be unsigned char instead of '" << (outputImageData?outputImageData->GetScalarTypeAsString():"None") << "'" << std::endl;
     return EXIT_FAILURE;
   }
-  if (baselineImageData->GetNumberOfPoints() != outputImageData->GetNumberOfPoints())
-  {
-    std::cerr << "Number of points do not match. " << baselineImageData->GetNumberOfPoints() << " != " << outputImageData->GetNumberOfPoints() << std::endl;
-    return EXIT_FAILURE;
-  }
+
+  // Compare voxels over the union of the extents, voxels outside an extent are empty
+  int baselineExtent[6] = {0,-1,0,-1,0,-1};
+  baselineImageData->GetExtent(baselineExtent);
+  int outputExtent[6] = {0,-1,0,-1,0,-1};
+  outputImageData->GetExtent(outputExtent);
+  int unionExtent[6] = { std::min(baselineExtent[0],outputExtent[0]), std::max(baselineExtent[1],outputExtent[1]),
+    std::min(baselineExtent[2],outputExtent[2]), std::max(baselineExtent[3],outputExtent[3]),
+    std::min(baselineExtent[4],outputExtent[4]), std::max(baselineExtent[5],outputExtent[5]) };
   int mismatches(0);
-  for (long i=0; i<baselineImageData->GetNumberOfPoints(); ++i)
+  for (int k=unionExtent[4]; k<=unionExtent[5]; ++k)
   {
-    if ( ((*baselineImagePtr) != 0 && (*outputImagePtr) == 0) ||
-      ((*baselineImagePtr) == 0 && (*outputImagePtr) != 0) )
+    for (int j=unionExtent[2]; j<=unionExtent[3]; ++j)
     {
-      mismatches++;
+      for (int i=unionExtent[0]; i<=unionExtent[1]; ++i)
+      {
+        if (IsVoxelInSegment(baselineImageData, baselineExtent, i, j, k) != IsVoxelInSegment(outputImageData, outputExtent, i, j, k))
+        {
+          mismatches++;
+        }
+      }
     }
-    ++baselineImagePtr;
-    ++outputImagePtr;
   }
 
   if (mismatches > volumeDifferenceToleranceVoxel)
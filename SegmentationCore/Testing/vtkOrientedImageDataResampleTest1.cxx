@@ -0,0 +1,251 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// STD includes
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  /// Create a labelmap with the given extent, all voxels zero
+  void CreateLabelmap(vtkOrientedImageData* labelmap, const int extent[6])
+  {
+    labelmap->SetExtent(const_cast<int*>(extent));
+    labelmap->SetSpacing(0.5, 1.0, 2.0);
+    labelmap->SetOrigin(10.0, 20.0, 30.0);
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    memset(labelmap->GetScalarPointer(), 0, labelmap->GetNumberOfPoints());
+  }
+
+  /// Set the voxels of a labelmap within an extent
+  void FillExtent(vtkOrientedImageData* labelmap, const int extent[6], unsigned char value)
+  {
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        for (int i=extent[0]; i<=extent[1]; ++i)
+        {
+          *(static_cast<unsigned char*>(labelmap->GetScalarPointer(i,j,k))) = value;
+        }
+      }
+    }
+  }
+
+  /// Calculate the changed extent of two labelmaps and compare it with the expected one
+  bool CheckChangedExtent(vtkOrientedImageData* image1, vtkOrientedImageData* image2, const int expectedExtent[6], const char* caseName)
+  {
+    int changedExtent[6] = {0,-1,0,-1,0,-1};
+    if (!vtkOrientedImageDataResample::CalculateChangedExtent(image1, image2, changedExtent))
+    {
+      std::cerr << __LINE__ << ": " << caseName << ": Failed to calculate changed extent!" << std::endl;
+      return false;
+    }
+    if (!std::equal(changedExtent, changedExtent+6, expectedExtent))
+    {
+      std::cerr << __LINE__ << ": " << caseName << ": Changed extent mismatch: (" << changedExtent[0] << ", " << changedExtent[1]
+        << ", " << changedExtent[2] << ", " << changedExtent[3] << ", " << changedExtent[4] << ", " << changedExtent[5] << ") instead of ("
+        << expectedExtent[0] << ", " << expectedExtent[1] << ", " << expectedExtent[2] << ", " << expectedExtent[3]
+        << ", " << expectedExtent[4] << ", " << expectedExtent[5] << ")" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  /// Calculate the effective extent of a labelmap and compare it and the number of voxels with the expected ones
+  bool CheckEffectiveExtent(vtkImageData* image, const int expectedExtent[6], vtkIdType expectedNumberOfVoxels, const char* caseName)
+  {
+    int effectiveExtent[6] = {0,-1,0,-1,0,-1};
+    vtkIdType numberOfVoxels = -1;
+    bool nonEmpty = vtkOrientedImageDataResample::CalculateEffectiveExtent(image, effectiveExtent, &numberOfVoxels);
+    if (nonEmpty != (expectedNumberOfVoxels > 0))
+    {
+      std::cerr << __LINE__ << ": " << caseName << ": Effective extent is reported " << (nonEmpty ? "non-empty" : "empty") << "!" << std::endl;
+      return false;
+    }
+    if (numberOfVoxels != expectedNumberOfVoxels)
+    {
+      std::cerr << __LINE__ << ": " << caseName << ": Number of non-zero voxels is " << numberOfVoxels << " instead of " << expectedNumberOfVoxels << std::endl;
+      return false;
+    }
+    if (!std::equal(effectiveExtent, effectiveExtent+6, expectedExtent))
+    {
+      std::cerr << __LINE__ << ": " << caseName << ": Effective extent mismatch: (" << effectiveExtent[0] << ", " << effectiveExtent[1]
+        << ", " << effectiveExtent[2] << ", " << effectiveExtent[3] << ", " << effectiveExtent[4] << ", " << effectiveExtent[5] << ") instead of ("
+        << expectedExtent[0] << ", " << expectedExtent[1] << ", " << expectedExtent[2] << ", " << expectedExtent[3]
+        << ", " << expectedExtent[4] << ", " << expectedExtent[5] << ")" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  /// Fill a mask of a box from a labelmap and compare it voxel by voxel with the labelmap
+  bool CheckMask(vtkOrientedImageData* labelmap, const int boxExtent[6], bool invert, const char* caseName)
+  {
+    int boxDimensions[3] = { boxExtent[1]-boxExtent[0]+1, boxExtent[3]-boxExtent[2]+1, boxExtent[5]-boxExtent[4]+1 };
+    std::vector<unsigned char> mask((size_t)boxDimensions[0]*boxDimensions[1]*boxDimensions[2], 2);
+    vtkOrientedImageDataResample::FillMaskFromImage(labelmap, boxExtent, &(mask[0]), invert);
+
+    int extent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(extent);
+    std::vector<unsigned char>::iterator maskIt = mask.begin();
+    for (int k=boxExtent[4]; k<=boxExtent[5]; ++k)
+    {
+      for (int j=boxExtent[2]; j<=boxExtent[3]; ++j)
+      {
+        for (int i=boxExtent[0]; i<=boxExtent[1]; ++i, ++maskIt)
+        {
+          bool insideImage = ( i >= extent[0] && i <= extent[1] && j >= extent[2] && j <= extent[3] && k >= extent[4] && k <= extent[5] );
+          bool segmentVoxel = ( insideImage && *(static_cast<unsigned char*>(labelmap->GetScalarPointer(i,j,k))) != 0 );
+          unsigned char expectedValue = (segmentVoxel != invert ? 1 : 0);
+          if (*maskIt != expectedValue)
+          {
+            std::cerr << __LINE__ << ": " << caseName << ": Mask value at (" << i << ", " << j << ", " << k << ") is "
+              << (int)(*maskIt) << " instead of " << (int)expectedValue << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkOrientedImageDataResampleTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int emptyExtent[6] = {0,-1,0,-1,0,-1};
+  const int labelmapExtent[6] = {-5, 14, 0, 19, 3, 12};
+  const int boxExtent[6] = {-2, 4, 6, 9, 3, 3};
+
+  vtkNew<vtkOrientedImageData> original;
+  CreateLabelmap(original.GetPointer(), labelmapExtent);
+  FillExtent(original.GetPointer(), boxExtent, 1);
+  vtkNew<vtkOrientedImageData> modified;
+  modified->DeepCopy(original.GetPointer());
+
+  // Same content
+  if (!CheckChangedExtent(original.GetPointer(), modified.GetPointer(), emptyExtent, "Unchanged"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Changes at separate corners of the labelmap
+  const int changedVoxel1[6] = {-5, -5, 19, 19, 7, 7};
+  const int changedVoxel2[6] = {8, 8, 2, 2, 12, 12};
+  FillExtent(modified.GetPointer(), changedVoxel1, 1);
+  FillExtent(modified.GetPointer(), changedVoxel2, 3);
+  const int changedVoxelsExtent[6] = {-5, 8, 2, 19, 7, 12};
+  if (!CheckChangedExtent(original.GetPointer(), modified.GetPointer(), changedVoxelsExtent, "Changed voxels"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Different extents: voxels outside the extent of an image are zero, so only non-zero voxels
+  // outside the other image are changes
+  vtkNew<vtkOrientedImageData> cropped;
+  const int croppedExtent[6] = {0, 20, 0, 9, 3, 5};
+  CreateLabelmap(cropped.GetPointer(), croppedExtent);
+  const int croppedBoxExtent[6] = {0, 4, 6, 9, 3, 3};
+  FillExtent(cropped.GetPointer(), croppedBoxExtent, 1);
+  const int croppedChangeExtent[6] = {-2, -1, 6, 9, 3, 3};
+  if (!CheckChangedExtent(original.GetPointer(), cropped.GetPointer(), croppedChangeExtent, "Different extents"))
+  {
+    return EXIT_FAILURE;
+  }
+  FillExtent(cropped.GetPointer(), croppedExtent, 0);
+  const int paintedOutsideExtent[6] = {18, 20, 1, 1, 4, 4};
+  FillExtent(cropped.GetPointer(), paintedOutsideExtent, 1);
+  const int croppedAndPaintedChangeExtent[6] = {-2, 20, 1, 9, 3, 4};
+  if (!CheckChangedExtent(original.GetPointer(), cropped.GetPointer(), croppedAndPaintedChangeExtent, "Painted outside"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Image without scalars is all zero
+  vtkNew<vtkOrientedImageData> empty;
+  empty->SetSpacing(0.5, 1.0, 2.0);
+  empty->SetOrigin(10.0, 20.0, 30.0);
+  if ( !CheckChangedExtent(empty.GetPointer(), original.GetPointer(), boxExtent, "Empty image")
+    || !CheckChangedExtent(empty.GetPointer(), empty.GetPointer(), emptyExtent, "Both empty") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Images of different geometry cannot be compared
+  vtkNew<vtkOrientedImageData> shifted;
+  shifted->DeepCopy(original.GetPointer());
+  shifted->SetOrigin(11.0, 20.0, 30.0);
+  int changedExtent[6] = {0,-1,0,-1,0,-1};
+  if (vtkOrientedImageDataResample::CalculateChangedExtent(original.GetPointer(), shifted.GetPointer(), changedExtent))
+  {
+    std::cerr << __LINE__ << ": Images of different geometry are compared!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Effective extent is in the IJK indices of the image extent, and a single slice is not empty
+  const int modifiedEffectiveExtent[6] = {-5, 8, 2, 19, 3, 12};
+  if ( !CheckEffectiveExtent(original.GetPointer(), boxExtent, 28, "Single slice box")
+    || !CheckEffectiveExtent(modified.GetPointer(), modifiedEffectiveExtent, 30, "Box and corners")
+    || !CheckEffectiveExtent(empty.GetPointer(), emptyExtent, 0, "No scalars") )
+  {
+    return EXIT_FAILURE;
+  }
+  FillExtent(modified.GetPointer(), labelmapExtent, 0);
+  if (!CheckEffectiveExtent(modified.GetPointer(), emptyExtent, 0, "All zero"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // All scalar types are supported, any non-zero value is a segment voxel
+  vtkNew<vtkImageData> signedImage;
+  signedImage->SetExtent(-3, 3, -3, 3, -3, 3);
+  signedImage->AllocateScalars(VTK_SHORT, 1);
+  memset(signedImage->GetScalarPointer(), 0, signedImage->GetNumberOfPoints() * sizeof(short));
+  *(static_cast<short*>(signedImage->GetScalarPointer(-1, 2, 0))) = -1;
+  *(static_cast<short*>(signedImage->GetScalarPointer(1, 2, 0))) = 5;
+  const int signedImageEffectiveExtent[6] = {-1, 1, 2, 2, 0, 0};
+  if (!CheckEffectiveExtent(signedImage.GetPointer(), signedImageEffectiveExtent, 2, "Signed image"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Masks of a box exceeding the labelmap extent
+  const int maskBoxExtent[6] = {-7, 0, 5, 21, 2, 4};
+  if ( !CheckMask(original.GetPointer(), maskBoxExtent, false, "Mask")
+    || !CheckMask(original.GetPointer(), maskBoxExtent, true, "Inverted mask")
+    || !CheckMask(cropped.GetPointer(), maskBoxExtent, false, "Mask outside") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
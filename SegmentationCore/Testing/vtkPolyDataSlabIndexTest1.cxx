@@ -0,0 +1,215 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCutter.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPlane.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSphereSource.h>
+
+// SegmentationCore includes
+#include "vtkPolyDataSlabIndex.h"
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  const double SPHERE_CENTER[3] = {50.0, 40.0, 30.0};
+  const double SPHERE_RADIUS = 30.0;
+  const double TOLERANCE = 1e-6;
+
+  /// Get total length of the line segments of the lines and polylines of a poly data
+  double GetTotalLineLength(vtkPolyData* polyData)
+  {
+    double length = 0.0;
+    vtkCellArray* lines = polyData->GetLines();
+    if (!lines)
+    {
+      return length;
+    }
+    vtkIdType numberOfCellPoints = 0;
+    vtkIdType* cellPointIds = NULL;
+    for (lines->InitTraversal(); lines->GetNextCell(numberOfCellPoints, cellPointIds); )
+    {
+      for (vtkIdType cellPointIndex=0; cellPointIndex+1<numberOfCellPoints; ++cellPointIndex)
+      {
+        double point1[3] = {0.0, 0.0, 0.0};
+        double point2[3] = {0.0, 0.0, 0.0};
+        polyData->GetPoint(cellPointIds[cellPointIndex], point1);
+        polyData->GetPoint(cellPointIds[cellPointIndex+1], point2);
+        length += sqrt(vtkMath::Distance2BetweenPoints(point1, point2));
+      }
+    }
+    return length;
+  }
+
+  /// Compare the cut of the slab index with the cut of vtkCutter for a plane
+  bool CompareCutWithCutter(vtkPolyData* spherePolyData, vtkPolyDataSlabIndex* slabIndex, const double origin[3], const double normal[3])
+  {
+    vtkPolyData* slabIndexCut = slabIndex->Cut(origin, normal);
+    if (!slabIndexCut)
+    {
+      std::cerr << __LINE__ << ": Failed to cut with the slab index!" << std::endl;
+      return false;
+    }
+
+    vtkNew<vtkPlane> plane;
+    plane->SetOrigin(const_cast<double*>(origin));
+    plane->SetNormal(const_cast<double*>(normal));
+    vtkNew<vtkCutter> cutter;
+    cutter->SetInputData(spherePolyData);
+    cutter->SetCutFunction(plane.GetPointer());
+    cutter->Update();
+    vtkPolyData* cutterCut = cutter->GetOutput();
+
+    // Same contour (length and bounds), all points on the plane
+    double slabIndexLength = GetTotalLineLength(slabIndexCut);
+    double cutterLength = GetTotalLineLength(cutterCut);
+    if (cutterLength <= 0.0 || fabs(slabIndexLength - cutterLength) > TOLERANCE * cutterLength)
+    {
+      std::cerr << __LINE__ << ": Contour length mismatch: " << slabIndexLength << " instead of " << cutterLength << std::endl;
+      return false;
+    }
+    double slabIndexBounds[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    double cutterBounds[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    slabIndexCut->GetBounds(slabIndexBounds);
+    cutterCut->GetBounds(cutterBounds);
+    for (int boundIndex=0; boundIndex<6; ++boundIndex)
+    {
+      if (fabs(slabIndexBounds[boundIndex] - cutterBounds[boundIndex]) > TOLERANCE * SPHERE_RADIUS)
+      {
+        std::cerr << __LINE__ << ": Contour bounds mismatch at " << boundIndex << ": " << slabIndexBounds[boundIndex]
+          << " instead of " << cutterBounds[boundIndex] << std::endl;
+        return false;
+      }
+    }
+    double unitNormal[3] = {normal[0], normal[1], normal[2]};
+    vtkMath::Normalize(unitNormal);
+    for (vtkIdType pointId=0; pointId<slabIndexCut->GetNumberOfPoints(); ++pointId)
+    {
+      double point[3] = {0.0, 0.0, 0.0};
+      slabIndexCut->GetPoint(pointId, point);
+      double pointToOrigin[3] = {point[0]-origin[0], point[1]-origin[1], point[2]-origin[2]};
+      if (fabs(vtkMath::Dot(pointToOrigin, unitNormal)) > TOLERANCE * SPHERE_RADIUS)
+      {
+        std::cerr << __LINE__ << ": Contour point " << pointId << " is not on the cutting plane!" << std::endl;
+        return false;
+      }
+    }
+
+    // The segments are joined into one polyline, because the contour of a sphere is a single closed curve
+    if (slabIndexCut->GetNumberOfLines() != 1)
+    {
+      std::cerr << __LINE__ << ": Contour of a sphere consists of " << slabIndexCut->GetNumberOfLines() << " polylines instead of one!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPolyDataSlabIndexTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkSphereSource> sphere;
+  sphere->SetCenter(const_cast<double*>(SPHERE_CENTER));
+  sphere->SetRadius(SPHERE_RADIUS);
+  sphere->SetThetaResolution(40);
+  sphere->SetPhiResolution(30);
+  sphere->Update();
+  vtkNew<vtkPolyData> spherePolyData;
+  spherePolyData->DeepCopy(sphere->GetOutput());
+
+  vtkPolyDataSlabIndex* slabIndex = vtkPolyDataSlabIndex::GetSlabIndexForPolyData(spherePolyData.GetPointer());
+  if (!slabIndex || slabIndex->GetNumberOfTriangles() != spherePolyData->GetNumberOfPolys())
+  {
+    std::cerr << __LINE__ << ": Failed to build slab index of the sphere!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Axial, sagittal, coronal and oblique planes through the sphere. The offsets are chosen so that
+  // the planes do not contain vertices of the sphere
+  const int numberOfPlanes = 5;
+  double planeOrigins[numberOfPlanes][3] = {
+    {50.0, 40.0, 30.37}, {50.0, 40.0, 51.13}, {27.71, 40.0, 30.0}, {50.0, 63.29, 30.0}, {53.17, 41.23, 28.91} };
+  double planeNormals[numberOfPlanes][3] = {
+    {0.0, 0.0, 1.0}, {0.0, 0.0, 1.0}, {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.3, -0.5, 0.8} };
+  for (int planeIndex=0; planeIndex<numberOfPlanes; ++planeIndex)
+  {
+    if (!CompareCutWithCutter(spherePolyData.GetPointer(), slabIndex, planeOrigins[planeIndex], planeNormals[planeIndex]))
+    {
+      std::cerr << __LINE__ << ": Cut mismatch for plane " << planeIndex << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Cutting the same plane again returns the cached result
+  vtkPolyData* firstCut = slabIndex->Cut(planeOrigins[0], planeNormals[0]);
+  if (slabIndex->Cut(planeOrigins[0], planeNormals[0]) != firstCut)
+  {
+    std::cerr << __LINE__ << ": Cut of the same plane is not taken from the cache!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Plane outside the sphere gives empty result
+  double outsideOrigin[3] = {50.0, 40.0, 30.0 + 2.0 * SPHERE_RADIUS};
+  vtkPolyData* outsideCut = slabIndex->Cut(outsideOrigin, planeNormals[0]);
+  if (!outsideCut || outsideCut->GetNumberOfPoints() != 0)
+  {
+    std::cerr << __LINE__ << ": Cut outside the sphere is not empty!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Index attached to the poly data is rebuilt after the poly data is modified
+  if (vtkPolyDataSlabIndex::GetSlabIndexForPolyData(spherePolyData.GetPointer()) != slabIndex)
+  {
+    std::cerr << __LINE__ << ": Slab index attached to the poly data is not reused!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkPoints* spherePoints = spherePolyData->GetPoints();
+  for (vtkIdType pointId=0; pointId<spherePoints->GetNumberOfPoints(); ++pointId)
+  {
+    double point[3] = {0.0, 0.0, 0.0};
+    spherePoints->GetPoint(pointId, point);
+    spherePoints->SetPoint(pointId, point[0], point[1], point[2] + SPHERE_RADIUS);
+  }
+  spherePoints->Modified();
+  spherePolyData->Modified();
+  if (slabIndex->IsUpToDate(spherePolyData.GetPointer()))
+  {
+    std::cerr << __LINE__ << ": Slab index is up-to-date after the poly data has been modified!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  slabIndex = vtkPolyDataSlabIndex::GetSlabIndexForPolyData(spherePolyData.GetPointer());
+  double shiftedOrigin[3] = {planeOrigins[0][0], planeOrigins[0][1], planeOrigins[0][2] + SPHERE_RADIUS};
+  if (!slabIndex || !CompareCutWithCutter(spherePolyData.GetPointer(), slabIndex, shiftedOrigin, planeNormals[0]))
+  {
+    std::cerr << __LINE__ << ": Cut mismatch after the poly data has been modified!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
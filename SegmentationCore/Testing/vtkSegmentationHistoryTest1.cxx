@@ -0,0 +1,307 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
+#include "vtkSegmentationHistory.h"
+
+// STD includes
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  const int LABELMAP_EXTENT[6] = {0, 19, 0, 19, 0, 19};
+  const char* SEGMENT_ID = "segment1";
+
+  /// Set the voxels of a labelmap within an extent
+  void FillExtent(vtkOrientedImageData* labelmap, const int extent[6], unsigned char value)
+  {
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        for (int i=extent[0]; i<=extent[1]; ++i)
+        {
+          *(static_cast<unsigned char*>(labelmap->GetScalarPointer(i,j,k))) = value;
+        }
+      }
+    }
+  }
+
+  /// Copy the voxels of a labelmap
+  void GetVoxels(vtkOrientedImageData* labelmap, std::vector<unsigned char>& voxels)
+  {
+    unsigned char* voxelPtr = static_cast<unsigned char*>(labelmap->GetScalarPointer());
+    voxels.assign(voxelPtr, voxelPtr + labelmap->GetNumberOfPoints());
+  }
+
+  /// Modify a copy of the segment labelmap within an extent, store the modification in the history,
+  /// then copy the modified labelmap into the segment the same way as the segment editor does
+  bool ModifySegment(vtkSegmentationHistory* history, vtkOrientedImageData* segmentLabelmap, const int extent[6], unsigned char value)
+  {
+    vtkSmartPointer<vtkOrientedImageData> modifiedLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    modifiedLabelmap->DeepCopy(segmentLabelmap);
+    FillExtent(modifiedLabelmap, extent, value);
+    if (!history->SaveModification(SEGMENT_ID, modifiedLabelmap, extent))
+    {
+      return false;
+    }
+    segmentLabelmap->DeepCopy(modifiedLabelmap);
+    history->UpdateSegmentModifiedTime(SEGMENT_ID);
+    return true;
+  }
+
+  /// Undo or redo the last modification and check that the segment labelmap matches the expected state
+  bool RestoreAndCompare(vtkSegmentationHistory* history, bool undo, vtkOrientedImageData* segmentLabelmap,
+    const std::vector<unsigned char>& expectedVoxels, const int expectedExtent[6])
+  {
+    std::string segmentID;
+    int restoredExtent[6] = {0,-1,0,-1,0,-1};
+    if (undo ? !history->Undo(segmentID, restoredExtent) : !history->Redo(segmentID, restoredExtent))
+    {
+      std::cerr << __LINE__ << ": Failed to " << (undo ? "undo" : "redo") << " modification!" << std::endl;
+      return false;
+    }
+    if (segmentID.compare(SEGMENT_ID) || !std::equal(restoredExtent, restoredExtent+6, expectedExtent))
+    {
+      std::cerr << __LINE__ << ": Restored segment or extent mismatch!" << std::endl;
+      return false;
+    }
+    std::vector<unsigned char> voxels;
+    GetVoxels(segmentLabelmap, voxels);
+    if (voxels != expectedVoxels)
+    {
+      std::cerr << __LINE__ << ": Segment labelmap does not match the expected state after " << (undo ? "undo" : "redo") << "!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkSegmentationHistoryTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Segment with a binary labelmap containing a box
+  vtkNew<vtkOrientedImageData> segmentLabelmap;
+  segmentLabelmap->SetExtent(const_cast<int*>(LABELMAP_EXTENT));
+  segmentLabelmap->SetSpacing(0.5, 1.0, 2.0);
+  segmentLabelmap->SetOrigin(10.0, 20.0, 30.0);
+  segmentLabelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  memset(segmentLabelmap->GetScalarPointer(), 0, segmentLabelmap->GetNumberOfPoints());
+  int boxExtent[6] = {2, 5, 2, 5, 2, 5};
+  FillExtent(segmentLabelmap.GetPointer(), boxExtent, 1);
+
+  vtkNew<vtkSegment> segment;
+  segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), segmentLabelmap.GetPointer());
+  vtkNew<vtkSegmentation> segmentation;
+  segmentation->SetMasterRepresentationName(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName());
+  segmentation->AddSegment(segment.GetPointer(), SEGMENT_ID);
+
+  vtkNew<vtkSegmentationHistory> history;
+  history->SetSegmentation(segmentation.GetPointer());
+
+  //////////////////////////////////////////////////////////////////////////
+  // Round trip: two modifications are undone and redone
+
+  std::vector<unsigned char> initialVoxels;
+  GetVoxels(segmentLabelmap.GetPointer(), initialVoxels);
+
+  int paintExtent[6] = {8, 12, 9, 14, 10, 11};
+  if (!ModifySegment(history.GetPointer(), segmentLabelmap.GetPointer(), paintExtent, 1))
+  {
+    std::cerr << __LINE__ << ": Failed to save first modification!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<unsigned char> paintedVoxels;
+  GetVoxels(segmentLabelmap.GetPointer(), paintedVoxels);
+
+  int eraseExtent[6] = {3, 9, 0, 19, 4, 10};
+  if (!ModifySegment(history.GetPointer(), segmentLabelmap.GetPointer(), eraseExtent, 0))
+  {
+    std::cerr << __LINE__ << ": Failed to save second modification!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<unsigned char> erasedVoxels;
+  GetVoxels(segmentLabelmap.GetPointer(), erasedVoxels);
+
+  if (history->GetNumberOfUndoLevels() != 2 || history->GetNumberOfRedoLevels() != 0)
+  {
+    std::cerr << __LINE__ << ": Number of undo/redo levels mismatch: " << history->GetNumberOfUndoLevels()
+      << "/" << history->GetNumberOfRedoLevels() << " instead of 2/0" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( !RestoreAndCompare(history.GetPointer(), true, segmentLabelmap.GetPointer(), paintedVoxels, eraseExtent)
+    || !RestoreAndCompare(history.GetPointer(), true, segmentLabelmap.GetPointer(), initialVoxels, paintExtent) )
+  {
+    return EXIT_FAILURE;
+  }
+  std::string segmentID;
+  int restoredExtent[6] = {0,-1,0,-1,0,-1};
+  if (history->Undo(segmentID, restoredExtent) || history->GetNumberOfRedoLevels() != 2)
+  {
+    std::cerr << __LINE__ << ": Undo succeeded without stored modifications!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( !RestoreAndCompare(history.GetPointer(), false, segmentLabelmap.GetPointer(), paintedVoxels, paintExtent)
+    || !RestoreAndCompare(history.GetPointer(), false, segmentLabelmap.GetPointer(), erasedVoxels, eraseExtent) )
+  {
+    return EXIT_FAILURE;
+  }
+  if (history->Redo(segmentID, restoredExtent))
+  {
+    std::cerr << __LINE__ << ": Redo succeeded without undone modifications!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // New modification after undo removes the redo history
+  if (!RestoreAndCompare(history.GetPointer(), true, segmentLabelmap.GetPointer(), paintedVoxels, eraseExtent))
+  {
+    return EXIT_FAILURE;
+  }
+  if ( !ModifySegment(history.GetPointer(), segmentLabelmap.GetPointer(), boxExtent, 0)
+    || history->GetNumberOfUndoLevels() != 2 || history->GetNumberOfRedoLevels() != 0 )
+  {
+    std::cerr << __LINE__ << ": Redo history is not removed by a new modification!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // Memory budget: the oldest modifications are evicted
+
+  history->RemoveAllModifications();
+  if (history->GetMemorySize() != 0)
+  {
+    std::cerr << __LINE__ << ": Memory size is not zero after removing all modifications!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const int numberOfModifications = 3;
+  std::vector<unsigned long> memorySizes;
+  std::vector< std::vector<unsigned char> > modifiedVoxels;
+  for (int modificationIndex=0; modificationIndex<numberOfModifications; ++modificationIndex)
+  {
+    int sliceExtent[6] = {0, 19, 0, 19, 2*modificationIndex, 2*modificationIndex};
+    if (!ModifySegment(history.GetPointer(), segmentLabelmap.GetPointer(), sliceExtent, 1))
+    {
+      std::cerr << __LINE__ << ": Failed to save modification " << modificationIndex << std::endl;
+      return EXIT_FAILURE;
+    }
+    memorySizes.push_back(history->GetMemorySize());
+    modifiedVoxels.push_back(std::vector<unsigned char>());
+    GetVoxels(segmentLabelmap.GetPointer(), modifiedVoxels.back());
+  }
+  if (memorySizes[0] == 0 || memorySizes[1] <= memorySizes[0] || memorySizes[2] <= memorySizes[1])
+  {
+    std::cerr << __LINE__ << ": Memory size does not grow with the modifications!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Limit just below the total evicts the oldest modification only
+  history->SetMaximumMemorySize(memorySizes[2] - 1);
+  if (history->GetNumberOfUndoLevels() != numberOfModifications-1 || history->GetMemorySize() > history->GetMaximumMemorySize())
+  {
+    std::cerr << __LINE__ << ": Number of undo levels mismatch after reducing the memory limit: "
+      << history->GetNumberOfUndoLevels() << " instead of " << numberOfModifications-1 << std::endl;
+    return EXIT_FAILURE;
+  }
+  int lastSliceExtent[6] = {0, 19, 0, 19, 4, 4};
+  if (!RestoreAndCompare(history.GetPointer(), true, segmentLabelmap.GetPointer(), modifiedVoxels[1], lastSliceExtent))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Modifications that do not fit in the limit are not kept
+  history->SetMaximumMemorySize(0);
+  if (history->GetNumberOfUndoLevels() != 0 || history->GetNumberOfRedoLevels() != 0 || history->GetMemorySize() != 0)
+  {
+    std::cerr << __LINE__ << ": Modifications are kept with zero memory limit!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // Modification of the segment outside the history invalidates the stored modifications
+
+  history->SetMaximumMemorySize(256 * 1024 * 1024);
+  int externalExtent[6] = {15, 18, 15, 18, 15, 18};
+  if ( !ModifySegment(history.GetPointer(), segmentLabelmap.GetPointer(), paintExtent, 1)
+    || !ModifySegment(history.GetPointer(), segmentLabelmap.GetPointer(), eraseExtent, 0) )
+  {
+    std::cerr << __LINE__ << ": Failed to save modifications!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  FillExtent(segmentLabelmap.GetPointer(), externalExtent, 1);
+  segmentLabelmap->Modified();
+  if (history->Undo(segmentID, restoredExtent) || history->GetNumberOfUndoLevels() != 0 || history->GetNumberOfRedoLevels() != 0)
+  {
+    std::cerr << __LINE__ << ": History is not cleared after the segment was modified outside the history!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // A new modification after an outside modification is stored, but the earlier ones are removed
+  if (!ModifySegment(history.GetPointer(), segmentLabelmap.GetPointer(), paintExtent, 1))
+  {
+    std::cerr << __LINE__ << ": Failed to save modification!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  FillExtent(segmentLabelmap.GetPointer(), externalExtent, 0);
+  segmentLabelmap->Modified();
+  std::vector<unsigned char> beforeLastModificationVoxels;
+  GetVoxels(segmentLabelmap.GetPointer(), beforeLastModificationVoxels);
+  if ( !ModifySegment(history.GetPointer(), segmentLabelmap.GetPointer(), paintExtent, 0)
+    || history->GetNumberOfUndoLevels() != 1 )
+  {
+    std::cerr << __LINE__ << ": Earlier modifications are kept after the segment was modified outside the history!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<unsigned char> lastModificationVoxels;
+  GetVoxels(segmentLabelmap.GetPointer(), lastModificationVoxels);
+  if (!RestoreAndCompare(history.GetPointer(), true, segmentLabelmap.GetPointer(), beforeLastModificationVoxels, paintExtent))
+  {
+    return EXIT_FAILURE;
+  }
+  // Undo itself is not an outside modification
+  if (!RestoreAndCompare(history.GetPointer(), false, segmentLabelmap.GetPointer(), lastModificationVoxels, paintExtent))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Replacing the labelmap of the segment also invalidates the history
+  vtkNew<vtkOrientedImageData> replacedLabelmap;
+  replacedLabelmap->DeepCopy(segmentLabelmap.GetPointer());
+  segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), replacedLabelmap.GetPointer());
+  if (history->Undo(segmentID, restoredExtent) || history->GetNumberOfUndoLevels() != 0)
+  {
+    std::cerr << __LINE__ << ": History is not cleared after the segment labelmap was replaced!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
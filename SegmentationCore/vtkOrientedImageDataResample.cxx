@@ -36,12 +36,109 @@
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkPlaneSource.h>
 #include <vtkAppendPolyData.h>
+#include <vtkDataArray.h>
+#include <vtkPointData.h>
 
 // STD includes
 #include <algorithm>
+#include <cstring>
+#include <vector>
 
 vtkStandardNewMacro(vtkOrientedImageDataResample);
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Get pointer to the first voxel of an image row within the image extent, NULL if the row is outside the extent
+  const unsigned char* GetRowPointer(vtkImageData* image, const int extent[6], int j, int k)
+  {
+    if ( extent[0] > extent[1] || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5] )
+    {
+      return NULL;
+    }
+    return static_cast<const unsigned char*>(image->GetScalarPointer(extent[0], j, k));
+  }
+
+  /// Get the extent and number of the non-zero voxels of an image with non-empty extent. The extent is only
+  /// extended by the rows that contain non-zero voxels, which are searched for their first and last one from both ends
+  template <class T>
+  void CalculateEffectiveExtentGeneric(T* scalarPointer, vtkImageData* image, int effectiveExtent[6], vtkIdType& numberOfNonZeroVoxels)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    image->GetExtent(extent);
+    vtkIdType increments[3] = {0,0,0};
+    image->GetIncrements(increments);
+    numberOfNonZeroVoxels = 0;
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        T* row = scalarPointer + (k-extent[4])*increments[2] + (j-extent[2])*increments[1];
+        int firstI = extent[0];
+        while (firstI <= extent[1] && row[(firstI-extent[0])*increments[0]] == 0)
+        {
+          ++firstI;
+        }
+        if (firstI > extent[1])
+        {
+          continue;
+        }
+        int lastI = extent[1];
+        while (row[(lastI-extent[0])*increments[0]] == 0)
+        {
+          --lastI;
+        }
+        for (T* voxel = row + (firstI-extent[0])*increments[0]; voxel <= row + (lastI-extent[0])*increments[0]; voxel+=increments[0])
+        {
+          if (*voxel != 0)
+          {
+            ++numberOfNonZeroVoxels;
+          }
+        }
+        effectiveExtent[0] = std::min(effectiveExtent[0], firstI);
+        effectiveExtent[1] = std::max(effectiveExtent[1], lastI);
+        effectiveExtent[2] = std::min(effectiveExtent[2], j);
+        effectiveExtent[3] = std::max(effectiveExtent[3], j);
+        effectiveExtent[4] = std::min(effectiveExtent[4], k);
+        effectiveExtent[5] = std::max(effectiveExtent[5], k);
+      }
+    }
+  }
+
+  /// Set the mask voxels of a box where the image is non-zero. The box may exceed the image extent
+  template <class T>
+  void FillMaskFromImageGeneric(T* scalarPointer, vtkImageData* image, const int boxExtent[6], unsigned char segmentValue, unsigned char* mask)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    image->GetExtent(extent);
+    vtkIdType increments[3] = {0,0,0};
+    image->GetIncrements(increments);
+    int boxDimensions[3] = { boxExtent[1]-boxExtent[0]+1, boxExtent[3]-boxExtent[2]+1, boxExtent[5]-boxExtent[4]+1 };
+
+    int commonExtent[6] = {0,-1,0,-1,0,-1};
+    for (int axis=0; axis<3; ++axis)
+    {
+      commonExtent[2*axis] = std::max(extent[2*axis], boxExtent[2*axis]);
+      commonExtent[2*axis+1] = std::min(extent[2*axis+1], boxExtent[2*axis+1]);
+    }
+    for (int k=commonExtent[4]; k<=commonExtent[5]; ++k)
+    {
+      for (int j=commonExtent[2]; j<=commonExtent[3]; ++j)
+      {
+        T* row = scalarPointer + (k-extent[4])*increments[2] + (j-extent[2])*increments[1] + (commonExtent[0]-extent[0])*increments[0];
+        unsigned char* maskRow = mask + ((vtkIdType)(k-boxExtent[4])*boxDimensions[1] + (j-boxExtent[2]))*boxDimensions[0] + (commonExtent[0]-boxExtent[0]);
+        for (int i=commonExtent[0]; i<=commonExtent[1]; ++i, row+=increments[0], ++maskRow)
+        {
+          if (*row != 0)
+          {
+            *maskRow = segmentValue;
+          }
+        }
+      }
+    }
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkOrientedImageDataResample::vtkOrientedImageDataResample()
 {
@@ -161,8 +258,6 @@ bool vtkOrientedImageDataResample::ResampleOrientedImageToReferenceGeometry(vtkO
   }
 
   // Determine IJK extent of contained data (non-zero voxels) in the input image
-  int inputExtent[6] = {0,-1,0,-1,0,-1};
-  inputImage->GetExtent(inputExtent);
   int effectiveInputExtent[6] = {0,-1,0,-1,0,-1};
   if (!vtkOrientedImageDataResample::CalculateEffectiveExtent(inputImage, effectiveInputExtent))
   {
@@ -170,14 +265,6 @@ bool vtkOrientedImageDataResample::ResampleOrientedImageToReferenceGeometry(vtkO
     return false;
   }
 
-  // Apply extent offset on calculated effective extent (in case the input extent does not start at 0)
-  effectiveInputExtent[0] = effectiveInputExtent[0] + inputExtent[0];
-  effectiveInputExtent[1] = effectiveInputExtent[1] + inputExtent[0];
-  effectiveInputExtent[2] = effectiveInputExtent[2] + inputExtent[2];
-  effectiveInputExtent[3] = effectiveInputExtent[3] + inputExtent[2];
-  effectiveInputExtent[4] = effectiveInputExtent[4] + inputExtent[4];
-  effectiveInputExtent[5] = effectiveInputExtent[5] + inputExtent[4];
-
   // Assemble transform
   vtkSmartPointer<vtkTransform> referenceImageToInputImageTransform = vtkSmartPointer<vtkTransform>::New();
   referenceImageToInputImageTransform->Identity();
@@ -208,9 +295,9 @@ bool vtkOrientedImageDataResample::ResampleOrientedImageToReferenceGeometry(vtkO
   vtkOrientedImageDataResample::TransformExtent(effectiveInputExtent, referenceImageToInputImageTransform, outputExtent);
 
   // Return with failure if effective output extent is empty
-  if ( outputExtent[0] == outputExtent[1]
-    || outputExtent[2] == outputExtent[3]
-    || outputExtent[4] == outputExtent[5] )
+  if ( outputExtent[0] > outputExtent[1]
+    || outputExtent[2] > outputExtent[3]
+    || outputExtent[4] > outputExtent[5] )
   {
     return false;
   }
@@ -272,97 +359,162 @@ bool vtkOrientedImageDataResample::IsEqual( const vtkMatrix4x4& lhs, const vtkMa
 }
 
 //----------------------------------------------------------------------------
-bool vtkOrientedImageDataResample::CalculateEffectiveExtent(vtkOrientedImageData* image, int effectiveExtent[6])
+bool vtkOrientedImageDataResample::CalculateEffectiveExtent(vtkImageData* image, int effectiveExtent[6], vtkIdType* numberOfNonZeroVoxels/*=NULL*/)
 {
-  if (!image)
+  effectiveExtent[0] = effectiveExtent[2] = effectiveExtent[4] = 0;
+  effectiveExtent[1] = effectiveExtent[3] = effectiveExtent[5] = -1;
+  if (numberOfNonZeroVoxels)
   {
-    return false;
+    *numberOfNonZeroVoxels = 0;
   }
-
-  int imageScalarType = image->GetScalarType();
-  if ( imageScalarType != VTK_UNSIGNED_CHAR
-    && imageScalarType != VTK_UNSIGNED_SHORT
-    && imageScalarType != VTK_SHORT )
+  if (!image || !image->GetPointData()->GetScalars())
   {
-    vtkErrorWithObjectMacro(image, "CalculateEffectiveExtent: Input image scalar type must be unsigned char, unsighed short, or short!");
     return false;
   }
 
-  // Start from a reverse invalid extent
   int extent[6] = {0,-1,0,-1,0,-1};
   image->GetExtent(extent);
-  effectiveExtent[0] = extent[1];
-  effectiveExtent[1] = extent[0];
-  effectiveExtent[2] = extent[3];
-  effectiveExtent[3] = extent[2];
-  effectiveExtent[4] = extent[5];
-  effectiveExtent[5] = extent[4];
+  if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    return false;
+  }
 
-  // Determine IJK extent of contained data (non-zero voxels) in the input image
-  int dimensions[3] = {0, 0, 0};
-  image->GetDimensions(dimensions);
-  // Handle three scalar types
-  unsigned char* imagePtrUChar = (unsigned char*)image->GetScalarPointerForExtent(extent);
-  unsigned short* imagePtrUShort = (unsigned short*)image->GetScalarPointerForExtent(extent);
-  short* imagePtrShort = (short*)image->GetScalarPointerForExtent(extent);
+  int foundExtent[6] = {VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN};
+  vtkIdType numberOfVoxels = 0;
+  switch (image->GetScalarType())
+  {
+    vtkTemplateMacro(CalculateEffectiveExtentGeneric(static_cast<VTK_TT*>(image->GetScalarPointer()), image, foundExtent, numberOfVoxels));
+  default:
+    vtkErrorWithObjectMacro(image, "CalculateEffectiveExtent: Unsupported image scalar type " << image->GetScalarType());
+    return false;
+  }
+  if (numberOfNonZeroVoxels)
+  {
+    *numberOfNonZeroVoxels = numberOfVoxels;
+  }
+  if (numberOfVoxels == 0)
+  {
+    return false;
+  }
+
+  std::copy(foundExtent, foundExtent+6, effectiveExtent);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkOrientedImageDataResample::FillMaskFromImage(vtkImageData* image, const int boxExtent[6], unsigned char* mask, bool invert/*=false*/)
+{
+  if (!mask || boxExtent[0] > boxExtent[1] || boxExtent[2] > boxExtent[3] || boxExtent[4] > boxExtent[5])
+  {
+    return;
+  }
+  unsigned char segmentValue = (invert ? 0 : 1);
+  vtkIdType numberOfBoxVoxels = (vtkIdType)(boxExtent[1]-boxExtent[0]+1) * (boxExtent[3]-boxExtent[2]+1) * (boxExtent[5]-boxExtent[4]+1);
+  memset(mask, 1-segmentValue, numberOfBoxVoxels);
+  if (!image || !image->GetPointData()->GetScalars())
+  {
+    return;
+  }
+
+  switch (image->GetScalarType())
+  {
+    vtkTemplateMacro(FillMaskFromImageGeneric(static_cast<VTK_TT*>(image->GetScalarPointer()), image, boxExtent, segmentValue, mask));
+  default:
+    vtkErrorWithObjectMacro(image, "FillMaskFromImage: Unsupported image scalar type " << image->GetScalarType());
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkOrientedImageDataResample::CalculateChangedExtent(vtkOrientedImageData* image1, vtkOrientedImageData* image2, int changedExtent[6])
+{
+  changedExtent[0] = changedExtent[2] = changedExtent[4] = 0;
+  changedExtent[1] = changedExtent[3] = changedExtent[5] = -1;
+  if (!image1 || !image2)
+  {
+    return false;
+  }
 
-  for (int i=0; i<dimensions[0]; ++i)
+  // An image without scalars has no voxels, so it is all zero
+  bool hasScalars1 = (image1->GetPointData()->GetScalars() != NULL);
+  bool hasScalars2 = (image2->GetPointData()->GetScalars() != NULL);
+  if (!hasScalars1 && !hasScalars2)
+  {
+    return true;
+  }
+  if (hasScalars1 && hasScalars2)
   {
-    for (int j=0; j<dimensions[1]; ++j)
+    if ( !vtkOrientedImageDataResample::DoGeometriesMatch(image1, image2)
+      || image1->GetScalarType() != image2->GetScalarType()
+      || image1->GetNumberOfScalarComponents() != image2->GetNumberOfScalarComponents() )
     {
-      for (int k=0; k<dimensions[2]; ++k)
+      return false;
+    }
+  }
+  vtkOrientedImageData* imageWithScalars = (hasScalars1 ? image1 : image2);
+  int voxelSize = imageWithScalars->GetScalarSize() * imageWithScalars->GetNumberOfScalarComponents();
+  std::vector<unsigned char> zeroVoxel(voxelSize, 0);
+
+  int extent1[6] = {0,-1,0,-1,0,-1};
+  if (hasScalars1)
+  {
+    image1->GetExtent(extent1);
+  }
+  int extent2[6] = {0,-1,0,-1,0,-1};
+  if (hasScalars2)
+  {
+    image2->GetExtent(extent2);
+  }
+  bool extent1Empty = (extent1[0] > extent1[1] || extent1[2] > extent1[3] || extent1[4] > extent1[5]);
+  bool extent2Empty = (extent2[0] > extent2[1] || extent2[2] > extent2[3] || extent2[4] > extent2[5]);
+  if (extent1Empty && extent2Empty)
+  {
+    return true;
+  }
+
+  // Compare the voxels of the region covered by either image
+  int unionExtent[6] = {0,-1,0,-1,0,-1};
+  for (int i=0; i<3; ++i)
+  {
+    unionExtent[2*i] = (extent1Empty ? extent2[2*i] : (extent2Empty ? extent1[2*i] : std::min(extent1[2*i], extent2[2*i])));
+    unionExtent[2*i+1] = (extent1Empty ? extent2[2*i+1] : (extent2Empty ? extent1[2*i+1] : std::max(extent1[2*i+1], extent2[2*i+1])));
+  }
+  bool changed = false;
+  for (int k=unionExtent[4]; k<=unionExtent[5]; ++k)
+  {
+    for (int j=unionExtent[2]; j<=unionExtent[3]; ++j)
+    {
+      const unsigned char* row1 = (extent1Empty ? NULL : GetRowPointer(image1, extent1, j, k));
+      const unsigned char* row2 = (extent2Empty ? NULL : GetRowPointer(image2, extent2, j, k));
+      if (!row1 && !row2)
       {
-        int voxelValue = 0;
-        if (imageScalarType == VTK_UNSIGNED_CHAR)
-        {
-          voxelValue = (int)(*(imagePtrUChar + i + j*dimensions[0] + k*dimensions[0]*dimensions[1]));
-        }
-        else if (imageScalarType == VTK_UNSIGNED_SHORT)
+        continue;
+      }
+      for (int i=unionExtent[0]; i<=unionExtent[1]; ++i)
+      {
+        const unsigned char* voxel1 = ( (row1 && i >= extent1[0] && i <= extent1[1]) ? row1 + (i-extent1[0])*voxelSize : &(zeroVoxel[0]) );
+        const unsigned char* voxel2 = ( (row2 && i >= extent2[0] && i <= extent2[1]) ? row2 + (i-extent2[0])*voxelSize : &(zeroVoxel[0]) );
+        if (memcmp(voxel1, voxel2, voxelSize) == 0)
         {
-          voxelValue = (int)(*(imagePtrUShort + i + j*dimensions[0] + k*dimensions[0]*dimensions[1]));
+          continue;
         }
-        else if (imageScalarType == VTK_SHORT)
+        if (!changed)
         {
-          voxelValue = (int)(*(imagePtrShort + i + j*dimensions[0] + k*dimensions[0]*dimensions[1]));
-        }
-
-        if (voxelValue != 0)
-        {
-          if (i < effectiveExtent[0])
-          {
-            effectiveExtent[0] = i;
-          }
-          if (i > effectiveExtent[1])
-          {
-            effectiveExtent[1] = i;
-          }
-          if (j < effectiveExtent[2])
-          {
-            effectiveExtent[2] = j;
-          }
-          if (j > effectiveExtent[3])
-          {
-            effectiveExtent[3] = j;
-          }
-          if (k < effectiveExtent[4])
-          {
-            effectiveExtent[4] = k;
-          }
-          if (k > effectiveExtent[5])
-          {
-            effectiveExtent[5] = k;
-          }
+          changedExtent[0] = changedExtent[1] = i;
+          changedExtent[2] = changedExtent[3] = j;
+          changedExtent[4] = changedExtent[5] = k;
+          changed = true;
+          continue;
         }
+        changedExtent[0] = std::min(changedExtent[0], i);
+        changedExtent[1] = std::max(changedExtent[1], i);
+        changedExtent[2] = std::min(changedExtent[2], j);
+        changedExtent[3] = std::max(changedExtent[3], j);
+        changedExtent[4] = std::min(changedExtent[4], k);
+        changedExtent[5] = std::max(changedExtent[5], k);
       }
     }
   }
 
-  // Return with failure if effective input extent is empty
-  if ( effectiveExtent[0] == effectiveExtent[1] || effectiveExtent[2] == effectiveExtent[3] || effectiveExtent[4] == effectiveExtent[5] )
-  {
-    return false;
-  }
-
   return true;
 }
 
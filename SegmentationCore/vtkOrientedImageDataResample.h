@@ -27,6 +27,7 @@
 #include "vtkObject.h"
 
 class vtkOrientedImageData;
+class vtkImageData;
 class vtkMatrix4x4;
 class vtkTransform;
 class vtkAbstractTransform;
@@ -69,7 +70,21 @@ public:
 
 public:
   /// Calculate effective extent of an image: the IJK extent where non-zero voxels are located
-  static bool CalculateEffectiveExtent(vtkOrientedImageData* image, int effectiveExtent[6]);
+  /// \param effectiveExtent Output extent, empty if the image has no non-zero voxels
+  /// \param numberOfNonZeroVoxels Optional output for the number of non-zero voxels
+  /// \return False if the image has no non-zero voxels
+  static bool CalculateEffectiveExtent(vtkImageData* image, int effectiveExtent[6], vtkIdType* numberOfNonZeroVoxels=NULL);
+
+  /// Fill a mask covering an IJK box of the image lattice, one byte per voxel with I varying fastest.
+  /// Mask voxels are 1 where the image is non-zero and 0 elsewhere, including where the box exceeds the image extent.
+  /// \param invert If enabled then mask voxels are 1 where the image is zero (or outside its extent) and 0 where it is non-zero
+  static void FillMaskFromImage(vtkImageData* image, const int boxExtent[6], unsigned char* mask, bool invert=false);
+
+  /// Calculate the IJK extent of the voxels that differ between two images of the same geometry and scalar type.
+  /// Voxels outside the extent of an image (or all voxels of an image without scalars) are considered zero.
+  /// \param changedExtent Output extent, empty if the images have the same content
+  /// \return False if the images cannot be compared (geometry or scalar type mismatch)
+  static bool CalculateChangedExtent(vtkOrientedImageData* image1, vtkOrientedImageData* image2, int changedExtent[6]);
 
   /// Determine if geometries of two oriented image data objects match.
   /// Origin, spacing and direction are considered, extent is not.
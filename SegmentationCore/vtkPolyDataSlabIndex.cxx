@@ -0,0 +1,417 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkPolyDataSlabIndex.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkInformation.h>
+#include <vtkInformationObjectBaseKey.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkStripper.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPolyDataSlabIndex);
+vtkInformationKeyMacro(vtkPolyDataSlabIndex, SLAB_INDEX, ObjectBase);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Maximum number of cutting directions slabs are kept for. Three slice views use three directions
+  const unsigned int MAXIMUM_NUMBER_OF_DIRECTIONS = 4;
+  /// Maximum number of slabs along a direction
+  const int MAXIMUM_NUMBER_OF_SLABS = 4096;
+  /// Tolerance for considering two normalized cutting directions the same
+  const double DIRECTION_TOLERANCE = 1e-6;
+  /// Tolerance for considering two plane offsets the same (in the unit of the poly data, typically mm)
+  const double OFFSET_TOLERANCE = 1e-4;
+
+  //----------------------------------------------------------------------------
+  bool AreDirectionsEqual(const double direction1[3], const double direction2[3])
+  {
+    return fabs(direction1[0] - direction2[0]) < DIRECTION_TOLERANCE
+      && fabs(direction1[1] - direction2[1]) < DIRECTION_TOLERANCE
+      && fabs(direction1[2] - direction2[2]) < DIRECTION_TOLERANCE;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkPolyDataSlabIndex::vtkPolyDataSlabIndex()
+{
+  this->MaximumNumberOfCachedCuts = 64;
+  this->BuiltPolyData = NULL;
+}
+
+//----------------------------------------------------------------------------
+vtkPolyDataSlabIndex::~vtkPolyDataSlabIndex()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataSlabIndex::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfTriangles: " << this->GetNumberOfTriangles() << "\n";
+  os << indent << "NumberOfDirections: " << this->SlabsForDirections.size() << "\n";
+  os << indent << "NumberOfCachedCuts: " << this->CachedCuts.size() << "\n";
+  os << indent << "MaximumNumberOfCachedCuts: " << this->MaximumNumberOfCachedCuts << "\n";
+}
+
+//----------------------------------------------------------------------------
+vtkPolyDataSlabIndex* vtkPolyDataSlabIndex::GetSlabIndexForPolyData(vtkPolyData* polyData)
+{
+  if ( !polyData || !polyData->GetPoints()
+    || (polyData->GetNumberOfPolys() == 0 && polyData->GetNumberOfStrips() == 0) )
+  {
+    return NULL;
+  }
+
+  vtkPolyDataSlabIndex* slabIndex = vtkPolyDataSlabIndex::SafeDownCast(
+    polyData->GetInformation()->Get(vtkPolyDataSlabIndex::SLAB_INDEX()) );
+  if (!slabIndex)
+  {
+    // The information object holds the only reference, so the index is deleted together with the poly data
+    vtkSmartPointer<vtkPolyDataSlabIndex> newSlabIndex = vtkSmartPointer<vtkPolyDataSlabIndex>::New();
+    polyData->GetInformation()->Set(vtkPolyDataSlabIndex::SLAB_INDEX(), newSlabIndex);
+    slabIndex = newSlabIndex.GetPointer();
+  }
+
+  if (!slabIndex->IsUpToDate(polyData))
+  {
+    if (!slabIndex->Build(polyData))
+    {
+      vtkPolyDataSlabIndex::RemoveSlabIndexFromPolyData(polyData);
+      return NULL;
+    }
+  }
+
+  return slabIndex;
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataSlabIndex::RemoveSlabIndexFromPolyData(vtkPolyData* polyData)
+{
+  if (!polyData)
+  {
+    return;
+  }
+  polyData->GetInformation()->Remove(vtkPolyDataSlabIndex::SLAB_INDEX());
+}
+
+//----------------------------------------------------------------------------
+bool vtkPolyDataSlabIndex::Build(vtkPolyData* polyData)
+{
+  this->BuiltPolyData = NULL;
+  this->Triangles.clear();
+  this->SlabsForDirections.clear();
+  this->CachedCuts.clear();
+
+  if (!polyData || !polyData->GetPoints())
+  {
+    vtkErrorMacro("Build: Invalid input poly data!");
+    return false;
+  }
+
+  vtkIdType numberOfCellPoints = 0;
+  vtkIdType* cellPointIds = NULL;
+
+  // Polygons are split into triangle fans
+  vtkCellArray* polys = polyData->GetPolys();
+  if (polys)
+  {
+    for (polys->InitTraversal(); polys->GetNextCell(numberOfCellPoints, cellPointIds); )
+    {
+      for (vtkIdType cellPointIndex=2; cellPointIndex<numberOfCellPoints; ++cellPointIndex)
+      {
+        this->Triangles.push_back(cellPointIds[0]);
+        this->Triangles.push_back(cellPointIds[cellPointIndex-1]);
+        this->Triangles.push_back(cellPointIds[cellPointIndex]);
+      }
+    }
+  }
+
+  // Triangle strips are split into triangles
+  vtkCellArray* strips = polyData->GetStrips();
+  if (strips)
+  {
+    for (strips->InitTraversal(); strips->GetNextCell(numberOfCellPoints, cellPointIds); )
+    {
+      for (vtkIdType cellPointIndex=2; cellPointIndex<numberOfCellPoints; ++cellPointIndex)
+      {
+        this->Triangles.push_back(cellPointIds[cellPointIndex-2]);
+        this->Triangles.push_back(cellPointIds[cellPointIndex-1]);
+        this->Triangles.push_back(cellPointIds[cellPointIndex]);
+      }
+    }
+  }
+
+  this->BuiltPolyData = polyData;
+  this->BuildTime.Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPolyDataSlabIndex::IsUpToDate(vtkPolyData* polyData)
+{
+  return polyData
+    && this->BuiltPolyData == polyData
+    && polyData->GetMTime() <= this->BuildTime.GetMTime();
+}
+
+//----------------------------------------------------------------------------
+vtkPolyData* vtkPolyDataSlabIndex::Cut(const double origin[3], const double normal[3])
+{
+  if (!this->BuiltPolyData)
+  {
+    vtkErrorMacro("Cut: Index has not been built!");
+    return NULL;
+  }
+  double direction[3] = { normal[0], normal[1], normal[2] };
+  if (vtkMath::Normalize(direction) == 0.0)
+  {
+    vtkErrorMacro("Cut: Invalid plane normal!");
+    return NULL;
+  }
+  double offset = vtkMath::Dot(origin, direction);
+
+  // Look up plane in the cache
+  for (std::deque<CachedCut>::iterator cacheIt = this->CachedCuts.begin(); cacheIt != this->CachedCuts.end(); ++cacheIt)
+  {
+    if (AreDirectionsEqual(cacheIt->Direction, direction) && fabs(cacheIt->Offset - offset) < OFFSET_TOLERANCE)
+    {
+      return cacheIt->Contours;
+    }
+  }
+
+  // Not found in the cache, cut the triangles of the slab and store the result
+  CachedCut cachedCut;
+  std::copy(direction, direction+3, cachedCut.Direction);
+  cachedCut.Offset = offset;
+  cachedCut.Contours = this->ComputeCut(this->GetSlabs(direction), offset);
+  this->CachedCuts.push_back(cachedCut);
+  while (this->CachedCuts.size() > (size_t)std::max(1, this->MaximumNumberOfCachedCuts))
+  {
+    this->CachedCuts.pop_front();
+  }
+  return cachedCut.Contours;
+}
+
+//----------------------------------------------------------------------------
+vtkPolyDataSlabIndex::Slabs* vtkPolyDataSlabIndex::GetSlabs(const double direction[3])
+{
+  for (std::deque<Slabs>::iterator slabsIt = this->SlabsForDirections.begin(); slabsIt != this->SlabsForDirections.end(); ++slabsIt)
+  {
+    if (AreDirectionsEqual(slabsIt->Direction, direction))
+    {
+      return &(*slabsIt);
+    }
+  }
+
+  // References to the remaining elements of a deque stay valid when adding or removing at the ends
+  this->SlabsForDirections.push_back(Slabs());
+  this->BuildSlabs(direction, this->SlabsForDirections.back());
+  if (this->SlabsForDirections.size() > MAXIMUM_NUMBER_OF_DIRECTIONS)
+  {
+    this->SlabsForDirections.pop_front();
+  }
+  return &(this->SlabsForDirections.back());
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataSlabIndex::BuildSlabs(const double direction[3], Slabs& slabs)
+{
+  std::copy(direction, direction+3, slabs.Direction);
+  slabs.MinimumOffset = 0.0;
+  slabs.MaximumOffset = -1.0;
+  slabs.SlabWidth = 1.0;
+  slabs.TriangleRanges.clear();
+  slabs.SlabTriangles.clear();
+
+  vtkIdType numberOfTriangles = this->GetNumberOfTriangles();
+  if (numberOfTriangles == 0)
+  {
+    return;
+  }
+
+  // Offset of each point along the direction
+  vtkPoints* points = this->BuiltPolyData->GetPoints();
+  vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  std::vector<double> pointOffsets(numberOfPoints, 0.0);
+  for (vtkIdType pointId=0; pointId<numberOfPoints; ++pointId)
+  {
+    double point[3] = {0.0, 0.0, 0.0};
+    points->GetPoint(pointId, point);
+    pointOffsets[pointId] = vtkMath::Dot(point, direction);
+  }
+
+  // Range of each triangle along the direction
+  slabs.TriangleRanges.resize(2 * numberOfTriangles);
+  double sumOfTriangleExtents = 0.0;
+  for (vtkIdType triangleIndex=0; triangleIndex<numberOfTriangles; ++triangleIndex)
+  {
+    const vtkIdType* trianglePointIds = &(this->Triangles[3*triangleIndex]);
+    double minimum = pointOffsets[trianglePointIds[0]];
+    double maximum = minimum;
+    for (int vertexIndex=1; vertexIndex<3; ++vertexIndex)
+    {
+      minimum = std::min(minimum, pointOffsets[trianglePointIds[vertexIndex]]);
+      maximum = std::max(maximum, pointOffsets[trianglePointIds[vertexIndex]]);
+    }
+    slabs.TriangleRanges[2*triangleIndex] = minimum;
+    slabs.TriangleRanges[2*triangleIndex+1] = maximum;
+    sumOfTriangleExtents += maximum - minimum;
+
+    if (triangleIndex == 0 || minimum < slabs.MinimumOffset)
+    {
+      slabs.MinimumOffset = minimum;
+    }
+    if (triangleIndex == 0 || maximum > slabs.MaximumOffset)
+    {
+      slabs.MaximumOffset = maximum;
+    }
+  }
+
+  // Slabs about as wide as the average triangle, so that a triangle is typically in one or two slabs
+  double range = slabs.MaximumOffset - slabs.MinimumOffset;
+  int numberOfSlabs = 1;
+  if (range > 0.0)
+  {
+    double averageTriangleExtent = sumOfTriangleExtents / numberOfTriangles;
+    double slabWidth = std::max(averageTriangleExtent, range / MAXIMUM_NUMBER_OF_SLABS);
+    numberOfSlabs = std::max(1, std::min(MAXIMUM_NUMBER_OF_SLABS, (int)ceil(range / slabWidth)));
+    slabs.SlabWidth = range / numberOfSlabs;
+  }
+
+  slabs.SlabTriangles.resize(numberOfSlabs);
+  for (vtkIdType triangleIndex=0; triangleIndex<numberOfTriangles; ++triangleIndex)
+  {
+    int firstSlab = (int)floor((slabs.TriangleRanges[2*triangleIndex] - slabs.MinimumOffset) / slabs.SlabWidth);
+    int lastSlab = (int)floor((slabs.TriangleRanges[2*triangleIndex+1] - slabs.MinimumOffset) / slabs.SlabWidth);
+    firstSlab = std::max(0, std::min(numberOfSlabs-1, firstSlab));
+    lastSlab = std::max(0, std::min(numberOfSlabs-1, lastSlab));
+    for (int slabIndex=firstSlab; slabIndex<=lastSlab; ++slabIndex)
+    {
+      slabs.SlabTriangles[slabIndex].push_back(triangleIndex);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> vtkPolyDataSlabIndex::ComputeCut(Slabs* slabs, double offset)
+{
+  vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+  if (!slabs || slabs->SlabTriangles.empty() || offset < slabs->MinimumOffset || offset > slabs->MaximumOffset)
+  {
+    return contours;
+  }
+  int numberOfSlabs = (int)slabs->SlabTriangles.size();
+  int slabIndex = std::max(0, std::min(numberOfSlabs-1, (int)floor((offset - slabs->MinimumOffset) / slabs->SlabWidth)));
+  const std::vector<vtkIdType>& slabTriangles = slabs->SlabTriangles[slabIndex];
+
+  vtkPoints* points = this->BuiltPolyData->GetPoints();
+  vtkNew<vtkPoints> intersectionPoints;
+  vtkNew<vtkCellArray> intersectionLines;
+
+  // Intersection points are shared by the two triangles of an edge, so that the segments can be joined.
+  // Vertices on the plane are considered to be above it, so each triangle has zero or two crossing edges
+  typedef std::map<std::pair<vtkIdType, vtkIdType>, vtkIdType> EdgePointMapType;
+  EdgePointMapType edgePointIds;
+  for (std::vector<vtkIdType>::const_iterator triangleIt = slabTriangles.begin(); triangleIt != slabTriangles.end(); ++triangleIt)
+  {
+    vtkIdType triangleIndex = (*triangleIt);
+    if (slabs->TriangleRanges[2*triangleIndex] > offset || slabs->TriangleRanges[2*triangleIndex+1] < offset)
+    {
+      continue;
+    }
+
+    const vtkIdType* trianglePointIds = &(this->Triangles[3*triangleIndex]);
+    double trianglePoints[3][3];
+    double signedDistances[3] = {0.0, 0.0, 0.0};
+    bool above[3] = {false, false, false};
+    for (int vertexIndex=0; vertexIndex<3; ++vertexIndex)
+    {
+      points->GetPoint(trianglePointIds[vertexIndex], trianglePoints[vertexIndex]);
+      signedDistances[vertexIndex] = vtkMath::Dot(trianglePoints[vertexIndex], slabs->Direction) - offset;
+      above[vertexIndex] = (signedDistances[vertexIndex] >= 0.0);
+    }
+    if (above[0] == above[1] && above[1] == above[2])
+    {
+      continue;
+    }
+
+    vtkIdType segmentPointIds[2] = {0, 0};
+    int numberOfSegmentPoints = 0;
+    for (int edgeIndex=0; edgeIndex<3 && numberOfSegmentPoints<2; ++edgeIndex)
+    {
+      int a = edgeIndex;
+      int b = (edgeIndex+1) % 3;
+      if (above[a] == above[b])
+      {
+        continue;
+      }
+      // Compute the point from the vertex with the lower id, so that both triangles of the edge get the same point
+      if (trianglePointIds[a] > trianglePointIds[b])
+      {
+        std::swap(a, b);
+      }
+      std::pair<vtkIdType, vtkIdType> edge(trianglePointIds[a], trianglePointIds[b]);
+      EdgePointMapType::iterator edgePointIt = edgePointIds.find(edge);
+      if (edgePointIt == edgePointIds.end())
+      {
+        double t = signedDistances[a] / (signedDistances[a] - signedDistances[b]);
+        double intersectionPoint[3] = {
+          trianglePoints[a][0] + t * (trianglePoints[b][0] - trianglePoints[a][0]),
+          trianglePoints[a][1] + t * (trianglePoints[b][1] - trianglePoints[a][1]),
+          trianglePoints[a][2] + t * (trianglePoints[b][2] - trianglePoints[a][2]) };
+        edgePointIt = edgePointIds.insert(std::make_pair(edge, intersectionPoints->InsertNextPoint(intersectionPoint))).first;
+      }
+      segmentPointIds[numberOfSegmentPoints++] = edgePointIt->second;
+    }
+    if (numberOfSegmentPoints == 2)
+    {
+      intersectionLines->InsertNextCell(2, segmentPointIds);
+    }
+  }
+
+  if (intersectionLines->GetNumberOfCells() == 0)
+  {
+    return contours;
+  }
+
+  // Join the segments into polylines
+  vtkNew<vtkPolyData> intersectionSegments;
+  intersectionSegments->SetPoints(intersectionPoints.GetPointer());
+  intersectionSegments->SetLines(intersectionLines.GetPointer());
+  vtkNew<vtkStripper> stripper;
+  stripper->SetInputData(intersectionSegments.GetPointer());
+  stripper->Update();
+  contours->ShallowCopy(stripper->GetOutput());
+  return contours;
+}
@@ -0,0 +1,158 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkPolyDataSlabIndex - Slab index of a surface for fast plane cutting
+// .SECTION Description
+// The triangles of a surface are bucketed by the interval they span along a
+// cutting direction (slab). Cutting the surface with a plane perpendicular to
+// that direction only needs to visit the triangles of one slab instead of all
+// the triangles of the surface.
+//
+// Slabs are built on demand for each cutting direction that is used, and the
+// cut results are cached, so that returning to a previously visited plane
+// (e.g. scrolling back and forth in a slice view) does not require cutting again.
+
+#ifndef __vtkPolyDataSlabIndex_h
+#define __vtkPolyDataSlabIndex_h
+
+// Segmentation includes
+#include "vtkSegmentationCoreConfigure.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimeStamp.h>
+
+// STD includes
+#include <deque>
+#include <vector>
+
+class vtkInformationObjectBaseKey;
+class vtkPolyData;
+
+/// \ingroup SegmentationCore
+class vtkSegmentationCore_EXPORT vtkPolyDataSlabIndex : public vtkObject
+{
+public:
+  static vtkPolyDataSlabIndex *New();
+  vtkTypeMacro(vtkPolyDataSlabIndex, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Information key used to attach the slab index to the poly data it was built from
+  static vtkInformationObjectBaseKey* SLAB_INDEX();
+
+  /// Get slab index attached to a poly data. If there is no index attached to the poly data
+  /// yet then it is created and attached. If the poly data has been modified since the index
+  /// was built then the index is rebuilt.
+  /// \return Up-to-date slab index of the poly data, NULL if the poly data has no polygons
+  static vtkPolyDataSlabIndex* GetSlabIndexForPolyData(vtkPolyData* polyData);
+
+  /// Remove slab index from poly data (if any)
+  static void RemoveSlabIndexFromPolyData(vtkPolyData* polyData);
+
+public:
+  /// Collect the triangles of the poly data. Polygons with more than three points are
+  /// split into triangle fans. Slabs and cached cuts are removed.
+  /// \return Success
+  bool Build(vtkPolyData* polyData);
+
+  /// Determine if the index has been built from the given poly data and the poly data
+  /// has not been modified since
+  bool IsUpToDate(vtkPolyData* polyData);
+
+  /// Cut the surface with a plane. The intersection line segments are joined into polylines
+  /// (contours of a closed surface are closed polylines).
+  /// \param origin Point of the plane in the coordinate system of the poly data
+  /// \param normal Normal of the plane in the coordinate system of the poly data
+  /// \return Intersection polylines. The poly data is owned by the cache of the index, it must
+  ///   not be modified, and it is only valid until the index is rebuilt or removed
+  vtkPolyData* Cut(const double origin[3], const double normal[3]);
+
+  /// Get number of triangles in the index
+  vtkIdType GetNumberOfTriangles() { return (vtkIdType)(this->Triangles.size() / 3); };
+
+public:
+  /// Maximum number of cut results kept in the cache. Default is 64
+  vtkGetMacro(MaximumNumberOfCachedCuts, int);
+  vtkSetClampMacro(MaximumNumberOfCachedCuts, int, 0, VTK_INT_MAX);
+
+protected:
+  /// Triangles bucketed along one cutting direction
+  struct Slabs
+  {
+    double Direction[3];
+    /// Offset of the first slab along the direction
+    double MinimumOffset;
+    /// Offset of the end of the last slab along the direction
+    double MaximumOffset;
+    double SlabWidth;
+    /// Extent of each triangle along the direction (minimum, maximum)
+    std::vector<double> TriangleRanges;
+    /// Indices of the triangles intersecting each slab
+    std::vector< std::vector<vtkIdType> > SlabTriangles;
+  };
+
+  /// Result of a cut, with the plane it was computed for
+  struct CachedCut
+  {
+    double Direction[3];
+    double Offset;
+    vtkSmartPointer<vtkPolyData> Contours;
+  };
+
+  /// Get slabs for a (normalized) cutting direction. The slabs are built if the direction has not been used yet
+  Slabs* GetSlabs(const double direction[3]);
+
+  /// Build slabs for a (normalized) cutting direction
+  void BuildSlabs(const double direction[3], Slabs& slabs);
+
+  /// Cut the triangles of the slab containing the plane direction*x = offset
+  vtkSmartPointer<vtkPolyData> ComputeCut(Slabs* slabs, double offset);
+
+protected:
+  /// Maximum number of cut results kept in the cache
+  int MaximumNumberOfCachedCuts;
+
+  /// Point ids of the triangles (three per triangle)
+  std::vector<vtkIdType> Triangles;
+
+  /// Slabs along the recently used cutting directions (most recent is the last)
+  std::deque<Slabs> SlabsForDirections;
+
+  /// Results of the recent cuts (most recent is the last)
+  std::deque<CachedCut> CachedCuts;
+
+  /// Poly data the index was built from. Not reference counted, because the index is
+  /// typically attached to the poly data itself (\sa SLAB_INDEX)
+  vtkPolyData* BuiltPolyData;
+
+  /// Time of the last build
+  vtkTimeStamp BuildTime;
+
+protected:
+  vtkPolyDataSlabIndex();
+  virtual ~vtkPolyDataSlabIndex();
+
+private:
+  vtkPolyDataSlabIndex(const vtkPolyDataSlabIndex&); // Not implemented
+  void operator=(const vtkPolyDataSlabIndex&);       // Not implemented
+};
+
+#endif
@@ -0,0 +1,560 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkSegmentationHistory.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+#include "vtkSegmentation.h"
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageConstantPad.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSegmentationHistory);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Tolerance for considering two labelmap geometries the same
+  const double GEOMETRY_TOLERANCE = 1e-6;
+
+  //----------------------------------------------------------------------------
+  void AppendRun(std::vector<unsigned char>& encoded, vtkIdType runLength, const unsigned char* value, int voxelSize)
+  {
+    // Run length as variable length integer: 7 bits per byte, highest bit set if more bytes follow
+    unsigned long long length = (unsigned long long)runLength;
+    while (length >= 0x80)
+    {
+      encoded.push_back((unsigned char)((length & 0x7F) | 0x80));
+      length >>= 7;
+    }
+    encoded.push_back((unsigned char)length);
+    encoded.insert(encoded.end(), value, value+voxelSize);
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsExtentEmpty(const int extent[6])
+  {
+    return (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5]);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentationHistory::vtkSegmentationHistory()
+{
+  this->Segmentation = NULL;
+  this->MemorySize = 0;
+  this->MaximumMemorySize = 256 * 1024 * 1024;
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentationHistory::~vtkSegmentationHistory()
+{
+  this->SetSegmentation(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentationHistory::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "Segmentation: " << this->Segmentation << "\n";
+  os << indent << "NumberOfUndoLevels: " << this->UndoModifications.size() << "\n";
+  os << indent << "NumberOfRedoLevels: " << this->RedoModifications.size() << "\n";
+  os << indent << "MemorySize: " << this->MemorySize << "\n";
+  os << indent << "MaximumMemorySize: " << this->MaximumMemorySize << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentationHistory::SetSegmentation(vtkSegmentation* segmentation)
+{
+  if (this->Segmentation == segmentation)
+  {
+    return;
+  }
+  this->RemoveAllModifications();
+  vtkSetObjectBodyMacro(Segmentation, vtkSegmentation, segmentation);
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentationHistory::SetMaximumMemorySize(unsigned long size)
+{
+  if (this->MaximumMemorySize == size)
+  {
+    return;
+  }
+  this->MaximumMemorySize = size;
+  this->EnforceMaximumMemorySize();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentationHistory::SaveModification(const std::string& segmentID, vtkOrientedImageData* modifiedLabelmap, const int modifiedExtent[6])
+{
+  if (!this->Segmentation)
+  {
+    vtkErrorMacro("SaveModification: Invalid segmentation!");
+    return false;
+  }
+  if (!modifiedLabelmap || !modifiedLabelmap->GetPointData()->GetScalars() || !modifiedExtent || IsExtentEmpty(modifiedExtent))
+  {
+    vtkErrorMacro("SaveModification: Invalid modified labelmap or extent!");
+    return false;
+  }
+  vtkSegment* segment = this->Segmentation->GetSegment(segmentID);
+  if (!segment)
+  {
+    vtkErrorMacro("SaveModification: Segment " << segmentID << " not found in segmentation!");
+    return false;
+  }
+  vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast(
+    segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
+  if (!segmentLabelmap)
+  {
+    vtkErrorMacro("SaveModification: Segment " << segmentID << " has no binary labelmap representation!");
+    return false;
+  }
+
+  // Earlier modifications cannot be restored consistently if a segment was modified outside the history,
+  // but the new modification only depends on the current content of the segment, so it is still stored
+  this->RemoveModificationsIfSegmentsModified();
+
+  // An empty segment labelmap has no geometry, its state is all zero
+  bool segmentLabelmapEmpty = (segmentLabelmap->IsEmpty() || !segmentLabelmap->GetPointData()->GetScalars());
+  if (!segmentLabelmapEmpty)
+  {
+    if (!vtkOrientedImageDataResample::DoGeometriesMatch(segmentLabelmap, modifiedLabelmap))
+    {
+      vtkErrorMacro("SaveModification: Modified labelmap geometry does not match the labelmap of segment " << segmentID);
+      return false;
+    }
+    if ( segmentLabelmap->GetScalarType() != modifiedLabelmap->GetScalarType()
+      || segmentLabelmap->GetNumberOfScalarComponents() != modifiedLabelmap->GetNumberOfScalarComponents() )
+    {
+      vtkErrorMacro("SaveModification: Modified labelmap scalar type does not match the labelmap of segment " << segmentID);
+      return false;
+    }
+  }
+
+  // Remove modifications that were undone, they cannot be redone after a new modification
+  for (std::deque<Modification>::iterator modificationIt = this->RedoModifications.begin(); modificationIt != this->RedoModifications.end(); ++modificationIt)
+  {
+    this->MemorySize -= vtkSegmentationHistory::GetModificationSize(*modificationIt);
+  }
+  this->RedoModifications.clear();
+
+  this->UndoModifications.push_back(Modification());
+  Modification& modification = this->UndoModifications.back();
+  modification.SegmentID = segmentID;
+  std::copy(modifiedExtent, modifiedExtent+6, modification.Extent);
+  modification.ScalarType = modifiedLabelmap->GetScalarType();
+  modification.NumberOfScalarComponents = modifiedLabelmap->GetNumberOfScalarComponents();
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  modifiedLabelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+  std::copy(&(imageToWorldMatrix->Element[0][0]), &(imageToWorldMatrix->Element[0][0])+16, modification.ImageToWorldMatrix);
+
+  int voxelSize = modifiedLabelmap->GetScalarSize() * modifiedLabelmap->GetNumberOfScalarComponents();
+  vtkSegmentationHistory::EncodeRegion(segmentLabelmapEmpty ? NULL : segmentLabelmap, modifiedExtent, voxelSize, modification.OldState);
+  vtkSegmentationHistory::EncodeRegion(modifiedLabelmap, modifiedExtent, voxelSize, modification.NewState);
+
+  this->MemorySize += vtkSegmentationHistory::GetModificationSize(modification);
+  this->EnforceMaximumMemorySize();
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentationHistory::UpdateSegmentModifiedTime(const std::string& segmentID)
+{
+  this->SegmentLabelmapModifiedTimes[segmentID] = this->GetSegmentLabelmapModifiedTime(segmentID);
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkSegmentationHistory::GetSegmentLabelmapModifiedTime(const std::string& segmentID)
+{
+  vtkSegment* segment = (this->Segmentation ? this->Segmentation->GetSegment(segmentID) : NULL);
+  vtkDataObject* segmentLabelmap = (segment ? segment->GetRepresentation(
+    vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) : NULL);
+  return (segmentLabelmap ? segmentLabelmap->GetMTime() : 0);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentationHistory::RemoveModificationsIfSegmentsModified()
+{
+  for (std::map<std::string, unsigned long>::iterator timeIt = this->SegmentLabelmapModifiedTimes.begin();
+    timeIt != this->SegmentLabelmapModifiedTimes.end(); ++timeIt)
+  {
+    // A replaced or removed labelmap has a different modification time too
+    if (this->GetSegmentLabelmapModifiedTime(timeIt->first) != timeIt->second)
+    {
+      this->RemoveAllModifications();
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentationHistory::Undo(std::string& segmentID, int restoredExtent[6])
+{
+  if (this->RemoveModificationsIfSegmentsModified())
+  {
+    vtkWarningMacro("Undo: Segmentation was modified outside the history, history is cleared");
+    return false;
+  }
+  if (this->UndoModifications.empty())
+  {
+    return false;
+  }
+
+  Modification& modification = this->UndoModifications.back();
+  if (!this->RestoreState(modification, true))
+  {
+    vtkErrorMacro("Undo: Failed to restore segment " << modification.SegmentID << ", history is cleared");
+    this->RemoveAllModifications();
+    return false;
+  }
+  this->UpdateSegmentModifiedTime(modification.SegmentID);
+  segmentID = modification.SegmentID;
+  std::copy(modification.Extent, modification.Extent+6, restoredExtent);
+
+  // Move the modification to the redo history without copying the stored states
+  this->RedoModifications.push_back(Modification());
+  Modification& undoneModification = this->RedoModifications.back();
+  undoneModification.SegmentID.swap(modification.SegmentID);
+  std::copy(modification.Extent, modification.Extent+6, undoneModification.Extent);
+  undoneModification.ScalarType = modification.ScalarType;
+  undoneModification.NumberOfScalarComponents = modification.NumberOfScalarComponents;
+  std::copy(modification.ImageToWorldMatrix, modification.ImageToWorldMatrix+16, undoneModification.ImageToWorldMatrix);
+  undoneModification.OldState.swap(modification.OldState);
+  undoneModification.NewState.swap(modification.NewState);
+  this->UndoModifications.pop_back();
+
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentationHistory::Redo(std::string& segmentID, int restoredExtent[6])
+{
+  if (this->RemoveModificationsIfSegmentsModified())
+  {
+    vtkWarningMacro("Redo: Segmentation was modified outside the history, history is cleared");
+    return false;
+  }
+  if (this->RedoModifications.empty())
+  {
+    return false;
+  }
+
+  Modification& modification = this->RedoModifications.back();
+  if (!this->RestoreState(modification, false))
+  {
+    vtkErrorMacro("Redo: Failed to restore segment " << modification.SegmentID << ", history is cleared");
+    this->RemoveAllModifications();
+    return false;
+  }
+  this->UpdateSegmentModifiedTime(modification.SegmentID);
+  segmentID = modification.SegmentID;
+  std::copy(modification.Extent, modification.Extent+6, restoredExtent);
+
+  // Move the modification back to the undo history without copying the stored states
+  this->UndoModifications.push_back(Modification());
+  Modification& redoneModification = this->UndoModifications.back();
+  redoneModification.SegmentID.swap(modification.SegmentID);
+  std::copy(modification.Extent, modification.Extent+6, redoneModification.Extent);
+  redoneModification.ScalarType = modification.ScalarType;
+  redoneModification.NumberOfScalarComponents = modification.NumberOfScalarComponents;
+  std::copy(modification.ImageToWorldMatrix, modification.ImageToWorldMatrix+16, redoneModification.ImageToWorldMatrix);
+  redoneModification.OldState.swap(modification.OldState);
+  redoneModification.NewState.swap(modification.NewState);
+  this->RedoModifications.pop_back();
+
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentationHistory::RemoveAllModifications()
+{
+  this->SegmentLabelmapModifiedTimes.clear();
+  if (this->UndoModifications.empty() && this->RedoModifications.empty())
+  {
+    return;
+  }
+  this->UndoModifications.clear();
+  this->RedoModifications.clear();
+  this->MemorySize = 0;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentationHistory::RestoreState(const Modification& modification, bool oldState)
+{
+  if (!this->Segmentation)
+  {
+    return false;
+  }
+  vtkSegment* segment = this->Segmentation->GetSegment(modification.SegmentID);
+  if (!segment)
+  {
+    return false;
+  }
+  vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast(
+    segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
+  if (!segmentLabelmap)
+  {
+    return false;
+  }
+
+  if (segmentLabelmap->IsEmpty() || !segmentLabelmap->GetPointData()->GetScalars())
+  {
+    // Allocate the modified region with the stored geometry
+    vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    imageToWorldMatrix->DeepCopy(modification.ImageToWorldMatrix);
+    segmentLabelmap->SetGeometryFromImageToWorldMatrix(imageToWorldMatrix);
+    segmentLabelmap->SetExtent(const_cast<int*>(modification.Extent));
+    segmentLabelmap->AllocateScalars(modification.ScalarType, modification.NumberOfScalarComponents);
+    memset(segmentLabelmap->GetScalarPointer(), 0,
+      (size_t)segmentLabelmap->GetNumberOfPoints() * segmentLabelmap->GetScalarSize() * modification.NumberOfScalarComponents);
+  }
+  else
+  {
+    // Segment labelmap must not have been replaced by a labelmap of another geometry or type since the modification
+    vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    segmentLabelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+    for (int i=0; i<16; ++i)
+    {
+      if (fabs(imageToWorldMatrix->Element[i/4][i%4] - modification.ImageToWorldMatrix[i]) > GEOMETRY_TOLERANCE)
+      {
+        return false;
+      }
+    }
+    if ( segmentLabelmap->GetScalarType() != modification.ScalarType
+      || segmentLabelmap->GetNumberOfScalarComponents() != modification.NumberOfScalarComponents )
+    {
+      return false;
+    }
+
+    // Extend the labelmap if it does not contain the modified region (it may have been shrunk since)
+    int labelmapExtent[6] = {0,-1,0,-1,0,-1};
+    segmentLabelmap->GetExtent(labelmapExtent);
+    int unionExtent[6] = {0,-1,0,-1,0,-1};
+    bool containsRegion = true;
+    for (int i=0; i<3; ++i)
+    {
+      unionExtent[2*i] = std::min(labelmapExtent[2*i], modification.Extent[2*i]);
+      unionExtent[2*i+1] = std::max(labelmapExtent[2*i+1], modification.Extent[2*i+1]);
+      if (unionExtent[2*i] != labelmapExtent[2*i] || unionExtent[2*i+1] != labelmapExtent[2*i+1])
+      {
+        containsRegion = false;
+      }
+    }
+    if (!containsRegion)
+    {
+      vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
+      padder->SetInputData(segmentLabelmap);
+      padder->SetOutputWholeExtent(unionExtent);
+      padder->SetConstant(0);
+      padder->Update();
+      segmentLabelmap->DeepCopy(padder->GetOutput());
+    }
+  }
+
+  if (!vtkSegmentationHistory::DecodeRegion(oldState ? modification.OldState : modification.NewState, segmentLabelmap, modification.Extent))
+  {
+    return false;
+  }
+  segmentLabelmap->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkSegmentationHistory::GetModificationSize(const Modification& modification)
+{
+  return (unsigned long)(sizeof(Modification) + modification.SegmentID.size()
+    + modification.OldState.capacity() + modification.NewState.capacity());
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentationHistory::EnforceMaximumMemorySize()
+{
+  while (this->MemorySize > this->MaximumMemorySize && !this->UndoModifications.empty())
+  {
+    this->MemorySize -= vtkSegmentationHistory::GetModificationSize(this->UndoModifications.front());
+    this->UndoModifications.pop_front();
+  }
+  while (this->MemorySize > this->MaximumMemorySize && !this->RedoModifications.empty())
+  {
+    this->MemorySize -= vtkSegmentationHistory::GetModificationSize(this->RedoModifications.front());
+    this->RedoModifications.pop_front();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentationHistory::EncodeRegion(vtkImageData* image, const int region[6], int voxelSize, std::vector<unsigned char>& encoded)
+{
+  encoded.clear();
+
+  int imageExtent[6] = {0,-1,0,-1,0,-1};
+  if (image && image->GetPointData()->GetScalars())
+  {
+    image->GetExtent(imageExtent);
+  }
+  std::vector<unsigned char> zeroVoxel(voxelSize, 0);
+
+  const unsigned char* runValue = NULL;
+  vtkIdType runLength = 0;
+  for (int k=region[4]; k<=region[5]; ++k)
+  {
+    for (int j=region[2]; j<=region[3]; ++j)
+    {
+      // Part of the row that is within the image
+      int rowStart = std::max(region[0], imageExtent[0]);
+      int rowEnd = std::min(region[1], imageExtent[1]);
+      const unsigned char* rowPtr = NULL;
+      if ( j >= imageExtent[2] && j <= imageExtent[3] && k >= imageExtent[4] && k <= imageExtent[5] && rowStart <= rowEnd )
+      {
+        rowPtr = static_cast<unsigned char*>(image->GetScalarPointer(rowStart, j, k));
+      }
+      for (int i=region[0]; i<=region[1]; ++i)
+      {
+        const unsigned char* value = ( (rowPtr && i >= rowStart && i <= rowEnd) ? rowPtr + (i-rowStart)*voxelSize : &(zeroVoxel[0]) );
+        if (runLength > 0 && memcmp(value, runValue, voxelSize) == 0)
+        {
+          ++runLength;
+          continue;
+        }
+        if (runLength > 0)
+        {
+          AppendRun(encoded, runLength, runValue, voxelSize);
+        }
+        runValue = value;
+        runLength = 1;
+      }
+    }
+  }
+  if (runLength > 0)
+  {
+    AppendRun(encoded, runLength, runValue, voxelSize);
+  }
+
+  // Release the memory reserved by the growth of the vector
+  std::vector<unsigned char>(encoded).swap(encoded);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentationHistory::DecodeRegion(const std::vector<unsigned char>& encoded, vtkImageData* image, const int region[6])
+{
+  if (!image || IsExtentEmpty(region))
+  {
+    return false;
+  }
+  int voxelSize = image->GetScalarSize() * image->GetNumberOfScalarComponents();
+  const int rowLength = region[1]-region[0]+1;
+
+  int j = region[2];
+  int k = region[4];
+  unsigned char* rowPtr = static_cast<unsigned char*>(image->GetScalarPointer(region[0], j, k));
+  int rowRemaining = rowLength;
+
+  size_t position = 0;
+  while (position < encoded.size())
+  {
+    // Read run length
+    unsigned long long runLength = 0;
+    int shift = 0;
+    while (position < encoded.size() && (encoded[position] & 0x80))
+    {
+      runLength |= (unsigned long long)(encoded[position] & 0x7F) << shift;
+      shift += 7;
+      ++position;
+    }
+    if (position >= encoded.size() || shift > 56)
+    {
+      return false;
+    }
+    runLength |= (unsigned long long)encoded[position] << shift;
+    ++position;
+
+    // Read run value
+    if (position + voxelSize > encoded.size())
+    {
+      return false;
+    }
+    const unsigned char* value = &(encoded[position]);
+    position += voxelSize;
+
+    // Write the run into the rows of the region
+    while (runLength > 0)
+    {
+      if (k > region[5])
+      {
+        // More voxels than the region contains
+        return false;
+      }
+      int count = (int)std::min(runLength, (unsigned long long)rowRemaining);
+      if (voxelSize == 1)
+      {
+        memset(rowPtr, value[0], count);
+      }
+      else
+      {
+        for (int i=0; i<count; ++i)
+        {
+          memcpy(rowPtr + i*voxelSize, value, voxelSize);
+        }
+      }
+      rowPtr += count*voxelSize;
+      rowRemaining -= count;
+      runLength -= count;
+
+      if (rowRemaining == 0)
+      {
+        ++j;
+        if (j > region[3])
+        {
+          j = region[2];
+          ++k;
+        }
+        if (k <= region[5])
+        {
+          rowPtr = static_cast<unsigned char*>(image->GetScalarPointer(region[0], j, k));
+        }
+        rowRemaining = rowLength;
+      }
+    }
+  }
+
+  // All voxels of the region must have been written
+  return (k > region[5]);
+}
@@ -0,0 +1,176 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkSegmentationHistory - Undo/redo history of segment binary labelmap modifications
+// .SECTION Description
+// Each modification stores only the region of the segment labelmap that was modified, both the
+// content before and after the modification, run-length encoded. Binary labelmaps consist of long
+// runs of the same value, so a typical brush stroke takes a few hundred bytes instead of a copy
+// of the whole labelmap. Undo and redo write the stored region back into the segment labelmap, so
+// their cost only depends on the size of the region, not on the size of the labelmap or the history.
+//
+// The total size of the stored modifications is limited by \sa MaximumMemorySize, the oldest
+// modifications are discarded when the limit is exceeded.
+//
+// The stored regions are only valid as long as the segment labelmaps are modified exclusively
+// through the history. The modification time of each labelmap is recorded after the history
+// modified it, and all modifications are removed if a labelmap was modified by anything else.
+
+#ifndef __vtkSegmentationHistory_h
+#define __vtkSegmentationHistory_h
+
+// Segmentation includes
+#include "vtkSegmentationCoreConfigure.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+class vtkImageData;
+class vtkOrientedImageData;
+class vtkSegmentation;
+
+/// \ingroup SegmentationCore
+class vtkSegmentationCore_EXPORT vtkSegmentationHistory : public vtkObject
+{
+public:
+  static vtkSegmentationHistory *New();
+  vtkTypeMacro(vtkSegmentationHistory, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Set segmentation that the modifications are undone and redone in.
+  /// All stored modifications are removed if the segmentation changes.
+  void SetSegmentation(vtkSegmentation* segmentation);
+  vtkGetObjectMacro(Segmentation, vtkSegmentation);
+
+  /// Store a modification of a segment binary labelmap. Redo history is removed.
+  /// Must be called before the modified labelmap is copied into the segment, so that the current
+  /// content of the segment labelmap is stored as the state before the modification.
+  /// \param segmentID ID of the modified segment
+  /// \param modifiedLabelmap Labelmap containing the state after the modification. It must have the
+  ///   same geometry as the segment labelmap (extents may differ, voxels outside the extent are zero)
+  /// \param modifiedExtent Modified region in the IJK coordinates of the labelmaps
+  /// \return Success
+  bool SaveModification(const std::string& segmentID, vtkOrientedImageData* modifiedLabelmap, const int modifiedExtent[6]);
+
+  /// Record that the modification stored by \sa SaveModification has been copied into the segment labelmap.
+  /// Must be called after the copy, so that later modifications of the labelmap made outside the history
+  /// can be detected. If it is not called then modifications of the segment are not checked.
+  void UpdateSegmentModifiedTime(const std::string& segmentID);
+
+  /// Restore the state of the segment labelmap before the last modification
+  /// \param segmentID Output ID of the segment that was restored
+  /// \param restoredExtent Output region of the segment labelmap that was restored
+  /// \return Success. If undo failed (e.g. because the segment was removed or modified outside
+  ///   the history) then the history is cleared
+  bool Undo(std::string& segmentID, int restoredExtent[6]);
+
+  /// Apply again the last undone modification
+  /// \param segmentID Output ID of the segment that was restored
+  /// \param restoredExtent Output region of the segment labelmap that was restored
+  /// \return Success. If redo failed (e.g. because the segment was modified outside the history)
+  ///   then the history is cleared
+  bool Redo(std::string& segmentID, int restoredExtent[6]);
+
+  /// Remove all stored modifications
+  void RemoveAllModifications();
+
+  /// Get number of modifications that can be undone
+  int GetNumberOfUndoLevels() { return (int)this->UndoModifications.size(); };
+  /// Get number of modifications that can be redone
+  int GetNumberOfRedoLevels() { return (int)this->RedoModifications.size(); };
+
+  /// Get total size of the stored modifications in bytes
+  unsigned long GetMemorySize() { return this->MemorySize; };
+
+public:
+  /// Maximum total size of the stored modifications in bytes. Default is 256MB
+  vtkGetMacro(MaximumMemorySize, unsigned long);
+  void SetMaximumMemorySize(unsigned long size);
+
+protected:
+  /// Stored modification of a segment labelmap region
+  struct Modification
+  {
+    std::string SegmentID;
+    int Extent[6];
+    int ScalarType;
+    int NumberOfScalarComponents;
+    double ImageToWorldMatrix[16];
+    /// Run-length encoded content of the region before the modification
+    std::vector<unsigned char> OldState;
+    /// Run-length encoded content of the region after the modification
+    std::vector<unsigned char> NewState;
+  };
+
+  /// Write a stored state of a modification into the segment labelmap
+  bool RestoreState(const Modification& modification, bool oldState);
+
+  /// Get the modification time of the binary labelmap of a segment, 0 if the segment has no labelmap
+  unsigned long GetSegmentLabelmapModifiedTime(const std::string& segmentID);
+
+  /// Remove all modifications if any segment labelmap was modified outside the history since the history
+  /// last modified it, as the stored states would not restore the segment consistently.
+  /// \return True if modifications were removed
+  bool RemoveModificationsIfSegmentsModified();
+
+  /// Get the size of a modification in bytes
+  static unsigned long GetModificationSize(const Modification& modification);
+
+  /// Remove the oldest modifications until the memory size is within the limit
+  void EnforceMaximumMemorySize();
+
+  /// Run-length encode a region of an image. Voxels outside the extent of the image are encoded as zero.
+  /// Each run is stored as the run length (variable length integer) followed by the voxel value.
+  static void EncodeRegion(vtkImageData* image, const int region[6], int voxelSize, std::vector<unsigned char>& encoded);
+
+  /// Decode run-length encoded voxels into a region of an image. The image must contain the region
+  static bool DecodeRegion(const std::vector<unsigned char>& encoded, vtkImageData* image, const int region[6]);
+
+protected:
+  vtkSegmentation* Segmentation;
+
+  /// Modifications that can be undone (most recent is the last)
+  std::deque<Modification> UndoModifications;
+
+  /// Modifications that can be redone (most recently undone is the last)
+  std::deque<Modification> RedoModifications;
+
+  /// Modification time of the segment labelmaps after the history last modified them
+  std::map<std::string, unsigned long> SegmentLabelmapModifiedTimes;
+
+  unsigned long MemorySize;
+  unsigned long MaximumMemorySize;
+
+protected:
+  vtkSegmentationHistory();
+  virtual ~vtkSegmentationHistory();
+
+private:
+  vtkSegmentationHistory(const vtkSegmentationHistory&); // Not implemented
+  void operator=(const vtkSegmentationHistory&);         // Not implemented
+};
+
+#endif
@@ -94,7 +94,7 @@ void qSlicerSegmentEditorLabelEffectPrivate::masterVolumeScalarRange(double& low
 }
 
 //-----------------------------------------------------------------------------
-void qSlicerSegmentEditorLabelEffectPrivate::applyMaskImage(vtkOrientedImageData* input, vtkOrientedImageData* mask, int notMask)
+void qSlicerSegmentEditorLabelEffectPrivate::applyMaskImage(vtkOrientedImageData* input, vtkOrientedImageData* mask, int notMask, const int* region/*=NULL*/)
 {
   if (!input || !mask)
   {
@@ -102,6 +102,35 @@ void qSlicerSegmentEditorLabelEffectPrivate::applyMaskImage(vtkOrientedImageData
     return;
   }
 
+  if (region)
+  {
+    // Mask only the region: crop input and mask to the region and copy the result back into the input
+    int maskedExtent[6] = {region[0], region[1], region[2], region[3], region[4], region[5]};
+    vtkSmartPointer<vtkOrientedImageData> resampledMask = mask;
+    if (!vtkOrientedImageDataResample::DoGeometriesMatch(mask, input))
+    {
+      resampledMask = vtkSmartPointer<vtkOrientedImageData>::New();
+      vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(mask, input, resampledMask);
+    }
+
+    vtkSmartPointer<vtkImageConstantPad> inputCropper = vtkSmartPointer<vtkImageConstantPad>::New();
+    inputCropper->SetInputData(input);
+    inputCropper->SetOutputWholeExtent(maskedExtent);
+    vtkSmartPointer<vtkImageConstantPad> maskCropper = vtkSmartPointer<vtkImageConstantPad>::New();
+    maskCropper->SetInputData(resampledMask);
+    maskCropper->SetOutputWholeExtent(maskedExtent);
+
+    vtkSmartPointer<vtkImageMask> masker = vtkSmartPointer<vtkImageMask>::New();
+    masker->SetImageInputConnection(inputCropper->GetOutputPort());
+    masker->SetMaskInputConnection(maskCropper->GetOutputPort());
+    masker->SetNotMask(notMask);
+    masker->SetMaskedOutputValue(0);
+    masker->Update();
+    input->CopyAndCastFrom(masker->GetOutput(), maskedExtent);
+    input->Modified();
+    return;
+  }
+
   // Make sure mask has the same lattice as the edited editedLabelmap
   vtkSmartPointer<vtkOrientedImageData> resampledMask = vtkSmartPointer<vtkOrientedImageData>::New();
   vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
@@ -314,10 +343,19 @@ void qSlicerSegmentEditorLabelEffect::apply()
   vtkOrientedImageData* editedLabelmap = this->parameterSetNode()->GetEditedLabelmap();
   vtkOrientedImageData* maskLabelmap = this->parameterSetNode()->GetMaskLabelmap();
 
+  // If the effect reported the region it modified, then mask and threshold only that region
+  int modifiedExtent[6] = {0,-1,0,-1,0,-1};
+  this->parameterSetNode()->GetEditedLabelmapModifiedExtent(modifiedExtent);
+  int* modifiedRegion = NULL;
+  if (modifiedExtent[0] <= modifiedExtent[1] && modifiedExtent[2] <= modifiedExtent[3] && modifiedExtent[4] <= modifiedExtent[5])
+  {
+    modifiedRegion = modifiedExtent;
+  }
+
   // Apply mask to edited editedLabelmap if paint over is turned off
   if (!this->integerParameter(this->paintOverParameterName()))
   {
-    d->applyMaskImage(editedLabelmap, maskLabelmap, 1);
+    d->applyMaskImage(editedLabelmap, maskLabelmap, 1, modifiedRegion);
   }
 
   // Apply threshold mask if paint threshold is turned on
@@ -329,8 +367,26 @@ void qSlicerSegmentEditorLabelEffect::apply()
       qCritical() << "qSlicerSegmentEditorPaintEffect::apply: Invalid master volume!";
       return;
     }
-    vtkSmartPointer<vtkOrientedImageData> masterVolumeOrientedImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
-      vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(masterVolumeNode) );
+    vtkSmartPointer<vtkOrientedImageData> masterVolumeOrientedImageData;
+    if (modifiedRegion && masterVolumeNode->GetImageData())
+    {
+      // Only the modified region of the master volume is thresholded
+      vtkSmartPointer<vtkImageConstantPad> masterCropper = vtkSmartPointer<vtkImageConstantPad>::New();
+      masterCropper->SetInputData(masterVolumeNode->GetImageData());
+      masterCropper->SetOutputWholeExtent(modifiedRegion);
+      masterCropper->Update();
+      masterVolumeOrientedImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+      masterVolumeOrientedImageData->vtkImageData::ShallowCopy(masterCropper->GetOutput());
+      vtkSmartPointer<vtkMatrix4x4> masterIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      masterVolumeNode->GetIJKToRASMatrix(masterIjkToRasMatrix);
+      masterVolumeOrientedImageData->SetGeometryFromImageToWorldMatrix(masterIjkToRasMatrix);
+      vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(masterVolumeNode, masterVolumeOrientedImageData);
+    }
+    else
+    {
+      masterVolumeOrientedImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+        vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(masterVolumeNode) );
+    }
     if (!masterVolumeOrientedImageData)
     {
       qCritical() << "qSlicerSegmentEditorPaintEffect::apply: Unable to get master volume image!";
@@ -360,7 +416,7 @@ void qSlicerSegmentEditorLabelEffect::apply()
     editedLabelmap->GetImageToWorldMatrix(editedLabelmapToWorldMatrix);
     thresholdMask->SetGeometryFromImageToWorldMatrix(editedLabelmapToWorldMatrix);
 
-    d->applyMaskImage(editedLabelmap, thresholdMask, 0);
+    d->applyMaskImage(editedLabelmap, thresholdMask, 0, modifiedRegion);
   }
 
   // Notify editor about changes
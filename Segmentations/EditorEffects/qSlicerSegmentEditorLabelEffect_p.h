@@ -64,7 +64,8 @@ public:
   /// \param notMask If on, the mask is passed through a boolean not before it is used to mask the image.
   ///   The effect is to pass the pixels where the input mask is zero, and replace the pixels where the
   ///   input value is non zero
-  void applyMaskImage(vtkOrientedImageData* input, vtkOrientedImageData* mask, int notMask);
+  /// \param region If specified, only this region of the input is masked (IJK extent of the input)
+  void applyMaskImage(vtkOrientedImageData* input, vtkOrientedImageData* mask, int notMask, const int* region=NULL);
 
 protected slots:
   /// Enable/disable threshold when checkbox is toggled
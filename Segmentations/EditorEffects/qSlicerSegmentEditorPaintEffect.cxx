@@ -98,6 +98,38 @@ public:
   vtkPolyData* PolyData;
 };
 
+//-----------------------------------------------------------------------------
+/// Clamp IJK coordinates to the extent of an image
+static void ClampToExtent(const int ijk[3], const int extent[6], int clampedIjk[3])
+{
+  for (int i=0; i<3; ++i)
+  {
+    clampedIjk[i] = qBound(extent[2*i], ijk[i], extent[2*i+1]);
+  }
+}
+
+//-----------------------------------------------------------------------------
+/// Extend extent so that it contains the region painted by a brush defined by its IJK corners
+static void ExtendExtentWithBrushCorners(int extent[6], const int topLeft[3], const int topRight[3], const int bottomLeft[3], const int bottomRight[3])
+{
+  const int* corners[4] = {topLeft, topRight, bottomLeft, bottomRight};
+  for (int cornerIndex=0; cornerIndex<4; ++cornerIndex)
+  {
+    for (int i=0; i<3; ++i)
+    {
+      if (extent[2*i] > extent[2*i+1])
+      {
+        extent[2*i] = extent[2*i+1] = corners[cornerIndex][i];
+      }
+      else
+      {
+        extent[2*i] = qMin(extent[2*i], corners[cornerIndex][i]);
+        extent[2*i+1] = qMax(extent[2*i+1], corners[cornerIndex][i]);
+      }
+    }
+  }
+}
+
 //-----------------------------------------------------------------------------
 // qSlicerSegmentEditorPaintEffectPrivate methods
 
@@ -228,10 +260,11 @@ void qSlicerSegmentEditorPaintEffectPrivate::paintApply(qMRMLSliceWidget* sliceW
 {
   Q_Q(qSlicerSegmentEditorPaintEffect);
 
-  //TODO:
-  //if self.paintCoordinates != []:
-  //  if self.undoRedo:
-  //    self.undoRedo.saveState()
+  // Nothing to apply, e.g. on button release after each point has already been painted
+  if (this->PaintCoordinates.isEmpty())
+  {
+    return;
+  }
 
   foreach (QPoint xy, this->PaintCoordinates)
   {
@@ -296,25 +329,23 @@ void qSlicerSegmentEditorPaintEffectPrivate::paintBrush(qMRMLSliceWidget* sliceW
   qSlicerSegmentEditorAbstractEffect::xyToIjk(QPoint(left, bottom),  bottomLeftIjk, sliceWidget, labelImage);
   qSlicerSegmentEditorAbstractEffect::xyToIjk(QPoint(right, bottom), bottomRightIjk, sliceWidget, labelImage);
 
-  // Clamp the top, bottom, left, right to the valid dimensions of the label image
-  int dims[3] = {0, 0, 0};
-  labelImage->GetDimensions(dims);
+  // Clamp the top, bottom, left, right to the valid extent of the label image
+  int labelExtent[6] = {0, -1, 0, -1, 0, -1};
+  labelImage->GetExtent(labelExtent);
 
   int topLeft[3] =     {0, 0, 0};
   int topRight[3] =    {0, 0, 0};
   int bottomLeft[3] =  {0, 0, 0};
   int bottomRight[3] = {0, 0, 0};
-  for (int i=0; i<3; ++i)
-  {
-    topLeft[i] = qMax(topLeftIjk[i], 0);
-    topLeft[i] = qMin(topLeftIjk[i], dims[i]-1);
-    topRight[i] = qMax(topRightIjk[i], 0);
-    topRight[i] = qMin(topRightIjk[i], dims[i]-1);
-    bottomLeft[i] = qMax(bottomLeftIjk[i], 0);
-    bottomLeft[i] = qMin(bottomLeftIjk[i], dims[i]-1);
-    bottomRight[i] = qMax(bottomRightIjk[i], 0);
-    bottomRight[i] = qMin(bottomRightIjk[i], dims[i]-1);
-  }
+  ClampToExtent(topLeftIjk, labelExtent, topLeft);
+  ClampToExtent(topRightIjk, labelExtent, topRight);
+  ClampToExtent(bottomLeftIjk, labelExtent, bottomLeft);
+  ClampToExtent(bottomRightIjk, labelExtent, bottomRight);
+
+  // Region of the label image the brush paints into. The painter only visits the voxels of the brush,
+  // and the region is reported so that only this part of the labelmap is applied to the segment
+  int brushExtent[6] = {0, -1, 0, -1, 0, -1};
+  ExtendExtentWithBrushCorners(brushExtent, topLeft, topRight, bottomLeft, bottomRight);
 
   // If the region is smaller than a pixel then paint it using paintPixel mode,
   // to make sure at least one pixel is filled on each click
@@ -445,22 +476,17 @@ void qSlicerSegmentEditorPaintEffectPrivate::paintBrush(qMRMLSliceWidget* sliceW
         int currentBottomRightIjk[3] = {0, 0, 0};
         q->xyzToIjk(bottomRightXyz, currentBottomRightIjk, sliceWidget, labelImage);
 
-        // Clamp the top, bottom, left, right to the valid dimensions of the label image
+        // Clamp the top, bottom, left, right to the valid extent of the label image
         int currentTopLeft[3] =     {0, 0, 0};
         int currentTopRight[3] =    {0, 0, 0};
         int currentBottomLeft[3] =  {0, 0, 0};
         int currentBottomRight[3] = {0, 0, 0};
-        for (int i=0; i<3; ++i)
-        {
-          currentTopLeft[i] = qMax(currentTopLeftIjk[i], 0);
-          currentTopLeft[i] = qMin(currentTopLeftIjk[i], dims[i]-1);
-          currentTopRight[i] = qMax(currentTopRightIjk[i], 0);
-          currentTopRight[i] = qMin(currentTopRightIjk[i], dims[i]-1);
-          currentBottomLeft[i] = qMax(currentBottomLeftIjk[i], 0);
-          currentBottomLeft[i] = qMin(currentBottomLeftIjk[i], dims[i]-1);
-          currentBottomRight[i] = qMax(currentBottomRightIjk[i], 0);
-          currentBottomRight[i] = qMin(currentBottomRightIjk[i], dims[i]-1);
-        }
+        ClampToExtent(currentTopLeftIjk, labelExtent, currentTopLeft);
+        ClampToExtent(currentTopRightIjk, labelExtent, currentTopRight);
+        ClampToExtent(currentBottomLeftIjk, labelExtent, currentBottomLeft);
+        ClampToExtent(currentBottomRightIjk, labelExtent, currentBottomRight);
+        ExtendExtentWithBrushCorners(brushExtent, currentTopLeft, currentTopRight, currentBottomLeft, currentBottomRight);
+
         this->Painter->SetTopLeft(currentTopLeft);
         this->Painter->SetTopRight(currentTopRight);
         this->Painter->SetBottomLeft(currentBottomLeft);
@@ -480,6 +506,8 @@ void qSlicerSegmentEditorPaintEffectPrivate::paintBrush(qMRMLSliceWidget* sliceW
   this->Painter->SetBottomRight(bottomRight);
 
   this->Painter->Paint();
+
+  q->parameterSetNode()->AddEditedLabelmapModifiedExtent(brushExtent);
 }
 
 //-----------------------------------------------------------------------------
@@ -503,17 +531,20 @@ void qSlicerSegmentEditorPaintEffectPrivate::paintPixel(qMRMLSliceWidget* sliceW
   q->xyToIjk(xy, ijk, sliceWidget, labelImage);
 
   // Clamp to image extent
-  int dims[3] = {0, 0, 0};
-  labelImage->GetDimensions(dims);
+  int labelExtent[6] = {0, -1, 0, -1, 0, -1};
+  labelImage->GetExtent(labelExtent);
   for (int i=0; i<3; ++i)
   {
-    if (ijk[i] < 0 || ijk[i] >= dims[i])
+    if (ijk[i] < labelExtent[2*i] || ijk[i] > labelExtent[2*i+1])
     {
       return;
     }
   }
 
   labelImage->SetScalarComponentFromDouble(ijk[0],ijk[1],ijk[2], 0, 1); // Segment binary labelmaps all have voxel values of 1 for foreground
+
+  int pixelExtent[6] = {ijk[0], ijk[0], ijk[1], ijk[1], ijk[2], ijk[2]};
+  q->parameterSetNode()->AddEditedLabelmapModifiedExtent(pixelExtent);
 }
 
 //-----------------------------------------------------------------------------
@@ -746,6 +777,11 @@ void qSlicerSegmentEditorPaintEffect::processInteractionEvents(
 
   if (eid == vtkCommand::LeftButtonPressEvent)
   {
+    // New stroke: discard the modified region possibly left over by an interrupted stroke
+    if (this->parameterSetNode())
+    {
+      this->parameterSetNode()->ResetEditedLabelmapModifiedExtent();
+    }
     d->IsPainting = true;
     if (!this->integerParameter("PixelMode"))
     {
@@ -22,6 +22,7 @@
 
 // SubjectHierarchy includes
 #include "qSlicerSegmentEditorScriptedEffect.h"
+#include "vtkMRMLSegmentEditorNode.h"
 
 // Qt includes
 #include <QDebug>
@@ -306,6 +307,13 @@ void qSlicerSegmentEditorScriptedEffect::deactivate()
 //-----------------------------------------------------------------------------
 void qSlicerSegmentEditorScriptedEffect::apply()
 {
+  // Scripted effects report their modified region (if any) in their apply method,
+  // so a region left over from an earlier operation must not be applied instead
+  if (this->parameterSetNode())
+  {
+    this->parameterSetNode()->ResetEditedLabelmapModifiedExtent();
+  }
+
   Q_D(const qSlicerSegmentEditorScriptedEffect);
   PyObject* result = d->PythonCppAPI.callMethod(d->ApplyMethod);
 
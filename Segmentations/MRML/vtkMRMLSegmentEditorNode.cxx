@@ -35,6 +35,7 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 
 // STD includes
 #include <sstream>
+#include <algorithm>
 
 //------------------------------------------------------------------------------
 static const char* SEGMENTATION_REFERENCE_ROLE = "segmentationRef";
@@ -52,6 +53,7 @@ vtkMRMLSegmentEditorNode::vtkMRMLSegmentEditorNode()
 {
   this->EditedLabelmap = vtkOrientedImageData::New();
   this->MaskLabelmap = vtkOrientedImageData::New();
+  this->ResetEditedLabelmapModifiedExtent();
 }
 
 //----------------------------------------------------------------------------
@@ -165,6 +167,9 @@ void vtkMRMLSegmentEditorNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "MaskLabelmap:\n";
   this->MaskLabelmap->PrintSelf(os,indent);
   os << indent << "\n";
+  os << indent << "EditedLabelmapModifiedExtent: " << this->EditedLabelmapModifiedExtent[0] << " " << this->EditedLabelmapModifiedExtent[1]
+    << " " << this->EditedLabelmapModifiedExtent[2] << " " << this->EditedLabelmapModifiedExtent[3]
+    << " " << this->EditedLabelmapModifiedExtent[4] << " " << this->EditedLabelmapModifiedExtent[5] << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -191,3 +196,33 @@ void vtkMRMLSegmentEditorNode::SetAndObserveSegmentationNode(vtkMRMLSegmentation
   this->SetNodeReferenceID(SEGMENTATION_REFERENCE_ROLE, (node ? node->GetID() : NULL));
 }
 
+
+//----------------------------------------------------------------------------
+void vtkMRMLSegmentEditorNode::AddEditedLabelmapModifiedExtent(const int extent[6])
+{
+  if (!extent || extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    return;
+  }
+  int* modifiedExtent = this->EditedLabelmapModifiedExtent;
+  if (modifiedExtent[0] > modifiedExtent[1] || modifiedExtent[2] > modifiedExtent[3] || modifiedExtent[4] > modifiedExtent[5])
+  {
+    for (int i=0; i<6; ++i)
+    {
+      modifiedExtent[i] = extent[i];
+    }
+    return;
+  }
+  for (int i=0; i<3; ++i)
+  {
+    modifiedExtent[2*i] = std::min(modifiedExtent[2*i], extent[2*i]);
+    modifiedExtent[2*i+1] = std::max(modifiedExtent[2*i+1], extent[2*i+1]);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLSegmentEditorNode::ResetEditedLabelmapModifiedExtent()
+{
+  this->EditedLabelmapModifiedExtent[0] = this->EditedLabelmapModifiedExtent[2] = this->EditedLabelmapModifiedExtent[4] = 0;
+  this->EditedLabelmapModifiedExtent[1] = this->EditedLabelmapModifiedExtent[3] = this->EditedLabelmapModifiedExtent[5] = -1;
+}
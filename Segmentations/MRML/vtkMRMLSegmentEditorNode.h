@@ -99,6 +99,18 @@ public:
   /// Get mask labelmap
   vtkGetObjectMacro(MaskLabelmap, vtkOrientedImageData);
 
+  /// Get region of the edited labelmap modified by the active effect since the changes were last applied
+  /// to the selected segment, in the IJK coordinates of the edited labelmap. If the extent is empty then
+  /// the modified region is unknown, and the whole edited labelmap is applied.
+  /// Effects reset the region at the start of each operation, and the editor resets it when the changes
+  /// are applied, when the edited labelmap is re-created, and when the active effect changes.
+  vtkGetVector6Macro(EditedLabelmapModifiedExtent, int);
+  /// Extend modified region of the edited labelmap (\sa EditedLabelmapModifiedExtent).
+  /// Modified event is not invoked, as the region is only used when the changes are applied.
+  void AddEditedLabelmapModifiedExtent(const int extent[6]);
+  /// Reset modified region of the edited labelmap to empty
+  void ResetEditedLabelmapModifiedExtent();
+
 protected:
   vtkMRMLSegmentEditorNode();
   ~vtkMRMLSegmentEditorNode();
@@ -118,6 +130,9 @@ protected:
   /// Mask labelmap containing a merged silhouette of all the segments other than the selected one.
   /// Used if the paint over feature is turned off.
   vtkOrientedImageData* MaskLabelmap;
+
+  /// Region of the edited labelmap modified since the changes were last applied
+  int EditedLabelmapModifiedExtent[6];
 };
 
 #endif // __vtkMRMLSegmentEditorNode_h
@@ -51,9 +51,75 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 #include <vtkHomogeneousTransform.h>
 #include <vtkTransform.h>
 #include <vtkLookupTable.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
 
 // STD includes
 #include <algorithm>
+#include <cstring>
+
+namespace
+{
+  //---------------------------------------------------------------------------
+  bool IsExtentEmpty(const int extent[6])
+  {
+    return (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5]);
+  }
+
+  //---------------------------------------------------------------------------
+  void IntersectExtents(const int extent1[6], const int extent2[6], int intersection[6])
+  {
+    for (int i=0; i<3; ++i)
+    {
+      intersection[2*i] = std::max(extent1[2*i], extent2[2*i]);
+      intersection[2*i+1] = std::min(extent1[2*i+1], extent2[2*i+1]);
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  /// Extend extent so that it contains another extent. Empty extents are ignored
+  void UnionExtents(int extent[6], const int otherExtent[6])
+  {
+    if (IsExtentEmpty(otherExtent))
+    {
+      return;
+    }
+    if (IsExtentEmpty(extent))
+    {
+      std::copy(otherExtent, otherExtent+6, extent);
+      return;
+    }
+    for (int i=0; i<3; ++i)
+    {
+      extent[2*i] = std::min(extent[2*i], otherExtent[2*i]);
+      extent[2*i+1] = std::max(extent[2*i+1], otherExtent[2*i+1]);
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  /// Paint the voxels of a segment labelmap that are not background with the label of the segment
+  /// in a region of the merged labelmap. The row loop is branch-free so that it can be vectorized.
+  template <class T>
+  void CompositeLabelmapRegion(vtkImageData* labelmap, vtkImageData* mergedImageData, const int mergedImageOffset[3],
+    const int region[6], unsigned char label)
+  {
+    const T backgroundValue = 0;
+    const int rowLength = region[1]-region[0]+1;
+    for (int k=region[4]; k<=region[5]; ++k)
+    {
+      for (int j=region[2]; j<=region[3]; ++j)
+      {
+        const T* labelmapRow = static_cast<T*>(labelmap->GetScalarPointer(region[0], j, k));
+        unsigned char* mergedRow = static_cast<unsigned char*>(mergedImageData->GetScalarPointer(
+          region[0]-mergedImageOffset[0], j-mergedImageOffset[1], k-mergedImageOffset[2]));
+        for (int i=0; i<rowLength; ++i)
+        {
+          mergedRow[i] = (labelmapRow[i] != backgroundValue ? label : mergedRow[i]);
+        }
+      }
+    }
+  }
+}
 
 //----------------------------------------------------------------------------
 vtkMRMLNodeNewMacro(vtkMRMLSegmentationNode);
@@ -757,6 +823,7 @@ vtkImageData* vtkMRMLSegmentationNode::GetImageData()
   }
 
   bool mergeNecessary = false;
+  std::vector<std::string> modifiedSegmentIDs;
 
   // Create image data if it does not exist
   vtkImageData* imageData = Superclass::GetImageData();
@@ -782,7 +849,7 @@ vtkImageData* vtkMRMLSegmentationNode::GetImageData()
         if (masterRepresentation->GetMTime() > this->LabelmapMergeTime.GetMTime())
         {
           mergeNecessary = true;
-          break;
+          modifiedSegmentIDs.push_back(segmentIt->first);
         }
       }
     }
@@ -793,7 +860,9 @@ vtkImageData* vtkMRMLSegmentationNode::GetImageData()
   {
     if (this->Segmentation->ContainsRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
     {
-      bool success = this->GenerateDisplayedMergedLabelmap(imageData);
+      // Re-composite only the regions changed by the modified segments if possible, otherwise re-generate the whole labelmap
+      bool success = ( !modifiedSegmentIDs.empty() && this->UpdateDisplayedMergedLabelmap(imageData, modifiedSegmentIDs) )
+        || this->GenerateDisplayedMergedLabelmap(imageData);
       if (!success)
       {
         vtkErrorMacro("GetImageData: Failed to create merged labelmap for 2D visualization!");
@@ -855,12 +924,188 @@ bool vtkMRMLSegmentationNode::GenerateDisplayedMergedLabelmap(vtkImageData* imag
     // Make sure merged labelmap extents starts at zeros for compatibility reasons
     vtkMRMLSegmentationNode::ShiftVolumeNodeExtentToZeroStart(this);
 
+    // Store geometry and segment extents so that subsequent segment changes can be merged incrementally
+    this->MergedSegmentExtents.clear();
+    this->SegmentModifiedExtents.clear();
+    this->DisplayedMergedLabelmapGeometry = this->Segmentation->DetermineCommonLabelmapGeometry();
+    if (!this->DisplayedMergedLabelmapGeometry.empty())
+    {
+      vtkSmartPointer<vtkOrientedImageData> commonGeometryImage = vtkSmartPointer<vtkOrientedImageData>::New();
+      vtkSegmentationConverter::DeserializeImageGeometry(this->DisplayedMergedLabelmapGeometry, commonGeometryImage);
+      vtkSegmentation::SegmentMap segmentMap = this->Segmentation->GetSegments();
+      for (vtkSegmentation::SegmentMap::iterator segmentIt = segmentMap.begin(); segmentIt != segmentMap.end(); ++segmentIt)
+      {
+        std::vector<int> segmentExtent(6, 0);
+        this->GetSegmentExtentInMergedLabelmap(segmentIt->second, commonGeometryImage, &segmentExtent[0]);
+        this->MergedSegmentExtents[segmentIt->first] = segmentExtent;
+      }
+    }
+
     return true;
   }
-  
+
+  this->DisplayedMergedLabelmapGeometry.clear();
   return false;
 }
 
+//---------------------------------------------------------------------------
+bool vtkMRMLSegmentationNode::UpdateDisplayedMergedLabelmap(vtkImageData* imageData, const std::vector<std::string>& modifiedSegmentIDs)
+{
+  if (!imageData || !this->Segmentation || this->DisplayedMergedLabelmapGeometry.empty())
+  {
+    return false;
+  }
+  // Changed regions are only known if the labelmaps are edited directly
+  const char* masterRepresentationName = this->Segmentation->GetMasterRepresentationName();
+  if ( !masterRepresentationName
+    || strcmp(masterRepresentationName, vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) )
+  {
+    return false;
+  }
+
+  // Re-generate the whole labelmap if segments were added or removed, or if the common geometry changed
+  std::vector<std::string> segmentIDs;
+  this->Segmentation->GetSegmentIDs(segmentIDs);
+  if (segmentIDs.size() != this->MergedSegmentExtents.size())
+  {
+    return false;
+  }
+  for (std::vector<std::string>::iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
+  {
+    if (this->MergedSegmentExtents.find(*segmentIdIt) == this->MergedSegmentExtents.end())
+    {
+      return false;
+    }
+  }
+  if (this->Segmentation->DetermineCommonLabelmapGeometry() != this->DisplayedMergedLabelmapGeometry)
+  {
+    return false;
+  }
+  vtkSmartPointer<vtkOrientedImageData> commonGeometryImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  vtkSegmentationConverter::DeserializeImageGeometry(this->DisplayedMergedLabelmapGeometry, commonGeometryImage);
+  int referenceExtent[6] = {0,-1,0,-1,0,-1};
+  commonGeometryImage->GetExtent(referenceExtent);
+
+  // The merged image extent is shifted to start at zero, so it only needs to match the common geometry in size
+  int mergedImageExtent[6] = {0,-1,0,-1,0,-1};
+  imageData->GetExtent(mergedImageExtent);
+  int mergedImageOffset[3] = {0,0,0};
+  for (int i=0; i<3; ++i)
+  {
+    if (mergedImageExtent[2*i+1]-mergedImageExtent[2*i] != referenceExtent[2*i+1]-referenceExtent[2*i])
+    {
+      return false;
+    }
+    mergedImageOffset[i] = referenceExtent[2*i] - mergedImageExtent[2*i];
+  }
+  if ( !imageData->GetPointData()->GetScalars()
+    || imageData->GetScalarType() != VTK_UNSIGNED_CHAR || imageData->GetNumberOfScalarComponents() != 1 )
+  {
+    return false;
+  }
+
+  // Collect the region changed by the modified segments
+  int modifiedRegion[6] = {0,-1,0,-1,0,-1};
+  for (std::vector<std::string>::const_iterator segmentIdIt = modifiedSegmentIDs.begin(); segmentIdIt != modifiedSegmentIDs.end(); ++segmentIdIt)
+  {
+    vtkSegment* segment = this->Segmentation->GetSegment(*segmentIdIt);
+    if (!segment)
+    {
+      continue;
+    }
+    std::vector<int>& mergedSegmentExtent = this->MergedSegmentExtents[*segmentIdIt];
+    int currentSegmentExtent[6] = {0,-1,0,-1,0,-1};
+    this->GetSegmentExtentInMergedLabelmap(segment, commonGeometryImage, currentSegmentExtent);
+
+    // If the segment did not change extent and the changed region was reported, then only that region needs update
+    std::map<std::string, std::vector<int> >::iterator reportedExtentIt = this->SegmentModifiedExtents.find(*segmentIdIt);
+    vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast(
+      segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
+    if ( reportedExtentIt != this->SegmentModifiedExtents.end()
+      && std::equal(currentSegmentExtent, currentSegmentExtent+6, mergedSegmentExtent.begin())
+      && segmentLabelmap && vtkOrientedImageDataResample::DoGeometriesMatch(commonGeometryImage, segmentLabelmap) )
+    {
+      int reportedRegion[6] = {0,-1,0,-1,0,-1};
+      IntersectExtents(&(reportedExtentIt->second[0]), currentSegmentExtent, reportedRegion);
+      UnionExtents(modifiedRegion, reportedRegion);
+    }
+    else
+    {
+      UnionExtents(modifiedRegion, &mergedSegmentExtent[0]);
+      UnionExtents(modifiedRegion, currentSegmentExtent);
+    }
+    std::copy(currentSegmentExtent, currentSegmentExtent+6, mergedSegmentExtent.begin());
+  }
+  this->SegmentModifiedExtents.clear();
+
+  // Re-composite all segments within the changed region
+  if (!IsExtentEmpty(modifiedRegion))
+  {
+    if (!this->CompositeMergedLabelmapRegion(imageData, mergedImageOffset, commonGeometryImage, segmentIDs, modifiedRegion))
+    {
+      return false;
+    }
+    imageData->GetPointData()->GetScalars()->Modified();
+    imageData->Modified();
+  }
+
+  this->LabelmapMergeTime.Modified();
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLSegmentationNode::AddSegmentModifiedExtent(const std::string& segmentID, const int modifiedExtent[6])
+{
+  if (!modifiedExtent || IsExtentEmpty(modifiedExtent))
+  {
+    return;
+  }
+  std::map<std::string, std::vector<int> >::iterator reportedExtentIt = this->SegmentModifiedExtents.find(segmentID);
+  if (reportedExtentIt == this->SegmentModifiedExtents.end())
+  {
+    this->SegmentModifiedExtents[segmentID] = std::vector<int>(modifiedExtent, modifiedExtent+6);
+  }
+  else
+  {
+    UnionExtents(&(reportedExtentIt->second[0]), modifiedExtent);
+  }
+
+  SegmentRegion modifiedRegion;
+  modifiedRegion.SegmentID = segmentID.c_str();
+  std::copy(modifiedExtent, modifiedExtent+6, modifiedRegion.Extent);
+  this->InvokeCustomModifiedEvent(vtkMRMLSegmentationNode::SegmentRegionModified, (void*)(&modifiedRegion));
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLSegmentationNode::GetSegmentExtentInMergedLabelmap(vtkSegment* segment, vtkOrientedImageData* commonGeometryImage, int extent[6])
+{
+  extent[0] = extent[2] = extent[4] = 0;
+  extent[1] = extent[3] = extent[5] = -1;
+  if (!segment || !commonGeometryImage)
+  {
+    return;
+  }
+  vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(
+    segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
+  if (!binaryLabelmap || binaryLabelmap->IsEmpty())
+  {
+    return;
+  }
+
+  int commonExtent[6] = {0,-1,0,-1,0,-1};
+  commonGeometryImage->GetExtent(commonExtent);
+  if (!vtkOrientedImageDataResample::DoGeometriesMatch(commonGeometryImage, binaryLabelmap))
+  {
+    // Resampled labelmap may cover any part of the common extent
+    std::copy(commonExtent, commonExtent+6, extent);
+    return;
+  }
+
+  int labelmapExtent[6] = {0,-1,0,-1,0,-1};
+  binaryLabelmap->GetExtent(labelmapExtent);
+  IntersectExtents(labelmapExtent, commonExtent, extent);
+}
+
 //---------------------------------------------------------------------------
 bool vtkMRMLSegmentationNode::GenerateMergedLabelmap(
   vtkImageData* mergedImageData,
@@ -927,33 +1172,86 @@ bool vtkMRMLSegmentationNode::GenerateMergedLabelmap(
     vtkSegmentationConverter::DeserializeImageGeometry(commonGeometryString, commonGeometryImage);
   }
   commonGeometryImage->GetImageToWorldMatrix(mergedImageToWorldMatrix);
-  int referenceDimensions[3] = {0,0,0};
-  commonGeometryImage->GetDimensions(referenceDimensions);
   int referenceExtent[6] = {0,-1,0,-1,0,-1};
   commonGeometryImage->GetExtent(referenceExtent);
 
-  // Allocate image data if empty or if reference extent changed
+  // Allocate image data if empty or if reference dimensions changed. If only the start of the extent
+  // differs (displayed merged labelmap extent is shifted to zero start) then the voxels are reused
   int imageDataExtent[6] = {0,-1,0,-1,0,-1};
   mergedImageData->GetExtent(imageDataExtent);
-  if ( imageDataExtent[0] != referenceExtent[0] || imageDataExtent[1] != referenceExtent[1] || imageDataExtent[2] != referenceExtent[2]
-    || imageDataExtent[3] != referenceExtent[3] || imageDataExtent[4] != referenceExtent[4] || imageDataExtent[5] != referenceExtent[5] )
+  bool extentsMatch = true;
+  bool dimensionsMatch = true;
+  for (int i=0; i<3; ++i)
+  {
+    if (imageDataExtent[2*i] != referenceExtent[2*i] || imageDataExtent[2*i+1] != referenceExtent[2*i+1])
+    {
+      extentsMatch = false;
+    }
+    if (imageDataExtent[2*i+1]-imageDataExtent[2*i] != referenceExtent[2*i+1]-referenceExtent[2*i])
+    {
+      dimensionsMatch = false;
+    }
+  }
+  if ( !dimensionsMatch || !mergedImageData->GetPointData()->GetScalars()
+    || mergedImageData->GetScalarType() != VTK_UNSIGNED_CHAR || mergedImageData->GetNumberOfScalarComponents() != 1 )
   {
     mergedImageData->SetExtent(referenceExtent);
     mergedImageData->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
   }
+  else if (!extentsMatch)
+  {
+    mergedImageData->SetExtent(referenceExtent);
+  }
 
-  // Paint the image data background first
-  unsigned short backgroundColor = vtkMRMLSegmentationDisplayNode::GetSegmentationColorIndexBackground();
   unsigned char* mergedImagePtr = (unsigned char*)mergedImageData->GetScalarPointerForExtent(referenceExtent);
   if (!mergedImagePtr)
   {
     // Setting the extent may invoke this function again via ImageDataModified, in which case the pointer is NULL
     return false;
   }
-  for (vtkIdType i=0; i<mergedImageData->GetNumberOfPoints(); ++i)
+
+  // Paint background and segments in the whole extent
+  int mergedImageOffset[3] = {0,0,0};
+  return this->CompositeMergedLabelmapRegion(mergedImageData, mergedImageOffset, commonGeometryImage, mergedSegmentIDs, referenceExtent);
+}
+
+//---------------------------------------------------------------------------
+bool vtkMRMLSegmentationNode::CompositeMergedLabelmapRegion(
+  vtkImageData* mergedImageData, const int mergedImageOffset[3], vtkOrientedImageData* commonGeometryImage,
+  const std::vector<std::string>& mergedSegmentIDs, const int region[6] )
+{
+  if (!mergedImageData || !mergedImageData->GetScalarPointer() || !commonGeometryImage)
+  {
+    vtkErrorMacro("CompositeMergedLabelmapRegion: Invalid merged labelmap!");
+    return false;
+  }
+  if (IsExtentEmpty(region))
   {
-    (*mergedImagePtr) = backgroundColor;
-    ++mergedImagePtr;
+    return true;
+  }
+
+  // Paint the region background first. Rows of the region are contiguous if the region spans whole rows,
+  // and slices are contiguous if it spans whole slices
+  unsigned char backgroundColor = (unsigned char)vtkMRMLSegmentationDisplayNode::GetSegmentationColorIndexBackground();
+  int mergedImageExtent[6] = {0,-1,0,-1,0,-1};
+  mergedImageData->GetExtent(mergedImageExtent);
+  int rowLength = region[1]-region[0]+1;
+  int numberOfRows = region[3]-region[2]+1;
+  bool wholeSlices = ( region[0]-mergedImageOffset[0] == mergedImageExtent[0] && region[1]-mergedImageOffset[0] == mergedImageExtent[1]
+    && region[2]-mergedImageOffset[1] == mergedImageExtent[2] && region[3]-mergedImageOffset[1] == mergedImageExtent[3] );
+  for (int k=region[4]; k<=region[5]; ++k)
+  {
+    if (wholeSlices)
+    {
+      void* slicePtr = mergedImageData->GetScalarPointer(region[0]-mergedImageOffset[0], region[2]-mergedImageOffset[1], k-mergedImageOffset[2]);
+      memset(slicePtr, backgroundColor, (size_t)rowLength*numberOfRows);
+      continue;
+    }
+    for (int j=region[2]; j<=region[3]; ++j)
+    {
+      void* rowPtr = mergedImageData->GetScalarPointer(region[0]-mergedImageOffset[0], j-mergedImageOffset[1], k-mergedImageOffset[2]);
+      memset(rowPtr, backgroundColor, rowLength);
+    }
   }
 
   // Skip the rest if there are no segments
@@ -966,16 +1264,23 @@ bool vtkMRMLSegmentationNode::GenerateMergedLabelmap(
   vtkMRMLSegmentationDisplayNode* displayNode = vtkMRMLSegmentationDisplayNode::SafeDownCast(this->GetDisplayNode());
   if (!displayNode)
   {
-    vtkErrorMacro("GenerateMergedLabelmap: No display node associated with segmentation!");
+    vtkErrorMacro("CompositeMergedLabelmapRegion: No display node associated with segmentation!");
     return false;
   }
 
-  // Create merged labelmap
+  vtkSmartPointer<vtkMatrix4x4> mergedImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  commonGeometryImage->GetImageToWorldMatrix(mergedImageToWorldMatrix);
+
+  // Composite segments in the order of the segmentation
+  vtkSegmentation::SegmentMap segmentMap = this->Segmentation->GetSegments();
   for (vtkSegmentation::SegmentMap::iterator segmentIt = segmentMap.begin(); segmentIt != segmentMap.end(); ++segmentIt)
   {
     std::string currentSegmentId(segmentIt->first);
     vtkSegment* currentSegment = segmentIt->second;
-    bool segmentIncluded = ( std::find(mergedSegmentIDs.begin(), mergedSegmentIDs.end(), std::string(currentSegmentId)) != mergedSegmentIDs.end() );
+    if (std::find(mergedSegmentIDs.begin(), mergedSegmentIDs.end(), currentSegmentId) == mergedSegmentIDs.end())
+    {
+      continue;
+    }
 
     // Skip segment if hidden
     vtkMRMLSegmentationDisplayNode::SegmentDisplayProperties properties;
@@ -990,7 +1295,7 @@ bool vtkMRMLSegmentationNode::GenerateMergedLabelmap(
     bool tagFound = currentSegment->GetTag(vtkMRMLSegmentationDisplayNode::GetColorIndexTag(), colorIndexStr);
     if (!tagFound)
     {
-      vtkErrorMacro("GenerateMergedLabelmap: No color table index found for segment " << currentSegmentId);
+      vtkErrorMacro("CompositeMergedLabelmapRegion: No color table index found for segment " << currentSegmentId);
       continue;
     }
     std::stringstream colorSS;
@@ -1001,7 +1306,7 @@ bool vtkMRMLSegmentationNode::GenerateMergedLabelmap(
     vtkOrientedImageData* representationBinaryLabelmap = vtkOrientedImageData::SafeDownCast(
       currentSegment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
     // If binary labelmap is empty then skip
-    if (representationBinaryLabelmap->IsEmpty())
+    if (!representationBinaryLabelmap || representationBinaryLabelmap->IsEmpty())
     {
       continue;
     }
@@ -1025,69 +1330,32 @@ bool vtkMRMLSegmentationNode::GenerateMergedLabelmap(
       binaryLabelmap = resampledBinaryLabelmap;
     }
 
-    // Copy image data voxels into merged labelmap with the proper color index
+    // Only the part of the labelmap within the region is copied
     int labelmapExtent[6] = {0,-1,0,-1,0,-1};
     binaryLabelmap->GetExtent(labelmapExtent);
-    int labelmapDimensions[3] = {0,0,0};
-    binaryLabelmap->GetDimensions(labelmapDimensions);
-    int labelmapCoordinates[3] = {0,0,0};
-    long residualIndex = 0;
-
-    int segmentLabelScalarType = binaryLabelmap->GetScalarType();
-    if ( segmentLabelScalarType != VTK_UNSIGNED_CHAR
-      && segmentLabelScalarType != VTK_UNSIGNED_SHORT
-      && segmentLabelScalarType != VTK_SHORT )
+    int compositeRegion[6] = {0,-1,0,-1,0,-1};
+    IntersectExtents(labelmapExtent, region, compositeRegion);
+    if (IsExtentEmpty(compositeRegion))
     {
-      vtkWarningMacro("GenerateMergedLabelmap: Segment " << currentSegmentId << " cannot be merged! Binary labelmap scalar type must be unsigned char, unsighed short, or short!");
       continue;
     }
-    void* voidScalarPointer = binaryLabelmap->GetScalarPointer();
-    unsigned char* labelmapPtrUChar = (unsigned char*)voidScalarPointer;
-    unsigned short* labelmapPtrUShort = (unsigned short*)voidScalarPointer;
-    short* labelmapPtrShort = (short*)voidScalarPointer;
-
-    mergedImagePtr = (unsigned char*)mergedImageData->GetScalarPointer();
-    unsigned char* imagePtrMax = mergedImagePtr + referenceDimensions[0]*referenceDimensions[1]*referenceDimensions[2];
-    for (long i=0; i<binaryLabelmap->GetNumberOfPoints(); ++i)
-    {
-      // Get labelmap color at voxel
-      unsigned short color = 0;
-      if (segmentLabelScalarType == VTK_UNSIGNED_CHAR)
-      {
-        color = (*labelmapPtrUChar);
-      }
-      else if (segmentLabelScalarType == VTK_UNSIGNED_SHORT)
-      {
-        color = (*labelmapPtrUShort);
-      }
-      else if (segmentLabelScalarType == VTK_SHORT)
-      {
-        color = (*labelmapPtrShort);
-      }
 
-      // Get labelmap coordinates
-      labelmapCoordinates[2] = i / (labelmapDimensions[1]*labelmapDimensions[0]);
-      residualIndex = i - labelmapCoordinates[2]*labelmapDimensions[1]*labelmapDimensions[0];
-      labelmapCoordinates[1] = residualIndex / labelmapDimensions[0];
-      residualIndex -= labelmapCoordinates[1]*labelmapDimensions[0];
-      labelmapCoordinates[0] = residualIndex;
-
-      // Apply extent offset and current offset
-      unsigned char* offsetImagePtr = mergedImagePtr +
-                                      (labelmapExtent[4]-referenceExtent[4]+labelmapCoordinates[2]) * referenceDimensions[1]*referenceDimensions[0] +
-                                      (labelmapExtent[2]-referenceExtent[2]+labelmapCoordinates[1]) * referenceDimensions[0] +
-                                      (labelmapExtent[0]-referenceExtent[0]+labelmapCoordinates[0]);
-
-      // Paint merged labelmap voxel if foreground and in extent
-      if ( color != backgroundColor
-        && offsetImagePtr >= mergedImagePtr && offsetImagePtr < imagePtrMax )
-      {
-        (*offsetImagePtr) = colorIndex;
-      }
-
-      ++labelmapPtrUChar;
-      ++labelmapPtrUShort;
-      ++labelmapPtrShort;
+    // Copy labelmap voxels into merged labelmap with the proper color index
+    unsigned char label = (unsigned char)colorIndex;
+    switch (binaryLabelmap->GetScalarType())
+    {
+    case VTK_UNSIGNED_CHAR:
+      CompositeLabelmapRegion<unsigned char>(binaryLabelmap, mergedImageData, mergedImageOffset, compositeRegion, label);
+      break;
+    case VTK_UNSIGNED_SHORT:
+      CompositeLabelmapRegion<unsigned short>(binaryLabelmap, mergedImageData, mergedImageOffset, compositeRegion, label);
+      break;
+    case VTK_SHORT:
+      CompositeLabelmapRegion<short>(binaryLabelmap, mergedImageData, mergedImageOffset, compositeRegion, label);
+      break;
+    default:
+      vtkWarningMacro("CompositeMergedLabelmapRegion: Segment " << currentSegmentId << " cannot be merged! Binary labelmap scalar type must be unsigned char, unsighed short, or short!");
+      break;
     }
   }
 
@@ -28,6 +28,8 @@
 
 // STD includes
 #include <cstdlib>
+#include <map>
+#include <vector>
 
 // Segmentation includes
 #include "vtkSegmentation.h"
@@ -41,6 +43,21 @@ class vtkMRMLSubjectHierarchyNode;
 /// \ingroup Segmentations
 class VTK_SLICER_SEGMENTATIONS_MODULE_MRML_EXPORT vtkMRMLSegmentationNode : public vtkMRMLLabelMapVolumeNode
 {
+public:
+  enum
+  {
+    /// Fired when a region of the binary labelmap of a segment is reported modified (\sa AddSegmentModifiedExtent).
+    /// Call data is a pointer to a SegmentRegion, so that consumers can update only that region
+    SegmentRegionModified = 62150
+  };
+
+  /// Region of a segment binary labelmap, in the IJK coordinates of the labelmap
+  struct SegmentRegion
+  {
+    const char* SegmentID;
+    int Extent[6];
+  };
+
 public:
   // Define constants
   static const char* GetSegmentIDAttributeName() { return "segmentID"; };
@@ -122,6 +139,14 @@ public:
   /// Re-generate displayed merged labelmap
   void ReGenerateDisplayedMergedLabelmap();
 
+  /// Report the region of a segment binary labelmap that has been modified (e.g. by a paint stroke).
+  /// When the merged labelmap is requested next time, only this region is re-composited for the segment
+  /// instead of the whole extent of the segment. Regions reported for the same segment are accumulated.
+  /// Needs to be called after the labelmap is modified, as \sa SegmentRegionModified is invoked with the region.
+  /// \param segmentID ID of the modified segment
+  /// \param modifiedExtent Modified region in the IJK coordinates of the segment binary labelmap
+  void AddSegmentModifiedExtent(const std::string& segmentID, const int modifiedExtent[6]);
+
   /// Make sure image data of a volume node has extents that start at zero.
   /// This needs to be done for compatibility reasons, as many components assume the extent has a form of
   /// (0,dim[0],0,dim[1],0,dim[2]), which is not the case many times for segmentation merged labelmaps.
@@ -147,6 +172,27 @@ protected:
   /// Build merged labelmap for 2D labelmap display from all contained segments
   virtual bool GenerateDisplayedMergedLabelmap(vtkImageData* imageData);
 
+  /// Re-composite only the regions of the displayed merged labelmap that were changed by the given segments.
+  /// The changed region of a segment is the region reported by \sa AddSegmentModifiedExtent if any, otherwise
+  /// the union of its extent at the last merge and its current extent.
+  /// \return False if the merged labelmap needs to be re-generated completely (e.g. because the common geometry changed)
+  virtual bool UpdateDisplayedMergedLabelmap(vtkImageData* imageData, const std::vector<std::string>& modifiedSegmentIDs);
+
+  /// Paint the background then the segments into a region of a merged labelmap.
+  /// Segments are composited in the order of the segmentation, so overlapping segments are resolved the same way
+  /// regardless of the size of the region.
+  /// \param mergedImageData Merged labelmap (unsigned char scalars)
+  /// \param mergedImageOffset Offset of the IJK coordinates of the common geometry relative to the merged image extent
+  /// \param commonGeometryImage Common labelmap geometry the segments are composited in
+  /// \param mergedSegmentIDs Segments to include in the merged labelmap
+  /// \param region Region to update in the IJK coordinates of the common geometry
+  bool CompositeMergedLabelmapRegion(vtkImageData* mergedImageData, const int mergedImageOffset[3], vtkOrientedImageData* commonGeometryImage,
+    const std::vector<std::string>& mergedSegmentIDs, const int region[6]);
+
+  /// Get extent covered by a segment in the merged labelmap in the IJK coordinates of the common geometry.
+  /// The whole common extent is returned if the segment needs to be resampled for merging.
+  void GetSegmentExtentInMergedLabelmap(vtkSegment* segment, vtkOrientedImageData* commonGeometryImage, int extent[6]);
+
   /// Add display properties for segment with given ID
   virtual bool AddSegmentDisplayProperties(std::string segmentId);
 
@@ -189,6 +235,17 @@ protected:
   /// Keep track of merged labelmap modification time
   vtkTimeStamp LabelmapMergeTime;
 
+  /// Common labelmap geometry of the displayed merged labelmap when it was last generated.
+  /// Empty if the merged labelmap needs to be re-generated completely on the next request
+  std::string DisplayedMergedLabelmapGeometry;
+
+  /// Extent each segment covered in the displayed merged labelmap when it was last composited,
+  /// in the IJK coordinates of the common geometry
+  std::map<std::string, std::vector<int> > MergedSegmentExtents;
+
+  /// Regions of segment labelmaps reported modified since the last merge (\sa AddSegmentModifiedExtent)
+  std::map<std::string, std::vector<int> > SegmentModifiedExtents;
+
   /// Command handling master representation modified events
   vtkCallbackCommand* MasterRepresentationCallbackCommand;
 
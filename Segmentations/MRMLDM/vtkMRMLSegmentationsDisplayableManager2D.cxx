@@ -37,6 +37,7 @@
 #include "vtkSegmentation.h"
 #include "vtkOrientedImageData.h"
 #include "vtkOrientedImageDataResample.h"
+#include "vtkPolyDataSlabIndex.h"
 
 // VTK includes
 #include <vtkNew.h>
@@ -63,11 +64,16 @@
 #include <vtkLookupTable.h>
 #include <vtkTriangleFilter.h>
 #include <vtkStripper.h>
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkPoints.h>
+#include <vtkUnsignedCharArray.h>
 
 // STD includes
 #include <algorithm>
 #include <set>
 #include <map>
+#include <vector>
 
 //---------------------------------------------------------------------------
 vtkStandardNewMacro(vtkMRMLSegmentationsDisplayableManager2D );
@@ -114,6 +120,89 @@ void SnapToPermuteMatrix(vtkTransform* transform)
   }
 }
 
+//---------------------------------------------------------------------------
+// Convert a color and opacity to RGBA cell scalar
+//----------------------------------------------------------------------------
+static void GetRGBAColor(const double color[3], double opacity, unsigned char rgba[4])
+{
+  for (int i=0; i<3; i++)
+    {
+    rgba[i] = (unsigned char)(std::max(0.0, std::min(1.0, color[i])) * 255.0 + 0.5);
+    }
+  rgba[3] = (unsigned char)(std::max(0.0, std::min(1.0, opacity)) * 255.0 + 0.5);
+}
+
+//---------------------------------------------------------------------------
+// Append transformed points and cells to a batched poly data, with the same
+// color for all the appended cells
+//----------------------------------------------------------------------------
+static void AppendCells(vtkPoints* inputPoints, vtkCellArray* inputCells, vtkMatrix4x4* inputToOutput, const unsigned char color[4],
+  vtkPoints* outputPoints, vtkCellArray* outputCells, vtkUnsignedCharArray* outputColors)
+{
+  if (!inputPoints || !inputCells || inputCells->GetNumberOfCells() == 0)
+    {
+    return;
+    }
+
+  vtkIdType pointIdOffset = outputPoints->GetNumberOfPoints();
+  vtkIdType numberOfInputPoints = inputPoints->GetNumberOfPoints();
+  for (vtkIdType pointId=0; pointId<numberOfInputPoints; ++pointId)
+    {
+    double point[4] = {0.0, 0.0, 0.0, 1.0};
+    inputPoints->GetPoint(pointId, point);
+    double transformedPoint[4] = {0.0, 0.0, 0.0, 1.0};
+    inputToOutput->MultiplyPoint(point, transformedPoint);
+    outputPoints->InsertNextPoint(transformedPoint);
+    }
+
+  std::vector<vtkIdType> outputCellPointIds;
+  vtkIdType numberOfCellPoints = 0;
+  vtkIdType* cellPointIds = NULL;
+  for (inputCells->InitTraversal(); inputCells->GetNextCell(numberOfCellPoints, cellPointIds); )
+    {
+    if (numberOfCellPoints == 0)
+      {
+      continue;
+      }
+    outputCellPointIds.resize(numberOfCellPoints);
+    for (vtkIdType cellPointIndex=0; cellPointIndex<numberOfCellPoints; ++cellPointIndex)
+      {
+      outputCellPointIds[cellPointIndex] = cellPointIds[cellPointIndex] + pointIdOffset;
+      }
+    outputCells->InsertNextCell(numberOfCellPoints, &(outputCellPointIds[0]));
+    outputColors->InsertNextTupleValue(color);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Make sure a batched poly data has points, line and polygon cells and RGBA cell scalars to append to.
+// Empty poly data returns a shared dummy cell array, so new cell arrays are set until the first cell is added
+//----------------------------------------------------------------------------
+static void InitializeBatchedCells(vtkPolyData* polyData)
+{
+  if (!polyData->GetPoints())
+    {
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    polyData->SetPoints(points);
+    }
+  if (polyData->GetNumberOfLines() == 0)
+    {
+    vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+    polyData->SetLines(lines);
+    }
+  if (polyData->GetNumberOfPolys() == 0)
+    {
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    polyData->SetPolys(polys);
+    }
+  if (!vtkUnsignedCharArray::SafeDownCast(polyData->GetCellData()->GetScalars()))
+    {
+    vtkSmartPointer<vtkUnsignedCharArray> colors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    colors->SetNumberOfComponents(4);
+    polyData->GetCellData()->SetScalars(colors);
+    }
+}
+
 //---------------------------------------------------------------------------
 class vtkMRMLSegmentationsDisplayableManager2D::vtkInternal
 {
@@ -122,20 +211,19 @@ public:
   vtkInternal( vtkMRMLSegmentationsDisplayableManager2D* external );
   ~vtkInternal();
 
+  /// Per-segment pipeline. Poly data segments are only cut here, they are drawn by the
+  /// batched pipeline of the display node. Image segments are drawn by their own actors
   struct Pipeline
     {
     std::string SegmentID;
-    vtkSmartPointer<vtkTransform> WorldToSliceTransform;
     vtkSmartPointer<vtkGeneralTransform> NodeToWorldTransform;
     vtkSmartPointer<vtkGeneralTransform> WorldToNodeTransform;
 
-    vtkSmartPointer<vtkActor2D> PolyDataOutlineActor;
-    vtkSmartPointer<vtkActor2D> PolyDataFillActor;
+    /// Cutting pipeline used if the segmentation is under a non-linear transform
     vtkSmartPointer<vtkTransformPolyDataFilter> ModelWarper;
     vtkSmartPointer<vtkPlane> Plane;
     vtkSmartPointer<vtkCutter> Cutter;
     vtkSmartPointer<vtkStripper> Stripper;
-    vtkSmartPointer<vtkTriangleFilter> TriangleFilter;
 
     vtkSmartPointer<vtkActor2D> ImageOutlineActor;
     vtkSmartPointer<vtkActor2D> ImageFillActor;
@@ -146,10 +234,23 @@ public:
     vtkSmartPointer<vtkLookupTable> LookupTableFill;
     };
 
+  /// Outlines and fills of all the poly data segments of a display node, in slice XY coordinates.
+  /// Each cell has the color and opacity of its segment, so all segments are drawn by two actors
+  struct BatchedPolyDataPipeline
+    {
+    vtkSmartPointer<vtkPolyData> OutlinePolyData;
+    vtkSmartPointer<vtkPolyData> FillPolyData;
+    vtkSmartPointer<vtkActor2D> OutlineActor;
+    vtkSmartPointer<vtkActor2D> FillActor;
+    };
+
   typedef std::map<std::string, const Pipeline*> PipelineMapType;
   typedef std::map < vtkMRMLSegmentationDisplayNode*, PipelineMapType > PipelinesCacheType;
   PipelinesCacheType DisplayPipelines;
 
+  typedef std::map < vtkMRMLSegmentationDisplayNode*, BatchedPolyDataPipeline* > BatchedPipelinesCacheType;
+  BatchedPipelinesCacheType BatchedPolyDataPipelines;
+
   typedef std::map < vtkMRMLSegmentationNode*, std::set< vtkMRMLSegmentationDisplayNode* > > SegmentationToDisplayCacheType;
   SegmentationToDisplayCacheType SegmentationToDisplayNodes;
 
@@ -169,6 +270,12 @@ public:
   // Display Nodes
   void AddDisplayNode(vtkMRMLSegmentationNode*, vtkMRMLSegmentationDisplayNode*);
   Pipeline* CreateSegmentPipeline(std::string segmentID);
+  BatchedPolyDataPipeline* CreateBatchedPolyDataPipeline();
+  void RemoveSegmentPipeline(const Pipeline* pipeline);
+  /// Cut the surface of a segment with the slice plane
+  /// \param contoursToSliceXY Output transform from the coordinate system of the returned contours to slice XY
+  /// \return Closed contour polylines, NULL if the surface does not intersect the slice
+  vtkPolyData* CutSegmentSurface(const Pipeline* pipeline, vtkPolyData* polyData, vtkMatrix4x4* rasToSliceXY, vtkMatrix4x4* contoursToSliceXY);
   void UpdateDisplayNode(vtkMRMLSegmentationDisplayNode* displayNode);
   void UpdateSegmentPipelines(vtkMRMLSegmentationDisplayNode*, PipelineMapType&);
   void UpdateDisplayNodePipeline(vtkMRMLSegmentationDisplayNode*, PipelineMapType);
@@ -381,14 +488,26 @@ void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::RemoveDisplayNode(vt
   PipelineMapType::iterator pipelineIt;
   for (pipelineIt = pipelinesIter->second.begin(); pipelineIt != pipelinesIter->second.end(); ++pipelineIt)
     {
-    const Pipeline* pipeline = pipelineIt->second;
-    this->External->GetRenderer()->RemoveActor(pipeline->PolyDataOutlineActor);
-    this->External->GetRenderer()->RemoveActor(pipeline->PolyDataFillActor);
-    this->External->GetRenderer()->RemoveActor(pipeline->ImageOutlineActor);
-    this->External->GetRenderer()->RemoveActor(pipeline->ImageFillActor);
-    delete pipeline;
+    this->RemoveSegmentPipeline(pipelineIt->second);
     }
   this->DisplayPipelines.erase(pipelinesIter);
+
+  BatchedPipelinesCacheType::iterator batchedPipelineIt = this->BatchedPolyDataPipelines.find(displayNode);
+  if (batchedPipelineIt != this->BatchedPolyDataPipelines.end())
+    {
+    this->External->GetRenderer()->RemoveActor(batchedPipelineIt->second->FillActor);
+    this->External->GetRenderer()->RemoveActor(batchedPipelineIt->second->OutlineActor);
+    delete batchedPipelineIt->second;
+    this->BatchedPolyDataPipelines.erase(batchedPipelineIt);
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::RemoveSegmentPipeline(const Pipeline* pipeline)
+{
+  this->External->GetRenderer()->RemoveActor(pipeline->ImageOutlineActor);
+  this->External->GetRenderer()->RemoveActor(pipeline->ImageFillActor);
+  delete pipeline;
 }
 
 //---------------------------------------------------------------------------
@@ -424,6 +543,7 @@ void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::AddDisplayNode(vtkMR
     }
 
   this->DisplayPipelines.insert( std::make_pair(displayNode, pipelineVector) );
+  this->BatchedPolyDataPipelines[displayNode] = this->CreateBatchedPolyDataPipeline();
 
   // Update cached matrices. Calls UpdateDisplayNodePipeline
   this->UpdateDisplayableTransforms(mNode);
@@ -435,41 +555,18 @@ vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::CreateSegmentPipeline(std
 {
   Pipeline* pipeline = new Pipeline();
   pipeline->SegmentID = segmentID;
-  pipeline->WorldToSliceTransform = vtkSmartPointer<vtkTransform>::New();
   pipeline->NodeToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
   pipeline->WorldToNodeTransform = vtkSmartPointer<vtkGeneralTransform>::New();
 
-  // Create poly data pipeline
-  pipeline->PolyDataOutlineActor = vtkSmartPointer<vtkActor2D>::New();
-  pipeline->PolyDataFillActor = vtkSmartPointer<vtkActor2D>::New();
+  // Create poly data cutting pipeline
   pipeline->Cutter = vtkSmartPointer<vtkCutter>::New();
   pipeline->ModelWarper = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
   pipeline->Plane = vtkSmartPointer<vtkPlane>::New();
   pipeline->Stripper = vtkSmartPointer<vtkStripper>::New();
-  pipeline->TriangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
-
-  // Set up poly data outline pipeline
   pipeline->Cutter->SetInputConnection(pipeline->ModelWarper->GetOutputPort());
   pipeline->Cutter->SetCutFunction(pipeline->Plane);
   pipeline->Cutter->SetGenerateCutScalars(0);
-  vtkSmartPointer<vtkTransformPolyDataFilter> polyDataOutlineTransformer = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-  polyDataOutlineTransformer->SetInputConnection(pipeline->Cutter->GetOutputPort());
-  polyDataOutlineTransformer->SetTransform(pipeline->WorldToSliceTransform);
-  vtkSmartPointer<vtkPolyDataMapper2D> polyDataOutlineMapper = vtkSmartPointer<vtkPolyDataMapper2D>::New();
-  polyDataOutlineMapper->SetInputConnection(polyDataOutlineTransformer->GetOutputPort());
-  pipeline->PolyDataOutlineActor->SetMapper(polyDataOutlineMapper);
-  pipeline->PolyDataOutlineActor->SetVisibility(0);
-
-  // Set up poly data fill pipeline
   pipeline->Stripper->SetInputConnection(pipeline->Cutter->GetOutputPort());
-  pipeline->TriangleFilter->SetInputConnection(NULL); // This will be modified in the UpdateDisplayNodePipeline function
-  vtkSmartPointer<vtkTransformPolyDataFilter> polyDataFillTransformer = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-  polyDataFillTransformer->SetInputConnection(pipeline->TriangleFilter->GetOutputPort());
-  polyDataFillTransformer->SetTransform(pipeline->WorldToSliceTransform);
-  vtkSmartPointer<vtkPolyDataMapper2D> polyDataFillMapper = vtkSmartPointer<vtkPolyDataMapper2D>::New();
-  polyDataFillMapper->SetInputConnection(polyDataFillTransformer->GetOutputPort());
-  pipeline->PolyDataFillActor->SetMapper(polyDataFillMapper);
-  pipeline->PolyDataFillActor->SetVisibility(0);
 
   // Create image pipeline
   pipeline->ImageOutlineActor = vtkSmartPointer<vtkActor2D>::New();
@@ -528,14 +625,46 @@ vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::CreateSegmentPipeline(std
   pipeline->ImageFillActor->SetVisibility(0);
 
   // Add actors to Renderer
-  this->External->GetRenderer()->AddActor( pipeline->PolyDataOutlineActor );
-  this->External->GetRenderer()->AddActor( pipeline->PolyDataFillActor );
   this->External->GetRenderer()->AddActor( pipeline->ImageOutlineActor );
   this->External->GetRenderer()->AddActor( pipeline->ImageFillActor );
 
   return pipeline;
 }
 
+//---------------------------------------------------------------------------
+vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::BatchedPolyDataPipeline*
+vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::CreateBatchedPolyDataPipeline()
+{
+  BatchedPolyDataPipeline* pipeline = new BatchedPolyDataPipeline();
+  pipeline->OutlinePolyData = vtkSmartPointer<vtkPolyData>::New();
+  pipeline->FillPolyData = vtkSmartPointer<vtkPolyData>::New();
+  pipeline->OutlineActor = vtkSmartPointer<vtkActor2D>::New();
+  pipeline->FillActor = vtkSmartPointer<vtkActor2D>::New();
+
+  // Colors are taken directly from the RGBA cell scalars
+  vtkSmartPointer<vtkPolyDataMapper2D> outlineMapper = vtkSmartPointer<vtkPolyDataMapper2D>::New();
+  outlineMapper->SetInputData(pipeline->OutlinePolyData);
+  outlineMapper->ScalarVisibilityOn();
+  outlineMapper->SetScalarModeToUseCellData();
+  outlineMapper->SetColorModeToDefault();
+  pipeline->OutlineActor->SetMapper(outlineMapper);
+  pipeline->OutlineActor->SetVisibility(0);
+
+  vtkSmartPointer<vtkPolyDataMapper2D> fillMapper = vtkSmartPointer<vtkPolyDataMapper2D>::New();
+  fillMapper->SetInputData(pipeline->FillPolyData);
+  fillMapper->ScalarVisibilityOn();
+  fillMapper->SetScalarModeToUseCellData();
+  fillMapper->SetColorModeToDefault();
+  pipeline->FillActor->SetMapper(fillMapper);
+  pipeline->FillActor->SetVisibility(0);
+
+  // Fill is added first so that the outlines are drawn over it
+  this->External->GetRenderer()->AddActor( pipeline->FillActor );
+  this->External->GetRenderer()->AddActor( pipeline->OutlineActor );
+
+  return pipeline;
+}
+
 //---------------------------------------------------------------------------
 void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::UpdateDisplayNode(vtkMRMLSegmentationDisplayNode* displayNode)
 {
@@ -596,11 +725,7 @@ void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::UpdateSegmentPipelin
       PipelineMapType::iterator erasedIt = pipelineIt;
       ++pipelineIt;
       pipelines.erase(erasedIt);
-      this->External->GetRenderer()->RemoveActor(pipeline->PolyDataOutlineActor);
-      this->External->GetRenderer()->RemoveActor(pipeline->PolyDataFillActor);
-      this->External->GetRenderer()->RemoveActor(pipeline->ImageOutlineActor);
-      this->External->GetRenderer()->RemoveActor(pipeline->ImageFillActor);
-      delete pipeline;
+      this->RemoveSegmentPipeline(pipeline);
       }
     else
       {
@@ -619,6 +744,15 @@ void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::UpdateDisplayNodePip
     }
   bool displayNodeVisible = this->IsVisible(displayNode);
 
+  BatchedPipelinesCacheType::iterator batchedPipelineIt = this->BatchedPolyDataPipelines.find(displayNode);
+  if (batchedPipelineIt == this->BatchedPolyDataPipelines.end())
+    {
+    return;
+    }
+  BatchedPolyDataPipeline* batchedPipeline = batchedPipelineIt->second;
+  batchedPipeline->OutlineActor->SetVisibility(false);
+  batchedPipeline->FillActor->SetVisibility(false);
+
   // Get segmentation display node
   vtkMRMLSegmentationDisplayNode* segmentationDisplayNode = vtkMRMLSegmentationDisplayNode::SafeDownCast(displayNode);
 
@@ -629,8 +763,6 @@ void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::UpdateDisplayNodePip
     // Hide segmentation if there is no 2D representation to show
     for (PipelineMapType::iterator pipelineIt=pipelines.begin(); pipelineIt!=pipelines.end(); ++pipelineIt)
       {
-      pipelineIt->second->PolyDataOutlineActor->SetVisibility(false);
-      pipelineIt->second->PolyDataFillActor->SetVisibility(false);
       pipelineIt->second->ImageOutlineActor->SetVisibility(false);
       pipelineIt->second->ImageFillActor->SetVisibility(false);
       }
@@ -655,6 +787,14 @@ void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::UpdateDisplayNodePip
     return;
     }
 
+  // Outlines and fills of the poly data segments are collected into one poly data each
+  vtkNew<vtkMatrix4x4> rasToSliceXY;
+  vtkMatrix4x4::Invert(this->SliceXYToRAS, rasToSliceXY.GetPointer());
+  vtkNew<vtkMatrix4x4> contoursToSliceXY;
+  batchedPipeline->OutlinePolyData->Initialize();
+  // Fill polygons of all segments are triangulated together after the loop
+  vtkNew<vtkPolyData> fillPolygons;
+
   // For all pipelines (pipeline per segment)
   for (PipelineMapType::iterator pipelineIt=pipelines.begin(); pipelineIt!=pipelines.end(); ++pipelineIt)
     {
@@ -678,8 +818,6 @@ void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::UpdateDisplayNodePip
     if ( (!segmentOutlineVisible && !segmentFillVisible)
       || ((!polyData || polyData->GetNumberOfPoints() == 0) && !imageData) )
       {
-      pipelineIt->second->PolyDataOutlineActor->SetVisibility(false);
-      pipelineIt->second->PolyDataFillActor->SetVisibility(false);
       pipelineIt->second->ImageOutlineActor->SetVisibility(false);
       pipelineIt->second->ImageFillActor->SetVisibility(false);
       continue;
@@ -692,54 +830,23 @@ void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::UpdateDisplayNodePip
       pipeline->ImageOutlineActor->SetVisibility(false);
       pipeline->ImageFillActor->SetVisibility(false);
 
-      pipeline->ModelWarper->SetInputData(polyData);
-      pipeline->ModelWarper->SetTransform(pipeline->NodeToWorldTransform);
-
-      // Set Plane transform
-      this->SetSlicePlaneFromMatrix(this->SliceXYToRAS, pipeline->Plane);
-      pipeline->Plane->Modified();
-
-      // Set PolyData transform
-      vtkNew<vtkMatrix4x4> rasToSliceXY;
-      vtkMatrix4x4::Invert(this->SliceXYToRAS, rasToSliceXY.GetPointer());
-      pipeline->WorldToSliceTransform->SetMatrix(rasToSliceXY.GetPointer());
-
-      // Optimization for slice to slice intersections which are 1 quad polydatas
-      // no need for 50^3 default locator divisions
-      if (polyData->GetPoints() != NULL && polyData->GetNumberOfPoints() <= 4 )
+      vtkPolyData* contours = this->CutSegmentSurface(pipeline, polyData, rasToSliceXY.GetPointer(), contoursToSliceXY.GetPointer());
+      if (!contours)
         {
-        vtkNew<vtkPointLocator> locator;
-        double *bounds = polyData->GetBounds();
-        locator->SetDivisions(2,2,2);
-        locator->InitPointInsertion(polyData->GetPoints(), bounds);
-        pipeline->Cutter->SetLocator(locator.GetPointer());
+        continue;
         }
 
-      // Apply trick to create cell from line for poly data fill
-      vtkSmartPointer<vtkPolyData> fillPolyData = vtkSmartPointer<vtkPolyData>::New();
-      pipeline->Stripper->Update();
-      fillPolyData->SetPoints(pipeline->Stripper->GetOutput()->GetPoints());
-      fillPolyData->SetPolys(pipeline->Stripper->GetOutput()->GetLines()); // Here's the trick
-      pipeline->TriangleFilter->SetInputData(fillPolyData);
-
-      // Update pipeline actors
-      pipeline->PolyDataOutlineActor->SetVisibility(segmentOutlineVisible);
-      pipeline->PolyDataOutlineActor->GetProperty()->SetColor(properties.Color[0], properties.Color[1], properties.Color[2]);
-      pipeline->PolyDataOutlineActor->GetProperty()->SetOpacity(properties.Opacity2DOutline * displayNode->GetOpacity());
-      pipeline->PolyDataOutlineActor->GetProperty()->SetLineWidth(displayNode->GetSliceIntersectionThickness());
-      pipeline->PolyDataOutlineActor->SetPosition(0,0);
-      pipeline->PolyDataFillActor->SetVisibility(segmentFillVisible);
-      pipeline->PolyDataFillActor->GetProperty()->SetColor(properties.Color[0], properties.Color[1], properties.Color[2]);
-      pipeline->PolyDataFillActor->GetProperty()->SetOpacity(properties.Opacity2DFill * displayNode->GetOpacity());
-      pipeline->PolyDataFillActor->SetPosition(0,0);
+      unsigned char outlineColor[4] = {0, 0, 0, 0};
+      GetRGBAColor(properties.Color, properties.Opacity2DOutline * displayNode->GetOpacity(), outlineColor);
+      unsigned char fillColor[4] = {0, 0, 0, 0};
+      GetRGBAColor(properties.Color, properties.Opacity2DFill * displayNode->GetOpacity(), fillColor);
+      vtkMRMLSegmentationsDisplayableManager2D::AppendSegmentContours(contours, contoursToSliceXY.GetPointer(),
+        segmentOutlineVisible ? outlineColor : NULL, segmentFillVisible ? fillColor : NULL,
+        batchedPipeline->OutlinePolyData, fillPolygons.GetPointer());
       }
     // If shown representation is image data
     else if (imageData)
       {
-      // Turn off poly data visibility when showing image
-      pipeline->PolyDataOutlineActor->SetVisibility(false);
-      pipeline->PolyDataFillActor->SetVisibility(false);
-
       // Set segment color
       pipeline->LookupTableOutline->SetTableValue(1,
         properties.Color[0], properties.Color[1], properties.Color[2], properties.Opacity2DOutline * displayNode->GetOpacity());
@@ -799,6 +906,91 @@ void vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::UpdateDisplayNodePip
       pipeline->ImageFillActor->SetPosition(0,0);
       }
     }
+
+  // Update batched poly data actors
+  batchedPipeline->OutlinePolyData->Modified();
+  batchedPipeline->OutlineActor->SetVisibility(batchedPipeline->OutlinePolyData->GetNumberOfLines() > 0);
+  batchedPipeline->OutlineActor->GetProperty()->SetLineWidth(displayNode->GetSliceIntersectionThickness());
+  batchedPipeline->OutlineActor->SetPosition(0,0);
+
+  vtkMRMLSegmentationsDisplayableManager2D::TriangulateSegmentFills(fillPolygons.GetPointer(), batchedPipeline->FillPolyData);
+  batchedPipeline->FillPolyData->Modified();
+  batchedPipeline->FillActor->SetVisibility(batchedPipeline->FillPolyData->GetNumberOfPolys() > 0);
+  batchedPipeline->FillActor->SetPosition(0,0);
+}
+
+//---------------------------------------------------------------------------
+vtkPolyData* vtkMRMLSegmentationsDisplayableManager2D::vtkInternal::CutSegmentSurface(
+  const Pipeline* pipeline, vtkPolyData* polyData, vtkMatrix4x4* rasToSliceXY, vtkMatrix4x4* contoursToSliceXY)
+{
+  // If the segmentation is not warped, then the surface is cut in the segmentation coordinate system
+  // using the slab index of the surface, so only the triangles near the slice are visited, and the
+  // cut of a previously visited slice position is reused
+  vtkPolyDataSlabIndex* slabIndex = NULL;
+  vtkSmartPointer<vtkTransform> linearNodeToWorldTransform = vtkSmartPointer<vtkTransform>::New();
+  if (vtkMRMLTransformNode::IsGeneralTransformLinear(pipeline->NodeToWorldTransform, linearNodeToWorldTransform))
+    {
+    slabIndex = vtkPolyDataSlabIndex::GetSlabIndexForPolyData(polyData);
+    }
+
+  vtkPolyData* contours = NULL;
+  if (slabIndex)
+    {
+    vtkMatrix4x4* nodeToWorldMatrix = linearNodeToWorldTransform->GetMatrix();
+    vtkNew<vtkMatrix4x4> worldToNodeMatrix;
+    vtkMatrix4x4::Invert(nodeToWorldMatrix, worldToNodeMatrix.GetPointer());
+
+    // Slice plane in the segmentation coordinate system. Normals are transformed by the transpose of the inverse
+    double sliceOrigin[4] = {0.0, 0.0, 0.0, 1.0};
+    double sliceNormal[3] = {0.0, 0.0, 0.0};
+    for (int i=0; i<3; i++)
+      {
+      sliceOrigin[i] = this->SliceXYToRAS->GetElement(i,3);
+      sliceNormal[i] = this->SliceXYToRAS->GetElement(i,2);
+      }
+    double planeOrigin[4] = {0.0, 0.0, 0.0, 1.0};
+    worldToNodeMatrix->MultiplyPoint(sliceOrigin, planeOrigin);
+    double planeNormal[3] = {0.0, 0.0, 0.0};
+    for (int i=0; i<3; i++)
+      {
+      for (int j=0; j<3; j++)
+        {
+        planeNormal[i] += nodeToWorldMatrix->GetElement(j,i) * sliceNormal[j];
+        }
+      }
+    contours = slabIndex->Cut(planeOrigin, planeNormal);
+    vtkMatrix4x4::Multiply4x4(rasToSliceXY, nodeToWorldMatrix, contoursToSliceXY);
+    }
+  else
+    {
+    pipeline->ModelWarper->SetInputData(polyData);
+    pipeline->ModelWarper->SetTransform(pipeline->NodeToWorldTransform);
+
+    // Set Plane transform
+    this->SetSlicePlaneFromMatrix(this->SliceXYToRAS, pipeline->Plane);
+    pipeline->Plane->Modified();
+
+    // Optimization for slice to slice intersections which are 1 quad polydatas
+    // no need for 50^3 default locator divisions
+    if (polyData->GetPoints() != NULL && polyData->GetNumberOfPoints() <= 4 )
+      {
+      vtkNew<vtkPointLocator> locator;
+      double *bounds = polyData->GetBounds();
+      locator->SetDivisions(2,2,2);
+      locator->InitPointInsertion(polyData->GetPoints(), bounds);
+      pipeline->Cutter->SetLocator(locator.GetPointer());
+      }
+
+    pipeline->Stripper->Update();
+    contours = pipeline->Stripper->GetOutput();
+    contoursToSliceXY->DeepCopy(rasToSliceXY);
+    }
+
+  if (!contours || !contours->GetPoints() || contours->GetNumberOfLines() == 0)
+    {
+    return NULL;
+    }
+  return contours;
 }
 
 //---------------------------------------------------------------------------
@@ -886,6 +1078,50 @@ vtkMRMLSegmentationsDisplayableManager2D::~vtkMRMLSegmentationsDisplayableManage
   this->Internal = NULL;
 }
 
+//---------------------------------------------------------------------------
+void vtkMRMLSegmentationsDisplayableManager2D::AppendSegmentContours(vtkPolyData* contours, vtkMatrix4x4* contoursToSliceXY,
+  const unsigned char* outlineColor, const unsigned char* fillColor,
+  vtkPolyData* outlinePolyData, vtkPolyData* fillPolygonsPolyData)
+{
+  if (!contours || !contoursToSliceXY)
+    {
+    return;
+    }
+  if (outlineColor && outlinePolyData)
+    {
+    InitializeBatchedCells(outlinePolyData);
+    AppendCells(contours->GetPoints(), contours->GetLines(), contoursToSliceXY, outlineColor, outlinePolyData->GetPoints(),
+      outlinePolyData->GetLines(), vtkUnsignedCharArray::SafeDownCast(outlinePolyData->GetCellData()->GetScalars()));
+    }
+  if (fillColor && fillPolygonsPolyData)
+    {
+    // Closed contour lines are added as polygons, they are triangulated later by TriangulateSegmentFills
+    InitializeBatchedCells(fillPolygonsPolyData);
+    AppendCells(contours->GetPoints(), contours->GetLines(), contoursToSliceXY, fillColor, fillPolygonsPolyData->GetPoints(),
+      fillPolygonsPolyData->GetPolys(), vtkUnsignedCharArray::SafeDownCast(fillPolygonsPolyData->GetCellData()->GetScalars()));
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLSegmentationsDisplayableManager2D::TriangulateSegmentFills(vtkPolyData* fillPolygonsPolyData, vtkPolyData* fillPolyData)
+{
+  if (!fillPolyData)
+    {
+    return;
+    }
+  fillPolyData->Initialize();
+  if (!fillPolygonsPolyData || fillPolygonsPolyData->GetNumberOfPolys() == 0)
+    {
+    return;
+    }
+
+  // Triangle filter copies the cell data of each polygon to its triangles, so the segment colors are kept
+  vtkNew<vtkTriangleFilter> triangleFilter;
+  triangleFilter->SetInputData(fillPolygonsPolyData);
+  triangleFilter->Update();
+  fillPolyData->ShallowCopy(triangleFilter->GetOutput());
+}
+
 //---------------------------------------------------------------------------
 void vtkMRMLSegmentationsDisplayableManager2D::PrintSelf(ostream& os, vtkIndent indent)
 {
@@ -26,6 +26,9 @@
 
 #include "vtkSlicerSegmentationsModuleMRMLDisplayableManagerExport.h"
 
+class vtkMatrix4x4;
+class vtkPolyData;
+
 /// \brief Displayable manager for showing segmentations in slice (2D) views.
 ///
 /// Displays segmentations in slice viewers as labelmaps or contour lines
@@ -38,6 +41,16 @@ public:
   vtkTypeMacro(vtkMRMLSegmentationsDisplayableManager2D, vtkMRMLAbstractSliceViewDisplayableManager);
   void PrintSelf(ostream& os, vtkIndent indent);
 
+  /// Append the slice intersection contours of a segment surface to the batched outline and fill polygon poly data.
+  /// The contour points are transformed to slice XY coordinates. The contour lines are added as lines to the outline
+  /// and as polygons to the fill polygons, each cell with the given RGBA color. NULL color skips the outline or fill.
+  static void AppendSegmentContours(vtkPolyData* contours, vtkMatrix4x4* contoursToSliceXY,
+    const unsigned char* outlineColor, const unsigned char* fillColor,
+    vtkPolyData* outlinePolyData, vtkPolyData* fillPolygonsPolyData);
+
+  /// Triangulate the fill polygons of all the segments in one pass. The cell colors are preserved.
+  static void TriangulateSegmentFills(vtkPolyData* fillPolygonsPolyData, vtkPolyData* fillPolyData);
+
 protected:
   virtual void UnobserveMRMLScene();
   virtual void OnMRMLSceneNodeAdded(vtkMRMLNode* node);
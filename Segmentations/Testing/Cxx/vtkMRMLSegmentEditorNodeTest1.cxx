@@ -0,0 +1,102 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Segmentations includes
+#include "vtkMRMLSegmentEditorNode.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+
+namespace
+{
+  /// Check the modified extent of the edited labelmap against the expected one
+  bool CheckModifiedExtent(vtkMRMLSegmentEditorNode* editorNode, const int expectedExtent[6], const char* stepName)
+  {
+    int modifiedExtent[6] = {0,-1,0,-1,0,-1};
+    editorNode->GetEditedLabelmapModifiedExtent(modifiedExtent);
+    for (int i=0; i<6; ++i)
+    {
+      if (modifiedExtent[i] != expectedExtent[i])
+      {
+        std::cerr << __LINE__ << ": " << stepName << ": Modified extent mismatch at " << i << ": "
+          << modifiedExtent[i] << " instead of " << expectedExtent[i] << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLSegmentEditorNodeTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkMRMLSegmentEditorNode> editorNode = vtkSmartPointer<vtkMRMLSegmentEditorNode>::New();
+  const int emptyExtent[6] = {0,-1,0,-1,0,-1};
+  if (!CheckModifiedExtent(editorNode, emptyExtent, "Initial"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Empty extents do not change the modified region
+  const int invalidExtent[6] = {5,4,0,10,0,10};
+  editorNode->AddEditedLabelmapModifiedExtent(invalidExtent);
+  editorNode->AddEditedLabelmapModifiedExtent(NULL);
+  if (!CheckModifiedExtent(editorNode, emptyExtent, "Add empty"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // The first extent is taken as is, including negative indices
+  const int brushExtent[6] = {-3,2,10,14,7,7};
+  editorNode->AddEditedLabelmapModifiedExtent(brushExtent);
+  if (!CheckModifiedExtent(editorNode, brushExtent, "Add first"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Further extents are united with the modified region
+  const int pixelExtent[6] = {6,6,12,12,3,3};
+  editorNode->AddEditedLabelmapModifiedExtent(pixelExtent);
+  const int unionExtent[6] = {-3,6,10,14,3,7};
+  if (!CheckModifiedExtent(editorNode, unionExtent, "Add second"))
+  {
+    return EXIT_FAILURE;
+  }
+  editorNode->AddEditedLabelmapModifiedExtent(invalidExtent);
+  if (!CheckModifiedExtent(editorNode, unionExtent, "Add empty to non-empty"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Reset empties the region, and the next operation starts from its own extent only
+  editorNode->ResetEditedLabelmapModifiedExtent();
+  if (!CheckModifiedExtent(editorNode, emptyExtent, "Reset"))
+  {
+    return EXIT_FAILURE;
+  }
+  editorNode->AddEditedLabelmapModifiedExtent(pixelExtent);
+  if (!CheckModifiedExtent(editorNode, pixelExtent, "Add after reset"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,394 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkMRMLSegmentationDisplayNode.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+  /// Common geometry of the segments. The extent does not start at zero, so the displayed merged labelmap
+  /// (that is shifted to zero start) is offset from the common geometry
+  const int REFERENCE_EXTENT[6] = {10, 49, 5, 34, 0, 19};
+  const double REFERENCE_SPACING[3] = {1.5, 1.5, 2.0};
+  const double REFERENCE_ORIGIN[3] = {-30.0, 20.0, 10.0};
+
+  /// Set the common geometry on an oriented image. Axes are permuted so that the geometry is not trivial
+  void SetReferenceGeometry(vtkOrientedImageData* image)
+  {
+    image->SetSpacing(REFERENCE_SPACING[0], REFERENCE_SPACING[1], REFERENCE_SPACING[2]);
+    image->SetOrigin(REFERENCE_ORIGIN[0], REFERENCE_ORIGIN[1], REFERENCE_ORIGIN[2]);
+    image->SetDirections(0.0, -1.0, 0.0,  1.0, 0.0, 0.0,  0.0, 0.0, 1.0);
+  }
+
+  /// Set the voxels of a labelmap within a box (clipped to the labelmap extent)
+  void PaintBox(vtkOrientedImageData* labelmap, const int box[6], unsigned char value)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(extent);
+    for (int k=std::max(box[4],extent[4]); k<=std::min(box[5],extent[5]); ++k)
+    {
+      for (int j=std::max(box[2],extent[2]); j<=std::min(box[3],extent[3]); ++j)
+      {
+        for (int i=std::max(box[0],extent[0]); i<=std::min(box[1],extent[1]); ++i)
+        {
+          *static_cast<unsigned char*>(labelmap->GetScalarPointer(i,j,k)) = value;
+        }
+      }
+    }
+  }
+
+  /// Create labelmap in the common geometry with the given extent and a box of foreground voxels
+  void CreateBoxLabelmap(const int extent[6], const int box[6], vtkOrientedImageData* labelmap)
+  {
+    SetReferenceGeometry(labelmap);
+    labelmap->SetExtent(const_cast<int*>(extent));
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    labelmap->GetPointData()->GetScalars()->FillComponent(0, 0);
+    PaintBox(labelmap, box, 1);
+  }
+
+  /// Change the extent of a segment labelmap, keeping the voxels of the overlapping region
+  void ChangeLabelmapExtent(vtkOrientedImageData* labelmap, const int newExtent[6])
+  {
+    vtkSmartPointer<vtkOrientedImageData> newLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    int emptyBox[6] = {0,-1,0,-1,0,-1};
+    CreateBoxLabelmap(newExtent, emptyBox, newLabelmap);
+    int oldExtent[6] = {0,-1,0,-1,0,-1};
+    labelmap->GetExtent(oldExtent);
+    for (int k=std::max(oldExtent[4],newExtent[4]); k<=std::min(oldExtent[5],newExtent[5]); ++k)
+    {
+      for (int j=std::max(oldExtent[2],newExtent[2]); j<=std::min(oldExtent[3],newExtent[3]); ++j)
+      {
+        for (int i=std::max(oldExtent[0],newExtent[0]); i<=std::min(oldExtent[1],newExtent[1]); ++i)
+        {
+          *static_cast<unsigned char*>(newLabelmap->GetScalarPointer(i,j,k)) =
+            *static_cast<unsigned char*>(labelmap->GetScalarPointer(i,j,k));
+        }
+      }
+    }
+    // Deep copy keeps the representation object of the segment
+    labelmap->DeepCopy(newLabelmap);
+  }
+
+  /// Segment regions received in SegmentRegionModified events
+  struct ReceivedSegmentRegion
+  {
+    std::string SegmentID;
+    std::vector<int> Extent;
+  };
+
+  /// Record the segment region passed as call data of a SegmentRegionModified event
+  void RecordSegmentRegion(vtkObject* vtkNotUsed(caller), unsigned long eid, void* clientData, void* callData)
+  {
+    std::vector<ReceivedSegmentRegion>* receivedRegions = reinterpret_cast<std::vector<ReceivedSegmentRegion>*>(clientData);
+    vtkMRMLSegmentationNode::SegmentRegion* region = reinterpret_cast<vtkMRMLSegmentationNode::SegmentRegion*>(callData);
+    if (eid != vtkMRMLSegmentationNode::SegmentRegionModified || !receivedRegions || !region)
+    {
+      return;
+    }
+    ReceivedSegmentRegion receivedRegion;
+    receivedRegion.SegmentID = (region->SegmentID ? region->SegmentID : "");
+    receivedRegion.Extent = std::vector<int>(region->Extent, region->Extent+6);
+    receivedRegions->push_back(receivedRegion);
+  }
+
+  /// Check that a received segment region matches the reported one
+  bool CheckReceivedSegmentRegion(const ReceivedSegmentRegion& receivedRegion, const char* segmentID, const int extent[6])
+  {
+    if (receivedRegion.SegmentID.compare(segmentID) || !std::equal(extent, extent+6, receivedRegion.Extent.begin()))
+    {
+      std::cerr << __LINE__ << ": Segment region event mismatch: received segment '" << receivedRegion.SegmentID
+        << "' extent (" << receivedRegion.Extent[0] << ", " << receivedRegion.Extent[1] << ", " << receivedRegion.Extent[2]
+        << ", " << receivedRegion.Extent[3] << ", " << receivedRegion.Extent[4] << ", " << receivedRegion.Extent[5]
+        << "), expected segment '" << segmentID << "'" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  /// Get value of a voxel of the displayed merged labelmap in the IJK coordinates of the common geometry
+  unsigned char GetDisplayedVoxel(vtkImageData* displayedLabelmap, int i, int j, int k)
+  {
+    return *static_cast<unsigned char*>(displayedLabelmap->GetScalarPointer(
+      i-REFERENCE_EXTENT[0], j-REFERENCE_EXTENT[2], k-REFERENCE_EXTENT[4]));
+  }
+
+  /// Get color index of a segment in the merged labelmap
+  int GetSegmentColorIndex(vtkMRMLSegmentationNode* segmentationNode, const std::string& segmentID)
+  {
+    std::string colorIndexStr;
+    if (!segmentationNode->GetSegmentation()->GetSegment(segmentID)->GetTag(vtkMRMLSegmentationDisplayNode::GetColorIndexTag(), colorIndexStr))
+    {
+      return -1;
+    }
+    int colorIndex = -1;
+    std::stringstream colorSS;
+    colorSS << colorIndexStr;
+    colorSS >> colorIndex;
+    return colorIndex;
+  }
+
+  /// Compare the displayed merged labelmap voxel by voxel with a merged labelmap generated from scratch
+  bool CompareWithGeneratedMergedLabelmap(vtkMRMLSegmentationNode* segmentationNode, const char* stepName)
+  {
+    vtkImageData* displayedLabelmap = segmentationNode->GetImageData();
+    vtkSmartPointer<vtkImageData> generatedLabelmap = vtkSmartPointer<vtkImageData>::New();
+    vtkSmartPointer<vtkMatrix4x4> generatedImageToWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+    if (!displayedLabelmap || !segmentationNode->GenerateMergedLabelmap(generatedLabelmap, generatedImageToWorld))
+    {
+      std::cerr << __LINE__ << ": " << stepName << ": Failed to get merged labelmaps!" << std::endl;
+      return false;
+    }
+
+    int displayedExtent[6] = {0,-1,0,-1,0,-1};
+    displayedLabelmap->GetExtent(displayedExtent);
+    int generatedExtent[6] = {0,-1,0,-1,0,-1};
+    generatedLabelmap->GetExtent(generatedExtent);
+    for (int i=0; i<6; ++i)
+    {
+      if (generatedExtent[i] != REFERENCE_EXTENT[i] || displayedExtent[i] != REFERENCE_EXTENT[i] - REFERENCE_EXTENT[i-i%2])
+      {
+        std::cerr << __LINE__ << ": " << stepName << ": Merged labelmap extent mismatch at " << i << ": displayed "
+          << displayedExtent[i] << ", generated " << generatedExtent[i] << std::endl;
+        return false;
+      }
+    }
+    if (displayedLabelmap->GetScalarType() != VTK_UNSIGNED_CHAR || generatedLabelmap->GetScalarType() != VTK_UNSIGNED_CHAR)
+    {
+      std::cerr << __LINE__ << ": " << stepName << ": Merged labelmaps are not unsigned char!" << std::endl;
+      return false;
+    }
+
+    int numberOfDifferences = 0;
+    for (int k=REFERENCE_EXTENT[4]; k<=REFERENCE_EXTENT[5]; ++k)
+    {
+      for (int j=REFERENCE_EXTENT[2]; j<=REFERENCE_EXTENT[3]; ++j)
+      {
+        for (int i=REFERENCE_EXTENT[0]; i<=REFERENCE_EXTENT[1]; ++i)
+        {
+          unsigned char displayedValue = GetDisplayedVoxel(displayedLabelmap, i, j, k);
+          unsigned char generatedValue = *static_cast<unsigned char*>(generatedLabelmap->GetScalarPointer(i,j,k));
+          if (displayedValue != generatedValue)
+          {
+            if (numberOfDifferences == 0)
+            {
+              std::cerr << __LINE__ << ": " << stepName << ": First mismatch at (" << i << ", " << j << ", " << k << "): displayed "
+                << (int)displayedValue << ", generated " << (int)generatedValue << std::endl;
+            }
+            ++numberOfDifferences;
+          }
+        }
+      }
+    }
+    if (numberOfDifferences > 0)
+    {
+      std::cerr << __LINE__ << ": " << stepName << ": " << numberOfDifferences << " voxels differ in the updated merged labelmap!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLSegmentationNodeTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkMRMLScene> scene = vtkSmartPointer<vtkMRMLScene>::New();
+  vtkSmartPointer<vtkMRMLSegmentationNode> segmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+  scene->AddNode(segmentationNode);
+  segmentationNode->CreateDefaultDisplayNodes();
+  vtkSegmentation* segmentation = segmentationNode->GetSegmentation();
+  segmentation->SetMasterRepresentationName(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName());
+
+  // Fix the common geometry so that it does not depend on the segment extents
+  vtkSmartPointer<vtkOrientedImageData> referenceGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+  SetReferenceGeometry(referenceGeometry);
+  referenceGeometry->SetExtent(const_cast<int*>(REFERENCE_EXTENT));
+  segmentation->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(),
+    vtkSegmentationConverter::SerializeImageGeometry(referenceGeometry));
+
+  // Segments are composited in the order of their IDs: B overlaps A and is painted over it
+  const int numberOfSegments = 3;
+  const char* segmentIDs[numberOfSegments] = {"A", "B", "C"};
+  const int labelmapExtents[numberOfSegments][6] = {
+    {12, 32, 8, 26, 2, 12}, {22, 42, 14, 32, 5, 17}, {36, 48, 5, 15, 12, 19} };
+  const int labelmapBoxes[numberOfSegments][6] = {
+    {14, 28, 10, 24, 3, 10}, {24, 40, 16, 30, 6, 15}, {38, 46, 6, 13, 13, 18} };
+  vtkOrientedImageData* labelmaps[numberOfSegments] = {NULL, NULL, NULL};
+  for (int segmentIndex=0; segmentIndex<numberOfSegments; ++segmentIndex)
+  {
+    vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    CreateBoxLabelmap(labelmapExtents[segmentIndex], labelmapBoxes[segmentIndex], labelmap);
+    vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
+    segment->SetName(segmentIDs[segmentIndex]);
+    segment->SetDefaultColor(0.2*segmentIndex, 0.5, 1.0-0.2*segmentIndex);
+    segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), labelmap);
+    if (!segmentation->AddSegment(segment, segmentIDs[segmentIndex]))
+    {
+      std::cerr << __LINE__ << ": Failed to add segment " << segmentIDs[segmentIndex] << std::endl;
+      return EXIT_FAILURE;
+    }
+    labelmaps[segmentIndex] = labelmap;
+  }
+  vtkOrientedImageData* labelmapA = labelmaps[0];
+  vtkOrientedImageData* labelmapB = labelmaps[1];
+  vtkOrientedImageData* labelmapC = labelmaps[2];
+  int colorIndexA = GetSegmentColorIndex(segmentationNode, "A");
+  int colorIndexB = GetSegmentColorIndex(segmentationNode, "B");
+  if (colorIndexA < 0 || colorIndexB < 0 || colorIndexA == colorIndexB)
+  {
+    std::cerr << __LINE__ << ": Invalid segment color indices: " << colorIndexA << ", " << colorIndexB << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Initial merge
+  if (!CompareWithGeneratedMergedLabelmap(segmentationNode, "Initial"))
+  {
+    return EXIT_FAILURE;
+  }
+  vtkImageData* displayedLabelmap = segmentationNode->GetImageData();
+  if (GetDisplayedVoxel(displayedLabelmap, 26, 20, 8) != colorIndexB)
+  {
+    std::cerr << __LINE__ << ": Overlapping segment is not composited over the previous one!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Edit regions of A under B and outside B, and report the regions. A voxel outside the reported regions is
+  // changed in the displayed labelmap directly: it is kept if only the reported regions are re-composited
+  const int clearedBoxA[6] = {24, 27, 17, 20, 7, 9};
+  const int paintedBoxA[6] = {13, 16, 8, 9, 11, 12};
+  PaintBox(labelmapA, clearedBoxA, 0);
+  PaintBox(labelmapA, paintedBoxA, 1);
+  labelmapA->Modified();
+  // Each reported region is passed to the observers of the segment region modified event, empty regions are ignored
+  std::vector<ReceivedSegmentRegion> receivedRegions;
+  vtkSmartPointer<vtkCallbackCommand> regionCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+  regionCallback->SetClientData(reinterpret_cast<void*>(&receivedRegions));
+  regionCallback->SetCallback(RecordSegmentRegion);
+  unsigned long regionObserverTag = segmentationNode->AddObserver(vtkMRMLSegmentationNode::SegmentRegionModified, regionCallback);
+  const int emptyBox[6] = {0,-1,0,-1,0,-1};
+  segmentationNode->AddSegmentModifiedExtent("A", clearedBoxA);
+  segmentationNode->AddSegmentModifiedExtent("A", emptyBox);
+  segmentationNode->AddSegmentModifiedExtent("A", paintedBoxA);
+  segmentationNode->RemoveObserver(regionObserverTag);
+  if (receivedRegions.size() != 2)
+  {
+    std::cerr << __LINE__ << ": Invalid number of segment region modified events: " << receivedRegions.size() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !CheckReceivedSegmentRegion(receivedRegions[0], "A", clearedBoxA)
+    || !CheckReceivedSegmentRegion(receivedRegions[1], "A", paintedBoxA) )
+  {
+    return EXIT_FAILURE;
+  }
+  unsigned char* untouchedVoxel = static_cast<unsigned char*>(displayedLabelmap->GetScalarPointer(0,0,0));
+  unsigned char untouchedValue = *untouchedVoxel;
+  *untouchedVoxel = 99;
+  if (segmentationNode->GetImageData() != displayedLabelmap)
+  {
+    std::cerr << __LINE__ << ": Displayed merged labelmap is replaced instead of updated!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (*untouchedVoxel != 99)
+  {
+    std::cerr << __LINE__ << ": Voxel outside the reported regions has been re-composited!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  *untouchedVoxel = untouchedValue;
+  if (!CompareWithGeneratedMergedLabelmap(segmentationNode, "Reported edit"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Edit B within its extent without reporting the region
+  const int clearedBoxB[6] = {30, 35, 20, 25, 10, 12};
+  PaintBox(labelmapB, clearedBoxB, 0);
+  labelmapB->Modified();
+  if (!CompareWithGeneratedMergedLabelmap(segmentationNode, "Unreported edit"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Grow A across B. The reported region is smaller than the change, but the extent change takes precedence
+  const int grownExtentA[6] = {12, 38, 8, 30, 2, 14};
+  const int grownBoxA[6] = {28, 36, 20, 28, 8, 13};
+  ChangeLabelmapExtent(labelmapA, grownExtentA);
+  PaintBox(labelmapA, grownBoxA, 1);
+  labelmapA->Modified();
+  const int staleReportedBoxA[6] = {14, 15, 10, 11, 3, 4};
+  segmentationNode->AddSegmentModifiedExtent("A", staleReportedBoxA);
+  if (!CompareWithGeneratedMergedLabelmap(segmentationNode, "Grow across overlap"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Shrink B so that it does not cover A anymore, which uncovers the voxels of A under it
+  const int shrunkExtentB[6] = {30, 42, 22, 32, 10, 17};
+  ChangeLabelmapExtent(labelmapB, shrunkExtentB);
+  labelmapB->Modified();
+  if (!CompareWithGeneratedMergedLabelmap(segmentationNode, "Shrink across overlap"))
+  {
+    return EXIT_FAILURE;
+  }
+  if (GetDisplayedVoxel(segmentationNode->GetImageData(), 26, 22, 6) != colorIndexA)
+  {
+    std::cerr << __LINE__ << ": Segment uncovered by shrinking the overlapping segment is not shown!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Modify two segments before one update: clear C completely without extent change and paint A with reporting
+  const int allOfC[6] = {36, 48, 5, 15, 12, 19};
+  PaintBox(labelmapC, allOfC, 0);
+  labelmapC->Modified();
+  const int paintedBoxA2[6] = {20, 22, 26, 29, 4, 5};
+  PaintBox(labelmapA, paintedBoxA2, 1);
+  labelmapA->Modified();
+  segmentationNode->AddSegmentModifiedExtent("A", paintedBoxA2);
+  if (!CompareWithGeneratedMergedLabelmap(segmentationNode, "Multiple segments"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
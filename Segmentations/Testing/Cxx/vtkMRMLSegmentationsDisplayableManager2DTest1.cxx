@@ -0,0 +1,255 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Segmentations includes
+#include "vtkMRMLSegmentationsDisplayableManager2D.h"
+
+// SegmentationCore includes
+#include "vtkPolyDataSlabIndex.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkTransform.h>
+#include <vtkTriangle.h>
+#include <vtkUnsignedCharArray.h>
+
+// STD includes
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  /// Segment surfaces are spheres, the first two overlap on the slice, the last one does not intersect it
+  const int NUMBER_OF_SEGMENTS = 4;
+  const double SEGMENT_CENTERS[NUMBER_OF_SEGMENTS][3] = {
+    {0.0, 0.0, 0.0}, {20.0, 5.0, 0.0}, {-40.0, 40.0, 0.0}, {0.0, 0.0, 100.0} };
+  const double SEGMENT_RADII[NUMBER_OF_SEGMENTS] = {30.0, 25.0, 15.0, 10.0};
+  /// Which segments have outline and fill shown
+  const bool SEGMENT_OUTLINE_VISIBLE[NUMBER_OF_SEGMENTS] = {true, false, true, true};
+  const bool SEGMENT_FILL_VISIBLE[NUMBER_OF_SEGMENTS] = {true, true, false, true};
+  const unsigned char SEGMENT_COLORS[NUMBER_OF_SEGMENTS][4] = {
+    {255, 0, 0, 128}, {0, 255, 0, 128}, {0, 0, 255, 128}, {255, 255, 0, 128} };
+  /// Slice plane is axial, chosen so that it does not contain vertices of the spheres
+  const double SLICE_OFFSET = 5.13;
+  /// Slice XY coordinates are scaled and shifted with respect to the segment coordinates
+  const double SLICE_XY_SCALE = 2.0;
+  const double SLICE_XY_SHIFT[2] = {120.0, 80.0};
+  /// Relative tolerance of the contour lengths and areas (the spheres are tessellated)
+  const double TOLERANCE = 0.03;
+
+  /// Get index of the segment from the color of a cell, -1 if there is no segment with that color
+  int GetSegmentIndexForColor(vtkUnsignedCharArray* colors, vtkIdType cellId)
+  {
+    unsigned char color[4] = {0, 0, 0, 0};
+    colors->GetTupleValue(cellId, color);
+    for (int segmentIndex=0; segmentIndex<NUMBER_OF_SEGMENTS; ++segmentIndex)
+    {
+      if ( color[0] == SEGMENT_COLORS[segmentIndex][0] && color[1] == SEGMENT_COLORS[segmentIndex][1]
+        && color[2] == SEGMENT_COLORS[segmentIndex][2] && color[3] == SEGMENT_COLORS[segmentIndex][3] )
+      {
+        return segmentIndex;
+      }
+    }
+    return -1;
+  }
+
+  /// Get the total line length and the total triangle area of each segment from the cell colors
+  bool GetSegmentLengthsAndAreas(vtkPolyData* outline, vtkPolyData* fill, std::vector<double>& lengths, std::vector<double>& areas)
+  {
+    lengths.assign(NUMBER_OF_SEGMENTS, 0.0);
+    areas.assign(NUMBER_OF_SEGMENTS, 0.0);
+
+    vtkUnsignedCharArray* outlineColors = vtkUnsignedCharArray::SafeDownCast(outline->GetCellData()->GetScalars());
+    if (!outlineColors || outlineColors->GetNumberOfComponents() != 4 || outlineColors->GetNumberOfTuples() != outline->GetNumberOfCells())
+    {
+      std::cerr << __LINE__ << ": Outline cells do not have RGBA colors!" << std::endl;
+      return false;
+    }
+    vtkIdType numberOfCellPoints = 0;
+    vtkIdType* cellPointIds = NULL;
+    vtkIdType cellId = 0;
+    vtkCellArray* lines = outline->GetLines();
+    for (lines->InitTraversal(); lines->GetNextCell(numberOfCellPoints, cellPointIds); ++cellId)
+    {
+      int segmentIndex = GetSegmentIndexForColor(outlineColors, cellId);
+      if (segmentIndex < 0)
+      {
+        std::cerr << __LINE__ << ": Outline cell " << cellId << " has unexpected color!" << std::endl;
+        return false;
+      }
+      for (vtkIdType cellPointIndex=0; cellPointIndex+1<numberOfCellPoints; ++cellPointIndex)
+      {
+        double point1[3] = {0.0, 0.0, 0.0};
+        double point2[3] = {0.0, 0.0, 0.0};
+        outline->GetPoint(cellPointIds[cellPointIndex], point1);
+        outline->GetPoint(cellPointIds[cellPointIndex+1], point2);
+        lengths[segmentIndex] += sqrt(vtkMath::Distance2BetweenPoints(point1, point2));
+      }
+    }
+
+    vtkUnsignedCharArray* fillColors = vtkUnsignedCharArray::SafeDownCast(fill->GetCellData()->GetScalars());
+    if (!fillColors || fillColors->GetNumberOfComponents() != 4 || fillColors->GetNumberOfTuples() != fill->GetNumberOfCells())
+    {
+      std::cerr << __LINE__ << ": Fill cells do not have RGBA colors!" << std::endl;
+      return false;
+    }
+    if (fill->GetNumberOfCells() != fill->GetNumberOfPolys())
+    {
+      std::cerr << __LINE__ << ": Fill contains cells other than polygons!" << std::endl;
+      return false;
+    }
+    cellId = 0;
+    vtkCellArray* polys = fill->GetPolys();
+    for (polys->InitTraversal(); polys->GetNextCell(numberOfCellPoints, cellPointIds); ++cellId)
+    {
+      if (numberOfCellPoints != 3)
+      {
+        std::cerr << __LINE__ << ": Fill cell " << cellId << " is not a triangle!" << std::endl;
+        return false;
+      }
+      int segmentIndex = GetSegmentIndexForColor(fillColors, cellId);
+      if (segmentIndex < 0)
+      {
+        std::cerr << __LINE__ << ": Fill cell " << cellId << " has unexpected color!" << std::endl;
+        return false;
+      }
+      double point1[3] = {0.0, 0.0, 0.0};
+      double point2[3] = {0.0, 0.0, 0.0};
+      double point3[3] = {0.0, 0.0, 0.0};
+      fill->GetPoint(cellPointIds[0], point1);
+      fill->GetPoint(cellPointIds[1], point2);
+      fill->GetPoint(cellPointIds[2], point3);
+      areas[segmentIndex] += vtkTriangle::TriangleArea(point1, point2, point3);
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLSegmentationsDisplayableManager2DTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Segment coordinates to slice XY: slice plane goes to z=0
+  vtkSmartPointer<vtkTransform> contoursToSliceXYTransform = vtkSmartPointer<vtkTransform>::New();
+  contoursToSliceXYTransform->PostMultiply();
+  contoursToSliceXYTransform->Translate(0.0, 0.0, -SLICE_OFFSET);
+  contoursToSliceXYTransform->Scale(SLICE_XY_SCALE, SLICE_XY_SCALE, SLICE_XY_SCALE);
+  contoursToSliceXYTransform->Translate(SLICE_XY_SHIFT[0], SLICE_XY_SHIFT[1], 0.0);
+  vtkMatrix4x4* contoursToSliceXY = contoursToSliceXYTransform->GetMatrix();
+
+  // Cut the segment surfaces and collect the contours the same way as the displayable manager does
+  const double sliceOrigin[3] = {0.0, 0.0, SLICE_OFFSET};
+  const double sliceNormal[3] = {0.0, 0.0, 1.0};
+  vtkSmartPointer<vtkPolyData> outline = vtkSmartPointer<vtkPolyData>::New();
+  vtkSmartPointer<vtkPolyData> fillPolygons = vtkSmartPointer<vtkPolyData>::New();
+  std::vector<vtkSmartPointer<vtkPolyData> > segmentSurfaces;
+  for (int segmentIndex=0; segmentIndex<NUMBER_OF_SEGMENTS; ++segmentIndex)
+  {
+    vtkSmartPointer<vtkSphereSource> sphere = vtkSmartPointer<vtkSphereSource>::New();
+    sphere->SetCenter(const_cast<double*>(SEGMENT_CENTERS[segmentIndex]));
+    sphere->SetRadius(SEGMENT_RADII[segmentIndex]);
+    sphere->SetThetaResolution(90);
+    sphere->SetPhiResolution(90);
+    sphere->Update();
+    vtkSmartPointer<vtkPolyData> surface = vtkSmartPointer<vtkPolyData>::New();
+    surface->DeepCopy(sphere->GetOutput());
+    segmentSurfaces.push_back(surface);
+
+    vtkPolyDataSlabIndex* slabIndex = vtkPolyDataSlabIndex::GetSlabIndexForPolyData(surface);
+    if (!slabIndex)
+    {
+      std::cerr << __LINE__ << ": Failed to build slab index for segment " << segmentIndex << std::endl;
+      return EXIT_FAILURE;
+    }
+    vtkPolyData* contours = slabIndex->Cut(sliceOrigin, sliceNormal);
+    vtkMRMLSegmentationsDisplayableManager2D::AppendSegmentContours(contours, contoursToSliceXY,
+      SEGMENT_OUTLINE_VISIBLE[segmentIndex] ? SEGMENT_COLORS[segmentIndex] : NULL,
+      SEGMENT_FILL_VISIBLE[segmentIndex] ? SEGMENT_COLORS[segmentIndex] : NULL,
+      outline, fillPolygons);
+  }
+
+  // Fill polygons of all the segments are triangulated at once
+  vtkSmartPointer<vtkPolyData> fill = vtkSmartPointer<vtkPolyData>::New();
+  vtkMRMLSegmentationsDisplayableManager2D::TriangulateSegmentFills(fillPolygons, fill);
+  if (fill->GetNumberOfPolys() <= fillPolygons->GetNumberOfPolys())
+  {
+    std::cerr << __LINE__ << ": Fill polygons are not triangulated!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<double> lengths;
+  std::vector<double> areas;
+  if (!GetSegmentLengthsAndAreas(outline, fill, lengths, areas))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // All points are in the slice plane, contours and fills of each segment match its circle on the slice
+  for (vtkIdType pointId=0; pointId<outline->GetNumberOfPoints(); ++pointId)
+  {
+    if (fabs(outline->GetPoint(pointId)[2]) > 1e-6)
+    {
+      std::cerr << __LINE__ << ": Outline point " << pointId << " is not in the slice plane!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  for (int segmentIndex=0; segmentIndex<NUMBER_OF_SEGMENTS; ++segmentIndex)
+  {
+    double distanceToSlice = fabs(SEGMENT_CENTERS[segmentIndex][2] - SLICE_OFFSET);
+    double circleRadius = 0.0;
+    if (distanceToSlice < SEGMENT_RADII[segmentIndex])
+    {
+      circleRadius = SLICE_XY_SCALE * sqrt(SEGMENT_RADII[segmentIndex]*SEGMENT_RADII[segmentIndex] - distanceToSlice*distanceToSlice);
+    }
+    double expectedLength = SEGMENT_OUTLINE_VISIBLE[segmentIndex] ? 2.0 * vtkMath::Pi() * circleRadius : 0.0;
+    double expectedArea = SEGMENT_FILL_VISIBLE[segmentIndex] ? vtkMath::Pi() * circleRadius * circleRadius : 0.0;
+    if (fabs(lengths[segmentIndex] - expectedLength) > TOLERANCE * expectedLength)
+    {
+      std::cerr << __LINE__ << ": Outline length of segment " << segmentIndex << " is " << lengths[segmentIndex]
+        << " instead of " << expectedLength << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (fabs(areas[segmentIndex] - expectedArea) > TOLERANCE * expectedArea)
+    {
+      std::cerr << __LINE__ << ": Fill area of segment " << segmentIndex << " is " << areas[segmentIndex]
+        << " instead of " << expectedArea << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // No fill polygons give empty fill
+  vtkSmartPointer<vtkPolyData> emptyFillPolygons = vtkSmartPointer<vtkPolyData>::New();
+  vtkMRMLSegmentationsDisplayableManager2D::TriangulateSegmentFills(emptyFillPolygons, fill);
+  if (fill->GetNumberOfCells() != 0 || fill->GetNumberOfPoints() != 0)
+  {
+    std::cerr << __LINE__ << ": Fill is not empty without fill polygons!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -31,6 +31,7 @@
 #include "vtkSegment.h"
 #include "vtkOrientedImageData.h"
 #include "vtkOrientedImageDataResample.h"
+#include "vtkSegmentationHistory.h"
 #include "vtkSlicerSegmentationsModuleLogic.h"
 
 // Segment editor effects includes
@@ -123,6 +124,17 @@ public:
   /// Show selected segment in 2D views as fill only, all the others as outline only
   void showSelectedSegment();
 
+  /// Update representations and display of a segment after its binary labelmap has been modified
+  /// \param modifiedExtent Modified region of the labelmap, NULL if unknown
+  void updateSegmentAfterLabelmapModification(vtkMRMLSegmentationNode* segmentationNode, const char* segmentID, int* modifiedExtent);
+
+  /// Restore a segment modification from the history
+  /// \param undo Undo last modification if true, redo last undone modification otherwise
+  void restoreFromHistory(bool undo);
+
+  /// Enable undo and redo buttons if there are modifications to undo or redo
+  void updateUndoRedoButtonsState();
+
 public:
   /// Segment editor parameter set node containing all selections and working images
   vtkWeakPointer<vtkMRMLSegmentEditorNode> ParameterSetNode;
@@ -141,6 +153,9 @@ public:
   
   /// Button group for the effects
   QButtonGroup EffectButtonGroup;
+
+  /// Undo/redo history of the segment modifications made in the editor
+  vtkSmartPointer<vtkSegmentationHistory> SegmentationHistory;
 };
 
 //-----------------------------------------------------------------------------
@@ -151,6 +166,8 @@ qMRMLSegmentEditorWidgetPrivate::qMRMLSegmentEditorWidgetPrivate(qMRMLSegmentEdi
 {
   this->InteractionCallbackCommands.clear();
   this->InteractionCallbackEventInfos.clear();
+
+  this->SegmentationHistory = vtkSmartPointer<vtkSegmentationHistory>::New();
 }
 
 //-----------------------------------------------------------------------------
@@ -191,12 +208,16 @@ void qMRMLSegmentEditorWidgetPrivate::init()
   QObject::connect( this->AddSegmentButton, SIGNAL(clicked()), q, SLOT(onAddSegment() ) );
   QObject::connect( this->RemoveSegmentButton, SIGNAL(clicked()), q, SLOT(onRemoveSegment() ) );
   QObject::connect( this->MakeModelButton, SIGNAL(clicked()), q, SLOT(onMakeModel() ) );
+  QObject::connect( this->UndoButton, SIGNAL(clicked()), q, SLOT(undo() ) );
+  QObject::connect( this->RedoButton, SIGNAL(clicked()), q, SLOT(redo() ) );
   
   // Widget properties
   this->SegmentsTableView->setMode(qMRMLSegmentsTableView::EditorMode);
   this->AddSegmentButton->setEnabled(false);
   this->RemoveSegmentButton->setEnabled(false);
   this->MakeModelButton->setVisible(false);
+  this->UndoButton->setEnabled(false);
+  this->RedoButton->setEnabled(false);
   this->EffectsGroupBox->setEnabled(false);
   this->OptionsGroupBox->setEnabled(false);
 
@@ -296,6 +317,7 @@ bool qMRMLSegmentEditorWidgetPrivate::createEditedLabelmapFromSelectedSegment()
 
   // Clear edited labelmap
   editedLabelmap->Initialize();
+  this->ParameterSetNode->ResetEditedLabelmapModifiedExtent();
 
   if (!segmentationNode || !masterVolumeNode || !editedLabelmap || !selectedSegmentID)
   {
@@ -415,6 +437,127 @@ void qMRMLSegmentEditorWidgetPrivate::showSelectedSegment()
   }
 }
 
+//-----------------------------------------------------------------------------
+void qMRMLSegmentEditorWidgetPrivate::updateSegmentAfterLabelmapModification(
+  vtkMRMLSegmentationNode* segmentationNode, const char* segmentID, int* modifiedExtent)
+{
+  vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(segmentID);
+  if (!segment)
+  {
+    qCritical() << "qMRMLSegmentEditorWidgetPrivate::updateSegmentAfterLabelmapModification: Failed to find segment " << segmentID;
+    return;
+  }
+
+  // Re-convert all other representations
+  std::vector<std::string> representationNames;
+  segment->GetContainedRepresentationNames(representationNames);
+  for (std::vector<std::string>::iterator reprIt = representationNames.begin();
+    reprIt != representationNames.end(); ++reprIt)
+  {
+    std::string targetRepresentationName = (*reprIt);
+    if (targetRepresentationName.compare(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+    {
+      segmentationNode->GetSegmentation()->ConvertSingleSegment(segmentID, targetRepresentationName);
+    }
+  }
+
+  // Report the modified region, so that the merged labelmap and other consumers only update that region
+  if (modifiedExtent)
+  {
+    segmentationNode->AddSegmentModifiedExtent(segmentID, modifiedExtent);
+  }
+
+  // Trigger display update
+  vtkMRMLSegmentationDisplayNode* displayNode = vtkMRMLSegmentationDisplayNode::SafeDownCast(segmentationNode->GetDisplayNode());
+  if (displayNode)
+  {
+    displayNode->Modified();
+  }
+}
+
+//-----------------------------------------------------------------------------
+void qMRMLSegmentEditorWidgetPrivate::restoreFromHistory(bool undo)
+{
+  if (!this->ParameterSetNode)
+  {
+    qCritical() << "qMRMLSegmentEditorWidgetPrivate::restoreFromHistory: Invalid segment editor parameter set node!";
+    return;
+  }
+  vtkMRMLSegmentationNode* segmentationNode = this->ParameterSetNode->GetSegmentationNode();
+  if (!segmentationNode || segmentationNode->GetSegmentation() != this->SegmentationHistory->GetSegmentation())
+  {
+    qCritical() << "qMRMLSegmentEditorWidgetPrivate::restoreFromHistory: Invalid segmentation node!";
+    return;
+  }
+
+  // Disable master representation modified event so that other representations are not removed from
+  // all segments, only the ones of the restored segment are re-converted
+  segmentationNode->GetSegmentation()->SetMasterRepresentationModifiedEnabled(false);
+
+  std::string segmentID;
+  int restoredExtent[6] = {0,-1,0,-1,0,-1};
+  bool success = ( undo ? this->SegmentationHistory->Undo(segmentID, restoredExtent)
+    : this->SegmentationHistory->Redo(segmentID, restoredExtent) );
+  if (success)
+  {
+    this->updateSegmentAfterLabelmapModification(segmentationNode, segmentID.c_str(), restoredExtent);
+  }
+
+  segmentationNode->GetSegmentation()->SetMasterRepresentationModifiedEnabled(true);
+  this->updateUndoRedoButtonsState();
+  if (!success)
+  {
+    qCritical() << "qMRMLSegmentEditorWidgetPrivate::restoreFromHistory: Failed to restore segment modification, history is cleared";
+    return;
+  }
+
+  // Update the edited labelmap if the restored segment is being edited
+  const char* selectedSegmentID = this->ParameterSetNode->GetSelectedSegmentID();
+  if (!selectedSegmentID || segmentID.compare(selectedSegmentID))
+  {
+    return;
+  }
+  vtkOrientedImageData* editedLabelmap = this->ParameterSetNode->GetEditedLabelmap();
+  vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast(
+    segmentationNode->GetSegmentation()->GetSegment(segmentID)->GetRepresentation(
+    vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
+  int editedExtent[6] = {0,-1,0,-1,0,-1};
+  if (editedLabelmap)
+  {
+    editedLabelmap->GetExtent(editedExtent);
+  }
+  bool restoredExtentInEditedLabelmap = (editedLabelmap && segmentLabelmap
+    && vtkOrientedImageDataResample::DoGeometriesMatch(editedLabelmap, segmentLabelmap)
+    && editedLabelmap->GetScalarType() == segmentLabelmap->GetScalarType());
+  for (int i=0; i<3; ++i)
+  {
+    if (restoredExtent[2*i] < editedExtent[2*i] || restoredExtent[2*i+1] > editedExtent[2*i+1])
+    {
+      restoredExtentInEditedLabelmap = false;
+    }
+  }
+  if (restoredExtentInEditedLabelmap)
+  {
+    // Only copy the restored region
+    editedLabelmap->CopyAndCastFrom(segmentLabelmap, restoredExtent);
+    editedLabelmap->Modified();
+    // The edited labelmap is in sync with the segment again, nothing is left to apply
+    this->ParameterSetNode->ResetEditedLabelmapModifiedExtent();
+  }
+  else if (!this->createEditedLabelmapFromSelectedSegment())
+  {
+    return;
+  }
+  this->notifyEffectsOfEditedLabelmapChange();
+}
+
+//-----------------------------------------------------------------------------
+void qMRMLSegmentEditorWidgetPrivate::updateUndoRedoButtonsState()
+{
+  this->UndoButton->setEnabled(this->SegmentationHistory->GetNumberOfUndoLevels() > 0);
+  this->RedoButton->setEnabled(this->SegmentationHistory->GetNumberOfRedoLevels() > 0);
+}
+
 //-----------------------------------------------------------------------------
 
 
@@ -492,6 +635,11 @@ void qMRMLSegmentEditorWidget::setActiveEffect(qSlicerSegmentEditorAbstractEffec
   {
     d->ActiveEffect->deactivate();
   }
+  // Discard the modified region of an operation that was interrupted by the effect change
+  if (d->ParameterSetNode)
+  {
+    d->ParameterSetNode->ResetEditedLabelmapModifiedExtent();
+  }
 
   if (effect)
   {
@@ -725,6 +873,10 @@ void qMRMLSegmentEditorWidget::onSegmentationNodeChanged(vtkMRMLNode* node)
     d->ParameterSetNode->DisableModifiedEventOff();
   }
 
+  // Modifications can only be undone in the segmentation they were made in
+  d->SegmentationHistory->SetSegmentation(segmentationNode ? segmentationNode->GetSegmentation() : NULL);
+  d->updateUndoRedoButtonsState();
+
   // The below functions only apply to valid segmentation node selection
   if (!segmentationNode)
   {
@@ -1279,48 +1431,99 @@ void qMRMLSegmentEditorWidget::applyChangesToSelectedSegment()
     return;
   }
 
-  // First copy the temporary padded edited labelmap to the segment.
-  // Mask and threshold was already applied on edited labelmap at this point if requested.
+  // Get the region modified by the effect (if reported) and reset it for the next modification
+  int modifiedExtent[6] = {0,-1,0,-1,0,-1};
+  d->ParameterSetNode->GetEditedLabelmapModifiedExtent(modifiedExtent);
+  d->ParameterSetNode->ResetEditedLabelmapModifiedExtent();
+  bool modifiedExtentValid = (modifiedExtent[0] <= modifiedExtent[1] && modifiedExtent[2] <= modifiedExtent[3] && modifiedExtent[4] <= modifiedExtent[5]);
+
+  // If the effect did not report the modified region, then find it by comparing the edited labelmap with the segment.
+  // This is not possible if the geometries differ, in which case the whole edited labelmap is applied
+  if (!modifiedExtentValid && vtkOrientedImageDataResample::CalculateChangedExtent(editedLabelmap, segmentLabelmap, modifiedExtent))
+  {
+    modifiedExtentValid = (modifiedExtent[0] <= modifiedExtent[1] && modifiedExtent[2] <= modifiedExtent[3] && modifiedExtent[4] <= modifiedExtent[5]);
+    if (!modifiedExtentValid)
+    {
+      // Segment is not changed by the effect
+      return;
+    }
+  }
+
+  // Store the modified region in the undo history before the segment is modified
+  int editedExtent[6] = {0,-1,0,-1,0,-1};
+  editedLabelmap->GetExtent(editedExtent);
+  if (!d->SegmentationHistory->SaveModification(selectedSegmentID, editedLabelmap, modifiedExtentValid ? modifiedExtent : editedExtent))
+  {
+    // Earlier modifications cannot be undone consistently if one is missing
+    d->SegmentationHistory->RemoveAllModifications();
+  }
+  d->updateUndoRedoButtonsState();
+
   // Disable modified event so that the consequently emitted MasterRepresentationModified event that causes
   // removal of all other representations in all segments does not get activated. Instead, explicitly create
   // representations for the edited segment that the other segments have.
   segmentationNode->GetSegmentation()->SetMasterRepresentationModifiedEnabled(false);
-  segmentLabelmap->DeepCopy(editedLabelmap);
 
-  // Then shrink the image data extent to only contain the effective data (extent of non-zero voxels)
-  int effectiveExtent[6] = {0,-1,0,-1,0,-1};
-  vtkOrientedImageDataResample::CalculateEffectiveExtent(segmentLabelmap, effectiveExtent);
-
-  vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
-  padder->SetInputData(segmentLabelmap);
-  padder->SetOutputWholeExtent(effectiveExtent);
-  padder->Update();
-  segmentLabelmap->DeepCopy(padder->GetOutput());
-
-  // Re-convert all other representations
-  std::vector<std::string> representationNames;
-  selectedSegment->GetContainedRepresentationNames(representationNames);
-  bool conversionHappened = false;
-  for (std::vector<std::string>::iterator reprIt = representationNames.begin();
-    reprIt != representationNames.end(); ++reprIt)
+  // If only a region was modified and both the segment labelmap and the edited labelmap contain it,
+  // then copy only that region in place
+  int segmentExtent[6] = {0,-1,0,-1,0,-1};
+  segmentLabelmap->GetExtent(segmentExtent);
+  bool modifiedExtentInSegment = modifiedExtentValid;
+  for (int i=0; i<3; ++i)
   {
-    std::string targetRepresentationName = (*reprIt);
-    if (targetRepresentationName.compare(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+    if ( modifiedExtent[2*i] < segmentExtent[2*i] || modifiedExtent[2*i+1] > segmentExtent[2*i+1]
+      || modifiedExtent[2*i] < editedExtent[2*i] || modifiedExtent[2*i+1] > editedExtent[2*i+1] )
     {
-      conversionHappened |= segmentationNode->GetSegmentation()->ConvertSingleSegment(
-        selectedSegmentID, targetRepresentationName );
+      modifiedExtentInSegment = false;
     }
   }
-
-  // Trigger display update
-  vtkMRMLSegmentationDisplayNode* displayNode = vtkMRMLSegmentationDisplayNode::SafeDownCast(segmentationNode->GetDisplayNode());
-  if (displayNode)
+  if ( modifiedExtentInSegment && segmentLabelmap->GetPointData()->GetScalars()
+    && segmentLabelmap->GetScalarType() == editedLabelmap->GetScalarType()
+    && vtkOrientedImageDataResample::DoGeometriesMatch(segmentLabelmap, editedLabelmap) )
   {
-    displayNode->Modified();
+    segmentLabelmap->CopyAndCastFrom(editedLabelmap, modifiedExtent);
+    segmentLabelmap->Modified();
+  }
+  else
+  {
+    // Copy the temporary padded edited labelmap to the segment.
+    // Mask and threshold was already applied on edited labelmap at this point if requested.
+    segmentLabelmap->DeepCopy(editedLabelmap);
+
+    // Then shrink the image data extent to only contain the effective data (extent of non-zero voxels)
+    int effectiveExtent[6] = {0,-1,0,-1,0,-1};
+    vtkOrientedImageDataResample::CalculateEffectiveExtent(segmentLabelmap, effectiveExtent);
+
+    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
+    padder->SetInputData(segmentLabelmap);
+    padder->SetOutputWholeExtent(effectiveExtent);
+    padder->Update();
+    segmentLabelmap->DeepCopy(padder->GetOutput());
   }
 
+  // Re-convert all other representations and update display.
+  // The segment labelmap has the geometry of the edited labelmap, so the modified extent is valid for both
+  d->updateSegmentAfterLabelmapModification(segmentationNode, selectedSegmentID, modifiedExtentValid ? modifiedExtent : NULL);
+
   // Re-enable master representation modified event
   segmentationNode->GetSegmentation()->SetMasterRepresentationModifiedEnabled(true);
+
+  // Let the history detect if the segment is modified by anything other than the editor from now on
+  d->SegmentationHistory->UpdateSegmentModifiedTime(selectedSegmentID);
+}
+
+//-----------------------------------------------------------------------------
+void qMRMLSegmentEditorWidget::undo()
+{
+  Q_D(qMRMLSegmentEditorWidget);
+  d->restoreFromHistory(true);
+}
+
+//-----------------------------------------------------------------------------
+void qMRMLSegmentEditorWidget::redo()
+{
+  Q_D(qMRMLSegmentEditorWidget);
+  d->restoreFromHistory(false);
 }
 
 //---------------------------------------------------------------------------
@@ -133,6 +133,11 @@ public slots:
   /// Called when effect sub-classes emit the signal \sa qSlicerSegmentEditorAbstractEffect::apply()
   void applyChangesToSelectedSegment();
 
+  /// Undo last modification of a segment made in the editor
+  void undo();
+  /// Redo last undone modification of a segment
+  void redo();
+
 protected slots:
   /// Handles changing of current segmentation MRML node
   Q_INVOKABLE void onSegmentationNodeChanged(vtkMRMLNode* node);
@@ -200,27 +200,33 @@ public:
     \param outItkVolume Output ITK image
     \param applyRasToWorldConversion Apply parent linear transform to image
     \param applyRasToLpsConversion Apply RAS (Slicer) to LPS (ITK, DICOM) coordinate frame conversion. True by default
+    \param shareVtkBuffer Make the ITK image use the voxel buffer of the volume instead of a copy. The buffer is kept
+      alive by the ITK image, so it must be treated as read-only by both sides. False by default
     \return Success
   */
-  template<typename T> static bool ConvertVolumeNodeToItkImage(vtkMRMLScalarVolumeNode* inVolumeNode, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToWorldConversion, bool applyRasToLpsConversion=true);
+  template<typename T> static bool ConvertVolumeNodeToItkImage(vtkMRMLScalarVolumeNode* inVolumeNode, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToWorldConversion, bool applyRasToLpsConversion=true, bool shareVtkBuffer=false);
 
   /*!
     Convert oriented image data to ITK image
     \param inImageData Input oriented image data
     \param outItkVolume Output ITK image
     \param applyRasToLpsConversion Apply RAS (Slicer) to LPS (ITK, DICOM) coordinate frame conversion. True by default
+    \param shareVtkBuffer Make the ITK image use the voxel buffer of the image data instead of a copy. The buffer is kept
+      alive by the ITK image, so it must be treated as read-only by both sides. False by default
     \return Success
   */
-  template<typename T> static bool ConvertVtkOrientedImageDataToItkImage(vtkOrientedImageData* inImageData, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToLpsConversion=true);
+  template<typename T> static bool ConvertVtkOrientedImageDataToItkImage(vtkOrientedImageData* inImageData, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToLpsConversion=true, bool shareVtkBuffer=false);
 
   /*!
     Convert ITK image to VTK image data. The image geometry is not considered!
     \param inItkImage Input ITK image
     \param outVtkImageData Output VTK image data
     \param vtkType Data scalar type (i.e VTK_FLOAT)
+    \param shareItkBuffer Make the VTK image data use the pixel buffer of the ITK image instead of a copy. The buffer is
+      kept alive by the VTK image data, so the ITK image must not be modified afterwards. False by default
     \return Success
   */
-  template<typename T> static bool ConvertItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType);
+  template<typename T> static bool ConvertItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType, bool shareItkBuffer=false);
 
   /*!
     Convert ITK image to MRML volume node. Image geometry is transferred.
@@ -228,9 +234,10 @@ public:
     \param outVolumeNode Output MRML scalar volume node
     \param vtkType Data scalar type (i.e VTK_FLOAT)
     \param applyLpsToRasConversion Apply LPS (ITK, DICOM) to RAS (Slicer) coordinate frame conversion. True by default
+    \param shareItkBuffer Make the volume use the pixel buffer of the ITK image instead of a copy. False by default
     \return Success
   */
-  template<typename T> static bool ConvertItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion=true);
+  template<typename T> static bool ConvertItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion=true, bool shareItkBuffer=false);
 
 //ETX
 };
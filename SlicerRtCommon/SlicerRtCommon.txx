@@ -26,14 +26,21 @@
 
 // VTK includes
 #include <vtkSmartPointer.h>
+#include <vtkCallbackCommand.h>
+#include <vtkDataArray.h>
 #include <vtkImageData.h>
 #include <vtkImageExport.h>
 #include <vtkImageThreshold.h>
+#include <vtkPointData.h>
 #include <vtkTransform.h>
 
 // ITK includes
+#include <itkCommand.h>
 #include <itkImageRegionIteratorWithIndex.h>
 
+// STD includes
+#include <cstring>
+
 // Segmentations includes
 #include "vtkOrientedImageData.h"
 
@@ -49,6 +56,44 @@ namespace
     }
     return val < EPSILON;
   }
+
+  /// Called when the ITK pixel container that wraps a VTK scalar array is deleted
+  void ReleaseSharedVtkArray(itk::Object* vtkNotUsed(caller), const itk::EventObject& vtkNotUsed(event), void* clientData)
+  {
+    static_cast<vtkDataArray*>(clientData)->UnRegister(NULL);
+  }
+
+  /// Called when the VTK data array that wraps an ITK pixel container is deleted
+  void ReleaseSharedItkPixelContainer(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid), void* clientData, void* vtkNotUsed(callData))
+  {
+    static_cast<itk::LightObject*>(clientData)->UnRegister();
+  }
+
+  /// Make the ITK image use the scalar buffer of the VTK image data without copying.
+  /// The VTK scalar array is kept alive until the pixel container of the ITK image is deleted.
+  /// Requires the regions of the ITK image to be set and to match the extent of the VTK image.
+  template<typename T> bool ShareVtkScalarsWithItkImage(vtkImageData* inImageData, typename itk::Image<T, 3>::Pointer outItkImage)
+  {
+    vtkDataArray* scalars = inImageData->GetPointData()->GetScalars();
+    if ( scalars == NULL || scalars->GetNumberOfComponents() != 1 || scalars->GetDataTypeSize() != (int)sizeof(T)
+      || scalars->GetNumberOfTuples() != (vtkIdType)outItkImage->GetLargestPossibleRegion().GetNumberOfPixels() )
+    {
+      return false;
+    }
+
+    typedef typename itk::Image<T, 3>::PixelContainer PixelContainerType;
+    typename PixelContainerType::Pointer pixelContainer = PixelContainerType::New();
+    pixelContainer->SetImportPointer(static_cast<T*>(scalars->GetVoidPointer(0)), scalars->GetNumberOfTuples(), false);
+
+    scalars->Register(NULL);
+    itk::CStyleCommand::Pointer releaseCommand = itk::CStyleCommand::New();
+    releaseCommand->SetClientData(scalars);
+    releaseCommand->SetCallback(ReleaseSharedVtkArray);
+    pixelContainer->AddObserver(itk::DeleteEvent(), releaseCommand);
+
+    outItkImage->SetPixelContainer(pixelContainer);
+    return true;
+  }
 }
 
 //---------------------------------------------------------------------------
@@ -60,7 +105,7 @@ template<typename T> bool SlicerRtCommon::IsEqual( const vtkVector3<T>& lhs, con
 }
 
 //----------------------------------------------------------------------------
-template<typename T> bool SlicerRtCommon::ConvertVolumeNodeToItkImage(vtkMRMLScalarVolumeNode* inVolumeNode, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToWorldConversion, bool applyRasToLpsConversion/*=true*/)
+template<typename T> bool SlicerRtCommon::ConvertVolumeNodeToItkImage(vtkMRMLScalarVolumeNode* inVolumeNode, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToWorldConversion, bool applyRasToLpsConversion/*=true*/, bool shareVtkBuffer/*=false*/)
 {
   if ( inVolumeNode == NULL )
   {
@@ -84,11 +129,6 @@ template<typename T> bool SlicerRtCommon::ConvertVolumeNodeToItkImage(vtkMRMLSca
     return false; 
   }
 
-  // Convert vtkImageData to itkImage 
-  vtkSmartPointer<vtkImageExport> imageExport = vtkSmartPointer<vtkImageExport>::New(); 
-  imageExport->SetInputData(inVolume);
-  imageExport->Update(); 
-
   // Determine input volume to world transform
   vtkSmartPointer<vtkMatrix4x4> rasToWorldTransformMatrix=vtkSmartPointer<vtkMatrix4x4>::New();
   vtkMRMLTransformNode* inTransformNode=inVolumeNode->GetParentTransformNode();
@@ -185,6 +225,12 @@ template<typename T> bool SlicerRtCommon::ConvertVolumeNodeToItkImage(vtkMRMLSca
   region.SetIndex(start);
   outItkImage->SetRegions(region);
 
+  // Use the VTK scalar buffer directly if requested, otherwise copy the voxels
+  if (shareVtkBuffer && ShareVtkScalarsWithItkImage<T>(inVolume, outItkImage))
+  {
+    return true;
+  }
+
   // Create and export ITK image
   try
   {
@@ -196,13 +242,16 @@ template<typename T> bool SlicerRtCommon::ConvertVolumeNodeToItkImage(vtkMRMLSca
     return false;
   }
 
+  vtkSmartPointer<vtkImageExport> imageExport = vtkSmartPointer<vtkImageExport>::New(); 
+  imageExport->SetInputData(inVolume);
+  imageExport->Update(); 
   imageExport->Export( outItkImage->GetBufferPointer() );
 
   return true;
 }
 
 //----------------------------------------------------------------------------
-template<typename T> bool SlicerRtCommon::ConvertVtkOrientedImageDataToItkImage(vtkOrientedImageData* inImageData, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToLpsConversion/*=true*/)
+template<typename T> bool SlicerRtCommon::ConvertVtkOrientedImageDataToItkImage(vtkOrientedImageData* inImageData, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToLpsConversion/*=true*/, bool shareVtkBuffer/*=false*/)
 {
   if ( inImageData == NULL )
   {
@@ -220,11 +269,6 @@ template<typename T> bool SlicerRtCommon::ConvertVtkOrientedImageDataToItkImage(
     return false; 
   }
 
-  // Convert vtkOrientedImageData to itkImage 
-  vtkSmartPointer<vtkImageExport> imageExport = vtkSmartPointer<vtkImageExport>::New(); 
-  imageExport->SetInputData(inImageData);
-  imageExport->Update(); 
-
   // Determine input image to world transform
   vtkSmartPointer<vtkMatrix4x4> inImageToWorldRasMatrix=vtkSmartPointer<vtkMatrix4x4>::New();
   inImageData->GetImageToWorldMatrix(inImageToWorldRasMatrix);
@@ -307,6 +351,12 @@ template<typename T> bool SlicerRtCommon::ConvertVtkOrientedImageDataToItkImage(
   region.SetIndex(start);
   outItkImage->SetRegions(region);
 
+  // Use the VTK scalar buffer directly if requested, otherwise copy the voxels
+  if (shareVtkBuffer && ShareVtkScalarsWithItkImage<T>(inImageData, outItkImage))
+  {
+    return true;
+  }
+
   // Create and export ITK image
   try
   {
@@ -318,13 +368,16 @@ template<typename T> bool SlicerRtCommon::ConvertVtkOrientedImageDataToItkImage(
     return false;
   }
 
+  vtkSmartPointer<vtkImageExport> imageExport = vtkSmartPointer<vtkImageExport>::New(); 
+  imageExport->SetInputData(inImageData);
+  imageExport->Update(); 
   imageExport->Export( outItkImage->GetBufferPointer() );
 
   return true;
 }
 
 //----------------------------------------------------------------------------
-template<typename T> bool SlicerRtCommon::ConvertItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType)
+template<typename T> bool SlicerRtCommon::ConvertItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType, bool shareItkBuffer/*=false*/)
 {
   if ( outVtkImageData == NULL )
   {
@@ -340,25 +393,44 @@ template<typename T> bool SlicerRtCommon::ConvertItkImageToVtkImageData(typename
 
   typename itk::Image<T, 3>::RegionType region = inItkImage->GetBufferedRegion();
   typename itk::Image<T, 3>::SizeType imageSize = region.GetSize();
+  vtkIdType numberOfVoxels = (vtkIdType)region.GetNumberOfPixels();
   int extent[6]={0, (int) imageSize[0]-1, 0, (int) imageSize[1]-1, 0, (int) imageSize[2]-1};
-  outVtkImageData->SetExtent(extent);
-  outVtkImageData->AllocateScalars(vtkType, 1);
 
-  T* outVtkImageDataPtr = (T*)outVtkImageData->GetScalarPointer();
-  typename itk::ImageRegionIteratorWithIndex< itk::Image<T, 3> > itInItkImage(
-    inItkImage, inItkImage->GetLargestPossibleRegion() );
-  for ( itInItkImage.GoToBegin(); !itInItkImage.IsAtEnd(); ++itInItkImage )
+  vtkSmartPointer<vtkDataArray> scalars = vtkSmartPointer<vtkDataArray>::Take(vtkDataArray::CreateDataArray(vtkType));
+  if (scalars.GetPointer() == NULL || scalars->GetDataTypeSize() != (int)sizeof(T))
   {
-    typename itk::Image<T, 3>::IndexType i = itInItkImage.GetIndex();
-    (*outVtkImageDataPtr) = inItkImage->GetPixel(i);
-    outVtkImageDataPtr++;
+    vtkErrorWithObjectMacro(outVtkImageData, "ConvertItkImageToVtkImageData: Requested VTK type has a different scalar size than the input ITK image!");
+    return false; 
   }
 
+  // The buffered region of the ITK image is contiguous and has the same x-fastest layout as VTK, so it can be
+  // either shared with the VTK image data or copied in one block
+  if (shareItkBuffer)
+  {
+    // The pixel container is kept alive until the VTK scalar array is deleted
+    itk::LightObject* pixelContainer = inItkImage->GetPixelContainer();
+    pixelContainer->Register();
+    scalars->SetVoidArray(inItkImage->GetBufferPointer(), numberOfVoxels, 1);
+
+    vtkSmartPointer<vtkCallbackCommand> releaseCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    releaseCallback->SetClientData(pixelContainer);
+    releaseCallback->SetCallback(ReleaseSharedItkPixelContainer);
+    scalars->AddObserver(vtkCommand::DeleteEvent, releaseCallback);
+  }
+  else
+  {
+    scalars->SetNumberOfTuples(numberOfVoxels);
+    memcpy(scalars->GetVoidPointer(0), inItkImage->GetBufferPointer(), numberOfVoxels * sizeof(T));
+  }
+
+  outVtkImageData->SetExtent(extent);
+  outVtkImageData->GetPointData()->SetScalars(scalars);
+
   return true;
 }
 
 //----------------------------------------------------------------------------
-template<typename T> bool SlicerRtCommon::ConvertItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion/*=true*/)
+template<typename T> bool SlicerRtCommon::ConvertItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion/*=true*/, bool shareItkBuffer/*=false*/)
 {
   if (outVolumeNode == NULL)
   {
@@ -398,7 +470,7 @@ template<typename T> bool SlicerRtCommon::ConvertItkImageToVolumeNode(typename i
   }
   
   // Convert ITK image to the VTK image data member of the output volume node
-  if (!SlicerRtCommon::ConvertItkImageToVtkImageData<T>(inItkImage, outImageData, vtkType))
+  if (!SlicerRtCommon::ConvertItkImageToVtkImageData<T>(inItkImage, outImageData, vtkType, shareItkBuffer))
   {
     vtkErrorWithObjectMacro(outVolumeNode, "ConvertItkImageToVolumeNode: Failed to convert ITK image to VTK image data");
     return false; 
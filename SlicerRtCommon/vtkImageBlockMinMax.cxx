@@ -0,0 +1,371 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkImageBlockMinMax.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkInformation.h>
+#include <vtkInformationObjectBaseKey.h>
+#include <vtkMultiThreader.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkImageBlockMinMax);
+vtkInformationKeyMacro(vtkImageBlockMinMax, BLOCK_MIN_MAX, ObjectBase);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Data shared by the threads computing the block index
+  struct BlockMinMaxThreadData
+  {
+    void* ScalarPointer;
+    int ScalarType;
+    vtkIdType Increments[3];
+    int Extent[6];
+    int BlockSize;
+    int BlockDimensions[3];
+    double* BlockMinimums;
+    double* BlockMaximums;
+  };
+
+  /// Compute minimum and maximum in all blocks of a slab of blocks (blocks with the same K block coordinate).
+  /// The blocks of a slab are only written by the thread processing the slab, so no locking is needed.
+  template <class T>
+  void ComputeBlockMinMaxForSlab(T* scalarPointer, BlockMinMaxThreadData* data, int blockK)
+  {
+    const int blockSize = data->BlockSize;
+    const int* blockDimensions = data->BlockDimensions;
+    int dimensions[3] = { data->Extent[1]-data->Extent[0]+1, data->Extent[3]-data->Extent[2]+1, data->Extent[5]-data->Extent[4]+1 };
+
+    std::vector<double> rowMinimums(blockDimensions[0], 0.0);
+    std::vector<double> rowMaximums(blockDimensions[0], 0.0);
+
+    int firstK = blockK * blockSize;
+    int lastK = std::min(firstK + blockSize, dimensions[2]-1);
+    for (int k=firstK; k<=lastK; ++k)
+    {
+      for (int j=0; j<dimensions[1]; ++j)
+      {
+        T* rowPointer = scalarPointer + k*data->Increments[2] + j*data->Increments[1];
+
+        // Row range in each block along I
+        for (int blockI=0; blockI<blockDimensions[0]; ++blockI)
+        {
+          int firstI = blockI * blockSize;
+          int lastI = std::min(firstI + blockSize, dimensions[0]-1);
+          T* voxelPointer = rowPointer + firstI*data->Increments[0];
+          T minimum = (*voxelPointer);
+          T maximum = (*voxelPointer);
+          for (int i=firstI+1; i<=lastI; ++i)
+          {
+            voxelPointer += data->Increments[0];
+            if ((*voxelPointer) < minimum)
+            {
+              minimum = (*voxelPointer);
+            }
+            else if ((*voxelPointer) > maximum)
+            {
+              maximum = (*voxelPointer);
+            }
+          }
+          rowMinimums[blockI] = static_cast<double>(minimum);
+          rowMaximums[blockI] = static_cast<double>(maximum);
+        }
+
+        // A row belongs to block j/blockSize, and also to the previous block if it is the overlapping voxel layer
+        int blockJ = j / blockSize;
+        int previousBlockJ = ((j % blockSize) == 0 && blockJ > 0) ? blockJ-1 : -1;
+        for (int currentBlockJ = previousBlockJ; currentBlockJ <= blockJ; ++currentBlockJ)
+        {
+          if (currentBlockJ < 0 || currentBlockJ >= blockDimensions[1])
+          {
+            continue;
+          }
+          int blockIndex = blockDimensions[0] * (currentBlockJ + blockDimensions[1] * blockK);
+          for (int blockI=0; blockI<blockDimensions[0]; ++blockI, ++blockIndex)
+          {
+            data->BlockMinimums[blockIndex] = std::min(data->BlockMinimums[blockIndex], rowMinimums[blockI]);
+            data->BlockMaximums[blockIndex] = std::max(data->BlockMaximums[blockIndex], rowMaximums[blockI]);
+          }
+        }
+      }
+    }
+  }
+
+  /// Thread function computing the block index for every N-th slab of blocks
+  VTK_THREAD_RETURN_TYPE BlockMinMaxThreadFunction(void* arg)
+  {
+    vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+    BlockMinMaxThreadData* data = static_cast<BlockMinMaxThreadData*>(threadInfo->UserData);
+
+    for (int blockK=threadInfo->ThreadID; blockK<data->BlockDimensions[2]; blockK+=threadInfo->NumberOfThreads)
+    {
+      switch (data->ScalarType)
+      {
+        vtkTemplateMacro(ComputeBlockMinMaxForSlab(static_cast<VTK_TT*>(data->ScalarPointer), data, blockK));
+      }
+    }
+
+    return VTK_THREAD_RETURN_VALUE;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkImageBlockMinMax::vtkImageBlockMinMax()
+{
+  this->BlockSize = 8;
+  this->BlockDimensions[0] = this->BlockDimensions[1] = this->BlockDimensions[2] = 0;
+  this->ImageExtent[0] = this->ImageExtent[2] = this->ImageExtent[4] = 0;
+  this->ImageExtent[1] = this->ImageExtent[3] = this->ImageExtent[5] = -1;
+  this->ScalarRange[0] = this->ScalarRange[1] = 0.0;
+  this->BuiltImageData = NULL;
+}
+
+//----------------------------------------------------------------------------
+vtkImageBlockMinMax::~vtkImageBlockMinMax()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkImageBlockMinMax::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "BlockSize: " << this->BlockSize << "\n";
+  os << indent << "BlockDimensions: " << this->BlockDimensions[0] << ", " << this->BlockDimensions[1] << ", " << this->BlockDimensions[2] << "\n";
+  os << indent << "ImageExtent: " << this->ImageExtent[0] << ", " << this->ImageExtent[1] << ", " << this->ImageExtent[2]
+    << ", " << this->ImageExtent[3] << ", " << this->ImageExtent[4] << ", " << this->ImageExtent[5] << "\n";
+  os << indent << "ScalarRange: " << this->ScalarRange[0] << ", " << this->ScalarRange[1] << "\n";
+}
+
+//----------------------------------------------------------------------------
+vtkImageBlockMinMax* vtkImageBlockMinMax::GetBlockMinMaxForImage(vtkImageData* imageData)
+{
+  if (!imageData || !imageData->GetPointData() || !imageData->GetPointData()->GetScalars())
+  {
+    return NULL;
+  }
+
+  vtkImageBlockMinMax* blockMinMax = vtkImageBlockMinMax::SafeDownCast(
+    imageData->GetInformation()->Get(vtkImageBlockMinMax::BLOCK_MIN_MAX()) );
+  if (!blockMinMax)
+  {
+    // The information object holds the only reference, so the index is deleted together with the image
+    vtkSmartPointer<vtkImageBlockMinMax> newBlockMinMax = vtkSmartPointer<vtkImageBlockMinMax>::New();
+    imageData->GetInformation()->Set(vtkImageBlockMinMax::BLOCK_MIN_MAX(), newBlockMinMax);
+    blockMinMax = newBlockMinMax.GetPointer();
+  }
+
+  if (!blockMinMax->IsUpToDate(imageData))
+  {
+    if (!blockMinMax->Build(imageData))
+    {
+      vtkImageBlockMinMax::RemoveBlockMinMaxFromImage(imageData);
+      return NULL;
+    }
+  }
+
+  return blockMinMax;
+}
+
+//----------------------------------------------------------------------------
+void vtkImageBlockMinMax::RemoveBlockMinMaxFromImage(vtkImageData* imageData)
+{
+  if (!imageData)
+  {
+    return;
+  }
+  imageData->GetInformation()->Remove(vtkImageBlockMinMax::BLOCK_MIN_MAX());
+}
+
+//----------------------------------------------------------------------------
+bool vtkImageBlockMinMax::Build(vtkImageData* imageData)
+{
+  this->BuiltImageData = NULL;
+  this->BlockMinimums.clear();
+  this->BlockMaximums.clear();
+  this->BlockDimensions[0] = this->BlockDimensions[1] = this->BlockDimensions[2] = 0;
+
+  if (!imageData || !imageData->GetPointData() || !imageData->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("Build: Invalid input image data!");
+    return false;
+  }
+
+  int extent[6] = {0,-1,0,-1,0,-1};
+  imageData->GetExtent(extent);
+  if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    vtkErrorMacro("Build: Input image data is empty!");
+    return false;
+  }
+
+  // Blocks are defined on the cells, so that each cell is fully contained by a block
+  int numberOfBlocks = 1;
+  for (int axis=0; axis<3; ++axis)
+  {
+    this->ImageExtent[2*axis] = extent[2*axis];
+    this->ImageExtent[2*axis+1] = extent[2*axis+1];
+    int numberOfCells = extent[2*axis+1] - extent[2*axis];
+    this->BlockDimensions[axis] = std::max(1, (numberOfCells + this->BlockSize - 1) / this->BlockSize);
+    numberOfBlocks *= this->BlockDimensions[axis];
+  }
+  this->BlockMinimums.resize(numberOfBlocks, VTK_DOUBLE_MAX);
+  this->BlockMaximums.resize(numberOfBlocks, VTK_DOUBLE_MIN);
+
+  BlockMinMaxThreadData data;
+  data.ScalarPointer = imageData->GetScalarPointerForExtent(extent);
+  data.ScalarType = imageData->GetScalarType();
+  imageData->GetIncrements(data.Increments);
+  std::copy(extent, extent+6, data.Extent);
+  data.BlockSize = this->BlockSize;
+  std::copy(this->BlockDimensions, this->BlockDimensions+3, data.BlockDimensions);
+  data.BlockMinimums = &(this->BlockMinimums[0]);
+  data.BlockMaximums = &(this->BlockMaximums[0]);
+
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(std::min(vtkMultiThreader::GetGlobalDefaultNumberOfThreads(), this->BlockDimensions[2]));
+  threader->SetSingleMethod(BlockMinMaxThreadFunction, &data);
+  threader->SingleMethodExecute();
+
+  // Global range is derived from the block ranges
+  this->ScalarRange[0] = *std::min_element(this->BlockMinimums.begin(), this->BlockMinimums.end());
+  this->ScalarRange[1] = *std::max_element(this->BlockMaximums.begin(), this->BlockMaximums.end());
+
+  this->BuiltImageData = imageData;
+  this->BuildTime.Modified();
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkImageBlockMinMax::IsUpToDate(vtkImageData* imageData)
+{
+  if (!imageData || imageData != this->BuiltImageData)
+  {
+    return false;
+  }
+  if (imageData->GetMTime() > this->BuildTime.GetMTime())
+  {
+    return false;
+  }
+
+  int extent[6] = {0,-1,0,-1,0,-1};
+  imageData->GetExtent(extent);
+  return std::equal(extent, extent+6, this->ImageExtent);
+}
+
+//----------------------------------------------------------------------------
+void vtkImageBlockMinMax::GetScalarRange(double range[2])
+{
+  range[0] = this->ScalarRange[0];
+  range[1] = this->ScalarRange[1];
+}
+
+//----------------------------------------------------------------------------
+int vtkImageBlockMinMax::GetNumberOfBlocks()
+{
+  return static_cast<int>(this->BlockMinimums.size());
+}
+
+//----------------------------------------------------------------------------
+void vtkImageBlockMinMax::GetBlockExtent(int blockI, int blockJ, int blockK, int extent[6])
+{
+  int blockCoordinates[3] = {blockI, blockJ, blockK};
+  for (int axis=0; axis<3; ++axis)
+  {
+    extent[2*axis] = this->ImageExtent[2*axis] + blockCoordinates[axis] * this->BlockSize;
+    extent[2*axis+1] = std::min(extent[2*axis] + this->BlockSize, this->ImageExtent[2*axis+1]);
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkImageBlockMinMax::BlockMayContainRange(int blockI, int blockJ, int blockK, double minValue, double maxValue)
+{
+  if ( blockI < 0 || blockI >= this->BlockDimensions[0]
+    || blockJ < 0 || blockJ >= this->BlockDimensions[1]
+    || blockK < 0 || blockK >= this->BlockDimensions[2] )
+  {
+    return false;
+  }
+
+  int blockIndex = this->GetBlockIndex(blockI, blockJ, blockK);
+  return this->BlockMinimums[blockIndex] <= maxValue && this->BlockMaximums[blockIndex] >= minValue;
+}
+
+//----------------------------------------------------------------------------
+int vtkImageBlockMinMax::GetNumberOfBlocksContainingRange(double minValue, double maxValue)
+{
+  int numberOfBlocks = 0;
+  for (int blockIndex=0; blockIndex<this->GetNumberOfBlocks(); ++blockIndex)
+  {
+    if (this->BlockMinimums[blockIndex] <= maxValue && this->BlockMaximums[blockIndex] >= minValue)
+    {
+      ++numberOfBlocks;
+    }
+  }
+  return numberOfBlocks;
+}
+
+//----------------------------------------------------------------------------
+bool vtkImageBlockMinMax::GetExtentContainingRange(double minValue, double maxValue, int extent[6])
+{
+  extent[0] = extent[2] = extent[4] = VTK_INT_MAX;
+  extent[1] = extent[3] = extent[5] = VTK_INT_MIN;
+
+  bool found = false;
+  int blockIndex = 0;
+  for (int blockK=0; blockK<this->BlockDimensions[2]; ++blockK)
+  {
+    for (int blockJ=0; blockJ<this->BlockDimensions[1]; ++blockJ)
+    {
+      for (int blockI=0; blockI<this->BlockDimensions[0]; ++blockI, ++blockIndex)
+      {
+        if (this->BlockMinimums[blockIndex] > maxValue || this->BlockMaximums[blockIndex] < minValue)
+        {
+          continue;
+        }
+        found = true;
+        int blockExtent[6] = {0,-1,0,-1,0,-1};
+        this->GetBlockExtent(blockI, blockJ, blockK, blockExtent);
+        for (int axis=0; axis<3; ++axis)
+        {
+          extent[2*axis] = std::min(extent[2*axis], blockExtent[2*axis]);
+          extent[2*axis+1] = std::max(extent[2*axis+1], blockExtent[2*axis+1]);
+        }
+      }
+    }
+  }
+
+  if (!found)
+  {
+    extent[0] = extent[2] = extent[4] = 0;
+    extent[1] = extent[3] = extent[5] = -1;
+  }
+  return found;
+}
@@ -0,0 +1,150 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkImageBlockMinMax - Per-block scalar range index ("span space") of an image
+// .SECTION Description
+// The image is divided into cubic blocks and the minimum and maximum scalar value
+// is stored for each block. Algorithms looking for voxels within a value range
+// (isodose contouring, thresholding, histogram range) can skip the blocks that
+// cannot contain the requested value.
+//
+// Neighboring blocks overlap by one voxel, so that every cell (2x2x2 voxel cube)
+// of the image is fully contained by at least one block. This way the index can
+// also be used to restrict contouring algorithms (e.g. marching cubes) to the
+// relevant region without missing any iso-surface crossings.
+
+#ifndef __vtkImageBlockMinMax_h
+#define __vtkImageBlockMinMax_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkTimeStamp.h>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+class vtkImageData;
+class vtkInformationObjectBaseKey;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+class VTK_SLICERRTCOMMON_EXPORT vtkImageBlockMinMax : public vtkObject
+{
+public:
+  static vtkImageBlockMinMax *New();
+  vtkTypeMacro(vtkImageBlockMinMax, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Information key used to attach the block index to the image data it was built from
+  static vtkInformationObjectBaseKey* BLOCK_MIN_MAX();
+
+  /// Get block index attached to an image data. If there is no index attached to the image
+  /// yet then it is created and attached. If the image has been modified since the index
+  /// was built then the index is rebuilt.
+  /// \return Up-to-date block index of the image, NULL if the image is invalid
+  static vtkImageBlockMinMax* GetBlockMinMaxForImage(vtkImageData* imageData);
+
+  /// Remove block index from image data (if any)
+  static void RemoveBlockMinMaxFromImage(vtkImageData* imageData);
+
+public:
+  /// Compute block minimums and maximums from the first scalar component of the image
+  /// \return Success
+  bool Build(vtkImageData* imageData);
+
+  /// Determine if the index has been built from the given image and the image
+  /// has not been modified since
+  bool IsUpToDate(vtkImageData* imageData);
+
+  /// Get range of all the scalar values in the image (the exact range, not an estimate)
+  void GetScalarRange(double range[2]);
+
+  /// Get number of blocks in the index
+  int GetNumberOfBlocks();
+
+  /// Get voxel extent of a block (including the overlapping voxel layer)
+  void GetBlockExtent(int blockI, int blockJ, int blockK, int extent[6]);
+
+  /// Determine if a block may contain values in the [minValue,maxValue] range
+  bool BlockMayContainRange(int blockI, int blockJ, int blockK, double minValue, double maxValue);
+
+  /// Get number of blocks that may contain values in the [minValue,maxValue] range
+  int GetNumberOfBlocksContainingRange(double minValue, double maxValue);
+
+  /// Get the smallest voxel extent that contains all the blocks that may contain values
+  /// in the [minValue,maxValue] range.
+  /// \return False if there are no such blocks (output extent is set to be empty), true otherwise
+  bool GetExtentContainingRange(double minValue, double maxValue, int extent[6]);
+
+public:
+  /// Edge length of a block in voxels. Changing it requires rebuilding the index
+  vtkGetMacro(BlockSize, int);
+  vtkSetClampMacro(BlockSize, int, 2, VTK_INT_MAX);
+
+  /// Number of blocks along each axis
+  vtkGetVector3Macro(BlockDimensions, int);
+
+  /// Extent of the image the index was built from
+  vtkGetVector6Macro(ImageExtent, int);
+
+protected:
+  /// Get linear index of a block from its block coordinates
+  int GetBlockIndex(int blockI, int blockJ, int blockK)
+  {
+    return blockI + this->BlockDimensions[0] * (blockJ + this->BlockDimensions[1] * blockK);
+  };
+
+protected:
+  /// Edge length of a block in voxels (without the overlap)
+  int BlockSize;
+
+  /// Number of blocks along each axis
+  int BlockDimensions[3];
+
+  /// Extent of the image the index was built from
+  int ImageExtent[6];
+
+  /// Minimum scalar value in each block
+  std::vector<double> BlockMinimums;
+
+  /// Maximum scalar value in each block
+  std::vector<double> BlockMaximums;
+
+  /// Range of all the scalar values in the image
+  double ScalarRange[2];
+
+  /// Image the index was built from. Not reference counted, because the index is
+  /// typically attached to the image itself (\sa BLOCK_MIN_MAX)
+  vtkImageData* BuiltImageData;
+
+  /// Time of the last build
+  vtkTimeStamp BuildTime;
+
+protected:
+  vtkImageBlockMinMax();
+  virtual ~vtkImageBlockMinMax();
+
+private:
+  vtkImageBlockMinMax(const vtkImageBlockMinMax&); // Not implemented
+  void operator=(const vtkImageBlockMinMax&);               // Not implemented
+};
+
+#endif
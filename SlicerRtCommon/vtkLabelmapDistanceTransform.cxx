@@ -0,0 +1,222 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkLabelmapDistanceTransform.h"
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLabelmapDistanceTransform);
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Data shared by the threads computing one pass of the distance transform
+  struct DistanceTransformThreadData
+  {
+    float* SquaredDistances;
+    int Dimensions[3];
+    /// Positions of the voxels along each axis
+    const double* Positions[3];
+    /// Axis of the lines processed in the pass
+    int Axis;
+  };
+
+  /// Working buffers of the one-dimensional transform, allocated once per thread
+  struct DistanceTransformLineBuffers
+  {
+    /// Input values of the line
+    std::vector<double> Values;
+    /// Positions of the parabolas in the lower envelope
+    std::vector<int> Vertices;
+    /// Left boundaries of the parabolas in the lower envelope
+    std::vector<double> Boundaries;
+  };
+
+  /// One-dimensional squared distance transform of a line, in place:
+  /// d(p) = min_q ( (position(p)-position(q))^2 + f(q) )
+  /// Samples with infinite value are not added to the lower envelope, so they never produce invalid arithmetic.
+  void ComputeSquaredDistancesForLine(float* line, vtkIdType stride, int numberOfSamples, const double* positions,
+    DistanceTransformLineBuffers& buffers)
+  {
+    const float infinity = vtkLabelmapDistanceTransform::GetInfiniteSquaredDistance();
+    double* values = &(buffers.Values[0]);
+    int* vertices = &(buffers.Vertices[0]);
+    double* boundaries = &(buffers.Boundaries[0]);
+
+    // Build lower envelope of the parabolas rooted at the finite samples
+    int k = -1;
+    for (int q=0; q<numberOfSamples; ++q)
+    {
+      float value = line[q*stride];
+      values[q] = value;
+      if (value >= infinity)
+      {
+        continue;
+      }
+      double positionQ = positions[q];
+      double heightQ = value + positionQ*positionQ;
+      double intersection = -VTK_DOUBLE_MAX;
+      while (k >= 0)
+      {
+        double positionV = positions[vertices[k]];
+        intersection = (heightQ - (values[vertices[k]] + positionV*positionV)) / (2.0 * (positionQ - positionV));
+        if (intersection > boundaries[k])
+        {
+          break;
+        }
+        --k;
+      }
+      ++k;
+      vertices[k] = q;
+      boundaries[k] = (k == 0 ? -VTK_DOUBLE_MAX : intersection);
+    }
+    if (k < 0)
+    {
+      // No finite samples in the line, all values remain infinite
+      return;
+    }
+
+    // Evaluate the lower envelope
+    int numberOfParabolas = k + 1;
+    int j = 0;
+    for (int p=0; p<numberOfSamples; ++p)
+    {
+      double positionP = positions[p];
+      while (j+1 < numberOfParabolas && boundaries[j+1] < positionP)
+      {
+        ++j;
+      }
+      double offset = positionP - positions[vertices[j]];
+      line[p*stride] = static_cast<float>(offset*offset + values[vertices[j]]);
+    }
+  }
+
+  /// Thread function computing one pass of the transform. Lines along the pass axis are grouped in slices,
+  /// and each thread processes every N-th slice. Lines along the third axis are grouped by the second index.
+  VTK_THREAD_RETURN_TYPE DistanceTransformThreadFunction(void* arg)
+  {
+    vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+    DistanceTransformThreadData* data = static_cast<DistanceTransformThreadData*>(threadInfo->UserData);
+
+    const int* dimensions = data->Dimensions;
+    vtkIdType increments[3] = { 1, dimensions[0], (vtkIdType)dimensions[0]*dimensions[1] };
+    int axis = data->Axis;
+    int sliceAxis = (axis == 2 ? 1 : 2);
+    int rowAxis = (axis == 0 ? 1 : 0);
+
+    DistanceTransformLineBuffers buffers;
+    buffers.Values.resize(dimensions[axis]);
+    buffers.Vertices.resize(dimensions[axis]);
+    buffers.Boundaries.resize(dimensions[axis]);
+
+    for (int slice=threadInfo->ThreadID; slice<dimensions[sliceAxis]; slice+=threadInfo->NumberOfThreads)
+    {
+      for (int row=0; row<dimensions[rowAxis]; ++row)
+      {
+        float* line = data->SquaredDistances + slice*increments[sliceAxis] + row*increments[rowAxis];
+        ComputeSquaredDistancesForLine(line, increments[axis], dimensions[axis], data->Positions[axis], buffers);
+      }
+    }
+
+    return VTK_THREAD_RETURN_VALUE;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapDistanceTransform::vtkLabelmapDistanceTransform()
+{
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapDistanceTransform::~vtkLabelmapDistanceTransform()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapDistanceTransform::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapDistanceTransform::ComputeSquaredDistances(const unsigned char* featureMask, const int dimensions[3],
+  const double spacing[3], float* squaredDistances, int numberOfThreads/*=0*/)
+{
+  if (dimensions[0] <= 0 || dimensions[1] <= 0 || dimensions[2] <= 0)
+  {
+    return;
+  }
+
+  std::vector<double> axisPositions[3];
+  const double* positions[3] = {NULL, NULL, NULL};
+  for (int axis=0; axis<3; ++axis)
+  {
+    axisPositions[axis].resize(dimensions[axis]);
+    for (int index=0; index<dimensions[axis]; ++index)
+    {
+      axisPositions[axis][index] = index * spacing[axis];
+    }
+    positions[axis] = &(axisPositions[axis][0]);
+  }
+  vtkLabelmapDistanceTransform::ComputeSquaredDistancesAtPositions(featureMask, dimensions, positions, squaredDistances, numberOfThreads);
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapDistanceTransform::ComputeSquaredDistancesAtPositions(const unsigned char* featureMask, const int dimensions[3],
+  const double* const positions[3], float* squaredDistances, int numberOfThreads/*=0*/)
+{
+  if (!featureMask || !squaredDistances || dimensions[0] <= 0 || dimensions[1] <= 0 || dimensions[2] <= 0)
+  {
+    return;
+  }
+
+  vtkIdType numberOfVoxels = (vtkIdType)dimensions[0] * dimensions[1] * dimensions[2];
+  const float infinity = vtkLabelmapDistanceTransform::GetInfiniteSquaredDistance();
+  for (vtkIdType voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+  {
+    squaredDistances[voxelIndex] = (featureMask[voxelIndex] ? 0.0f : infinity);
+  }
+
+  DistanceTransformThreadData data;
+  data.SquaredDistances = squaredDistances;
+  std::copy(dimensions, dimensions+3, data.Dimensions);
+  std::copy(positions, positions+3, data.Positions);
+
+  if (numberOfThreads <= 0)
+  {
+    numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  }
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  for (int axis=0; axis<3; ++axis)
+  {
+    data.Axis = axis;
+    threader->SetNumberOfThreads(std::max(1, std::min(numberOfThreads, dimensions[axis == 2 ? 1 : 2])));
+    threader->SetSingleMethod(DistanceTransformThreadFunction, &data);
+    threader->SingleMethodExecute();
+  }
+}
@@ -0,0 +1,80 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkLabelmapDistanceTransform - Exact Euclidean distance transform of binary masks
+// .SECTION Description
+// Computes the squared Euclidean distance of every voxel of a grid to the nearest feature voxel
+// using the separable algorithm of Felzenszwalb and Huttenlocher (lower envelope of parabolas).
+// The one-dimensional transform is applied along each axis in a separate pass, so the cost is
+// linear in the number of voxels and does not depend on the distances. The lines of a pass are
+// independent of each other, so they are distributed between threads.
+//
+// The spacing can be different along each axis. Besides physical voxel spacing this allows computing
+// distances scaled differently per axis (e.g. spacing divided by per-axis margin gives a distance that
+// is at most 1 within an ellipsoidal margin).
+//
+// The voxels can also be at arbitrary increasing positions along each axis. This allows leaving out
+// ranges of voxels that are not needed, such as the empty space between two distant segments.
+
+#ifndef __vtkLabelmapDistanceTransform_h
+#define __vtkLabelmapDistanceTransform_h
+
+// VTK includes
+#include <vtkObject.h>
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+/// \ingroup SlicerRt_SlicerRtCommon
+class VTK_SLICERRTCOMMON_EXPORT vtkLabelmapDistanceTransform : public vtkObject
+{
+public:
+  static vtkLabelmapDistanceTransform *New();
+  vtkTypeMacro(vtkLabelmapDistanceTransform, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Squared distance assigned to the voxels if there are no feature voxels in the grid
+  static float GetInfiniteSquaredDistance() { return VTK_FLOAT_MAX; };
+
+  /// Compute squared distance of each voxel to the nearest feature voxel
+  /// \param featureMask Voxels of the grid (first index changes fastest), non-zero voxels are the features
+  /// \param dimensions Number of voxels along each axis of the grid
+  /// \param spacing Distance between neighboring voxels along each axis
+  /// \param squaredDistances Output squared distances, same number of elements as the grid. Feature voxels
+  ///   get zero, all voxels get \sa GetInfiniteSquaredDistance if there are no feature voxels.
+  /// \param numberOfThreads Number of threads to use, the global default number of threads if zero
+  static void ComputeSquaredDistances(const unsigned char* featureMask, const int dimensions[3], const double spacing[3],
+    float* squaredDistances, int numberOfThreads=0);
+
+  /// Compute squared distance of each voxel to the nearest feature voxel on a grid with the voxels at the given
+  /// positions along each axis. Same as \sa ComputeSquaredDistances otherwise.
+  /// \param positions Positions of the voxels along each axis, dimensions[axis] increasing values for each axis
+  static void ComputeSquaredDistancesAtPositions(const unsigned char* featureMask, const int dimensions[3],
+    const double* const positions[3], float* squaredDistances, int numberOfThreads=0);
+
+protected:
+  vtkLabelmapDistanceTransform();
+  virtual ~vtkLabelmapDistanceTransform();
+
+private:
+  vtkLabelmapDistanceTransform(const vtkLabelmapDistanceTransform&); // Not implemented
+  void operator=(const vtkLabelmapDistanceTransform&);               // Not implemented
+};
+
+#endif
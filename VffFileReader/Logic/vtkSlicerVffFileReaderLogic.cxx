@@ -23,6 +23,8 @@
 #include "vtkSlicerVffFileReaderLogic.h"
 
 // VTK includes
+#include <vtkByteSwap.h>
+#include <vtkCommand.h>
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageShiftScale.h>
@@ -45,6 +47,11 @@
 #include <cctype>
 #include <functional>
 
+//----------------------------------------------------------------------------
+// Maximum number of bytes read from the file at once. Large volumes are read in chunks of this size
+// so that progress can be reported and the conversion buffer for non-float data stays small
+static const vtkTypeInt64 VFF_READ_CHUNK_SIZE_BYTES = 16 * 1024 * 1024;
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerVffFileReaderLogic);
 
@@ -287,9 +294,9 @@ void vtkSlicerVffFileReaderLogic::LoadVffFile(char *filename, bool useImageInten
     else
     {
       bits = numberFromParsedStringBits[0];
-      if (bits % 8 != 0)
+      if (bits != 8 && bits != 16 && bits != 32)
       {
-        vtkErrorMacro("LoadVffFile: The value entered for the bits must be divisible by 8.");
+        vtkErrorMacro("LoadVffFile: The value entered for the bits must be 8, 16 (integer voxels), or 32 (floating point voxels).");
         parameterInvalidValue = true;
       }
     }
@@ -497,9 +504,9 @@ void vtkSlicerVffFileReaderLogic::LoadVffFile(char *filename, bool useImageInten
     if (parameterMissing == false && parameterInvalidValue == false)
     {
       // Calculates the number of bytes to read based on some of the specified parameters
-      long bytesToRead = 1;
-      bytesToRead = bands*bits/8;
-      int sizeOfImageData = (int)size[0]*size[1]*size[2]*(bits/8);
+      int bytesPerVoxel = bands*bits/8;
+      vtkTypeInt64 numberOfVoxels = (vtkTypeInt64)size[0] * size[1] * size[2];
+      vtkTypeInt64 sizeOfImageData = numberOfVoxels * bytesPerVoxel;
 
       if (rawsize != sizeOfImageData)
       {
@@ -537,49 +544,60 @@ void vtkSlicerVffFileReaderLogic::LoadVffFile(char *filename, bool useImageInten
       // Reads the line feed that comes directly before the image data from the file
       readFileStream.get();
 
+      // Image data is stored slice by slice (columns varying fastest, then rows, then slices), which is the
+      // same order as in VTK image data, in big endian byte order. The data is read in large chunks directly
+      // into the image buffer (or into a small conversion buffer for integer voxels) and swapped in place.
       float* floatPtr = (float*)floatVffVolumeData->GetScalarPointer();
-      std::stringstream ss;
-
-      // The size of the image data read is specified in the header by the parameter size
-      for (long x = 0; x < size[0]; x++)
+      vtkTypeInt64 voxelsPerChunk = std::max((vtkTypeInt64)1, VFF_READ_CHUNK_SIZE_BYTES / bytesPerVoxel);
+      std::vector<char> conversionBuffer;
+      if (bits != 32)
+      {
+        conversionBuffer.resize((size_t)(std::min(voxelsPerChunk, numberOfVoxels) * bytesPerVoxel));
+      }
+      vtkTypeInt64 numberOfVoxelsRead = 0;
+      while (numberOfVoxelsRead < numberOfVoxels)
       {
-        for (long y = 0; y < size[1]; y++)
+        vtkTypeInt64 voxelsInChunk = std::min(voxelsPerChunk, numberOfVoxels - numberOfVoxelsRead);
+        float* chunkFloatPtr = floatPtr + numberOfVoxelsRead;
+        char* chunkBuffer = (bits == 32 ? (char*)chunkFloatPtr : &(conversionBuffer[0]));
+        readFileStream.read(chunkBuffer, (std::streamsize)(voxelsInChunk * bytesPerVoxel));
+        vtkTypeInt64 voxelsInChunkRead = readFileStream.gcount() / bytesPerVoxel;
+
+        // Convert voxels from big endian to the native type
+        if (bits == 32)
+        {
+          vtkByteSwap::Swap4BERange(chunkFloatPtr, (size_t)voxelsInChunkRead);
+        }
+        else if (bits == 16)
+        {
+          short* shortPtr = (short*)chunkBuffer;
+          vtkByteSwap::Swap2BERange(shortPtr, (size_t)voxelsInChunkRead);
+          for (vtkTypeInt64 i=0; i<voxelsInChunkRead; ++i)
+          {
+            chunkFloatPtr[i] = shortPtr[i];
+          }
+        }
+        else
         {
-          for (long z = 0; z < size[2]; z++)
+          unsigned char* ucharPtr = (unsigned char*)chunkBuffer;
+          for (vtkTypeInt64 i=0; i<voxelsInChunkRead; ++i)
           {
-            if (!readFileStream.eof())
-            {
-              // Reads in the specified number of bytes at a time from the file
-              char *buffer = new char[bytesToRead];
-              char *newBuffer = new char[bytesToRead];
-              readFileStream.read(buffer, bytesToRead);
-
-              // Checks that the correct number of bytes were read from the file
-              if (readFileStream.gcount() == bytesToRead) 
-              { 
-                float *valueFromFile = (float *) newBuffer;
-
-                // Reverses the byte order
-                for (int byte=0; byte<bytesToRead; ++byte)
-                {
-                  newBuffer[byte] = buffer[bytesToRead-byte-1];
-                }
-                (*floatPtr) = (*valueFromFile);
-                ++floatPtr;
-              }
-              else
-              {
-                vtkErrorMacro("LoadVffFile: The end of the file was reached earlier than specified.");
-              }
-            }
-            else
-            {
-              vtkErrorMacro("LoadVffFile: The end of the file was reached earlier than specified.");
-            }
+            chunkFloatPtr[i] = ucharPtr[i];
           }
         }
+        numberOfVoxelsRead += voxelsInChunkRead;
+
+        if (voxelsInChunkRead < voxelsInChunk)
+        {
+          vtkErrorMacro("LoadVffFile: The end of the file was reached earlier than specified.");
+          std::fill(floatPtr + numberOfVoxelsRead, floatPtr + numberOfVoxels, 0.0f);
+          break;
+        }
+
+        double progress = (double)numberOfVoxelsRead / numberOfVoxels;
+        this->InvokeEvent(vtkCommand::ProgressEvent, &progress);
       }
-      
+
       if (readFileStream.get() && !readFileStream.eof())
       {
         vtkWarningMacro("LoadVffFile: The end of the file was not reached.");